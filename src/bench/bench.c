@@ -0,0 +1,1372 @@
+/*
+ * PROJECT:     filecheck Benchmarks
+ * LICENSE:     GPL2
+ * PURPOSE:     Measures throughput, latency and peak memory of the filecheck.h
+ *              engines over deterministic synthetic corpora.
+ * COPYRIGHT:   Copyright 2025 Zafer Balkan
+ */
+
+#include <windows.h>    // WinAPI: CreateFileW, WriteFile, CreateProcessW, QueryPerformanceCounter
+#include <psapi.h>      // GetProcessMemoryInfo
+#include <strsafe.h>    // StringCchPrintfA, StringCchPrintfW
+#include <pathcch.h>    // PathCchCombine
+#include <stdlib.h>     // wcstoul, qsort
+#include <limits.h>     // UINT_MAX, ULLONG_MAX
+#include <wchar.h>      // _wcsicmp, wcsncmp
+#include "../fc/filecheck.h"
+#if defined(__linux__)
+#include <linux/perf_event.h>   // Data-TLB miss counter
+#include <sys/ioctl.h>
+#endif
+
+#pragma comment(lib, "Pathcch.lib")
+#pragma comment(lib, "Psapi.lib")
+
+#define BENCH_FORMAT_VERSION 1
+#define BENCH_DEFAULT_SCALE_MB 8u
+#define BENCH_DEFAULT_ITERATIONS 5u
+#define BENCH_MAX_ITERATIONS 100u
+#define BENCH_SEED 0x9E3779B97F4A7C15ull
+#define BENCH_MAX_PATH 32768
+#ifdef _WIN32
+#define BENCH_PATH_SEPARATOR L'\\'
+#define BENCH_FC_NAME L"fc.exe"
+#else
+#define BENCH_PATH_SEPARATOR L'/'
+#define BENCH_FC_NAME L"fc"
+#endif
+
+/*
+	The benchmark runs in two roles. Without /RUN it generates every corpus into
+	a temporary directory, prints a header record and then starts one child
+	process per measurement, so that each result carries the peak working set of
+	that measurement alone. With /RUN:n the process is such a child: it times
+	run n of g_Runs over the existing corpus and prints one JSON record.
+
+	All output is JSON Lines on standard output; redirect it to a file to keep
+	results across releases.
+*/
+
+/* -------------------- Workload generation -------------------- */
+
+/**
+ * @struct BENCH_BUFFER
+ * @brief Growable byte buffer holding one generated file.
+ */
+typedef struct {
+	BYTE* Data;
+	size_t Size;
+	size_t Capacity;
+} BENCH_BUFFER;
+
+/**
+ * @struct BENCH_TEXT_SHAPE
+ * @brief Parameters of a generated text corpus.
+ *
+ * Lines of A are generated from the seed; B follows A, except that each line
+ * is replaced, preceded by inserted lines, or case-flipped at the given
+ * per-mille rates.
+ */
+typedef struct {
+	UINT MinLineBytes;
+	UINT MaxLineBytes;
+	UINT Vocabulary;        /**< Nonzero draws every line from this many distinct lines. */
+	BOOL Utf8;              /**< Mix multibyte characters and mixed case into the words. */
+	UINT EditPerMille;
+	UINT InsertPerMille;
+	UINT InsertMaxLines;
+	UINT CaseFlipPerMille;
+} BENCH_TEXT_SHAPE;
+
+/**
+ * @struct BENCH_CASE
+ * @brief One corpus: a pair of files written as `<Name>.a` and `<Name>.b`.
+ */
+typedef struct {
+	const char* Name;
+	BOOL Binary;
+	BENCH_TEXT_SHAPE Text;
+} BENCH_CASE;
+
+static const BENCH_CASE g_Cases[] = {
+	{ "identical",        FALSE, { 16,   120,    0, FALSE, 0, 0,   0,  0 } },
+	{ "sparse_edits",     FALSE, { 16,   120,    0, FALSE, 1, 0,   0,  0 } },
+	{ "heavy_inserts",    FALSE, { 16,   120,    0, FALSE, 0, 100, 20, 0 } },
+	{ "repetitive",       FALSE, { 16,   40,     8, FALSE, 1, 1,   3,  0 } },
+	{ "long_lines",       FALSE, { 4096, 65536,  0, FALSE, 5, 0,   0,  0 } },
+	{ "utf8",             FALSE, { 16,   120,    0, TRUE,  1, 0,   0,  50 } },
+	{ "binary_clustered", TRUE,  { 0 } },
+};
+
+/** Engine entry points that are measured. */
+typedef enum {
+	BENCH_ENGINE_COMPARE,   /**< FC_CompareFilesW. */
+	BENCH_ENGINE_SESSION,   /**< FC_SessionCompareFilesW on one reused session. */
+	BENCH_ENGINE_ITERATE,   /**< FC_DiffBegin/FC_DiffNext/FC_DiffEnd. */
+	BENCH_ENGINE_EQUAL      /**< FC_FilesEqualW. */
+} BENCH_ENGINE;
+
+static const char* const g_EngineNames[] = { "compare", "session", "iterate", "equal" };
+
+/**
+ * @struct BENCH_RUN
+ * @brief One measurement: a corpus, an engine, a mode and comparison flags.
+ */
+typedef struct {
+	const char* Case;
+	BENCH_ENGINE Engine;
+	FC_MODE Mode;
+	UINT Flags;
+} BENCH_RUN;
+
+static const BENCH_RUN g_Runs[] = {
+	{ "identical",        BENCH_ENGINE_COMPARE, FC_MODE_TEXT_ASCII,   0 },
+	{ "identical",        BENCH_ENGINE_EQUAL,   FC_MODE_TEXT_ASCII,   0 },
+	{ "identical",        BENCH_ENGINE_COMPARE, FC_MODE_BINARY,       0 },
+	{ "sparse_edits",     BENCH_ENGINE_COMPARE, FC_MODE_TEXT_ASCII,   0 },
+	{ "sparse_edits",     BENCH_ENGINE_SESSION, FC_MODE_TEXT_ASCII,   0 },
+	{ "sparse_edits",     BENCH_ENGINE_ITERATE, FC_MODE_TEXT_ASCII,   0 },
+	{ "sparse_edits",     BENCH_ENGINE_EQUAL,   FC_MODE_TEXT_ASCII,   0 },
+	{ "sparse_edits",     BENCH_ENGINE_COMPARE, FC_MODE_TEXT_ASCII,   FC_IGNORE_WS },
+	{ "sparse_edits",     BENCH_ENGINE_COMPARE, FC_MODE_TEXT_ASCII,   FC_LARGE_PAGES },
+	{ "sparse_edits",     BENCH_ENGINE_SESSION, FC_MODE_TEXT_ASCII,   FC_LARGE_PAGES },
+	{ "heavy_inserts",    BENCH_ENGINE_COMPARE, FC_MODE_TEXT_ASCII,   0 },
+	{ "heavy_inserts",    BENCH_ENGINE_COMPARE, FC_MODE_TEXT_ASCII,   FC_LARGE_PAGES },
+	{ "heavy_inserts",    BENCH_ENGINE_ITERATE, FC_MODE_TEXT_ASCII,   0 },
+	{ "repetitive",       BENCH_ENGINE_COMPARE, FC_MODE_TEXT_ASCII,   0 },
+	{ "long_lines",       BENCH_ENGINE_COMPARE, FC_MODE_TEXT_ASCII,   0 },
+	{ "utf8",             BENCH_ENGINE_COMPARE, FC_MODE_TEXT_UNICODE, 0 },
+	{ "utf8",             BENCH_ENGINE_COMPARE, FC_MODE_TEXT_UNICODE, FC_IGNORE_CASE },
+	{ "binary_clustered", BENCH_ENGINE_COMPARE, FC_MODE_BINARY,       0 },
+	{ "binary_clustered", BENCH_ENGINE_EQUAL,   FC_MODE_BINARY,       0 },
+};
+
+/**
+ * @brief xorshift64* step; the corpora depend only on BENCH_SEED and the scale.
+ */
+static ULONGLONG BenchRandom(_Inout_ ULONGLONG* State)
+{
+	ULONGLONG x = *State;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*State = x;
+	return x * 0x2545F4914F6CDD1Dull;
+}
+
+static UINT BenchRange(_Inout_ ULONGLONG* State, UINT Low, UINT High)
+{
+	return Low + (UINT)(BenchRandom(State) % (ULONGLONG)(High - Low + 1));
+}
+
+static BOOL BenchAppend(_Inout_ BENCH_BUFFER* Buffer, _In_reads_bytes_(Size) const void* Data, size_t Size)
+{
+	if (Buffer->Size + Size > Buffer->Capacity)
+	{
+		size_t NewCapacity = Buffer->Capacity ? Buffer->Capacity * 2 : 1024 * 1024;
+		while (NewCapacity < Buffer->Size + Size)
+			NewCapacity *= 2;
+		BYTE* NewData = Buffer->Data
+			? (BYTE*)HeapReAlloc(GetProcessHeap(), 0, Buffer->Data, NewCapacity)
+			: (BYTE*)HeapAlloc(GetProcessHeap(), 0, NewCapacity);
+		if (!NewData)
+			return FALSE;
+		Buffer->Data = NewData;
+		Buffer->Capacity = NewCapacity;
+	}
+	memcpy(Buffer->Data + Buffer->Size, Data, Size);
+	Buffer->Size += Size;
+	return TRUE;
+}
+
+static void BenchFreeBuffer(_Inout_ BENCH_BUFFER* Buffer)
+{
+	if (Buffer->Data)
+		HeapFree(GetProcessHeap(), 0, Buffer->Data);
+	ZeroMemory(Buffer, sizeof(*Buffer));
+}
+
+/**
+ * @brief Fills Line with one random line of words, without the line break.
+ * @return The number of bytes written; at most Shape->MaxLineBytes + 4.
+ */
+static size_t BenchMakeLine(_Inout_ ULONGLONG* State, _In_ const BENCH_TEXT_SHAPE* Shape, _Out_writes_(Capacity) char* Line, size_t Capacity)
+{
+	// Two- to four-byte UTF-8 sequences: e-acute, Cyrillic zhe, a CJK ideograph, an emoji.
+	static const char* const Multibyte[] = { "\xC3\xA9", "\xD0\xB6", "\xE4\xB8\xAD", "\xF0\x9F\x98\x80" };
+	UINT Target = BenchRange(State, Shape->MinLineBytes, Shape->MaxLineBytes);
+	size_t Length = 0;
+
+	while (Length < Target && Length + 5 < Capacity)
+	{
+		ULONGLONG r = BenchRandom(State);
+		if (Shape->Utf8 && (r & 7) == 0)
+		{
+			const char* Sequence = Multibyte[(r >> 3) & 3];
+			size_t n = strlen(Sequence);
+			memcpy(Line + Length, Sequence, n);
+			Length += n;
+		}
+		else if ((r & 15) == 1 && Length > 0)
+		{
+			Line[Length++] = ' ';
+		}
+		else
+		{
+			char c = (char)('a' + (r >> 8) % 26);
+			if (Shape->Utf8 && ((r >> 16) & 3) == 0)
+				c = (char)(c - 'a' + 'A');
+			Line[Length++] = c;
+		}
+	}
+	return Length;
+}
+
+/**
+ * @brief Swaps the case of the ASCII letters of a line in place.
+ */
+static void BenchFlipCase(_Inout_updates_(Length) char* Line, size_t Length)
+{
+	for (size_t i = 0; i < Length; i++)
+	{
+		if ((Line[i] >= 'a' && Line[i] <= 'z') || (Line[i] >= 'A' && Line[i] <= 'Z'))
+			Line[i] ^= 0x20;
+	}
+}
+
+static BOOL BenchGenerateText(_In_ const BENCH_TEXT_SHAPE* Shape, size_t Bytes, _Out_ BENCH_BUFFER* A, _Out_ BENCH_BUFFER* B)
+{
+	ULONGLONG State = BENCH_SEED;
+	size_t Capacity = (size_t)Shape->MaxLineBytes + 8;
+	char* Line = (char*)HeapAlloc(GetProcessHeap(), 0, Capacity);
+	char* Other = (char*)HeapAlloc(GetProcessHeap(), 0, Capacity);
+	char* Words = NULL;
+	size_t* WordLengths = NULL;
+	BOOL Ok = FALSE;
+
+	ZeroMemory(A, sizeof(*A));
+	ZeroMemory(B, sizeof(*B));
+	if (!Line || !Other)
+		goto cleanup;
+
+	// Repetitive corpora draw whole lines from a small fixed vocabulary.
+	if (Shape->Vocabulary)
+	{
+		Words = (char*)HeapAlloc(GetProcessHeap(), 0, Capacity * Shape->Vocabulary);
+		WordLengths = (size_t*)HeapAlloc(GetProcessHeap(), 0, sizeof(size_t) * Shape->Vocabulary);
+		if (!Words || !WordLengths)
+			goto cleanup;
+		for (UINT i = 0; i < Shape->Vocabulary; i++)
+			WordLengths[i] = BenchMakeLine(&State, Shape, Words + i * Capacity, Capacity);
+	}
+
+	while (A->Size < Bytes)
+	{
+		size_t Length;
+		if (Shape->Vocabulary)
+		{
+			UINT Pick = BenchRange(&State, 0, Shape->Vocabulary - 1);
+			Length = WordLengths[Pick];
+			memcpy(Line, Words + Pick * Capacity, Length);
+		}
+		else
+		{
+			Length = BenchMakeLine(&State, Shape, Line, Capacity);
+		}
+		Line[Length] = '\n';
+
+		if (Shape->InsertPerMille && BenchRange(&State, 1, 1000) <= Shape->InsertPerMille)
+		{
+			UINT Count = BenchRange(&State, 1, Shape->InsertMaxLines);
+			for (UINT i = 0; i < Count; i++)
+			{
+				size_t n = BenchMakeLine(&State, Shape, Other, Capacity);
+				Other[n] = '\n';
+				if (!BenchAppend(B, Other, n + 1))
+					goto cleanup;
+			}
+		}
+
+		if (!BenchAppend(A, Line, Length + 1))
+			goto cleanup;
+
+		if (Shape->EditPerMille && BenchRange(&State, 1, 1000) <= Shape->EditPerMille)
+		{
+			size_t n = BenchMakeLine(&State, Shape, Other, Capacity);
+			Other[n] = '\n';
+			if (!BenchAppend(B, Other, n + 1))
+				goto cleanup;
+			continue;
+		}
+		if (Shape->CaseFlipPerMille && BenchRange(&State, 1, 1000) <= Shape->CaseFlipPerMille)
+			BenchFlipCase(Line, Length);
+		if (!BenchAppend(B, Line, Length + 1))
+			goto cleanup;
+	}
+	Ok = TRUE;
+
+cleanup:
+	if (Line) HeapFree(GetProcessHeap(), 0, Line);
+	if (Other) HeapFree(GetProcessHeap(), 0, Other);
+	if (Words) HeapFree(GetProcessHeap(), 0, Words);
+	if (WordLengths) HeapFree(GetProcessHeap(), 0, WordLengths);
+	if (!Ok)
+	{
+		BenchFreeBuffer(A);
+		BenchFreeBuffer(B);
+	}
+	return Ok;
+}
+
+/**
+ * @brief Random bytes for A; B equals A except for a cluster of 64 bytes to
+ *        4 KB of changed bytes in every megabyte.
+ */
+static BOOL BenchGenerateBinary(size_t Bytes, _Out_ BENCH_BUFFER* A, _Out_ BENCH_BUFFER* B)
+{
+	ULONGLONG State = BENCH_SEED;
+	ZeroMemory(A, sizeof(*A));
+	ZeroMemory(B, sizeof(*B));
+
+	while (A->Size < Bytes)
+	{
+		ULONGLONG Word = BenchRandom(&State);
+		if (!BenchAppend(A, &Word, sizeof(Word)))
+			goto fail;
+	}
+	if (!BenchAppend(B, A->Data, A->Size))
+		goto fail;
+
+	for (size_t Base = 0; Base < B->Size; Base += 1024 * 1024)
+	{
+		size_t Span = B->Size - Base < 1024 * 1024 ? B->Size - Base : 1024 * 1024;
+		UINT Length = BenchRange(&State, 64, 4096);
+		if (Length > Span)
+			Length = (UINT)Span;
+		size_t Start = Base + (size_t)(BenchRandom(&State) % (Span - Length + 1));
+		for (UINT i = 0; i < Length; i++)
+			B->Data[Start + i] ^= (BYTE)(1 + BenchRange(&State, 0, 254));
+	}
+	return TRUE;
+
+fail:
+	BenchFreeBuffer(A);
+	BenchFreeBuffer(B);
+	return FALSE;
+}
+
+static BOOL BenchWriteFile(_In_z_ const WCHAR* Path, _In_ const BENCH_BUFFER* Buffer)
+{
+	HANDLE File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (File == INVALID_HANDLE_VALUE)
+		return FALSE;
+	BOOL Ok = TRUE;
+	size_t Offset = 0;
+	while (Ok && Offset < Buffer->Size)
+	{
+		DWORD Chunk = (DWORD)min(Buffer->Size - Offset, (size_t)(64u * 1024u * 1024u));
+		DWORD Written = 0;
+		Ok = WriteFile(File, Buffer->Data + Offset, Chunk, &Written, NULL) && Written == Chunk;
+		Offset += Chunk;
+	}
+	CloseHandle(File);
+	return Ok;
+}
+
+static BOOL BenchCasePaths(_In_z_ const WCHAR* Directory, _In_z_ const char* Case, _Out_writes_(BENCH_MAX_PATH) WCHAR* PathA, _Out_writes_(BENCH_MAX_PATH) WCHAR* PathB)
+{
+	WCHAR Name[128];
+	if (FAILED(StringCchPrintfW(Name, ARRAYSIZE(Name), L"%hs.a", Case)) ||
+		FAILED(PathCchCombine(PathA, BENCH_MAX_PATH, Directory, Name)) ||
+		FAILED(StringCchPrintfW(Name, ARRAYSIZE(Name), L"%hs.b", Case)) ||
+		FAILED(PathCchCombine(PathB, BENCH_MAX_PATH, Directory, Name)))
+		return FALSE;
+	return TRUE;
+}
+
+/* -------------------- Output -------------------- */
+
+static void BenchPrint(_In_z_ const char* Text)
+{
+	DWORD Written;
+	size_t Length = strlen(Text);
+	WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), Text, (DWORD)Length, &Written, NULL);
+}
+
+static void BenchPrintError(_In_z_ const char* Case, _In_z_ const char* Engine, _In_z_ const char* What, long Code)
+{
+	char Record[512];
+	if (SUCCEEDED(StringCchPrintfA(Record, ARRAYSIZE(Record),
+		"{\"case\":\"%s\",\"engine\":\"%s\",\"error\":\"%s\",\"code\":%ld}\n", Case, Engine, What, Code)))
+		BenchPrint(Record);
+}
+
+/* -------------------- Measurement -------------------- */
+
+/** Counts the reported blocks so the callback has a cost comparable to a real consumer. */
+static void BenchDiffCallback(_In_ const FC_USER_CONTEXT* Context, _In_ const FC_DIFF_BLOCK* Block)
+{
+	(void)Block;
+	(*(ULONGLONG*)Context->UserData)++;
+}
+
+static ULONGLONG BenchNanoseconds(void)
+{
+	static LARGE_INTEGER Frequency;
+	LARGE_INTEGER Now;
+	if (Frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&Now);
+	return (ULONGLONG)((double)Now.QuadPart * 1e9 / (double)Frequency.QuadPart);
+}
+
+static BOOL BenchAddFileSize(_In_z_ const WCHAR* Path, _Inout_ ULONGLONG* Bytes)
+{
+	LARGE_INTEGER Size;
+	HANDLE File = CreateFileW(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (File == INVALID_HANDLE_VALUE)
+		return FALSE;
+	BOOL Ok = GetFileSizeEx(File, &Size);
+	CloseHandle(File);
+	if (Ok)
+		*Bytes += (ULONGLONG)Size.QuadPart;
+	return Ok;
+}
+
+static int BenchCompareDurations(const void* Left, const void* Right)
+{
+	ULONGLONG a = *(const ULONGLONG*)Left, b = *(const ULONGLONG*)Right;
+	return a < b ? -1 : a > b;
+}
+
+/**
+ * @brief Runs one engine once over a file pair.
+ * @return The FC_RESULT of the comparison; Blocks receives the reported block count.
+ */
+static FC_RESULT BenchRunOnce(_In_ const BENCH_RUN* Run, _In_opt_ FC_SESSION* Session, _In_z_ const WCHAR* PathA, _In_z_ const WCHAR* PathB, _Inout_ FC_CONFIG* Config, _Out_ ULONGLONG* Blocks)
+{
+	*Blocks = 0;
+	Config->UserData = Blocks;
+	switch (Run->Engine)
+	{
+	case BENCH_ENGINE_COMPARE:
+		return FC_CompareFilesW(PathA, PathB, Config);
+	case BENCH_ENGINE_SESSION:
+		return FC_SessionCompareFilesW(Session, PathA, PathB, Config);
+	case BENCH_ENGINE_EQUAL:
+		return FC_FilesEqualW(PathA, PathB, Config);
+	case BENCH_ENGINE_ITERATE:
+	{
+		FC_DIFF_ITERATOR* Iterator = NULL;
+		FC_DIFF_BLOCK Block;
+		FC_RESULT Result = FC_DiffBegin(PathA, PathB, Config, &Iterator);
+		if (Result != FC_OK)
+			return Result;
+		while ((Result = FC_DiffNext(Iterator, &Block)) == FC_DIFFERENT)
+			(*Blocks)++;
+		FC_DiffEnd(Iterator);
+		if (Result != FC_OK)
+			return Result;
+		return *Blocks ? FC_DIFFERENT : FC_OK;
+	}
+	}
+	return FC_ERROR_INVALID_PARAM;
+}
+
+/**
+ * @brief Starts counting the data-TLB load misses of this thread, where the system allows it.
+ * @return A counter for `BenchTlbMissesStop`, or -1 (always, outside Linux).
+ */
+static int BenchTlbMissesStart(void)
+{
+#if defined(__linux__)
+	struct perf_event_attr Attr;
+	ZeroMemory(&Attr, sizeof(Attr));
+	Attr.size = sizeof(Attr);
+	Attr.type = PERF_TYPE_HW_CACHE;
+	Attr.config = PERF_COUNT_HW_CACHE_DTLB |
+		((ULONGLONG)PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		((ULONGLONG)PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	Attr.disabled = 1;
+	Attr.exclude_kernel = 1;
+	Attr.exclude_hv = 1;
+	int Counter = (int)syscall(SYS_perf_event_open, &Attr, 0, -1, -1, 0);
+	if (Counter >= 0 && ioctl(Counter, PERF_EVENT_IOC_ENABLE, 0) != 0)
+	{
+		close(Counter);
+		Counter = -1;
+	}
+	return Counter;
+#else
+	return -1;
+#endif
+}
+
+/**
+ * @brief Stops a counter from `BenchTlbMissesStart` and formats its count, or null, as JSON.
+ */
+static void BenchTlbMissesStop(int Counter, _Out_writes_(Capacity) char* Json, size_t Capacity)
+{
+	StringCchCopyA(Json, Capacity, "null");
+#if defined(__linux__)
+	ULONGLONG Misses;
+	if (Counter < 0)
+		return;
+	ioctl(Counter, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(Counter, &Misses, sizeof(Misses)) == (ssize_t)sizeof(Misses))
+		StringCchPrintfA(Json, Capacity, "%llu", Misses);
+	close(Counter);
+#endif
+}
+
+/**
+ * @brief Child role: one warm-up pass, then Iterations timed passes of a run.
+ *
+ * Prints one record with the latency distribution, throughput over the
+ * median, the process peak working set, the data-TLB misses of the timed
+ * passes where the system can count them, and the FC_STATS phase breakdown of
+ * the last pass.
+ */
+static int BenchMeasure(UINT RunIndex, _In_z_ const WCHAR* Directory, UINT Iterations)
+{
+	const BENCH_RUN* Run = &g_Runs[RunIndex];
+	const char* Engine = g_EngineNames[Run->Engine];
+	WCHAR* PathA = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, 2 * BENCH_MAX_PATH * sizeof(WCHAR));
+	WCHAR* PathB = PathA ? PathA + BENCH_MAX_PATH : NULL;
+	ULONGLONG Durations[BENCH_MAX_ITERATIONS];
+	ULONGLONG Blocks = 0;
+	FC_SESSION* Session = NULL;
+	FC_STATS Stats = { 0 };
+	FC_CONFIG Config = { 0 };
+	FC_RESULT Result = FC_OK;
+	ULONGLONG Bytes = 0;
+	PROCESS_MEMORY_COUNTERS Memory = { 0 };
+	char TlbMisses[32];
+	char Record[2048];
+	int Exit = 1;
+
+	if (!PathA || !BenchCasePaths(Directory, Run->Case, PathA, PathB) ||
+		!BenchAddFileSize(PathA, &Bytes) || !BenchAddFileSize(PathB, &Bytes))
+	{
+		BenchPrintError(Run->Case, Engine, "corpus missing", (long)GetLastError());
+		goto cleanup;
+	}
+	if (Run->Engine == BENCH_ENGINE_SESSION && FC_SessionCreate(&Session) != FC_OK)
+	{
+		BenchPrintError(Run->Case, Engine, "session", 0);
+		goto cleanup;
+	}
+
+	Config.Mode = Run->Mode;
+	Config.Flags = Run->Flags;
+	Config.DiffCallback = BenchDiffCallback;
+
+	Result = BenchRunOnce(Run, Session, PathA, PathB, &Config, &Blocks);
+	int TlbCounter = BenchTlbMissesStart();
+	for (UINT i = 0; i < Iterations && (Result == FC_OK || Result == FC_DIFFERENT); i++)
+	{
+		ZeroMemory(&Stats, sizeof(Stats));
+		Config.Stats = &Stats;
+		ULONGLONG Start = BenchNanoseconds();
+		Result = BenchRunOnce(Run, Session, PathA, PathB, &Config, &Blocks);
+		Durations[i] = BenchNanoseconds() - Start;
+	}
+	BenchTlbMissesStop(TlbCounter, TlbMisses, ARRAYSIZE(TlbMisses));
+	if (Result != FC_OK && Result != FC_DIFFERENT)
+	{
+		BenchPrintError(Run->Case, Engine, "comparison failed", (long)Result);
+		goto cleanup;
+	}
+
+	qsort(Durations, Iterations, sizeof(Durations[0]), BenchCompareDurations);
+	GetProcessMemoryInfo(GetCurrentProcess(), &Memory, sizeof(Memory));
+
+	{
+		ULONGLONG Median = Durations[Iterations / 2];
+		double Throughput = Median ? (double)Bytes / (1024.0 * 1024.0) / ((double)Median / 1e9) : 0.0;
+		if (FAILED(StringCchPrintfA(Record, ARRAYSIZE(Record),
+			"{\"case\":\"%s\",\"engine\":\"%s\",\"mode\":\"%s\",\"ignore_case\":%s,\"ignore_ws\":%s,\"large_pages\":%s,"
+			"\"bytes\":%llu,\"iterations\":%u,\"result\":\"%s\",\"blocks\":%llu,"
+			"\"min_ns\":%llu,\"median_ns\":%llu,\"max_ns\":%llu,\"mib_per_s\":%.2f,\"peak_rss_bytes\":%llu,\"dtlb_misses\":%s,"
+			"\"stats\":{\"read_ns\":%llu,\"parse_ns\":%llu,\"hash_ns\":%llu,\"lcs_ns\":%llu,\"binary_ns\":%llu,\"report_ns\":%llu,"
+			"\"bytes_read\":%llu,\"lines_parsed\":%llu,\"chunks\":%llu,\"rewinds\":%llu,\"matches_probed\":%llu,"
+			"\"hash_collisions\":%llu,\"peak_memory_bytes\":%llu,\"large_page_bytes\":%llu}}\n",
+			Run->Case, Engine,
+			Run->Mode == FC_MODE_BINARY ? "binary" : Run->Mode == FC_MODE_TEXT_UNICODE ? "unicode" : "ascii",
+			(Run->Flags & FC_IGNORE_CASE) ? "true" : "false",
+			(Run->Flags & FC_IGNORE_WS) ? "true" : "false",
+			(Run->Flags & FC_LARGE_PAGES) ? "true" : "false",
+			Bytes, Iterations, Result == FC_OK ? "identical" : "different", Blocks,
+			Durations[0], Median, Durations[Iterations - 1], Throughput, (ULONGLONG)Memory.PeakWorkingSetSize, TlbMisses,
+			Stats.ReadNanoseconds, Stats.ParseNanoseconds, Stats.HashNanoseconds, Stats.LcsNanoseconds,
+			Stats.BinaryCompareNanoseconds, Stats.ReportNanoseconds,
+			Stats.BytesRead, Stats.LinesParsed, Stats.ChunksProcessed, Stats.Rewinds, Stats.MatchesProbed,
+			Stats.HashCollisions, Stats.PeakMemoryBytes, Stats.LargePageBytes)))
+			goto cleanup;
+	}
+	BenchPrint(Record);
+	Exit = 0;
+
+cleanup:
+	if (Session)
+		FC_SessionClose(Session);
+	if (PathA)
+		HeapFree(GetProcessHeap(), 0, PathA);
+	return Exit;
+}
+
+/* -------------------- Kernel microbenchmarks -------------------- */
+
+/*
+	With /KERNELS the benchmark times the hot internal routines of filecheck.h in
+	isolation, over a sweep of input sizes, and prints one record per kernel and
+	size. Each measurement repeats the kernel until a batch takes at least
+	BENCH_KERNEL_BATCH_NS, then reports the fastest of BENCH_KERNEL_BATCHES
+	batches as ns/op and, for kernels that consume bytes, ns/byte.
+*/
+
+#define BENCH_KERNEL_BATCH_NS 20000000ull
+#define BENCH_KERNEL_BATCHES 5
+
+/**
+ * @struct BENCH_KERNEL
+ * @brief Input and state of one kernel measurement.
+ */
+typedef struct {
+	const char* Text;           /**< Input bytes, or the first buffer of a pair. */
+	const char* Other;          /**< Second buffer of a pair. */
+	size_t Size;                /**< Bytes per operation, or elements per operation. */
+	UINT Flags;                 /**< FC_* flags passed to the kernel. */
+	const UINT* Hashes;         /**< Hash values for the map kernels. */
+	_FC_HASH_MAP Map;           /**< Map prepared for the find kernel. */
+	_FC_BUFFER Out;             /**< Normalization output. */
+	_FC_BUFFER Scratch;         /**< Normalization scratch space. */
+	ULONGLONG Sink;             /**< Folds results in so they are not optimized away. */
+} BENCH_KERNEL;
+
+typedef void (*BENCH_KERNEL_ROUTINE)(_Inout_ BENCH_KERNEL* Kernel, size_t Repeats);
+
+static void BenchKernelHash(_Inout_ BENCH_KERNEL* Kernel, size_t Repeats)
+{
+	for (size_t r = 0; r < Repeats; r++)
+		Kernel->Sink += _FC_ComputeHash(Kernel->Text, Kernel->Size, Kernel->Flags);
+}
+
+static void BenchKernelParse(_Inout_ BENCH_KERNEL* Kernel, size_t Repeats)
+{
+	FC_CONFIG Config = { 0 };
+	Config.Mode = FC_MODE_TEXT_ASCII;
+	Config.Flags = Kernel->Flags;
+	for (size_t r = 0; r < Repeats; r++)
+	{
+		_FC_BUFFER Lines;
+		_FC_BufferInit(&Lines, sizeof(_FC_LINE));
+		if (_FC_ParseLines(Kernel->Text, Kernel->Size, &Lines, &Config) == FC_OK)
+			Kernel->Sink += Lines.Count;
+		_FC_FreeLineBufferContents(&Lines);
+	}
+}
+
+static void BenchKernelNormalize(_Inout_ BENCH_KERNEL* Kernel, size_t Repeats)
+{
+	for (size_t r = 0; r < Repeats; r++)
+	{
+		if (_FC_NormalizeLine(Kernel->Text, Kernel->Size, Kernel->Flags, &Kernel->Out, &Kernel->Scratch))
+			Kernel->Sink += Kernel->Out.Count;
+	}
+}
+
+static void BenchKernelLower(_Inout_ BENCH_KERNEL* Kernel, size_t Repeats)
+{
+	for (size_t r = 0; r < Repeats; r++)
+	{
+		size_t Length = 0;
+		char* Lower = _FC_StringToLowerUnicode(Kernel->Text, Kernel->Size, &Length);
+		Kernel->Sink += Length;
+		_FC_WorkFree(Lower);
+	}
+}
+
+static void BenchKernelMapInsert(_Inout_ BENCH_KERNEL* Kernel, size_t Repeats)
+{
+	for (size_t r = 0; r < Repeats; r++)
+	{
+		_FC_HASH_MAP Map = { 0 };
+		if (!_FC_HashMapCreate(&Map, Kernel->Size))
+			return;
+		for (size_t i = 0; i < Kernel->Size; i++)
+			Kernel->Sink += (ULONGLONG)(ULONG_PTR)_FC_HashMapInsert(&Map, Kernel->Hashes[i]);
+		_FC_HashMapFree(&Map);
+	}
+}
+
+static void BenchKernelMapFind(_Inout_ BENCH_KERNEL* Kernel, size_t Repeats)
+{
+	for (size_t r = 0; r < Repeats; r++)
+	{
+		for (size_t i = 0; i < Kernel->Size; i++)
+			Kernel->Sink += (ULONGLONG)(ULONG_PTR)_FC_HashMapFind(&Kernel->Map, Kernel->Hashes[i]);
+	}
+}
+
+/** One match per scanned line, a few lines off the diagonal, so chains grow long. */
+static void BenchKernelThreshold(_Inout_ BENCH_KERNEL* Kernel, size_t Repeats)
+{
+	for (size_t r = 0; r < Repeats; r++)
+	{
+		_FC_LCS_CONTEXT Ctx = { 0 };
+		size_t LcsLength = 0;
+		Ctx.Thresholds = (_FC_CHUNK_INDEX*)_FC_WorkAlloc(0, (Kernel->Size + 8) * sizeof(_FC_CHUNK_INDEX));
+		Ctx.Links = (_FC_CHUNK_INDEX*)_FC_WorkAlloc(0, (Kernel->Size + 8) * sizeof(_FC_CHUNK_INDEX));
+		_FC_BufferInit(&Ctx.LinkPool, sizeof(_FC_LCS_LINK));
+		if (Ctx.Thresholds && Ctx.Links)
+		{
+			for (size_t k = 0; k < Kernel->Size + 8; k++)
+			{
+				Ctx.Thresholds[k] = _FC_CHUNK_NONE;
+				Ctx.Links[k] = _FC_CHUNK_NONE;
+			}
+			for (size_t i = 0; i < Kernel->Size; i++)
+			{
+				if (!_FC_LcsAddMatch(&Ctx, (_FC_CHUNK_INDEX)i, (_FC_CHUNK_INDEX)(i + (Kernel->Hashes[i] & 7)), &LcsLength))
+					break;
+			}
+			Kernel->Sink += LcsLength;
+		}
+		_FC_BufferFree(&Ctx.LinkPool);
+		_FC_WorkFree(Ctx.Thresholds);
+		_FC_WorkFree(Ctx.Links);
+	}
+}
+
+static void BenchKernelCompareBytes(_Inout_ BENCH_KERNEL* Kernel, size_t Repeats)
+{
+	FC_CONFIG Config = { 0 };
+	for (size_t r = 0; r < Repeats; r++)
+	{
+		Kernel->Sink += _FC_CompareBytes(NULL, NULL, (const unsigned char*)Kernel->Text,
+			(const unsigned char*)Kernel->Other, Kernel->Size, Kernel->Size, Kernel->Size, &Config);
+	}
+}
+
+static void BenchKernelBuffersEqual(_Inout_ BENCH_KERNEL* Kernel, size_t Repeats)
+{
+	FC_CONFIG Config = { 0 };
+	Config.Mode = FC_MODE_BINARY;
+	for (size_t r = 0; r < Repeats; r++)
+		Kernel->Sink += FC_BuffersEqual(Kernel->Text, Kernel->Size, Kernel->Other, Kernel->Size, &Config);
+}
+
+/**
+ * @brief Times one kernel at one size and prints its record.
+ * @param Bytes Input bytes consumed per operation, or 0 for kernels measured per element.
+ * @param Ops Operations per call of the routine with Repeats 1.
+ */
+static void BenchKernelMeasure(_In_z_ const char* Name, _Inout_ BENCH_KERNEL* Kernel, BENCH_KERNEL_ROUTINE Routine, size_t Bytes, size_t Ops)
+{
+	size_t Repeats = 1;
+	ULONGLONG Best = ULLONG_MAX;
+	char Record[512];
+
+	// Calibrate the batch size, then keep the fastest batch.
+	for (;;)
+	{
+		ULONGLONG Start = BenchNanoseconds();
+		Routine(Kernel, Repeats);
+		ULONGLONG Elapsed = BenchNanoseconds() - Start;
+		if (Elapsed >= BENCH_KERNEL_BATCH_NS || Repeats >= ((size_t)1 << 30))
+			break;
+		Repeats *= Elapsed > 0 && Elapsed < BENCH_KERNEL_BATCH_NS / 8 ? 8 : 2;
+	}
+	for (int b = 0; b < BENCH_KERNEL_BATCHES; b++)
+	{
+		ULONGLONG Start = BenchNanoseconds();
+		Routine(Kernel, Repeats);
+		ULONGLONG Elapsed = BenchNanoseconds() - Start;
+		if (Elapsed < Best)
+			Best = Elapsed;
+	}
+
+	char PerByte[32] = "null";
+	double PerOp = (double)Best / ((double)Repeats * (double)Ops);
+	if (Bytes)
+		StringCchPrintfA(PerByte, ARRAYSIZE(PerByte), "%.4f", (double)Best / ((double)Repeats * (double)Bytes));
+	if (SUCCEEDED(StringCchPrintfA(Record, ARRAYSIZE(Record),
+		"{\"kernel\":\"%s\",\"size\":%llu,\"repeats\":%llu,\"ns_per_op\":%.3f,\"ns_per_byte\":%s}\n",
+		Name, (ULONGLONG)Kernel->Size, (ULONGLONG)Repeats, PerOp, PerByte)))
+		BenchPrint(Record);
+}
+
+/**
+ * @brief Runs every kernel over its size sweep.
+ * @return 0 on success, 1 if the inputs could not be allocated.
+ */
+static int BenchKernels(void)
+{
+	static const size_t LineSizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+	static const size_t BufferSizes[] = { 4096, 65536, 1024 * 1024, 16 * 1024 * 1024 };
+	static const size_t Counts[] = { 1024, 16384, 262144 };
+	const size_t MaxBuffer = 16 * 1024 * 1024;
+	const size_t MaxCount = 262144;
+	ULONGLONG State = BENCH_SEED;
+	BENCH_TEXT_SHAPE Shape = { 16, 120, 0, FALSE, 0, 0, 0, 0 };
+	BENCH_KERNEL Kernel = { 0 };
+	char* Words = (char*)HeapAlloc(GetProcessHeap(), 0, MaxBuffer);
+	char* Tabs = (char*)HeapAlloc(GetProcessHeap(), 0, LineSizes[ARRAYSIZE(LineSizes) - 1]);
+	char* Spaces = (char*)HeapAlloc(GetProcessHeap(), 0, LineSizes[ARRAYSIZE(LineSizes) - 1]);
+	char* Utf8 = (char*)HeapAlloc(GetProcessHeap(), 0, LineSizes[ARRAYSIZE(LineSizes) - 1] + 8);
+	char* Copy = (char*)HeapAlloc(GetProcessHeap(), 0, MaxBuffer);
+	UINT* Hashes = (UINT*)HeapAlloc(GetProcessHeap(), 0, MaxCount * sizeof(UINT));
+	int Exit = 1;
+
+	if (!Words || !Tabs || !Spaces || !Utf8 || !Copy || !Hashes)
+		goto cleanup;
+
+	// Text of short lines for hashing and the newline scan.
+	for (size_t Used = 0; Used < MaxBuffer;)
+	{
+		char Line[256];
+		size_t n = BenchMakeLine(&State, &Shape, Line, sizeof(Line));
+		Line[n++] = '\n';
+		if (n > MaxBuffer - Used)
+			n = MaxBuffer - Used;
+		memcpy(Words + Used, Line, n);
+		Used += n;
+	}
+	memcpy(Copy, Words, MaxBuffer);
+
+	// A tab every eight bytes, and runs of one to four spaces between words.
+	for (size_t i = 0; i < LineSizes[ARRAYSIZE(LineSizes) - 1]; i++)
+	{
+		Tabs[i] = (i % 8 == 5) ? '\t' : (char)('a' + i % 26);
+		Spaces[i] = (BenchRange(&State, 0, 5) < 2) ? ' ' : (char)('a' + i % 26);
+	}
+	Shape.Utf8 = TRUE;
+	Shape.MinLineBytes = Shape.MaxLineBytes = (UINT)LineSizes[ARRAYSIZE(LineSizes) - 1];
+	BenchMakeLine(&State, &Shape, Utf8, LineSizes[ARRAYSIZE(LineSizes) - 1] + 8);
+
+	for (size_t i = 0; i < MaxCount; i++)
+		Hashes[i] = (UINT)BenchRandom(&State);
+
+	_FC_BufferInit(&Kernel.Out, sizeof(char));
+	_FC_BufferInit(&Kernel.Scratch, sizeof(char));
+	Kernel.Hashes = Hashes;
+
+	for (size_t s = 0; s < ARRAYSIZE(LineSizes); s++)
+	{
+		Kernel.Size = LineSizes[s];
+		Kernel.Text = Words;
+		Kernel.Flags = 0;
+		BenchKernelMeasure("compute_hash", &Kernel, BenchKernelHash, Kernel.Size, 1);
+		Kernel.Flags = FC_IGNORE_CASE;
+		BenchKernelMeasure("compute_hash_ignore_case", &Kernel, BenchKernelHash, Kernel.Size, 1);
+		Kernel.Text = Tabs;
+		Kernel.Flags = 0;
+		BenchKernelMeasure("expand_tabs", &Kernel, BenchKernelNormalize, Kernel.Size, 1);
+		Kernel.Text = Spaces;
+		Kernel.Flags = FC_RAW_TABS | FC_IGNORE_WS;
+		BenchKernelMeasure("compress_whitespace", &Kernel, BenchKernelNormalize, Kernel.Size, 1);
+		Kernel.Text = Utf8;
+		// Do not cut a multibyte sequence in half at the end of the sample.
+		while (Kernel.Size > 0 && ((unsigned char)Utf8[Kernel.Size] & 0xC0) == 0x80)
+			Kernel.Size--;
+		BenchKernelMeasure("to_lower_unicode", &Kernel, BenchKernelLower, Kernel.Size, 1);
+	}
+
+	for (size_t s = 0; s < ARRAYSIZE(BufferSizes); s++)
+	{
+		Kernel.Size = BufferSizes[s];
+		Kernel.Text = Words;
+		Kernel.Other = Copy;
+		Kernel.Flags = FC_RAW_TABS;
+		BenchKernelMeasure("parse_lines", &Kernel, BenchKernelParse, Kernel.Size, 1);
+		BenchKernelMeasure("compare_bytes", &Kernel, BenchKernelCompareBytes, Kernel.Size, 1);
+		BenchKernelMeasure("buffers_equal_binary", &Kernel, BenchKernelBuffersEqual, Kernel.Size, 1);
+	}
+
+	for (size_t s = 0; s < ARRAYSIZE(Counts); s++)
+	{
+		Kernel.Size = Counts[s];
+		BenchKernelMeasure("hash_map_insert", &Kernel, BenchKernelMapInsert, 0, Kernel.Size);
+		ZeroMemory(&Kernel.Map, sizeof(Kernel.Map));
+		if (!_FC_HashMapCreate(&Kernel.Map, Kernel.Size))
+			goto cleanup;
+		for (size_t i = 0; i < Kernel.Size; i++)
+			_FC_HashMapInsert(&Kernel.Map, Hashes[i]);
+		BenchKernelMeasure("hash_map_find", &Kernel, BenchKernelMapFind, 0, Kernel.Size);
+		_FC_HashMapFree(&Kernel.Map);
+		ZeroMemory(&Kernel.Map, sizeof(Kernel.Map));
+		BenchKernelMeasure("lcs_threshold", &Kernel, BenchKernelThreshold, 0, Kernel.Size);
+	}
+	Exit = 0;
+
+cleanup:
+	_FC_BufferFree(&Kernel.Out);
+	_FC_BufferFree(&Kernel.Scratch);
+	if (Words) HeapFree(GetProcessHeap(), 0, Words);
+	if (Tabs) HeapFree(GetProcessHeap(), 0, Tabs);
+	if (Spaces) HeapFree(GetProcessHeap(), 0, Spaces);
+	if (Utf8) HeapFree(GetProcessHeap(), 0, Utf8);
+	if (Copy) HeapFree(GetProcessHeap(), 0, Copy);
+	if (Hashes) HeapFree(GetProcessHeap(), 0, Hashes);
+	return Exit;
+}
+
+/* -------------------- Reference tools -------------------- */
+
+/*
+	With /TOOLS the benchmark runs the fc.exe built next to it and the locally
+	installed cmp and diff over the same corpora, one process per pass, and
+	records wall time, CPU time, peak working set and output size of each.
+	Every fc run is then set against each reference run on the same corpus;
+	the comparisons where fc is slower are also listed on standard error.
+	A reference tool that cannot be found on the PATH is reported as skipped.
+*/
+
+/** Command-line tools that are measured. */
+typedef enum {
+	BENCH_TOOL_FC,
+	BENCH_TOOL_DIFF,
+	BENCH_TOOL_CMP,
+	BENCH_TOOL_COUNT
+} BENCH_TOOL;
+
+static const WCHAR* const g_ToolNames[] = { L"fc", L"diff", L"cmp" };
+
+/**
+ * @struct BENCH_TOOL_RUN
+ * @brief One fc invocation and the reference invocations it is measured against.
+ */
+typedef struct {
+	const char* Case;
+	const WCHAR* FcArgs;
+	struct {
+		BENCH_TOOL Tool;
+		const WCHAR* Args;
+	} References[2];
+} BENCH_TOOL_RUN;
+
+static const BENCH_TOOL_RUN g_ToolRuns[] = {
+	{ "identical",        L"",      { { BENCH_TOOL_DIFF, L"" },   { BENCH_TOOL_CMP, L"" } } },
+	{ "identical",        L"/B",    { { BENCH_TOOL_CMP, L"-l" } } },
+	{ "sparse_edits",     L"",      { { BENCH_TOOL_DIFF, L"" },   { BENCH_TOOL_DIFF, L"--minimal" } } },
+	{ "heavy_inserts",    L"",      { { BENCH_TOOL_DIFF, L"" },   { BENCH_TOOL_DIFF, L"--minimal" } } },
+	{ "repetitive",       L"",      { { BENCH_TOOL_DIFF, L"" },   { BENCH_TOOL_DIFF, L"--minimal" } } },
+	{ "long_lines",       L"",      { { BENCH_TOOL_DIFF, L"" },   { BENCH_TOOL_DIFF, L"--minimal" } } },
+	{ "utf8",             L"/U",    { { BENCH_TOOL_DIFF, L"" } } },
+	{ "utf8",             L"/U /C", { { BENCH_TOOL_DIFF, L"-i" } } },
+	{ "binary_clustered", L"/B",    { { BENCH_TOOL_CMP, L"-l" } } },
+};
+
+/**
+ * @struct BENCH_TOOL_RESULT
+ * @brief Measurements of one tool invocation over all passes.
+ */
+typedef struct {
+	ULONGLONG WallNanoseconds;  /**< Median over the passes. */
+	ULONGLONG CpuNanoseconds;   /**< Median user plus kernel time over the passes. */
+	ULONGLONG PeakBytes;        /**< Largest peak working set of any pass; 0 if some pass could not report its own. */
+	ULONGLONG OutputBytes;      /**< Bytes written to standard output by the last pass. */
+	DWORD ExitCode;             /**< Exit code of the last pass. */
+} BENCH_TOOL_RESULT;
+
+static ULONGLONG BenchFiletime(_In_ const FILETIME* Time)
+{
+	return ((ULONGLONG)Time->dwHighDateTime << 32 | Time->dwLowDateTime) * 100ull;
+}
+
+/**
+ * @brief Runs a tool once per pass, plus one warm-up pass, with its standard
+ *        output redirected to OutputPath.
+ * @return FALSE if the process could not be started or exited with a code above 1.
+ */
+static BOOL BenchToolMeasure(_In_z_ const WCHAR* Exe, _In_z_ const WCHAR* Args, _In_z_ const WCHAR* PathA, _In_z_ const WCHAR* PathB,
+	_In_z_ const WCHAR* OutputPath, UINT Iterations, _Out_ BENCH_TOOL_RESULT* Result)
+{
+	size_t Capacity = 3 * BENCH_MAX_PATH + 256;
+	WCHAR* CommandLine = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, Capacity * sizeof(WCHAR));
+	ULONGLONG Wall[BENCH_MAX_ITERATIONS], Cpu[BENCH_MAX_ITERATIONS];
+	SECURITY_ATTRIBUTES Inherit = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+	BOOL PeakUnavailable = FALSE;
+	BOOL Ok = FALSE;
+
+	ZeroMemory(Result, sizeof(*Result));
+	if (!CommandLine)
+		return FALSE;
+
+	for (UINT Pass = 0; Pass <= Iterations; Pass++)
+	{
+		STARTUPINFOW Startup = { 0 };
+		PROCESS_INFORMATION Process = { 0 };
+		PROCESS_MEMORY_COUNTERS Memory = { 0 };
+		FILETIME Created, Exited, Kernel, User;
+		LARGE_INTEGER Size;
+
+		HANDLE Output = CreateFileW(OutputPath, GENERIC_WRITE, FILE_SHARE_READ, &Inherit, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (Output == INVALID_HANDLE_VALUE)
+			goto cleanup;
+		Startup.cb = sizeof(Startup);
+		Startup.dwFlags = STARTF_USESTDHANDLES;
+		Startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+		Startup.hStdOutput = Output;
+		Startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+		// CreateProcessW may modify the command line, so it is rebuilt for every pass.
+		ULONGLONG Start = BenchNanoseconds();
+		if (FAILED(StringCchPrintfW(CommandLine, Capacity, L"\"%ls\" %ls \"%ls\" \"%ls\"", Exe, Args, PathA, PathB)) ||
+			!CreateProcessW(Exe, CommandLine, NULL, NULL, TRUE, 0, NULL, NULL, &Startup, &Process))
+		{
+			CloseHandle(Output);
+			goto cleanup;
+		}
+		WaitForSingleObject(Process.hProcess, INFINITE);
+		ULONGLONG Elapsed = BenchNanoseconds() - Start;
+
+		GetExitCodeProcess(Process.hProcess, &Result->ExitCode);
+		if (GetProcessTimes(Process.hProcess, &Created, &Exited, &Kernel, &User) && Pass > 0)
+			Cpu[Pass - 1] = BenchFiletime(&Kernel) + BenchFiletime(&User);
+		else if (Pass > 0)
+			Cpu[Pass - 1] = 0;
+		if (!GetProcessMemoryInfo(Process.hProcess, &Memory, sizeof(Memory)))
+			PeakUnavailable = TRUE;
+		else if (Memory.PeakWorkingSetSize > Result->PeakBytes)
+			Result->PeakBytes = Memory.PeakWorkingSetSize;
+		CloseHandle(Process.hThread);
+		CloseHandle(Process.hProcess);
+
+		Result->OutputBytes = GetFileSizeEx(Output, &Size) ? (ULONGLONG)Size.QuadPart : 0;
+		CloseHandle(Output);
+		if (Result->ExitCode > 1)
+			goto cleanup;
+		if (Pass > 0)
+			Wall[Pass - 1] = Elapsed;
+	}
+
+	qsort(Wall, Iterations, sizeof(Wall[0]), BenchCompareDurations);
+	qsort(Cpu, Iterations, sizeof(Cpu[0]), BenchCompareDurations);
+	Result->WallNanoseconds = Wall[Iterations / 2];
+	Result->CpuNanoseconds = Cpu[Iterations / 2];
+	if (PeakUnavailable)
+		Result->PeakBytes = 0;
+	Ok = TRUE;
+
+cleanup:
+	HeapFree(GetProcessHeap(), 0, CommandLine);
+	return Ok;
+}
+
+static void BenchPrintToolResult(_In_z_ const char* Case, BENCH_TOOL Tool, _In_z_ const WCHAR* Args, UINT Iterations, _In_ const BENCH_TOOL_RESULT* Result)
+{
+	char Record[1024];
+	char Peak[32] = "null";
+	if (Result->PeakBytes)
+		StringCchPrintfA(Peak, ARRAYSIZE(Peak), "%llu", Result->PeakBytes);
+	if (SUCCEEDED(StringCchPrintfA(Record, ARRAYSIZE(Record),
+		"{\"case\":\"%s\",\"tool\":\"%ls\",\"args\":\"%ls\",\"iterations\":%u,\"exit_code\":%lu,"
+		"\"wall_ns\":%llu,\"cpu_ns\":%llu,\"peak_rss_bytes\":%s,\"output_bytes\":%llu}\n",
+		Case, g_ToolNames[Tool], Args, Iterations, Result->ExitCode,
+		Result->WallNanoseconds, Result->CpuNanoseconds, Peak, Result->OutputBytes)))
+		BenchPrint(Record);
+}
+
+static double BenchRatio(ULONGLONG Numerator, ULONGLONG Denominator)
+{
+	return Denominator ? (double)Numerator / (double)Denominator : 0.0;
+}
+
+/**
+ * @brief Parent role of /TOOLS over corpora already generated in Directory.
+ * @return The number of fc runs that failed; missing reference tools do not count.
+ */
+static int BenchRunTools(_In_z_ const WCHAR* Directory, UINT Iterations, _In_opt_z_ const char* Only)
+{
+	WCHAR* Exes = (WCHAR*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (BENCH_TOOL_COUNT + 3) * BENCH_MAX_PATH * sizeof(WCHAR));
+	WCHAR* PathA = Exes ? Exes + BENCH_TOOL_COUNT * BENCH_MAX_PATH : NULL;
+	WCHAR* PathB = PathA ? PathA + BENCH_MAX_PATH : NULL;
+	WCHAR* OutputPath = PathB ? PathB + BENCH_MAX_PATH : NULL;
+	char Record[1024];
+	int Failures = 0;
+
+	if (!Exes || FAILED(PathCchCombine(OutputPath, BENCH_MAX_PATH, Directory, L"tool.out")))
+		return 1;
+
+	// fc.exe is built next to the benchmark; the references come from the PATH.
+	WCHAR* Slash = GetModuleFileNameW(NULL, Exes, BENCH_MAX_PATH) ? wcsrchr(Exes, BENCH_PATH_SEPARATOR) : NULL;
+	if (Slash == NULL)
+		Exes[0] = L'\0';
+	else if (FAILED(StringCchCopyW(Slash + 1, BENCH_MAX_PATH - (Slash + 1 - Exes), BENCH_FC_NAME)) ||
+		GetFileAttributesW(Exes) == INVALID_FILE_ATTRIBUTES)
+		Exes[0] = L'\0';
+	for (int Tool = BENCH_TOOL_DIFF; Tool < BENCH_TOOL_COUNT; Tool++)
+	{
+		if (!SearchPathW(NULL, g_ToolNames[Tool], L".exe", BENCH_MAX_PATH, Exes + Tool * BENCH_MAX_PATH, NULL))
+			Exes[Tool * BENCH_MAX_PATH] = L'\0';
+	}
+	for (int Tool = BENCH_TOOL_FC; Tool < BENCH_TOOL_COUNT; Tool++)
+	{
+		if (Exes[Tool * BENCH_MAX_PATH] == L'\0' &&
+			SUCCEEDED(StringCchPrintfA(Record, ARRAYSIZE(Record), "{\"tool\":\"%ls\",\"skipped\":\"not found\"}\n", g_ToolNames[Tool])))
+			BenchPrint(Record);
+	}
+	if (Exes[0] == L'\0')
+	{
+		Failures = 1;
+		goto cleanup;
+	}
+
+	for (size_t i = 0; i < ARRAYSIZE(g_ToolRuns); i++)
+	{
+		const BENCH_TOOL_RUN* Run = &g_ToolRuns[i];
+		BENCH_TOOL_RESULT Fc = { 0 };
+		if (Only && strcmp(Only, Run->Case) != 0)
+			continue;
+		if (!BenchCasePaths(Directory, Run->Case, PathA, PathB) ||
+			!BenchToolMeasure(Exes, Run->FcArgs, PathA, PathB, OutputPath, Iterations, &Fc))
+		{
+			BenchPrintError(Run->Case, "fc", "tool failed", (long)Fc.ExitCode);
+			Failures++;
+			continue;
+		}
+		BenchPrintToolResult(Run->Case, BENCH_TOOL_FC, Run->FcArgs, Iterations, &Fc);
+
+		for (size_t r = 0; r < ARRAYSIZE(Run->References) && Run->References[r].Args != NULL; r++)
+		{
+			BENCH_TOOL Tool = Run->References[r].Tool;
+			const WCHAR* Args = Run->References[r].Args;
+			BENCH_TOOL_RESULT Reference;
+			if (Exes[Tool * BENCH_MAX_PATH] == L'\0')
+				continue;
+			if (!BenchToolMeasure(Exes + Tool * BENCH_MAX_PATH, Args, PathA, PathB, OutputPath, Iterations, &Reference))
+			{
+				if (SUCCEEDED(StringCchPrintfA(Record, ARRAYSIZE(Record),
+					"{\"case\":\"%s\",\"tool\":\"%ls\",\"args\":\"%ls\",\"skipped\":\"exit code %lu\"}\n",
+					Run->Case, g_ToolNames[Tool], Args, Reference.ExitCode)))
+					BenchPrint(Record);
+				continue;
+			}
+			BenchPrintToolResult(Run->Case, Tool, Args, Iterations, &Reference);
+
+			double WallRatio = BenchRatio(Fc.WallNanoseconds, Reference.WallNanoseconds);
+			char MemoryRatio[32] = "null";
+			if (Fc.PeakBytes && Reference.PeakBytes)
+				StringCchPrintfA(MemoryRatio, ARRAYSIZE(MemoryRatio), "%.3f", BenchRatio(Fc.PeakBytes, Reference.PeakBytes));
+			const WCHAR* FcSpace = Run->FcArgs[0] ? L" " : L"";
+			const WCHAR* ReferenceSpace = Args[0] ? L" " : L"";
+			if (SUCCEEDED(StringCchPrintfA(Record, ARRAYSIZE(Record),
+				"{\"case\":\"%s\",\"fc_args\":\"%ls\",\"reference\":\"%ls%ls%ls\",\"wall_ratio\":%.3f,\"cpu_ratio\":%.3f,"
+				"\"memory_ratio\":%s,\"output_ratio\":%.3f,\"slower\":%s}\n",
+				Run->Case, Run->FcArgs, g_ToolNames[Tool], ReferenceSpace, Args, WallRatio,
+				BenchRatio(Fc.CpuNanoseconds, Reference.CpuNanoseconds),
+				MemoryRatio,
+				BenchRatio(Fc.OutputBytes, Reference.OutputBytes),
+				WallRatio > 1.0 ? "true" : "false")))
+				BenchPrint(Record);
+			if (WallRatio > 1.0)
+				fwprintf(stderr, L"fc%ls%ls is %.2fx slower than %ls%ls%ls on %hs\n",
+					FcSpace, Run->FcArgs, WallRatio, g_ToolNames[Tool], ReferenceSpace, Args, Run->Case);
+		}
+	}
+
+cleanup:
+	DeleteFileW(OutputPath);
+	HeapFree(GetProcessHeap(), 0, Exes);
+	return Failures;
+}
+
+/* -------------------- Driver -------------------- */
+
+static BOOL BenchGenerateCorpora(_In_z_ const WCHAR* Directory, size_t Bytes, _In_opt_z_ const char* Only)
+{
+	WCHAR* PathA = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, 2 * BENCH_MAX_PATH * sizeof(WCHAR));
+	WCHAR* PathB = PathA ? PathA + BENCH_MAX_PATH : NULL;
+	BOOL Ok = PathA != NULL;
+
+	for (size_t i = 0; Ok && i < ARRAYSIZE(g_Cases); i++)
+	{
+		const BENCH_CASE* Case = &g_Cases[i];
+		BENCH_BUFFER A, B;
+		if (Only && strcmp(Only, Case->Name) != 0)
+			continue;
+		Ok = Case->Binary
+			? BenchGenerateBinary(Bytes, &A, &B)
+			: BenchGenerateText(&Case->Text, Bytes, &A, &B);
+		if (!Ok)
+			break;
+		Ok = BenchCasePaths(Directory, Case->Name, PathA, PathB) &&
+			BenchWriteFile(PathA, &A) && BenchWriteFile(PathB, &B);
+		BenchFreeBuffer(&A);
+		BenchFreeBuffer(&B);
+	}
+	if (PathA)
+		HeapFree(GetProcessHeap(), 0, PathA);
+	return Ok;
+}
+
+static void BenchDeleteCorpora(_In_z_ const WCHAR* Directory)
+{
+	WCHAR* PathA = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, 2 * BENCH_MAX_PATH * sizeof(WCHAR));
+	WCHAR* PathB = PathA ? PathA + BENCH_MAX_PATH : NULL;
+	if (!PathA)
+		return;
+	for (size_t i = 0; i < ARRAYSIZE(g_Cases); i++)
+	{
+		if (BenchCasePaths(Directory, g_Cases[i].Name, PathA, PathB))
+		{
+			DeleteFileW(PathA);
+			DeleteFileW(PathB);
+		}
+	}
+	RemoveDirectoryW(Directory);
+	HeapFree(GetProcessHeap(), 0, PathA);
+}
+
+/**
+ * @brief Parent role: starts a child per selected run and waits for it.
+ * @return The number of runs whose child failed.
+ */
+static int BenchRunAll(_In_z_ const WCHAR* Directory, UINT Iterations, _In_opt_z_ const char* Only)
+{
+	WCHAR* Self = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, BENCH_MAX_PATH * sizeof(WCHAR));
+	WCHAR* CommandLine = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, (2 * BENCH_MAX_PATH + 64) * sizeof(WCHAR));
+	int Failures = 0;
+
+	if (!Self || !CommandLine || !GetModuleFileNameW(NULL, Self, BENCH_MAX_PATH))
+	{
+		Failures = 1;
+		goto cleanup;
+	}
+
+	for (UINT i = 0; i < ARRAYSIZE(g_Runs); i++)
+	{
+		STARTUPINFOW Startup = { 0 };
+		PROCESS_INFORMATION Process = { 0 };
+		DWORD Exit = 1;
+		if (Only && strcmp(Only, g_Runs[i].Case) != 0)
+			continue;
+		Startup.cb = sizeof(Startup);
+		if (FAILED(StringCchPrintfW(CommandLine, 2 * BENCH_MAX_PATH + 64, L"\"%ls\" /RUN:%u /ITER:%u \"/DIR:%ls\"",
+			Self, i, Iterations, Directory)) ||
+			!CreateProcessW(Self, CommandLine, NULL, NULL, TRUE, 0, NULL, NULL, &Startup, &Process))
+		{
+			BenchPrintError(g_Runs[i].Case, g_EngineNames[g_Runs[i].Engine], "process", (long)GetLastError());
+			Failures++;
+			continue;
+		}
+		WaitForSingleObject(Process.hProcess, INFINITE);
+		GetExitCodeProcess(Process.hProcess, &Exit);
+		CloseHandle(Process.hThread);
+		CloseHandle(Process.hProcess);
+		if (Exit != 0)
+			Failures++;
+	}
+
+cleanup:
+	if (Self) HeapFree(GetProcessHeap(), 0, Self);
+	if (CommandLine) HeapFree(GetProcessHeap(), 0, CommandLine);
+	return Failures;
+}
+
+static void BenchUsage(void)
+{
+	fwprintf(stderr,
+		L"Usage: fc.bench [/SCALE:mb] [/ITER:n] [/CASE:name] [/KEEP]\n"
+		L"       fc.bench /KERNELS\n"
+		L"       fc.bench /TOOLS [/SCALE:mb] [/ITER:n] [/CASE:name] [/KEEP]\n"
+		L"  /SCALE:mb   Size of each generated file in MiB (default %u).\n"
+		L"  /ITER:n     Timed passes per measurement, 1 to %u (default %u).\n"
+		L"  /CASE:name  Generate and measure a single corpus.\n"
+		L"  /KEEP       Leave the generated corpora in the temporary directory.\n"
+		L"  /KERNELS    Time the internal kernels over a sweep of input sizes instead.\n"
+		L"  /TOOLS      Time fc.exe against the cmp and diff found on the PATH instead.\n"
+		L"Results are written to standard output as JSON Lines.\n",
+		BENCH_DEFAULT_SCALE_MB, BENCH_MAX_ITERATIONS, BENCH_DEFAULT_ITERATIONS);
+}
+
+// Using wmain to natively support Unicode command-line arguments.
+int wmain(int argc, WCHAR* argv[])
+{
+	UINT Scale = BENCH_DEFAULT_SCALE_MB;
+	UINT Iterations = BENCH_DEFAULT_ITERATIONS;
+	UINT RunIndex = UINT_MAX;
+	BOOL Keep = FALSE;
+	BOOL Kernels = FALSE;
+	BOOL Tools = FALSE;
+	char Only[64] = { 0 };
+	WCHAR Directory[MAX_PATH] = { 0 };
+	char Header[512];
+
+	for (int i = 1; i < argc; i++)
+	{
+		const WCHAR* Arg = argv[i];
+		if (_wcsnicmp(Arg, L"/SCALE:", 7) == 0)
+			Scale = (UINT)wcstoul(Arg + 7, NULL, 10);
+		else if (_wcsnicmp(Arg, L"/ITER:", 6) == 0)
+			Iterations = (UINT)wcstoul(Arg + 6, NULL, 10);
+		else if (_wcsnicmp(Arg, L"/RUN:", 5) == 0)
+			RunIndex = (UINT)wcstoul(Arg + 5, NULL, 10);
+		else if (_wcsnicmp(Arg, L"/DIR:", 5) == 0)
+			StringCchCopyW(Directory, ARRAYSIZE(Directory), Arg + 5);
+		else if (_wcsnicmp(Arg, L"/CASE:", 6) == 0)
+			WideCharToMultiByte(CP_UTF8, 0, Arg + 6, -1, Only, (int)sizeof(Only) - 1, NULL, NULL);
+		else if (_wcsicmp(Arg, L"/KEEP") == 0)
+			Keep = TRUE;
+		else if (_wcsicmp(Arg, L"/KERNELS") == 0)
+			Kernels = TRUE;
+		else if (_wcsicmp(Arg, L"/TOOLS") == 0)
+			Tools = TRUE;
+		else
+		{
+			BenchUsage();
+			return 2;
+		}
+	}
+	if (Scale == 0 || Iterations == 0 || Iterations > BENCH_MAX_ITERATIONS)
+	{
+		BenchUsage();
+		return 2;
+	}
+
+	if (RunIndex != UINT_MAX)
+	{
+		if (RunIndex >= ARRAYSIZE(g_Runs) || Directory[0] == L'\0')
+			return 2;
+		return BenchMeasure(RunIndex, Directory, Iterations);
+	}
+
+	if (Kernels)
+	{
+		if (SUCCEEDED(StringCchPrintfA(Header, ARRAYSIZE(Header),
+			"{\"suite\":\"fc.bench.kernels\",\"format\":%d,\"seed\":\"0x%016llX\",\"pointer_bits\":%u}\n",
+			BENCH_FORMAT_VERSION, BENCH_SEED, (UINT)(sizeof(void*) * 8))))
+			BenchPrint(Header);
+		return BenchKernels();
+	}
+
+	{
+		WCHAR Temp[MAX_PATH];
+		WCHAR Name[64];
+		if (!GetTempPathW(ARRAYSIZE(Temp), Temp) ||
+			FAILED(StringCchPrintfW(Name, ARRAYSIZE(Name), L"fc_bench_%lu", GetCurrentProcessId())) ||
+			FAILED(PathCchCombine(Directory, ARRAYSIZE(Directory), Temp, Name)))
+			return 1;
+	}
+	CreateDirectoryW(Directory, NULL);
+	if (!BenchGenerateCorpora(Directory, (size_t)Scale * 1024 * 1024, Only[0] ? Only : NULL))
+	{
+		BenchPrintError(Only[0] ? Only : "*", "*", "corpus generation", (long)GetLastError());
+		BenchDeleteCorpora(Directory);
+		return 1;
+	}
+
+	if (SUCCEEDED(StringCchPrintfA(Header, ARRAYSIZE(Header),
+		"{\"suite\":\"%s\",\"format\":%d,\"scale_mib\":%u,\"iterations\":%u,\"seed\":\"0x%016llX\",\"pointer_bits\":%u}\n",
+		Tools ? "fc.bench.tools" : "fc.bench", BENCH_FORMAT_VERSION, Scale, Iterations, BENCH_SEED, (UINT)(sizeof(void*) * 8))))
+		BenchPrint(Header);
+
+	int Failures = Tools
+		? BenchRunTools(Directory, Iterations, Only[0] ? Only : NULL)
+		: BenchRunAll(Directory, Iterations, Only[0] ? Only : NULL);
+	if (!Keep)
+		BenchDeleteCorpora(Directory);
+	return Failures ? 1 : 0;
+}
@@ -0,0 +1,1221 @@
+/*
+ * PROJECT:     filecheck POSIX Compatibility Layer
+ * LICENSE:     GPL2
+ * PURPOSE:     Implements the Win32 subset declared in the compat headers
+ *              and the narrow entry point that forwards to wmain.
+ * COPYRIGHT:   Copyright 2025 Zafer Balkan
+ */
+
+#include "windows.h"
+#include "psapi.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <locale.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+/* -------------------- Handles -------------------- */
+
+typedef enum {
+	COMPAT_HANDLE_FILE = 1,
+	COMPAT_HANDLE_FIND,
+	COMPAT_HANDLE_THREAD,
+	COMPAT_HANDLE_PROCESS
+} COMPAT_HANDLE_KIND;
+
+/**
+ * @struct COMPAT_HANDLE
+ * @brief The object behind every HANDLE the layer hands out.
+ */
+typedef struct {
+	COMPAT_HANDLE_KIND Kind;
+	int Fd;                          /**< File descriptor, for files. */
+	BOOL Standard;                   /**< TRUE for the shared standard handles, which are never closed. */
+	DIR* Directory;                  /**< Open directory stream, for finds. */
+	char* DirectoryPath;             /**< Directory being enumerated, for finds. */
+	char* Mask;                      /**< fnmatch pattern, for finds. */
+	pthread_t Thread;                /**< Thread identifier, for threads. */
+	LPTHREAD_START_ROUTINE Routine;  /**< Entry point, for threads. */
+	LPVOID Parameter;                /**< Entry point argument, for threads. */
+	BOOL Joined;                     /**< TRUE once the thread or process has been waited for. */
+	pid_t Pid;                       /**< Process identifier, for processes. */
+	DWORD ExitCode;                  /**< Exit code, once Joined. */
+	struct rusage Usage;             /**< Resource usage of the exited process. */
+	long MaxRssFloor;                /**< Parent's peak resident set at spawn, in KiB, for processes. */
+} COMPAT_HANDLE;
+
+static COMPAT_HANDLE g_StandardHandles[3] = {
+	{ COMPAT_HANDLE_FILE, 0, TRUE },
+	{ COMPAT_HANDLE_FILE, 1, TRUE },
+	{ COMPAT_HANDLE_FILE, 2, TRUE },
+};
+
+static __thread DWORD g_LastError;
+
+DWORD GetLastError(void)
+{
+	return g_LastError;
+}
+
+void SetLastError(DWORD ErrorCode)
+{
+	g_LastError = ErrorCode;
+}
+
+/** Records errno as the closest Win32 error code. */
+static void CompatSetErrno(int Error)
+{
+	switch (Error)
+	{
+	case ENOENT:
+		g_LastError = ERROR_FILE_NOT_FOUND;
+		break;
+	case ENOTDIR:
+		g_LastError = ERROR_PATH_NOT_FOUND;
+		break;
+	case EACCES:
+	case EPERM:
+	case EISDIR:
+		g_LastError = ERROR_ACCESS_DENIED;
+		break;
+	case EEXIST:
+		g_LastError = ERROR_ALREADY_EXISTS;
+		break;
+	case ENOMEM:
+		g_LastError = ERROR_NOT_ENOUGH_MEMORY;
+		break;
+	default:
+		g_LastError = ERROR_INVALID_PARAMETER;
+		break;
+	}
+}
+
+static COMPAT_HANDLE* CompatNewHandle(COMPAT_HANDLE_KIND Kind)
+{
+	COMPAT_HANDLE* Handle = (COMPAT_HANDLE*)calloc(1, sizeof(COMPAT_HANDLE));
+	if (Handle == NULL)
+	{
+		g_LastError = ERROR_NOT_ENOUGH_MEMORY;
+		return NULL;
+	}
+	Handle->Kind = Kind;
+	Handle->Fd = -1;
+	return Handle;
+}
+
+static COMPAT_HANDLE* CompatHandle(HANDLE Handle, COMPAT_HANDLE_KIND Kind)
+{
+	COMPAT_HANDLE* Object = (COMPAT_HANDLE*)Handle;
+	if (Handle == NULL || Handle == INVALID_HANDLE_VALUE || Object->Kind != Kind)
+	{
+		g_LastError = ERROR_INVALID_HANDLE;
+		return NULL;
+	}
+	return Object;
+}
+
+/* -------------------- Text -------------------- */
+
+/**
+ * Decodes one UTF-8 sequence starting at Source[*Index]. Malformed input,
+ * overlong forms, surrogates and values above U+10FFFF consume one byte and
+ * yield FALSE.
+ */
+static BOOL CompatDecodeUtf8(const unsigned char* Source, size_t Length, size_t* Index, DWORD* CodePoint)
+{
+	unsigned char Lead = Source[*Index];
+	size_t Count;
+	DWORD Value;
+
+	if (Lead < 0x80)
+	{
+		*CodePoint = Lead;
+		(*Index)++;
+		return TRUE;
+	}
+	if ((Lead & 0xE0) == 0xC0)
+	{
+		Count = 2;
+		Value = Lead & 0x1F;
+	}
+	else if ((Lead & 0xF0) == 0xE0)
+	{
+		Count = 3;
+		Value = Lead & 0x0F;
+	}
+	else if ((Lead & 0xF8) == 0xF0)
+	{
+		Count = 4;
+		Value = Lead & 0x07;
+	}
+	else
+	{
+		goto invalid;
+	}
+
+	if (Length - *Index < Count)
+		goto invalid;
+	for (size_t i = 1; i < Count; i++)
+	{
+		unsigned char Next = Source[*Index + i];
+		if ((Next & 0xC0) != 0x80)
+			goto invalid;
+		Value = (Value << 6) | (Next & 0x3F);
+	}
+	if ((Count == 2 && Value < 0x80) || (Count == 3 && Value < 0x800) || (Count == 4 && Value < 0x10000) ||
+		Value > 0x10FFFF || (Value >= 0xD800 && Value <= 0xDFFF))
+		goto invalid;
+
+	*Index += Count;
+	*CodePoint = Value;
+	return TRUE;
+
+invalid:
+	(*Index)++;
+	*CodePoint = 0xFFFD;
+	return FALSE;
+}
+
+/* The ANSI code page is taken to be UTF-8, which is what POSIX locales use in practice. */
+int MultiByteToWideChar(UINT CodePage, DWORD Flags, LPCSTR Source, int SourceLength, LPWSTR Destination, int DestinationLength)
+{
+	if (Source == NULL || (CodePage != CP_UTF8 && CodePage != CP_ACP))
+	{
+		g_LastError = ERROR_INVALID_PARAMETER;
+		return 0;
+	}
+
+	const unsigned char* Bytes = (const unsigned char*)Source;
+	size_t Length = (SourceLength < 0) ? strlen(Source) + 1 : (size_t)SourceLength;
+	size_t Index = 0;
+	int Written = 0;
+
+	while (Index < Length)
+	{
+		DWORD CodePoint;
+		if (!CompatDecodeUtf8(Bytes, Length, &Index, &CodePoint) && (Flags & MB_ERR_INVALID_CHARS))
+		{
+			g_LastError = ERROR_NO_UNICODE_TRANSLATION;
+			return 0;
+		}
+		if (DestinationLength > 0)
+		{
+			if (Written >= DestinationLength)
+			{
+				g_LastError = ERROR_INSUFFICIENT_BUFFER;
+				return 0;
+			}
+			Destination[Written] = (WCHAR)CodePoint;
+		}
+		Written++;
+	}
+	return Written;
+}
+
+int WideCharToMultiByte(UINT CodePage, DWORD Flags, LPCWSTR Source, int SourceLength, LPSTR Destination, int DestinationLength, LPCSTR DefaultChar, LPBOOL UsedDefaultChar)
+{
+	(void)DefaultChar;
+	if (Source == NULL || (CodePage != CP_UTF8 && CodePage != CP_ACP))
+	{
+		g_LastError = ERROR_INVALID_PARAMETER;
+		return 0;
+	}
+	if (UsedDefaultChar != NULL)
+		*UsedDefaultChar = FALSE;
+
+	size_t Length = (SourceLength < 0) ? wcslen(Source) + 1 : (size_t)SourceLength;
+	int Written = 0;
+
+	for (size_t i = 0; i < Length; i++)
+	{
+		DWORD Value = (DWORD)Source[i];
+		unsigned char Encoded[4];
+		int Count;
+
+		if (Value > 0x10FFFF || (Value >= 0xD800 && Value <= 0xDFFF))
+		{
+			if (Flags & WC_ERR_INVALID_CHARS)
+			{
+				g_LastError = ERROR_NO_UNICODE_TRANSLATION;
+				return 0;
+			}
+			Value = 0xFFFD;
+		}
+
+		if (Value < 0x80)
+		{
+			Encoded[0] = (unsigned char)Value;
+			Count = 1;
+		}
+		else if (Value < 0x800)
+		{
+			Encoded[0] = (unsigned char)(0xC0 | (Value >> 6));
+			Encoded[1] = (unsigned char)(0x80 | (Value & 0x3F));
+			Count = 2;
+		}
+		else if (Value < 0x10000)
+		{
+			Encoded[0] = (unsigned char)(0xE0 | (Value >> 12));
+			Encoded[1] = (unsigned char)(0x80 | ((Value >> 6) & 0x3F));
+			Encoded[2] = (unsigned char)(0x80 | (Value & 0x3F));
+			Count = 3;
+		}
+		else
+		{
+			Encoded[0] = (unsigned char)(0xF0 | (Value >> 18));
+			Encoded[1] = (unsigned char)(0x80 | ((Value >> 12) & 0x3F));
+			Encoded[2] = (unsigned char)(0x80 | ((Value >> 6) & 0x3F));
+			Encoded[3] = (unsigned char)(0x80 | (Value & 0x3F));
+			Count = 4;
+		}
+
+		if (DestinationLength > 0)
+		{
+			if (Written + Count > DestinationLength)
+			{
+				g_LastError = ERROR_INSUFFICIENT_BUFFER;
+				return 0;
+			}
+			memcpy(Destination + Written, Encoded, (size_t)Count);
+		}
+		Written += Count;
+	}
+	return Written;
+}
+
+/** Converts a wide string to a malloc'd UTF-8 string, or NULL on failure. */
+static char* CompatToUtf8(LPCWSTR String)
+{
+	int Bytes = WideCharToMultiByte(CP_UTF8, 0, String, -1, NULL, 0, NULL, NULL);
+	char* Result = (Bytes > 0) ? (char*)malloc((size_t)Bytes) : NULL;
+	if (Result != NULL && WideCharToMultiByte(CP_UTF8, 0, String, -1, Result, Bytes, NULL, NULL) == 0)
+	{
+		free(Result);
+		Result = NULL;
+	}
+	if (Result == NULL && Bytes > 0)
+		g_LastError = ERROR_NOT_ENOUGH_MEMORY;
+	return Result;
+}
+
+/** Converts a UTF-8 string to a malloc'd wide string, or NULL on failure. */
+static WCHAR* CompatFromUtf8(const char* String)
+{
+	int Chars = MultiByteToWideChar(CP_UTF8, 0, String, -1, NULL, 0);
+	WCHAR* Result = (Chars > 0) ? (WCHAR*)malloc((size_t)Chars * sizeof(WCHAR)) : NULL;
+	if (Result != NULL)
+		MultiByteToWideChar(CP_UTF8, 0, String, -1, Result, Chars);
+	return Result;
+}
+
+/**
+ * Copies a UTF-8 string into a caller buffer with Win32 length semantics:
+ * returns the length without the terminator on success, or the required
+ * size including it when the buffer is too small.
+ */
+static DWORD CompatCopyOut(const char* Value, LPWSTR Buffer, DWORD Size)
+{
+	WCHAR* Wide = CompatFromUtf8(Value);
+	if (Wide == NULL)
+		return 0;
+	size_t Length = wcslen(Wide);
+	DWORD Result;
+	if (Length + 1 > Size)
+	{
+		Result = (DWORD)(Length + 1);
+	}
+	else
+	{
+		wmemcpy(Buffer, Wide, Length + 1);
+		Result = (DWORD)Length;
+	}
+	free(Wide);
+	return Result;
+}
+
+/* -------------------- Files -------------------- */
+
+HANDLE GetStdHandle(DWORD StdHandle)
+{
+	if (StdHandle == STD_INPUT_HANDLE)
+		return &g_StandardHandles[0];
+	if (StdHandle == STD_OUTPUT_HANDLE)
+		return &g_StandardHandles[1];
+	if (StdHandle == STD_ERROR_HANDLE)
+		return &g_StandardHandles[2];
+	return INVALID_HANDLE_VALUE;
+}
+
+HANDLE CreateFileW(LPCWSTR FileName, DWORD DesiredAccess, DWORD ShareMode, LPSECURITY_ATTRIBUTES SecurityAttributes,
+	DWORD CreationDisposition, DWORD FlagsAndAttributes, HANDLE TemplateFile)
+{
+	(void)ShareMode;
+	(void)SecurityAttributes;
+	(void)FlagsAndAttributes;
+	(void)TemplateFile;
+
+	int Flags = O_CLOEXEC;
+	if ((DesiredAccess & GENERIC_READ) && (DesiredAccess & GENERIC_WRITE))
+		Flags |= O_RDWR;
+	else if (DesiredAccess & GENERIC_WRITE)
+		Flags |= O_WRONLY;
+	else
+		Flags |= O_RDONLY;
+	if (CreationDisposition == CREATE_ALWAYS)
+		Flags |= O_CREAT | O_TRUNC;
+	else if (CreationDisposition != OPEN_EXISTING)
+	{
+		g_LastError = ERROR_INVALID_PARAMETER;
+		return INVALID_HANDLE_VALUE;
+	}
+
+	char* Path = CompatToUtf8(FileName);
+	if (Path == NULL)
+		return INVALID_HANDLE_VALUE;
+	int Fd;
+	do
+	{
+		Fd = open(Path, Flags, 0666);
+	} while (Fd < 0 && errno == EINTR);
+	free(Path);
+	if (Fd < 0)
+	{
+		CompatSetErrno(errno);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	// Windows refuses to open a directory as a file without backup semantics.
+	struct stat Status;
+	if (fstat(Fd, &Status) != 0 || S_ISDIR(Status.st_mode))
+	{
+		close(Fd);
+		g_LastError = ERROR_ACCESS_DENIED;
+		return INVALID_HANDLE_VALUE;
+	}
+
+	COMPAT_HANDLE* Handle = CompatNewHandle(COMPAT_HANDLE_FILE);
+	if (Handle == NULL)
+	{
+		close(Fd);
+		return INVALID_HANDLE_VALUE;
+	}
+	Handle->Fd = Fd;
+	return Handle;
+}
+
+BOOL ReadFile(HANDLE File, LPVOID Buffer, DWORD BytesToRead, LPDWORD BytesRead, LPVOID Overlapped)
+{
+	(void)Overlapped;
+	COMPAT_HANDLE* Handle = CompatHandle(File, COMPAT_HANDLE_FILE);
+	if (BytesRead != NULL)
+		*BytesRead = 0;
+	if (Handle == NULL)
+		return FALSE;
+
+	ssize_t Result;
+	do
+	{
+		Result = read(Handle->Fd, Buffer, BytesToRead);
+	} while (Result < 0 && errno == EINTR);
+	if (Result < 0)
+	{
+		CompatSetErrno(errno);
+		return FALSE;
+	}
+	if (BytesRead != NULL)
+		*BytesRead = (DWORD)Result;
+	return TRUE;
+}
+
+BOOL WriteFile(HANDLE File, LPCVOID Buffer, DWORD BytesToWrite, LPDWORD BytesWritten, LPVOID Overlapped)
+{
+	(void)Overlapped;
+	COMPAT_HANDLE* Handle = CompatHandle(File, COMPAT_HANDLE_FILE);
+	if (BytesWritten != NULL)
+		*BytesWritten = 0;
+	if (Handle == NULL)
+		return FALSE;
+
+	ssize_t Result;
+	do
+	{
+		Result = write(Handle->Fd, Buffer, BytesToWrite);
+	} while (Result < 0 && errno == EINTR);
+	if (Result < 0)
+	{
+		CompatSetErrno(errno);
+		return FALSE;
+	}
+	if (BytesWritten != NULL)
+		*BytesWritten = (DWORD)Result;
+	return TRUE;
+}
+
+BOOL GetFileSizeEx(HANDLE File, LARGE_INTEGER* FileSize)
+{
+	COMPAT_HANDLE* Handle = CompatHandle(File, COMPAT_HANDLE_FILE);
+	struct stat Status;
+	if (Handle == NULL)
+		return FALSE;
+	if (fstat(Handle->Fd, &Status) != 0)
+	{
+		CompatSetErrno(errno);
+		return FALSE;
+	}
+	FileSize->QuadPart = (LONGLONG)Status.st_size;
+	return TRUE;
+}
+
+static void CompatFreeFind(COMPAT_HANDLE* Handle)
+{
+	if (Handle->Directory != NULL)
+		closedir(Handle->Directory);
+	free(Handle->DirectoryPath);
+	free(Handle->Mask);
+	free(Handle);
+}
+
+BOOL CloseHandle(HANDLE Object)
+{
+	COMPAT_HANDLE* Handle = (COMPAT_HANDLE*)Object;
+	if (Object == NULL || Object == INVALID_HANDLE_VALUE)
+	{
+		g_LastError = ERROR_INVALID_HANDLE;
+		return FALSE;
+	}
+	if (Handle->Standard)
+		return TRUE;
+
+	BOOL Result = TRUE;
+	switch (Handle->Kind)
+	{
+	case COMPAT_HANDLE_FILE:
+		if (close(Handle->Fd) != 0)
+		{
+			CompatSetErrno(errno);
+			Result = FALSE;
+		}
+		break;
+	case COMPAT_HANDLE_FIND:
+		CompatFreeFind(Handle);
+		return TRUE;
+	case COMPAT_HANDLE_THREAD:
+	case COMPAT_HANDLE_PROCESS:
+		// The handle owns the thread's result and the child's exit status, so
+		// it is waited for rather than detached.
+		if (!Handle->Joined)
+			WaitForSingleObject(Object, INFINITE);
+		break;
+	}
+	free(Handle);
+	return Result;
+}
+
+static DWORD CompatAttributes(const struct stat* Status, BOOL Link)
+{
+	DWORD Attributes = S_ISDIR(Status->st_mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+	if (Link)
+		Attributes |= FILE_ATTRIBUTE_REPARSE_POINT;
+	return Attributes;
+}
+
+DWORD GetFileAttributesW(LPCWSTR FileName)
+{
+	char* Path = CompatToUtf8(FileName);
+	struct stat Status;
+	if (Path == NULL)
+		return INVALID_FILE_ATTRIBUTES;
+	int Result = lstat(Path, &Status);
+	BOOL Link = (Result == 0 && S_ISLNK(Status.st_mode));
+	if (Link)
+		Result = stat(Path, &Status);
+	free(Path);
+	if (Result != 0)
+	{
+		CompatSetErrno(errno);
+		return INVALID_FILE_ATTRIBUTES;
+	}
+	return CompatAttributes(&Status, Link);
+}
+
+BOOL CreateDirectoryW(LPCWSTR PathName, LPSECURITY_ATTRIBUTES SecurityAttributes)
+{
+	(void)SecurityAttributes;
+	char* Path = CompatToUtf8(PathName);
+	if (Path == NULL)
+		return FALSE;
+	int Result = mkdir(Path, 0777);
+	free(Path);
+	if (Result != 0)
+	{
+		CompatSetErrno(errno);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL RemoveDirectoryW(LPCWSTR PathName)
+{
+	char* Path = CompatToUtf8(PathName);
+	if (Path == NULL)
+		return FALSE;
+	int Result = rmdir(Path);
+	free(Path);
+	if (Result != 0)
+	{
+		CompatSetErrno(errno);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL DeleteFileW(LPCWSTR FileName)
+{
+	char* Path = CompatToUtf8(FileName);
+	if (Path == NULL)
+		return FALSE;
+	int Result = unlink(Path);
+	free(Path);
+	if (Result != 0)
+	{
+		CompatSetErrno(errno);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void CompatToFiletime(const struct timespec* Time, FILETIME* FileTime)
+{
+	ULONGLONG Value = ((ULONGLONG)Time->tv_sec + 11644473600ull) * 10000000ull + (ULONGLONG)Time->tv_nsec / 100;
+	FileTime->dwLowDateTime = (DWORD)Value;
+	FileTime->dwHighDateTime = (DWORD)(Value >> 32);
+}
+
+/** Returns the next directory entry matching the find's mask, filling FindData. */
+static BOOL CompatFindNext(COMPAT_HANDLE* Handle, LPWIN32_FIND_DATAW FindData)
+{
+	struct dirent* Entry;
+	while ((Entry = readdir(Handle->Directory)) != NULL)
+	{
+		if (fnmatch(Handle->Mask, Entry->d_name, 0) != 0)
+			continue;
+
+		size_t Length = strlen(Handle->DirectoryPath) + strlen(Entry->d_name) + 2;
+		char* Full = (char*)malloc(Length);
+		struct stat Status;
+		BOOL Link = FALSE;
+		int Result = -1;
+		if (Full != NULL)
+		{
+			snprintf(Full, Length, "%s/%s", Handle->DirectoryPath, Entry->d_name);
+			Result = lstat(Full, &Status);
+			Link = (Result == 0 && S_ISLNK(Status.st_mode));
+			// A dangling link is reported as an empty file.
+			if (Link && stat(Full, &Status) != 0)
+			{
+				Status.st_mode = S_IFREG;
+				Status.st_size = 0;
+			}
+			free(Full);
+		}
+
+		memset(FindData, 0, sizeof(*FindData));
+		if (Result == 0)
+		{
+			FindData->dwFileAttributes = CompatAttributes(&Status, Link);
+			FindData->nFileSizeHigh = (DWORD)((ULONGLONG)Status.st_size >> 32);
+			FindData->nFileSizeLow = (DWORD)Status.st_size;
+			CompatToFiletime(&Status.st_mtim, &FindData->ftLastWriteTime);
+		}
+		if (MultiByteToWideChar(CP_UTF8, 0, Entry->d_name, -1, FindData->cFileName, MAX_PATH) == 0)
+			continue;
+		return TRUE;
+	}
+	g_LastError = ERROR_NO_MORE_FILES;
+	return FALSE;
+}
+
+HANDLE FindFirstFileW(LPCWSTR FileName, LPWIN32_FIND_DATAW FindData)
+{
+	char* Pattern = CompatToUtf8(FileName);
+	COMPAT_HANDLE* Handle = CompatNewHandle(COMPAT_HANDLE_FIND);
+	if (Pattern == NULL || Handle == NULL)
+		goto failure;
+
+	char* Slash = strrchr(Pattern, '/');
+	const char* Mask = Slash ? Slash + 1 : Pattern;
+	if (Slash != NULL)
+		*Slash = '\0';
+	Handle->DirectoryPath = strdup(Slash == NULL ? "." : (Pattern[0] != '\0' ? Pattern : "/"));
+	// "*.*" matches every name on Windows, including names without a dot.
+	Handle->Mask = strdup(strcmp(Mask, "*.*") == 0 ? "*" : Mask);
+	if (Handle->DirectoryPath == NULL || Handle->Mask == NULL)
+		goto failure;
+
+	Handle->Directory = opendir(Handle->DirectoryPath);
+	if (Handle->Directory == NULL)
+	{
+		CompatSetErrno(errno);
+		goto failure;
+	}
+	if (!CompatFindNext(Handle, FindData))
+	{
+		g_LastError = ERROR_FILE_NOT_FOUND;
+		goto failure;
+	}
+	free(Pattern);
+	return Handle;
+
+failure:
+	free(Pattern);
+	if (Handle != NULL)
+		CompatFreeFind(Handle);
+	return INVALID_HANDLE_VALUE;
+}
+
+BOOL FindNextFileW(HANDLE FindFile, LPWIN32_FIND_DATAW FindData)
+{
+	COMPAT_HANDLE* Handle = CompatHandle(FindFile, COMPAT_HANDLE_FIND);
+	return Handle != NULL && CompatFindNext(Handle, FindData);
+}
+
+BOOL FindClose(HANDLE FindFile)
+{
+	return CompatHandle(FindFile, COMPAT_HANDLE_FIND) != NULL && CloseHandle(FindFile);
+}
+
+DWORD GetTempPathW(DWORD BufferLength, LPWSTR Buffer)
+{
+	const char* Directory = getenv("TMPDIR");
+	char Path[4096];
+	if (Directory == NULL || Directory[0] == '\0')
+		Directory = "/tmp";
+	size_t Length = strlen(Directory);
+	if (Length + 2 > sizeof(Path))
+	{
+		g_LastError = ERROR_INSUFFICIENT_BUFFER;
+		return 0;
+	}
+	memcpy(Path, Directory, Length + 1);
+	if (Path[Length - 1] != '/')
+		memcpy(Path + Length, "/", 2);
+	return CompatCopyOut(Path, Buffer, BufferLength);
+}
+
+DWORD GetCurrentDirectoryW(DWORD BufferLength, LPWSTR Buffer)
+{
+	char Path[4096];
+	if (getcwd(Path, sizeof(Path)) == NULL)
+	{
+		CompatSetErrno(errno);
+		return 0;
+	}
+	return CompatCopyOut(Path, Buffer, BufferLength);
+}
+
+/* -------------------- Synchronization -------------------- */
+
+BOOL SleepConditionVariableSRW(PCONDITION_VARIABLE Condition, PSRWLOCK Lock, DWORD Milliseconds, ULONG Flags)
+{
+	(void)Flags;
+	if (Milliseconds == INFINITE)
+		return pthread_cond_wait(&Condition->Condition, &Lock->Mutex) == 0;
+
+	struct timespec Deadline;
+	clock_gettime(CLOCK_REALTIME, &Deadline);
+	Deadline.tv_sec += Milliseconds / 1000;
+	Deadline.tv_nsec += (long)(Milliseconds % 1000) * 1000000L;
+	if (Deadline.tv_nsec >= 1000000000L)
+	{
+		Deadline.tv_sec++;
+		Deadline.tv_nsec -= 1000000000L;
+	}
+	return pthread_cond_timedwait(&Condition->Condition, &Lock->Mutex, &Deadline) == 0;
+}
+
+/* -------------------- Processes and threads -------------------- */
+
+static void* CompatThreadMain(void* Parameter)
+{
+	COMPAT_HANDLE* Handle = (COMPAT_HANDLE*)Parameter;
+	Handle->ExitCode = Handle->Routine(Handle->Parameter);
+	return NULL;
+}
+
+HANDLE CreateThread(LPSECURITY_ATTRIBUTES SecurityAttributes, SIZE_T StackSize, LPTHREAD_START_ROUTINE StartAddress,
+	LPVOID Parameter, DWORD CreationFlags, LPDWORD ThreadId)
+{
+	(void)SecurityAttributes;
+	(void)StackSize;
+	(void)CreationFlags;
+	COMPAT_HANDLE* Handle = CompatNewHandle(COMPAT_HANDLE_THREAD);
+	if (Handle == NULL)
+		return NULL;
+	Handle->Routine = StartAddress;
+	Handle->Parameter = Parameter;
+	if (pthread_create(&Handle->Thread, NULL, CompatThreadMain, Handle) != 0)
+	{
+		free(Handle);
+		g_LastError = ERROR_NOT_ENOUGH_MEMORY;
+		return NULL;
+	}
+	if (ThreadId != NULL)
+		*ThreadId = 0;
+	return Handle;
+}
+
+/**
+ * Splits a command line into arguments with the rules the Microsoft C
+ * runtime uses: whitespace separates arguments outside double quotes, and
+ * 2n backslashes before a quote become n backslashes with the quote toggling
+ * quoting, while 2n+1 backslashes produce n backslashes and a literal quote.
+ */
+static char** CompatSplitCommandLine(const char* Line)
+{
+	size_t Capacity = strlen(Line) + 1;
+	char** Argv = (char**)calloc(Capacity / 2 + 2, sizeof(char*));
+	char* Storage = (char*)malloc(Capacity + 1);
+	size_t Count = 0;
+	size_t Out = 0;
+	const char* p = Line;
+
+	if (Argv == NULL || Storage == NULL)
+	{
+		free(Argv);
+		free(Storage);
+		return NULL;
+	}
+	// Argv[0] owns the storage, so freeing it releases every argument.
+	while (*p != '\0')
+	{
+		BOOL Quoted = FALSE;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '\0')
+			break;
+
+		Argv[Count++] = Storage + Out;
+		while (*p != '\0' && (Quoted || (*p != ' ' && *p != '\t')))
+		{
+			size_t Backslashes = 0;
+			while (*p == '\\')
+			{
+				Backslashes++;
+				p++;
+			}
+			if (*p == '"')
+			{
+				for (size_t i = 0; i < Backslashes / 2; i++)
+					Storage[Out++] = '\\';
+				if (Backslashes % 2)
+					Storage[Out++] = '"';
+				else
+					Quoted = !Quoted;
+				p++;
+			}
+			else
+			{
+				for (size_t i = 0; i < Backslashes; i++)
+					Storage[Out++] = '\\';
+				if (*p != '\0' && (Quoted || (*p != ' ' && *p != '\t')))
+					Storage[Out++] = *p++;
+			}
+		}
+		Storage[Out++] = '\0';
+	}
+	if (Count == 0)
+	{
+		Argv[0] = Storage;
+		Storage[0] = '\0';
+	}
+	return Argv;
+}
+
+/**
+ * Peak resident set of the current process in KiB. On Linux this is VmHWM, the
+ * peak of the address space alone; ru_maxrss also holds the peak inherited
+ * through exec from the parent.
+ */
+static long CompatPeakRss(void)
+{
+#ifdef __linux__
+	FILE* Status = fopen("/proc/self/status", "r");
+	if (Status != NULL)
+	{
+		char Line[256];
+		long Peak = -1;
+		while (Peak < 0 && fgets(Line, sizeof(Line), Status) != NULL)
+		{
+			if (sscanf(Line, "VmHWM: %ld kB", &Peak) != 1)
+				Peak = -1;
+		}
+		fclose(Status);
+		if (Peak >= 0)
+			return Peak;
+	}
+#endif
+	struct rusage Usage;
+	return getrusage(RUSAGE_SELF, &Usage) == 0 ? Usage.ru_maxrss : 0;
+}
+
+BOOL CreateProcessW(LPCWSTR ApplicationName, LPWSTR CommandLine, LPSECURITY_ATTRIBUTES ProcessAttributes,
+	LPSECURITY_ATTRIBUTES ThreadAttributes, BOOL InheritHandles, DWORD CreationFlags, LPVOID Environment,
+	LPCWSTR CurrentDirectory, LPSTARTUPINFOW StartupInfo, LPPROCESS_INFORMATION ProcessInformation)
+{
+	(void)ProcessAttributes;
+	(void)ThreadAttributes;
+	(void)InheritHandles;
+	(void)CreationFlags;
+	(void)Environment;
+
+	if (CurrentDirectory != NULL || CommandLine == NULL)
+	{
+		g_LastError = ERROR_INVALID_PARAMETER;
+		return FALSE;
+	}
+
+	char* Line = CompatToUtf8(CommandLine);
+	char** Argv = Line ? CompatSplitCommandLine(Line) : NULL;
+	char* Program = ApplicationName ? CompatToUtf8(ApplicationName) : (Argv ? strdup(Argv[0]) : NULL);
+	COMPAT_HANDLE* Handle = CompatNewHandle(COMPAT_HANDLE_PROCESS);
+	posix_spawn_file_actions_t Actions;
+	BOOL Result = FALSE;
+
+	if (Argv == NULL || Program == NULL || Handle == NULL || posix_spawn_file_actions_init(&Actions) != 0)
+	{
+		g_LastError = ERROR_NOT_ENOUGH_MEMORY;
+		goto cleanup;
+	}
+
+	if (StartupInfo != NULL && (StartupInfo->dwFlags & STARTF_USESTDHANDLES))
+	{
+		HANDLE Standard[3] = { StartupInfo->hStdInput, StartupInfo->hStdOutput, StartupInfo->hStdError };
+		for (int i = 0; i < 3; i++)
+		{
+			COMPAT_HANDLE* Redirect = (Standard[i] != NULL && Standard[i] != INVALID_HANDLE_VALUE) ? (COMPAT_HANDLE*)Standard[i] : NULL;
+			if (Redirect != NULL && Redirect->Kind == COMPAT_HANDLE_FILE && Redirect->Fd != i)
+				posix_spawn_file_actions_adddup2(&Actions, Redirect->Fd, i);
+		}
+	}
+
+	// The child execs out of this process's address space, and exec carries that
+	// address space's peak into the child's ru_maxrss.
+	Handle->MaxRssFloor = CompatPeakRss();
+	int Error = posix_spawn(&Handle->Pid, Program, &Actions, NULL, Argv, environ);
+	posix_spawn_file_actions_destroy(&Actions);
+	if (Error != 0)
+	{
+		CompatSetErrno(Error);
+		goto cleanup;
+	}
+
+	ProcessInformation->hProcess = Handle;
+	ProcessInformation->hThread = NULL;
+	ProcessInformation->dwProcessId = (DWORD)Handle->Pid;
+	ProcessInformation->dwThreadId = 0;
+	Handle = NULL;
+	Result = TRUE;
+
+cleanup:
+	free(Handle);
+	free(Program);
+	if (Argv != NULL)
+		free(Argv[0]);
+	free(Argv);
+	free(Line);
+	return Result;
+}
+
+DWORD WaitForSingleObject(HANDLE Handle, DWORD Milliseconds)
+{
+	COMPAT_HANDLE* Object = (COMPAT_HANDLE*)Handle;
+	if (Milliseconds != INFINITE || Handle == NULL || Handle == INVALID_HANDLE_VALUE)
+	{
+		g_LastError = ERROR_INVALID_PARAMETER;
+		return WAIT_FAILED;
+	}
+	if (Object->Joined)
+		return WAIT_OBJECT_0;
+
+	if (Object->Kind == COMPAT_HANDLE_THREAD)
+	{
+		if (pthread_join(Object->Thread, NULL) != 0)
+			return WAIT_FAILED;
+	}
+	else if (Object->Kind == COMPAT_HANDLE_PROCESS)
+	{
+		int Status = 0;
+		pid_t Result;
+		do
+		{
+			Result = wait4(Object->Pid, &Status, 0, &Object->Usage);
+		} while (Result < 0 && errno == EINTR);
+		if (Result < 0)
+		{
+			CompatSetErrno(errno);
+			return WAIT_FAILED;
+		}
+		// A child killed by a signal reports a nonzero code, as an unhandled exception would.
+		Object->ExitCode = WIFEXITED(Status) ? (DWORD)WEXITSTATUS(Status) : (DWORD)(128 + WTERMSIG(Status));
+	}
+	else
+	{
+		g_LastError = ERROR_INVALID_HANDLE;
+		return WAIT_FAILED;
+	}
+	Object->Joined = TRUE;
+	return WAIT_OBJECT_0;
+}
+
+DWORD WaitForMultipleObjects(DWORD Count, const HANDLE* Handles, BOOL WaitAll, DWORD Milliseconds)
+{
+	if (!WaitAll)
+	{
+		g_LastError = ERROR_INVALID_PARAMETER;
+		return WAIT_FAILED;
+	}
+	for (DWORD i = 0; i < Count; i++)
+	{
+		if (WaitForSingleObject(Handles[i], Milliseconds) == WAIT_FAILED)
+			return WAIT_FAILED;
+	}
+	return WAIT_OBJECT_0;
+}
+
+BOOL GetExitCodeProcess(HANDLE Process, LPDWORD ExitCode)
+{
+	COMPAT_HANDLE* Handle = CompatHandle(Process, COMPAT_HANDLE_PROCESS);
+	if (Handle == NULL || WaitForSingleObject(Process, INFINITE) == WAIT_FAILED)
+		return FALSE;
+	*ExitCode = Handle->ExitCode;
+	return TRUE;
+}
+
+static void CompatTimevalToFiletime(const struct timeval* Time, FILETIME* FileTime)
+{
+	ULONGLONG Value = ((ULONGLONG)Time->tv_sec * 1000000ull + (ULONGLONG)Time->tv_usec) * 10ull;
+	FileTime->dwLowDateTime = (DWORD)Value;
+	FileTime->dwHighDateTime = (DWORD)(Value >> 32);
+}
+
+/** Resource usage of the current process or of an exited child. */
+static BOOL CompatUsage(HANDLE Process, struct rusage* Usage)
+{
+	if (Process == GetCurrentProcess())
+		return getrusage(RUSAGE_SELF, Usage) == 0;
+
+	COMPAT_HANDLE* Handle = CompatHandle(Process, COMPAT_HANDLE_PROCESS);
+	if (Handle == NULL || !Handle->Joined)
+		return FALSE;
+	*Usage = Handle->Usage;
+	return TRUE;
+}
+
+BOOL GetProcessTimes(HANDLE Process, FILETIME* CreationTime, FILETIME* ExitTime, FILETIME* KernelTime, FILETIME* UserTime)
+{
+	struct rusage Usage;
+	if (!CompatUsage(Process, &Usage))
+		return FALSE;
+	memset(CreationTime, 0, sizeof(*CreationTime));
+	memset(ExitTime, 0, sizeof(*ExitTime));
+	CompatTimevalToFiletime(&Usage.ru_stime, KernelTime);
+	CompatTimevalToFiletime(&Usage.ru_utime, UserTime);
+	return TRUE;
+}
+
+BOOL GetProcessMemoryInfo(HANDLE Process, PPROCESS_MEMORY_COUNTERS Counters, DWORD Size)
+{
+	struct rusage Usage;
+	if (Size < sizeof(*Counters) || !CompatUsage(Process, &Usage))
+		return FALSE;
+
+	long Peak = Usage.ru_maxrss;
+	if (Process == GetCurrentProcess())
+	{
+		Peak = CompatPeakRss();
+	}
+	else if (Peak <= ((COMPAT_HANDLE*)Process)->MaxRssFloor)
+	{
+		// The child's own peak is hidden under the one it inherited at exec.
+		g_LastError = ERROR_NOT_SUPPORTED;
+		return FALSE;
+	}
+	memset(Counters, 0, sizeof(*Counters));
+	Counters->cb = (DWORD)sizeof(*Counters);
+	Counters->PageFaultCount = (DWORD)(Usage.ru_minflt + Usage.ru_majflt);
+	Counters->PeakWorkingSetSize = (SIZE_T)Peak * 1024;
+	return TRUE;
+}
+
+HANDLE GetCurrentProcess(void)
+{
+	return (HANDLE)(intptr_t)-1;
+}
+
+DWORD GetCurrentProcessId(void)
+{
+	return (DWORD)getpid();
+}
+
+void ExitProcess(UINT ExitCode)
+{
+	exit((int)ExitCode);
+}
+
+DWORD GetModuleFileNameW(HMODULE Module, LPWSTR FileName, DWORD Size)
+{
+	char Path[4096];
+	if (Module != NULL)
+	{
+		g_LastError = ERROR_INVALID_PARAMETER;
+		return 0;
+	}
+	ssize_t Length = readlink("/proc/self/exe", Path, sizeof(Path) - 1);
+	if (Length < 0)
+	{
+		CompatSetErrno(errno);
+		return 0;
+	}
+	Path[Length] = '\0';
+
+	// Unlike the other queries, a short buffer is a failure rather than a size hint.
+	DWORD Result = CompatCopyOut(Path, FileName, Size);
+	if (Result >= Size)
+	{
+		g_LastError = ERROR_INSUFFICIENT_BUFFER;
+		return 0;
+	}
+	return Result;
+}
+
+/* Executables carry no extension on POSIX, so the bare name is tried after FileName plus Extension. */
+DWORD SearchPathW(LPCWSTR Path, LPCWSTR FileName, LPCWSTR Extension, DWORD BufferLength, LPWSTR Buffer, LPWSTR* FilePart)
+{
+	const char* Search = getenv("PATH");
+	char* Name = CompatToUtf8(FileName);
+	char* Suffix = Extension ? CompatToUtf8(Extension) : NULL;
+	char* Directories = strdup(Path == NULL && Search != NULL ? Search : "");
+	char* Context = NULL;
+	char Candidate[4096];
+	DWORD Result = 0;
+
+	if (Path != NULL || Name == NULL || Directories == NULL)
+	{
+		g_LastError = ERROR_INVALID_PARAMETER;
+		goto cleanup;
+	}
+	g_LastError = ERROR_FILE_NOT_FOUND;
+	for (char* Directory = strtok_r(Directories, ":", &Context); Directory != NULL && Result == 0;
+		Directory = strtok_r(NULL, ":", &Context))
+	{
+		for (int Pass = (Suffix != NULL) ? 0 : 1; Pass < 2; Pass++)
+		{
+			int Length = snprintf(Candidate, sizeof(Candidate), "%s/%s%s", Directory, Name, Pass == 0 ? Suffix : "");
+			if (Length > 0 && (size_t)Length < sizeof(Candidate) && access(Candidate, X_OK) == 0)
+			{
+				Result = CompatCopyOut(Candidate, Buffer, BufferLength);
+				break;
+			}
+		}
+	}
+	if (Result != 0 && Result < BufferLength && FilePart != NULL)
+		*FilePart = wcsrchr(Buffer, L'/') + 1;
+
+cleanup:
+	free(Directories);
+	free(Suffix);
+	free(Name);
+	return Result;
+}
+
+DWORD GetEnvironmentVariableW(LPCWSTR Name, LPWSTR Buffer, DWORD Size)
+{
+	char* Key = CompatToUtf8(Name);
+	const char* Value = Key ? getenv(Key) : NULL;
+	free(Key);
+	if (Value == NULL)
+	{
+		g_LastError = ERROR_ENVVAR_NOT_FOUND;
+		return 0;
+	}
+	return CompatCopyOut(Value, Buffer, Size);
+}
+
+BOOL SetEnvironmentVariableW(LPCWSTR Name, LPCWSTR Value)
+{
+	char* Key = CompatToUtf8(Name);
+	char* Text = Value ? CompatToUtf8(Value) : NULL;
+	int Result = -1;
+	if (Key != NULL && (Value == NULL || Text != NULL))
+		Result = (Value != NULL) ? setenv(Key, Text, 1) : unsetenv(Key);
+	free(Text);
+	free(Key);
+	if (Result != 0)
+	{
+		g_LastError = ERROR_INVALID_PARAMETER;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+void GetSystemInfo(LPSYSTEM_INFO SystemInfo)
+{
+	long Processors = sysconf(_SC_NPROCESSORS_ONLN);
+	long PageSize = sysconf(_SC_PAGESIZE);
+	memset(SystemInfo, 0, sizeof(*SystemInfo));
+	SystemInfo->dwNumberOfProcessors = (DWORD)(Processors > 0 ? Processors : 1);
+	SystemInfo->dwPageSize = (DWORD)(PageSize > 0 ? PageSize : 4096);
+	SystemInfo->dwAllocationGranularity = SystemInfo->dwPageSize;
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* PerformanceCount)
+{
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	PerformanceCount->QuadPart = (LONGLONG)Now.tv_sec * 1000000000LL + Now.tv_nsec;
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* Frequency)
+{
+	Frequency->QuadPart = 1000000000LL;
+	return TRUE;
+}
+
+/* -------------------- Entry point -------------------- */
+
+int wmain(int argc, WCHAR** argv);
+
+/* Converts the UTF-8 arguments to wide strings and runs the program's wmain. */
+int main(int argc, char** argv)
+{
+	WCHAR** WideArgv = (WCHAR**)calloc((size_t)argc + 1, sizeof(WCHAR*));
+	int Result = 1;
+	if (WideArgv == NULL)
+		return 1;
+	// Wide formatting of narrow %hs arguments decodes them through the locale.
+	if (setlocale(LC_CTYPE, "C.UTF-8") == NULL)
+		setlocale(LC_CTYPE, "");
+	for (int i = 0; i < argc; i++)
+	{
+		WideArgv[i] = CompatFromUtf8(argv[i]);
+		if (WideArgv[i] == NULL)
+			goto cleanup;
+	}
+	Result = wmain(argc, WideArgv);
+
+cleanup:
+	for (int i = 0; i < argc; i++)
+		free(WideArgv[i]);
+	free(WideArgv);
+	return Result;
+}
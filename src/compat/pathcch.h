@@ -0,0 +1,47 @@
+/*
+ * PROJECT:     filecheck POSIX Compatibility Layer
+ * LICENSE:     GPL2
+ * PURPOSE:     Path helpers from <pathcch.h>, using '/' as the separator.
+ * COPYRIGHT:   Copyright 2025 Zafer Balkan
+ */
+
+#pragma once
+
+#include "strsafe.h"
+
+static inline HRESULT PathCchAddBackslash(wchar_t* Path, size_t Capacity)
+{
+	size_t Length = wcsnlen(Path, Capacity);
+	if (Length >= Capacity)
+		return STRSAFE_E_INVALID_PARAMETER;
+	if (Length > 0 && Path[Length - 1] == L'/')
+		return S_OK;
+	if (Length + 2 > Capacity)
+		return STRSAFE_E_INSUFFICIENT_BUFFER;
+	Path[Length] = L'/';
+	Path[Length + 1] = L'\0';
+	return S_OK;
+}
+
+static inline HRESULT PathCchCombine(wchar_t* Output, size_t Capacity, const wchar_t* Directory, const wchar_t* File)
+{
+	if (File != NULL && File[0] == L'/')
+		return StringCchCopyW(Output, Capacity, File);
+
+	// Output may alias Directory, so the result is assembled separately.
+	wchar_t* Combined = (wchar_t*)malloc(Capacity * sizeof(wchar_t));
+	if (Combined == NULL)
+		return STRSAFE_E_INSUFFICIENT_BUFFER;
+	HRESULT Result = StringCchCopyW(Combined, Capacity, Directory != NULL ? Directory : L"");
+	if (SUCCEEDED(Result) && File != NULL && File[0] != L'\0')
+	{
+		if (Combined[0] != L'\0')
+			Result = PathCchAddBackslash(Combined, Capacity);
+		if (SUCCEEDED(Result))
+			Result = StringCchCatW(Combined, Capacity, File);
+	}
+	if (SUCCEEDED(Result))
+		Result = StringCchCopyW(Output, Capacity, Combined);
+	free(Combined);
+	return Result;
+}
@@ -0,0 +1,39 @@
+/*
+ * PROJECT:     filecheck POSIX Compatibility Layer
+ * LICENSE:     GPL2
+ * PURPOSE:     Process memory counters from <psapi.h>.
+ * COPYRIGHT:   Copyright 2025 Zafer Balkan
+ */
+
+#pragma once
+
+#include "windows.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	DWORD cb;
+	DWORD PageFaultCount;
+	SIZE_T PeakWorkingSetSize;
+	SIZE_T WorkingSetSize;
+	SIZE_T QuotaPeakPagedPoolUsage;
+	SIZE_T QuotaPagedPoolUsage;
+	SIZE_T QuotaPeakNonPagedPoolUsage;
+	SIZE_T QuotaNonPagedPoolUsage;
+	SIZE_T PagefileUsage;
+	SIZE_T PeakPagefileUsage;
+} PROCESS_MEMORY_COUNTERS, * PPROCESS_MEMORY_COUNTERS;
+
+/*
+ * Only the peak working set and page faults are filled in, from getrusage and,
+ * on Linux, VmHWM. A child's ru_maxrss starts at the peak it inherits at exec,
+ * so for a child whose peak does not exceed that floor the call fails with
+ * ERROR_NOT_SUPPORTED.
+ */
+BOOL GetProcessMemoryInfo(HANDLE Process, PPROCESS_MEMORY_COUNTERS Counters, DWORD Size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,32 @@
+/*
+ * PROJECT:     filecheck POSIX Compatibility Layer
+ * LICENSE:     GPL2
+ * PURPOSE:     Empty definitions of the SAL annotations used by the sources.
+ * COPYRIGHT:   Copyright 2025 Zafer Balkan
+ */
+
+#pragma once
+
+#define _In_
+#define _In_opt_
+#define _In_z_
+#define _In_opt_z_
+#define _In_reads_(x)
+#define _In_reads_opt_(x)
+#define _In_reads_bytes_(x)
+#define _In_reads_bytes_opt_(x)
+#define _Inout_
+#define _Inout_updates_(x)
+#define _Out_
+#define _Out_opt_
+#define _Out_writes_(x)
+#define _Out_writes_z_(x)
+#define _Out_writes_bytes_(x)
+#define _Outptr_result_maybenull_
+#define _Outptr_opt_result_maybenull_
+#define _Outptr_result_buffer_maybenull_(x)
+#define _Outptr_result_nullonfailure_
+#define _Outptr_result_z_
+#define _Reserved_
+#define _Success_(x)
+#define _Printf_format_string_
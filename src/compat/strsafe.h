@@ -0,0 +1,111 @@
+/*
+ * PROJECT:     filecheck POSIX Compatibility Layer
+ * LICENSE:     GPL2
+ * PURPOSE:     Counted string helpers from <strsafe.h>.
+ * COPYRIGHT:   Copyright 2025 Zafer Balkan
+ */
+
+#pragma once
+
+#include "windows.h"
+#include <stdio.h>
+
+#define STRSAFE_MAX_CCH 2147483647
+
+static inline HRESULT StringCchLengthA(const char* String, size_t Max, size_t* Length)
+{
+	size_t Count = 0;
+	if (Length != NULL)
+		*Length = 0;
+	if (String == NULL || Max > STRSAFE_MAX_CCH)
+		return STRSAFE_E_INVALID_PARAMETER;
+	while (Count < Max && String[Count] != '\0')
+		Count++;
+	if (Count >= Max)
+		return STRSAFE_E_INVALID_PARAMETER;
+	if (Length != NULL)
+		*Length = Count;
+	return S_OK;
+}
+
+static inline HRESULT StringCchLengthW(const wchar_t* String, size_t Max, size_t* Length)
+{
+	size_t Count = 0;
+	if (Length != NULL)
+		*Length = 0;
+	if (String == NULL || Max > STRSAFE_MAX_CCH)
+		return STRSAFE_E_INVALID_PARAMETER;
+	while (Count < Max && String[Count] != L'\0')
+		Count++;
+	if (Count >= Max)
+		return STRSAFE_E_INVALID_PARAMETER;
+	if (Length != NULL)
+		*Length = Count;
+	return S_OK;
+}
+
+static inline HRESULT StringCchCopyA(char* Destination, size_t Capacity, const char* Source)
+{
+	if (Capacity == 0)
+		return STRSAFE_E_INVALID_PARAMETER;
+	size_t Length = strlen(Source);
+	if (Length >= Capacity)
+	{
+		memcpy(Destination, Source, Capacity - 1);
+		Destination[Capacity - 1] = '\0';
+		return STRSAFE_E_INSUFFICIENT_BUFFER;
+	}
+	memcpy(Destination, Source, Length + 1);
+	return S_OK;
+}
+
+static inline HRESULT StringCchCopyW(wchar_t* Destination, size_t Capacity, const wchar_t* Source)
+{
+	if (Capacity == 0)
+		return STRSAFE_E_INVALID_PARAMETER;
+	size_t Length = wcslen(Source);
+	if (Length >= Capacity)
+	{
+		wmemcpy(Destination, Source, Capacity - 1);
+		Destination[Capacity - 1] = L'\0';
+		return STRSAFE_E_INSUFFICIENT_BUFFER;
+	}
+	wmemcpy(Destination, Source, Length + 1);
+	return S_OK;
+}
+
+static inline HRESULT StringCchCatW(wchar_t* Destination, size_t Capacity, const wchar_t* Source)
+{
+	size_t Length = wcsnlen(Destination, Capacity);
+	if (Length >= Capacity)
+		return STRSAFE_E_INVALID_PARAMETER;
+	return StringCchCopyW(Destination + Length, Capacity - Length, Source);
+}
+
+static inline HRESULT StringCchPrintfA(char* Destination, size_t Capacity, const char* Format, ...)
+{
+	if (Capacity == 0)
+		return STRSAFE_E_INVALID_PARAMETER;
+	va_list Args;
+	va_start(Args, Format);
+	int Written = vsnprintf(Destination, Capacity, Format, Args);
+	va_end(Args);
+	return (Written < 0 || (size_t)Written >= Capacity) ? STRSAFE_E_INSUFFICIENT_BUFFER : S_OK;
+}
+
+static inline HRESULT StringCchPrintfW(wchar_t* Destination, size_t Capacity, const wchar_t* Format, ...)
+{
+	if (Capacity == 0)
+		return STRSAFE_E_INVALID_PARAMETER;
+	va_list Args;
+	va_start(Args, Format);
+	int Written = vswprintf(Destination, Capacity, Format, Args);
+	va_end(Args);
+	if (Written < 0)
+	{
+		// vswprintf reports truncation as failure and leaves the buffer unspecified.
+		Destination[Capacity - 1] = L'\0';
+		return STRSAFE_E_INSUFFICIENT_BUFFER;
+	}
+	return S_OK;
+}
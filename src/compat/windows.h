@@ -0,0 +1,416 @@
+/*
+ * PROJECT:     filecheck POSIX Compatibility Layer
+ * LICENSE:     GPL2
+ * PURPOSE:     The subset of the Win32 API used by the fc, fc.test and
+ *              fc.bench programs, implemented over POSIX.
+ * COPYRIGHT:   Copyright 2025 Zafer Balkan
+ */
+
+/*
+	filecheck.h does not need this header: the library talks to the operating
+	system through its own platform layer. The command-line programs are
+	written against Win32, so on POSIX systems this directory is placed on the
+	include path in front of the system headers and supplies just enough of
+	that API for them to build and run unchanged.
+
+	The emulation follows POSIX rather than Windows wherever the two disagree
+	on things the programs do not depend on: paths are passed through as
+	UTF-8 without separator or prefix translation, names are case-sensitive,
+	file sharing modes are ignored and the ANSI code page is UTF-8.
+*/
+
+#pragma once
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "sal.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------- Types -------------------- */
+
+/* Must match the fallback definitions in filecheck.h. */
+#define _FC_WIN32_TYPES_DEFINED
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef unsigned int UINT;
+typedef unsigned int DWORD;
+typedef long long LONGLONG;
+typedef unsigned long long ULONGLONG;
+typedef long long LONG64;
+typedef wchar_t WCHAR;
+typedef void* HANDLE;
+
+typedef unsigned short WORD;
+typedef int LONG;
+typedef unsigned int ULONG;
+typedef LONG HRESULT;
+typedef char CHAR;
+typedef size_t SIZE_T;
+typedef uintptr_t ULONG_PTR;
+typedef ULONG_PTR DWORD_PTR;
+typedef WCHAR* LPWSTR;
+typedef WCHAR* PWSTR;
+typedef const WCHAR* LPCWSTR;
+typedef const WCHAR* PCWSTR;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef void* LPVOID;
+typedef void* PVOID;
+typedef const void* LPCVOID;
+typedef DWORD* LPDWORD;
+typedef BOOL* LPBOOL;
+typedef HANDLE HMODULE;
+
+#define TRUE 1
+#define FALSE 0
+#define WINAPI
+#define __cdecl
+
+#define UNREFERENCED_PARAMETER(P) ((void)(P))
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+#ifndef NOMINMAX
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#define ZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#define CopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+
+typedef union {
+	struct { DWORD LowPart; LONG HighPart; };
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct {
+	DWORD dwLowDateTime;
+	DWORD dwHighDateTime;
+} FILETIME;
+
+typedef struct {
+	DWORD nLength;
+	LPVOID lpSecurityDescriptor;
+	BOOL bInheritHandle;
+} SECURITY_ATTRIBUTES, * LPSECURITY_ATTRIBUTES;
+
+#define MAX_PATH 260
+#define INFINITE 0xFFFFFFFFu
+#define WAIT_OBJECT_0 0u
+#define WAIT_FAILED 0xFFFFFFFFu
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+
+/* -------------------- Errors -------------------- */
+
+#define S_OK ((HRESULT)0)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define STRSAFE_E_INSUFFICIENT_BUFFER ((HRESULT)0x8007007AL)
+#define STRSAFE_E_INVALID_PARAMETER ((HRESULT)0x80070057L)
+
+#define ERROR_SUCCESS 0
+#define ERROR_FILE_NOT_FOUND 2
+#define ERROR_PATH_NOT_FOUND 3
+#define ERROR_ACCESS_DENIED 5
+#define ERROR_INVALID_HANDLE 6
+#define ERROR_NOT_ENOUGH_MEMORY 8
+#define ERROR_NO_MORE_FILES 18
+#define ERROR_NOT_SUPPORTED 50
+#define ERROR_INVALID_PARAMETER 87
+#define ERROR_INSUFFICIENT_BUFFER 122
+#define ERROR_ALREADY_EXISTS 183
+#define ERROR_ENVVAR_NOT_FOUND 203
+#define ERROR_NO_UNICODE_TRANSLATION 1113
+
+DWORD GetLastError(void);
+void SetLastError(DWORD ErrorCode);
+
+/* -------------------- Memory -------------------- */
+
+#define HEAP_ZERO_MEMORY 0x00000008
+
+/* The programs only use the process heap, which maps onto the C runtime. */
+static inline HANDLE GetProcessHeap(void)
+{
+	return (HANDLE)1;
+}
+
+static inline LPVOID HeapAlloc(HANDLE Heap, DWORD Flags, SIZE_T Bytes)
+{
+	(void)Heap;
+	return (Flags & HEAP_ZERO_MEMORY) ? calloc(1, Bytes ? Bytes : 1) : malloc(Bytes ? Bytes : 1);
+}
+
+static inline LPVOID HeapReAlloc(HANDLE Heap, DWORD Flags, LPVOID Block, SIZE_T Bytes)
+{
+	(void)Heap;
+	(void)Flags;
+	return realloc(Block, Bytes ? Bytes : 1);
+}
+
+static inline BOOL HeapFree(HANDLE Heap, DWORD Flags, LPVOID Block)
+{
+	(void)Heap;
+	(void)Flags;
+	free(Block);
+	return TRUE;
+}
+
+/* -------------------- Synchronization -------------------- */
+
+static inline LONG InterlockedIncrement(LONG volatile* Addend)
+{
+	return __atomic_add_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedDecrement(LONG volatile* Addend)
+{
+	return __atomic_sub_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedExchange(LONG volatile* Target, LONG Value)
+{
+	return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedCompareExchange(LONG volatile* Destination, LONG Exchange, LONG Comparand)
+{
+	__atomic_compare_exchange_n(Destination, &Comparand, Exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return Comparand;
+}
+
+static inline LONG64 InterlockedIncrement64(LONG64 volatile* Addend)
+{
+	return __atomic_add_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Only exclusive acquisition is used, so a mutex carries the same semantics. */
+typedef struct {
+	pthread_mutex_t Mutex;
+} SRWLOCK, * PSRWLOCK;
+
+typedef struct {
+	pthread_cond_t Condition;
+} CONDITION_VARIABLE, * PCONDITION_VARIABLE;
+
+static inline void InitializeSRWLock(PSRWLOCK Lock)
+{
+	pthread_mutex_init(&Lock->Mutex, NULL);
+}
+
+static inline void AcquireSRWLockExclusive(PSRWLOCK Lock)
+{
+	pthread_mutex_lock(&Lock->Mutex);
+}
+
+static inline void ReleaseSRWLockExclusive(PSRWLOCK Lock)
+{
+	pthread_mutex_unlock(&Lock->Mutex);
+}
+
+static inline void InitializeConditionVariable(PCONDITION_VARIABLE Condition)
+{
+	pthread_cond_init(&Condition->Condition, NULL);
+}
+
+static inline void WakeConditionVariable(PCONDITION_VARIABLE Condition)
+{
+	pthread_cond_signal(&Condition->Condition);
+}
+
+static inline void WakeAllConditionVariable(PCONDITION_VARIABLE Condition)
+{
+	pthread_cond_broadcast(&Condition->Condition);
+}
+
+BOOL SleepConditionVariableSRW(PCONDITION_VARIABLE Condition, PSRWLOCK Lock, DWORD Milliseconds, ULONG Flags);
+
+/* -------------------- Text -------------------- */
+
+#define CP_ACP 0
+#define CP_UTF8 65001
+#define MB_ERR_INVALID_CHARS 0x00000008
+#define WC_ERR_INVALID_CHARS 0x00000080
+#define WC_NO_BEST_FIT_CHARS 0x00000400
+
+int MultiByteToWideChar(UINT CodePage, DWORD Flags, LPCSTR Source, int SourceLength, LPWSTR Destination, int DestinationLength);
+int WideCharToMultiByte(UINT CodePage, DWORD Flags, LPCWSTR Source, int SourceLength, LPSTR Destination, int DestinationLength, LPCSTR DefaultChar, LPBOOL UsedDefaultChar);
+
+/* The wide printf family takes %ls for wide strings, as the C standard requires. */
+static inline int swprintf_s(wchar_t* Buffer, size_t Count, const wchar_t* Format, ...)
+{
+	va_list Args;
+	va_start(Args, Format);
+	int Result = vswprintf(Buffer, Count, Format, Args);
+	va_end(Args);
+	return Result;
+}
+
+static inline int _wcsicmp(const wchar_t* Left, const wchar_t* Right)
+{
+	return wcscasecmp(Left, Right);
+}
+
+static inline int _wcsnicmp(const wchar_t* Left, const wchar_t* Right, size_t Count)
+{
+	return wcsncasecmp(Left, Right, Count);
+}
+
+static inline int wcscpy_s(wchar_t* Destination, size_t Capacity, const wchar_t* Source)
+{
+	size_t Length = wcslen(Source);
+	if (Length >= Capacity)
+	{
+		if (Capacity > 0)
+			Destination[0] = L'\0';
+		return 34; /* ERANGE */
+	}
+	wmemcpy(Destination, Source, Length + 1);
+	return 0;
+}
+
+/* -------------------- Files -------------------- */
+
+#define GENERIC_READ 0x80000000u
+#define GENERIC_WRITE 0x40000000u
+#define FILE_SHARE_READ 0x00000001
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_DIRECTORY 0x00000010
+#define FILE_ATTRIBUTE_NORMAL 0x00000080
+#define FILE_ATTRIBUTE_REPARSE_POINT 0x00000400
+#define INVALID_FILE_ATTRIBUTES ((DWORD)-1)
+
+#define STD_INPUT_HANDLE ((DWORD)-10)
+#define STD_OUTPUT_HANDLE ((DWORD)-11)
+#define STD_ERROR_HANDLE ((DWORD)-12)
+
+typedef struct {
+	DWORD dwFileAttributes;
+	FILETIME ftCreationTime;
+	FILETIME ftLastAccessTime;
+	FILETIME ftLastWriteTime;
+	DWORD nFileSizeHigh;
+	DWORD nFileSizeLow;
+	DWORD dwReserved0;
+	DWORD dwReserved1;
+	WCHAR cFileName[MAX_PATH];
+	WCHAR cAlternateFileName[14];
+} WIN32_FIND_DATAW, * LPWIN32_FIND_DATAW;
+
+HANDLE GetStdHandle(DWORD StdHandle);
+HANDLE CreateFileW(LPCWSTR FileName, DWORD DesiredAccess, DWORD ShareMode, LPSECURITY_ATTRIBUTES SecurityAttributes,
+	DWORD CreationDisposition, DWORD FlagsAndAttributes, HANDLE TemplateFile);
+BOOL ReadFile(HANDLE File, LPVOID Buffer, DWORD BytesToRead, LPDWORD BytesRead, LPVOID Overlapped);
+BOOL WriteFile(HANDLE File, LPCVOID Buffer, DWORD BytesToWrite, LPDWORD BytesWritten, LPVOID Overlapped);
+BOOL GetFileSizeEx(HANDLE File, LARGE_INTEGER* FileSize);
+BOOL CloseHandle(HANDLE Object);
+DWORD GetFileAttributesW(LPCWSTR FileName);
+BOOL CreateDirectoryW(LPCWSTR PathName, LPSECURITY_ATTRIBUTES SecurityAttributes);
+BOOL RemoveDirectoryW(LPCWSTR PathName);
+BOOL DeleteFileW(LPCWSTR FileName);
+HANDLE FindFirstFileW(LPCWSTR FileName, LPWIN32_FIND_DATAW FindData);
+BOOL FindNextFileW(HANDLE FindFile, LPWIN32_FIND_DATAW FindData);
+BOOL FindClose(HANDLE FindFile);
+DWORD GetTempPathW(DWORD BufferLength, LPWSTR Buffer);
+DWORD GetCurrentDirectoryW(DWORD BufferLength, LPWSTR Buffer);
+
+/* There is no console API: callers fall back to writing UTF-8 to the handle. */
+static inline BOOL GetConsoleMode(HANDLE Console, LPDWORD Mode)
+{
+	(void)Console;
+	(void)Mode;
+	return FALSE;
+}
+
+static inline BOOL WriteConsoleW(HANDLE Console, const void* Buffer, DWORD Length, LPDWORD Written, LPVOID Reserved)
+{
+	(void)Console;
+	(void)Buffer;
+	(void)Length;
+	(void)Written;
+	(void)Reserved;
+	return FALSE;
+}
+
+/* -------------------- Processes and threads -------------------- */
+
+#define STARTF_USESTDHANDLES 0x00000100
+
+typedef DWORD(WINAPI* LPTHREAD_START_ROUTINE)(LPVOID);
+
+typedef struct {
+	DWORD cb;
+	LPWSTR lpReserved;
+	LPWSTR lpDesktop;
+	LPWSTR lpTitle;
+	DWORD dwX;
+	DWORD dwY;
+	DWORD dwXSize;
+	DWORD dwYSize;
+	DWORD dwXCountChars;
+	DWORD dwYCountChars;
+	DWORD dwFillAttribute;
+	DWORD dwFlags;
+	WORD wShowWindow;
+	WORD cbReserved2;
+	BYTE* lpReserved2;
+	HANDLE hStdInput;
+	HANDLE hStdOutput;
+	HANDLE hStdError;
+} STARTUPINFOW, * LPSTARTUPINFOW;
+
+typedef struct {
+	HANDLE hProcess;
+	HANDLE hThread;
+	DWORD dwProcessId;
+	DWORD dwThreadId;
+} PROCESS_INFORMATION, * LPPROCESS_INFORMATION;
+
+typedef struct {
+	WORD wProcessorArchitecture;
+	WORD wReserved;
+	DWORD dwPageSize;
+	LPVOID lpMinimumApplicationAddress;
+	LPVOID lpMaximumApplicationAddress;
+	DWORD_PTR dwActiveProcessorMask;
+	DWORD dwNumberOfProcessors;
+	DWORD dwProcessorType;
+	DWORD dwAllocationGranularity;
+	WORD wProcessorLevel;
+	WORD wProcessorRevision;
+} SYSTEM_INFO, * LPSYSTEM_INFO;
+
+HANDLE CreateThread(LPSECURITY_ATTRIBUTES SecurityAttributes, SIZE_T StackSize, LPTHREAD_START_ROUTINE StartAddress,
+	LPVOID Parameter, DWORD CreationFlags, LPDWORD ThreadId);
+BOOL CreateProcessW(LPCWSTR ApplicationName, LPWSTR CommandLine, LPSECURITY_ATTRIBUTES ProcessAttributes,
+	LPSECURITY_ATTRIBUTES ThreadAttributes, BOOL InheritHandles, DWORD CreationFlags, LPVOID Environment,
+	LPCWSTR CurrentDirectory, LPSTARTUPINFOW StartupInfo, LPPROCESS_INFORMATION ProcessInformation);
+DWORD WaitForSingleObject(HANDLE Handle, DWORD Milliseconds);
+DWORD WaitForMultipleObjects(DWORD Count, const HANDLE* Handles, BOOL WaitAll, DWORD Milliseconds);
+BOOL GetExitCodeProcess(HANDLE Process, LPDWORD ExitCode);
+BOOL GetProcessTimes(HANDLE Process, FILETIME* CreationTime, FILETIME* ExitTime, FILETIME* KernelTime, FILETIME* UserTime);
+HANDLE GetCurrentProcess(void);
+DWORD GetCurrentProcessId(void);
+void ExitProcess(UINT ExitCode);
+DWORD GetModuleFileNameW(HMODULE Module, LPWSTR FileName, DWORD Size);
+DWORD SearchPathW(LPCWSTR Path, LPCWSTR FileName, LPCWSTR Extension, DWORD BufferLength, LPWSTR Buffer, LPWSTR* FilePart);
+DWORD GetEnvironmentVariableW(LPCWSTR Name, LPWSTR Buffer, DWORD Size);
+BOOL SetEnvironmentVariableW(LPCWSTR Name, LPCWSTR Value);
+void GetSystemInfo(LPSYSTEM_INFO SystemInfo);
+BOOL QueryPerformanceCounter(LARGE_INTEGER* PerformanceCount);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* Frequency);
+
+#ifdef __cplusplus
+}
+#endif
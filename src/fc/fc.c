@@ -12,12 +12,89 @@
 #include <wctype.h>  // For iswdigit, towupper
 #include <strsafe.h> // For StringCchLengthW
 
+/** Separator used when building paths and printing directory names. */
+#ifdef _WIN32
+#define CLI_PATH_SEPARATOR L"\\"
+#else
+#define CLI_PATH_SEPARATOR L"/"
+#endif
+
+/**
+ * @struct CLI_OUTPUT_BUFFER
+ * @brief Growable wide-character buffer used to capture standard output.
+ *
+ * Tree mode compares file pairs on worker threads. Each comparison captures
+ * its output into one of these so the results can be printed in a stable
+ * order once all workers have finished.
+ */
+typedef struct {
+	WCHAR* Text;      /**< Captured text, null-terminated when non-NULL. */
+	size_t Length;    /**< Number of characters in Text, excluding the terminator. */
+	size_t Capacity;  /**< Allocated capacity of Text, in characters. */
+	BOOL   HadError;  /**< TRUE if an allocation failed while appending. */
+} CLI_OUTPUT_BUFFER;
+
+/** Standard-output capture for the calling thread, or NULL to write to the console. */
+static _FC_THREAD_LOCAL CLI_OUTPUT_BUFFER* g_ThreadOutput = NULL;
+
+/**
+ * @brief Appends a wide-character string to an output capture buffer.
+ * @internal
+ * @param Buffer The buffer to append to. HadError is set on allocation failure.
+ * @param msg    The null-terminated wide string to append.
+ */
+static void
+AppendOutputBuffer(_Inout_ CLI_OUTPUT_BUFFER* Buffer, _In_z_ const WCHAR* msg)
+{
+	if (Buffer->HadError)
+		return;
+
+	const size_t MsgLen = wcslen(msg);
+	if (MsgLen > (SIZE_MAX / sizeof(WCHAR)) - Buffer->Length - 1)
+	{
+		Buffer->HadError = TRUE;
+		return;
+	}
+
+	const size_t Needed = Buffer->Length + MsgLen + 1;
+	if (Needed > Buffer->Capacity)
+	{
+		size_t NewCapacity = (Buffer->Capacity > 0) ? Buffer->Capacity : 256;
+		while (NewCapacity < Needed)
+		{
+			if (NewCapacity > (SIZE_MAX / sizeof(WCHAR)) / 2)
+			{
+				NewCapacity = Needed;
+				break;
+			}
+			NewCapacity *= 2;
+		}
+
+		WCHAR* NewText = (Buffer->Text == NULL)
+			? (WCHAR*)HeapAlloc(GetProcessHeap(), 0, NewCapacity * sizeof(WCHAR))
+			: (WCHAR*)HeapReAlloc(GetProcessHeap(), 0, Buffer->Text, NewCapacity * sizeof(WCHAR));
+		if (NewText == NULL)
+		{
+			Buffer->HadError = TRUE;
+			return;
+		}
+		Buffer->Text = NewText;
+		Buffer->Capacity = NewCapacity;
+	}
+
+	CopyMemory(Buffer->Text + Buffer->Length, msg, MsgLen * sizeof(WCHAR));
+	Buffer->Length += MsgLen;
+	Buffer->Text[Buffer->Length] = L'\0';
+}
+
 /**
  * @brief Writes a wide-character string to an output handle.
  *
  * When the handle is a real console, WriteConsoleW is used directly.
  * When the handle is redirected or piped, the string is converted to UTF-8
  * and written with WriteFile so that output is not silently lost.
+ * If the calling thread has an output capture installed, standard output
+ * is appended to it instead of being written.
  *
  * @internal
  * @param hOut The output handle (e.g., STD_OUTPUT_HANDLE or STD_ERROR_HANDLE).
@@ -26,6 +103,12 @@
 static void
 ConPrintW(_In_ HANDLE hOut, _In_z_ const WCHAR* msg)
 {
+	if (g_ThreadOutput != NULL && hOut == GetStdHandle(STD_OUTPUT_HANDLE))
+	{
+		AppendOutputBuffer(g_ThreadOutput, msg);
+		return;
+	}
+
 	DWORD Mode;
 	if (GetConsoleMode(hOut, &Mode))
 	{
@@ -70,6 +153,8 @@ ConPrintW(_In_ HANDLE hOut, _In_z_ const WCHAR* msg)
 typedef struct {
 	UINT Flags;              /**< Configuration flags (e.g., FC_SHOW_LINE_NUMS). */
 	FC_MODE DecodeMode;      /**< Effective text decode mode for line rendering. */
+	BOOL Inline;             /**< Mark the changed characters of changed lines (/INLINE). */
+	BOOL LcsWarnings;        /**< Warn about inputs that make the LCS slow (/LCSWARN). */
 } CLI_CALLBACK_USER_DATA;
 
 /**
@@ -95,11 +180,12 @@ static void
 PrintOneLine(
 	_In_ HANDLE hOut,
 	_In_ const _FC_BUFFER* Lines,
+	_In_ size_t Offset,
 	_In_ size_t Index,
 	_In_ BOOL ShowLineNumbers,
 	_In_ FC_MODE DecodeMode)
 {
-	const _FC_LINE* line = GetLine(Lines, Index);
+	const _FC_LINE* line = GetLine(Lines, Index - Offset);
 	if (line == NULL || line->Text == NULL)
 		return;
 
@@ -130,6 +216,87 @@ PrintOneLine(
 	ConPrintW(hOut, L"\n");
 }
 
+/**
+ * @brief Prints a marker line with '^' under the changed characters of a line.
+ *
+ * Columns count characters: bytes in ASCII mode, UTF-8 lead bytes otherwise. An
+ * empty span marks the character at which the other file's text was inserted or
+ * removed. Nothing is printed if the line has no spans.
+ *
+ * @internal
+ */
+static void
+PrintSpanMarkers(
+	_In_ HANDLE hOut,
+	_In_ const _FC_BUFFER* Lines,
+	_In_ size_t Offset,
+	_In_ size_t Index,
+	_In_ const FC_REFINED_BLOCK* Refined,
+	_In_ BOOL SecondFile,
+	_In_ BOOL ShowLineNumbers,
+	_In_ FC_MODE DecodeMode)
+{
+	const _FC_LINE* line = GetLine(Lines, Index - Offset);
+	if (line == NULL || line->Text == NULL)
+		return;
+
+	// Spans are ordered by line pair and offset, so each line's spans are contiguous.
+	size_t First = 0;
+	while (First < Refined->SpanCount &&
+		(SecondFile ? Refined->Spans[First].LineB : Refined->Spans[First].LineA) != Index)
+		First++;
+	if (First == Refined->SpanCount)
+		return;
+
+	WCHAR* Marks = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, (line->Length + 2) * sizeof(WCHAR));
+	if (Marks == NULL)
+		return;
+
+	size_t Span = First;
+	size_t Column = 0;
+	size_t Width = 0;
+	for (size_t i = 0; i <= line->Length; i++)
+	{
+		if (i < line->Length && DecodeMode != FC_MODE_TEXT_ASCII && ((unsigned char)line->Text[i] & 0xC0) == 0x80)
+			continue;
+		BOOL Marked = FALSE;
+		while (Span < Refined->SpanCount &&
+			(SecondFile ? Refined->Spans[Span].LineB : Refined->Spans[Span].LineA) == Index)
+		{
+			size_t Start = SecondFile ? Refined->Spans[Span].StartB : Refined->Spans[Span].StartA;
+			size_t End = SecondFile ? Refined->Spans[Span].EndB : Refined->Spans[Span].EndA;
+			if (i < Start)
+				break;
+			if (i < End || i == Start)
+			{
+				Marked = TRUE;
+				break;
+			}
+			Span++;
+		}
+		Marks[Column++] = Marked ? L'^' : L' ';
+		if (Marked)
+			Width = Column;
+	}
+	Marks[Width] = L'\0';
+
+	if (Width > 0)
+	{
+		if (ShowLineNumbers)
+		{
+			// Blank out a line number prefix of the same width as PrintOneLine's.
+			WCHAR numBuf[16];
+			swprintf_s(numBuf, 16, L"%5zu:  ", Index + 1);
+			for (WCHAR* p = numBuf; *p != L'\0'; ++p)
+				*p = L' ';
+			ConPrintW(hOut, numBuf);
+		}
+		ConPrintW(hOut, Marks);
+		ConPrintW(hOut, L"\n");
+	}
+	HeapFree(GetProcessHeap(), 0, Marks);
+}
+
 /**
  * @brief Prints a range of lines from a buffer to the console.
  * @internal
@@ -137,14 +304,21 @@ PrintOneLine(
 static void
 PrintLines(
 	_In_ const _FC_BUFFER* Lines,
+	_In_ size_t Offset,
 	_In_ size_t Start,
 	_In_ size_t End,
 	_In_ BOOL ShowLineNumbers,
-	_In_ FC_MODE DecodeMode)
+	_In_ FC_MODE DecodeMode,
+	_In_opt_ const FC_REFINED_BLOCK* Refined,
+	_In_ BOOL SecondFile)
 {
 	HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
 	for (size_t i = Start; i < End; ++i)
-		PrintOneLine(hOut, Lines, i, ShowLineNumbers, DecodeMode);
+	{
+		PrintOneLine(hOut, Lines, Offset, i, ShowLineNumbers, DecodeMode);
+		if (Refined != NULL)
+			PrintSpanMarkers(hOut, Lines, Offset, i, Refined, SecondFile, ShowLineNumbers, DecodeMode);
+	}
 }
 
 /**
@@ -159,10 +333,13 @@ PrintLines(
 static void
 PrintLinesAbbreviated(
 	_In_ const _FC_BUFFER* Lines,
+	_In_ size_t Offset,
 	_In_ size_t Start,
 	_In_ size_t End,
 	_In_ BOOL ShowLineNumbers,
-	_In_ FC_MODE DecodeMode)
+	_In_ FC_MODE DecodeMode,
+	_In_opt_ const FC_REFINED_BLOCK* Refined,
+	_In_ BOOL SecondFile)
 {
 	HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
 	size_t Count = (End > Start) ? (End - Start) : 0;
@@ -170,15 +347,14 @@ PrintLinesAbbreviated(
 	if (Count <= 2)
 	{
 		// One or two lines: show all of them.
-		for (size_t i = Start; i < End; ++i)
-			PrintOneLine(hOut, Lines, i, ShowLineNumbers, DecodeMode);
+		PrintLines(Lines, Offset, Start, End, ShowLineNumbers, DecodeMode, Refined, SecondFile);
 	}
 	else
 	{
 		// Three or more: show first, "...", last.
-		PrintOneLine(hOut, Lines, Start, ShowLineNumbers, DecodeMode);
+		PrintLines(Lines, Offset, Start, Start + 1, ShowLineNumbers, DecodeMode, Refined, SecondFile);
 		ConPrintW(hOut, L"...\n");
-		PrintOneLine(hOut, Lines, End - 1, ShowLineNumbers, DecodeMode);
+		PrintLines(Lines, Offset, End - 1, End, ShowLineNumbers, DecodeMode, Refined, SecondFile);
 	}
 }
 
@@ -196,6 +372,11 @@ PrintLinesAbbreviated(
  * <lines from file2 in the difference block>
  * *****
  *
+ * Block indices are absolute line numbers; the line buffers of a chunked
+ * comparison start at Context->OffsetA and Context->OffsetB. With /INLINE, each
+ * paired line of a change block is followed by a line marking its changed
+ * characters.
+ *
  * @param Context The user context, providing file paths and line buffers.
  * @param Block The difference block describing the change, deletion, or addition.
  */
@@ -218,6 +399,8 @@ TextDiffCallback(
 	BOOL ShowLineNumbers = FALSE;
 	BOOL Abbreviated = FALSE;
 	FC_MODE DecodeMode = FC_MODE_AUTO;
+	FC_REFINED_BLOCK Refined = { 0 };
+	const FC_REFINED_BLOCK* pRefined = NULL;
 	if (Context->UserData != NULL)
 	{
 		CLI_CALLBACK_USER_DATA* userData = (CLI_CALLBACK_USER_DATA*)Context->UserData;
@@ -225,6 +408,16 @@ TextDiffCallback(
 		ShowLineNumbers = (Flags & FC_SHOW_LINE_NUMS) != 0;
 		Abbreviated = (Flags & FC_ABBREVIATED) != 0;
 		DecodeMode = userData->DecodeMode;
+
+		// Without the spans (e.g. out of memory) the block is printed without markers.
+		if (userData->Inline && Block->Type == FC_DIFF_TYPE_CHANGE)
+		{
+			FC_CONFIG RefineConfig = { 0 };
+			RefineConfig.Mode = DecodeMode;
+			RefineConfig.Flags = Flags;
+			if (FC_RefineBlock(Context, Block, &RefineConfig, &Refined) == FC_OK)
+				pRefined = &Refined;
+		}
 	}
 
 	if (Block->Type == FC_DIFF_TYPE_CHANGE ||
@@ -241,9 +434,9 @@ TextDiffCallback(
 		if (Block->Type == FC_DIFF_TYPE_CHANGE || Block->Type == FC_DIFF_TYPE_DELETE)
 		{
 			if (Abbreviated)
-				PrintLinesAbbreviated(Lines1, Block->StartA, Block->EndA, ShowLineNumbers, DecodeMode);
+				PrintLinesAbbreviated(Lines1, Context->OffsetA, Block->StartA, Block->EndA, ShowLineNumbers, DecodeMode, pRefined, FALSE);
 			else
-				PrintLines(Lines1, Block->StartA, Block->EndA, ShowLineNumbers, DecodeMode);
+				PrintLines(Lines1, Context->OffsetA, Block->StartA, Block->EndA, ShowLineNumbers, DecodeMode, pRefined, FALSE);
 		}
 
 		// Print second file block
@@ -254,14 +447,15 @@ TextDiffCallback(
 		if (Block->Type == FC_DIFF_TYPE_CHANGE || Block->Type == FC_DIFF_TYPE_ADD)
 		{
 			if (Abbreviated)
-				PrintLinesAbbreviated(Lines2, Block->StartB, Block->EndB, ShowLineNumbers, DecodeMode);
+				PrintLinesAbbreviated(Lines2, Context->OffsetB, Block->StartB, Block->EndB, ShowLineNumbers, DecodeMode, pRefined, TRUE);
 			else
-				PrintLines(Lines2, Block->StartB, Block->EndB, ShowLineNumbers, DecodeMode);
+				PrintLines(Lines2, Context->OffsetB, Block->StartB, Block->EndB, ShowLineNumbers, DecodeMode, pRefined, TRUE);
 		}
 
 		// Print closing marker followed by a blank line (matching Windows fc.exe output).
 		ConPrintW(hOut, L"*****\n\n");
 	}
+	FC_RefinedBlockFree(&Refined);
 }
 
 /**
@@ -307,6 +501,20 @@ BinaryDiffCallback(
 	}
 }
 
+/**
+ * @brief Callback used in equality-only mode (/Q); discards every diff block.
+ *
+ * Only the overall FC_RESULT matters in this mode, so nothing is printed.
+ */
+static void
+QuietDiffCallback(
+	_In_ const FC_USER_CONTEXT* Context,
+	_In_ const FC_DIFF_BLOCK* Block)
+{
+	UNREFERENCED_PARAMETER(Context);
+	UNREFERENCED_PARAMETER(Block);
+}
+
 /**
  * @brief Dispatches each diff block to the appropriate formatter.
  *
@@ -367,12 +575,241 @@ PrintUsage(void)
 	ConPrintW(hOut, L"  /U    Unicode text comparison\n");
 	ConPrintW(hOut, L"  /nnnn Set resync line threshold (default 2)\n");
 	ConPrintW(hOut, L"  /LBn  Set internal buffer size for text lines (default 100)\n");
+	ConPrintW(hOut, L"  /Q    Equality-only: report whether files differ without listing differences\n");
+	ConPrintW(hOut, L"  /INLINE  Mark the changed characters under each changed line\n");
+	ConPrintW(hOut, L"  /STATS  Print phase timings and counters to standard error\n");
+	ConPrintW(hOut, L"  /LCSWARN  Warn about inputs whose repeated lines or hash collisions slow the text diff\n");
+	ConPrintW(hOut, L"  /MAXMEM:n  Limit the working memory of each comparison to n megabytes\n");
+	ConPrintW(hOut, L"  /LARGEPAGES  Back large text buffers with large pages where the system allows it\n");
+	ConPrintW(hOut, L"  /TREE Compare two directory trees recursively\n");
+	ConPrintW(hOut, L"  /CACHE:file  Reuse results for unchanged files across runs (cache stored in file)\n");
+	ConPrintW(hOut, L"  /TRACE:file  Write a timeline of each comparison phase to file (Chrome trace-event JSON)\n");
 	ConPrintW(hOut, L"(If neither /L, /B nor /U is specified, the mode is auto-detected from\n");
 	ConPrintW(hOut, L" file content in this order: a UTF BOM means text; otherwise a null byte\n");
 	ConPrintW(hOut, L" means binary; otherwise >=90%% printable ASCII means text. This differs\n");
 	ConPrintW(hOut, L" from fc.exe, which defaults to /L.)\n");
 }
 
+//
+// Ranks one line of a partial run's FC_STATS::TopLines into a running total,
+// keeping one entry per line hash.
+//
+static void
+AddTopLine(
+	_Inout_ FC_STATS* Total,
+	_In_ const FC_STATS_LINE* Line)
+{
+	FC_STATS_LINE* Top = Total->TopLines;
+	size_t Slot = FC_STATS_TOP_LINES - 1;
+	for (size_t i = 0; i < FC_STATS_TOP_LINES; i++)
+	{
+		if (Top[i].MatchListLength != 0 && Top[i].Hash == Line->Hash)
+		{
+			if (Line->MatchListLength <= Top[i].MatchListLength)
+				return;
+			Slot = i;
+			break;
+		}
+	}
+	if (Line->MatchListLength <= Top[Slot].MatchListLength)
+		return;
+	while (Slot > 0 && Top[Slot - 1].MatchListLength < Line->MatchListLength)
+	{
+		Top[Slot] = Top[Slot - 1];
+		Slot--;
+	}
+	Top[Slot] = *Line;
+}
+
+//
+// Adds the statistics of one comparison run to a running total.
+//
+static void
+AddStats(
+	_Inout_ FC_STATS* Total,
+	_In_ const FC_STATS* Part)
+{
+	Total->ReadNanoseconds += Part->ReadNanoseconds;
+	Total->ParseNanoseconds += Part->ParseNanoseconds;
+	Total->HashNanoseconds += Part->HashNanoseconds;
+	Total->LcsNanoseconds += Part->LcsNanoseconds;
+	Total->BinaryCompareNanoseconds += Part->BinaryCompareNanoseconds;
+	Total->ReportNanoseconds += Part->ReportNanoseconds;
+	Total->BytesRead += Part->BytesRead;
+	Total->LinesParsed += Part->LinesParsed;
+	Total->ChunksProcessed += Part->ChunksProcessed;
+	Total->Rewinds += Part->Rewinds;
+	Total->MatchesProbed += Part->MatchesProbed;
+	Total->HashCollisions += Part->HashCollisions;
+	if (Part->PeakMemoryBytes > Total->PeakMemoryBytes)
+		Total->PeakMemoryBytes = Part->PeakMemoryBytes;
+	Total->BudgetFallbacks += Part->BudgetFallbacks;
+	Total->MatchListLookups += Part->MatchListLookups;
+	if (Part->MaxMatchListLength > Total->MaxMatchListLength)
+		Total->MaxMatchListLength = Part->MaxMatchListLength;
+	if (Part->PeakLcsLinks > Total->PeakLcsLinks)
+		Total->PeakLcsLinks = Part->PeakLcsLinks;
+	Total->LargePageBytes += Part->LargePageBytes;
+	for (size_t i = 0; i < FC_STATS_TOP_LINES && Part->TopLines[i].MatchListLength != 0; i++)
+		AddTopLine(Total, &Part->TopLines[i]);
+}
+
+//
+// Copies the start of a line from FC_STATS_LINE::Text for display, replacing
+// control and non-ASCII bytes with '?'.
+//
+static void
+FormatStatsLine(
+	_In_ const FC_STATS_LINE* Line,
+	_Out_writes_(Capacity) WCHAR* Out,
+	_In_ size_t Capacity)
+{
+	size_t i = 0;
+	for (; i + 1 < Capacity && i < sizeof(Line->Text) && Line->Text[i] != '\0'; i++)
+	{
+		unsigned char c = (unsigned char)Line->Text[i];
+		Out[i] = (c >= 0x20 && c < 0x7F) ? (WCHAR)c : L'?';
+	}
+	Out[i] = L'\0';
+}
+
+//
+// Prints the statistics collected with /STATS to standard error.
+//
+static void
+PrintStats(_In_ const FC_STATS* Stats)
+{
+	HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
+	WCHAR buf[1024];
+	swprintf_s(buf, 1024,
+		L"FC statistics:\n"
+		L"  read            %12.3f ms\n"
+		L"  parse           %12.3f ms\n"
+		L"  hash            %12.3f ms\n"
+		L"  lcs             %12.3f ms\n"
+		L"  binary compare  %12.3f ms\n"
+		L"  report          %12.3f ms\n"
+		L"  bytes read      %12llu\n"
+		L"  lines parsed    %12llu\n"
+		L"  chunks          %12llu\n"
+		L"  rewinds         %12llu\n"
+		L"  matches probed  %12llu\n"
+		L"  hash collisions %12llu\n"
+		L"  peak memory     %12llu bytes\n"
+		L"  budget fallbacks%12llu\n"
+		L"  match lists     %12llu (mean %.1f, longest %llu)\n"
+		L"  peak lcs links  %12llu\n"
+		L"  large pages     %12llu bytes\n",
+		Stats->ReadNanoseconds / 1e6,
+		Stats->ParseNanoseconds / 1e6,
+		Stats->HashNanoseconds / 1e6,
+		Stats->LcsNanoseconds / 1e6,
+		Stats->BinaryCompareNanoseconds / 1e6,
+		Stats->ReportNanoseconds / 1e6,
+		Stats->BytesRead,
+		Stats->LinesParsed,
+		Stats->ChunksProcessed,
+		Stats->Rewinds,
+		Stats->MatchesProbed,
+		Stats->HashCollisions,
+		Stats->PeakMemoryBytes,
+		Stats->BudgetFallbacks,
+		Stats->MatchListLookups,
+		Stats->MatchListLookups ? (double)Stats->MatchesProbed / (double)Stats->MatchListLookups : 0.0,
+		Stats->MaxMatchListLength,
+		Stats->PeakLcsLinks,
+		Stats->LargePageBytes);
+	ConPrintW(hErr, buf);
+
+	// Lines without a repeat say nothing about the input, so only longer lists are shown.
+	for (size_t i = 0; i < FC_STATS_TOP_LINES && Stats->TopLines[i].MatchListLength > 1; i++)
+	{
+		WCHAR Text[40];
+		FormatStatsLine(&Stats->TopLines[i], Text, _countof(Text));
+		swprintf_s(buf, 1024, L"  long list %zu     %12llu \"%ls\" (hash %08X)\n",
+			i + 1, Stats->TopLines[i].MatchListLength, Text, Stats->TopLines[i].Hash);
+		ConPrintW(hErr, buf);
+	}
+}
+
+// An input is reported by /LCSWARN when the LCS probed more than
+// LCSWARN_PROBES_PER_LOOKUP line pairs per match list lookup and one match list
+// held at least LCSWARN_MIN_LIST_LENGTH lines, or when at least LCSWARN_MIN_COLLISIONS
+// probed pairs, and 1% of all, were hash collisions. The probes are counted per
+// lookup, not per parsed line, so the equal chunks that never reach the LCS do
+// not hide a slow one. Under /LBn a lookup visits at most 2n+1 candidates, so
+// the list threshold drops to 2n there.
+#define LCSWARN_PROBES_PER_LOOKUP 32
+#define LCSWARN_MIN_LIST_LENGTH 256
+#define LCSWARN_MIN_COLLISIONS 16
+
+//
+// Prints a warning to standard error if the statistics of one comparison show
+// an input that is pathological for the LCS (/LCSWARN).
+//
+static void
+WarnPathologicalInput(
+	_In_z_ const WCHAR* File1,
+	_In_z_ const WCHAR* File2,
+	_In_ const FC_STATS* Stats,
+	_In_ UINT BufferLines)
+{
+	HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
+	WCHAR buf[1024];
+	ULONGLONG MinListLength = LCSWARN_MIN_LIST_LENGTH;
+	if (BufferLines > 0 && 2ull * BufferLines < MinListLength)
+		MinListLength = 2ull * BufferLines;
+	if (Stats->MatchesProbed > LCSWARN_PROBES_PER_LOOKUP * Stats->MatchListLookups &&
+		Stats->MaxMatchListLength >= MinListLength)
+	{
+		WCHAR Text[40];
+		FormatStatsLine(&Stats->TopLines[0], Text, _countof(Text));
+		swprintf_s(buf, 1024,
+			L"FC: warning: %ls and %ls: the LCS probed %llu line pairs for %llu lines; "
+			L"the line \"%ls\" had up to %llu match candidates per lookup\n",
+			File1, File2, Stats->MatchesProbed, Stats->LinesParsed, Text, Stats->TopLines[0].MatchListLength);
+		ConPrintW(hErr, buf);
+	}
+	if (Stats->HashCollisions >= LCSWARN_MIN_COLLISIONS && Stats->HashCollisions * 100 >= Stats->MatchesProbed)
+	{
+		swprintf_s(buf, 1024,
+			L"FC: warning: %ls and %ls: %llu of %llu probed line pairs were hash collisions\n",
+			File1, File2, Stats->HashCollisions, Stats->MatchesProbed);
+		ConPrintW(hErr, buf);
+	}
+}
+
+//
+// Compares one file pair, with a session if one is given. With /LCSWARN the pair
+// collects its own statistics, which are checked and then added to Config->Stats.
+//
+static FC_RESULT
+CompareFilePair(
+	_In_opt_ FC_SESSION* Session,
+	_In_z_ const WCHAR* File1,
+	_In_z_ const WCHAR* File2,
+	_In_ const FC_CONFIG* Config)
+{
+	const CLI_CALLBACK_USER_DATA* UserData = (const CLI_CALLBACK_USER_DATA*)Config->UserData;
+	if (UserData == NULL || !UserData->LcsWarnings)
+	{
+		return (Session != NULL)
+			? FC_SessionCompareFilesW(Session, File1, File2, Config)
+			: FC_CompareFilesW(File1, File2, Config);
+	}
+
+	FC_STATS PairStats = { 0 };
+	FC_CONFIG PairConfig = *Config;
+	PairConfig.Stats = &PairStats;
+	FC_RESULT Result = (Session != NULL)
+		? FC_SessionCompareFilesW(Session, File1, File2, &PairConfig)
+		: FC_CompareFilesW(File1, File2, &PairConfig);
+	WarnPathologicalInput(File1, File2, &PairStats, Config->BufferLines);
+	if (Config->Stats != NULL)
+		AddStats(Config->Stats, &PairStats);
+	return Result;
+}
+
 _Success_(return == TRUE)
 static BOOL
 ParseNumericOption(
@@ -390,7 +827,7 @@ ParseNumericOption(
 	{
 		HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
 		WCHAR buf[256];
-		swprintf_s(buf, 256, L"Invalid numeric option: %s\n", OptionString);
+		swprintf_s(buf, 256, L"Invalid numeric option: %ls\n", OptionString);
 		ConPrintW(hErr, buf);
 		return FALSE;
 	}
@@ -930,7 +1367,8 @@ WildcardFileCompare(
 			ConPrintW(hOut, File2);
 			ConPrintW(hOut, L"\n\n");
 
-			FC_RESULT Result = FC_CompareFilesW(File1, File2, Config);
+			Config->TracePair = ComparedPairCount;
+			FC_RESULT Result = CompareFilePair(NULL, File1, File2, Config);
 			ComparedPairCount++;
 
 			switch (Result)
@@ -1018,7 +1456,8 @@ WildcardFileCompare(
 			ConPrintW(hOut, File2);
 			ConPrintW(hOut, L"\n\n");
 
-			FC_RESULT Result = FC_CompareFilesW(File1, File2, Config);
+			Config->TracePair = i;
+			FC_RESULT Result = CompareFilePair(NULL, File1, File2, Config);
 
 			switch (Result)
 			{
@@ -1058,110 +1497,1255 @@ WildcardFileCompare(
 	return OverallResult;
 }
 
-//
-// Main entry point for the application.
-// Using wmain to natively support Unicode command-line arguments.
-//
-int
-wmain(
-	_In_ int argc,
-	_In_reads_(argc) WCHAR * argv[])
-{
-	// Special-case: fc /? or fc -? with no file arguments — print usage and exit 0.
-	if (argc == 2 && (argv[1][0] == L'/' || argv[1][0] == L'-') && argv[1][1] == L'?')
-	{
-		PrintUsage();
-		return 0;
-	}
+/*
+ * Directory-tree comparison (/TREE).
+ *
+ * Both trees are walked at the same time on a small pool of worker threads.
+ * Each worker owns a deque of tasks: it pushes and pops work at the bottom
+ * (most recent first, which keeps a directory walk depth-first and cache
+ * friendly) and, when its own deque is empty, steals the oldest task from
+ * the top of another worker's deque. Two task types exist: scanning one
+ * relative directory on both sides, and comparing one common file. Scan
+ * tasks merge the two sorted listings, submit sub-scans and comparisons,
+ * and record entries that exist on one side only. Results are collected
+ * under a lock and printed in relative-path order after the pool drains,
+ * so output is deterministic regardless of scheduling.
+ */
 
-	if (argc < 3)
-	{
-		PrintUsage();
-		return -1; // Syntax error
-	}
+/** Upper bound on tree-mode worker threads (also the WaitForMultipleObjects limit). */
+#define TREE_MAX_WORKERS 64
 
-	FC_CONFIG Config = { 0 }; // Initialize all fields to zero
-	CLI_CALLBACK_USER_DATA CallbackUserData = { 0 }; // User data for CLI diff callbacks
+/**
+ * @enum TREE_ENTRY_KIND
+ * @brief Classifies one reported entry of a tree comparison.
+ */
+typedef enum {
+	TREE_ENTRY_ONLY_IN = 0,    /**< Entry exists in one tree only (see Side). */
+	TREE_ENTRY_TYPE_MISMATCH,  /**< A directory in one tree and a file in the other. */
+	TREE_ENTRY_COMPARED,       /**< A file present in both trees was compared. */
+	TREE_ENTRY_ENUM_ERROR      /**< A directory could not be enumerated (see Side). */
+} TREE_ENTRY_KIND;
 
-	// Set non-zero defaults
-	Config.Mode = FC_MODE_AUTO;
-	Config.ResyncLines = 2;
-	Config.BufferLines = 100;
-	Config.MaxTextFileBytes = (size_t)FC_DEFAULT_MAX_TEXT_FILE_BYTES;
+/**
+ * @struct TREE_ENTRY
+ * @brief One reported result of a tree comparison.
+ */
+typedef struct {
+	WCHAR*            RelativePath;  /**< Path relative to the tree root(s), as spelled in the left tree if present there. */
+	TREE_ENTRY_KIND   Kind;          /**< What this entry reports. */
+	int               Side;          /**< 0 for the left tree, 1 for the right (ONLY_IN / ENUM_ERROR). */
+	BOOL              IsDirectory;   /**< TRUE if an ONLY_IN entry is a directory. */
+	BOOL              SizeOnly;      /**< TRUE if a COMPARED pair was judged from file sizes alone. */
+	FC_RESULT         Result;        /**< Comparison result for COMPARED entries. */
+	CLI_OUTPUT_BUFFER Output;        /**< Captured comparison output for COMPARED entries. */
+} TREE_ENTRY;
 
-	// Options may appear anywhere in the argument list — before, between, or
-	// after the two file paths — matching Windows fc.exe behaviour.
-	// Non-option arguments are collected in order as the two file paths.
-	const WCHAR* FileArgs[2] = { NULL, NULL };
-	int FileCount = 0;
+typedef enum {
+	TREE_TASK_SCAN_DIR = 0,
+	TREE_TASK_COMPARE_FILES
+} TREE_TASK_TYPE;
 
-	for (int i = 1; i < argc; ++i)
-	{
-		WCHAR* Arg = argv[i];
+/**
+ * @struct TREE_TASK
+ * @brief A unit of work for the tree-mode worker pool.
+ */
+typedef struct {
+	TREE_TASK_TYPE Type;          /**< Scan a directory or compare a file pair. */
+	WCHAR*         RelativePath;  /**< Relative path in the left tree; "" denotes the tree roots. */
+	WCHAR*         RightPath;     /**< Relative path in the right tree if its case differs, else NULL. */
+	ULONGLONG      SizeLeft;      /**< Left file size (COMPARE_FILES only). */
+	ULONGLONG      SizeRight;     /**< Right file size (COMPARE_FILES only). */
+} TREE_TASK;
 
-		if (Arg[0] == L'/' || Arg[0] == L'-')
-		{
-			// Handle /? — print usage and exit.
-			if (Arg[1] == L'?')
-			{
-				PrintUsage();
-				return 0;
-			}
-			// NOTE (intentional divergence): /OFF and /OFFLINE are currently accepted
-			// as compatibility switches but treated as no-ops.
-			// See README "Documented Differences from Windows fc.exe".
-			else if (_wcsicmp(Arg + 1, L"OFF") == 0 || _wcsicmp(Arg + 1, L"OFFLINE") == 0)
-			{
-				// No-op: accepted for compatibility with Windows fc.exe.
-			}
-			// Check for numeric resync line option (e.g., /20)
-			else if (iswdigit(Arg[1]))
-			{
-				if (!ParseNumericOption(Arg + 1, &Config.ResyncLines, 1, UINT_MAX))
-					return -1;
-			}
-			// Check for buffer line option (e.g., /LB100 or /lb100)
-			else if (_wcsnicmp(Arg + 1, L"LB", 2) == 0)
-			{
-				size_t ArgLen = wcslen(Arg);
-				if (ArgLen <= 3 || !iswdigit((wint_t)Arg[3]))
-				{
-					HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
-					WCHAR buf[256];
-					swprintf_s(buf, 256, L"Invalid option: %s\n", Arg);
-					ConPrintW(hErr, buf);
-					return -1;
-				}
+/**
+ * @struct TREE_DEQUE
+ * @brief Lock-protected ring buffer of tasks owned by one worker.
+ *
+ * The owner pushes and pops at the bottom; other workers steal from the top.
+ */
+typedef struct {
+	SRWLOCK     Lock;
+	TREE_TASK** Items;     /**< Ring buffer storage. */
+	size_t      Head;      /**< Index of the oldest task (the steal end). */
+	size_t      Count;     /**< Number of queued tasks. */
+	size_t      Capacity;  /**< Allocated capacity of Items. */
+} TREE_DEQUE;
 
-				if (!ParseNumericOption(Arg + 3, &Config.BufferLines, 1, UINT_MAX))
-					return -1;
-			}
-			else
-			{
-				WCHAR OptionChar = towupper(Arg[1]);
-				BOOL Handled = FALSE;
+struct _TREE_POOL;
 
-				for (int j = 0; g_OptionMap[j].OptionChar != 0; ++j)
-				{
-					if (OptionChar == g_OptionMap[j].OptionChar)
-					{
-						if (g_OptionMap[j].FlagToSet)
-							Config.Flags |= g_OptionMap[j].FlagToSet;
-						if (g_OptionMap[j].ModeToSet)
-							Config.Mode = g_OptionMap[j].ModeToSet;
-						Handled = TRUE;
-						break;
-					}
-				}
+typedef struct {
+	struct _TREE_POOL* Pool;
+	DWORD              Index;
+	TREE_DEQUE         Deque;
+	FC_SESSION*        Session;   /**< Per-worker comparison session; NULL falls back to FC_CompareFilesW. */
+	FC_CONFIG          Config;    /**< Copy of the pool configuration whose Stats points to this worker's Stats. */
+	FC_STATS           Stats;     /**< Statistics of this worker's comparisons (/STATS). */
+} TREE_WORKER;
 
-				if (!Handled)
-				{
-					HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
-					WCHAR buf[256];
-					swprintf_s(buf, 256, L"Invalid option: %s\n", Arg);
-					ConPrintW(hErr, buf);
-					return -1;
-				}
+/**
+ * @struct TREE_POOL
+ * @brief Shared state of one tree comparison.
+ */
+typedef struct _TREE_POOL {
+	const WCHAR*       LeftRoot;
+	const WCHAR*       RightRoot;
+	const FC_CONFIG*   Config;
+	BOOL               QuietMode;       /**< Equality-only mode (/Q). */
+	TREE_WORKER*       Workers;
+	DWORD              WorkerCount;
+	volatile LONG      PendingTasks;    /**< Tasks submitted but not yet finished. */
+	volatile LONG      HadError;        /**< Non-zero once an allocation has failed. */
+	volatile LONG64    NextPair;        /**< Trace pair index of the next file comparison (/TRACE). */
+	volatile LONG      IdleGeneration;  /**< Bumped under IdleLock when work is queued or the pool drains. */
+	SRWLOCK            IdleLock;
+	CONDITION_VARIABLE IdleCondition;   /**< Signalled after every IdleGeneration bump. */
+	SRWLOCK            EntriesLock;
+	TREE_ENTRY*        Entries;
+	size_t             EntryCount;
+	size_t             EntryCapacity;
+} TREE_POOL;
+
+/**
+ * @struct TREE_DIR_ITEM
+ * @brief One child of a directory listing.
+ */
+typedef struct {
+	WCHAR*    Name;
+	BOOL      IsDirectory;
+	BOOL      IsReparsePoint;
+	ULONGLONG Size;
+} TREE_DIR_ITEM;
+
+typedef struct {
+	TREE_DIR_ITEM* Items;
+	size_t         Count;
+	size_t         Capacity;
+} TREE_DIR_LISTING;
+
+/**
+ * @brief Duplicates a wide string on the process heap.
+ * @internal
+ * @return The copy, or NULL on allocation failure.
+ */
+static WCHAR*
+DuplicateStringAlloc(_In_z_ const WCHAR* Source)
+{
+	const size_t Len = wcslen(Source);
+	WCHAR* Copy = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, (Len + 1) * sizeof(WCHAR));
+	if (Copy == NULL)
+		return NULL;
+	CopyMemory(Copy, Source, (Len + 1) * sizeof(WCHAR));
+	return Copy;
+}
+
+/**
+ * @brief Joins two path fragments with a backslash.
+ *
+ * An empty Prefix yields a copy of Name, and no separator is inserted when
+ * Prefix already ends with one. This builds both relative paths ("" + "a",
+ * "a" + "b") and full paths (root + relative path).
+ *
+ * @internal
+ * @return A heap-allocated path, or NULL on allocation failure.
+ */
+static WCHAR*
+JoinPathAlloc(
+	_In_z_ const WCHAR* Prefix,
+	_In_z_ const WCHAR* Name)
+{
+	const size_t PrefixLen = wcslen(Prefix);
+	const size_t NameLen = wcslen(Name);
+	const BOOL NeedSep = (PrefixLen > 0 && NameLen > 0 &&
+		Prefix[PrefixLen - 1] != L'\\' && Prefix[PrefixLen - 1] != L'/');
+	const size_t TotalLen = PrefixLen + (NeedSep ? 1 : 0) + NameLen;
+	if (TotalLen < PrefixLen || TotalLen > (SIZE_MAX / sizeof(WCHAR)) - 1)
+		return NULL;
+
+	WCHAR* Path = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, (TotalLen + 1) * sizeof(WCHAR));
+	if (Path == NULL)
+		return NULL;
+
+	CopyMemory(Path, Prefix, PrefixLen * sizeof(WCHAR));
+	size_t Pos = PrefixLen;
+	if (NeedSep)
+		Path[Pos++] = CLI_PATH_SEPARATOR[0];
+	CopyMemory(Path + Pos, Name, NameLen * sizeof(WCHAR));
+	Path[TotalLen] = L'\0';
+	return Path;
+}
+
+static void
+FreeDirListing(_Inout_ TREE_DIR_LISTING* Listing)
+{
+	for (size_t i = 0; i < Listing->Count; i++)
+		HeapFree(GetProcessHeap(), 0, Listing->Items[i].Name);
+	if (Listing->Items != NULL)
+		HeapFree(GetProcessHeap(), 0, Listing->Items);
+	ZeroMemory(Listing, sizeof(*Listing));
+}
+
+/**
+ * @brief Compares two entry names the way the file system matches them.
+ *
+ * Windows matches names case-insensitively. POSIX file systems are
+ * case-sensitive, so there "Readme" and "README" are different entries.
+ *
+ * @internal
+ */
+static int
+CompareTreeNames(_In_z_ const WCHAR* A, _In_z_ const WCHAR* B)
+{
+#ifdef _WIN32
+	return _wcsicmp(A, B);
+#else
+	return wcscmp(A, B);
+#endif
+}
+
+static int __cdecl
+CompareDirItems(_In_ const void* A, _In_ const void* B)
+{
+	return CompareTreeNames(((const TREE_DIR_ITEM*)A)->Name, ((const TREE_DIR_ITEM*)B)->Name);
+}
+
+/**
+ * @brief Lists the immediate children of a directory, sorted by name.
+ *
+ * "." and ".." are skipped. Names are ordered by CompareTreeNames().
+ *
+ * @internal
+ * @param Directory The directory to enumerate.
+ * @param Listing   Receives the children. Freed with FreeDirListing().
+ * @param OutOfMemory Set to TRUE when the failure was an allocation failure.
+ * @return TRUE on success, FALSE if the directory could not be enumerated.
+ */
+static BOOL
+ListDirectory(
+	_In_z_ const WCHAR* Directory,
+	_Out_ TREE_DIR_LISTING* Listing,
+	_Out_ BOOL* OutOfMemory)
+{
+	ZeroMemory(Listing, sizeof(*Listing));
+	*OutOfMemory = FALSE;
+
+	WCHAR* Pattern = JoinPathAlloc(Directory, L"*");
+	if (Pattern == NULL)
+	{
+		*OutOfMemory = TRUE;
+		return FALSE;
+	}
+
+	WIN32_FIND_DATAW FindData;
+	HANDLE hFind = FindFirstFileW(Pattern, &FindData);
+	HeapFree(GetProcessHeap(), 0, Pattern);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	do
+	{
+		if (wcscmp(FindData.cFileName, L".") == 0 || wcscmp(FindData.cFileName, L"..") == 0)
+			continue;
+
+		if (Listing->Count >= Listing->Capacity)
+		{
+			size_t NewCapacity = (Listing->Capacity > 0) ? Listing->Capacity * 2 : 32;
+			if (NewCapacity > SIZE_MAX / sizeof(TREE_DIR_ITEM))
+			{
+				*OutOfMemory = TRUE;
+				break;
+			}
+			TREE_DIR_ITEM* NewItems = (Listing->Items == NULL)
+				? (TREE_DIR_ITEM*)HeapAlloc(GetProcessHeap(), 0, NewCapacity * sizeof(TREE_DIR_ITEM))
+				: (TREE_DIR_ITEM*)HeapReAlloc(GetProcessHeap(), 0, Listing->Items, NewCapacity * sizeof(TREE_DIR_ITEM));
+			if (NewItems == NULL)
+			{
+				*OutOfMemory = TRUE;
+				break;
+			}
+			Listing->Items = NewItems;
+			Listing->Capacity = NewCapacity;
+		}
+
+		TREE_DIR_ITEM* Item = &Listing->Items[Listing->Count];
+		Item->Name = DuplicateStringAlloc(FindData.cFileName);
+		if (Item->Name == NULL)
+		{
+			*OutOfMemory = TRUE;
+			break;
+		}
+		Item->IsDirectory = (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		Item->IsReparsePoint = (FindData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+		Item->Size = ((ULONGLONG)FindData.nFileSizeHigh << 32) | FindData.nFileSizeLow;
+		Listing->Count++;
+	} while (FindNextFileW(hFind, &FindData));
+
+	FindClose(hFind);
+
+	if (*OutOfMemory)
+	{
+		FreeDirListing(Listing);
+		return FALSE;
+	}
+
+	if (Listing->Count > 1)
+		qsort(Listing->Items, Listing->Count, sizeof(TREE_DIR_ITEM), CompareDirItems);
+	return TRUE;
+}
+
+/**
+ * @brief Pushes a task onto the bottom (owner end) of a deque.
+ * @internal
+ * @return TRUE on success, FALSE on allocation failure.
+ */
+static BOOL
+TreeDequePush(_Inout_ TREE_DEQUE* Deque, _In_ TREE_TASK* Task)
+{
+	BOOL Ok = TRUE;
+	AcquireSRWLockExclusive(&Deque->Lock);
+
+	if (Deque->Count >= Deque->Capacity)
+	{
+		size_t NewCapacity = (Deque->Capacity > 0) ? Deque->Capacity * 2 : 64;
+		TREE_TASK** NewItems = (NewCapacity <= SIZE_MAX / sizeof(TREE_TASK*))
+			? (TREE_TASK**)HeapAlloc(GetProcessHeap(), 0, NewCapacity * sizeof(TREE_TASK*))
+			: NULL;
+		if (NewItems == NULL)
+		{
+			Ok = FALSE;
+		}
+		else
+		{
+			// Unwrap the ring so the oldest task lands at index 0.
+			for (size_t i = 0; i < Deque->Count; i++)
+				NewItems[i] = Deque->Items[(Deque->Head + i) % Deque->Capacity];
+			if (Deque->Items != NULL)
+				HeapFree(GetProcessHeap(), 0, Deque->Items);
+			Deque->Items = NewItems;
+			Deque->Head = 0;
+			Deque->Capacity = NewCapacity;
+		}
+	}
+
+	if (Ok)
+	{
+		Deque->Items[(Deque->Head + Deque->Count) % Deque->Capacity] = Task;
+		Deque->Count++;
+	}
+
+	ReleaseSRWLockExclusive(&Deque->Lock);
+	return Ok;
+}
+
+/**
+ * @brief Pops the most recently pushed task (owner end).
+ * @internal
+ */
+static TREE_TASK*
+TreeDequePopBottom(_Inout_ TREE_DEQUE* Deque)
+{
+	TREE_TASK* Task = NULL;
+	AcquireSRWLockExclusive(&Deque->Lock);
+	if (Deque->Count > 0)
+	{
+		Deque->Count--;
+		Task = Deque->Items[(Deque->Head + Deque->Count) % Deque->Capacity];
+	}
+	ReleaseSRWLockExclusive(&Deque->Lock);
+	return Task;
+}
+
+/**
+ * @brief Steals the oldest task (thief end).
+ *
+ * Older tasks sit closer to the tree roots, so a thief tends to take a large
+ * subtree rather than a single file.
+ *
+ * @internal
+ */
+static TREE_TASK*
+TreeDequeStealTop(_Inout_ TREE_DEQUE* Deque)
+{
+	TREE_TASK* Task = NULL;
+	AcquireSRWLockExclusive(&Deque->Lock);
+	if (Deque->Count > 0)
+	{
+		Task = Deque->Items[Deque->Head];
+		Deque->Head = (Deque->Head + 1) % Deque->Capacity;
+		Deque->Count--;
+	}
+	ReleaseSRWLockExclusive(&Deque->Lock);
+	return Task;
+}
+
+static void
+FreeTreeTask(_In_opt_ TREE_TASK* Task)
+{
+	if (Task == NULL)
+		return;
+	if (Task->RelativePath != NULL)
+		HeapFree(GetProcessHeap(), 0, Task->RelativePath);
+	if (Task->RightPath != NULL)
+		HeapFree(GetProcessHeap(), 0, Task->RightPath);
+	HeapFree(GetProcessHeap(), 0, Task);
+}
+
+/**
+ * @brief Wakes idle workers after work was queued (one) or the pool drained (All).
+ *
+ * The generation is bumped under IdleLock, so a worker that checked for work
+ * and is about to sleep either sees the bump or is already waiting.
+ *
+ * @internal
+ */
+static void
+SignalTreePool(_Inout_ TREE_POOL* Pool, _In_ BOOL All)
+{
+	AcquireSRWLockExclusive(&Pool->IdleLock);
+	InterlockedIncrement(&Pool->IdleGeneration);
+	ReleaseSRWLockExclusive(&Pool->IdleLock);
+	if (All)
+		WakeAllConditionVariable(&Pool->IdleCondition);
+	else
+		WakeConditionVariable(&Pool->IdleCondition);
+}
+
+/**
+ * @brief Queues a new task on a worker's own deque.
+ *
+ * Takes ownership of RelativePath and RightPath in all cases. A NULL
+ * RelativePath is an allocation failure; a NULL RightPath means the right
+ * tree uses RelativePath too. On failure the pool's HadError flag is raised
+ * so the run ends with an error exit code.
+ *
+ * @internal
+ */
+static void
+SubmitTreeTask(
+	_In_ TREE_WORKER* Worker,
+	_In_ TREE_TASK_TYPE Type,
+	_In_opt_ WCHAR* RelativePath,
+	_In_opt_ WCHAR* RightPath,
+	_In_ ULONGLONG SizeLeft,
+	_In_ ULONGLONG SizeRight)
+{
+	TREE_POOL* Pool = Worker->Pool;
+	TREE_TASK* Task = NULL;
+
+	if (RelativePath != NULL)
+		Task = (TREE_TASK*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TREE_TASK));
+	if (Task == NULL)
+	{
+		if (RelativePath != NULL)
+			HeapFree(GetProcessHeap(), 0, RelativePath);
+		if (RightPath != NULL)
+			HeapFree(GetProcessHeap(), 0, RightPath);
+		InterlockedExchange(&Pool->HadError, 1);
+		return;
+	}
+
+	Task->Type = Type;
+	Task->RelativePath = RelativePath;
+	Task->RightPath = RightPath;
+	Task->SizeLeft = SizeLeft;
+	Task->SizeRight = SizeRight;
+
+	// Count the task before it becomes visible so the pool cannot appear
+	// drained while it is still queued.
+	InterlockedIncrement(&Pool->PendingTasks);
+	if (!TreeDequePush(&Worker->Deque, Task))
+	{
+		InterlockedDecrement(&Pool->PendingTasks);
+		FreeTreeTask(Task);
+		InterlockedExchange(&Pool->HadError, 1);
+		return;
+	}
+	SignalTreePool(Pool, FALSE);
+}
+
+/**
+ * @brief Appends a result entry to the pool. Takes ownership of the entry's
+ * RelativePath and Output buffer in all cases.
+ * @internal
+ */
+static void
+AddTreeEntry(_Inout_ TREE_POOL* Pool, _In_ TREE_ENTRY* Entry)
+{
+	BOOL Ok = (Entry->RelativePath != NULL);
+
+	AcquireSRWLockExclusive(&Pool->EntriesLock);
+	if (Ok && Pool->EntryCount >= Pool->EntryCapacity)
+	{
+		size_t NewCapacity = (Pool->EntryCapacity > 0) ? Pool->EntryCapacity * 2 : 64;
+		TREE_ENTRY* NewEntries = NULL;
+		if (NewCapacity <= SIZE_MAX / sizeof(TREE_ENTRY))
+		{
+			NewEntries = (Pool->Entries == NULL)
+				? (TREE_ENTRY*)HeapAlloc(GetProcessHeap(), 0, NewCapacity * sizeof(TREE_ENTRY))
+				: (TREE_ENTRY*)HeapReAlloc(GetProcessHeap(), 0, Pool->Entries, NewCapacity * sizeof(TREE_ENTRY));
+		}
+		if (NewEntries == NULL)
+		{
+			Ok = FALSE;
+		}
+		else
+		{
+			Pool->Entries = NewEntries;
+			Pool->EntryCapacity = NewCapacity;
+		}
+	}
+	if (Ok)
+		Pool->Entries[Pool->EntryCount++] = *Entry;
+	ReleaseSRWLockExclusive(&Pool->EntriesLock);
+
+	if (!Ok)
+	{
+		if (Entry->RelativePath != NULL)
+			HeapFree(GetProcessHeap(), 0, Entry->RelativePath);
+		if (Entry->Output.Text != NULL)
+			HeapFree(GetProcessHeap(), 0, Entry->Output.Text);
+		InterlockedExchange(&Pool->HadError, 1);
+	}
+}
+
+/**
+ * @brief Records an entry that exists in only one tree.
+ * @internal
+ */
+static void
+AddOnlyInEntry(
+	_Inout_ TREE_POOL* Pool,
+	_In_z_ const WCHAR* ParentRelative,
+	_In_ const TREE_DIR_ITEM* Item,
+	_In_ int Side)
+{
+	TREE_ENTRY Entry = { 0 };
+	Entry.Kind = TREE_ENTRY_ONLY_IN;
+	Entry.Side = Side;
+	Entry.IsDirectory = Item->IsDirectory;
+	Entry.RelativePath = JoinPathAlloc(ParentRelative, Item->Name);
+	AddTreeEntry(Pool, &Entry);
+}
+
+/**
+ * @brief Scans one relative directory in both trees and merges the listings.
+ *
+ * Common subdirectories become new scan tasks and common files become
+ * comparison tasks. Reparse-point directories (junctions, directory
+ * symbolic links) are not descended into, which rules out cycles.
+ *
+ * @internal
+ */
+static void
+RunTreeScanTask(_In_ TREE_WORKER* Worker, _In_ TREE_TASK* Task)
+{
+	TREE_POOL* Pool = Worker->Pool;
+	const WCHAR* Roots[2] = { Pool->LeftRoot, Pool->RightRoot };
+
+	const WCHAR* Relatives[2] = { Task->RelativePath, (Task->RightPath != NULL) ? Task->RightPath : Task->RelativePath };
+	TREE_DIR_LISTING Listings[2];
+	BOOL Listed[2] = { FALSE, FALSE };
+
+	for (int Side = 0; Side < 2; Side++)
+	{
+		BOOL OutOfMemory = FALSE;
+		WCHAR* Directory = JoinPathAlloc(Roots[Side], Relatives[Side]);
+		if (Directory == NULL)
+		{
+			OutOfMemory = TRUE;
+			ZeroMemory(&Listings[Side], sizeof(Listings[Side]));
+		}
+		else
+		{
+			Listed[Side] = ListDirectory(Directory, &Listings[Side], &OutOfMemory);
+			HeapFree(GetProcessHeap(), 0, Directory);
+		}
+
+		if (OutOfMemory)
+		{
+			InterlockedExchange(&Pool->HadError, 1);
+		}
+		else if (!Listed[Side])
+		{
+			TREE_ENTRY Entry = { 0 };
+			Entry.Kind = TREE_ENTRY_ENUM_ERROR;
+			Entry.Side = Side;
+			Entry.RelativePath = DuplicateStringAlloc(Relatives[Side]);
+			AddTreeEntry(Pool, &Entry);
+		}
+	}
+
+	if (Listed[0] && Listed[1])
+	{
+		const TREE_DIR_LISTING* Left = &Listings[0];
+		const TREE_DIR_LISTING* Right = &Listings[1];
+		size_t i = 0, j = 0;
+
+		while (i < Left->Count || j < Right->Count)
+		{
+			int Cmp;
+			if (i >= Left->Count)
+				Cmp = 1;
+			else if (j >= Right->Count)
+				Cmp = -1;
+			else
+				Cmp = CompareTreeNames(Left->Items[i].Name, Right->Items[j].Name);
+
+			if (Cmp < 0)
+			{
+				AddOnlyInEntry(Pool, Task->RelativePath, &Left->Items[i++], 0);
+				continue;
+			}
+			if (Cmp > 0)
+			{
+				AddOnlyInEntry(Pool, Relatives[1], &Right->Items[j++], 1);
+				continue;
+			}
+
+			const TREE_DIR_ITEM* ItemL = &Left->Items[i++];
+			const TREE_DIR_ITEM* ItemR = &Right->Items[j++];
+			WCHAR* Relative = JoinPathAlloc(Task->RelativePath, ItemL->Name);
+
+			// Names matched case-insensitively may differ in case; the right
+			// tree then keeps its own spelling of the path.
+			WCHAR* RightRelative = NULL;
+			if (Task->RightPath != NULL || wcscmp(ItemL->Name, ItemR->Name) != 0)
+			{
+				RightRelative = JoinPathAlloc(Relatives[1], ItemR->Name);
+				if (RightRelative == NULL && Relative != NULL)
+				{
+					HeapFree(GetProcessHeap(), 0, Relative);
+					Relative = NULL;
+				}
+			}
+
+			if (ItemL->IsDirectory && ItemR->IsDirectory)
+			{
+				if (ItemL->IsReparsePoint || ItemR->IsReparsePoint)
+				{
+					if (Relative != NULL)
+						HeapFree(GetProcessHeap(), 0, Relative);
+					else
+						InterlockedExchange(&Pool->HadError, 1);
+					if (RightRelative != NULL)
+						HeapFree(GetProcessHeap(), 0, RightRelative);
+					continue;
+				}
+				SubmitTreeTask(Worker, TREE_TASK_SCAN_DIR, Relative, RightRelative, 0, 0);
+			}
+			else if (!ItemL->IsDirectory && !ItemR->IsDirectory)
+			{
+				SubmitTreeTask(Worker, TREE_TASK_COMPARE_FILES, Relative, RightRelative, ItemL->Size, ItemR->Size);
+			}
+			else
+			{
+				if (RightRelative != NULL)
+					HeapFree(GetProcessHeap(), 0, RightRelative);
+				TREE_ENTRY Entry = { 0 };
+				Entry.Kind = TREE_ENTRY_TYPE_MISMATCH;
+				Entry.RelativePath = Relative;
+				AddTreeEntry(Pool, &Entry);
+			}
+		}
+	}
+
+	if (Listed[0])
+		FreeDirListing(&Listings[0]);
+	if (Listed[1])
+		FreeDirListing(&Listings[1]);
+}
+
+/**
+ * @brief Compares one file pair that exists in both trees.
+ *
+ * In equality-only binary mode (/Q /B) a size mismatch decides the result
+ * without opening either file. Otherwise output is captured per pair and
+ * printed later in path order.
+ *
+ * @internal
+ */
+static void
+RunTreeCompareTask(_In_ TREE_WORKER* Worker, _In_ TREE_TASK* Task)
+{
+	TREE_POOL* Pool = Worker->Pool;
+	TREE_ENTRY Entry = { 0 };
+	Entry.Kind = TREE_ENTRY_COMPARED;
+
+	if (Pool->QuietMode && Pool->Config->Mode == FC_MODE_BINARY && Task->SizeLeft != Task->SizeRight)
+	{
+		Entry.Result = FC_DIFFERENT;
+		Entry.SizeOnly = TRUE;
+	}
+	else
+	{
+		WCHAR* File1 = JoinPathAlloc(Pool->LeftRoot, Task->RelativePath);
+		WCHAR* File2 = JoinPathAlloc(Pool->RightRoot, (Task->RightPath != NULL) ? Task->RightPath : Task->RelativePath);
+		if (File1 == NULL || File2 == NULL)
+		{
+			Entry.Result = FC_ERROR_MEMORY;
+		}
+		else
+		{
+			HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+			g_ThreadOutput = &Entry.Output;
+			if (!Pool->QuietMode)
+			{
+				ConPrintW(hOut, L"Comparing files ");
+				ConPrintW(hOut, File1);
+				ConPrintW(hOut, L" and ");
+				ConPrintW(hOut, File2);
+				ConPrintW(hOut, L"\n\n");
+			}
+
+			Worker->Config.TracePair = (ULONGLONG)(InterlockedIncrement64(&Pool->NextPair) - 1);
+
+			// Each worker is driven by exactly one thread, which satisfies the
+			// session's thread-affinity rule.
+			Entry.Result = CompareFilePair(Worker->Session, File1, File2, &Worker->Config);
+
+			if (!Pool->QuietMode && Entry.Result == FC_OK)
+				ConPrintW(hOut, L"FC: no differences encountered\n");
+			g_ThreadOutput = NULL;
+
+			if (Entry.Output.HadError)
+				InterlockedExchange(&Pool->HadError, 1);
+		}
+		if (File1 != NULL)
+			HeapFree(GetProcessHeap(), 0, File1);
+		if (File2 != NULL)
+			HeapFree(GetProcessHeap(), 0, File2);
+	}
+
+	// Hand the relative path over to the entry.
+	Entry.RelativePath = Task->RelativePath;
+	Task->RelativePath = NULL;
+	AddTreeEntry(Pool, &Entry);
+}
+
+/**
+ * @brief Worker thread body: run own tasks, steal when idle, exit when drained.
+ * @internal
+ */
+static DWORD WINAPI
+TreeWorkerProc(_In_ LPVOID Parameter)
+{
+	TREE_WORKER* Self = (TREE_WORKER*)Parameter;
+	TREE_POOL* Pool = Self->Pool;
+
+	for (;;)
+	{
+		// Taken before looking for work: a task queued after this point bumps it.
+		LONG Generation = InterlockedCompareExchange(&Pool->IdleGeneration, 0, 0);
+		TREE_TASK* Task = TreeDequePopBottom(&Self->Deque);
+		for (DWORD i = 1; Task == NULL && i < Pool->WorkerCount; i++)
+			Task = TreeDequeStealTop(&Pool->Workers[(Self->Index + i) % Pool->WorkerCount].Deque);
+
+		if (Task != NULL)
+		{
+			if (Task->Type == TREE_TASK_SCAN_DIR)
+				RunTreeScanTask(Self, Task);
+			else
+				RunTreeCompareTask(Self, Task);
+			FreeTreeTask(Task);
+
+			if (InterlockedDecrement(&Pool->PendingTasks) == 0)
+				SignalTreePool(Pool, TRUE);
+			continue;
+		}
+
+		if (InterlockedCompareExchange(&Pool->PendingTasks, 0, 0) == 0)
+			break;
+
+		// Work is still in flight on another worker and may fan out. Sleep
+		// until a task is queued or the pool drains; a bump since Generation
+		// was taken means one of them already happened.
+		AcquireSRWLockExclusive(&Pool->IdleLock);
+		while (InterlockedCompareExchange(&Pool->PendingTasks, 0, 0) != 0 &&
+			InterlockedCompareExchange(&Pool->IdleGeneration, 0, 0) == Generation)
+			SleepConditionVariableSRW(&Pool->IdleCondition, &Pool->IdleLock, INFINITE, 0);
+		ReleaseSRWLockExclusive(&Pool->IdleLock);
+	}
+
+	return 0;
+}
+
+static int __cdecl
+CompareTreeEntries(_In_ const void* A, _In_ const void* B)
+{
+	const TREE_ENTRY* EntryA = (const TREE_ENTRY*)A;
+	const TREE_ENTRY* EntryB = (const TREE_ENTRY*)B;
+	int Cmp = _wcsicmp(EntryA->RelativePath, EntryB->RelativePath);
+	if (Cmp == 0)
+		Cmp = wcscmp(EntryA->RelativePath, EntryB->RelativePath);
+	if (Cmp != 0)
+		return Cmp;
+	return EntryA->Side - EntryB->Side;
+}
+
+/**
+ * @brief Prints one sorted tree entry and folds it into the overall result.
+ * @internal
+ */
+static void
+PrintTreeEntry(
+	_In_ const TREE_POOL* Pool,
+	_In_ const TREE_ENTRY* Entry,
+	_Inout_ int* OverallResult)
+{
+	HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+	const WCHAR* Root = (Entry->Side == 0) ? Pool->LeftRoot : Pool->RightRoot;
+
+	switch (Entry->Kind)
+	{
+	case TREE_ENTRY_ONLY_IN:
+		ConPrintW(hOut, L"FC: only in ");
+		ConPrintW(hOut, Root);
+		ConPrintW(hOut, L": ");
+		ConPrintW(hOut, Entry->RelativePath);
+		ConPrintW(hOut, Entry->IsDirectory ? CLI_PATH_SEPARATOR L"\n" : L"\n");
+		if (*OverallResult < 1)
+			*OverallResult = 1;
+		break;
+
+	case TREE_ENTRY_TYPE_MISMATCH:
+		ConPrintW(hOut, L"FC: ");
+		ConPrintW(hOut, Entry->RelativePath);
+		ConPrintW(hOut, L" is a directory in one tree and a file in the other\n");
+		if (*OverallResult < 1)
+			*OverallResult = 1;
+		break;
+
+	case TREE_ENTRY_ENUM_ERROR:
+	{
+		HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
+		ConPrintW(hErr, L"Error: cannot enumerate directory ");
+		ConPrintW(hErr, Root);
+		if (Entry->RelativePath[0] != L'\0')
+		{
+			ConPrintW(hErr, CLI_PATH_SEPARATOR);
+			ConPrintW(hErr, Entry->RelativePath);
+		}
+		ConPrintW(hErr, L"\n");
+		*OverallResult = 2;
+		break;
+	}
+
+	case TREE_ENTRY_COMPARED:
+		if (Entry->Output.Text != NULL)
+			ConPrintW(hOut, Entry->Output.Text);
+
+		switch (Entry->Result)
+		{
+		case FC_OK:
+			break;
+		case FC_DIFFERENT:
+			if (Pool->QuietMode)
+			{
+				ConPrintW(hOut, L"FC: files differ");
+				ConPrintW(hOut, Entry->SizeOnly ? L" (size): " : L": ");
+				ConPrintW(hOut, Entry->RelativePath);
+				ConPrintW(hOut, L"\n");
+			}
+			if (*OverallResult < 1)
+				*OverallResult = 1;
+			break;
+		case FC_ERROR_IO:
+		case FC_ERROR_MEMORY:
+		{
+			HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
+			WCHAR errBuf[32];
+			ConPrintW(hErr, L"Error during comparison of ");
+			ConPrintW(hErr, Entry->RelativePath);
+			swprintf_s(errBuf, 32, L": %d\n", Entry->Result);
+			ConPrintW(hErr, errBuf);
+			*OverallResult = 2;
+			break;
+		}
+		default:
+			if (*OverallResult == 0)
+				*OverallResult = -1;
+			break;
+		}
+		break;
+	}
+}
+
+/**
+ * @brief Compares two directory trees recursively (/TREE).
+ *
+ * Relative paths are matched case-insensitively. Entries present in only
+ * one tree are reported once (a missing directory is not expanded), common
+ * files are compared with Config, and a summary line closes the report.
+ *
+ * @param LeftRoot  Root directory of the first tree.
+ * @param RightRoot Root directory of the second tree.
+ * @param Config    The already-configured FC_CONFIG to use for each file pair.
+ * @param QuietMode TRUE for equality-only reporting (/Q).
+ * @return 0 if the trees are identical, 1 if anything differs, 2 on I/O or
+ *         memory error, -1 on argument/usage errors.
+ */
+static int
+TreeCompare(
+	_In_z_ const WCHAR* LeftRoot,
+	_In_z_ const WCHAR* RightRoot,
+	_In_   const FC_CONFIG* Config,
+	_In_   BOOL QuietMode)
+{
+	const WCHAR* Roots[2] = { LeftRoot, RightRoot };
+	for (int Side = 0; Side < 2; Side++)
+	{
+		DWORD Attributes = GetFileAttributesW(Roots[Side]);
+		if (Attributes == INVALID_FILE_ATTRIBUTES || (Attributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+		{
+			HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+			ConPrintW(hOut, L"FC: not a directory: ");
+			ConPrintW(hOut, Roots[Side]);
+			ConPrintW(hOut, L"\n");
+			return -1;
+		}
+	}
+
+	SYSTEM_INFO SystemInfo;
+	GetSystemInfo(&SystemInfo);
+	DWORD WorkerCount = SystemInfo.dwNumberOfProcessors;
+	if (WorkerCount < 1)
+		WorkerCount = 1;
+	if (WorkerCount > TREE_MAX_WORKERS)
+		WorkerCount = TREE_MAX_WORKERS;
+
+	TREE_POOL Pool;
+	ZeroMemory(&Pool, sizeof(Pool));
+	Pool.LeftRoot = LeftRoot;
+	Pool.RightRoot = RightRoot;
+	Pool.Config = Config;
+	Pool.QuietMode = QuietMode;
+	Pool.WorkerCount = WorkerCount;
+	InitializeSRWLock(&Pool.IdleLock);
+	InitializeConditionVariable(&Pool.IdleCondition);
+	InitializeSRWLock(&Pool.EntriesLock);
+
+	Pool.Workers = (TREE_WORKER*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, WorkerCount * sizeof(TREE_WORKER));
+	if (Pool.Workers == NULL)
+	{
+		ConPrintW(GetStdHandle(STD_ERROR_HANDLE), L"Error: memory allocation failure during tree comparison.\n");
+		return 2;
+	}
+	for (DWORD i = 0; i < WorkerCount; i++)
+	{
+		Pool.Workers[i].Pool = &Pool;
+		Pool.Workers[i].Index = i;
+		// Workers collect statistics separately; they are totalled once the pool drains.
+		Pool.Workers[i].Config = *Config;
+		if (Config->Stats != NULL)
+			Pool.Workers[i].Config.Stats = &Pool.Workers[i].Stats;
+		InitializeSRWLock(&Pool.Workers[i].Deque.Lock);
+		if (FC_SessionCreate(&Pool.Workers[i].Session) != FC_OK)
+			Pool.Workers[i].Session = NULL;
+	}
+
+	// Seed the pool with a scan of the roots, then start the workers. Worker 0
+	// runs on this thread, so the comparison still completes if no additional
+	// thread can be created.
+	SubmitTreeTask(&Pool.Workers[0], TREE_TASK_SCAN_DIR, DuplicateStringAlloc(L""), NULL, 0, 0);
+
+	HANDLE Threads[TREE_MAX_WORKERS];
+	DWORD ThreadCount = 0;
+	for (DWORD i = 1; i < WorkerCount; i++)
+	{
+		HANDLE hThread = CreateThread(NULL, 0, TreeWorkerProc, &Pool.Workers[i], 0, NULL);
+		if (hThread != NULL)
+			Threads[ThreadCount++] = hThread;
+	}
+	TreeWorkerProc(&Pool.Workers[0]);
+	if (ThreadCount > 0)
+		WaitForMultipleObjects(ThreadCount, Threads, TRUE, INFINITE);
+	for (DWORD i = 0; i < ThreadCount; i++)
+		CloseHandle(Threads[i]);
+
+	if (Pool.EntryCount > 1)
+		qsort(Pool.Entries, Pool.EntryCount, sizeof(TREE_ENTRY), CompareTreeEntries);
+
+	HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+	ConPrintW(hOut, L"Comparing directories ");
+	ConPrintW(hOut, LeftRoot);
+	ConPrintW(hOut, L" and ");
+	ConPrintW(hOut, RightRoot);
+	ConPrintW(hOut, L"\n\n");
+
+	int OverallResult = 0;
+	size_t Compared = 0, Different = 0, OnlyLeft = 0, OnlyRight = 0;
+	for (size_t i = 0; i < Pool.EntryCount; i++)
+	{
+		const TREE_ENTRY* Entry = &Pool.Entries[i];
+		PrintTreeEntry(&Pool, Entry, &OverallResult);
+
+		if (Entry->Kind == TREE_ENTRY_COMPARED)
+		{
+			Compared++;
+			if (Entry->Result == FC_DIFFERENT)
+				Different++;
+		}
+		else if (Entry->Kind == TREE_ENTRY_ONLY_IN)
+		{
+			if (Entry->Side == 0)
+				OnlyLeft++;
+			else
+				OnlyRight++;
+		}
+		else if (Entry->Kind == TREE_ENTRY_TYPE_MISMATCH)
+		{
+			Different++;
+		}
+
+		HeapFree(GetProcessHeap(), 0, Entry->RelativePath);
+		if (Entry->Output.Text != NULL)
+			HeapFree(GetProcessHeap(), 0, Entry->Output.Text);
+	}
+
+	WCHAR Summary[192];
+	swprintf_s(Summary, 192, L"FC: %zu file(s) compared, %zu different, %zu only in first tree, %zu only in second tree\n",
+		Compared, Different, OnlyLeft, OnlyRight);
+	ConPrintW(hOut, Summary);
+
+	if (Pool.HadError)
+	{
+		ConPrintW(GetStdHandle(STD_ERROR_HANDLE), L"Error: memory allocation failure during tree comparison.\n");
+		OverallResult = 2;
+	}
+
+	for (DWORD i = 0; i < WorkerCount; i++)
+	{
+		if (Config->Stats != NULL)
+			AddStats(Config->Stats, &Pool.Workers[i].Stats);
+		if (Pool.Workers[i].Deque.Items != NULL)
+			HeapFree(GetProcessHeap(), 0, Pool.Workers[i].Deque.Items);
+		FC_SessionClose(Pool.Workers[i].Session);
+	}
+	HeapFree(GetProcessHeap(), 0, Pool.Workers);
+	if (Pool.Entries != NULL)
+		HeapFree(GetProcessHeap(), 0, Pool.Entries);
+
+	return OverallResult;
+}
+
+/**
+ * @brief Reports whether a command-line argument is a switch rather than a path.
+ *
+ * Switches begin with '/' or '-'. On POSIX systems '/' also begins every
+ * absolute path, so there an argument is a switch only when no further '/'
+ * appears before the first ':' — switch names never contain one, although a
+ * switch value such as /CACHE:/tmp/fc.cache may.
+ *
+ * @internal
+ */
+static BOOL
+IsSwitchArgument(_In_z_ const WCHAR* Arg)
+{
+	if (Arg[0] == L'-')
+		return TRUE;
+	if (Arg[0] != L'/')
+		return FALSE;
+#ifndef _WIN32
+	for (const WCHAR* p = Arg + 1; *p != L'\0' && *p != L':'; p++)
+	{
+		if (*p == L'/')
+			return FALSE;
+	}
+#endif
+	return TRUE;
+}
+
+//
+// Enables SeLockMemoryPrivilege for /LARGEPAGES; Windows requires it for
+// large-page allocations. The account also needs the "Lock pages in memory"
+// right. If either is missing, the library quietly stays on its heap. Linux
+// needs no privilege for transparent huge pages.
+//
+static void
+EnableLargePagePrivilege(void)
+{
+#ifdef _WIN32
+	HANDLE Token;
+	TOKEN_PRIVILEGES Privileges = { 0 };
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &Token))
+		return;
+	Privileges.PrivilegeCount = 1;
+	Privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	if (LookupPrivilegeValueW(NULL, SE_LOCK_MEMORY_NAME, &Privileges.Privileges[0].Luid))
+		AdjustTokenPrivileges(Token, FALSE, &Privileges, 0, NULL, NULL);
+	CloseHandle(Token);
+#endif
+}
+
+//
+// Main entry point for the application.
+// Using wmain to natively support Unicode command-line arguments.
+//
+int
+wmain(
+	_In_ int argc,
+	_In_reads_(argc) WCHAR * argv[])
+{
+	// Special-case: fc /? or fc -? with no file arguments — print usage and exit 0.
+	if (argc == 2 && IsSwitchArgument(argv[1]) && argv[1][1] == L'?')
+	{
+		PrintUsage();
+		return 0;
+	}
+
+	if (argc < 3)
+	{
+		PrintUsage();
+		return -1; // Syntax error
+	}
+
+	FC_CONFIG Config = { 0 }; // Initialize all fields to zero
+	CLI_CALLBACK_USER_DATA CallbackUserData = { 0 }; // User data for CLI diff callbacks
+
+	// Set non-zero defaults
+	Config.Mode = FC_MODE_AUTO;
+	Config.ResyncLines = 2;
+	Config.BufferLines = 100;
+	Config.MaxTextFileBytes = (size_t)FC_DEFAULT_MAX_TEXT_FILE_BYTES;
+
+	// Options may appear anywhere in the argument list — before, between, or
+	// after the two file paths — matching Windows fc.exe behaviour.
+	// Non-option arguments are collected in order as the two file paths.
+	const WCHAR* FileArgs[2] = { NULL, NULL };
+	int FileCount = 0;
+	BOOL TreeMode = FALSE;
+	BOOL QuietMode = FALSE;
+	BOOL InlineMode = FALSE;
+	BOOL StatsMode = FALSE;
+	FC_STATS Stats = { 0 };
+	const WCHAR* CachePath = NULL;
+	const WCHAR* TracePath = NULL;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		WCHAR* Arg = argv[i];
+
+		if (IsSwitchArgument(Arg))
+		{
+			// Handle /? — print usage and exit.
+			if (Arg[1] == L'?')
+			{
+				PrintUsage();
+				return 0;
+			}
+			// NOTE (intentional divergence): /OFF and /OFFLINE are currently accepted
+			// as compatibility switches but treated as no-ops.
+			// See README "Documented Differences from Windows fc.exe".
+			else if (_wcsicmp(Arg + 1, L"OFF") == 0 || _wcsicmp(Arg + 1, L"OFFLINE") == 0)
+			{
+				// No-op: accepted for compatibility with Windows fc.exe.
+			}
+			// Multi-character switches must be matched before the single-character
+			// table below, which would otherwise read /TREE as /T.
+			else if (_wcsicmp(Arg + 1, L"TREE") == 0)
+			{
+				TreeMode = TRUE;
+			}
+			else if (_wcsicmp(Arg + 1, L"Q") == 0)
+			{
+				QuietMode = TRUE;
+			}
+			else if (_wcsicmp(Arg + 1, L"INLINE") == 0)
+			{
+				InlineMode = TRUE;
+			}
+			else if (_wcsicmp(Arg + 1, L"STATS") == 0)
+			{
+				StatsMode = TRUE;
+			}
+			else if (_wcsicmp(Arg + 1, L"LCSWARN") == 0)
+			{
+				CallbackUserData.LcsWarnings = TRUE;
+			}
+			else if (_wcsicmp(Arg + 1, L"LARGEPAGES") == 0)
+			{
+				Config.Flags |= FC_LARGE_PAGES;
+				EnableLargePagePrivilege();
+			}
+			else if (_wcsnicmp(Arg + 1, L"MAXMEM:", 7) == 0)
+			{
+				UINT Megabytes;
+				if (!ParseNumericOption(Arg + 8, &Megabytes, 1, UINT_MAX))
+					return -1;
+				ULONGLONG Bytes = (ULONGLONG)Megabytes * 1024 * 1024;
+				Config.MaxMemoryBytes = (Bytes > SIZE_MAX) ? SIZE_MAX : (size_t)Bytes;
+			}
+			else if (_wcsnicmp(Arg + 1, L"CACHE:", 6) == 0)
+			{
+				if (Arg[7] == L'\0')
+				{
+					HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
+					WCHAR buf[256];
+					swprintf_s(buf, 256, L"Invalid option: %ls\n", Arg);
+					ConPrintW(hErr, buf);
+					return -1;
+				}
+				CachePath = Arg + 7;
+			}
+			else if (_wcsnicmp(Arg + 1, L"TRACE:", 6) == 0)
+			{
+				if (Arg[7] == L'\0')
+				{
+					HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
+					WCHAR buf[256];
+					swprintf_s(buf, 256, L"Invalid option: %ls\n", Arg);
+					ConPrintW(hErr, buf);
+					return -1;
+				}
+				TracePath = Arg + 7;
+			}
+			// Check for numeric resync line option (e.g., /20)
+			else if (iswdigit(Arg[1]))
+			{
+				if (!ParseNumericOption(Arg + 1, &Config.ResyncLines, 1, UINT_MAX))
+					return -1;
+			}
+			// Check for buffer line option (e.g., /LB100 or /lb100)
+			else if (_wcsnicmp(Arg + 1, L"LB", 2) == 0)
+			{
+				size_t ArgLen = wcslen(Arg);
+				if (ArgLen <= 3 || !iswdigit((wint_t)Arg[3]))
+				{
+					HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
+					WCHAR buf[256];
+					swprintf_s(buf, 256, L"Invalid option: %ls\n", Arg);
+					ConPrintW(hErr, buf);
+					return -1;
+				}
+
+				if (!ParseNumericOption(Arg + 3, &Config.BufferLines, 1, UINT_MAX))
+					return -1;
+			}
+			else
+			{
+				WCHAR OptionChar = towupper(Arg[1]);
+				BOOL Handled = FALSE;
+
+				for (int j = 0; g_OptionMap[j].OptionChar != 0; ++j)
+				{
+					if (OptionChar == g_OptionMap[j].OptionChar)
+					{
+						if (g_OptionMap[j].FlagToSet)
+							Config.Flags |= g_OptionMap[j].FlagToSet;
+						if (g_OptionMap[j].ModeToSet)
+							Config.Mode = g_OptionMap[j].ModeToSet;
+						Handled = TRUE;
+						break;
+					}
+				}
+
+				if (!Handled)
+				{
+					HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
+					WCHAR buf[256];
+					swprintf_s(buf, 256, L"Invalid option: %ls\n", Arg);
+					ConPrintW(hErr, buf);
+					return -1;
+				}
 			}
 		}
 		else
@@ -1180,48 +2764,88 @@ wmain(
 	}
 
 	// Always use the dispatcher so mode AUTO can route each block format
-	// according to actual detected diff data.
-	Config.DiffCallback = DispatchDiffCallback;
+	// according to actual detected diff data. Equality-only mode discards
+	// the blocks and reports only the overall result.
+	Config.DiffCallback = QuietMode ? QuietDiffCallback : DispatchDiffCallback;
 	CallbackUserData.Flags = Config.Flags;
 	CallbackUserData.DecodeMode = (Config.Mode == FC_MODE_TEXT_ASCII) ? FC_MODE_TEXT_ASCII : FC_MODE_TEXT_UNICODE;
+	CallbackUserData.Inline = InlineMode;
 	Config.UserData = &CallbackUserData;
+	if (StatsMode)
+		Config.Stats = &Stats;
 
 	const WCHAR* File1 = FileArgs[0];
 	const WCHAR* File2 = FileArgs[1];
 
-	if (ContainsWildcard(File1) || ContainsWildcard(File2))
+	// The cache is best effort: if it cannot be opened, compare without it.
+	if (CachePath != NULL && FC_CacheOpenW(CachePath, 0, &Config.Cache) != FC_OK)
 	{
-		return WildcardFileCompare(File1, File2, &Config);
+		ConPrintW(GetStdHandle(STD_ERROR_HANDLE), L"Warning: cache could not be opened; continuing without it.\n");
+		Config.Cache = NULL;
 	}
 
-	HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-	ConPrintW(hOut, L"Comparing files ");
-	ConPrintW(hOut, File1);
-	ConPrintW(hOut, L" and ");
-	ConPrintW(hOut, File2);
-	ConPrintW(hOut, L"\n\n");
-
-	FC_RESULT Result = FC_CompareFilesW(File1, File2, &Config);
+	// Like the cache, tracing is best effort and never fails the comparison.
+	if (TracePath != NULL && FC_TraceOpenW(TracePath, &Config.Trace) != FC_OK)
+	{
+		ConPrintW(GetStdHandle(STD_ERROR_HANDLE), L"Warning: trace file could not be created; continuing without it.\n");
+		Config.Trace = NULL;
+	}
 
-	switch (Result)
+	int ExitCode;
+	if (TreeMode)
 	{
-	case FC_OK:
-		ConPrintW(hOut, L"FC: no differences encountered\n");
-		return 0;
-	case FC_DIFFERENT:
-		// Differences were found and printed by the callback
-		return 1;
-	case FC_ERROR_IO:
-	case FC_ERROR_MEMORY:
+		ExitCode = TreeCompare(File1, File2, &Config, QuietMode);
+	}
+	else if (ContainsWildcard(File1) || ContainsWildcard(File2))
 	{
-		HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
-		WCHAR errBuf[64];
-		swprintf_s(errBuf, 64, L"Error during comparison: %d\n", Result);
-		ConPrintW(hErr, errBuf);
-		return 2;
+		ExitCode = WildcardFileCompare(File1, File2, &Config);
 	}
-	default:
-		// Invalid parameter or other syntax error
-		return -1;
+	else
+	{
+		HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+		ConPrintW(hOut, L"Comparing files ");
+		ConPrintW(hOut, File1);
+		ConPrintW(hOut, L" and ");
+		ConPrintW(hOut, File2);
+		ConPrintW(hOut, L"\n\n");
+
+		FC_RESULT Result = CompareFilePair(NULL, File1, File2, &Config);
+
+		switch (Result)
+		{
+		case FC_OK:
+			ConPrintW(hOut, L"FC: no differences encountered\n");
+			ExitCode = 0;
+			break;
+		case FC_DIFFERENT:
+			// Differences were found and printed by the callback
+			ExitCode = 1;
+			break;
+		case FC_ERROR_IO:
+		case FC_ERROR_MEMORY:
+		{
+			HANDLE hErr = GetStdHandle(STD_ERROR_HANDLE);
+			WCHAR errBuf[64];
+			swprintf_s(errBuf, 64, L"Error during comparison: %d\n", Result);
+			ConPrintW(hErr, errBuf);
+			ExitCode = 2;
+			break;
+		}
+		default:
+			// Invalid parameter or other syntax error
+			ExitCode = -1;
+			break;
+		}
 	}
+
+	if (Config.Cache != NULL && FC_CacheClose(Config.Cache) != FC_OK)
+		ConPrintW(GetStdHandle(STD_ERROR_HANDLE), L"Warning: cache could not be saved.\n");
+
+	if (Config.Trace != NULL && FC_TraceClose(Config.Trace) != FC_OK)
+		ConPrintW(GetStdHandle(STD_ERROR_HANDLE), L"Warning: trace file could not be written completely.\n");
+
+	if (StatsMode)
+		PrintStats(&Stats);
+
+	return ExitCode;
 }
@@ -1,7 +1,7 @@
 /*
  * PROJECT:     FileCheck Library
  * LICENSE:     GPL2
- * PURPOSE:     Header-only file comparison library for Windows.
+ * PURPOSE:     Header-only file comparison library for Windows and Linux.
  * COPYRIGHT:   Copyright 2025 Zafer Balkan
  */
 
@@ -11,8 +11,74 @@
 extern "C" {
 #endif
 
+#ifdef _WIN32
 #include <windows.h>
 #include <winternl.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <wchar.h>
+#include <wctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+	// Elsewhere the library keeps its Win32 vocabulary: the base types the API is
+	// declared with, and SAL annotations that expand to nothing. A compatibility
+	// header included earlier may already provide the same definitions.
+#ifndef _FC_WIN32_TYPES_DEFINED
+#define _FC_WIN32_TYPES_DEFINED
+	typedef int BOOL;
+	typedef unsigned char BYTE;
+	typedef unsigned int UINT;
+	typedef unsigned int DWORD;
+	typedef long long LONGLONG;
+	typedef unsigned long long ULONGLONG;
+	typedef long long LONG64;
+	typedef wchar_t WCHAR;
+	typedef void* HANDLE;
+#define TRUE 1
+#define FALSE 0
+#endif
+#ifndef __cdecl
+#define __cdecl
+#endif
+
+#ifndef _In_
+#define _In_
+#define _In_opt_
+#define _In_z_
+#define _In_opt_z_
+#define _In_reads_(x)
+#define _In_reads_opt_(x)
+#define _In_reads_bytes_(x)
+#define _In_reads_bytes_opt_(x)
+#define _Inout_
+#define _Out_
+#define _Out_opt_
+#define _Out_writes_(x)
+#define _Out_writes_bytes_(x)
+#define _Outptr_result_maybenull_
+#define _Outptr_opt_result_maybenull_
+#define _Outptr_result_buffer_maybenull_(x)
+#define _Outptr_result_nullonfailure_
+#define _Outptr_result_z_
+#define _Reserved_
+#endif
+#endif
 
 	/**
 	 * @enum FC_RESULT
@@ -27,7 +93,8 @@ extern "C" {
 		FC_DIFFERENT,
 		FC_ERROR_IO,
 		FC_ERROR_INVALID_PARAM,
-		FC_ERROR_MEMORY
+		FC_ERROR_MEMORY,
+		FC_CANCELLED            // The progress callback asked the comparison to stop.
 	} FC_RESULT;
 
 	/**
@@ -55,8 +122,10 @@ extern "C" {
 #define FC_SHOW_LINE_NUMS   0x0004  // Show line numbers in output.
 #define FC_RAW_TABS         0x0008  // Do not expand tabs in text comparison.
 #define FC_ABBREVIATED      0x0010  // Abbreviated output: show only first and last line of each diff block.
+#define FC_LARGE_PAGES      0x0020  // Back large working buffers with large pages where the system allows it.
 	 /** @} */
 
+#ifdef _WIN32
 	/**
 	 * @enum RTL_PATH_TYPE
 	 * @brief Describes the type of a DOS-style path as interpreted by Windows internal path normalization routines.
@@ -118,6 +187,7 @@ extern "C" {
 		_Outptr_opt_result_maybenull_ PWSTR* FilePart,
 		_Reserved_ PVOID Reserved
 	);
+#endif
 
 	/**
 	 * @brief Defines the function pointer for a callback that reports comparison differences.
@@ -163,6 +233,39 @@ extern "C" {
 		size_t EndB;            /**< The ending line index (exclusive) in file B's line buffer. */
 	} FC_DIFF_BLOCK;
 
+	/**
+	 * @brief Allocates a block of at least Size bytes; returns NULL on failure.
+	 * @param AllocatorData The `UserData` member of the FC_ALLOCATOR.
+	 */
+	typedef void* (*FC_ALLOC_CALLBACK)(_In_opt_ void* AllocatorData, _In_ size_t Size);
+
+	/**
+	 * @brief Resizes a block returned by the same allocator, preserving its contents.
+	 *        Returns NULL on failure, leaving Block valid. Block is never NULL.
+	 */
+	typedef void* (*FC_REALLOC_CALLBACK)(_In_opt_ void* AllocatorData, _In_ void* Block, _In_ size_t Size);
+
+	/**
+	 * @brief Releases a block returned by the same allocator. Block is never NULL.
+	 */
+	typedef void (*FC_FREE_CALLBACK)(_In_opt_ void* AllocatorData, _In_ void* Block);
+
+	/**
+	 * @struct FC_ALLOCATOR
+	 * @brief Optional memory hooks for a comparison.
+	 *
+	 * Either all three callbacks are set, or none is (the default: the process heap,
+	 * or the session heap for FC_Session* calls). Blocks need only be aligned for
+	 * any fundamental type, as with `malloc`. The callbacks may be called from every
+	 * thread that runs a comparison with this configuration.
+	 */
+	typedef struct {
+		FC_ALLOC_CALLBACK Alloc;        /**< Allocation callback. */
+		FC_REALLOC_CALLBACK Realloc;    /**< Reallocation callback. */
+		FC_FREE_CALLBACK Free;          /**< Release callback. */
+		void* UserData;                 /**< Passed as AllocatorData to each callback. */
+	} FC_ALLOCATOR;
+
 	/**
  * @struct _FC_BUFFER
  * @brief A generic, reusable dynamic buffer for storing contiguous elements.
@@ -179,6 +282,10 @@ extern "C" {
 		size_t ElementSize; // The size of a single element (e.g., sizeof(char)).
 		size_t Count;       // The number of elements currently in the buffer.
 		size_t Capacity;    // The number of elements the buffer can hold before resizing.
+		HANDLE Heap;        // The heap pData lives on, captured by _FC_BufferInit (NULL: process heap).
+		FC_ALLOCATOR Allocator; // Caller's allocator captured by _FC_BufferInit; used instead of Heap when set.
+		BOOL LargePages;    // pData may move to large pages once it reaches FC_LARGE_PAGE_MIN_BYTES.
+		size_t LargeBytes;  // Mapped size when pData came from _FC_PalLargeAlloc, otherwise 0.
 	} _FC_BUFFER;
 
 	/**
@@ -209,6 +316,230 @@ extern "C" {
 	 */
 	typedef void (*FC_DIFF_CALLBACK)(_In_ const FC_USER_CONTEXT* Context, _In_ const FC_DIFF_BLOCK* Block);
 
+	/**
+	 * @enum FC_PROGRESS_PHASE
+	 * @brief Identifies the stage a progress report refers to.
+	 */
+	typedef enum {
+		FC_PHASE_TEXT_PARSE,        /**< Splitting and normalizing lines; units are input bytes of both files. */
+		FC_PHASE_TEXT_COMPARE,      /**< Chunked LCS; units are lines of the first file. */
+		FC_PHASE_BINARY_COMPARE     /**< Byte comparison; units are bytes of the common prefix. */
+	} FC_PROGRESS_PHASE;
+
+	/**
+	 * @brief Defines the function pointer for an optional progress callback.
+	 *
+	 * Called at chunk granularity (one text chunk, or about 1 MB of binary data),
+	 * never per line or per byte. `Done` never decreases within a phase, and each
+	 * phase ends with a report where `Done == Total`.
+	 *
+	 * @param UserData The user-defined pointer from FC_CONFIG.
+	 * @param Phase    The current stage of the comparison.
+	 * @param Done     Units processed so far.
+	 * @param Total    Units in the phase.
+	 * @return TRUE to continue, FALSE to stop the comparison with FC_CANCELLED.
+	 */
+	typedef BOOL (*FC_PROGRESS_CALLBACK)(
+		_In_opt_ void* UserData,
+		_In_ FC_PROGRESS_PHASE Phase,
+		_In_ ULONGLONG Done,
+		_In_ ULONGLONG Total);
+
+	/**
+	 * @brief Opaque handle to a persistent comparison cache.
+	 *
+	 * Created with `FC_CacheOpenW` and released with `FC_CacheClose`. See the
+	 * "Persistent Comparison Cache" section below for the invalidation rules.
+	 */
+	typedef struct _FC_CACHE FC_CACHE;
+
+	/**
+	 * @brief Opaque handle to a trace-event file.
+	 *
+	 * Created with `FC_TraceOpenW` and released with `FC_TraceClose`. See the
+	 * "Trace Events" section below for the recorded phases.
+	 */
+	typedef struct _FC_TRACE FC_TRACE;
+
+	/**
+	 * @brief Opaque handle to a reusable comparison session.
+	 *
+	 * Created with `FC_SessionCreate` and released with `FC_SessionClose`. See
+	 * `FC_SessionCompareFilesW` for the thread-affinity rules.
+	 */
+	typedef struct _FC_SESSION FC_SESSION;
+
+	/**
+	 * @brief Opaque handle to a pull-based diff iteration.
+	 *
+	 * Created with `FC_DiffBegin`, advanced with `FC_DiffNext` and released with
+	 * `FC_DiffEnd`.
+	 */
+	typedef struct _FC_DIFF_ITERATOR FC_DIFF_ITERATOR;
+
+	/**
+	 * @enum FC_MERGE_TYPE
+	 * @brief Classifies an aligned region of a three-way comparison.
+	 */
+	typedef enum {
+		FC_MERGE_UNCHANGED,     /**< All three versions agree. */
+		FC_MERGE_LOCAL,         /**< Only the local version changed the base. */
+		FC_MERGE_REMOTE,        /**< Only the remote version changed the base. */
+		FC_MERGE_BOTH,          /**< Both versions made the same change. */
+		FC_MERGE_CONFLICT       /**< Both versions changed the base differently. */
+	} FC_MERGE_TYPE;
+
+	/**
+	 * @struct FC_MERGE_REGION
+	 * @brief One aligned region of a three-way comparison.
+	 *
+	 * The indices are 0-based line indices, exclusive of the end. Consecutive regions
+	 * tile all three files and never share a type.
+	 */
+	typedef struct {
+		FC_MERGE_TYPE Type;     /**< How the two versions relate to the base here. */
+		size_t BaseStart;       /**< The starting line index in the base. */
+		size_t BaseEnd;         /**< The ending line index (exclusive) in the base. */
+		size_t LocalStart;      /**< The starting line index in the local version. */
+		size_t LocalEnd;        /**< The ending line index (exclusive) in the local version. */
+		size_t RemoteStart;     /**< The starting line index in the remote version. */
+		size_t RemoteEnd;       /**< The ending line index (exclusive) in the remote version. */
+	} FC_MERGE_REGION;
+
+	/**
+	 * @struct FC_MERGE_CONTEXT
+	 * @brief Provides the region callback with the paths and parsed lines of all three files.
+	 */
+	typedef struct {
+		const WCHAR* BasePath;          /**< The canonical path to the base. */
+		const WCHAR* LocalPath;         /**< The canonical path to the local version. */
+		const WCHAR* RemotePath;        /**< The canonical path to the remote version. */
+		const _FC_BUFFER* BaseLines;    /**< The _FC_LINE structs of the base. */
+		const _FC_BUFFER* LocalLines;   /**< The _FC_LINE structs of the local version. */
+		const _FC_BUFFER* RemoteLines;  /**< The _FC_LINE structs of the remote version. */
+		void* UserData;                 /**< The user-defined data pointer from FC_CONFIG. */
+	} FC_MERGE_CONTEXT;
+
+	/**
+	 * @brief Defines the function pointer for a callback that receives three-way regions.
+	 *
+	 * @param Context A pointer to the FC_MERGE_CONTEXT for the comparison.
+	 * @param Region  A pointer to the FC_MERGE_REGION being reported.
+	 */
+	typedef void (*FC_MERGE_CALLBACK)(_In_ const FC_MERGE_CONTEXT* Context, _In_ const FC_MERGE_REGION* Region);
+
+	/**
+	 * @brief Opaque handle to a comparison of two in-memory texts that can be edited.
+	 *
+	 * Created with `FC_DiffStateCreate`, updated with `FC_DiffStateEdit` and released
+	 * with `FC_DiffStateClose`.
+	 */
+	typedef struct _FC_DIFF_STATE FC_DIFF_STATE;
+
+	/**
+	 * @brief Opaque handle to a text file prepared for comparison against many others.
+	 *
+	 * Created with `FC_ReferenceOpenW`, used with `FC_ReferenceCompareFileW` and
+	 * `FC_ReferenceCompareBuffer`, and released with `FC_ReferenceClose`.
+	 */
+	typedef struct _FC_REFERENCE FC_REFERENCE;
+
+	/**
+	 * @enum FC_TEXT_SIDE
+	 * @brief Selects one of the two texts of an FC_DIFF_STATE.
+	 */
+	typedef enum {
+		FC_TEXT_FIRST,          /**< The first text (file A of the diff blocks). */
+		FC_TEXT_SECOND          /**< The second text (file B of the diff blocks). */
+	} FC_TEXT_SIDE;
+
+	/**
+	 * @struct FC_TEXT_EDIT
+	 * @brief Replaces a byte range of a text: RemoveLength bytes at Offset become Insert.
+	 */
+	typedef struct {
+		size_t Offset;          /**< Byte offset of the edit in the text as it is before this edit. */
+		size_t RemoveLength;    /**< The number of bytes removed at Offset. */
+		const char* Insert;     /**< The bytes inserted at Offset; may be NULL when InsertLength is 0. */
+		size_t InsertLength;    /**< The number of bytes inserted. */
+	} FC_TEXT_EDIT;
+
+	/**
+	 * @struct FC_LINE_SPAN
+	 * @brief A changed span within one line pair of a refined change block.
+	 *
+	 * Offsets are byte offsets into the normalized line text (`_FC_LINE::Text`),
+	 * exclusive of the end. An empty span on one side marks where the other side's
+	 * bytes were inserted or removed.
+	 */
+	typedef struct {
+		size_t LineA;           /**< The absolute line index in file A. */
+		size_t LineB;           /**< The absolute line index in file B. */
+		size_t StartA;          /**< The first changed byte in line A. */
+		size_t EndA;            /**< The end (exclusive) of the changed bytes in line A. */
+		size_t StartB;          /**< The first changed byte in line B. */
+		size_t EndB;            /**< The end (exclusive) of the changed bytes in line B. */
+	} FC_LINE_SPAN;
+
+	/**
+	 * @struct FC_REFINED_BLOCK
+	 * @brief A diff block together with the changed spans inside its paired lines.
+	 *
+	 * Filled by `FC_RefineBlock` and released with `FC_RefinedBlockFree`.
+	 */
+	typedef struct {
+		FC_DIFF_BLOCK Block;        /**< The block that was refined. */
+		const FC_LINE_SPAN* Spans;  /**< Changed spans, ordered by line pair and then by offset. */
+		size_t SpanCount;           /**< The number of spans. */
+		size_t CoarsePairs;         /**< Line pairs over the budget, each reported as one span. */
+		_FC_BUFFER Storage;         /**< Owns Spans. */
+	} FC_REFINED_BLOCK;
+
+	// Number of lines FC_STATS::TopLines keeps.
+#define FC_STATS_TOP_LINES 4
+
+	/**
+	 * @struct FC_STATS_LINE
+	 * @brief A line that gave the LCS a long match list.
+	 */
+	typedef struct {
+		UINT Hash;                          /**< The line hash shared by the occurrences. */
+		ULONGLONG MatchListLength;          /**< Most same-hash lines probed for one occurrence. */
+		char Text[32];                      /**< The start of the normalized line, null-terminated. */
+	} FC_STATS_LINE;
+
+	/**
+	 * @struct FC_STATS
+	 * @brief Optional per-phase timings and counters of comparisons.
+	 *
+	 * Pass a zeroed structure through `FC_CONFIG::Stats`. Each comparison adds to the
+	 * counters and durations and raises PeakMemoryBytes, so one structure can total
+	 * a batch. The durations do not overlap: time spent in the diff callback counts
+	 * as report time only. One structure must not be used by two comparisons at the
+	 * same time.
+	 */
+	typedef struct {
+		ULONGLONG ReadNanoseconds;          /**< Reading text files into memory, and reading binary files. */
+		ULONGLONG ParseNanoseconds;         /**< Splitting and normalizing lines. */
+		ULONGLONG HashNanoseconds;          /**< Hashing lines and building the per-chunk match tables (with BufferLines set, the tables fill during the LCS and count there). */
+		ULONGLONG LcsNanoseconds;           /**< Chunk matching and the LCS search. */
+		ULONGLONG BinaryCompareNanoseconds; /**< Byte comparison in binary mode. */
+		ULONGLONG ReportNanoseconds;        /**< Time spent in the diff callback. */
+		ULONGLONG BytesRead;                /**< Input bytes read from files or mapped views. */
+		ULONGLONG LinesParsed;              /**< Lines stored after normalization. */
+		ULONGLONG ChunksProcessed;          /**< Text chunks run through the LCS. */
+		ULONGLONG Rewinds;                  /**< Chunks that ended by rewinding to their last anchor. */
+		ULONGLONG MatchesProbed;            /**< Same-hash line pairs the LCS looked at. */
+		ULONGLONG HashCollisions;           /**< Probed pairs whose hashes matched but whose text did not. */
+		ULONGLONG PeakMemoryBytes;          /**< Most working memory held at once, counted at every allocation and free. */
+		ULONGLONG BudgetFallbacks;          /**< Chunks retried smaller, and texts streamed, to stay within FC_CONFIG::MaxMemoryBytes. */
+		ULONGLONG MatchListLookups;         /**< Lines whose hash had a match list; MatchesProbed divided by this is the mean list length. */
+		ULONGLONG MaxMatchListLength;       /**< Longest match list probed for one line. */
+		ULONGLONG PeakLcsLinks;             /**< Most LCS links one chunk needed. */
+		ULONGLONG LargePageBytes;           /**< Working-buffer memory mapped with large pages under FC_LARGE_PAGES; 0 if the system refused. */
+		FC_STATS_LINE TopLines[FC_STATS_TOP_LINES]; /**< Distinct lines with the longest match lists, longest first. */
+	} FC_STATS;
+
 	/**
 		 * @struct FC_CONFIG
 		 * @brief Holds the configuration settings for a file comparison operation.
@@ -225,6 +556,13 @@ extern "C" {
 		size_t MaxTextFileBytes;        /**< Maximum file size allowed for text-mode parsing; 0 uses default and oversized text paths fall back to binary comparison. */
 		FC_DIFF_CALLBACK DiffCallback;  /**< The mandatory callback function for receiving structured diff reports. */
 		void* UserData;                 /**< A user-defined pointer passed to the callback function's context. */
+		FC_CACHE* Cache;                /**< Optional persistent cache from FC_CacheOpenW; NULL disables caching. */
+		FC_PROGRESS_CALLBACK ProgressCallback; /**< Optional progress and cancellation callback; receives UserData. */
+		FC_ALLOCATOR Allocator;         /**< Optional allocator for all working memory; zero-initialized uses the default heap. */
+		FC_STATS* Stats;                /**< Optional statistics that the comparison adds to; NULL collects nothing. */
+		size_t MaxMemoryBytes;          /**< Working-memory budget of one call in bytes; 0 is unlimited. See README "Memory budget". */
+		FC_TRACE* Trace;                /**< Optional trace-event file from FC_TraceOpenW; NULL records nothing. */
+		ULONGLONG TracePair;            /**< Pair index stored with every trace event, to tell the pairs of a batch apart. */
 	} FC_CONFIG;
 
 	/* -------------------- Internal Implementation (Private) -------------------- */
@@ -251,2551 +589,9905 @@ extern "C" {
 #define FC_MAX_CHUNK_LINES 50000u
 #endif
 
+// Binary comparisons report progress (and can be cancelled) once per this many bytes.
+#ifndef FC_PROGRESS_GRANULE_BYTES
+#define FC_PROGRESS_GRANULE_BYTES (1024u * 1024u)
+#endif
+
+#ifndef FC_CACHE_DEFAULT_MAX_BYTES
+#define FC_CACHE_DEFAULT_MAX_BYTES (16ull * 1024ull * 1024ull)
+#endif
+
+// Files modified less than this long (in 100 ns units) before they were hashed
+// are not recorded, because a later write within the same timestamp tick would
+// be invisible to the metadata check.
+#ifndef FC_CACHE_RACY_WINDOW
+#define FC_CACHE_RACY_WINDOW (2ull * 10000000ull)
+#endif
+
+// Read buffers larger than this are released after a session comparison
+// instead of being kept for the next one.
+#ifndef FC_SESSION_MAX_RETAINED_BYTES
+#define FC_SESSION_MAX_RETAINED_BYTES (16ull * 1024ull * 1024ull)
+#endif
+
+// Under FC_LARGE_PAGES, buffers that grow to this size move to large pages.
+#ifndef FC_LARGE_PAGE_MIN_BYTES
+#define FC_LARGE_PAGE_MIN_BYTES (2u * 1024u * 1024u)
+#endif
+
+// Set to 0 to compile out the FC_CONFIG::Stats instrumentation entirely.
+#ifndef FC_ENABLE_STATS
+#define FC_ENABLE_STATS 1
+#endif
+
+// Set to 0 to compile out the FC_CONFIG::Trace instrumentation entirely.
+#ifndef FC_ENABLE_TRACE
+#define FC_ENABLE_TRACE 1
+#endif
+
+// Trace events a thread collects before writing them to the trace file.
+#ifndef FC_TRACE_BUFFER_EVENTS
+#define FC_TRACE_BUFFER_EVENTS 256u
+#endif
+
+// Set to 1 on Linux to compile in USDT probes (provider "fc") from <sys/sdt.h>
+// for bpftrace and perf. Each probe is a single no-op instruction until a tracer
+// attaches; elsewhere, or with 0, the probe macros and their arguments vanish.
+// See README "Static probes" for the probe list.
+#ifndef FC_ENABLE_USDT
+#define FC_ENABLE_USDT 0
+#endif
+
+#if FC_ENABLE_USDT && defined(__linux__)
+#include <sys/sdt.h>
+#define _FC_PROBE2(Name, A, B) DTRACE_PROBE2(fc, Name, A, B)
+#define _FC_PROBE3(Name, A, B, C) DTRACE_PROBE3(fc, Name, A, B, C)
+#define _FC_PROBE4(Name, A, B, C, D) DTRACE_PROBE4(fc, Name, A, B, C, D)
+#else
+#define _FC_PROBE2(Name, A, B) ((void)0)
+#define _FC_PROBE3(Name, A, B, C) ((void)0)
+#define _FC_PROBE4(Name, A, B, C, D) ((void)0)
+#endif
+
+#ifndef _FC_THREAD_LOCAL
+#if defined(_MSC_VER)
+#define _FC_THREAD_LOCAL __declspec(thread)
+#else
+#define _FC_THREAD_LOCAL __thread
+#endif
+#endif
+
+	/* -------------------- Platform Layer -------------------- */
+
+	//
+	// Everything the engines need from the operating system goes through the
+	// _FC_Pal* functions below: heaps, files (open, positioned read, write, size,
+	// identity, mapping), UTF-8 transcoding, clocks, locks and threads. Windows
+	// uses Win32 directly; other systems use POSIX (open, pread, mmap, madvise).
+	// Paths stay WCHAR strings throughout and are converted to UTF-8 only at the
+	// POSIX system call.
+	//
+
+	// _FC_PalAlloc flag: return zero-filled memory (HEAP_ZERO_MEMORY).
+#define _FC_ALLOC_ZERO 0x00000008u
+
+#ifdef _WIN32
+
+	typedef HANDLE _FC_FILE;
+#define _FC_INVALID_FILE INVALID_HANDLE_VALUE
+
+	typedef SRWLOCK _FC_LOCK;
+
+	static inline HANDLE _FC_PalProcessHeap(void)
+	{
+		return GetProcessHeap();
+	}
+
 	/**
-	 * @brief Conditionally frees a heap pointer. Safe to call with NULL.
+	 * @brief Creates a growable private heap; sessions are single-threaded, so it takes no lock.
 	 * @internal
 	 */
-	static inline void _FC_HeapFree(const void* p)
+	static inline HANDLE _FC_PalHeapCreate(void)
 	{
-		if (p)
-			HeapFree(GetProcessHeap(), 0, (LPVOID)p);
+		return HeapCreate(HEAP_NO_SERIALIZE, 0, 0);
 	}
 
-	static const WCHAR* const g_ReservedDevices[] = {
-		L"CON", L"PRN", L"AUX", L"NUL",
-		L"COM1", L"COM2", L"COM3", L"COM4", L"COM5", L"COM6", L"COM7", L"COM8", L"COM9",
-		L"LPT1", L"LPT2", L"LPT3", L"LPT4", L"LPT5", L"LPT6", L"LPT7", L"LPT8", L"LPT9"
-	};
+	static inline void _FC_PalHeapDestroy(_In_ HANDLE Heap)
+	{
+		HeapDestroy(Heap);
+	}
+
+	static inline void* _FC_PalAlloc(_In_ HANDLE Heap, _In_ DWORD Flags, _In_ size_t Size)
+	{
+		return HeapAlloc(Heap, (Flags & _FC_ALLOC_ZERO) ? HEAP_ZERO_MEMORY : 0, Size);
+	}
+
+	static inline void* _FC_PalReAlloc(_In_ HANDLE Heap, _In_ void* Block, _In_ size_t Size)
+	{
+		return HeapReAlloc(Heap, 0, Block, Size);
+	}
+
+	static inline void _FC_PalFree(_In_ HANDLE Heap, _In_ const void* Block)
+	{
+		HeapFree(Heap, 0, (LPVOID)Block);
+	}
+
+	static inline size_t _FC_PalBlockSize(_In_ HANDLE Heap, _In_ const void* Block)
+	{
+		return (size_t)HeapSize(Heap, 0, Block);
+	}
 
 	/**
-	 * @struct _FC_LINE
-	 * @brief Internal representation of a single line of text from a file.
-	 *
-	 * This structure stores the processed text of a line, its length, and a pre-computed
-	 * hash value for fast comparisons. The text is normalized according to the
-	 * active comparison flags (e.g., whitespace removal, tab expansion).
-	 *
+	 * @brief Opens an existing file for reading, shared with other readers.
 	 * @internal
+	 * @param Sequential TRUE to hint that the file is read front to back.
+	 * @return The file, or `_FC_INVALID_FILE`.
 	 */
-	typedef struct
+	static inline _FC_FILE _FC_PalOpenRead(_In_z_ const WCHAR* Path, _In_ BOOL Sequential)
 	{
-		char* Text;
-		size_t Length;
-		UINT Hash;
-	} _FC_LINE;
+		return CreateFileW(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | (Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : 0), NULL);
+	}
 
 	/**
-	 * @struct _FC_MATCH
-	 * @brief Represents a potential match of a line from file A in file B.
-	 *
-	 * This is used to build a singly-linked list of all occurrences of a line
-	 * with a specific hash in file B.
+	 * @brief Creates or truncates a file for writing.
 	 * @internal
+	 * @param ShareRead TRUE to let other handles read the file while it is open.
+	 * @return The file, or `_FC_INVALID_FILE`.
 	 */
-	typedef struct _FC_MATCH {
-		size_t IndexInB;         /**< The 0-based line index in file B. */
-		struct _FC_MATCH* Next;  /**< Pointer to the next match with the same hash. */
-	} _FC_MATCH;
+	static inline _FC_FILE _FC_PalCreateFile(_In_z_ const WCHAR* Path, _In_ BOOL ShareRead)
+	{
+		return CreateFileW(Path, GENERIC_WRITE, ShareRead ? FILE_SHARE_READ : 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL, NULL);
+	}
+
+	static inline BOOL _FC_PalClose(_In_ _FC_FILE File)
+	{
+		return CloseHandle(File);
+	}
+
+	static inline BOOL _FC_PalFileSize(_In_ _FC_FILE File, _Out_ ULONGLONG* Size)
+	{
+		LARGE_INTEGER Value;
+		*Size = 0;
+		if (!GetFileSizeEx(File, &Value) || Value.QuadPart < 0)
+			return FALSE;
+		*Size = (ULONGLONG)Value.QuadPart;
+		return TRUE;
+	}
 
 	/**
-	 * @struct _FC_LCS_LINK
-	 * @brief A single node in the LCS backtracking chain.
-	 *
-	 * Each time the Thresholds array is updated at level k, one link node is
-	 * appended to the pool.  Links[k] holds the pool index of the most recent
-	 * such node; PrevLink chains back to the length-(k-1) predecessor.
+	 * @brief Reads up to Length bytes at the file position; *BytesRead is 0 at end of file.
 	 * @internal
 	 */
-	typedef struct {
-		size_t AIdx;      /**< Line index in file A. */
-		size_t BIdx;      /**< Line index in file B. */
-		size_t PrevLink;  /**< Pool index of the predecessor link, or SIZE_MAX if none. */
-	} _FC_LCS_LINK;
+	static inline BOOL _FC_PalRead(
+		_In_ _FC_FILE File,
+		_Out_writes_bytes_(Length) void* Buffer,
+		_In_ DWORD Length,
+		_Out_ DWORD* BytesRead)
+	{
+		return ReadFile(File, Buffer, Length, BytesRead, NULL);
+	}
 
 	/**
-	 * @struct _FC_LCS_CONTEXT
-	 * @brief Holds the intermediate data structures for the Hunt-McIlroy LCS algorithm.
+	 * @brief Reads up to Length bytes at Offset without using the file position.
 	 * @internal
 	 */
-	typedef struct {
-		size_t* Thresholds;  /**< THRESH[k]: smallest B-end index for an LCS of length k. */
-		size_t* Links;       /**< Links[k]: pool index of the best length-k chain; SIZE_MAX = none. */
-		_FC_BUFFER LinkPool; /**< Pool of _FC_LCS_LINK nodes, grown on each Threshold update. */
-	} _FC_LCS_CONTEXT;
+	static inline BOOL _FC_PalReadAt(
+		_In_ _FC_FILE File,
+		_In_ ULONGLONG Offset,
+		_Out_writes_bytes_(Length) void* Buffer,
+		_In_ DWORD Length,
+		_Out_ DWORD* BytesRead)
+	{
+		OVERLAPPED Position;
+		memset(&Position, 0, sizeof(Position));
+		Position.Offset = (DWORD)Offset;
+		Position.OffsetHigh = (DWORD)(Offset >> 32);
+		*BytesRead = 0;
+		if (ReadFile(File, Buffer, Length, BytesRead, &Position))
+			return TRUE;
+		// With an explicit offset, end of file is reported as an error.
+		return GetLastError() == ERROR_HANDLE_EOF;
+	}
+
+	static inline BOOL _FC_PalWrite(
+		_In_ _FC_FILE File,
+		_In_reads_bytes_(Length) const void* Buffer,
+		_In_ DWORD Length,
+		_Out_ DWORD* Written)
+	{
+		return WriteFile(File, Buffer, Length, Written, NULL);
+	}
+
+	static inline BOOL _FC_PalFlush(_In_ _FC_FILE File)
+	{
+		return FlushFileBuffers(File);
+	}
 
 	/**
-	 * @struct _FC_HASH_MAP_ENTRY
-	 * @brief An entry in the hash map's bucket list.
-	 *
-	 * Contains the hash value, a pointer to the head of the match list for that hash,
-	 * and a pointer to the next entry in the same bucket (to handle collisions).
+	 * @brief Moves Source over Target, replacing it, and flushes the rename to disk.
 	 * @internal
 	 */
-	typedef struct _FC_HASH_MAP_ENTRY {
-		UINT Hash;
-		_FC_MATCH* MatchHead;
-		struct _FC_HASH_MAP_ENTRY* Next;
-	} _FC_HASH_MAP_ENTRY;
+	static inline BOOL _FC_PalReplaceFile(_In_z_ const WCHAR* Source, _In_z_ const WCHAR* Target)
+	{
+		return MoveFileExW(Source, Target, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+	}
+
+	static inline void _FC_PalDeleteFile(_In_z_ const WCHAR* Path)
+	{
+		DeleteFileW(Path);
+	}
 
 	/**
-	 * @struct _FC_HASH_MAP
-	 * @brief A simple hash map implementation for finding line matches.
-	 *
-	 * Uses open addressing with chaining for collision resolution. It pre-allocates
-	 * all necessary entry and match nodes from pools for performance, avoiding
-	 * repeated small allocations.
+	 * @brief Reports a file's size, last write and change times, and identity.
 	 * @internal
+	 * @param LastWriteTime Receives the time in 100 ns intervals since 1601-01-01 UTC.
+	 * @param ChangeTime Receives the last metadata or content change, in the same
+	 *        units. Unlike LastWriteTime, it cannot be set by user code.
+	 * @param FileId Receives an identifier unique to the file on its volume.
+	 * @param VolumeSerial Receives an identifier of the volume.
 	 */
-	typedef struct {
-		_FC_HASH_MAP_ENTRY** Buckets;      /**< Array of pointers to bucket chains. */
-		size_t NumBuckets;                 /**< The number of buckets in the hash table. */
-		_FC_HASH_MAP_ENTRY* EntryPool;     /**< A pre-allocated pool of hash map entries. */
-		size_t EntryPoolIndex;             /**< The next available index in the entry pool. */
-	} _FC_HASH_MAP;
+	static inline BOOL _FC_PalFileInfo(
+		_In_ _FC_FILE File,
+		_Out_ ULONGLONG* Size,
+		_Out_ ULONGLONG* LastWriteTime,
+		_Out_ ULONGLONG* ChangeTime,
+		_Out_ ULONGLONG* FileId,
+		_Out_ DWORD* VolumeSerial)
+	{
+		BY_HANDLE_FILE_INFORMATION Info;
+		FILE_BASIC_INFO Basic;
+		if (!GetFileInformationByHandle(File, &Info) ||
+			!GetFileInformationByHandleEx(File, FileBasicInfo, &Basic, sizeof(Basic)))
+			return FALSE;
+		*Size = ((ULONGLONG)Info.nFileSizeHigh << 32) | Info.nFileSizeLow;
+		*LastWriteTime = ((ULONGLONG)Info.ftLastWriteTime.dwHighDateTime << 32) | Info.ftLastWriteTime.dwLowDateTime;
+		*ChangeTime = (ULONGLONG)Basic.ChangeTime.QuadPart;
+		*FileId = ((ULONGLONG)Info.nFileIndexHigh << 32) | Info.nFileIndexLow;
+		*VolumeSerial = Info.dwVolumeSerialNumber;
+		return TRUE;
+	}
 
 	/**
-	 * @brief Creates and initializes a hash map.
+	 * @brief Maps the first Length bytes of a file read-only, for one front-to-back pass.
 	 * @internal
-	 * @param Map A pointer to the _FC_HASH_MAP structure to initialize.
-	 * @param InitialCapacity The number of entries to pre-allocate in the pool.
-	 * @return TRUE on success, FALSE on memory allocation failure.
+	 * @return The view, or NULL.
 	 */
-	static BOOL _FC_HashMapCreate(_Inout_ _FC_HASH_MAP* Map, _In_ size_t InitialCapacity) {
-		Map->NumBuckets = 1021; // A reasonably sized prime number
-		Map->Buckets = (_FC_HASH_MAP_ENTRY**)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, Map->NumBuckets * sizeof(_FC_HASH_MAP_ENTRY*));
-		if (!Map->Buckets) return FALSE;
-		Map->EntryPool = (_FC_HASH_MAP_ENTRY*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, InitialCapacity * sizeof(_FC_HASH_MAP_ENTRY));
-		if (!Map->EntryPool) { HeapFree(GetProcessHeap(), 0, Map->Buckets); return FALSE; }
-		Map->EntryPoolIndex = 0;
-		return TRUE;
+	static inline const void* _FC_PalMapView(_In_ _FC_FILE File, _In_ size_t Length)
+	{
+		const void* View;
+		HANDLE Mapping = CreateFileMappingW(File, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (Mapping == NULL)
+			return NULL;
+		View = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, Length);
+		// The view keeps the section alive.
+		CloseHandle(Mapping);
+		return View;
+	}
+
+	static inline void _FC_PalUnmapView(_In_ const void* View, _In_ size_t Length)
+	{
+		(void)Length;
+		UnmapViewOfFile(View);
 	}
 
 	/**
-	 * @brief Frees all memory associated with a hash map.
+	 * @brief Allocates at least Size bytes of read-write memory backed by large pages.
+	 *
+	 * Needs SeLockMemoryPrivilege enabled in the process token; without it, or when
+	 * no contiguous large pages are free, the allocation fails and the caller falls
+	 * back to its heap.
 	 * @internal
-	 * @param Map A pointer to the _FC_HASH_MAP to free.
+	 * @param[out] Mapped Receives the size to pass to `_FC_PalLargeFree`.
+	 * @return The block, or NULL.
 	 */
-	static void _FC_HashMapFree(_Inout_ _FC_HASH_MAP* Map) {
-		if (Map->Buckets) HeapFree(GetProcessHeap(), 0, Map->Buckets);
-		if (Map->EntryPool) HeapFree(GetProcessHeap(), 0, Map->EntryPool);
+	static inline void* _FC_PalLargeAlloc(_In_ size_t Size, _Out_ size_t* Mapped)
+	{
+		size_t Page = (size_t)GetLargePageMinimum();
+		*Mapped = 0;
+		if (Page == 0 || Size > SIZE_MAX - Page)
+			return NULL;
+		size_t Rounded = (Size + Page - 1) & ~(Page - 1);
+		void* Block = VirtualAlloc(NULL, Rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (Block != NULL)
+			*Mapped = Rounded;
+		return Block;
+	}
+
+	static inline void _FC_PalLargeFree(_In_ void* Block, _In_ size_t Mapped)
+	{
+		(void)Mapped;
+		VirtualFree(Block, 0, MEM_RELEASE);
 	}
 
 	/**
-	 * @brief Finds an entry in the hash map by its hash value.
+	 * @brief Converts UTF-8 to WCHARs with MultiByteToWideChar semantics.
 	 * @internal
-	 * @param Map A pointer to the hash map.
-	 * @param Hash The hash value to find.
-	 * @return A pointer to the found _FC_HASH_MAP_ENTRY, or NULL if not found.
+	 * @param Length Input bytes, or -1 to convert through the terminator.
+	 * @param Output Receives the characters; with Capacity 0, only the count is returned.
+	 * @param Strict TRUE to fail on malformed input instead of substituting U+FFFD.
+	 * @return The number of WCHARs, or 0 on failure.
 	 */
-	static _FC_HASH_MAP_ENTRY* _FC_HashMapFind(_In_ _FC_HASH_MAP* Map, _In_ UINT Hash) {
-		size_t bucketIndex = Hash % Map->NumBuckets;
-		_FC_HASH_MAP_ENTRY* entry = Map->Buckets[bucketIndex];
-		while (entry) { if (entry->Hash == Hash) return entry; entry = entry->Next; }
-		return NULL;
+	static inline int _FC_PalUtf8ToWide(
+		_In_ const char* Input,
+		_In_ int Length,
+		_Out_writes_(Capacity) WCHAR* Output,
+		_In_ int Capacity,
+		_In_ BOOL Strict)
+	{
+		return MultiByteToWideChar(CP_UTF8, Strict ? MB_ERR_INVALID_CHARS : 0, Input, Length, Output, Capacity);
 	}
 
 	/**
-	 * @brief Inserts a new hash value into the map, or finds the existing entry.
+	 * @brief Converts WCHARs to UTF-8 with WideCharToMultiByte semantics.
 	 * @internal
-	 * @param Map A pointer to the hash map.
-	 * @param Hash The hash value to insert.
-	 * @return A pointer to the new or existing _FC_HASH_MAP_ENTRY, or NULL on failure.
+	 * @return The number of bytes, or 0 on failure.
 	 */
-	static _FC_HASH_MAP_ENTRY* _FC_HashMapInsert(_Inout_ _FC_HASH_MAP* Map, _In_ UINT Hash) {
-		_FC_HASH_MAP_ENTRY* entry = _FC_HashMapFind(Map, Hash);
-		if (entry) return entry;
-		entry = &Map->EntryPool[Map->EntryPoolIndex++];
-		entry->Hash = Hash;
-		entry->MatchHead = NULL;
-		size_t bucketIndex = Hash % Map->NumBuckets;
-		entry->Next = Map->Buckets[bucketIndex];
-		Map->Buckets[bucketIndex] = entry;
-		return entry;
+	static inline int _FC_PalWideToUtf8(
+		_In_ const WCHAR* Input,
+		_In_ int Length,
+		_Out_writes_(Capacity) char* Output,
+		_In_ int Capacity)
+	{
+		return WideCharToMultiByte(CP_UTF8, 0, Input, Length, Output, Capacity, NULL, NULL);
 	}
 
 	/**
-	 * @brief Computes the optimal chunk size for streaming line processing.
-	 *
-	 * Phase B: Calculates a dynamic chunk size based on the larger file's size and the
-	 * /LBn configuration parameter. The heuristic uses sqrt(FileSizeBytes / 80) to keep
-	 * per-chunk LCS time roughly constant while scaling with file size.
-	 *
+	 * @brief Lowercases WCHARs in place with the system's locale-independent mapping.
 	 * @internal
-	 * @param MaxFileSizeBytes The size in bytes of the larger input file.
-	 * @param BufferLinesConfig The /LBn parameter (100 = neutral, 50 = half, 200 = double).
-	 * @return Optimal number of lines per chunk, clamped to [FC_MIN_CHUNK_LINES, FC_MAX_CHUNK_LINES].
+	 * @return The number of characters processed.
 	 */
-	static inline size_t
-		_FC_ComputeChunkSize(
-			_In_ LONGLONG MaxFileSizeBytes,
-			_In_ UINT BufferLinesConfig)
+	static inline DWORD _FC_PalLowerWide(_Inout_ WCHAR* Buffer, _In_ DWORD Length)
 	{
-		// Guard against invalid inputs
-		if (MaxFileSizeBytes <= 0)
-			return FC_MIN_CHUNK_LINES;
-
-		UINT Config = BufferLinesConfig;
-		if (Config == 0)
-			Config = 100; // default neutral value
+		return CharLowerBuffW(Buffer, Length);
+	}
 
-		// Base heuristic: sqrt(file_size / 80) where 80 = est. bytes per line
-		// Using integer square root approximation to avoid floating point
-		size_t BaseChunk = 1000;  // Start with minimum
-		ULONGLONG USize = (ULONGLONG)MaxFileSizeBytes;
-		if (USize > 80000000ull) {
-			// Rough integer square root for large values
-			// sqrt(n) ≈ (n >> 1) for n > 100
-			// Use a simple estimate: for 80MB file (1M lines), target ~3k
-			if (USize > 80000000ull) BaseChunk = 3162;  // sqrt(10M)
-			if (USize > 800000000ull) BaseChunk = 10000;  // sqrt(100M)
-			if (USize > 8000000000ull) BaseChunk = 31622;  // sqrt(1B)
-		}
+	static inline int _FC_PalCompareNoCaseW(_In_z_ const WCHAR* Left, _In_z_ const WCHAR* Right)
+	{
+		return _wcsicmp(Left, Right);
+	}
 
-		// Apply /LBn scaling: BufferLinesConfig of 100 is neutral
-		// 50 = half, 200 = double (linear scaling)
-		size_t Scaled = BaseChunk;
-		if (Config != 100) {
-			// Avoid overflow: scale carefully
-			if (Config > 100) {
-				Scaled = BaseChunk + (BaseChunk * (Config - 100)) / 100;
-			} else if (Config < 100) {
-				Scaled = BaseChunk - (BaseChunk * (100 - Config)) / 100;
+	/**
+	 * @brief Reads a decimal environment variable; used by FC_TESTING overrides.
+	 * @internal
+	 */
+	static inline BOOL _FC_PalGetEnvironmentNumber(_In_z_ const WCHAR* Name, _Out_ ULONGLONG* Value)
+	{
+		WCHAR value[32];
+		DWORD len = GetEnvironmentVariableW(Name, value, _FC_ARRAYSIZE(value));
+		*Value = 0;
+		if (len > 0 && len < _FC_ARRAYSIZE(value))
+		{
+			WCHAR* endptr = NULL;
+			unsigned __int64 parsed = _wcstoui64(value, &endptr, 10);
+			if (endptr != value && *endptr == L'\0')
+			{
+				*Value = (ULONGLONG)parsed;
+				return TRUE;
 			}
 		}
+		return FALSE;
+	}
 
-		// Clamp to valid range
-		if (Scaled < FC_MIN_CHUNK_LINES)
-			return FC_MIN_CHUNK_LINES;
-		if (Scaled > FC_MAX_CHUNK_LINES)
-			return FC_MAX_CHUNK_LINES;
+	static inline LONGLONG _FC_PalCounter(void)
+	{
+		LARGE_INTEGER Now;
+		QueryPerformanceCounter(&Now);
+		return Now.QuadPart;
+	}
 
-		return Scaled;
+	static inline LONGLONG _FC_PalCounterFrequency(void)
+	{
+		LARGE_INTEGER Frequency;
+		return QueryPerformanceFrequency(&Frequency) ? Frequency.QuadPart : 0;
 	}
 
 	/**
-	 * @brief Initializes a new, empty buffer for elements of a specific size.
+	 * @brief Returns the current time in 100 ns intervals since 1601-01-01 UTC.
 	 * @internal
-	 * @param pBuffer A pointer to the _FC_BUFFER to initialize.
-	 * @param elementSize The size in bytes of each element the buffer will hold.
 	 */
-	static inline void
-		_FC_BufferInit(
-			_Inout_ _FC_BUFFER* pBuffer,
-			_In_ size_t elementSize)
+	static inline ULONGLONG _FC_PalSystemTime(void)
 	{
-		pBuffer->pData = NULL;
-		pBuffer->ElementSize = elementSize;
-		pBuffer->Count = 0;
-		pBuffer->Capacity = 0;
+		FILETIME Now;
+		GetSystemTimeAsFileTime(&Now);
+		return ((ULONGLONG)Now.dwHighDateTime << 32) | Now.dwLowDateTime;
+	}
+
+	static inline void _FC_PalLockInit(_Out_ _FC_LOCK* Lock)
+	{
+		InitializeSRWLock(Lock);
+	}
+
+	static inline void _FC_PalLockDelete(_Inout_ _FC_LOCK* Lock)
+	{
+		(void)Lock;
+	}
+
+	static inline void _FC_PalLockExclusive(_Inout_ _FC_LOCK* Lock)
+	{
+		AcquireSRWLockExclusive(Lock);
+	}
+
+	static inline void _FC_PalUnlockExclusive(_Inout_ _FC_LOCK* Lock)
+	{
+		ReleaseSRWLockExclusive(Lock);
+	}
+
+	static inline void _FC_PalLockShared(_Inout_ _FC_LOCK* Lock)
+	{
+		AcquireSRWLockShared(Lock);
+	}
+
+	static inline void _FC_PalUnlockShared(_Inout_ _FC_LOCK* Lock)
+	{
+		ReleaseSRWLockShared(Lock);
+	}
+
+	static inline LONGLONG _FC_PalIncrement64(_Inout_ volatile LONG64* Value)
+	{
+		return InterlockedIncrement64(Value);
+	}
+
+	static inline DWORD _FC_PalProcessId(void)
+	{
+		return GetCurrentProcessId();
+	}
+
+	static inline DWORD _FC_PalThreadId(void)
+	{
+		return GetCurrentThreadId();
+	}
+
+	typedef void (*_FC_THREAD_ROUTINE)(_In_ void* Parameter);
+
+	typedef struct
+	{
+		_FC_THREAD_ROUTINE Routine;
+		void* Parameter;
+		HANDLE Handle;
+	} _FC_THREAD;
+
+	static DWORD WINAPI _FC_PalThreadMain(_In_ LPVOID Parameter)
+	{
+		_FC_THREAD* Thread = (_FC_THREAD*)Parameter;
+		Thread->Routine(Thread->Parameter);
+		return 0;
 	}
 
 	/**
-	 * @brief Frees the internal memory block owned by the buffer.
+	 * @brief Runs Routine(Parameter) on a new thread; Thread must stay valid until joined.
 	 * @internal
-	 * @note This function does not free any nested pointers within the elements themselves.
-	 *       The caller is responsible for freeing such data before calling this.
-	 * @param pBuffer A pointer to the _FC_BUFFER to free.
 	 */
-	static inline void
-		_FC_BufferFree(
-			_Inout_ _FC_BUFFER* pBuffer)
+	static inline BOOL _FC_PalThreadStart(
+		_Out_ _FC_THREAD* Thread,
+		_In_ _FC_THREAD_ROUTINE Routine,
+		_In_opt_ void* Parameter)
 	{
-		if (pBuffer->pData != NULL)
-		{
-			HeapFree(GetProcessHeap(), 0, pBuffer->pData);
-		}
-		pBuffer->pData = NULL;
-		pBuffer->Count = 0;
-		pBuffer->Capacity = 0;
+		Thread->Routine = Routine;
+		Thread->Parameter = Parameter;
+		Thread->Handle = CreateThread(NULL, 0, _FC_PalThreadMain, Thread, 0, NULL);
+		return Thread->Handle != NULL;
 	}
 
+	static inline void _FC_PalThreadJoin(_Inout_ _FC_THREAD* Thread)
+	{
+		WaitForSingleObject(Thread->Handle, INFINITE);
+		CloseHandle(Thread->Handle);
+	}
+
+#else
+
+	typedef int _FC_FILE;
+#define _FC_INVALID_FILE (-1)
+
+	typedef pthread_rwlock_t _FC_LOCK;
+
 	/**
-	 * @brief Ensures the buffer has enough capacity for a specified number of new elements.
-	 *
-	 * If the current capacity is insufficient, it reallocates the internal memory,
-	 * typically doubling the size.
+	 * @struct _FC_PAL_BLOCK
+	 * @brief Header in front of every heap block: its size and, in a private heap, its list links.
 	 * @internal
-	 * @param pBuffer A pointer to the _FC_BUFFER.
-	 * @param additionalCount The number of additional elements to make space for.
-	 * @return TRUE if the capacity is sufficient or reallocation succeeded, FALSE on failure.
 	 */
-	static inline BOOL
-		_FC_BufferEnsureCapacity(
-			_Inout_ _FC_BUFFER* pBuffer,
-			_In_ size_t additionalCount)
+	typedef struct _FC_PAL_BLOCK
 	{
-		if (additionalCount > SIZE_MAX - pBuffer->Count)
-			return FALSE;
-		if (pBuffer->Count + additionalCount > pBuffer->Capacity)
-		{
-			size_t newCapacity = pBuffer->Capacity > 0 ? pBuffer->Capacity : 8;
-			if (pBuffer->Capacity > 0)
-			{
-				if (pBuffer->Capacity > SIZE_MAX / 2) // Check before doubling
-					newCapacity = SIZE_MAX;
-				else
-					newCapacity *= 2;
-			}
-
-			if (newCapacity < pBuffer->Count + additionalCount)
-				newCapacity = pBuffer->Count + additionalCount;
-			if (pBuffer->ElementSize > 0 && newCapacity > SIZE_MAX / pBuffer->ElementSize) // Check before multiplication
-				return FALSE;
-			size_t newSizeInBytes = newCapacity * pBuffer->ElementSize;
-			void* pNewData = pBuffer->pData
-				? HeapReAlloc(GetProcessHeap(), 0, pBuffer->pData, newSizeInBytes)
-				: HeapAlloc(GetProcessHeap(), 0, newSizeInBytes);
-			if (pNewData == NULL)
-				return FALSE;
-			pBuffer->pData = pNewData;
-			pBuffer->Capacity = newCapacity;
-		}
-		return TRUE;
-	}
+		struct _FC_PAL_BLOCK* Prev;
+		struct _FC_PAL_BLOCK* Next;
+		size_t Size;
+		size_t Reserved;        // Keeps the payload 16-byte aligned.
+	} _FC_PAL_BLOCK;
 
 	/**
-	 * @brief Appends a single element to the end of the buffer.
+	 * @struct _FC_PAL_HEAP
+	 * @brief A heap over malloc. Private heaps list their blocks so that destroying one frees them all.
 	 * @internal
-	 * @param pBuffer A pointer to the _FC_BUFFER.
-	 * @param pElement A pointer to the element to be copied into the buffer.
-	 * @return TRUE on success, FALSE on memory allocation failure.
 	 */
-	static inline BOOL
-		_FC_BufferAppend(
-			_Inout_ _FC_BUFFER* pBuffer,
-			_In_ const void* pElement)
+	typedef struct
 	{
-		if (!_FC_BufferEnsureCapacity(pBuffer, 1))
+		_FC_PAL_BLOCK Blocks;   // List head of a private heap.
+		BOOL Private;
+	} _FC_PAL_HEAP;
+
+	static _FC_PAL_HEAP g_FcProcessHeap;
+
+	static inline HANDLE _FC_PalProcessHeap(void)
+	{
+		return &g_FcProcessHeap;
+	}
+
+	static inline HANDLE _FC_PalHeapCreate(void)
+	{
+		_FC_PAL_HEAP* Heap = (_FC_PAL_HEAP*)calloc(1, sizeof(_FC_PAL_HEAP));
+		if (Heap == NULL)
+			return NULL;
+		Heap->Private = TRUE;
+		Heap->Blocks.Prev = &Heap->Blocks;
+		Heap->Blocks.Next = &Heap->Blocks;
+		return Heap;
+	}
+
+	static inline void _FC_PalHeapDestroy(_In_ HANDLE Heap)
+	{
+		_FC_PAL_HEAP* Private = (_FC_PAL_HEAP*)Heap;
+		_FC_PAL_BLOCK* Block = Private->Blocks.Next;
+		while (Block != &Private->Blocks)
 		{
-			return FALSE;
+			_FC_PAL_BLOCK* Next = Block->Next;
+			free(Block);
+			Block = Next;
 		}
+		free(Private);
+	}
 
-		void* pDestination = (char*)pBuffer->pData + (pBuffer->Count * pBuffer->ElementSize);
-		memcpy(pDestination, pElement, pBuffer->ElementSize);
-		pBuffer->Count++;
-		return TRUE;
+	static inline void _FC_PalLink(_In_ HANDLE Heap, _Inout_ _FC_PAL_BLOCK* Block)
+	{
+		_FC_PAL_HEAP* Owner = (_FC_PAL_HEAP*)Heap;
+		if (!Owner->Private)
+		{
+			Block->Prev = Block->Next = NULL;
+			return;
+		}
+		Block->Prev = &Owner->Blocks;
+		Block->Next = Owner->Blocks.Next;
+		Owner->Blocks.Next->Prev = Block;
+		Owner->Blocks.Next = Block;
 	}
 
-	/**
-	 * @brief Appends a range of elements from an array to the end of the buffer.
-	 * @internal
-	 * @param pBuffer A pointer to the _FC_BUFFER.
-	 * @param pElements A pointer to the first element in the array to append.
-	 * @param count The number of elements to append from the array.
-	 * @return TRUE on success, FALSE on memory allocation failure.
-	 */
-	static inline BOOL
-		_FC_BufferAppendRange(
-			_Inout_ _FC_BUFFER* pBuffer,
-			_In_ const void* pElements,
-			_In_ size_t count)
+	static inline void _FC_PalUnlink(_Inout_ _FC_PAL_BLOCK* Block)
 	{
-		if (count == 0) return TRUE;
-		if (!_FC_BufferEnsureCapacity(pBuffer, count))
+		if (Block->Next != NULL)
 		{
-			return FALSE;
+			Block->Prev->Next = Block->Next;
+			Block->Next->Prev = Block->Prev;
 		}
+	}
 
-		void* pDestination = (char*)pBuffer->pData + (pBuffer->Count * pBuffer->ElementSize);
-		memcpy(pDestination, pElements, count * pBuffer->ElementSize);
-		pBuffer->Count += count;
-		return TRUE;
+	static inline void* _FC_PalAlloc(_In_ HANDLE Heap, _In_ DWORD Flags, _In_ size_t Size)
+	{
+		_FC_PAL_BLOCK* Block;
+		if (Size > SIZE_MAX - sizeof(_FC_PAL_BLOCK))
+			return NULL;
+		Block = (_FC_PAL_BLOCK*)((Flags & _FC_ALLOC_ZERO)
+			? calloc(1, sizeof(_FC_PAL_BLOCK) + Size)
+			: malloc(sizeof(_FC_PAL_BLOCK) + Size));
+		if (Block == NULL)
+			return NULL;
+		Block->Size = Size;
+		_FC_PalLink(Heap, Block);
+		return Block + 1;
 	}
 
-	/**
-	 * @brief Retrieves a pointer to the element at a specific index.
-	 * @internal
-	 * @param pBuffer A pointer to the _FC_BUFFER.
-	 * @param index The zero-based index of the element to retrieve.
-	 * @return A pointer to the element, or NULL if the index is out of bounds.
-	 */
-	static inline void*
-		_FC_BufferGet(
-			_In_ const _FC_BUFFER* pBuffer,
-			_In_ size_t index)
+	static inline void* _FC_PalReAlloc(_In_ HANDLE Heap, _In_ void* Block, _In_ size_t Size)
 	{
-		if (index >= pBuffer->Count)
+		_FC_PAL_BLOCK* Old = (_FC_PAL_BLOCK*)Block - 1;
+		_FC_PAL_BLOCK* New;
+		if (Size > SIZE_MAX - sizeof(_FC_PAL_BLOCK))
+			return NULL;
+		_FC_PalUnlink(Old);
+		New = (_FC_PAL_BLOCK*)realloc(Old, sizeof(_FC_PAL_BLOCK) + Size);
+		if (New == NULL)
 		{
+			// The original block is untouched; put it back.
+			_FC_PalLink(Heap, Old);
 			return NULL;
 		}
-		return (char*)pBuffer->pData + (index * pBuffer->ElementSize);
+		New->Size = Size;
+		_FC_PalLink(Heap, New);
+		return New + 1;
 	}
 
-	/**
-	 * @brief Finds the first occurrence of a pattern of elements within a buffer.
-	 * @internal
-	 * @param pBuffer The buffer to search within.
-	 * @param pPattern A pointer to the pattern of elements to find.
-	 * @param patternSize The number of elements in the pattern.
-	 * @param startIndex The index in the buffer from which to start the search.
-	 * @return The starting index of the found pattern, or (size_t)-1 if the pattern is not found.
-	 */
-	static inline size_t
-		_FC_BufferFind(
-			_In_ const _FC_BUFFER* pBuffer,
-			_In_ const void* pPattern,
-			_In_ size_t patternSize,
-			_In_ size_t startIndex)
+	static inline void _FC_PalFree(_In_ HANDLE Heap, _In_ const void* Block)
 	{
-		if (patternSize == 0 || pBuffer->Count < patternSize || startIndex > pBuffer->Count - patternSize)
-		{
-			return (size_t)-1;
-		}
+		_FC_PAL_BLOCK* Header = (_FC_PAL_BLOCK*)Block - 1;
+		(void)Heap;
+		_FC_PalUnlink(Header);
+		free(Header);
+	}
 
-		size_t searchLimit = pBuffer->Count - patternSize;
-		for (size_t i = startIndex; i <= searchLimit; ++i)
+	static inline size_t _FC_PalBlockSize(_In_ HANDLE Heap, _In_ const void* Block)
+	{
+		(void)Heap;
+		return ((const _FC_PAL_BLOCK*)Block - 1)->Size;
+	}
+
+	static inline int _FC_PalUtf8ToWide(
+		_In_ const char* Input,
+		_In_ int Length,
+		_Out_writes_(Capacity) WCHAR* Output,
+		_In_ int Capacity,
+		_In_ BOOL Strict)
+	{
+		const unsigned char* Bytes = (const unsigned char*)Input;
+		size_t Size;
+		size_t Index = 0;
+		size_t Count = 0;
+
+		if (Input == NULL || Length == 0 || Length < -1 || Capacity < 0 || (Capacity > 0 && Output == NULL))
+			return 0;
+		Size = (Length < 0) ? strlen(Input) + 1 : (size_t)Length;
+
+		while (Index < Size)
 		{
-			void* pCurrent = (char*)pBuffer->pData + (i * pBuffer->ElementSize);
-			if (memcmp(pCurrent, pPattern, patternSize * pBuffer->ElementSize) == 0)
+			unsigned int Lead = Bytes[Index];
+			unsigned int CodePoint = Lead;
+			unsigned int Minimum = 0;
+			size_t Trail = 0;
+			size_t Used = 1;
+			BOOL Valid = TRUE;
+			size_t Units;
+
+			if (Lead >= 0xC2 && Lead <= 0xDF) { CodePoint = Lead & 0x1F; Trail = 1; Minimum = 0x80; }
+			else if ((Lead & 0xF0) == 0xE0) { CodePoint = Lead & 0x0F; Trail = 2; Minimum = 0x800; }
+			else if (Lead >= 0xF0 && Lead <= 0xF4) { CodePoint = Lead & 0x07; Trail = 3; Minimum = 0x10000; }
+			else if (Lead >= 0x80) Valid = FALSE;
+
+			while (Valid && Used <= Trail && Index + Used < Size && (Bytes[Index + Used] & 0xC0) == 0x80)
 			{
-				return i;
+				CodePoint = (CodePoint << 6) | (Bytes[Index + Used] & 0x3F);
+				Used++;
+			}
+			if (Valid && (Used != Trail + 1 || CodePoint < Minimum || CodePoint > 0x10FFFF ||
+				(CodePoint >= 0xD800 && CodePoint <= 0xDFFF)))
+				Valid = FALSE;
+			if (!Valid)
+			{
+				if (Strict)
+					return 0;
+				CodePoint = 0xFFFD;
+			}
+			Index += Used;
+
+			Units = (sizeof(WCHAR) == 2 && CodePoint > 0xFFFF) ? 2 : 1;
+			if (Count + Units > (size_t)INT_MAX)
+				return 0;
+			if (Capacity > 0)
+			{
+				if (Count + Units > (size_t)Capacity)
+					return 0;
+				if (Units == 2)
+				{
+					Output[Count] = (WCHAR)(0xD800 + ((CodePoint - 0x10000) >> 10));
+					Output[Count + 1] = (WCHAR)(0xDC00 + ((CodePoint - 0x10000) & 0x3FF));
+				}
+				else
+				{
+					Output[Count] = (WCHAR)CodePoint;
+				}
 			}
+			Count += Units;
 		}
-		return (size_t)-1;
+		return (int)Count;
 	}
 
-	/**
-	 * @brief Replaces all occurrences of a pattern with a new pattern.
-	 *
-	 * This function performs a single-pass replacement. It first calculates the
-	 * required size for the new buffer, allocates it, and then iterates through the
-	 * source buffer, copying non-matching parts and inserting the new pattern where
-	 * matches occur. If the new pattern is NULL or its size is 0, it effectively
-	 * removes all occurrences of the old pattern.
-	 * @internal
-	 * @param pBuffer A pointer to the _FC_BUFFER to modify. The original buffer's data is freed and replaced.
-	 * @param pOldPattern A pointer to the sequence of elements to be replaced.
-	 * @param oldPatternSize The number of elements in the old pattern.
-	 * @param pNewPattern A pointer to the new sequence of elements to insert. Can be NULL to indicate removal.
-	 * @param newPatternSize The number of elements in the new pattern.
-	 * @return TRUE on success, FALSE on memory allocation or parameter validation failure.
-	 */
-	static inline BOOL
-		_FC_BufferReplace(
-			_Inout_ _FC_BUFFER* pBuffer,
-			_In_ const void* pOldPattern,
-			_In_ size_t oldPatternSize,
-			_In_opt_ const void* pNewPattern,
-			_In_ size_t newPatternSize)
+	static inline int _FC_PalWideToUtf8(
+		_In_ const WCHAR* Input,
+		_In_ int Length,
+		_Out_writes_(Capacity) char* Output,
+		_In_ int Capacity)
 	{
-		// 1. Defensive Input Validation
-		if (!pBuffer || !pOldPattern)
-			return FALSE;
-		if (newPatternSize > 0 && !pNewPattern)
-			return FALSE;
-		if (pBuffer->Count > 0 && !pBuffer->pData) // Check for inconsistent buffer state
-			return FALSE;
-		if (pBuffer->ElementSize == 0 && pBuffer->Count > 0) // Reject degenerate buffer
-			return FALSE;
+		size_t Size;
+		size_t Index = 0;
+		size_t Count = 0;
 
-		if (oldPatternSize == 0 || pBuffer->Count == 0)
-			return TRUE;
+		if (Input == NULL || Length == 0 || Length < -1 || Capacity < 0 || (Capacity > 0 && Output == NULL))
+			return 0;
+		Size = (Length < 0) ? wcslen(Input) + 1 : (size_t)Length;
 
-		size_t count = 0;
-		// Pass 1: count occurrences
-		for (size_t i = 0; i + oldPatternSize <= pBuffer->Count; )
+		while (Index < Size)
 		{
-			if (memcmp((char*)pBuffer->pData + i * pBuffer->ElementSize,
-				pOldPattern,
-				oldPatternSize * pBuffer->ElementSize) == 0)
+			unsigned int CodePoint = (unsigned int)Input[Index++];
+			unsigned char Encoded[4];
+			size_t Bytes;
+
+			if (sizeof(WCHAR) == 2 && CodePoint >= 0xD800 && CodePoint <= 0xDBFF && Index < Size &&
+				(unsigned int)Input[Index] >= 0xDC00 && (unsigned int)Input[Index] <= 0xDFFF)
 			{
-				if (count == SIZE_MAX)
-					return FALSE; // Too many occurrences to count
-				count++;
-				i += oldPatternSize;
+				CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + ((unsigned int)Input[Index] - 0xDC00);
+				Index++;
+			}
+			// Unpaired surrogates and values outside Unicode become U+FFFD.
+			if ((CodePoint >= 0xD800 && CodePoint <= 0xDFFF) || CodePoint > 0x10FFFF)
+				CodePoint = 0xFFFD;
+
+			if (CodePoint < 0x80)
+			{
+				Encoded[0] = (unsigned char)CodePoint;
+				Bytes = 1;
+			}
+			else if (CodePoint < 0x800)
+			{
+				Encoded[0] = (unsigned char)(0xC0 | (CodePoint >> 6));
+				Encoded[1] = (unsigned char)(0x80 | (CodePoint & 0x3F));
+				Bytes = 2;
+			}
+			else if (CodePoint < 0x10000)
+			{
+				Encoded[0] = (unsigned char)(0xE0 | (CodePoint >> 12));
+				Encoded[1] = (unsigned char)(0x80 | ((CodePoint >> 6) & 0x3F));
+				Encoded[2] = (unsigned char)(0x80 | (CodePoint & 0x3F));
+				Bytes = 3;
 			}
 			else
 			{
-				i++;
+				Encoded[0] = (unsigned char)(0xF0 | (CodePoint >> 18));
+				Encoded[1] = (unsigned char)(0x80 | ((CodePoint >> 12) & 0x3F));
+				Encoded[2] = (unsigned char)(0x80 | ((CodePoint >> 6) & 0x3F));
+				Encoded[3] = (unsigned char)(0x80 | (CodePoint & 0x3F));
+				Bytes = 4;
+			}
+
+			if (Count + Bytes > (size_t)INT_MAX)
+				return 0;
+			if (Capacity > 0)
+			{
+				if (Count + Bytes > (size_t)Capacity)
+					return 0;
+				memcpy(Output + Count, Encoded, Bytes);
 			}
+			Count += Bytes;
 		}
+		return (int)Count;
+	}
 
-		if (count == 0)
-			return TRUE;
+	// Defined with the per-thread working-memory scope below.
+	static inline void* _FC_WorkAlloc(_In_ DWORD Flags, _In_ size_t Size);
+	static inline void _FC_WorkFree(const void* p);
 
-		// 2. Safely calculate new buffer size using pure unsigned arithmetic
-		size_t newCount;
-		if (newPatternSize >= oldPatternSize) {
-			// Growth path
-			size_t delta = newPatternSize - oldPatternSize;
-			if (delta > 0 && count > (SIZE_MAX - pBuffer->Count) / delta)
-				return FALSE; // Overflow
-			newCount = pBuffer->Count + count * delta;
+	/**
+	 * @brief Converts a path to a NUL-terminated UTF-8 string; free with _FC_WorkFree().
+	 * @internal
+	 */
+	static inline char* _FC_PalNativePath(_In_z_ const WCHAR* Path)
+	{
+		char* Native;
+		int Bytes = _FC_PalWideToUtf8(Path, -1, NULL, 0);
+		if (Bytes <= 0)
+			return NULL;
+		Native = (char*)_FC_WorkAlloc(0, (size_t)Bytes);
+		if (Native != NULL && _FC_PalWideToUtf8(Path, -1, Native, Bytes) != Bytes)
+		{
+			_FC_WorkFree(Native);
+			Native = NULL;
 		}
-		else {
-			// Shrink path
-			size_t delta = oldPatternSize - newPatternSize;
-			size_t totalShrink = count * delta;
-				if (totalShrink > pBuffer->Count)
-					return FALSE;  // Logic error: cannot shrink more than the buffer size
-				newCount = pBuffer->Count - totalShrink;
-			}
-
-			_FC_BUFFER newBuf = { 0 };
-			_FC_BufferInit(&newBuf, pBuffer->ElementSize);
+		return Native;
+	}
 
-		// Handle the edge case of replacing with nothing, resulting in an empty buffer
-		if (newCount == 0)
+	static inline _FC_FILE _FC_PalOpenRead(_In_z_ const WCHAR* Path, _In_ BOOL Sequential)
+	{
+		struct stat Info;
+		int File;
+		char* Native = _FC_PalNativePath(Path);
+		if (Native == NULL)
+			return _FC_INVALID_FILE;
+		do
+			File = open(Native, O_RDONLY | O_CLOEXEC);
+		while (File < 0 && errno == EINTR);
+		_FC_WorkFree(Native);
+		if (File < 0)
+			return _FC_INVALID_FILE;
+
+		// Only regular files are compared: directories, devices and pipes are
+		// refused here, as the Win32 path checks refuse them by name.
+		if (fstat(File, &Info) != 0 || !S_ISREG(Info.st_mode))
 		{
-			_FC_BufferFree(pBuffer);
-			*pBuffer = newBuf; // newBuf is already an empty, valid buffer
-			return TRUE;
+			close(File);
+			return _FC_INVALID_FILE;
 		}
+#if defined(POSIX_FADV_SEQUENTIAL)
+		if (Sequential)
+			(void)posix_fadvise(File, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+		(void)Sequential;
+#endif
+		return File;
+	}
 
-		// 3. Check for allocation size overflow before allocating
-		if (pBuffer->ElementSize > 0 && newCount > SIZE_MAX / pBuffer->ElementSize)
+	static inline _FC_FILE _FC_PalCreateFile(_In_z_ const WCHAR* Path, _In_ BOOL ShareRead)
+	{
+		int File;
+		char* Native = _FC_PalNativePath(Path);
+		(void)ShareRead;
+		if (Native == NULL)
+			return _FC_INVALID_FILE;
+		do
+			File = open(Native, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		while (File < 0 && errno == EINTR);
+		_FC_WorkFree(Native);
+		return File;
+	}
+
+	static inline BOOL _FC_PalClose(_In_ _FC_FILE File)
+	{
+		return close(File) == 0;
+	}
+
+	static inline BOOL _FC_PalFileSize(_In_ _FC_FILE File, _Out_ ULONGLONG* Size)
+	{
+		struct stat Info;
+		*Size = 0;
+		if (fstat(File, &Info) != 0 || Info.st_size < 0)
 			return FALSE;
-		size_t newSizeInBytes = newCount * pBuffer->ElementSize;
+		*Size = (ULONGLONG)Info.st_size;
+		return TRUE;
+	}
 
-		newBuf.pData = HeapAlloc(GetProcessHeap(), 0, newSizeInBytes);
-		if (!newBuf.pData)
+	static inline BOOL _FC_PalRead(
+		_In_ _FC_FILE File,
+		_Out_writes_bytes_(Length) void* Buffer,
+		_In_ DWORD Length,
+		_Out_ DWORD* BytesRead)
+	{
+		ssize_t Got;
+		do
+			Got = read(File, Buffer, Length);
+		while (Got < 0 && errno == EINTR);
+		*BytesRead = (Got > 0) ? (DWORD)Got : 0;
+		return Got >= 0;
+	}
+
+	static inline BOOL _FC_PalReadAt(
+		_In_ _FC_FILE File,
+		_In_ ULONGLONG Offset,
+		_Out_writes_bytes_(Length) void* Buffer,
+		_In_ DWORD Length,
+		_Out_ DWORD* BytesRead)
+	{
+		ssize_t Got;
+		*BytesRead = 0;
+		if (Offset > (ULONGLONG)INT64_MAX)
 			return FALSE;
-		newBuf.Capacity = newCount;
+		do
+			Got = pread(File, Buffer, Length, (off_t)Offset);
+		while (Got < 0 && errno == EINTR);
+		*BytesRead = (Got > 0) ? (DWORD)Got : 0;
+		return Got >= 0;
+	}
 
-		// Pass 2: build the new buffer
-		size_t read_idx = 0, write_idx = 0;
-		const size_t elemSize = pBuffer->ElementSize;
-		char* const dstBase = (char*)newBuf.pData;
-		const char* const srcBase = (char*)pBuffer->pData;
+	static inline BOOL _FC_PalWrite(
+		_In_ _FC_FILE File,
+		_In_reads_bytes_(Length) const void* Buffer,
+		_In_ DWORD Length,
+		_Out_ DWORD* Written)
+	{
+		ssize_t Put;
+		do
+			Put = write(File, Buffer, Length);
+		while (Put < 0 && errno == EINTR);
+		*Written = (Put > 0) ? (DWORD)Put : 0;
+		return Put >= 0;
+	}
 
-		while (read_idx < pBuffer->Count)
-		{
-			if (read_idx + oldPatternSize <= pBuffer->Count &&
-				memcmp(srcBase + read_idx * elemSize, pOldPattern, oldPatternSize * elemSize) == 0)
-			{
-				if (newPatternSize > 0)
-				{
-					if (write_idx + newPatternSize > newBuf.Capacity) goto cleanup;
-					memcpy(dstBase + write_idx * elemSize, pNewPattern, newPatternSize * elemSize);
-					write_idx += newPatternSize;
-				}
-				read_idx += oldPatternSize;
-			}
-			else
-			{
-				if (write_idx + 1 > newBuf.Capacity) goto cleanup;
-				memcpy(dstBase + write_idx * elemSize, srcBase + read_idx * elemSize, elemSize);
-				write_idx++;
-				read_idx++;
-			}
-		}
-		newBuf.Count = write_idx;
+	static inline BOOL _FC_PalFlush(_In_ _FC_FILE File)
+	{
+		return fsync(File) == 0;
+	}
 
-		// Swap in the new buffer
-		HeapFree(GetProcessHeap(), 0, pBuffer->pData);
-		*pBuffer = newBuf;
+	static inline BOOL _FC_PalReplaceFile(_In_z_ const WCHAR* Source, _In_z_ const WCHAR* Target)
+	{
+		BOOL Moved = FALSE;
+		char* NativeSource = _FC_PalNativePath(Source);
+		char* NativeTarget = _FC_PalNativePath(Target);
+		if (NativeSource != NULL && NativeTarget != NULL)
+			Moved = rename(NativeSource, NativeTarget) == 0;
+		_FC_WorkFree(NativeSource);
+		_FC_WorkFree(NativeTarget);
+		return Moved;
+	}
+
+	static inline void _FC_PalDeleteFile(_In_z_ const WCHAR* Path)
+	{
+		char* Native = _FC_PalNativePath(Path);
+		if (Native != NULL)
+			(void)unlink(Native);
+		_FC_WorkFree(Native);
+	}
+
+	// Seconds from 1601-01-01 (the FILETIME epoch) to 1970-01-01.
+#define _FC_PAL_EPOCH_DELTA 11644473600ull
+
+	static inline BOOL _FC_PalFileInfo(
+		_In_ _FC_FILE File,
+		_Out_ ULONGLONG* Size,
+		_Out_ ULONGLONG* LastWriteTime,
+		_Out_ ULONGLONG* ChangeTime,
+		_Out_ ULONGLONG* FileId,
+		_Out_ DWORD* VolumeSerial)
+	{
+		struct stat Info;
+		if (fstat(File, &Info) != 0)
+			return FALSE;
+#if defined(__APPLE__)
+		const struct timespec Modified = Info.st_mtimespec;
+		const struct timespec Changed = Info.st_ctimespec;
+#else
+		const struct timespec Modified = Info.st_mtim;
+		const struct timespec Changed = Info.st_ctim;
+#endif
+		*Size = (ULONGLONG)Info.st_size;
+		*LastWriteTime = ((ULONGLONG)Modified.tv_sec + _FC_PAL_EPOCH_DELTA) * 10000000ull +
+			(ULONGLONG)Modified.tv_nsec / 100;
+		*ChangeTime = ((ULONGLONG)Changed.tv_sec + _FC_PAL_EPOCH_DELTA) * 10000000ull +
+			(ULONGLONG)Changed.tv_nsec / 100;
+		*FileId = (ULONGLONG)Info.st_ino;
+		*VolumeSerial = (DWORD)((ULONGLONG)Info.st_dev ^ ((ULONGLONG)Info.st_dev >> 32));
 		return TRUE;
+	}
 
-	cleanup:
-		// This cleanup path is a safeguard against logic errors in the write loop
-		HeapFree(GetProcessHeap(), 0, newBuf.pData);
-		return FALSE;
+	static inline const void* _FC_PalMapView(_In_ _FC_FILE File, _In_ size_t Length)
+	{
+		void* View = mmap(NULL, Length, PROT_READ, MAP_PRIVATE, File, 0);
+		if (View == MAP_FAILED)
+			return NULL;
+#if defined(MADV_SEQUENTIAL)
+		(void)madvise(View, Length, MADV_SEQUENTIAL);
+#endif
+		return View;
+	}
+
+	static inline void _FC_PalUnmapView(_In_ const void* View, _In_ size_t Length)
+	{
+		munmap((void*)View, Length);
 	}
 
+#define _FC_PAL_LARGE_PAGE_BYTES ((size_t)2 * 1024 * 1024)
+
 	/**
-	 * @brief Converts a character buffer to a null-terminated string.
+	 * @brief Allocates at least Size bytes of read-write memory backed by large pages.
 	 *
-	 * Ensures the buffer is of type `char`, appends a null terminator if one is not
-	 * already present, and returns a pointer to the raw data.
+	 * Tries the reserved huge page pool first (MAP_HUGETLB). When it is empty, as it
+	 * is by default, maps a range aligned to 2 MiB and asks for transparent huge
+	 * pages with madvise(MADV_HUGEPAGE). Where neither exists the allocation fails
+	 * and the caller falls back to its heap.
 	 * @internal
-	 * @note On failure, this function may free the buffer's internal data.
-	 * @param pBuffer A pointer to the character `_FC_BUFFER`.
-	 * @return A pointer to the null-terminated string, or NULL on failure or if the buffer is not a char buffer.
+	 * @param[out] Mapped Receives the size to pass to `_FC_PalLargeFree`.
+	 * @return The block, or NULL.
 	 */
-	static inline char*
-		_FC_BufferToString(
-			_Inout_ _FC_BUFFER* pBuffer)
+	static inline void* _FC_PalLargeAlloc(_In_ size_t Size, _Out_ size_t* Mapped)
 	{
-		// Ensure it's a char buffer.
-		if (pBuffer->ElementSize != sizeof(char)) return NULL;
-
-		// Append a null terminator if not already present.
-		if (pBuffer->Count == 0 || *((char*)_FC_BufferGet(pBuffer, pBuffer->Count - 1)) != '\0')
+		const size_t Page = _FC_PAL_LARGE_PAGE_BYTES;
+		*Mapped = 0;
+		if (Size > SIZE_MAX - 2 * Page)
+			return NULL;
+		size_t Rounded = (Size + Page - 1) & ~(Page - 1);
+#if defined(MAP_HUGETLB)
+		void* Huge = mmap(NULL, Rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (Huge != MAP_FAILED)
 		{
-			char nullChar = '\0';
-			if (!_FC_BufferAppend(pBuffer, &nullChar))
-			{
-				// On failure, we can't return a valid string.
-				_FC_BufferFree(pBuffer);
-				return NULL;
-			}
+			*Mapped = Rounded;
+			return Huge;
 		}
-		return (char*)pBuffer->pData;
+#endif
+#if defined(MADV_HUGEPAGE)
+		// Over-map by one page and trim both ends so that the range is aligned.
+		BYTE* Raw = (BYTE*)mmap(NULL, Rounded + Page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if ((void*)Raw == MAP_FAILED)
+			return NULL;
+		BYTE* Aligned = (BYTE*)(((uintptr_t)Raw + Page - 1) & ~(uintptr_t)(Page - 1));
+		size_t Head = (size_t)(Aligned - Raw);
+		if (Head != 0)
+			munmap(Raw, Head);
+		if (Page - Head != 0)
+			munmap(Aligned + Rounded, Page - Head);
+		if (madvise(Aligned, Rounded, MADV_HUGEPAGE) != 0)
+		{
+			munmap(Aligned, Rounded);
+			return NULL;
+		}
+		*Mapped = Rounded;
+		return Aligned;
+#else
+		return NULL;
+#endif
 	}
 
-	/**
-	 * @brief Converts an ASCII character to its lowercase equivalent.
-	 * @internal
-	 * @param Character The input character.
-	 * @return The lowercase version of the character if it's an uppercase letter, otherwise the character itself.
-	 */
-	static inline unsigned char
-		_FC_ToLowerAscii(
-			unsigned char Character)
+	static inline void _FC_PalLargeFree(_In_ void* Block, _In_ size_t Mapped)
 	{
-		if (Character >= 'A' && Character <= 'Z')
+		munmap(Block, Mapped);
+	}
+
+	static locale_t g_FcLowerLocale;
+	static pthread_once_t g_FcLowerLocaleOnce = PTHREAD_ONCE_INIT;
+
+	static void _FC_PalLowerLocaleInit(void)
+	{
+		// A private C.UTF-8 locale gives Unicode case mapping without
+		// touching the process locale.
+		g_FcLowerLocale = newlocale(LC_CTYPE_MASK, "C.UTF-8", (locale_t)0);
+	}
+
+	static inline DWORD _FC_PalLowerWide(_Inout_ WCHAR* Buffer, _In_ DWORD Length)
+	{
+		DWORD Index;
+		pthread_once(&g_FcLowerLocaleOnce, _FC_PalLowerLocaleInit);
+		for (Index = 0; Index < Length; Index++)
 		{
-			return Character + ('a' - 'A');
+			if (g_FcLowerLocale != (locale_t)0)
+				Buffer[Index] = (WCHAR)towlower_l((wint_t)Buffer[Index], g_FcLowerLocale);
+			else if (Buffer[Index] >= L'A' && Buffer[Index] <= L'Z')
+				Buffer[Index] = (WCHAR)(Buffer[Index] + (L'a' - L'A'));
 		}
-		return Character;
+		return Length;
 	}
 
-	/**
-	 * @brief Creates a new, null-terminated heap-allocated string from a character range.
-	 * @internal
-	 * @param String A pointer to the source character array.
-	 * @param Length The number of characters to copy from the source.
-	 * @return A pointer to the new heap-allocated string, or NULL on failure. The caller must free this memory.
-	 */
-	static inline char*
-		_FC_StringDuplicateRange(
-			_In_reads_(Length) const char* String,
-			_In_ size_t Length)
+	static inline int _FC_PalCompareNoCaseW(_In_z_ const WCHAR* Left, _In_z_ const WCHAR* Right)
 	{
-		char* Output = (char*)HeapAlloc(GetProcessHeap(), 0, Length + 1);
-		if (Output == NULL)
+		return wcscasecmp(Left, Right);
+	}
+
+	static inline BOOL _FC_PalGetEnvironmentNumber(_In_z_ const WCHAR* Name, _Out_ ULONGLONG* Value)
+	{
+		char Native[64];
+		const char* Text;
+		char* End = NULL;
+		size_t Index;
+		*Value = 0;
+		// Variable names are ASCII.
+		for (Index = 0; Name[Index] != L'\0'; Index++)
 		{
-			return NULL;
+			if (Index + 1 >= sizeof(Native) || (unsigned int)Name[Index] > 0x7F)
+				return FALSE;
+			Native[Index] = (char)Name[Index];
 		}
-		CopyMemory(Output, String, Length);
-		Output[Length] = '\0';
-		return Output;
+		Native[Index] = '\0';
+		Text = getenv(Native);
+		if (Text == NULL || Text[0] < '0' || Text[0] > '9')
+			return FALSE;
+		errno = 0;
+		*Value = (ULONGLONG)strtoull(Text, &End, 10);
+		return errno == 0 && End != Text && *End == '\0';
 	}
 
-	/**
-	 * @brief Converts a UTF-8 encoded string to its lowercase equivalent.
-	 *
-	 * This function handles multi-byte UTF-8 characters correctly by converting the
-	 * string to UTF-16, using the Windows `CharLowerBuffW` function, and then converting
-	 * it back to a new UTF-8 string.
-	 * @internal
-	 * @param Source A pointer to the source UTF-8 string.
-	 * @param SourceLength The length in bytes of the source string.
-	 * @param[out] NewLength A pointer to a size_t that will receive the length of the new lowercase string.
-	 * @return A pointer to a new, heap-allocated, null-terminated lowercase UTF-8 string, or NULL on failure. The caller must free this memory.
-	 */
-	static inline char*
-		_FC_StringToLowerUnicode(
-			_In_reads_(SourceLength) const char* Source,
-			_In_ size_t SourceLength,
-			_Out_ size_t* NewLength)
+	static inline LONGLONG _FC_PalCounter(void)
 	{
-		*NewLength = 0;
-		char* DestBuffer = NULL;
-		WCHAR* WideBuffer = NULL;
+		struct timespec Now;
+		clock_gettime(CLOCK_MONOTONIC, &Now);
+		return (LONGLONG)Now.tv_sec * 1000000000ll + Now.tv_nsec;
+	}
 
-		if (SourceLength == 0)
-		{
-			// Empty input → return empty string
-			return _FC_StringDuplicateRange("", 0);
-		}
+	static inline LONGLONG _FC_PalCounterFrequency(void)
+	{
+		return 1000000000ll;
+	}
 
-		// The MultiByteToWideChar API uses an int for length, so we must respect that limit.
-		if (SourceLength > INT_MAX)
-		{
-			return NULL; // Input too large for the API.
-		}
+	static inline ULONGLONG _FC_PalSystemTime(void)
+	{
+		struct timespec Now;
+		clock_gettime(CLOCK_REALTIME, &Now);
+		return ((ULONGLONG)Now.tv_sec + _FC_PAL_EPOCH_DELTA) * 10000000ull + (ULONGLONG)Now.tv_nsec / 100;
+	}
 
-		// Determine required UTF-16 length
-		int WideLength = MultiByteToWideChar(CP_UTF8, 0,
-			Source, (int)SourceLength,
-			NULL, 0);
-		if (WideLength == 0)
-			goto cleanup;
+	static inline void _FC_PalLockInit(_Out_ _FC_LOCK* Lock)
+	{
+		pthread_rwlock_init(Lock, NULL);
+	}
 
-#define STACK_BUFFER_SIZE 512 // Use stack for up to 512 wide chars (1KB)
-		WCHAR TmpStackBuffer[STACK_BUFFER_SIZE];
-		WideBuffer = TmpStackBuffer;
+	static inline void _FC_PalLockDelete(_Inout_ _FC_LOCK* Lock)
+	{
+		pthread_rwlock_destroy(Lock);
+	}
 
-		// If the required size is larger than our stack buffer, allocate from the heap.
-		if (WideLength > STACK_BUFFER_SIZE)
-		{
-			if ((size_t)WideLength > SIZE_MAX / sizeof(WCHAR)) // Check for overflow
-				goto cleanup;
-			WideBuffer = (WCHAR*)HeapAlloc(GetProcessHeap(), 0,
-				(size_t)WideLength * sizeof(WCHAR));
-			if (WideBuffer == NULL)
-				goto cleanup;
-		}
+	static inline void _FC_PalLockExclusive(_Inout_ _FC_LOCK* Lock)
+	{
+		pthread_rwlock_wrlock(Lock);
+	}
 
-		// Convert UTF-8 → UTF-16
-		if (MultiByteToWideChar(CP_UTF8, 0,
-			Source, (int)SourceLength,
-			WideBuffer, WideLength) == 0)
-			goto cleanup;
+	static inline void _FC_PalUnlockExclusive(_Inout_ _FC_LOCK* Lock)
+	{
+		pthread_rwlock_unlock(Lock);
+	}
 
-		// Lowercase in place using an explicit character count. This avoids
-		// relying on NUL-termination because the UTF-16 buffer above is created
-		// from an explicit byte length (SourceLength), not from a NUL-terminated input.
-		if (CharLowerBuffW(WideBuffer, (DWORD)WideLength) == 0 && WideLength > 0)
-			goto cleanup;
+	static inline void _FC_PalLockShared(_Inout_ _FC_LOCK* Lock)
+	{
+		pthread_rwlock_rdlock(Lock);
+	}
 
-		// Determine required UTF-8 length
-		int Utf8Length = WideCharToMultiByte(CP_UTF8, 0,
-			WideBuffer, WideLength,
-			NULL, 0, NULL, NULL);
-		if (Utf8Length == 0)
-			goto cleanup;
+	static inline void _FC_PalUnlockShared(_Inout_ _FC_LOCK* Lock)
+	{
+		pthread_rwlock_unlock(Lock);
+	}
 
-		// Allocate UTF-8 buffer
-		DestBuffer = (char*)HeapAlloc(GetProcessHeap(), 0,
-			(size_t)Utf8Length + 1);
-		if (DestBuffer == NULL)
-			goto cleanup;
+	static inline LONGLONG _FC_PalIncrement64(_Inout_ volatile LONG64* Value)
+	{
+		return __atomic_add_fetch(Value, 1, __ATOMIC_SEQ_CST);
+	}
 
-		// Convert UTF-16 → UTF-8
-		if (WideCharToMultiByte(CP_UTF8, 0,
-			WideBuffer, WideLength,
-			DestBuffer, Utf8Length,
-			NULL, NULL) == 0)
-		{
-			HeapFree(GetProcessHeap(), 0, DestBuffer);
-			DestBuffer = NULL;
-			goto cleanup;
-		}
+	static inline DWORD _FC_PalProcessId(void)
+	{
+		return (DWORD)getpid();
+	}
 
-		DestBuffer[Utf8Length] = '\0';
-		*NewLength = (size_t)Utf8Length;
+	static inline DWORD _FC_PalThreadId(void)
+	{
+#if defined(__linux__)
+		return (DWORD)syscall(SYS_gettid);
+#else
+		return (DWORD)(uintptr_t)pthread_self();
+#endif
+	}
 
-	cleanup:
-		// Free the heap buffer if it was allocated
-		if (WideBuffer != TmpStackBuffer && WideBuffer != NULL)
-			HeapFree(GetProcessHeap(), 0, WideBuffer);
+	typedef void (*_FC_THREAD_ROUTINE)(_In_ void* Parameter);
 
-#undef STACK_BUFFER_SIZE
-		return DestBuffer;
+	typedef struct
+	{
+		_FC_THREAD_ROUTINE Routine;
+		void* Parameter;
+		pthread_t Handle;
+	} _FC_THREAD;
+
+	static void* _FC_PalThreadMain(_In_ void* Parameter)
+	{
+		_FC_THREAD* Thread = (_FC_THREAD*)Parameter;
+		Thread->Routine(Thread->Parameter);
+		return NULL;
+	}
+
+	static inline BOOL _FC_PalThreadStart(
+		_Out_ _FC_THREAD* Thread,
+		_In_ _FC_THREAD_ROUTINE Routine,
+		_In_opt_ void* Parameter)
+	{
+		Thread->Routine = Routine;
+		Thread->Parameter = Parameter;
+		return pthread_create(&Thread->Handle, NULL, _FC_PalThreadMain, Thread) == 0;
 	}
 
+	static inline void _FC_PalThreadJoin(_Inout_ _FC_THREAD* Thread)
+	{
+		pthread_join(Thread->Handle, NULL);
+	}
+
+#endif
+
 	/**
-	 * @brief Computes a hash for a character string using a simple algorithm (djb2-like).
-	 *
-	 * This function can optionally ignore case and whitespace for ASCII strings.
+	 * @brief Reads exactly Length bytes at Offset, failing on a read error or early end of file.
 	 * @internal
-	 * @param String The string to hash.
-	 * @param Length The length of the string.
-	 * @param Flags A bitmask of comparison flags (FC_IGNORE_CASE, FC_IGNORE_WS).
-	 * @return The computed 32-bit hash value.
 	 */
-	static inline UINT
-		_FC_ComputeHash(
-			_In_reads_(Length) const char* String,
-			_In_ size_t Length,
-			_In_ UINT Flags)
+	static BOOL
+		_FC_ReadFully(
+			_In_ _FC_FILE File,
+			_In_ ULONGLONG Offset,
+			_Out_writes_bytes_(Length) void* Buffer,
+			_In_ size_t Length)
 	{
-		UINT Hash = 0;
-		BOOL const ignoreCase = (Flags & FC_IGNORE_CASE);
-		BOOL const ignoreWs = (Flags & FC_IGNORE_WS);
-
-		for (size_t i = 0; i < Length; ++i)
+		size_t Filled = 0;
+		while (Filled < Length)
 		{
-			unsigned char Character = (unsigned char)String[i];
-			if (ignoreWs && (Character == ' ' || Character == '\t'))
-				continue;
-			if (ignoreCase)
-				Character = _FC_ToLowerAscii(Character);
-			Hash = Hash * 31 + Character;
+			DWORD BytesRead = 0;
+			size_t Want = Length - Filled;
+			if (Want > 0x40000000u)
+				Want = 0x40000000u;
+			if (!_FC_PalReadAt(File, Offset + Filled, (BYTE*)Buffer + Filled, (DWORD)Want, &BytesRead) ||
+				BytesRead == 0)
+				return FALSE;
+			Filled += (size_t)BytesRead;
 		}
-		return Hash;
+		return TRUE;
 	}
 
 	/**
-	 * @brief Computes a hash for a line, handling Unicode case-insensitivity if required.
-	 *
-	 * This is a wrapper around `_FC_ComputeHash`. If Unicode case-insensitivity is
-	 * requested, it first converts the line to lowercase using the Unicode-aware
-	 * `_FC_StringToLowerUnicode` function before hashing. Otherwise, it calls
-	 * `_FC_ComputeHash` directly.
+	 * @brief Conditionally frees a heap pointer. Safe to call with NULL.
 	 * @internal
-	 * @param String The line's text to hash.
-	 * @param Length The length of the line's text.
-	 * @param Config A pointer to the main comparison configuration.
-	 * @return The computed hash value for the line.
 	 */
-	static inline UINT
-		_FC_HashLine(
-			_In_reads_(Length) const char* String,
-			_In_ size_t Length,
-			_In_ const FC_CONFIG* Config)
+	static inline void _FC_HeapFree(const void* p)
 	{
-		UINT Flags = Config->Flags;
-
-		// If case-insensitive and Unicode, we must use the slower, Unicode-aware path.
-		if ((Flags & FC_IGNORE_CASE) && Config->Mode == FC_MODE_TEXT_UNICODE)
-		{
-			size_t LowerLength;
-			char* LowerString = _FC_StringToLowerUnicode(String, Length, &LowerLength);
-			if (LowerString == NULL)
-				return 0; // Fail-safe; hashing 0 for NULL is safe for comparison fallback
-
-			// We pass the original flags, but the string is already lowercase, so
-			// the case-insensitivity path in _FC_ComputeHash will be redundant but harmless.
-			UINT Hash = _FC_ComputeHash(LowerString, LowerLength, Flags);
-			HeapFree(GetProcessHeap(), 0, LowerString);
-			return Hash;
-		}
-
-		// For all other cases (ASCII, or case-sensitive), compute the hash directly.
-		// _FC_ComputeHash now handles ASCII case-insensitivity on the fly.
-		return _FC_ComputeHash(String, Length, Flags);
+		if (p)
+			_FC_PalFree(_FC_PalProcessHeap(), p);
 	}
 
 	/**
-	 * @brief Compares two parsed lines for equality using the same normalization as the
-	 * hash function.
-	 *
-	 * This is used as a secondary check after a hash match to rule out false positives
-	 * due to hash collisions.  The comparison is case-insensitive when FC_IGNORE_CASE is
-	 * set, mirroring the behavior of _FC_HashLine.
+	 * @struct _FC_SESSION
+	 * @brief State kept alive between the comparisons of one FC_SESSION.
 	 * @internal
-	 * @param lineA The first line to compare.
-	 * @param lineB The second line to compare.
-	 * @param Config A pointer to the comparison configuration.
-	 * @return TRUE if the lines are equal under the current configuration, FALSE otherwise.
 	 */
-	static inline BOOL
-		_FC_LinesEqual(
-			_In_ const _FC_LINE* lineA,
-			_In_ const _FC_LINE* lineB,
-			_In_ const FC_CONFIG* Config)
+	struct _FC_SESSION
 	{
-		if (lineA->Length != lineB->Length)
-			return FALSE;
-
-		if (!(Config->Flags & FC_IGNORE_CASE))
-			return memcmp(lineA->Text, lineB->Text, lineA->Length) == 0;
+		HANDLE Heap;            // Private, unserialized heap for all per-comparison working memory.
+		_FC_BUFFER Read1;       // Reused file contents of the first text input.
+		_FC_BUFFER Read2;       // Reused file contents of the second text input.
+		unsigned char* Chunk1;  // Reused streamed binary read buffer, allocated on first use.
+		unsigned char* Chunk2;
+		BOOL Active;            // Set while an FC_Session* call is running (rejects re-entry).
+	};
 
-		if (Config->Mode == FC_MODE_TEXT_UNICODE)
-		{
-			// Unicode-aware case-insensitive comparison: lowercase both sides and compare.
-			size_t LowLenA = 0, LowLenB = 0;
-			char* LowA = _FC_StringToLowerUnicode(lineA->Text, lineA->Length, &LowLenA);
-			char* LowB = _FC_StringToLowerUnicode(lineB->Text, lineB->Length, &LowLenB);
-			// On allocation failure, both pointers are freed safely by _FC_HeapFree (which
-			// accepts NULL).  Returning FALSE is intentionally conservative: under OOM we
-			// report extra diffs rather than silently masking real differences.
-			BOOL Equal = FALSE;
-			if (LowA != NULL && LowB != NULL && LowLenA == LowLenB)
-				Equal = (memcmp(LowA, LowB, LowLenA) == 0);
-			_FC_HeapFree(LowA);
-			_FC_HeapFree(LowB);
-			return Equal;
-		}
+	/**
+	 * @enum _FC_STATS_PHASE
+	 * @brief The FC_STATS duration that the running code is charged to.
+	 * @internal
+	 */
+	typedef enum
+	{
+		_FC_STATS_NONE,         // Setup, path handling and anything else not reported.
+		_FC_STATS_READ,
+		_FC_STATS_PARSE,
+		_FC_STATS_HASH,
+		_FC_STATS_LCS,
+		_FC_STATS_BINARY,
+		_FC_STATS_REPORT
+	} _FC_STATS_PHASE;
 
-		// ASCII case-insensitive: compare byte-by-byte using the same _FC_ToLowerAscii
-		// that the hash function uses.
-		for (size_t i = 0; i < lineA->Length; i++)
-		{
-			if (_FC_ToLowerAscii((unsigned char)lineA->Text[i]) !=
-				_FC_ToLowerAscii((unsigned char)lineB->Text[i]))
-				return FALSE;
-		}
-		return TRUE;
-	}
+	/**
+	 * @struct _FC_WORK_SCOPE
+	 * @brief Working-memory source of the comparison running on a thread.
+	 * @internal
+	 */
+	typedef struct
+	{
+		struct _FC_SESSION* Session;    // Session whose heap and buffers serve the comparison, or NULL.
+		const FC_ALLOCATOR* Allocator;  // Caller's allocator, or NULL; takes precedence over the heaps.
+		FC_STATS* Stats;                // Caller's statistics, or NULL.
+		_FC_STATS_PHASE Phase;          // The phase being timed while Stats is set.
+		LONGLONG PhaseStart;            // Performance counter value at which Phase began.
+		size_t Budget;                  // FC_CONFIG::MaxMemoryBytes, or 0.
+		LONGLONG LiveBytes;             // Working memory held, while Budget or Stats is set.
+		BOOL OverBudget;                // An allocation was refused because of Budget.
+		FC_TRACE* Trace;                // Caller's trace file, or NULL.
+		ULONGLONG TracePair;            // FC_CONFIG::TracePair, stored with each event.
+		BOOL LargePages;                // FC_LARGE_PAGES was set and no caller's allocator is.
+	} _FC_WORK_SCOPE;
+
+	// Plain FC_Compare* calls run with an empty scope and use the process heap.
+	static _FC_THREAD_LOCAL _FC_WORK_SCOPE g_FcWork;
 
 	/**
-	 * @brief Frees all memory associated with the lines stored in a line buffer.
-	 *
-	 * This iterates through each `_FC_LINE` in the buffer, frees the `Text` pointer
-	 * for each line, and then frees the buffer's main data block itself.
+	 * @brief Installs the working-memory source for a public entry point on this thread.
 	 * @internal
-	 * @param pLineBuffer A pointer to the `_FC_BUFFER` containing `_FC_LINE` elements.
+	 * @param Session The session serving the call, or NULL.
+	 * @param Config The caller's configuration, whose allocator (if set) serves the call. May be NULL.
+	 * @return The previous scope, to be passed to `_FC_LeaveWork`.
 	 */
-	static void
-		_FC_FreeLineBufferContents(_Inout_ _FC_BUFFER* pLineBuffer)
+	static inline _FC_WORK_SCOPE _FC_EnterWork(
+		_In_opt_ struct _FC_SESSION* Session,
+		_In_opt_ const FC_CONFIG* Config)
 	{
-		for (size_t i = 0; i < pLineBuffer->Count; ++i)
+		_FC_WORK_SCOPE Previous = g_FcWork;
+		g_FcWork.Session = Session;
+		g_FcWork.Allocator = (Config != NULL && Config->Allocator.Alloc != NULL) ? &Config->Allocator : NULL;
+		g_FcWork.Stats = (Config != NULL) ? Config->Stats : NULL;
+		g_FcWork.Phase = _FC_STATS_NONE;
+		g_FcWork.Budget = (Config != NULL) ? Config->MaxMemoryBytes : 0;
+		g_FcWork.LiveBytes = 0;
+		g_FcWork.OverBudget = FALSE;
+		g_FcWork.Trace = (Config != NULL) ? Config->Trace : NULL;
+		g_FcWork.TracePair = (Config != NULL) ? Config->TracePair : 0;
+		g_FcWork.LargePages = g_FcWork.Allocator == NULL && Config != NULL && (Config->Flags & FC_LARGE_PAGES);
+
+		// Buffers a session kept from earlier calls are held by this one too.
+		if (Session != NULL)
 		{
-			_FC_LINE* line = (_FC_LINE*)_FC_BufferGet(pLineBuffer, i);
-			if (line && line->Text)
-			{
-				HeapFree(GetProcessHeap(), 0, line->Text);
-			}
+			g_FcWork.LiveBytes += (LONGLONG)(Session->Read1.Capacity * Session->Read1.ElementSize);
+			g_FcWork.LiveBytes += (LONGLONG)(Session->Read2.Capacity * Session->Read2.ElementSize);
+			if (Session->Chunk1 != NULL)
+				g_FcWork.LiveBytes += (LONGLONG)_FC_PalBlockSize(Session->Heap, Session->Chunk1);
+			if (Session->Chunk2 != NULL)
+				g_FcWork.LiveBytes += (LONGLONG)_FC_PalBlockSize(Session->Heap, Session->Chunk2);
 		}
-		_FC_BufferFree(pLineBuffer);
+		return Previous;
+	}
+
+	static inline void _FC_LeaveWork(_In_ _FC_WORK_SCOPE Previous)
+	{
+		g_FcWork = Previous;
 	}
 
 	/**
-	 * @brief Filters an LCS result to enforce a resynchronization threshold.
+	 * @brief Returns the statistics the comparison on this thread fills, or NULL.
 	 *
-	 * This function processes an optimal LCS result and keeps only "stable anchors"—
-	 * runs of consecutive matches that are at least `ResyncLines` long. This emulates
-	 * the behavior of fc.exe's /nnnn switch by discarding shorter, potentially
-	 * coincidental matches and consolidating differences into larger blocks.
+	 * Every instrumentation point tests this first, so with no FC_CONFIG::Stats a
+	 * comparison only pays one test per phase or chunk, and with FC_ENABLE_STATS 0
+	 * the instrumentation is removed by the compiler.
 	 * @internal
-	 *
-	 * @param LcsA              The array of LCS indices for file A.
-	 * @param LcsB              The array of LCS indices for file B.
-	 * @param LcsLength         The length of the input LCS arrays.
-	 * @param ResyncLines       The minimum number of consecutive lines to be considered a stable anchor.
-	 * @param[out] pFilteredLcsA A pointer to receive the new, heap-allocated filtered array of indices for file A. The caller must free this.
-	 * @param[out] pFilteredLcsB A pointer to receive the new, heap-allocated filtered array of indices for file B. The caller must free this.
-	 * @return The length of the new filtered LCS. Returns SIZE_MAX on memory allocation failure, 0 if all runs were filtered out.
 	 */
-	static size_t
-		_FC_FilterLcsForResync(
-			_In_ const size_t* LcsA,
-			_In_ const size_t* LcsB,
-			_In_ size_t LcsLength,
-			_In_ UINT ResyncLines,
-			_Outptr_result_buffer_maybenull_(LcsLength) size_t** pFilteredLcsA,
-			_Outptr_result_buffer_maybenull_(LcsLength) size_t** pFilteredLcsB)
-	{
-		*pFilteredLcsA = NULL;
-		*pFilteredLcsB = NULL;
-
-		// If no resync threshold is set (or is 1), or if there's nothing to filter,
-		// just make a copy of the original LCS.
-		if (LcsLength == 0 || ResyncLines <= 1)
-		{
-			if (LcsLength > 0)
-			{
-				*pFilteredLcsA = (size_t*)HeapAlloc(GetProcessHeap(), 0, LcsLength * sizeof(size_t));
-				*pFilteredLcsB = (size_t*)HeapAlloc(GetProcessHeap(), 0, LcsLength * sizeof(size_t));
-				if (!*pFilteredLcsA || !*pFilteredLcsB)
-				{
-					if (*pFilteredLcsA)
-						HeapFree(GetProcessHeap(), 0, *pFilteredLcsA);
-					if (*pFilteredLcsB)
-						HeapFree(GetProcessHeap(), 0, *pFilteredLcsB);
-					*pFilteredLcsA = NULL;
-					*pFilteredLcsB = NULL;
-					return SIZE_MAX; // Allocation failed
-				}
-				memcpy(*pFilteredLcsA, LcsA, LcsLength * sizeof(size_t));
-				memcpy(*pFilteredLcsB, LcsB, LcsLength * sizeof(size_t));
-			}
-			return LcsLength;
-		}
-
-		_FC_BUFFER FilteredA = { 0 }, FilteredB = { 0 };
-		_FC_BufferInit(&FilteredA, sizeof(size_t));
-		_FC_BufferInit(&FilteredB, sizeof(size_t));
+	static inline FC_STATS* _FC_Stats(void)
+	{
+#if FC_ENABLE_STATS
+		return g_FcWork.Stats;
+#else
+		return NULL;
+#endif
+	}
 
-		for (size_t i = 0; i < LcsLength; )
+	/**
+	 * @brief Charges the time since the last switch to the current phase and starts Phase.
+	 * @internal
+	 * @return The phase that was running, to be restored with another call.
+	 */
+	static inline _FC_STATS_PHASE _FC_StatsPhase(_In_ _FC_STATS_PHASE Phase)
+	{
+		FC_STATS* Stats = _FC_Stats();
+		if (Stats == NULL)
+			return _FC_STATS_NONE;
+
+		LONGLONG Now = _FC_PalCounter();
+		LONGLONG Frequency = _FC_PalCounterFrequency();
+		_FC_STATS_PHASE Previous = g_FcWork.Phase;
+		if (Previous != _FC_STATS_NONE && Frequency > 0)
 		{
-			size_t runStart = i;
-			size_t runEnd = i;
-			// Find the end of the current run of consecutive matching lines.
-			while (runEnd + 1 < LcsLength &&
-				LcsA[runEnd + 1] == LcsA[runEnd] + 1 &&
-				LcsB[runEnd + 1] == LcsB[runEnd] + 1)
-			{
-				runEnd++;
-			}
-
-			size_t runLength = (runEnd - runStart) + 1;
-			if (runLength >= ResyncLines)
+			ULONGLONG Ticks = (ULONGLONG)(Now - g_FcWork.PhaseStart);
+			ULONGLONG Freq = (ULONGLONG)Frequency;
+			ULONGLONG Nanoseconds = (Ticks / Freq) * 1000000000ull + (Ticks % Freq) * 1000000000ull / Freq;
+			switch (Previous)
 			{
-				// This run is a stable anchor, so keep it.
-				if (!_FC_BufferAppendRange(&FilteredA, &LcsA[runStart], runLength) ||
-					!_FC_BufferAppendRange(&FilteredB, &LcsB[runStart], runLength))
-				{
-					// On failure, free what we have allocated and return SIZE_MAX to signal error.
-					_FC_BufferFree(&FilteredA);
-					_FC_BufferFree(&FilteredB);
-					return SIZE_MAX;
-				}
+			case _FC_STATS_READ: Stats->ReadNanoseconds += Nanoseconds; break;
+			case _FC_STATS_PARSE: Stats->ParseNanoseconds += Nanoseconds; break;
+			case _FC_STATS_HASH: Stats->HashNanoseconds += Nanoseconds; break;
+			case _FC_STATS_LCS: Stats->LcsNanoseconds += Nanoseconds; break;
+			case _FC_STATS_BINARY: Stats->BinaryCompareNanoseconds += Nanoseconds; break;
+			case _FC_STATS_REPORT: Stats->ReportNanoseconds += Nanoseconds; break;
+			default: break;
 			}
-
-			i = runEnd + 1;
 		}
-
-		// Transfer ownership of the buffer's data to the output pointers.
-		*pFilteredLcsA = (size_t*)FilteredA.pData;
-		*pFilteredLcsB = (size_t*)FilteredB.pData;
-		return FilteredA.Count;
+		g_FcWork.Phase = Phase;
+		g_FcWork.PhaseStart = Now;
+		return Previous;
 	}
 
 	/**
-	 * @brief Processes the final LCS result to report differences via the callback.
+	 * @enum _FC_TRACE_EVENT
+	 * @brief The kinds of event written to an FC_TRACE file.
 	 * @internal
-	 * @param Context The user context containing file paths and line buffers.
-	 * @param Config The main comparison configuration, containing the callback pointer.
-	 * @param LcsA Array of matching line indices from file A.
-	 * @param LcsB Array of matching line indices from file B.
-	 * @param LcsLength The number of matching lines in the LCS.
-	 * @return FC_OK if files are identical, FC_DIFFERENT otherwise.
 	 */
-	static FC_RESULT
-		_FC_ProcessLcs(
-			_In_ const FC_USER_CONTEXT* Context,
-			_In_ const FC_CONFIG* Config, // Add this parameter
-			_In_ const size_t* LcsA,
-			_In_ const size_t* LcsB,
-			_In_ size_t LcsLength)
+	typedef enum
 	{
-		const _FC_BUFFER* pBufferA = Context->Lines1;
-		const _FC_BUFFER* pBufferB = Context->Lines2;
-
-		if (LcsLength == pBufferA->Count && LcsLength == pBufferB->Count) return FC_OK;
-
-		size_t IndexA = 0, IndexB = 0;
-		for (size_t i = 0; i <= LcsLength; ++i) {
-			size_t LcsLineA = (i < LcsLength) ? LcsA[i] : pBufferA->Count;
-			size_t LcsLineB = (i < LcsLength) ? LcsB[i] : pBufferB->Count;
-
-			BOOL hasAdds = (IndexB < LcsLineB);
-			BOOL hasDeletes = (IndexA < LcsLineA);
-
-			if (hasAdds || hasDeletes) {
-				FC_DIFF_BLOCK block = { 0 };
-				if (hasAdds && hasDeletes) block.Type = FC_DIFF_TYPE_CHANGE;
-				else if (hasAdds) block.Type = FC_DIFF_TYPE_ADD;
-				else block.Type = FC_DIFF_TYPE_DELETE;
-
-				// Convert chunk-relative indices to absolute indices using Context offsets
-				block.StartA = IndexA + Context->OffsetA;
-				block.EndA = LcsLineA + Context->OffsetA;
-				block.StartB = IndexB + Context->OffsetB;
-				block.EndB = LcsLineB + Context->OffsetB;
-				// CORRECTED: Call the callback from the Config struct, not the Context.
-				Config->DiffCallback(Context, &block);
-			}
-			IndexA = LcsLineA + 1;
-			IndexB = LcsLineB + 1;
-		}
-		return FC_DIFFERENT;
-	}
+		_FC_TRACE_COMPARE,      // One pair, from path checks to the result.
+		_FC_TRACE_OPEN,         // Path validation and canonicalization.
+		_FC_TRACE_SNIFF,        // Auto-mode content detection of one file.
+		_FC_TRACE_READ,         // Reading one file, or one streamed block.
+		_FC_TRACE_PARSE,        // Splitting one text into lines.
+		_FC_TRACE_CHUNK,        // The LCS over one chunk.
+		_FC_TRACE_REWIND,       // A chunk that ended at its last anchor (instant).
+		_FC_TRACE_REPORT,       // One text diff callback.
+		_FC_TRACE_BINARY        // Byte comparison of a mapped file or one streamed block.
+	} _FC_TRACE_EVENT;
 
 	/**
-	 * @brief Implements the Hunt-McIlroy algorithm to find the Longest Common Subsequence.
+	 * @brief Names of each _FC_TRACE_EVENT and of its two arguments (NULL when unused).
 	 * @internal
-	 * @param Context The user context containing file paths, line buffers, and user data.
-	 * @param Config The main comparison	configuration.
-	 * @param[out] pLastAnchorA Receives the chunk-relative index of the last confirmed match in buffer A (or 0 if none).
-	 * @param[out] pLastAnchorB Receives the chunk-relative index of the last confirmed match in buffer B (or 0 if none).
-	 * @return FC_OK if files are identical, FC_DIFFERENT if they differ, or an error code.
 	 */
-	static FC_RESULT
-		_FC_FindLcs(
-			_In_  const FC_USER_CONTEXT* Context,
-			_In_  const FC_CONFIG*       Config,
-			_Out_ size_t*                pLastAnchorA,
-			_Out_ size_t*                pLastAnchorB) {
-		const _FC_BUFFER* pBufferA = Context->Lines1;
-		const _FC_BUFFER* pBufferB = Context->Lines2;
-
-		FC_RESULT Result = FC_OK;
-		_FC_LCS_CONTEXT Ctx = { 0 };
-		_FC_MATCH* MatchPool = NULL;
-		_FC_HASH_MAP MapB = { 0 };
+	static const struct { const char* Name; const char* Arg1; const char* Arg2; } g_FcTraceEventNames[] = {
+		{ "compare", "result", NULL },
+		{ "open", NULL, NULL },
+		{ "sniff", "text", NULL },
+		{ "read", "bytes", NULL },
+		{ "parse", "lines", NULL },
+		{ "chunk", "lines_a", "lines_b" },
+		{ "rewind", "line_a", "line_b" },
+		{ "report", "start_a", "start_b" },
+		{ "binary", "bytes", NULL }
+	};
 
-		size_t* LcsA = NULL;
-		size_t* LcsB = NULL;
-		size_t* FilteredLcsA = NULL;
-		size_t* FilteredLcsB = NULL;
+	/**
+	 * @struct _FC_TRACE_RECORD
+	 * @brief One event held in a thread's buffer until it is written.
+	 * @internal
+	 */
+	typedef struct
+	{
+		LONGLONG Start;         // Performance counter values; equal for an instant event.
+		LONGLONG End;
+		ULONGLONG Pair;
+		ULONGLONG Arg1;
+		ULONGLONG Arg2;
+		_FC_TRACE_EVENT Event;
+		char Label[40];         // UTF-8 file name of a compare event, JSON-safe; empty otherwise.
+	} _FC_TRACE_RECORD;
 
-		// Initialize anchor outputs: default to no anchor (0)
-		*pLastAnchorA = 0;
-		*pLastAnchorB = 0;
+	/**
+	 * @struct _FC_TRACE_BUFFER
+	 * @brief The events one thread has recorded and not yet written.
+	 * @internal
+	 */
+	typedef struct _FC_TRACE_BUFFER
+	{
+		struct _FC_TRACE_BUFFER* Next;
+		DWORD ThreadId;
+		UINT Count;
+		_FC_TRACE_RECORD Records[FC_TRACE_BUFFER_EVENTS];
+	} _FC_TRACE_BUFFER;
 
-		if (pBufferA->Count == 0 && pBufferB->Count == 0) {
-			// Entire chunk identical
-			*pLastAnchorA = pBufferA->Count;
-			*pLastAnchorB = pBufferB->Count;
-			return FC_OK;
-		}
-		if (pBufferA->Count > 0 && pBufferB->Count == 0) return FC_DIFFERENT;
-		if (pBufferA->Count == 0 && pBufferB->Count > 0) return FC_DIFFERENT;
+	/**
+	 * @struct _FC_TRACE
+	 * @brief An open trace file and the per-thread buffers that feed it.
+	 * @internal
+	 */
+	struct _FC_TRACE
+	{
+		_FC_FILE File;
+		_FC_LOCK Lock;                  // Guards Buffers, File, Written and Failed.
+		_FC_TRACE_BUFFER* Buffers;
+		LONGLONG Id;                    // Unique per handle, so a stale thread-local cache never matches.
+		LONGLONG Origin;                // Counter value at open; timestamps are relative to it.
+		LONGLONG Frequency;
+		DWORD ProcessId;
+		ULONGLONG Written;
+		BOOL Failed;                    // A write failed or a thread buffer could not be allocated.
+	};
 
-		if (!_FC_HashMapCreate(&MapB, pBufferB->Count)) return FC_ERROR_MEMORY;
+	static volatile LONG64 g_FcTraceNextId;
 
-		MatchPool = (_FC_MATCH*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, pBufferB->Count * sizeof(_FC_MATCH));
-		if (!MatchPool) { Result = FC_ERROR_MEMORY; goto cleanup; }
+	// The buffer this thread last used and the Id of the trace it belongs to.
+	static _FC_THREAD_LOCAL _FC_TRACE_BUFFER* g_FcTraceBuffer;
+	static _FC_THREAD_LOCAL LONGLONG g_FcTraceBufferOwner;
 
-		for (size_t i = 0; i < pBufferB->Count; ++i) {
-			UINT hash = ((_FC_LINE*)_FC_BufferGet(pBufferB, i))->Hash;
-			_FC_HASH_MAP_ENTRY* entry = _FC_HashMapInsert(&MapB, hash);
-			_FC_MATCH* newMatch = &MatchPool[i];
-			newMatch->IndexInB = i;
-			newMatch->Next = entry->MatchHead;
-			entry->MatchHead = newMatch;
-		}
+	/**
+	 * @brief Returns the trace the comparison on this thread writes to, or NULL.
+	 *
+	 * Like `_FC_Stats`, every trace point tests this first, so an untraced
+	 * comparison pays one test per event and FC_ENABLE_TRACE 0 removes the points.
+	 * @internal
+	 */
+	static inline FC_TRACE* _FC_Trace(void)
+	{
+#if FC_ENABLE_TRACE
+		return g_FcWork.Trace;
+#else
+		return NULL;
+#endif
+	}
 
-		Ctx.Thresholds = (size_t*)HeapAlloc(GetProcessHeap(), 0, (pBufferA->Count + 1) * sizeof(size_t));
-		Ctx.Links = (size_t*)HeapAlloc(GetProcessHeap(), 0, (pBufferA->Count + 1) * sizeof(size_t));
-		if (!Ctx.Thresholds || !Ctx.Links) { Result = FC_ERROR_MEMORY; goto cleanup; }
+	/**
+	 * @brief Returns the start time of an event, or 0 if the comparison is not traced.
+	 * @internal
+	 */
+	static inline LONGLONG _FC_TraceNow(void)
+	{
+		if (_FC_Trace() == NULL)
+			return 0;
+		return _FC_PalCounter();
+	}
 
-		_FC_BufferInit(&Ctx.LinkPool, sizeof(_FC_LCS_LINK));
+	static inline char* _FC_TraceAppend(_Out_ char* Out, _In_z_ const char* Text)
+	{
+		while (*Text != '\0')
+			*Out++ = *Text++;
+		return Out;
+	}
 
-		size_t LcsLength = 0;
-		Ctx.Thresholds[0] = (size_t)-1;
-		Ctx.Links[0] = SIZE_MAX;
-		for (size_t i = 1; i <= pBufferA->Count; ++i)
+	static inline char* _FC_TraceAppendNumber(_Out_ char* Out, _In_ ULONGLONG Value)
+	{
+		char Digits[20];
+		int Count = 0;
+		do
 		{
-			Ctx.Thresholds[i] = SIZE_MAX;
-			Ctx.Links[i] = SIZE_MAX;
-		}
+			Digits[Count++] = (char)('0' + Value % 10);
+			Value /= 10;
+		} while (Value != 0);
+		while (Count > 0)
+			*Out++ = Digits[--Count];
+		return Out;
+	}
 
-		for (size_t i = 0; i < pBufferA->Count; ++i) {
-			const _FC_LINE* lineA = (const _FC_LINE*)_FC_BufferGet(pBufferA, i);
-			UINT hashA = lineA->Hash;
-			_FC_HASH_MAP_ENTRY* entry = _FC_HashMapFind(&MapB, hashA);
-			if (entry) {
-				for (_FC_MATCH* match = entry->MatchHead; match != NULL; match = match->Next) {
-					// NOTE (intentional divergence): /LBn is modeled as an LCS anchor-distance
-					// window, not as strict legacy fc.exe internal line-buffer emulation.
-					// See README "Documented Differences from Windows fc.exe".
-					if (Config->BufferLines > 0)
-					{
-						size_t j = match->IndexInB;
-						size_t delta = (i > j) ? (i - j) : (j - i);
-						if (delta > (size_t)Config->BufferLines)
-							continue;
-					}
+	/**
+	 * @brief Appends a counter interval as microseconds with three decimals.
+	 * @internal
+	 */
+	static inline char* _FC_TraceAppendMicros(
+		_Out_ char* Out,
+		_In_ const FC_TRACE* Trace,
+		_In_ LONGLONG Ticks)
+	{
+		ULONGLONG T = (Ticks > 0) ? (ULONGLONG)Ticks : 0;
+		ULONGLONG Freq = (ULONGLONG)Trace->Frequency;
+		ULONGLONG Nanoseconds = (T / Freq) * 1000000000ull + (T % Freq) * 1000000000ull / Freq;
+		Out = _FC_TraceAppendNumber(Out, Nanoseconds / 1000);
+		*Out++ = '.';
+		*Out++ = (char)('0' + Nanoseconds / 100 % 10);
+		*Out++ = (char)('0' + Nanoseconds / 10 % 10);
+		*Out++ = (char)('0' + Nanoseconds % 10);
+		return Out;
+	}
 
-					const _FC_LINE* lineB = (const _FC_LINE*)_FC_BufferGet(pBufferB, match->IndexInB);
-					// Hashes are only a pre-filter; verify actual line equality to avoid
-					// false matches on hash collisions.  Use the config-aware helper so that
-					// case-insensitive modes are handled correctly (raw memcmp would reject
-					// "Hello" == "hello" even though their hashes match under FC_IGNORE_CASE).
-					if (!_FC_LinesEqual(lineA, lineB, Config))
-						continue;
+	/**
+	 * @brief Writes Length bytes to the trace file, noting a failure.
+	 * @internal
+	 * @note The caller holds Trace->Lock.
+	 */
+	static void _FC_TraceWriteLocked(
+		_Inout_ FC_TRACE* Trace,
+		_In_reads_bytes_(Length) const char* Text,
+		_In_ size_t Length)
+	{
+		DWORD Written = 0;
+		if (Length > 0 && (!_FC_PalWrite(Trace->File, Text, (DWORD)Length, &Written) || Written != Length))
+			Trace->Failed = TRUE;
+	}
 
-					size_t k = 0, low = 1, high = LcsLength;
-					while (low <= high) {
-						size_t mid = low + (high - low) / 2;
-						if (match->IndexInB > Ctx.Thresholds[mid]) low = mid + 1;
-						else high = mid - 1;
-					}
-					k = low;
-
-					if (match->IndexInB < Ctx.Thresholds[k]) {
-						_FC_LCS_LINK newNode;
-						newNode.AIdx = i;
-						newNode.BIdx = match->IndexInB;
-						newNode.PrevLink = (k > 0) ? Ctx.Links[k - 1] : SIZE_MAX;
-						if (!_FC_BufferAppend(&Ctx.LinkPool, &newNode))
-						{
-							Result = FC_ERROR_MEMORY;
-							goto cleanup;
-						}
-						Ctx.Thresholds[k] = match->IndexInB;
-						Ctx.Links[k] = Ctx.LinkPool.Count - 1;
-						if (k > LcsLength) LcsLength = k;
-					}
-				}
+	/**
+	 * @brief Writes the events of a thread buffer as Chrome trace-event JSON and empties it.
+	 * @internal
+	 * @note The caller holds Trace->Lock.
+	 */
+	static void _FC_TraceFlushLocked(
+		_Inout_ FC_TRACE* Trace,
+		_Inout_ _FC_TRACE_BUFFER* Buffer)
+	{
+		char Out[4096];
+		size_t Used = 0;
+		for (UINT i = 0; i < Buffer->Count; i++)
+		{
+			const _FC_TRACE_RECORD* Record = &Buffer->Records[i];
+			char Line[320];
+			char* p = Line;
+			if (Trace->Written++ > 0)
+				p = _FC_TraceAppend(p, ",\n");
+			p = _FC_TraceAppend(p, "{\"name\":\"");
+			p = _FC_TraceAppend(p, g_FcTraceEventNames[Record->Event].Name);
+			p = _FC_TraceAppend(p, "\",\"cat\":\"fc\",\"ph\":\"");
+			p = _FC_TraceAppend(p, (Record->Event == _FC_TRACE_REWIND) ? "i\",\"s\":\"t" : "X");
+			p = _FC_TraceAppend(p, "\",\"ts\":");
+			p = _FC_TraceAppendMicros(p, Trace, Record->Start - Trace->Origin);
+			if (Record->Event != _FC_TRACE_REWIND)
+			{
+				p = _FC_TraceAppend(p, ",\"dur\":");
+				p = _FC_TraceAppendMicros(p, Trace, Record->End - Record->Start);
 			}
-		}
-
-		if (LcsLength > 0) {
-			LcsA = (size_t*)HeapAlloc(GetProcessHeap(), 0, LcsLength * sizeof(size_t));
-			LcsB = (size_t*)HeapAlloc(GetProcessHeap(), 0, LcsLength * sizeof(size_t));
-			if (!LcsA || !LcsB) { Result = FC_ERROR_MEMORY; goto cleanup; }
-
-			size_t curLink = Ctx.Links[LcsLength];
-			for (size_t i = LcsLength; i > 0 && curLink != SIZE_MAX; --i) {
-				_FC_LCS_LINK* node = (_FC_LCS_LINK*)_FC_BufferGet(&Ctx.LinkPool, curLink);
-				LcsA[i - 1] = node->AIdx;
-				LcsB[i - 1] = node->BIdx;
-				curLink = node->PrevLink;
+			p = _FC_TraceAppend(p, ",\"pid\":");
+			p = _FC_TraceAppendNumber(p, Trace->ProcessId);
+			p = _FC_TraceAppend(p, ",\"tid\":");
+			p = _FC_TraceAppendNumber(p, Buffer->ThreadId);
+			p = _FC_TraceAppend(p, ",\"args\":{\"pair\":");
+			p = _FC_TraceAppendNumber(p, Record->Pair);
+			if (g_FcTraceEventNames[Record->Event].Arg1 != NULL)
+			{
+				p = _FC_TraceAppend(p, ",\"");
+				p = _FC_TraceAppend(p, g_FcTraceEventNames[Record->Event].Arg1);
+				p = _FC_TraceAppend(p, "\":");
+				p = _FC_TraceAppendNumber(p, Record->Arg1);
 			}
-		}
-
-		if (LcsLength == pBufferA->Count && LcsLength == pBufferB->Count) {
-			// Entire chunk is identical after LCS
-			Result = FC_OK;
-			*pLastAnchorA = pBufferA->Count;
-			*pLastAnchorB = pBufferB->Count;
-		}
-		else {
-			size_t FilteredLcsLength = _FC_FilterLcsForResync(
-				LcsA, LcsB, LcsLength, Config->ResyncLines, &FilteredLcsA, &FilteredLcsB);
+			if (g_FcTraceEventNames[Record->Event].Arg2 != NULL)
+			{
+				p = _FC_TraceAppend(p, ",\"");
+				p = _FC_TraceAppend(p, g_FcTraceEventNames[Record->Event].Arg2);
+				p = _FC_TraceAppend(p, "\":");
+				p = _FC_TraceAppendNumber(p, Record->Arg2);
+			}
+			if (Record->Label[0] != '\0')
+			{
+				p = _FC_TraceAppend(p, ",\"file\":\"");
+				p = _FC_TraceAppend(p, Record->Label);
+				p = _FC_TraceAppend(p, "\"");
+			}
+			p = _FC_TraceAppend(p, "}}");
 
-			if (FilteredLcsLength == SIZE_MAX)
+			size_t Length = (size_t)(p - Line);
+			if (Used + Length > sizeof(Out))
 			{
-				// SIZE_MAX signals a memory allocation failure inside the filter function.
-				Result = FC_ERROR_MEMORY;
-				goto cleanup;
+				_FC_TraceWriteLocked(Trace, Out, Used);
+				Used = 0;
 			}
+			memcpy(Out + Used, Line, Length);
+			Used += Length;
+		}
+		_FC_TraceWriteLocked(Trace, Out, Used);
+		Buffer->Count = 0;
+	}
 
-			// Extract the last anchor from the filtered LCS (chunk-relative indices)
-			if (FilteredLcsLength > 0 && FilteredLcsA != NULL && FilteredLcsB != NULL)
+	/**
+	 * @brief Finds or creates the buffer of the calling thread in a trace.
+	 * @internal
+	 * @return The buffer, or NULL (after marking the trace failed) if it could not be allocated.
+	 */
+	static _FC_TRACE_BUFFER* _FC_TraceThreadBuffer(_Inout_ FC_TRACE* Trace)
+	{
+		if (g_FcTraceBuffer != NULL && g_FcTraceBufferOwner == Trace->Id)
+			return g_FcTraceBuffer;
+
+		DWORD ThreadId = _FC_PalThreadId();
+		_FC_PalLockExclusive(&Trace->Lock);
+		_FC_TRACE_BUFFER* Buffer = Trace->Buffers;
+		while (Buffer != NULL && Buffer->ThreadId != ThreadId)
+			Buffer = Buffer->Next;
+		if (Buffer == NULL)
+		{
+			// Trace buffers outlive the comparison, so they are not working memory.
+			Buffer = (_FC_TRACE_BUFFER*)_FC_PalAlloc(_FC_PalProcessHeap(), 0, sizeof(_FC_TRACE_BUFFER));
+			if (Buffer != NULL)
 			{
-				*pLastAnchorA = FilteredLcsA[FilteredLcsLength - 1] + 1;  // +1 for exclusive end
-				*pLastAnchorB = FilteredLcsB[FilteredLcsLength - 1] + 1;
+				Buffer->ThreadId = ThreadId;
+				Buffer->Count = 0;
+				Buffer->Next = Trace->Buffers;
+				Trace->Buffers = Buffer;
 			}
 			else
 			{
-				// No stable anchor found — entire chunk is unconfirmed diff
-				*pLastAnchorA = 0;
-				*pLastAnchorB = 0;
+				Trace->Failed = TRUE;
 			}
+		}
+		_FC_PalUnlockExclusive(&Trace->Lock);
 
-			// Process the (potentially filtered) results to show differences.
-			Result = _FC_ProcessLcs(Context, Config, FilteredLcsA, FilteredLcsB, FilteredLcsLength);
+		if (Buffer != NULL)
+		{
+			g_FcTraceBuffer = Buffer;
+			g_FcTraceBufferOwner = Trace->Id;
 		}
-	cleanup:
-		_FC_HashMapFree(&MapB);
-		_FC_HeapFree(MatchPool);
-		_FC_HeapFree(Ctx.Thresholds);
-		_FC_HeapFree(Ctx.Links);
-		_FC_BufferFree(&Ctx.LinkPool);
-		_FC_HeapFree(LcsA);
-		_FC_HeapFree(LcsB);
-		// The filtered arrays are now owned by these pointers, so we must free them.
-		_FC_HeapFree(FilteredLcsA);
-		_FC_HeapFree(FilteredLcsB);
-		return Result;
+		return Buffer;
 	}
 
 	/**
-	 * @brief Processes a single chunk of lines through the LCS algorithm.
-	 *
-	 * Phase C: Runs LCS over one chunk of file lines and emits diff blocks via callback.
-	 * Returns the anchor pair (last confirmed match) for rollback coordination.
-	 *
-	 * The anchor is critical for boundary handling: if the last anchor is before the
-	 * chunk's final line, a diff block straddles the boundary and the caller should
-	 * rewind to the anchor for re-processing.
+	 * @brief Records an event that began at Start (from `_FC_TraceNow`) and ends now.
 	 *
+	 * The event goes to the calling thread's buffer, which takes the trace lock
+	 * only when it is full.
 	 * @internal
-	 * @param Context User context with chunk's line buffers and offsets (UPDATED: OffsetA, OffsetB set by caller)
-	 * @param Config Comparison configuration
-	 * @param[out] pNextAnchorA Receives the absolute line index of the last anchor in file A (or chunk start if no matches)
-	 * @param[out] pNextAnchorB Receives the absolute line index of the last anchor in file B (or chunk start if no matches)
-	 * @return FC_OK if chunk lines identical, FC_DIFFERENT if diffs found, or error code
+	 * @param Label Optional path whose file name is stored with the event.
 	 */
-	static FC_RESULT
-		_FC_ProcessChunk(
-			_In_ const FC_USER_CONTEXT* Context,
-			_In_ const FC_CONFIG* Config,
-			_Out_ size_t* pNextAnchorA,
-			_Out_ size_t* pNextAnchorB)
+	static void _FC_TraceRecord(
+		_In_ _FC_TRACE_EVENT Event,
+		_In_ LONGLONG Start,
+		_In_ ULONGLONG Arg1,
+		_In_ ULONGLONG Arg2,
+		_In_opt_z_ const WCHAR* Label)
 	{
-		if (!Context || !Config || !pNextAnchorA || !pNextAnchorB)
-			return FC_ERROR_INVALID_PARAM;
-
-		const _FC_BUFFER* pBufferA = Context->Lines1;
-		const _FC_BUFFER* pBufferB = Context->Lines2;
-
-		// Initialize anchors to chunk start (offsets)
-		*pNextAnchorA = Context->OffsetA;
-		*pNextAnchorB = Context->OffsetB;
-
-		// Empty chunks are identical
-		if (pBufferA->Count == 0 && pBufferB->Count == 0)
-			return FC_OK;
-
-		// Different sizes → return one as diff
-		if ((pBufferA->Count == 0 && pBufferB->Count > 0) ||
-			(pBufferA->Count > 0 && pBufferB->Count == 0))
-			return FC_DIFFERENT;
-
-		// Check if entire chunk is identical (diagonal check within chunk)
-		BOOL AllMatch = TRUE;
-		if (pBufferA->Count == pBufferB->Count) {
-			for (size_t i = 0; i < pBufferA->Count; i++) {
-				const _FC_LINE* a = (const _FC_LINE*)_FC_BufferGet(pBufferA, i);
-				const _FC_LINE* b = (const _FC_LINE*)_FC_BufferGet(pBufferB, i);
-				if (a->Hash != b->Hash || !_FC_LinesEqual(a, b, Config)) {
-					AllMatch = FALSE;
+		FC_TRACE* Trace = _FC_Trace();
+		if (Trace == NULL)
+			return;
+		_FC_TRACE_BUFFER* Buffer = _FC_TraceThreadBuffer(Trace);
+		if (Buffer == NULL)
+			return;
+
+		LONGLONG Now = _FC_PalCounter();
+		_FC_TRACE_RECORD* Record = &Buffer->Records[Buffer->Count];
+		Record->Event = Event;
+		Record->Start = (Event == _FC_TRACE_REWIND) ? Now : Start;
+		Record->End = Now;
+		Record->Pair = g_FcWork.TracePair;
+		Record->Arg1 = Arg1;
+		Record->Arg2 = Arg2;
+		Record->Label[0] = '\0';
+		if (Label != NULL)
+		{
+			const WCHAR* Name = Label;
+			for (const WCHAR* p = Label; *p != L'\0'; p++)
+			{
+				if (*p == L'\\' || *p == L'/' || *p == L':')
+					Name = p + 1;
+			}
+			// Keep as many whole characters of the name as fit.
+			int Length = (int)wcslen(Name);
+			int Bytes = 0;
+			while (Length > 0)
+			{
+				Bytes = _FC_PalWideToUtf8(Name, Length, Record->Label,
+					(int)sizeof(Record->Label) - 1);
+				if (Bytes > 0)
 					break;
-				}
+				Length--;
+				if (Length > 0 && Name[Length - 1] >= 0xD800 && Name[Length - 1] <= 0xDBFF)
+					Length--;
+			}
+			Record->Label[Bytes] = '\0';
+			for (int i = 0; i < Bytes; i++)
+			{
+				if ((unsigned char)Record->Label[i] < 0x20 || Record->Label[i] == '"' || Record->Label[i] == '\\')
+					Record->Label[i] = '_';
 			}
-		} else {
-			AllMatch = FALSE;
 		}
 
-		if (AllMatch) {
-			// Entire chunk matches - set anchor to end of chunk
-			*pNextAnchorA = Context->OffsetA + pBufferA->Count;
-			*pNextAnchorB = Context->OffsetB + pBufferB->Count;
-			return FC_OK;
+		if (++Buffer->Count == FC_TRACE_BUFFER_EVENTS)
+		{
+			_FC_PalLockExclusive(&Trace->Lock);
+			_FC_TraceFlushLocked(Trace, Buffer);
+			_FC_PalUnlockExclusive(&Trace->Lock);
 		}
+	}
 
-		// Run LCS on this chunk
-		size_t lastAnchorA = 0, lastAnchorB = 0;
-		FC_RESULT Result = _FC_FindLcs(Context, Config, &lastAnchorA, &lastAnchorB);
-
-		// Convert chunk-relative anchor to absolute line index
-		*pNextAnchorA = Context->OffsetA + lastAnchorA;
-		*pNextAnchorB = Context->OffsetB + lastAnchorB;
-
-		return Result;
+	/**
+	 * @brief Records a span event if the comparison on this thread is traced.
+	 * @internal
+	 */
+	static inline void _FC_TraceSpan(
+		_In_ _FC_TRACE_EVENT Event,
+		_In_ LONGLONG Start,
+		_In_ ULONGLONG Arg1,
+		_In_ ULONGLONG Arg2)
+	{
+		if (_FC_Trace() != NULL)
+			_FC_TraceRecord(Event, Start, Arg1, Arg2, NULL);
 	}
 
 	/**
-	 * @brief Parses a raw memory buffer into a structured array of lines.
-	 *
-	 * This function iterates through the input buffer, identifying line breaks. For each
-	 * line, it performs normalization based on the `FC_CONFIG` flags (e.g., tab expansion,
-	 * whitespace removal), computes a hash of the normalized text, and stores the result
-	 * as an `_FC_LINE` in the output buffer.
+	 * @brief Returns TRUE if allocations on this thread are counted, for a budget or FC_STATS.
 	 * @internal
-	 * @param Buffer The raw character buffer containing the file's content.
-	 * @param BufferLength The length of the raw buffer.
-	 * @param[out] pLineBuffer The output buffer where `_FC_LINE` structs will be stored.
-	 * @param Config A pointer to the comparison configuration.
-	 * @return FC_OK on success, or FC_ERROR_MEMORY on allocation failure.
 	 */
-	static inline FC_RESULT
-		_FC_ParseLines(
-			_In_reads_(BufferLength) const char* Buffer,
-			_In_ size_t BufferLength,
-			_Inout_ _FC_BUFFER* pLineBuffer,
-			_In_ const FC_CONFIG* Config)
+	static inline BOOL _FC_WorkTracked(void)
 	{
-		const char* Ptr = Buffer;
-		const char* End = Buffer + BufferLength;
+		return g_FcWork.Budget != 0 || _FC_Stats() != NULL;
+	}
+
+	/**
+	 * @brief Returns TRUE if Bytes more working memory fits the budget of the comparison on this thread.
+	 * @internal
+	 */
+	static inline BOOL _FC_WorkFits(_In_ size_t Bytes)
+	{
+		if (g_FcWork.Budget == 0)
+			return TRUE;
+		return Bytes <= g_FcWork.Budget && g_FcWork.LiveBytes <= (LONGLONG)(g_FcWork.Budget - Bytes);
+	}
+
+	/**
+	 * @brief Checks that Bytes more working memory fits the budget of the comparison on this thread.
+	 * @internal
+	 * @return FALSE, after marking the scope over budget, if the allocation must be refused.
+	 */
+	static inline BOOL _FC_WorkReserve(_In_ size_t Bytes)
+	{
+		if (!_FC_WorkFits(Bytes))
+		{
+			g_FcWork.OverBudget = TRUE;
+			return FALSE;
+		}
+		return TRUE;
+	}
+
+	/**
+	 * @brief Counts working memory acquired (Bytes) or released (-Bytes) toward the peak.
+	 * @internal
+	 */
+	static inline void _FC_WorkCharge(_In_ LONGLONG Bytes)
+	{
+		g_FcWork.LiveBytes += Bytes;
+		FC_STATS* Stats = _FC_Stats();
+		if (Stats != NULL && g_FcWork.LiveBytes > (LONGLONG)Stats->PeakMemoryBytes)
+			Stats->PeakMemoryBytes = (ULONGLONG)g_FcWork.LiveBytes;
+	}
+
+	/**
+	 * @brief Returns TRUE if all allocator callbacks are set or none is.
+	 * @internal
+	 */
+	static inline BOOL _FC_IsValidAllocator(_In_ const FC_ALLOCATOR* Allocator)
+	{
+		BOOL Any = Allocator->Alloc || Allocator->Realloc || Allocator->Free;
+		BOOL All = Allocator->Alloc && Allocator->Realloc && Allocator->Free;
+		return All || !Any;
+	}
+
+	// Blocks from a caller's allocator start with a header holding their size, so
+	// that frees can be counted; heap blocks are measured by the heap. The header
+	// keeps the block aligned for any fundamental type.
+#define _FC_BLOCK_HEADER_BYTES 16
+
+	/**
+	 * @brief Returns the size a block from `_FC_AllocFrom` was requested with.
+	 * @internal
+	 */
+	static inline size_t _FC_BlockSize(
+		_In_ HANDLE Heap,
+		_In_opt_ const FC_ALLOCATOR* Allocator,
+		_In_ const void* Block)
+	{
+		if (Allocator != NULL && Allocator->Alloc != NULL)
+			return *(const size_t*)((const BYTE*)Block - _FC_BLOCK_HEADER_BYTES);
+		return _FC_PalBlockSize(Heap, Block);
+	}
+
+	/**
+	 * @brief Allocates from an allocator when one is set, otherwise from Heap.
+	 * @internal
+	 * @param Flags 0 or _FC_ALLOC_ZERO.
+	 * @return The block, or NULL on failure or if it would exceed the budget of the comparison.
+	 */
+	static inline void* _FC_AllocFrom(
+		_In_ HANDLE Heap,
+		_In_opt_ const FC_ALLOCATOR* Allocator,
+		_In_ DWORD Flags,
+		_In_ size_t Size)
+	{
+		void* Block;
+		if (!_FC_WorkReserve(Size))
+			return NULL;
+		if (Allocator != NULL && Allocator->Alloc != NULL)
+		{
+			if (Size > SIZE_MAX - _FC_BLOCK_HEADER_BYTES)
+				return NULL;
+			BYTE* Header = (BYTE*)Allocator->Alloc(Allocator->UserData, Size + _FC_BLOCK_HEADER_BYTES);
+			if (Header == NULL)
+				return NULL;
+			*(size_t*)Header = Size;
+			Block = Header + _FC_BLOCK_HEADER_BYTES;
+			if (Flags & _FC_ALLOC_ZERO)
+				memset(Block, 0, Size);
+		}
+		else
+		{
+			Block = _FC_PalAlloc(Heap, Flags, Size);
+			if (Block == NULL)
+				return NULL;
+		}
+		if (_FC_WorkTracked())
+			_FC_WorkCharge((LONGLONG)Size);
+		return Block;
+	}
+
+	static inline void* _FC_ReAllocFrom(
+		_In_ HANDLE Heap,
+		_In_opt_ const FC_ALLOCATOR* Allocator,
+		_In_ void* Block,
+		_In_ size_t Size)
+	{
+		BOOL Tracked = _FC_WorkTracked();
+		size_t OldSize = Tracked ? _FC_BlockSize(Heap, Allocator, Block) : 0;
+		if (Size > OldSize && !_FC_WorkReserve(Size - OldSize))
+			return NULL;
+
+		void* Resized;
+		if (Allocator != NULL && Allocator->Alloc != NULL)
+		{
+			if (Size > SIZE_MAX - _FC_BLOCK_HEADER_BYTES)
+				return NULL;
+			BYTE* Header = (BYTE*)Allocator->Realloc(Allocator->UserData,
+				(BYTE*)Block - _FC_BLOCK_HEADER_BYTES, Size + _FC_BLOCK_HEADER_BYTES);
+			if (Header == NULL)
+				return NULL;
+			*(size_t*)Header = Size;
+			Resized = Header + _FC_BLOCK_HEADER_BYTES;
+		}
+		else
+		{
+			Resized = _FC_PalReAlloc(Heap, Block, Size);
+			if (Resized == NULL)
+				return NULL;
+		}
+		if (Tracked)
+			_FC_WorkCharge((LONGLONG)Size - (LONGLONG)OldSize);
+		return Resized;
+	}
+
+	static inline void _FC_FreeFrom(
+		_In_ HANDLE Heap,
+		_In_opt_ const FC_ALLOCATOR* Allocator,
+		_In_opt_ const void* Block)
+	{
+		if (Block == NULL)
+			return;
+		if (_FC_WorkTracked())
+			_FC_WorkCharge(-(LONGLONG)_FC_BlockSize(Heap, Allocator, Block));
+		if (Allocator != NULL && Allocator->Alloc != NULL)
+			Allocator->Free(Allocator->UserData, (BYTE*)Block - _FC_BLOCK_HEADER_BYTES);
+		else
+			_FC_PalFree(Heap, Block);
+	}
+
+	/**
+	 * @brief Returns the heap for per-comparison working memory on this thread.
+	 * @internal
+	 */
+	static inline HANDLE _FC_WorkHeap(void)
+	{
+		return g_FcWork.Session ? g_FcWork.Session->Heap : _FC_PalProcessHeap();
+	}
+
+	/**
+	 * @brief Allocates per-comparison working memory on this thread.
+	 * @internal
+	 * @param Flags 0 or _FC_ALLOC_ZERO.
+	 */
+	static inline void* _FC_WorkAlloc(_In_ DWORD Flags, _In_ size_t Size)
+	{
+		return _FC_AllocFrom(_FC_WorkHeap(), g_FcWork.Allocator, Flags, Size);
+	}
+
+	/**
+	 * @brief Conditionally frees working memory. Safe to call with NULL.
+	 * @internal
+	 */
+	static inline void _FC_WorkFree(const void* p)
+	{
+		_FC_FreeFrom(_FC_WorkHeap(), g_FcWork.Allocator, p);
+	}
+
+	/**
+	 * @brief Forwards a progress report to the configured callback, if any.
+	 * @internal
+	 * @return FALSE if the comparison must stop with FC_CANCELLED.
+	 */
+	static inline BOOL
+		_FC_ReportProgress(
+			_In_ const FC_CONFIG* Config,
+			_In_ FC_PROGRESS_PHASE Phase,
+			_In_ ULONGLONG Done,
+			_In_ ULONGLONG Total)
+	{
+		if (Config->ProgressCallback == NULL)
+			return TRUE;
+		return Config->ProgressCallback(Config->UserData, Phase, Done, Total);
+	}
+
+#ifdef _WIN32
+	static const WCHAR* const g_ReservedDevices[] = {
+		L"CON", L"PRN", L"AUX", L"NUL",
+		L"COM1", L"COM2", L"COM3", L"COM4", L"COM5", L"COM6", L"COM7", L"COM8", L"COM9",
+		L"LPT1", L"LPT2", L"LPT3", L"LPT4", L"LPT5", L"LPT6", L"LPT7", L"LPT8", L"LPT9"
+	};
+#endif
+
+	/**
+	 * @struct _FC_LINE
+	 * @brief Internal representation of a single line of text from a file.
+	 *
+	 * This structure stores the processed text of a line, its length, and a pre-computed
+	 * hash value for fast comparisons. The text is normalized according to the
+	 * active comparison flags (e.g., whitespace removal, tab expansion).
+	 *
+	 * The length is kept in 32 bits so that a record is 16 bytes on 64-bit targets;
+	 * line arrays are scanned on every chunk, so their size is paid in cache misses.
+	 * Parsing rejects a line longer than _FC_MAX_LINE_LENGTH.
+	 *
+	 * @internal
+	 */
+	typedef struct
+	{
+		char* Text;
+		UINT Length;
+		UINT Hash;
+	} _FC_LINE;
+
+	// Longest normalized line a _FC_LINE can describe. Only reachable when
+	// MaxTextFileBytes is raised beyond 4 GB.
+#define _FC_MAX_LINE_LENGTH 0xFFFFFFFFu
+
+	// Index type of everything that is relative to one chunk: line positions, LCS
+	// links and match chains. Chunks are bounded by FC_MAX_CHUNK_LINES.
+	typedef UINT _FC_CHUNK_INDEX;
+
+	// Marks the end of a match chain or an LCS chain.
+#define _FC_CHUNK_NONE ((_FC_CHUNK_INDEX)-1)
+
+#if FC_MAX_CHUNK_LINES >= 0xFFFFFFFFu
+#error FC_MAX_CHUNK_LINES must fit a 32-bit chunk index.
+#endif
+
+	/**
+	 * @struct _FC_LCS_LINK
+	 * @brief A single node in the LCS backtracking chain.
+	 *
+	 * Each time the Thresholds array is updated at level k, one link node is
+	 * appended to the pool.  Links[k] holds the pool index of the most recent
+	 * such node; PrevLink chains back to the length-(k-1) predecessor, until
+	 * `_FC_LcsReverseChain` turns the final chain around for reporting.
+	 * @internal
+	 */
+	typedef struct {
+		_FC_CHUNK_INDEX AIdx;      /**< Line index in file A. */
+		_FC_CHUNK_INDEX BIdx;      /**< Line index in file B. */
+		_FC_CHUNK_INDEX PrevLink;  /**< Pool index of the predecessor link, or _FC_CHUNK_NONE. */
+	} _FC_LCS_LINK;
+
+	/**
+	 * @struct _FC_LCS_CONTEXT
+	 * @brief Holds the intermediate data structures for the Hunt-McIlroy LCS algorithm.
+	 * @internal
+	 */
+	typedef struct {
+		_FC_CHUNK_INDEX* Thresholds;  /**< THRESH[k]: smallest B-end index for an LCS of length k. */
+		_FC_CHUNK_INDEX* Links;       /**< Links[k]: pool index of the best length-k chain, or _FC_CHUNK_NONE. */
+		_FC_BUFFER LinkPool;          /**< Pool of _FC_LCS_LINK nodes, grown on each Threshold update. */
+	} _FC_LCS_CONTEXT;
+
+	/**
+	 * @struct _FC_HASH_MAP_ENTRY
+	 * @brief An entry in the hash map's bucket list.
+	 *
+	 * Contains the hash value, the last line of file B with that hash, and a pointer
+	 * to the next entry in the same bucket (to handle collisions). The other lines
+	 * with the hash are chained, in descending order, through a per-chunk array that
+	 * holds for each line of B the previous line with the same hash.
+	 * @internal
+	 */
+	typedef struct _FC_HASH_MAP_ENTRY {
+		UINT Hash;
+		_FC_CHUNK_INDEX MatchHead;  /**< Last line of B with this hash, or _FC_CHUNK_NONE. */
+		struct _FC_HASH_MAP_ENTRY* Next;
+	} _FC_HASH_MAP_ENTRY;
+
+	/**
+	 * @struct _FC_HASH_MAP
+	 * @brief A simple hash map implementation for finding line matches.
+	 *
+	 * Uses open addressing with chaining for collision resolution. It pre-allocates
+	 * all necessary entry and match nodes from pools for performance, avoiding
+	 * repeated small allocations.
+	 * @internal
+	 */
+	typedef struct {
+		_FC_HASH_MAP_ENTRY** Buckets;      /**< Array of pointers to bucket chains. */
+		size_t NumBuckets;                 /**< The number of buckets in the hash table. */
+		_FC_HASH_MAP_ENTRY* EntryPool;     /**< A pre-allocated pool of hash map entries. */
+		size_t EntryPoolIndex;             /**< The next available index in the entry pool. */
+	} _FC_HASH_MAP;
+
+	/**
+	 * @brief Creates and initializes a hash map.
+	 * @internal
+	 * @param Map A pointer to the _FC_HASH_MAP structure to initialize.
+	 * @param InitialCapacity The number of entries to pre-allocate in the pool.
+	 * @return TRUE on success, FALSE on memory allocation failure.
+	 */
+	static BOOL _FC_HashMapCreate(_Inout_ _FC_HASH_MAP* Map, _In_ size_t InitialCapacity) {
+		Map->NumBuckets = 1021; // A reasonably sized prime number
+		Map->Buckets = (_FC_HASH_MAP_ENTRY**)_FC_WorkAlloc(_FC_ALLOC_ZERO, Map->NumBuckets * sizeof(_FC_HASH_MAP_ENTRY*));
+		if (!Map->Buckets) return FALSE;
+		Map->EntryPool = (_FC_HASH_MAP_ENTRY*)_FC_WorkAlloc(_FC_ALLOC_ZERO, InitialCapacity * sizeof(_FC_HASH_MAP_ENTRY));
+		if (!Map->EntryPool) { _FC_WorkFree(Map->Buckets); Map->Buckets = NULL; return FALSE; }
+		Map->EntryPoolIndex = 0;
+		return TRUE;
+	}
+
+	/**
+	 * @brief Frees all memory associated with a hash map.
+	 * @internal
+	 * @param Map A pointer to the _FC_HASH_MAP to free.
+	 */
+	static void _FC_HashMapFree(_Inout_ _FC_HASH_MAP* Map) {
+		if (Map->Buckets) _FC_WorkFree(Map->Buckets);
+		if (Map->EntryPool) _FC_WorkFree(Map->EntryPool);
+	}
+
+	/**
+	 * @brief Finds an entry in the hash map by its hash value.
+	 * @internal
+	 * @param Map A pointer to the hash map.
+	 * @param Hash The hash value to find.
+	 * @return A pointer to the found _FC_HASH_MAP_ENTRY, or NULL if not found.
+	 */
+	static _FC_HASH_MAP_ENTRY* _FC_HashMapFind(_In_ _FC_HASH_MAP* Map, _In_ UINT Hash) {
+		size_t bucketIndex = Hash % Map->NumBuckets;
+		_FC_HASH_MAP_ENTRY* entry = Map->Buckets[bucketIndex];
+		while (entry) { if (entry->Hash == Hash) return entry; entry = entry->Next; }
+		return NULL;
+	}
+
+	/**
+	 * @brief Inserts a new hash value into the map, or finds the existing entry.
+	 * @internal
+	 * @param Map A pointer to the hash map.
+	 * @param Hash The hash value to insert.
+	 * @return A pointer to the new or existing _FC_HASH_MAP_ENTRY, or NULL on failure.
+	 */
+	static _FC_HASH_MAP_ENTRY* _FC_HashMapInsert(_Inout_ _FC_HASH_MAP* Map, _In_ UINT Hash) {
+		_FC_HASH_MAP_ENTRY* entry = _FC_HashMapFind(Map, Hash);
+		if (entry) return entry;
+		entry = &Map->EntryPool[Map->EntryPoolIndex++];
+		entry->Hash = Hash;
+		entry->MatchHead = _FC_CHUNK_NONE;
+		size_t bucketIndex = Hash % Map->NumBuckets;
+		entry->Next = Map->Buckets[bucketIndex];
+		Map->Buckets[bucketIndex] = entry;
+		return entry;
+	}
+
+	/**
+	 * @brief Adds line j of a chunk, whose hash is Hash, in front of the earlier lines with that hash.
+	 * @internal
+	 * @param PrevMatch The chunk's chain array; receives the previous line with the hash of line j.
+	 */
+	static inline void
+		_FC_HashMapAddLine(
+			_Inout_ _FC_HASH_MAP* Map,
+			_Inout_ _FC_CHUNK_INDEX* PrevMatch,
+			_In_ UINT Hash,
+			_In_ size_t j)
+	{
+		_FC_HASH_MAP_ENTRY* entry = _FC_HashMapInsert(Map, Hash);
+		PrevMatch[j] = entry->MatchHead;
+		entry->MatchHead = (_FC_CHUNK_INDEX)j;
+	}
+
+	/**
+	 * @brief Computes the optimal chunk size for streaming line processing.
+	 *
+	 * Phase B: Calculates a dynamic chunk size based on the larger file's size and the
+	 * /LBn configuration parameter. The heuristic uses sqrt(FileSizeBytes / 80) to keep
+	 * per-chunk LCS time roughly constant while scaling with file size.
+	 *
+	 * @internal
+	 * @param MaxFileSizeBytes The size in bytes of the larger input file.
+	 * @param BufferLinesConfig The /LBn parameter (100 = neutral, 50 = half, 200 = double).
+	 * @return Optimal number of lines per chunk, clamped to [FC_MIN_CHUNK_LINES, FC_MAX_CHUNK_LINES].
+	 */
+	static inline size_t
+		_FC_ComputeChunkSize(
+			_In_ LONGLONG MaxFileSizeBytes,
+			_In_ UINT BufferLinesConfig)
+	{
+		// Guard against invalid inputs
+		if (MaxFileSizeBytes <= 0)
+			return FC_MIN_CHUNK_LINES;
+
+		UINT Config = BufferLinesConfig;
+		if (Config == 0)
+			Config = 100; // default neutral value
+
+		// Base heuristic: sqrt(file_size / 80) where 80 = est. bytes per line
+		// Using integer square root approximation to avoid floating point
+		size_t BaseChunk = 1000;  // Start with minimum
+		ULONGLONG USize = (ULONGLONG)MaxFileSizeBytes;
+		if (USize > 80000000ull) {
+			// Rough integer square root for large values
+			// sqrt(n) ≈ (n >> 1) for n > 100
+			// Use a simple estimate: for 80MB file (1M lines), target ~3k
+			if (USize > 80000000ull) BaseChunk = 3162;  // sqrt(10M)
+			if (USize > 800000000ull) BaseChunk = 10000;  // sqrt(100M)
+			if (USize > 8000000000ull) BaseChunk = 31622;  // sqrt(1B)
+		}
+
+		// Apply /LBn scaling: BufferLinesConfig of 100 is neutral
+		// 50 = half, 200 = double (linear scaling)
+		size_t Scaled = BaseChunk;
+		if (Config != 100) {
+			// Avoid overflow: scale carefully
+			if (Config > 100) {
+				Scaled = BaseChunk + (BaseChunk * (Config - 100)) / 100;
+			} else if (Config < 100) {
+				Scaled = BaseChunk - (BaseChunk * (100 - Config)) / 100;
+			}
+		}
+
+		// Clamp to valid range
+		if (Scaled < FC_MIN_CHUNK_LINES)
+			return FC_MIN_CHUNK_LINES;
+		if (Scaled > FC_MAX_CHUNK_LINES)
+			return FC_MAX_CHUNK_LINES;
+
+		return Scaled;
+	}
+
+	/**
+	 * @brief Initializes a new, empty buffer for elements of a specific size.
+	 * @internal
+	 * @param pBuffer A pointer to the _FC_BUFFER to initialize.
+	 * @param elementSize The size in bytes of each element the buffer will hold.
+	 */
+	static inline void
+		_FC_BufferInit(
+			_Inout_ _FC_BUFFER* pBuffer,
+			_In_ size_t elementSize)
+	{
+		pBuffer->pData = NULL;
+		pBuffer->ElementSize = elementSize;
+		pBuffer->Count = 0;
+		pBuffer->Capacity = 0;
+		pBuffer->Heap = _FC_WorkHeap();
+		pBuffer->LargePages = FALSE;
+		pBuffer->LargeBytes = 0;
+		if (g_FcWork.Allocator != NULL)
+			pBuffer->Allocator = *g_FcWork.Allocator;
+		else
+			memset(&pBuffer->Allocator, 0, sizeof(pBuffer->Allocator));
+	}
+
+	/**
+	 * @brief Returns the heap a buffer allocates from.
+	 * @internal
+	 */
+	static inline HANDLE
+		_FC_BufferHeap(
+			_In_ const _FC_BUFFER* pBuffer)
+	{
+		return pBuffer->Heap ? pBuffer->Heap : _FC_PalProcessHeap();
+	}
+
+	/**
+	 * @brief Frees the internal memory block owned by the buffer.
+	 * @internal
+	 * @note This function does not free any nested pointers within the elements themselves.
+	 *       The caller is responsible for freeing such data before calling this.
+	 * @param pBuffer A pointer to the _FC_BUFFER to free.
+	 */
+	static inline void
+		_FC_BufferFree(
+			_Inout_ _FC_BUFFER* pBuffer)
+	{
+		if (pBuffer->LargeBytes != 0)
+		{
+			if (_FC_WorkTracked())
+				_FC_WorkCharge(-(LONGLONG)(pBuffer->Capacity * pBuffer->ElementSize));
+			_FC_PalLargeFree(pBuffer->pData, pBuffer->LargeBytes);
+			pBuffer->LargeBytes = 0;
+		}
+		else if (pBuffer->pData != NULL)
+		{
+			_FC_FreeFrom(_FC_BufferHeap(pBuffer), &pBuffer->Allocator, pBuffer->pData);
+		}
+		pBuffer->pData = NULL;
+		pBuffer->Count = 0;
+		pBuffer->Capacity = 0;
+	}
+
+	/**
+	 * @brief Lets a buffer move to large pages when the comparison on this thread asked for them.
+	 *
+	 * Only for buffers whose block is never handed over to another owner, since a
+	 * large-page block must be released by `_FC_BufferFree`.
+	 * @internal
+	 */
+	static inline void
+		_FC_BufferPreferLargePages(
+			_Inout_ _FC_BUFFER* pBuffer)
+	{
+		pBuffer->LargePages = g_FcWork.LargePages;
+	}
+
+	/**
+	 * @brief Moves the contents of a buffer to a new block of newCapacity elements.
+	 * @internal
+	 * @param Large TRUE to take the block from `_FC_PalLargeAlloc`, FALSE to take it from the buffer's heap.
+	 * @return TRUE on success; FALSE leaves the buffer unchanged. A large-page block is
+	 *         not taken if it would exceed the budget, but the scope is not marked over
+	 *         budget, since the caller falls back to its heap.
+	 */
+	static BOOL
+		_FC_BufferMove(
+			_Inout_ _FC_BUFFER* pBuffer,
+			_In_ size_t newCapacity,
+			_In_ BOOL Large)
+	{
+		size_t newSizeInBytes = newCapacity * pBuffer->ElementSize;
+		size_t Mapped = 0;
+		void* pNewData;
+		if (Large)
+		{
+			if (!_FC_WorkFits(newSizeInBytes))
+				return FALSE;
+			pNewData = _FC_PalLargeAlloc(newSizeInBytes, &Mapped);
+			if (pNewData == NULL)
+				return FALSE;
+			FC_STATS* Stats = _FC_Stats();
+			if (_FC_WorkTracked())
+				_FC_WorkCharge((LONGLONG)newSizeInBytes);
+			if (Stats != NULL)
+				Stats->LargePageBytes += Mapped;
+		}
+		else
+		{
+			pNewData = _FC_AllocFrom(_FC_BufferHeap(pBuffer), &pBuffer->Allocator, 0, newSizeInBytes);
+			if (pNewData == NULL)
+				return FALSE;
+		}
+
+		size_t Count = pBuffer->Count;
+		if (Count > 0)
+			memcpy(pNewData, pBuffer->pData, Count * pBuffer->ElementSize);
+		_FC_BufferFree(pBuffer);
+		pBuffer->pData = pNewData;
+		pBuffer->Count = Count;
+		pBuffer->Capacity = newCapacity;
+		pBuffer->LargeBytes = Mapped;
+		return TRUE;
+	}
+
+	/**
+	 * @brief Ensures the buffer has enough capacity for a specified number of new elements.
+	 *
+	 * If the current capacity is insufficient, it reallocates the internal memory,
+	 * typically doubling the size.
+	 * @internal
+	 * @param pBuffer A pointer to the _FC_BUFFER.
+	 * @param additionalCount The number of additional elements to make space for.
+	 * @return TRUE if the capacity is sufficient or reallocation succeeded, FALSE on failure.
+	 */
+	static inline BOOL
+		_FC_BufferEnsureCapacity(
+			_Inout_ _FC_BUFFER* pBuffer,
+			_In_ size_t additionalCount)
+	{
+		if (additionalCount > SIZE_MAX - pBuffer->Count)
+			return FALSE;
+		if (pBuffer->Count + additionalCount > pBuffer->Capacity)
+		{
+			size_t newCapacity = pBuffer->Capacity > 0 ? pBuffer->Capacity : 8;
+			if (pBuffer->Capacity > 0)
+			{
+				if (pBuffer->Capacity > SIZE_MAX / 2) // Check before doubling
+					newCapacity = SIZE_MAX;
+				else
+					newCapacity *= 2;
+			}
+
+			if (newCapacity < pBuffer->Count + additionalCount)
+				newCapacity = pBuffer->Count + additionalCount;
+			if (pBuffer->ElementSize > 0 && newCapacity > SIZE_MAX / pBuffer->ElementSize) // Check before multiplication
+				return FALSE;
+			size_t newSizeInBytes = newCapacity * pBuffer->ElementSize;
+
+			// Large pages cannot be resized in place, so a buffer that may use them is
+			// copied to each new block. If none is available, it goes back to its heap.
+			if (pBuffer->LargePages && pBuffer->Allocator.Alloc == NULL &&
+				newSizeInBytes >= FC_LARGE_PAGE_MIN_BYTES &&
+				_FC_BufferMove(pBuffer, newCapacity, TRUE))
+				return TRUE;
+			if (pBuffer->LargeBytes != 0)
+				return _FC_BufferMove(pBuffer, newCapacity, FALSE);
+
+			void* pNewData = pBuffer->pData
+				? _FC_ReAllocFrom(_FC_BufferHeap(pBuffer), &pBuffer->Allocator, pBuffer->pData, newSizeInBytes)
+				: _FC_AllocFrom(_FC_BufferHeap(pBuffer), &pBuffer->Allocator, 0, newSizeInBytes);
+			if (pNewData == NULL)
+				return FALSE;
+			pBuffer->pData = pNewData;
+			pBuffer->Capacity = newCapacity;
+		}
+		return TRUE;
+	}
+
+	/**
+	 * @brief Appends a single element to the end of the buffer.
+	 * @internal
+	 * @param pBuffer A pointer to the _FC_BUFFER.
+	 * @param pElement A pointer to the element to be copied into the buffer.
+	 * @return TRUE on success, FALSE on memory allocation failure.
+	 */
+	static inline BOOL
+		_FC_BufferAppend(
+			_Inout_ _FC_BUFFER* pBuffer,
+			_In_ const void* pElement)
+	{
+		if (!_FC_BufferEnsureCapacity(pBuffer, 1))
+		{
+			return FALSE;
+		}
+
+		void* pDestination = (char*)pBuffer->pData + (pBuffer->Count * pBuffer->ElementSize);
+		memcpy(pDestination, pElement, pBuffer->ElementSize);
+		pBuffer->Count++;
+		return TRUE;
+	}
+
+	/**
+	 * @brief Appends a range of elements from an array to the end of the buffer.
+	 * @internal
+	 * @param pBuffer A pointer to the _FC_BUFFER.
+	 * @param pElements A pointer to the first element in the array to append.
+	 * @param count The number of elements to append from the array.
+	 * @return TRUE on success, FALSE on memory allocation failure.
+	 */
+	static inline BOOL
+		_FC_BufferAppendRange(
+			_Inout_ _FC_BUFFER* pBuffer,
+			_In_ const void* pElements,
+			_In_ size_t count)
+	{
+		if (count == 0) return TRUE;
+		if (!_FC_BufferEnsureCapacity(pBuffer, count))
+		{
+			return FALSE;
+		}
+
+		void* pDestination = (char*)pBuffer->pData + (pBuffer->Count * pBuffer->ElementSize);
+		memcpy(pDestination, pElements, count * pBuffer->ElementSize);
+		pBuffer->Count += count;
+		return TRUE;
+	}
+
+	/**
+	 * @brief Replaces a range of elements with the contents of an array.
+	 * @internal
+	 * @param pBuffer A pointer to the _FC_BUFFER.
+	 * @param index The first element to replace.
+	 * @param removeCount The number of elements to remove at index.
+	 * @param pElements The elements to insert at index, or NULL if insertCount is 0.
+	 * @param insertCount The number of elements to insert.
+	 * @return TRUE on success, FALSE on memory allocation failure (the buffer is unchanged).
+	 */
+	static inline BOOL
+		_FC_BufferSplice(
+			_Inout_ _FC_BUFFER* pBuffer,
+			_In_ size_t index,
+			_In_ size_t removeCount,
+			_In_reads_opt_(insertCount) const void* pElements,
+			_In_ size_t insertCount)
+	{
+		if (index > pBuffer->Count || removeCount > pBuffer->Count - index)
+			return FALSE;
+		if (insertCount > removeCount && !_FC_BufferEnsureCapacity(pBuffer, insertCount - removeCount))
+			return FALSE;
+
+		char* pData = (char*)pBuffer->pData;
+		size_t Size = pBuffer->ElementSize;
+		size_t Tail = pBuffer->Count - index - removeCount;
+		if (Tail > 0 && insertCount != removeCount)
+			memmove(pData + (index + insertCount) * Size, pData + (index + removeCount) * Size, Tail * Size);
+		if (insertCount > 0)
+			memcpy(pData + index * Size, pElements, insertCount * Size);
+		pBuffer->Count = pBuffer->Count - removeCount + insertCount;
+		return TRUE;
+	}
+
+	/**
+	 * @brief Retrieves a pointer to the element at a specific index.
+	 * @internal
+	 * @param pBuffer A pointer to the _FC_BUFFER.
+	 * @param index The zero-based index of the element to retrieve.
+	 * @return A pointer to the element, or NULL if the index is out of bounds.
+	 */
+	static inline void*
+		_FC_BufferGet(
+			_In_ const _FC_BUFFER* pBuffer,
+			_In_ size_t index)
+	{
+		if (index >= pBuffer->Count)
+		{
+			return NULL;
+		}
+		return (char*)pBuffer->pData + (index * pBuffer->ElementSize);
+	}
+
+	/**
+	 * @brief Finds the first occurrence of a pattern of elements within a buffer.
+	 * @internal
+	 * @param pBuffer The buffer to search within.
+	 * @param pPattern A pointer to the pattern of elements to find.
+	 * @param patternSize The number of elements in the pattern.
+	 * @param startIndex The index in the buffer from which to start the search.
+	 * @return The starting index of the found pattern, or (size_t)-1 if the pattern is not found.
+	 */
+	static inline size_t
+		_FC_BufferFind(
+			_In_ const _FC_BUFFER* pBuffer,
+			_In_ const void* pPattern,
+			_In_ size_t patternSize,
+			_In_ size_t startIndex)
+	{
+		if (patternSize == 0 || pBuffer->Count < patternSize || startIndex > pBuffer->Count - patternSize)
+		{
+			return (size_t)-1;
+		}
+
+		size_t searchLimit = pBuffer->Count - patternSize;
+		for (size_t i = startIndex; i <= searchLimit; ++i)
+		{
+			void* pCurrent = (char*)pBuffer->pData + (i * pBuffer->ElementSize);
+			if (memcmp(pCurrent, pPattern, patternSize * pBuffer->ElementSize) == 0)
+			{
+				return i;
+			}
+		}
+		return (size_t)-1;
+	}
+
+	/**
+	 * @brief Replaces all occurrences of a pattern with a new pattern.
+	 *
+	 * This function performs a single-pass replacement. It first calculates the
+	 * required size for the new buffer, allocates it, and then iterates through the
+	 * source buffer, copying non-matching parts and inserting the new pattern where
+	 * matches occur. If the new pattern is NULL or its size is 0, it effectively
+	 * removes all occurrences of the old pattern.
+	 * @internal
+	 * @param pBuffer A pointer to the _FC_BUFFER to modify. The original buffer's data is freed and replaced.
+	 * @param pOldPattern A pointer to the sequence of elements to be replaced.
+	 * @param oldPatternSize The number of elements in the old pattern.
+	 * @param pNewPattern A pointer to the new sequence of elements to insert. Can be NULL to indicate removal.
+	 * @param newPatternSize The number of elements in the new pattern.
+	 * @return TRUE on success, FALSE on memory allocation or parameter validation failure.
+	 */
+	static inline BOOL
+		_FC_BufferReplace(
+			_Inout_ _FC_BUFFER* pBuffer,
+			_In_ const void* pOldPattern,
+			_In_ size_t oldPatternSize,
+			_In_opt_ const void* pNewPattern,
+			_In_ size_t newPatternSize)
+	{
+		// 1. Defensive Input Validation
+		if (!pBuffer || !pOldPattern)
+			return FALSE;
+		if (newPatternSize > 0 && !pNewPattern)
+			return FALSE;
+		if (pBuffer->Count > 0 && !pBuffer->pData) // Check for inconsistent buffer state
+			return FALSE;
+		if (pBuffer->ElementSize == 0 && pBuffer->Count > 0) // Reject degenerate buffer
+			return FALSE;
+
+		if (oldPatternSize == 0 || pBuffer->Count == 0)
+			return TRUE;
+
+		size_t count = 0;
+		// Pass 1: count occurrences
+		for (size_t i = 0; i + oldPatternSize <= pBuffer->Count; )
+		{
+			if (memcmp((char*)pBuffer->pData + i * pBuffer->ElementSize,
+				pOldPattern,
+				oldPatternSize * pBuffer->ElementSize) == 0)
+			{
+				if (count == SIZE_MAX)
+					return FALSE; // Too many occurrences to count
+				count++;
+				i += oldPatternSize;
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		if (count == 0)
+			return TRUE;
+
+		// 2. Safely calculate new buffer size using pure unsigned arithmetic
+		size_t newCount;
+		if (newPatternSize >= oldPatternSize) {
+			// Growth path
+			size_t delta = newPatternSize - oldPatternSize;
+			if (delta > 0 && count > (SIZE_MAX - pBuffer->Count) / delta)
+				return FALSE; // Overflow
+			newCount = pBuffer->Count + count * delta;
+		}
+		else {
+			// Shrink path
+			size_t delta = oldPatternSize - newPatternSize;
+			size_t totalShrink = count * delta;
+				if (totalShrink > pBuffer->Count)
+					return FALSE;  // Logic error: cannot shrink more than the buffer size
+				newCount = pBuffer->Count - totalShrink;
+			}
+
+			_FC_BUFFER newBuf = { 0 };
+			_FC_BufferInit(&newBuf, pBuffer->ElementSize);
+			newBuf.Heap = pBuffer->Heap;
+			newBuf.Allocator = pBuffer->Allocator;
+
+		// Handle the edge case of replacing with nothing, resulting in an empty buffer
+		if (newCount == 0)
+		{
+			_FC_BufferFree(pBuffer);
+			*pBuffer = newBuf; // newBuf is already an empty, valid buffer
+			return TRUE;
+		}
+
+		// 3. Check for allocation size overflow before allocating
+		if (pBuffer->ElementSize > 0 && newCount > SIZE_MAX / pBuffer->ElementSize)
+			return FALSE;
+		size_t newSizeInBytes = newCount * pBuffer->ElementSize;
+
+		newBuf.pData = _FC_AllocFrom(_FC_BufferHeap(&newBuf), &newBuf.Allocator, 0, newSizeInBytes);
+		if (!newBuf.pData)
+			return FALSE;
+		newBuf.Capacity = newCount;
+
+		// Pass 2: build the new buffer
+		size_t read_idx = 0, write_idx = 0;
+		const size_t elemSize = pBuffer->ElementSize;
+		char* const dstBase = (char*)newBuf.pData;
+		const char* const srcBase = (char*)pBuffer->pData;
+
+		while (read_idx < pBuffer->Count)
+		{
+			if (read_idx + oldPatternSize <= pBuffer->Count &&
+				memcmp(srcBase + read_idx * elemSize, pOldPattern, oldPatternSize * elemSize) == 0)
+			{
+				if (newPatternSize > 0)
+				{
+					if (write_idx + newPatternSize > newBuf.Capacity) goto cleanup;
+					memcpy(dstBase + write_idx * elemSize, pNewPattern, newPatternSize * elemSize);
+					write_idx += newPatternSize;
+				}
+				read_idx += oldPatternSize;
+			}
+			else
+			{
+				if (write_idx + 1 > newBuf.Capacity) goto cleanup;
+				memcpy(dstBase + write_idx * elemSize, srcBase + read_idx * elemSize, elemSize);
+				write_idx++;
+				read_idx++;
+			}
+		}
+		newBuf.Count = write_idx;
+
+		// Swap in the new buffer
+		_FC_BufferFree(pBuffer);
+		*pBuffer = newBuf;
+		return TRUE;
+
+	cleanup:
+		// This cleanup path is a safeguard against logic errors in the write loop
+		_FC_FreeFrom(_FC_BufferHeap(&newBuf), &newBuf.Allocator, newBuf.pData);
+		return FALSE;
+	}
+
+	/**
+	 * @brief Converts a character buffer to a null-terminated string.
+	 *
+	 * Ensures the buffer is of type `char`, appends a null terminator if one is not
+	 * already present, and returns a pointer to the raw data.
+	 * @internal
+	 * @note On failure, this function may free the buffer's internal data.
+	 * @param pBuffer A pointer to the character `_FC_BUFFER`.
+	 * @return A pointer to the null-terminated string, or NULL on failure or if the buffer is not a char buffer.
+	 */
+	static inline char*
+		_FC_BufferToString(
+			_Inout_ _FC_BUFFER* pBuffer)
+	{
+		// Ensure it's a char buffer.
+		if (pBuffer->ElementSize != sizeof(char)) return NULL;
+
+		// Append a null terminator if not already present.
+		if (pBuffer->Count == 0 || *((char*)_FC_BufferGet(pBuffer, pBuffer->Count - 1)) != '\0')
+		{
+			char nullChar = '\0';
+			if (!_FC_BufferAppend(pBuffer, &nullChar))
+			{
+				// On failure, we can't return a valid string.
+				_FC_BufferFree(pBuffer);
+				return NULL;
+			}
+		}
+		return (char*)pBuffer->pData;
+	}
+
+	/**
+	 * @brief Converts an ASCII character to its lowercase equivalent.
+	 * @internal
+	 * @param Character The input character.
+	 * @return The lowercase version of the character if it's an uppercase letter, otherwise the character itself.
+	 */
+	static inline unsigned char
+		_FC_ToLowerAscii(
+			unsigned char Character)
+	{
+		if (Character >= 'A' && Character <= 'Z')
+		{
+			return Character + ('a' - 'A');
+		}
+		return Character;
+	}
+
+	/**
+	 * @brief Creates a new, null-terminated heap-allocated string from a character range.
+	 * @internal
+	 * @param String A pointer to the source character array.
+	 * @param Length The number of characters to copy from the source.
+	 * @return A pointer to the new heap-allocated string, or NULL on failure. The caller must free this memory.
+	 */
+	static inline char*
+		_FC_StringDuplicateRange(
+			_In_reads_(Length) const char* String,
+			_In_ size_t Length)
+	{
+		char* Output = (char*)_FC_WorkAlloc(0, Length + 1);
+		if (Output == NULL)
+		{
+			return NULL;
+		}
+		memcpy(Output, String, Length);
+		Output[Length] = '\0';
+		return Output;
+	}
+
+	/**
+	 * @brief Converts a UTF-8 encoded string to its lowercase equivalent.
+	 *
+	 * This function handles multi-byte UTF-8 characters correctly by converting the
+	 * string to WCHARs, lowercasing them with `_FC_PalLowerWide`, and then converting
+	 * it back to a new UTF-8 string.
+	 * @internal
+	 * @param Source A pointer to the source UTF-8 string.
+	 * @param SourceLength The length in bytes of the source string.
+	 * @param[out] NewLength A pointer to a size_t that will receive the length of the new lowercase string.
+	 * @return A pointer to a new, heap-allocated, null-terminated lowercase UTF-8 string, or NULL on failure. The caller must free this memory.
+	 */
+	static inline char*
+		_FC_StringToLowerUnicode(
+			_In_reads_(SourceLength) const char* Source,
+			_In_ size_t SourceLength,
+			_Out_ size_t* NewLength)
+	{
+		*NewLength = 0;
+		char* DestBuffer = NULL;
+		WCHAR* WideBuffer = NULL;
+
+		if (SourceLength == 0)
+		{
+			// Empty input → return empty string
+			return _FC_StringDuplicateRange("", 0);
+		}
+
+		// The transcoding functions use an int for length, so we must respect that limit.
+		if (SourceLength > INT_MAX)
+		{
+			return NULL; // Input too large for the API.
+		}
+
+		// Determine required UTF-16 length
+		int WideLength = _FC_PalUtf8ToWide(
+			Source, (int)SourceLength,
+			NULL, 0, FALSE);
+		if (WideLength == 0)
+			goto cleanup;
+
+#define STACK_BUFFER_SIZE 512 // Use stack for up to 512 wide chars (1KB)
+		WCHAR TmpStackBuffer[STACK_BUFFER_SIZE];
+		WideBuffer = TmpStackBuffer;
+
+		// If the required size is larger than our stack buffer, allocate from the heap.
+		if (WideLength > STACK_BUFFER_SIZE)
+		{
+			if ((size_t)WideLength > SIZE_MAX / sizeof(WCHAR)) // Check for overflow
+				goto cleanup;
+			WideBuffer = (WCHAR*)_FC_WorkAlloc(0,
+				(size_t)WideLength * sizeof(WCHAR));
+			if (WideBuffer == NULL)
+				goto cleanup;
+		}
+
+		// Convert UTF-8 → UTF-16
+		if (_FC_PalUtf8ToWide(
+			Source, (int)SourceLength,
+			WideBuffer, WideLength, FALSE) == 0)
+			goto cleanup;
+
+		// Lowercase in place using an explicit character count. This avoids
+		// relying on NUL-termination because the UTF-16 buffer above is created
+		// from an explicit byte length (SourceLength), not from a NUL-terminated input.
+		if (_FC_PalLowerWide(WideBuffer, (DWORD)WideLength) == 0 && WideLength > 0)
+			goto cleanup;
+
+		// Determine required UTF-8 length
+		int Utf8Length = _FC_PalWideToUtf8(
+			WideBuffer, WideLength,
+			NULL, 0);
+		if (Utf8Length == 0)
+			goto cleanup;
+
+		// Allocate UTF-8 buffer
+		DestBuffer = (char*)_FC_WorkAlloc(0,
+			(size_t)Utf8Length + 1);
+		if (DestBuffer == NULL)
+			goto cleanup;
+
+		// Convert UTF-16 → UTF-8
+		if (_FC_PalWideToUtf8(
+			WideBuffer, WideLength,
+			DestBuffer, Utf8Length) == 0)
+		{
+			_FC_WorkFree(DestBuffer);
+			DestBuffer = NULL;
+			goto cleanup;
+		}
+
+		DestBuffer[Utf8Length] = '\0';
+		*NewLength = (size_t)Utf8Length;
+
+	cleanup:
+		// Free the heap buffer if it was allocated
+		if (WideBuffer != TmpStackBuffer && WideBuffer != NULL)
+			_FC_WorkFree(WideBuffer);
+
+#undef STACK_BUFFER_SIZE
+		return DestBuffer;
+	}
+
+	/**
+	 * @brief Computes a hash for a character string using a simple algorithm (djb2-like).
+	 *
+	 * This function can optionally ignore case and whitespace for ASCII strings.
+	 * @internal
+	 * @param String The string to hash.
+	 * @param Length The length of the string.
+	 * @param Flags A bitmask of comparison flags (FC_IGNORE_CASE, FC_IGNORE_WS).
+	 * @return The computed 32-bit hash value.
+	 */
+	static inline UINT
+		_FC_ComputeHash(
+			_In_reads_(Length) const char* String,
+			_In_ size_t Length,
+			_In_ UINT Flags)
+	{
+		UINT Hash = 0;
+		BOOL const ignoreCase = (Flags & FC_IGNORE_CASE);
+		BOOL const ignoreWs = (Flags & FC_IGNORE_WS);
+
+		for (size_t i = 0; i < Length; ++i)
+		{
+			unsigned char Character = (unsigned char)String[i];
+			if (ignoreWs && (Character == ' ' || Character == '\t'))
+				continue;
+			if (ignoreCase)
+				Character = _FC_ToLowerAscii(Character);
+			Hash = Hash * 31 + Character;
+		}
+		return Hash;
+	}
+
+	/**
+	 * @brief Computes a hash for a line, handling Unicode case-insensitivity if required.
+	 *
+	 * This is a wrapper around `_FC_ComputeHash`. If Unicode case-insensitivity is
+	 * requested, it first converts the line to lowercase using the Unicode-aware
+	 * `_FC_StringToLowerUnicode` function before hashing. Otherwise, it calls
+	 * `_FC_ComputeHash` directly.
+	 * @internal
+	 * @param String The line's text to hash.
+	 * @param Length The length of the line's text.
+	 * @param Config A pointer to the main comparison configuration.
+	 * @return The computed hash value for the line.
+	 */
+	static inline UINT
+		_FC_HashLine(
+			_In_reads_(Length) const char* String,
+			_In_ size_t Length,
+			_In_ const FC_CONFIG* Config)
+	{
+		UINT Flags = Config->Flags;
+
+		// If case-insensitive and Unicode, we must use the slower, Unicode-aware path.
+		if ((Flags & FC_IGNORE_CASE) && Config->Mode == FC_MODE_TEXT_UNICODE)
+		{
+			size_t LowerLength;
+			char* LowerString = _FC_StringToLowerUnicode(String, Length, &LowerLength);
+			if (LowerString == NULL)
+				return 0; // Fail-safe; hashing 0 for NULL is safe for comparison fallback
+
+			// We pass the original flags, but the string is already lowercase, so
+			// the case-insensitivity path in _FC_ComputeHash will be redundant but harmless.
+			UINT Hash = _FC_ComputeHash(LowerString, LowerLength, Flags);
+			_FC_WorkFree(LowerString);
+			return Hash;
+		}
+
+		// For all other cases (ASCII, or case-sensitive), compute the hash directly.
+		// _FC_ComputeHash now handles ASCII case-insensitivity on the fly.
+		return _FC_ComputeHash(String, Length, Flags);
+	}
+
+	/**
+	 * @brief Compares two parsed lines for equality using the same normalization as the
+	 * hash function.
+	 *
+	 * This is used as a secondary check after a hash match to rule out false positives
+	 * due to hash collisions.  The comparison is case-insensitive when FC_IGNORE_CASE is
+	 * set, mirroring the behavior of _FC_HashLine.
+	 * @internal
+	 * @param TextA The normalized text of the first line.
+	 * @param LengthA The length of TextA in bytes.
+	 * @param TextB The normalized text of the second line.
+	 * @param LengthB The length of TextB in bytes.
+	 * @param Config A pointer to the comparison configuration.
+	 * @return TRUE if the lines are equal under the current configuration, FALSE otherwise.
+	 */
+	static inline BOOL
+		_FC_LineTextsEqual(
+			_In_reads_(LengthA) const char* TextA,
+			_In_ size_t LengthA,
+			_In_reads_(LengthB) const char* TextB,
+			_In_ size_t LengthB,
+			_In_ const FC_CONFIG* Config)
+	{
+		if (LengthA != LengthB)
+			return FALSE;
+
+		if (!(Config->Flags & FC_IGNORE_CASE))
+			return memcmp(TextA, TextB, LengthA) == 0;
+
+		if (Config->Mode == FC_MODE_TEXT_UNICODE)
+		{
+			// Unicode-aware case-insensitive comparison: lowercase both sides and compare.
+			size_t LowLenA = 0, LowLenB = 0;
+			char* LowA = _FC_StringToLowerUnicode(TextA, LengthA, &LowLenA);
+			char* LowB = _FC_StringToLowerUnicode(TextB, LengthB, &LowLenB);
+			// On allocation failure, both pointers are freed safely by _FC_WorkFree (which
+			// accepts NULL).  Returning FALSE is intentionally conservative: under OOM we
+			// report extra diffs rather than silently masking real differences.
+			BOOL Equal = FALSE;
+			if (LowA != NULL && LowB != NULL && LowLenA == LowLenB)
+				Equal = (memcmp(LowA, LowB, LowLenA) == 0);
+			_FC_WorkFree(LowA);
+			_FC_WorkFree(LowB);
+			return Equal;
+		}
+
+		// ASCII case-insensitive: compare byte-by-byte using the same _FC_ToLowerAscii
+		// that the hash function uses.
+		for (size_t i = 0; i < LengthA; i++)
+		{
+			if (_FC_ToLowerAscii((unsigned char)TextA[i]) !=
+				_FC_ToLowerAscii((unsigned char)TextB[i]))
+				return FALSE;
+		}
+		return TRUE;
+	}
+
+	/**
+	 * @brief Compares two parsed lines for equality.
+	 * @internal
+	 * @see _FC_LineTextsEqual
+	 */
+	static inline BOOL
+		_FC_LinesEqual(
+			_In_ const _FC_LINE* lineA,
+			_In_ const _FC_LINE* lineB,
+			_In_ const FC_CONFIG* Config)
+	{
+		return _FC_LineTextsEqual(lineA->Text, lineA->Length, lineB->Text, lineB->Length, Config);
+	}
+
+	/**
+	 * @brief Frees all memory associated with the lines stored in a line buffer.
+	 *
+	 * This iterates through each `_FC_LINE` in the buffer, frees the `Text` pointer
+	 * for each line, and then frees the buffer's main data block itself.
+	 * @internal
+	 * @param pLineBuffer A pointer to the `_FC_BUFFER` containing `_FC_LINE` elements.
+	 */
+	static void
+		_FC_FreeLineBufferContents(_Inout_ _FC_BUFFER* pLineBuffer)
+	{
+		for (size_t i = 0; i < pLineBuffer->Count; ++i)
+		{
+			_FC_LINE* line = (_FC_LINE*)_FC_BufferGet(pLineBuffer, i);
+			if (line && line->Text)
+			{
+				_FC_WorkFree(line->Text);
+			}
+		}
+		_FC_BufferFree(pLineBuffer);
+	}
+
+	/**
+	 * @struct _FC_LINE_INDEX_SLOT
+	 * @brief One distinct line hash of a _FC_LINE_INDEX.
+	 * @internal
+	 */
+	typedef struct {
+		UINT Hash;
+		size_t Count;   // Number of lines with this hash; 0 marks an empty slot.
+	} _FC_LINE_INDEX_SLOT;
+
+	/**
+	 * @struct _FC_LINE_INDEX
+	 * @brief An immutable index of the line hashes of a whole line array.
+	 *
+	 * Unlike the per-chunk _FC_HASH_MAP, it is built once and can serve any chunk.
+	 * It tells whether a hash occurs at all, which keeps lines that cannot match out
+	 * of the per-chunk map. Lookups only read the index, so one index can serve
+	 * several comparisons running on different threads.
+	 * @internal
+	 */
+	typedef struct {
+		_FC_LINE_INDEX_SLOT* Slots; // Open addressing with linear probing.
+		size_t SlotMask;            // Slot count - 1; the slot count is a power of two.
+		UINT SlotShift;             // 32 - log2(slot count), for multiplicative hashing.
+	} _FC_LINE_INDEX;
+
+	/**
+	 * @brief Returns the slot of a hash in a line index, or NULL if no line has it.
+	 * @internal
+	 */
+	static inline const _FC_LINE_INDEX_SLOT*
+		_FC_LineIndexFind(
+			_In_ const _FC_LINE_INDEX* Index,
+			_In_ UINT Hash)
+	{
+		size_t Slot = (size_t)((Hash * 2654435761u) >> Index->SlotShift) & Index->SlotMask;
+		while (Index->Slots[Slot].Count != 0)
+		{
+			if (Index->Slots[Slot].Hash == Hash)
+				return &Index->Slots[Slot];
+			Slot = (Slot + 1) & Index->SlotMask;
+		}
+		return NULL;
+	}
+
+	/**
+	 * @brief Frees a line index. Safe to call on a zeroed index.
+	 * @internal
+	 */
+	static void
+		_FC_LineIndexFree(
+			_Inout_ _FC_LINE_INDEX* Index)
+	{
+		_FC_WorkFree(Index->Slots);
+		memset(Index, 0, sizeof(*Index));
+	}
+
+	/**
+	 * @brief Builds a line index over every line of a line array.
+	 * @internal
+	 * @param pLines A buffer of _FC_LINE elements.
+	 * @param[out] Index Receives the index; free it with `_FC_LineIndexFree`.
+	 * @return TRUE on success, FALSE on memory allocation failure.
+	 */
+	static BOOL
+		_FC_LineIndexBuild(
+			_In_ const _FC_BUFFER* pLines,
+			_Out_ _FC_LINE_INDEX* Index)
+	{
+		memset(Index, 0, sizeof(*Index));
+
+		// At most half the slots are used, which keeps probe sequences short.
+		UINT Bits = 4;
+		while (Bits < 31 && ((size_t)1 << Bits) < pLines->Count * 2)
+			Bits++;
+		Index->SlotMask = ((size_t)1 << Bits) - 1;
+		Index->SlotShift = 32 - Bits;
+		Index->Slots = (_FC_LINE_INDEX_SLOT*)_FC_WorkAlloc(_FC_ALLOC_ZERO, (Index->SlotMask + 1) * sizeof(_FC_LINE_INDEX_SLOT));
+		if (Index->Slots == NULL)
+			return FALSE;
+
+		for (size_t i = 0; i < pLines->Count; ++i)
+		{
+			UINT Hash = ((const _FC_LINE*)_FC_BufferGet(pLines, i))->Hash;
+			size_t Slot = (size_t)((Hash * 2654435761u) >> Index->SlotShift) & Index->SlotMask;
+			while (Index->Slots[Slot].Count != 0 && Index->Slots[Slot].Hash != Hash)
+				Slot = (Slot + 1) & Index->SlotMask;
+			Index->Slots[Slot].Hash = Hash;
+			Index->Slots[Slot].Count++;
+		}
+		return TRUE;
+	}
+
+	/**
+	 * @brief Reports one difference block of a chunk through the diff callback.
+	 * @internal
+	 * @param StartA The chunk-relative first line of the block in A; EndA is exclusive.
+	 * @param StartB The chunk-relative first line of the block in B; EndB is exclusive.
+	 */
+	static void
+		_FC_ReportChunkBlock(
+			_In_ const FC_USER_CONTEXT* Context,
+			_In_ const FC_CONFIG* Config,
+			_In_ size_t StartA,
+			_In_ size_t EndA,
+			_In_ size_t StartB,
+			_In_ size_t EndB)
+	{
+		FC_DIFF_BLOCK block = { 0 };
+		if (EndA > StartA && EndB > StartB) block.Type = FC_DIFF_TYPE_CHANGE;
+		else if (EndB > StartB) block.Type = FC_DIFF_TYPE_ADD;
+		else block.Type = FC_DIFF_TYPE_DELETE;
+
+		// Convert chunk-relative indices to absolute indices using Context offsets
+		block.StartA = StartA + Context->OffsetA;
+		block.EndA = EndA + Context->OffsetA;
+		block.StartB = StartB + Context->OffsetB;
+		block.EndB = EndB + Context->OffsetB;
+		LONGLONG TraceStart = _FC_TraceNow();
+		_FC_STATS_PHASE OuterPhase = _FC_StatsPhase(_FC_STATS_REPORT);
+		Config->DiffCallback(Context, &block);
+		_FC_StatsPhase(OuterPhase);
+		_FC_TraceSpan(_FC_TRACE_REPORT, TraceStart, block.StartA, block.StartB);
+	}
+
+	/**
+	 * @brief Reverses the LCS chain that ends at link Last, so that each PrevLink points to the next match.
+	 * @internal
+	 * @return The pool index of the first match, or _FC_CHUNK_NONE for an empty chain.
+	 */
+	static _FC_CHUNK_INDEX
+		_FC_LcsReverseChain(
+			_Inout_ _FC_BUFFER* pLinkPool,
+			_In_ _FC_CHUNK_INDEX Last)
+	{
+		_FC_LCS_LINK* Nodes = (_FC_LCS_LINK*)pLinkPool->pData;
+		_FC_CHUNK_INDEX Next = _FC_CHUNK_NONE;
+		while (Last != _FC_CHUNK_NONE)
+		{
+			_FC_CHUNK_INDEX Prev = Nodes[Last].PrevLink;
+			Nodes[Last].PrevLink = Next;
+			Next = Last;
+			Last = Prev;
+		}
+		return Next;
+	}
+
+	/**
+	 * @brief Reports the differences of a chunk in one pass over its reversed LCS chain.
+	 *
+	 * Keeps only "stable anchors": runs of consecutive matches that are at least
+	 * `ResyncLines` long. This emulates the behavior of fc.exe's /nnnn switch by
+	 * discarding shorter, potentially coincidental matches and consolidating
+	 * differences into larger blocks. A run is measured as the chain is walked, and
+	 * the gap in front of each kept run is reported as soon as the run qualifies, so
+	 * the LCS is never copied out of the link pool.
+	 * @internal
+	 * @param Context The user context containing file paths and line buffers.
+	 * @param Config The main comparison configuration, containing the callback pointer.
+	 * @param pLinkPool The link pool holding the chain.
+	 * @param First The first match, from `_FC_LcsReverseChain`, or _FC_CHUNK_NONE.
+	 * @param[out] pLastAnchorA Receives the chunk-relative end of the last kept run in A (or 0 if none).
+	 * @param[out] pLastAnchorB Receives the chunk-relative end of the last kept run in B (or 0 if none).
+	 * @return FC_OK if no block was reported, FC_DIFFERENT otherwise.
+	 */
+	static FC_RESULT
+		_FC_ReportLcsChain(
+			_In_ const FC_USER_CONTEXT* Context,
+			_In_ const FC_CONFIG* Config,
+			_In_ const _FC_BUFFER* pLinkPool,
+			_In_ _FC_CHUNK_INDEX First,
+			_Out_ size_t* pLastAnchorA,
+			_Out_ size_t* pLastAnchorB)
+	{
+		const _FC_LCS_LINK* Nodes = (const _FC_LCS_LINK*)pLinkPool->pData;
+		const size_t MinRun = (Config->ResyncLines > 1) ? Config->ResyncLines : 1;
+		size_t IndexA = 0, IndexB = 0;              // End of the last kept run.
+		size_t RunA = 0, RunB = 0, RunLength = 0;   // The run being measured.
+		BOOL Reported = FALSE;
+
+		for (_FC_CHUNK_INDEX Link = First; ; )
+		{
+			size_t MatchA = 0, MatchB = 0;
+			BOOL More = (Link != _FC_CHUNK_NONE);
+			if (More)
+			{
+				MatchA = Nodes[Link].AIdx;
+				MatchB = Nodes[Link].BIdx;
+				Link = Nodes[Link].PrevLink;
+				if (RunLength > 0 && MatchA == RunA + RunLength && MatchB == RunB + RunLength)
+				{
+					RunLength++;
+					continue;
+				}
+			}
+
+			// The run being measured ended; keep it if it is a stable anchor.
+			if (RunLength >= MinRun)
+			{
+				if (IndexA < RunA || IndexB < RunB)
+				{
+					_FC_ReportChunkBlock(Context, Config, IndexA, RunA, IndexB, RunB);
+					Reported = TRUE;
+				}
+				IndexA = RunA + RunLength;
+				IndexB = RunB + RunLength;
+			}
+			if (!More)
+				break;
+			RunA = MatchA;
+			RunB = MatchB;
+			RunLength = 1;
+		}
+
+		const size_t CountA = Context->Lines1->Count;
+		const size_t CountB = Context->Lines2->Count;
+		if (IndexA < CountA || IndexB < CountB)
+		{
+			_FC_ReportChunkBlock(Context, Config, IndexA, CountA, IndexB, CountB);
+			Reported = TRUE;
+		}
+		*pLastAnchorA = IndexA;
+		*pLastAnchorB = IndexB;
+		return Reported ? FC_DIFFERENT : FC_OK;
+	}
+
+	/**
+	 * @brief Records one match in the Hunt-McIlroy threshold arrays.
+	 * @internal
+	 * @param Ctx The LCS state.
+	 * @param I The line index on the scanned side.
+	 * @param J The line index on the looked-up side; the matches of one I must arrive in decreasing J.
+	 * @param[in,out] pLcsLength The length of the longest chain so far.
+	 * @return FALSE on memory allocation failure, or if the link pool outgrows a chunk index.
+	 */
+	static inline BOOL
+		_FC_LcsAddMatch(
+			_Inout_ _FC_LCS_CONTEXT* Ctx,
+			_In_ _FC_CHUNK_INDEX I,
+			_In_ _FC_CHUNK_INDEX J,
+			_Inout_ size_t* pLcsLength)
+	{
+		size_t k = 0, low = 1, high = *pLcsLength;
+		while (low <= high) {
+			size_t mid = low + (high - low) / 2;
+			if (J > Ctx->Thresholds[mid]) low = mid + 1;
+			else high = mid - 1;
+		}
+		k = low;
+
+		if (J < Ctx->Thresholds[k]) {
+			// At most one link per match, so only chunks far above the default
+			// FC_MAX_CHUNK_LINES could get here.
+			if (Ctx->LinkPool.Count >= _FC_CHUNK_NONE)
+				return FALSE;
+			_FC_LCS_LINK newNode;
+			newNode.AIdx = I;
+			newNode.BIdx = J;
+			newNode.PrevLink = (k > 0) ? Ctx->Links[k - 1] : _FC_CHUNK_NONE;
+			if (!_FC_BufferAppend(&Ctx->LinkPool, &newNode))
+				return FALSE;
+			Ctx->Thresholds[k] = J;
+			Ctx->Links[k] = (_FC_CHUNK_INDEX)(Ctx->LinkPool.Count - 1);
+			if (k > *pLcsLength) *pLcsLength = k;
+		}
+		return TRUE;
+	}
+
+	/**
+	 * @brief Ranks the match list probed for one line among FC_STATS::TopLines.
+	 * @internal
+	 * @param Length The number of same-hash lines probed for Line; the caller has
+	 *        checked that it beats the last entry.
+	 */
+	static void
+		_FC_StatsMatchList(
+			_Inout_ FC_STATS* Stats,
+			_In_ const _FC_LINE* Line,
+			_In_ ULONGLONG Length)
+	{
+		FC_STATS_LINE* Top = Stats->TopLines;
+		size_t Slot = FC_STATS_TOP_LINES - 1;
+		for (size_t i = 0; i < FC_STATS_TOP_LINES; i++)
+		{
+			// A line already ranked keeps one entry, with its longest list.
+			if (Top[i].MatchListLength != 0 && Top[i].Hash == Line->Hash)
+			{
+				if (Length <= Top[i].MatchListLength)
+					return;
+				Slot = i;
+				break;
+			}
+		}
+
+		FC_STATS_LINE Entry = { 0 };
+		Entry.Hash = Line->Hash;
+		Entry.MatchListLength = Length;
+		size_t TextLength = Line->Length < sizeof(Entry.Text) - 1 ? Line->Length : sizeof(Entry.Text) - 1;
+		memcpy(Entry.Text, Line->Text, TextLength);
+		while (Slot > 0 && Top[Slot - 1].MatchListLength < Length)
+		{
+			Top[Slot] = Top[Slot - 1];
+			Slot--;
+		}
+		Top[Slot] = Entry;
+	}
+
+	/**
+	 * @brief Implements the Hunt-McIlroy algorithm to find the Longest Common Subsequence.
+	 *
+	 * The lines of file A are scanned and looked up in a hash map built over the
+	 * chunk of file B, whose match chains are walked from the last line down. A
+	 * prepared index over all of file A only keeps lines of B that occur nowhere in A
+	 * out of the map; the scan order, and so the alignment chosen among LCSs of the
+	 * same length, is the same with or without it.
+	 * @internal
+	 * @param Context The user context containing file paths, line buffers, and user data.
+	 * @param Config The main comparison	configuration.
+	 * @param IndexA An index over the whole of file A, whose chunk starts at Context->OffsetA, or NULL.
+	 * @param[out] pLastAnchorA Receives the chunk-relative index of the last confirmed match in buffer A (or 0 if none).
+	 * @param[out] pLastAnchorB Receives the chunk-relative index of the last confirmed match in buffer B (or 0 if none).
+	 * @return FC_OK if files are identical, FC_DIFFERENT if they differ, or an error code.
+	 */
+	static FC_RESULT
+		_FC_FindLcs(
+			_In_  const FC_USER_CONTEXT* Context,
+			_In_  const FC_CONFIG*       Config,
+			_In_opt_ const _FC_LINE_INDEX* IndexA,
+			_Out_ size_t*                pLastAnchorA,
+			_Out_ size_t*                pLastAnchorB) {
+		const _FC_BUFFER* pBufferA = Context->Lines1;
+		const _FC_BUFFER* pBufferB = Context->Lines2;
+
+		FC_RESULT Result = FC_OK;
+		_FC_LCS_CONTEXT Ctx = { 0 };
+		_FC_CHUNK_INDEX* PrevMatch = NULL;
+		_FC_HASH_MAP MapB = { 0 };
+
+		// Probe counts for FC_STATS, added once when the chunk is done.
+		FC_STATS* Stats = _FC_Stats();
+		ULONGLONG Probes = 0, Collisions = 0, Lookups = 0, LongestList = 0;
+		size_t LcsLength = 0;
+
+		// Initialize anchor outputs: default to no anchor (0)
+		*pLastAnchorA = 0;
+		*pLastAnchorB = 0;
+
+		_FC_PROBE3(lcs__start, pBufferA->Count, pBufferB->Count, IndexA != NULL);
+		if (pBufferA->Count == 0 || pBufferB->Count == 0) {
+			// Entire chunk identical when both sides are empty, different otherwise.
+			Result = (pBufferA->Count == pBufferB->Count) ? FC_OK : FC_DIFFERENT;
+			goto cleanup;
+		}
+
+		// The LCS is at most as long as A's chunk, which sizes the threshold arrays.
+		Ctx.Thresholds = (_FC_CHUNK_INDEX*)_FC_WorkAlloc(0, (pBufferA->Count + 1) * sizeof(_FC_CHUNK_INDEX));
+		Ctx.Links = (_FC_CHUNK_INDEX*)_FC_WorkAlloc(0, (pBufferA->Count + 1) * sizeof(_FC_CHUNK_INDEX));
+		if (!Ctx.Thresholds || !Ctx.Links) { Result = FC_ERROR_MEMORY; goto cleanup; }
+
+		_FC_BufferInit(&Ctx.LinkPool, sizeof(_FC_LCS_LINK));
+		_FC_BufferPreferLargePages(&Ctx.LinkPool);
+
+		for (size_t i = 0; i <= pBufferA->Count; ++i)
+		{
+			Ctx.Thresholds[i] = _FC_CHUNK_NONE;
+			Ctx.Links[i] = _FC_CHUNK_NONE;
+		}
+
+		if (Stats != NULL)
+			_FC_StatsPhase(_FC_STATS_HASH);
+		if (!_FC_HashMapCreate(&MapB, pBufferB->Count)) { Result = FC_ERROR_MEMORY; goto cleanup; }
+
+		// Each entry heads its most recent line; PrevMatch chains to the earlier ones.
+		PrevMatch = (_FC_CHUNK_INDEX*)_FC_WorkAlloc(0, pBufferB->Count * sizeof(_FC_CHUNK_INDEX));
+		if (!PrevMatch) { Result = FC_ERROR_MEMORY; goto cleanup; }
+
+		// NOTE (intentional divergence): /LBn is modeled as an LCS anchor-distance
+		// window, not as strict legacy fc.exe internal line-buffer emulation.
+		// See README "Documented Differences from Windows fc.exe".
+		// With a window, the lines of B enter the map only as the scan of A comes
+		// within BufferLines of them, so every chain starts at the top of the window
+		// and is walked down only to its bottom. With IndexA, lines of B that occur
+		// nowhere in A are never added; they could not be matched anyway.
+		const _FC_LINE* LinesB = (const _FC_LINE*)pBufferB->pData;
+		const size_t Window = Config->BufferLines;
+		size_t Added = 0;
+		if (Window == 0)
+		{
+			for (; Added < pBufferB->Count; ++Added)
+				if (IndexA == NULL || _FC_LineIndexFind(IndexA, LinesB[Added].Hash) != NULL)
+					_FC_HashMapAddLine(&MapB, PrevMatch, LinesB[Added].Hash, Added);
+		}
+		if (Stats != NULL)
+			_FC_StatsPhase(_FC_STATS_LCS);
+
+		for (size_t i = 0; i < pBufferA->Count; ++i) {
+			const _FC_LINE* lineA = (const _FC_LINE*)_FC_BufferGet(pBufferA, i);
+			for (; Added < pBufferB->Count && Added <= i + Window; ++Added)
+				if (IndexA == NULL || _FC_LineIndexFind(IndexA, LinesB[Added].Hash) != NULL)
+					_FC_HashMapAddLine(&MapB, PrevMatch, LinesB[Added].Hash, Added);
+
+			UINT hashA = lineA->Hash;
+			_FC_HASH_MAP_ENTRY* entry = _FC_HashMapFind(&MapB, hashA);
+			if (entry) {
+				ULONGLONG ListStart = Probes;
+				for (_FC_CHUNK_INDEX j = entry->MatchHead; j != _FC_CHUNK_NONE; j = PrevMatch[j]) {
+					// Chains descend, so the rest lies below the window.
+					if (Window > 0 && j + Window < i)
+						break;
+					Probes++;
+
+					const _FC_LINE* lineB = (const _FC_LINE*)_FC_BufferGet(pBufferB, j);
+					// Hashes are only a pre-filter; verify actual line equality to avoid
+					// false matches on hash collisions.  Use the config-aware helper so that
+					// case-insensitive modes are handled correctly (raw memcmp would reject
+					// "Hello" == "hello" even though their hashes match under FC_IGNORE_CASE).
+					if (!_FC_LinesEqual(lineA, lineB, Config))
+					{
+						Collisions++;
+						continue;
+					}
+
+					if (!_FC_LcsAddMatch(&Ctx, (_FC_CHUNK_INDEX)i, j, &LcsLength))
+					{
+						Result = FC_ERROR_MEMORY;
+						goto cleanup;
+					}
+				}
+				ULONGLONG ListLength = Probes - ListStart;
+				if (ListLength == 0)
+					continue;
+				Lookups++;
+				if (ListLength > LongestList)
+					LongestList = ListLength;
+				if (Stats != NULL && ListLength > Stats->TopLines[FC_STATS_TOP_LINES - 1].MatchListLength)
+					_FC_StatsMatchList(Stats, lineA, ListLength);
+			}
+		}
+
+		if (LcsLength == pBufferA->Count && LcsLength == pBufferB->Count) {
+			// Entire chunk is identical after LCS
+			Result = FC_OK;
+			*pLastAnchorA = pBufferA->Count;
+			*pLastAnchorB = pBufferB->Count;
+		}
+		else {
+			// The chain runs from the last match back to the first; turn it around in
+			// place and report from it directly.
+			_FC_CHUNK_INDEX First = (LcsLength > 0)
+				? _FC_LcsReverseChain(&Ctx.LinkPool, Ctx.Links[LcsLength])
+				: _FC_CHUNK_NONE;
+			Result = _FC_ReportLcsChain(Context, Config, &Ctx.LinkPool, First,
+				pLastAnchorA, pLastAnchorB);
+		}
+	cleanup:
+		if (Stats != NULL)
+		{
+			Stats->MatchesProbed += Probes;
+			Stats->HashCollisions += Collisions;
+			Stats->MatchListLookups += Lookups;
+			if (LongestList > Stats->MaxMatchListLength)
+				Stats->MaxMatchListLength = LongestList;
+			if (Ctx.LinkPool.Count > Stats->PeakLcsLinks)
+				Stats->PeakLcsLinks = Ctx.LinkPool.Count;
+		}
+		_FC_PROBE4(lcs__done, Probes, Collisions, LcsLength, Result);
+		_FC_HashMapFree(&MapB);
+		_FC_WorkFree(PrevMatch);
+		_FC_WorkFree(Ctx.Thresholds);
+		_FC_WorkFree(Ctx.Links);
+		_FC_BufferFree(&Ctx.LinkPool);
+		return Result;
+	}
+
+	/**
+	 * @brief Processes a single chunk of lines through the LCS algorithm.
+	 *
+	 * Phase C: Runs LCS over one chunk of file lines and emits diff blocks via callback.
+	 * Returns the anchor pair (last confirmed match) for rollback coordination.
+	 *
+	 * The anchor is critical for boundary handling: if the last anchor is before the
+	 * chunk's final line, a diff block straddles the boundary and the caller should
+	 * rewind to the anchor for re-processing.
+	 *
+	 * @internal
+	 * @param Context User context with chunk's line buffers and offsets (UPDATED: OffsetA, OffsetB set by caller)
+	 * @param Config Comparison configuration
+	 * @param IndexA Optional prepared index over the whole of file A (see _FC_FindLcs)
+	 * @param[out] pNextAnchorA Receives the absolute line index of the last anchor in file A (or chunk start if no matches)
+	 * @param[out] pNextAnchorB Receives the absolute line index of the last anchor in file B (or chunk start if no matches)
+	 * @return FC_OK if chunk lines identical, FC_DIFFERENT if diffs found, or error code
+	 */
+	static FC_RESULT
+		_FC_ProcessChunk(
+			_In_ const FC_USER_CONTEXT* Context,
+			_In_ const FC_CONFIG* Config,
+			_In_opt_ const _FC_LINE_INDEX* IndexA,
+			_Out_ size_t* pNextAnchorA,
+			_Out_ size_t* pNextAnchorB)
+	{
+		if (!Context || !Config || !pNextAnchorA || !pNextAnchorB)
+			return FC_ERROR_INVALID_PARAM;
+
+		const _FC_BUFFER* pBufferA = Context->Lines1;
+		const _FC_BUFFER* pBufferB = Context->Lines2;
+
+		// Initialize anchors to chunk start (offsets)
+		*pNextAnchorA = Context->OffsetA;
+		*pNextAnchorB = Context->OffsetB;
+
+		// Empty chunks are identical
+		if (pBufferA->Count == 0 && pBufferB->Count == 0)
+			return FC_OK;
+
+		// One side empty: the other side's lines are one ADD or DELETE block. This
+		// covers an empty (or, under FC_IGNORE_WS, all-blank) file and a chunk past
+		// the end of the shorter file.
+		if (pBufferA->Count == 0 || pBufferB->Count == 0)
+		{
+			if (Config->DiffCallback != NULL)
+				_FC_ReportChunkBlock(Context, Config, 0, pBufferA->Count, 0, pBufferB->Count);
+			*pNextAnchorA = Context->OffsetA + pBufferA->Count;
+			*pNextAnchorB = Context->OffsetB + pBufferB->Count;
+			return FC_DIFFERENT;
+		}
+
+		// Check if entire chunk is identical (diagonal check within chunk)
+		BOOL AllMatch = TRUE;
+		if (pBufferA->Count == pBufferB->Count) {
+			for (size_t i = 0; i < pBufferA->Count; i++) {
+				const _FC_LINE* a = (const _FC_LINE*)_FC_BufferGet(pBufferA, i);
+				const _FC_LINE* b = (const _FC_LINE*)_FC_BufferGet(pBufferB, i);
+				if (a->Hash != b->Hash || !_FC_LinesEqual(a, b, Config)) {
+					AllMatch = FALSE;
+					break;
+				}
+			}
+		} else {
+			AllMatch = FALSE;
+		}
+
+		if (AllMatch) {
+			// Entire chunk matches - set anchor to end of chunk
+			*pNextAnchorA = Context->OffsetA + pBufferA->Count;
+			*pNextAnchorB = Context->OffsetB + pBufferB->Count;
+			return FC_OK;
+		}
+
+		// Run LCS on this chunk
+		size_t lastAnchorA = 0, lastAnchorB = 0;
+		FC_RESULT Result = _FC_FindLcs(Context, Config, IndexA, &lastAnchorA, &lastAnchorB);
+
+		// Convert chunk-relative anchor to absolute line index
+		*pNextAnchorA = Context->OffsetA + lastAnchorA;
+		*pNextAnchorB = Context->OffsetB + lastAnchorB;
+
+		return Result;
+	}
+
+	/**
+	 * @brief Applies the line normalization of the configured flags to one raw line.
+	 *
+	 * Tabs are expanded to 8-column stops unless FC_RAW_TABS is set; FC_IGNORE_WS then
+	 * trims leading and trailing spaces and tabs and collapses internal runs to one space,
+	 * matching Windows fc.exe /W.
+	 * @internal
+	 * @param Text The raw line, without its line terminator.
+	 * @param Length The length of the raw line in bytes.
+	 * @param Flags The FC_* flag bits of the comparison.
+	 * @param[in,out] pOut A char buffer that receives the normalized line (replacing its content).
+	 * @param[in,out] pScratch A char buffer used as intermediate storage; may be reused across calls.
+	 * @return TRUE on success, FALSE on allocation failure.
+	 */
+	static BOOL
+		_FC_NormalizeLine(
+			_In_reads_(Length) const char* Text,
+			_In_ size_t Length,
+			_In_ UINT Flags,
+			_Inout_ _FC_BUFFER* pOut,
+			_Inout_ _FC_BUFFER* pScratch)
+	{
+		const char* Src = Text;
+		size_t SrcLength = Length;
+		pOut->Count = 0;
+
+		if (!(Flags & FC_RAW_TABS))
+		{
+			// Expand tabs using 8-column tab stops, matching fc.exe/ReactOS behavior.
+			_FC_BUFFER* pExpanded = (Flags & FC_IGNORE_WS) ? pScratch : pOut;
+			size_t Tabs = 0;
+			for (size_t i = 0; i < Length; i++)
+				Tabs += (Text[i] == '\t');
+			if (Tabs > (SIZE_MAX - Length) / 7)
+				return FALSE;
+			pExpanded->Count = 0;
+			if (!_FC_BufferEnsureCapacity(pExpanded, Length + Tabs * 7))
+				return FALSE;
+
+			char* Dst = (char*)pExpanded->pData;
+			size_t Col = 0;
+			for (size_t i = 0; i < Length; i++)
+			{
+				char c = Text[i];
+				if (c == '\t')
+				{
+					size_t nSpaces = 8 - (Col % 8);
+					memset(Dst + pExpanded->Count, ' ', nSpaces);
+					pExpanded->Count += nSpaces;
+					Col += nSpaces;
+				}
+				else
+				{
+					Dst[pExpanded->Count++] = c;
+					// Lines never contain newlines; this reset is defensive in case that changes.
+					Col = (c == '\n' || c == '\r') ? 0 : Col + 1;
+				}
+			}
+			if (!(Flags & FC_IGNORE_WS))
+				return TRUE;
+			Src = Dst;
+			SrcLength = pExpanded->Count;
+		}
+
+		if (Flags & FC_IGNORE_WS)
+		{
+			// Compress whitespace: trim leading/trailing, collapse internal runs
+			// to a single space. Matches Windows fc.exe /W: "Compresses white space
+			// (tabs and spaces) during comparison."
+			size_t wsStart = 0, wsEnd = SrcLength;
+			while (wsStart < wsEnd && (Src[wsStart] == ' ' || Src[wsStart] == '\t'))
+				wsStart++;
+			while (wsEnd > wsStart && (Src[wsEnd - 1] == ' ' || Src[wsEnd - 1] == '\t'))
+				wsEnd--;
+			if (!_FC_BufferEnsureCapacity(pOut, wsEnd - wsStart))
+				return FALSE;
+
+			char* Dst = (char*)pOut->pData;
+			BOOL inSpace = FALSE;
+			for (size_t ci = wsStart; ci < wsEnd; ci++)
+			{
+				char c = Src[ci];
+				if (c == ' ' || c == '\t')
+				{
+					if (!inSpace)
+						Dst[pOut->Count++] = ' ';
+					inSpace = TRUE;
+				}
+				else
+				{
+					Dst[pOut->Count++] = c;
+					inSpace = FALSE;
+				}
+			}
+			return TRUE;
+		}
+
+		return _FC_BufferAppendRange(pOut, Text, Length);
+	}
+
+	/**
+	 * @brief Parses a raw memory buffer into a structured array of lines.
+	 *
+	 * This function iterates through the input buffer, identifying line breaks. For each
+	 * line, it performs normalization based on the `FC_CONFIG` flags (e.g., tab expansion,
+	 * whitespace removal), computes a hash of the normalized text, and stores the result
+	 * as an `_FC_LINE` in the output buffer.
+	 *
+	 * A buffer that does not start the file (AtFileStart FALSE) must start at the
+	 * beginning of a line; a leading UTF-8 BOM is then part of that line.
+	 * @internal
+	 * @param Buffer The raw character buffer containing the file's content.
+	 * @param BufferLength The length of the raw buffer.
+	 * @param AtFileStart TRUE if Buffer starts the file, so that a UTF-8 BOM is skipped.
+	 * @param[out] pLineBuffer The output buffer where `_FC_LINE` structs will be stored.
+	 * @param Config A pointer to the comparison configuration.
+	 * @return FC_OK on success, or FC_ERROR_MEMORY on allocation failure or a line longer than _FC_MAX_LINE_LENGTH.
+	 */
+	static inline FC_RESULT
+		_FC_ParseLineRange(
+			_In_reads_(BufferLength) const char* Buffer,
+			_In_ size_t BufferLength,
+			_In_ BOOL AtFileStart,
+			_Inout_ _FC_BUFFER* pLineBuffer,
+			_In_ const FC_CONFIG* Config)
+	{
+		const char* Ptr = Buffer;
+		const char* End = Buffer + BufferLength;
 
 		// Skip UTF-8 BOM (0xEF 0xBB 0xBF) at the start of the buffer in Unicode or
 		// auto-detect mode. In auto mode, _FC_CompareFilesInternal calls _FC_CompareFilesText
 		// (and thus _FC_ParseLines) with Config->Mode still set to FC_MODE_AUTO, so without
 		// this check the three BOM bytes would be treated as part of the first line.
+		if (AtFileStart &&
+			(Config->Mode == FC_MODE_TEXT_UNICODE || Config->Mode == FC_MODE_AUTO) &&
+			BufferLength >= 3 &&
+			(unsigned char)Ptr[0] == 0xEF &&
+			(unsigned char)Ptr[1] == 0xBB &&
+			(unsigned char)Ptr[2] == 0xBF)
+		{
+			Ptr += 3;
+			if (Ptr == End)
+				return FC_OK;
+		}
+
+		// Tab expansion scratch space, reused by every line.
+		FC_RESULT Result = FC_OK;
+		_FC_BUFFER Scratch;
+		_FC_BufferInit(&Scratch, sizeof(char));
+
+		FC_STATS* Stats = _FC_Stats();
+		size_t FirstLine = pLineBuffer->Count;
+		LONGLONG TraceStart = _FC_TraceNow();
+		_FC_STATS_PHASE OuterPhase = _FC_StatsPhase(_FC_STATS_PARSE);
+
+		// Compute hash config once: clear FC_IGNORE_WS since text is already
+		// WS-normalized before hashing, so single preserved spaces are significant.
+		FC_CONFIG HashConfig = *Config;
+		if (HashConfig.Flags & FC_IGNORE_WS)
+			HashConfig.Flags &= ~(UINT)FC_IGNORE_WS;
+
+		while (Ptr <= End)
+		{
+			// This condition handles the last line if the file doesn't end with a newline.
+			if (Ptr == End)
+			{
+				if (BufferLength == 0 || Buffer[BufferLength - 1] == '\n' || Buffer[BufferLength - 1] == '\r')
+				{
+					break; // Don't process a zero-length line at the very end.
+				}
+			}
+
+			const char* Newline = Ptr;
+			while (Newline < End && *Newline != '\n' && *Newline != '\r')
+			{
+				Newline++;
+			}
+			size_t LineLength = (size_t)(Newline - Ptr);
+
+			_FC_BUFFER textBuffer = { 0 };
+			_FC_BufferInit(&textBuffer, sizeof(char));
+			if (!_FC_NormalizeLine(Ptr, LineLength, Config->Flags, &textBuffer, &Scratch))
+			{
+				_FC_BufferFree(&textBuffer);
+				Result = FC_ERROR_MEMORY;
+				goto cleanup;
+			}
+
+			size_t FinalLength = textBuffer.Count;
+			if (FinalLength > _FC_MAX_LINE_LENGTH)
+			{
+				_FC_BufferFree(&textBuffer);
+				Result = FC_ERROR_MEMORY;
+				goto cleanup;
+			}
+			char* FinalText = _FC_BufferToString(&textBuffer);
+
+			if (FinalText == NULL)
+			{
+				Result = FC_ERROR_MEMORY; // _FC_BufferToString frees on failure
+				goto cleanup;
+			}
+
+			// If ignoring whitespace and the line becomes empty, discard it.
+			if ((Config->Flags & FC_IGNORE_WS) && FinalLength == 0)
+			{
+				_FC_WorkFree(FinalText);
+			}
+			else
+			{
+				_FC_LINE line;
+				line.Text = FinalText;
+				line.Length = (UINT)FinalLength;
+				if (Stats != NULL)
+					_FC_StatsPhase(_FC_STATS_HASH);
+				line.Hash = _FC_HashLine(FinalText, FinalLength, &HashConfig);
+				if (Stats != NULL)
+					_FC_StatsPhase(_FC_STATS_PARSE);
+
+				if (!_FC_BufferAppend(pLineBuffer, &line))
+				{
+					_FC_WorkFree(FinalText);
+					Result = FC_ERROR_MEMORY;
+					goto cleanup;
+				}
+			}
+
+			if (Newline >= End)
+			{
+				break; // Reached end of buffer
+			}
+
+			Ptr = Newline;
+			while (Ptr < End && (*Ptr == '\n' || *Ptr == '\r'))
+			{
+				Ptr++;
+			}
+		}
+
+	cleanup:
+		_FC_BufferFree(&Scratch);
+		if (Stats != NULL)
+			Stats->LinesParsed += pLineBuffer->Count - FirstLine;
+		_FC_StatsPhase(OuterPhase);
+		_FC_TraceSpan(_FC_TRACE_PARSE, TraceStart, pLineBuffer->Count - FirstLine, 0);
+		return Result;
+	}
+
+	/**
+	 * @brief Parses the whole contents of a file into a structured array of lines.
+	 * @internal
+	 * @see _FC_ParseLineRange
+	 */
+	static inline FC_RESULT
+		_FC_ParseLines(
+			_In_reads_(BufferLength) const char* Buffer,
+			_In_ size_t BufferLength,
+			_Inout_ _FC_BUFFER* pLineBuffer,
+			_In_ const FC_CONFIG* Config)
+	{
+		return _FC_ParseLineRange(Buffer, BufferLength, TRUE, pLineBuffer, Config);
+	}
+
+	/**
+	 * @brief Reads the entire contents of a file into a caller-owned character buffer.
+	 * @internal
+	 * @param Path The wide character path to the file to read.
+	 * @param[in,out] FileBuffer An initialized `char` buffer. Its previous contents are
+	 *        discarded but its capacity is reused; on success it holds the file's bytes
+	 *        followed by a null terminator that is not included in Count.
+	 * @return FC_OK on success, FC_ERROR_IO or FC_ERROR_MEMORY on failure.
+	 *
+	 * The file is read in fixed-size chunks to avoid single-call read limits and
+	 * reduce large transient allocation pressure.
+	 */
+	static inline FC_RESULT
+		_FC_ReadFileIntoBuffer(
+			_In_z_ const WCHAR* Path,
+			_Inout_ _FC_BUFFER* FileBuffer)
+	{
+		FC_RESULT Result = FC_OK;
+		_FC_FILE FileHandle = _FC_INVALID_FILE;
+		FC_STATS* Stats = _FC_Stats();
+		LONGLONG TraceStart = _FC_TraceNow();
+		_FC_STATS_PHASE OuterPhase = _FC_StatsPhase(_FC_STATS_READ);
+		FileBuffer->Count = 0;
+
+		FileHandle = _FC_PalOpenRead(Path, TRUE);
+
+		if (FileHandle == _FC_INVALID_FILE)
+		{
+			_FC_StatsPhase(OuterPhase);
+			_FC_TraceSpan(_FC_TRACE_READ, TraceStart, 0, 0);
+			return FC_ERROR_IO;
+		}
+
+		ULONGLONG FileSize;
+		if (!_FC_PalFileSize(FileHandle, &FileSize))
+		{
+			Result = FC_ERROR_IO;
+			goto cleanup;
+		}
+
+		if (FileSize > (ULONGLONG)SIZE_MAX - 1)
+		{
+			Result = FC_ERROR_MEMORY; // File too large
+			goto cleanup;
+		}
+
+		// Reserve the terminator too, so that a file read at its expected size is not
+		// followed by a doubling of the buffer.
+		size_t LengthHint = (size_t)FileSize;
+		if (!_FC_BufferEnsureCapacity(FileBuffer, LengthHint + 1))
+		{
+			Result = FC_ERROR_MEMORY;
+			goto cleanup;
+		}
+
+		#pragma warning(push)
+		#pragma warning(disable:6262)  // Stack usage warning: benign for scoped read chunk
+		{
+			enum { FC_READ_CHUNK = 64 * 1024 };
+			char ReadChunk[FC_READ_CHUNK];
+			for (;;)
+			{
+				DWORD BytesRead = 0;
+				if (!_FC_PalRead(FileHandle, ReadChunk, FC_READ_CHUNK, &BytesRead))
+				{
+					Result = FC_ERROR_IO;
+					goto cleanup;
+				}
+				if (BytesRead == 0)
+					break; // EOF
+
+				if (!_FC_BufferAppendRange(FileBuffer, ReadChunk, (size_t)BytesRead))
+				{
+					Result = FC_ERROR_MEMORY;
+					goto cleanup;
+				}
+			}
+		}
+		#pragma warning(pop)
+
+		// Ensure null-termination.
+		if (!_FC_BufferEnsureCapacity(FileBuffer, 1))
+		{
+			Result = FC_ERROR_MEMORY;
+			goto cleanup;
+		}
+		((char*)FileBuffer->pData)[FileBuffer->Count] = '\0';
+		if (Stats != NULL)
+			Stats->BytesRead += FileBuffer->Count;
+
+	cleanup:
+		_FC_PalClose(FileHandle);
+		_FC_StatsPhase(OuterPhase);
+		_FC_TraceSpan(_FC_TRACE_READ, TraceStart, FileBuffer->Count, 0);
+		return Result;
+	}
+
+	/**
+	 * @brief Reads the entire contents of a file into a new heap-allocated buffer.
+	 * @internal
+	 * @param Path The wide character path to the file to read.
+	 * @param[out] OutputLength A pointer to a size_t that will receive the number of bytes read.
+	 * @param[out] Result A pointer to an FC_RESULT that will be set to indicate the outcome.
+	 * @return A pointer to a new, null-terminated buffer containing the file's content, or NULL on failure. The caller must free this memory with `_FC_WorkFree`.
+	 */
+	static inline char*
+		_FC_ReadFileContents(
+			_In_z_ const WCHAR* Path,
+			_Out_ size_t* OutputLength,
+			_Out_ FC_RESULT* Result)
+	{
+		char* Buffer = NULL;
+		_FC_BUFFER FileBuffer = { 0 };
+		_FC_BufferInit(&FileBuffer, sizeof(char));
+		*OutputLength = 0;
+
+		*Result = _FC_ReadFileIntoBuffer(Path, &FileBuffer);
+		if (*Result == FC_OK)
+		{
+			Buffer = (char*)FileBuffer.pData;
+			*OutputLength = FileBuffer.Count;
+			FileBuffer.pData = NULL;
+		}
+		_FC_BufferFree(&FileBuffer);
+		return Buffer;
+	}
+
+	static inline BOOL
+		_FC_GetFileSizeW(
+			_In_z_ const WCHAR* Path,
+			_Out_ ULONGLONG* SizeOut)
+	{
+		if (Path == NULL || SizeOut == NULL)
+			return FALSE;
+
+		*SizeOut = 0;
+		_FC_FILE hFile = _FC_PalOpenRead(Path, TRUE);
+		if (hFile == _FC_INVALID_FILE)
+			return FALSE;
+
+		BOOL ok = _FC_PalFileSize(hFile, SizeOut);
+		_FC_PalClose(hFile);
+		return ok;
+	}
+
+	static inline ULONGLONG
+		_FC_GetEffectiveTextLimitBytes(
+			_In_ const FC_CONFIG* Config)
+	{
+		if (Config != NULL && Config->MaxTextFileBytes > 0)
+			return (ULONGLONG)Config->MaxTextFileBytes;
+		return (ULONGLONG)FC_DEFAULT_MAX_TEXT_FILE_BYTES;
+	}
+
+	static inline ULONGLONG
+		_FC_GetEffectiveBinaryStreamThresholdBytes(void)
+	{
+#if defined(FC_TESTING)
+		ULONGLONG Override;
+		if (_FC_PalGetEnvironmentNumber(L"FC_BINARY_STREAM_THRESHOLD_OVERRIDE", &Override))
+			return Override;
+#endif
+		return (ULONGLONG)FC_BINARY_STREAM_THRESHOLD_BYTES;
+	}
+
+	static inline BOOL
+		_FC_ShouldUseBinaryForLargeText(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		ULONGLONG limit = _FC_GetEffectiveTextLimitBytes(Config);
+		ULONGLONG size1 = 0, size2 = 0;
+
+		// Fail-open: if probing size fails, preserve existing behavior.
+		if (!_FC_GetFileSizeW(Path1, &size1) || !_FC_GetFileSizeW(Path2, &size2))
+			return FALSE;
+
+		return (size1 > limit || size2 > limit);
+	}
+
+	/**
+	 * @brief Analyzes a byte buffer to determine if it likely contains text.
+	 *
+	 * This heuristic is used by @c FC_MODE_AUTO to decide whether to apply text or
+	 * binary comparison. This is an intentional design difference from the Windows
+	 * @c fc.exe tool, which defaults unconditionally to text mode (@c /L) when no
+	 * explicit mode flag is given. Here, the content is inspected instead, which
+	 * prevents misleading line-diff output for binary files that happen to carry a
+	 * @c .txt extension.
+	 *
+	 * The heuristic rules, applied in order:
+	 * -# If the buffer begins with a UTF-8, UTF-16 LE, or UTF-16 BE BOM, it is text.
+	 * -# If any byte is @c 0x00 (null), it is binary (strong binary indicator).
+	 * -# If at least 90 % of bytes are printable ASCII (0x20–0x7E, TAB, CR, LF),
+	 *    it is text; otherwise binary.
+	 *
+	 * The caller reads only the first 4 KB of each file (@c _FC_IsProbablyTextFileW).
+	 * If either file is classified as binary the pair is compared in binary mode.
+	 * @internal
+	 * @param Buffer A pointer to the byte buffer to inspect.
+	 * @param BufferLength The length of the buffer in bytes.
+	 * @return TRUE if the buffer content is likely text, FALSE otherwise.
+	 */
+	static inline BOOL
+		_FC_IsProbablyTextBuffer(const BYTE* Buffer, DWORD BufferLength)
+	{
+		const double textThreshold = 0.90;
+		if (BufferLength == 0) return FALSE;
+
+		// Detect UTF BOMs (early exit for known good encodings)
+		if (BufferLength >= 3 && Buffer[0] == 0xEF && Buffer[1] == 0xBB && Buffer[2] == 0xBF) // UTF-8 BOM
+			return TRUE;
+		if (BufferLength >= 2 && Buffer[0] == 0xFF && Buffer[1] == 0xFE) // UTF-16 LE BOM
+			return TRUE;
+		if (BufferLength >= 2 && Buffer[0] == 0xFE && Buffer[1] == 0xFF) // UTF-16 BE BOM
+			return TRUE;
+
+		int printable = 0;
+		for (DWORD i = 0; i < BufferLength; ++i)
+		{
+			BYTE c = Buffer[i];
+			if ((c >= 32 && c <= 126) || c == 9 || c == 10 || c == 13) {
+				printable++;
+			}
+			else if (c == 0) {
+				return FALSE; // Null byte strongly suggests binary
+			}
+			// Could expand here with UTF-8 continuation byte validation, if needed
+		}
+
+		double ratio = (double)printable / BufferLength;
+		return (ratio >= textThreshold);
+	}
+
+	/**
+	 * @brief Reads the beginning of a file to determine if it is likely a text file.
+	 *
+	 * This function opens the specified file, reads the first chunk of data, and uses
+	 * `_FC_IsProbablyTextBuffer` to analyze its content.
+	 * @internal
+	 * @param Path The wide character path to the file to check.
+	 * @return TRUE if the file is likely a text file, FALSE otherwise or on error.
+	 */
+	static inline BOOL
+		_FC_IsProbablyTextFileW(const WCHAR* Path) {
+		LONGLONG TraceStart = _FC_TraceNow();
+		_FC_FILE hFile = _FC_PalOpenRead(Path, TRUE);
+		if (hFile == _FC_INVALID_FILE)
+		{
+			_FC_TraceSpan(_FC_TRACE_SNIFF, TraceStart, FALSE, 0);
+			return FALSE;
+		}
+
+#define BUFFER_SIZE 4096
+
+		BYTE* buffer = (BYTE*)_FC_WorkAlloc(0, BUFFER_SIZE);
+		if (buffer == NULL)
+		{
+			// If heap allocation fails, we can't proceed.
+			_FC_PalClose(hFile);
+			_FC_TraceSpan(_FC_TRACE_SNIFF, TraceStart, FALSE, 0);
+			return FALSE;
+		}
+
+		DWORD bytesRead = 0;
+		BOOL success = _FC_PalRead(hFile, buffer, BUFFER_SIZE, &bytesRead);
+
+		// Call the text-checking function.
+		BOOL isText = _FC_IsProbablyTextBuffer(buffer, bytesRead);
+
+		_FC_WorkFree(buffer);
+		_FC_PalClose(hFile);
+
+#undef BUFFER_SIZE
+
+		if (!success || bytesRead == 0)
+			isText = FALSE;
+		_FC_TraceSpan(_FC_TRACE_SNIFF, TraceStart, isText, 0);
+		return isText;
+	}
+
+	/**
+	 * @brief Runs the LCS over the chunk starting at (*pCurA, *pCurB) and advances both cursors.
+	 *
+	 * Differences in the chunk are reported through `Config->DiffCallback`. The cursors
+	 * either move past the chunk or, for a difference straddling the chunk boundary,
+	 * rewind to the last confirmed match so the next chunk re-examines it; either way
+	 * *pCurA never moves backwards.
+	 *
+	 * The line arrays may be windows of longer texts: line numbers, including the
+	 * cursors, count from the start of the texts, and BaseA and BaseB are the line
+	 * numbers of the first line in each window. A window must reach at least one line
+	 * past the chunk unless it ends its text, so that a rewind is recognized.
+	 * @internal
+	 * @param Path1 The path reported for the first text, or NULL.
+	 * @param Path2 The path reported for the second text, or NULL.
+	 * @param pBufferA The lines of the first text from line BaseA on.
+	 * @param BaseA The line number of the first line in pBufferA.
+	 * @param pBufferB The lines of the second text from line BaseB on.
+	 * @param BaseB The line number of the first line in pBufferB.
+	 * @param ChunkLines The maximum number of lines per side in one chunk.
+	 * @param[in,out] pCurA The chunk start in the first text.
+	 * @param[in,out] pCurB The chunk start in the second text.
+	 * @param Config A pointer to the comparison configuration.
+	 * @param IndexA A prepared index over all of pBufferA that filters each chunk's map of pBufferB, or NULL.
+	 * @return FC_OK or FC_DIFFERENT for the chunk, or an error code.
+	 */
+	static FC_RESULT
+		_FC_ProcessWindowChunk(
+			_In_opt_z_ const WCHAR* Path1,
+			_In_opt_z_ const WCHAR* Path2,
+			_In_ const _FC_BUFFER* pBufferA,
+			_In_ size_t BaseA,
+			_In_ const _FC_BUFFER* pBufferB,
+			_In_ size_t BaseB,
+			_In_ size_t ChunkLines,
+			_Inout_ size_t* pCurA,
+			_Inout_ size_t* pCurB,
+			_In_ const FC_CONFIG* Config,
+			_In_opt_ const _FC_LINE_INDEX* IndexA)
+	{
+		size_t CurA = *pCurA, CurB = *pCurB;
+		size_t EndA = BaseA + pBufferA->Count, EndB = BaseB + pBufferB->Count;
+
+		// Build non-owning slice views into the line arrays.
+		size_t SliceCountA = EndA - CurA;
+		size_t SliceCountB = EndB - CurB;
+		if (SliceCountA > ChunkLines) SliceCountA = ChunkLines;
+		if (SliceCountB > ChunkLines) SliceCountB = ChunkLines;
+
+		_FC_BUFFER SliceA = {
+			(char*)pBufferA->pData + (CurA - BaseA) * pBufferA->ElementSize,
+			pBufferA->ElementSize,
+			SliceCountA,
+			SliceCountA
+		};
+		_FC_BUFFER SliceB = {
+			(char*)pBufferB->pData + (CurB - BaseB) * pBufferB->ElementSize,
+			pBufferB->ElementSize,
+			SliceCountB,
+			SliceCountB
+		};
+
+		FC_USER_CONTEXT Ctx = {
+			Path1, Path2,
+			&SliceA, &SliceB,
+			Config->UserData,
+			CurA,    // OffsetA
+			CurB     // OffsetB
+		};
+
+		FC_STATS* Stats = _FC_Stats();
+		size_t NextAnchorA = 0, NextAnchorB = 0;
+		LONGLONG TraceStart = _FC_TraceNow();
+		_FC_PROBE4(chunk__start, CurA, CurB, SliceCountA, SliceCountB);
+		_FC_STATS_PHASE OuterPhase = _FC_StatsPhase(_FC_STATS_LCS);
+		FC_RESULT ChunkResult = _FC_ProcessChunk(&Ctx, Config, IndexA, &NextAnchorA, &NextAnchorB);
+		_FC_StatsPhase(OuterPhase);
+		_FC_TraceSpan(_FC_TRACE_CHUNK, TraceStart, SliceCountA, SliceCountB);
+		_FC_PROBE3(chunk__done, CurA, CurB, ChunkResult);
+		if (Stats != NULL)
+			Stats->ChunksProcessed++;
+		if (ChunkResult == FC_ERROR_MEMORY || ChunkResult == FC_ERROR_IO)
+			return ChunkResult;
+
+		// Advance cursor based on anchor position.
+		// The anchor represents the line after the last confirmed match (chunk-relative).
+		// Boundary-straddling diffs only occur if the anchor is STRICTLY BEFORE chunk_end
+		// AND there's more content after the chunk (not at EOF).
+		//
+		// If anchor is within chunk but we're at/near EOF, just advance normally.
+
+		BOOL IsAnchorWithinChunk =
+			(NextAnchorA > CurA && NextAnchorA < CurA + SliceCountA) ||
+			(NextAnchorB > CurB && NextAnchorB < CurB + SliceCountB);
+
+		BOOL HasMoreContent =
+			(CurA + SliceCountA < EndA) ||
+			(CurB + SliceCountB < EndB);
+
+		if (NextAnchorA == CurA && NextAnchorB == CurB)
+		{
+			// No anchor advance — entire chunk is divergent, force advance
+			CurA += SliceCountA;
+			CurB += SliceCountB;
+		}
+		else if (IsAnchorWithinChunk && HasMoreContent)
+		{
+			// Anchor within chunk AND more content exists — boundary-straddling diff
+			// Rewind to anchor for re-processing from the confirmed match point
+			_FC_PROBE3(rewind, NextAnchorA, NextAnchorB, CurA + SliceCountA - NextAnchorA);
+			CurA = NextAnchorA;
+			CurB = NextAnchorB;
+			if (Stats != NULL)
+				Stats->Rewinds++;
+			_FC_TraceSpan(_FC_TRACE_REWIND, 0, CurA, CurB);
+		}
+		else
+		{
+			// Normal case: anchor at chunk_end, or at EOF, advance past chunk
+			CurA += SliceCountA;
+			CurB += SliceCountB;
+		}
+
+		*pCurA = CurA;
+		*pCurB = CurB;
+		return ChunkResult;
+	}
+
+	/**
+	 * @brief Runs the LCS over the chunk starting at (*pCurA, *pCurB) of two whole line arrays.
+	 * @internal
+	 * @see _FC_ProcessWindowChunk
+	 */
+	static inline FC_RESULT
+		_FC_ProcessNextChunk(
+			_In_opt_z_ const WCHAR* Path1,
+			_In_opt_z_ const WCHAR* Path2,
+			_In_ const _FC_BUFFER* pBufferA,
+			_In_ const _FC_BUFFER* pBufferB,
+			_In_ size_t ChunkLines,
+			_Inout_ size_t* pCurA,
+			_Inout_ size_t* pCurB,
+			_In_ const FC_CONFIG* Config,
+			_In_opt_ const _FC_LINE_INDEX* IndexA)
+	{
+		return _FC_ProcessWindowChunk(Path1, Path2, pBufferA, 0, pBufferB, 0,
+			ChunkLines, pCurA, pCurB, Config, IndexA);
+	}
+
+#ifndef FC_BUDGET_MIN_CHUNK_LINES
+#define FC_BUDGET_MIN_CHUNK_LINES 16
+#endif
+
+	/**
+	 * @brief Counts a change of strategy forced by FC_CONFIG::MaxMemoryBytes and clears the refusal.
+	 * @internal
+	 */
+	static inline void _FC_NoteBudgetFallback(void)
+	{
+		g_FcWork.OverBudget = FALSE;
+		FC_STATS* Stats = _FC_Stats();
+		if (Stats != NULL)
+			Stats->BudgetFallbacks++;
+	}
+
+	/**
+	 * @brief Decides whether a text comparison that failed for lack of memory before comparing
+	 *        any lines switches to `_FC_CompareTextStreams`.
+	 * @internal
+	 * @return TRUE if the memory was refused by FC_CONFIG::MaxMemoryBytes rather than by the system.
+	 */
+	static inline BOOL _FC_StreamForBudget(void)
+	{
+		if (!g_FcWork.OverBudget)
+			return FALSE;
+		_FC_NoteBudgetFallback();
+		return TRUE;
+	}
+
+	/**
+	 * @brief Halves the chunk size after FC_CONFIG::MaxMemoryBytes refused a chunk's memory.
+	 *
+	 * A chunk allocates all of its LCS state before it reports anything, so a chunk that
+	 * failed for lack of memory can run again from the same cursors with fewer lines.
+	 * @internal
+	 * @param[in,out] pChunkLines The chunk size, halved down to FC_BUDGET_MIN_CHUNK_LINES.
+	 * @return TRUE if the chunk should be retried, FALSE if the failure stands.
+	 */
+	static inline BOOL
+		_FC_ShrinkChunkForBudget(
+			_Inout_ size_t* pChunkLines)
+	{
+		if (!g_FcWork.OverBudget || *pChunkLines <= FC_BUDGET_MIN_CHUNK_LINES)
+			return FALSE;
+		*pChunkLines /= 2;
+		if (*pChunkLines < FC_BUDGET_MIN_CHUNK_LINES)
+			*pChunkLines = FC_BUDGET_MIN_CHUNK_LINES;
+		_FC_NoteBudgetFallback();
+		return TRUE;
+	}
+
+	/**
+	 * @brief Runs the chunked LCS over two parsed line arrays and reports their differences.
+	 * @internal
+	 * @param Path1 The path reported for the first text, or NULL.
+	 * @param Path2 The path reported for the second text, or NULL.
+	 * @param pBufferA The line array of the first text.
+	 * @param pBufferB The line array of the second text.
+	 * @param MaxBytes The size in bytes of the larger text, which sets the chunk size.
+	 * @param IndexA A prepared index over pBufferA, or NULL.
+	 * @param Config A pointer to the comparison configuration.
+	 * @return An FC_RESULT code indicating the outcome.
+	 */
+	static FC_RESULT
+		_FC_CompareLineArrays(
+			_In_opt_z_ const WCHAR* Path1,
+			_In_opt_z_ const WCHAR* Path2,
+			_In_ const _FC_BUFFER* pBufferA,
+			_In_ const _FC_BUFFER* pBufferB,
+			_In_ LONGLONG MaxBytes,
+			_In_opt_ const _FC_LINE_INDEX* IndexA,
+			_In_ const FC_CONFIG* Config)
+	{
+		size_t ChunkLines = _FC_ComputeChunkSize(MaxBytes, Config->BufferLines);
+		size_t CurA = 0, CurB = 0;
+		BOOL AnyDiff = FALSE;
+
+		while (CurA < pBufferA->Count || CurB < pBufferB->Count)
+		{
+			// CurA only moves forward (a rewind lands past the previous cursor).
+			if (!_FC_ReportProgress(Config, FC_PHASE_TEXT_COMPARE, CurA, pBufferA->Count))
+				return FC_CANCELLED;
+
+			FC_RESULT ChunkResult = _FC_ProcessNextChunk(Path1, Path2, pBufferA, pBufferB, ChunkLines, &CurA, &CurB, Config, IndexA);
+			if (ChunkResult == FC_ERROR_MEMORY && _FC_ShrinkChunkForBudget(&ChunkLines))
+				continue;
+			if (ChunkResult == FC_ERROR_MEMORY || ChunkResult == FC_ERROR_IO)
+				return ChunkResult;
+			if (ChunkResult == FC_DIFFERENT)
+				AnyDiff = TRUE;
+		}
+
+		if (!_FC_ReportProgress(Config, FC_PHASE_TEXT_COMPARE, pBufferA->Count, pBufferA->Count))
+			return FC_CANCELLED;
+		return AnyDiff ? FC_DIFFERENT : FC_OK;
+	}
+
+	//
+	// Line streams split a file or buffer into lines one read window at a time.
+	// The equality checks walk two of them in lockstep, and a text comparison
+	// that does not fit FC_CONFIG::MaxMemoryBytes diffs them chunk by chunk.
+	//
+
+#ifndef FC_EQUAL_READ_BYTES
+#define FC_EQUAL_READ_BYTES (256u * 1024u)
+#endif
+
+	/**
+	 * @struct _FC_LINE_STREAM
+	 * @brief Produces the raw lines of a file or buffer one at a time, split exactly
+	 *        as `_FC_ParseLines` splits them.
+	 * @internal
+	 */
+	typedef struct
+	{
+		_FC_FILE File;          // Source file, or _FC_INVALID_FILE for an in-memory source.
+		const char* Data;       // Current window: the read buffer, or the whole in-memory input.
+		size_t Length;          // Valid bytes in Data.
+		size_t Pos;             // Next unread byte in Data.
+		char* Window;           // Read buffer of a file source.
+		size_t Capacity;        // Size of Window.
+		ULONGLONG Consumed;     // Bytes of the source before the current window.
+		ULONGLONG Size;         // Bytes in the whole source, for progress reports.
+		BOOL Eof;               // Nothing follows the current window.
+		BOOL Started;           // The first line has been produced.
+		_FC_BUFFER Carry;       // A line that straddles read windows.
+	} _FC_LINE_STREAM;
+
+	/**
+	 * @brief Skips a UTF-8 BOM at the start of the input, as `_FC_ParseLines` does.
+	 * @internal
+	 */
+	static inline void
+		_FC_LineStreamSkipBom(
+			_Inout_ _FC_LINE_STREAM* Stream,
+			_In_ const FC_CONFIG* Config)
+	{
 		if ((Config->Mode == FC_MODE_TEXT_UNICODE || Config->Mode == FC_MODE_AUTO) &&
-			BufferLength >= 3 &&
-			(unsigned char)Ptr[0] == 0xEF &&
-			(unsigned char)Ptr[1] == 0xBB &&
-			(unsigned char)Ptr[2] == 0xBF)
+			Stream->Length >= 3 &&
+			(unsigned char)Stream->Data[0] == 0xEF &&
+			(unsigned char)Stream->Data[1] == 0xBB &&
+			(unsigned char)Stream->Data[2] == 0xBF)
+		{
+			Stream->Pos = 3;
+		}
+	}
+
+	static void
+		_FC_LineStreamInitMemory(
+			_Out_ _FC_LINE_STREAM* Stream,
+			_In_reads_(Length) const char* Data,
+			_In_ size_t Length,
+			_In_ const FC_CONFIG* Config)
+	{
+		memset(Stream, 0, sizeof(*Stream));
+		Stream->File = _FC_INVALID_FILE;
+		Stream->Data = Data;
+		Stream->Length = Length;
+		Stream->Size = Length;
+		Stream->Eof = TRUE;
+		_FC_BufferInit(&Stream->Carry, sizeof(char));
+		_FC_LineStreamSkipBom(Stream, Config);
+	}
+
+	/**
+	 * @brief Opens a file as a line stream and reads its first window.
+	 * @internal
+	 * @return FC_OK, FC_ERROR_IO or FC_ERROR_MEMORY. The stream must be closed in every case.
+	 */
+	static FC_RESULT
+		_FC_LineStreamOpenFile(
+			_Out_ _FC_LINE_STREAM* Stream,
+			_In_z_ const WCHAR* Path,
+			_In_ const FC_CONFIG* Config)
+	{
+		memset(Stream, 0, sizeof(*Stream));
+		_FC_BufferInit(&Stream->Carry, sizeof(char));
+		Stream->File = _FC_PalOpenRead(Path, TRUE);
+		if (Stream->File == _FC_INVALID_FILE || !_FC_PalFileSize(Stream->File, &Stream->Size))
+			return FC_ERROR_IO;
+
+		// A tight memory budget gets a smaller read window rather than a refusal.
+		Stream->Capacity = FC_EQUAL_READ_BYTES;
+		if (g_FcWork.Budget != 0 && Stream->Capacity > g_FcWork.Budget / 16)
+			Stream->Capacity = (g_FcWork.Budget / 16 > 4096) ? g_FcWork.Budget / 16 : 4096;
+		Stream->Window = (char*)_FC_WorkAlloc(0, Stream->Capacity);
+		if (Stream->Window == NULL)
+			return FC_ERROR_MEMORY;
+		Stream->Data = Stream->Window;
+
+		// Fill the first window completely (or up to end of file) so the BOM check
+		// and the empty-input check see the same bytes as a whole-file read.
+		while (Stream->Length < Stream->Capacity)
+		{
+			DWORD BytesRead = 0;
+			if (!_FC_PalRead(Stream->File, Stream->Window + Stream->Length,
+				(DWORD)(Stream->Capacity - Stream->Length), &BytesRead))
+				return FC_ERROR_IO;
+			if (BytesRead == 0)
+			{
+				Stream->Eof = TRUE;
+				break;
+			}
+			Stream->Length += (size_t)BytesRead;
+		}
+		FC_STATS* Stats = _FC_Stats();
+		if (Stats != NULL)
+			Stats->BytesRead += Stream->Length;
+		_FC_LineStreamSkipBom(Stream, Config);
+		return FC_OK;
+	}
+
+	static void
+		_FC_LineStreamClose(
+			_Inout_ _FC_LINE_STREAM* Stream)
+	{
+		if (Stream->File != _FC_INVALID_FILE)
+			_FC_PalClose(Stream->File);
+		_FC_WorkFree(Stream->Window);
+		_FC_BufferFree(&Stream->Carry);
+	}
+
+	/**
+	 * @brief Replaces the consumed window of a file stream with the next one.
+	 * @internal
+	 * @param[out] pGot Set to FALSE at end of input.
+	 */
+	static FC_RESULT
+		_FC_LineStreamRefill(
+			_Inout_ _FC_LINE_STREAM* Stream,
+			_Out_ BOOL* pGot)
+	{
+		DWORD BytesRead = 0;
+		*pGot = FALSE;
+		Stream->Consumed += Stream->Length;
+		Stream->Pos = 0;
+		Stream->Length = 0;
+		if (Stream->Eof)
+			return FC_OK;
+		LONGLONG TraceStart = _FC_TraceNow();
+		BOOL Read = _FC_PalRead(Stream->File, Stream->Window, (DWORD)Stream->Capacity, &BytesRead);
+		_FC_TraceSpan(_FC_TRACE_READ, TraceStart, BytesRead, 0);
+		if (!Read)
+			return FC_ERROR_IO;
+		if (BytesRead == 0)
+		{
+			Stream->Eof = TRUE;
+			return FC_OK;
+		}
+		Stream->Length = (size_t)BytesRead;
+		FC_STATS* Stats = _FC_Stats();
+		if (Stats != NULL)
+			Stats->BytesRead += BytesRead;
+		*pGot = TRUE;
+		return FC_OK;
+	}
+
+	/**
+	 * @brief Produces the next raw line of a stream.
+	 *
+	 * Lines end at runs of CR and LF. The first line of a non-empty input is produced
+	 * even when empty; a terminator run at the end of the input does not start a line.
+	 * @internal
+	 * @param[out] pLine Receives the line; valid until the next call.
+	 * @param[out] pLength Receives the line length in bytes.
+	 * @param[out] pHasLine Set to FALSE when the input has no more lines.
+	 */
+	static FC_RESULT
+		_FC_LineStreamNext(
+			_Inout_ _FC_LINE_STREAM* Stream,
+			_Out_ const char** pLine,
+			_Out_ size_t* pLength,
+			_Out_ BOOL* pHasLine)
+	{
+		FC_RESULT Result;
+		BOOL Got;
+		*pLine = "";
+		*pLength = 0;
+		*pHasLine = FALSE;
+
+		if (!Stream->Started)
+		{
+			Stream->Started = TRUE;
+			if (Stream->Pos == Stream->Length && Stream->Eof)
+				return FC_OK; // Empty input (or a lone BOM) has no lines.
+		}
+		else
+		{
+			// Skip the terminator run that ended the previous line.
+			for (;;)
+			{
+				if (Stream->Pos == Stream->Length)
+				{
+					Result = _FC_LineStreamRefill(Stream, &Got);
+					if (Result != FC_OK || !Got)
+						return Result;
+				}
+				char c = Stream->Data[Stream->Pos];
+				if (c != '\n' && c != '\r')
+					break;
+				Stream->Pos++;
+			}
+		}
+
+		Stream->Carry.Count = 0;
+		for (;;)
+		{
+			const char* Start = Stream->Data + Stream->Pos;
+			const char* Limit = Stream->Data + Stream->Length;
+			const char* Newline = Start;
+			while (Newline < Limit && *Newline != '\n' && *Newline != '\r')
+				Newline++;
+			Stream->Pos = (size_t)(Newline - Stream->Data);
+
+			if (Newline < Limit || Stream->Eof)
+			{
+				if (Stream->Carry.Count == 0)
+				{
+					*pLine = Start;
+					*pLength = (size_t)(Newline - Start);
+				}
+				else
+				{
+					if (!_FC_BufferAppendRange(&Stream->Carry, Start, (size_t)(Newline - Start)))
+						return FC_ERROR_MEMORY;
+					*pLine = (const char*)Stream->Carry.pData;
+					*pLength = Stream->Carry.Count;
+				}
+				*pHasLine = TRUE;
+				return FC_OK;
+			}
+
+			// The line continues in the next window.
+			if (!_FC_BufferAppendRange(&Stream->Carry, Start, (size_t)(Limit - Start)))
+				return FC_ERROR_MEMORY;
+			Result = _FC_LineStreamRefill(Stream, &Got);
+			if (Result != FC_OK)
+				return Result;
+		}
+	}
+
+	/**
+	 * @brief Produces the next line of a stream in normalized form, skipping lines that
+	 *        `_FC_ParseLines` would discard.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_LineStreamNextNormalized(
+			_Inout_ _FC_LINE_STREAM* Stream,
+			_In_ const FC_CONFIG* Config,
+			_Inout_ _FC_BUFFER* pOut,
+			_Inout_ _FC_BUFFER* pScratch,
+			_Out_ BOOL* pHasLine)
+	{
+		for (;;)
+		{
+			const char* Line;
+			size_t Length;
+			FC_RESULT Result = _FC_LineStreamNext(Stream, &Line, &Length, pHasLine);
+			if (Result != FC_OK || !*pHasLine)
+				return Result;
+			if (!_FC_NormalizeLine(Line, Length, Config->Flags, pOut, pScratch))
+				return FC_ERROR_MEMORY;
+			// Lines emptied by FC_IGNORE_WS are dropped.
+			if (!(Config->Flags & FC_IGNORE_WS) || pOut->Count > 0)
+				return FC_OK;
+		}
+	}
+	/**
+	 * @struct _FC_LINE_WINDOW
+	 * @brief The parsed lines of a line stream that a streamed comparison still needs.
+	 * @internal
+	 */
+	typedef struct
+	{
+		_FC_LINE_STREAM* Stream;    // Source of the lines.
+		_FC_BUFFER Lines;           // Owned _FC_LINE records, starting at line number Base.
+		size_t Base;                // Line number of the first entry in Lines.
+		BOOL Eof;                   // Stream has produced its last line.
+	} _FC_LINE_WINDOW;
+
+	/**
+	 * @brief Parses lines into a window until it reaches line number Until or its text ends.
+	 * @internal
+	 * @param HashConfig Config without FC_IGNORE_WS, as `_FC_ParseLineRange` hashes lines.
+	 * @param pOut Line buffer for `_FC_LineStreamNextNormalized`, with a capacity of at least 1.
+	 * @param pScratch Scratch buffer for `_FC_LineStreamNextNormalized`.
+	 * @return FC_OK, FC_ERROR_IO or FC_ERROR_MEMORY.
+	 */
+	static FC_RESULT
+		_FC_LineWindowFill(
+			_Inout_ _FC_LINE_WINDOW* Window,
+			_In_ size_t Until,
+			_In_ const FC_CONFIG* Config,
+			_In_ const FC_CONFIG* HashConfig,
+			_Inout_ _FC_BUFFER* pOut,
+			_Inout_ _FC_BUFFER* pScratch)
+	{
+		FC_RESULT Result = FC_OK;
+		FC_STATS* Stats = _FC_Stats();
+		_FC_STATS_PHASE OuterPhase = _FC_StatsPhase(_FC_STATS_PARSE);
+
+		while (!Window->Eof && Window->Base + Window->Lines.Count < Until)
+		{
+			BOOL HasLine;
+			Result = _FC_LineStreamNextNormalized(Window->Stream, Config, pOut, pScratch, &HasLine);
+			if (Result != FC_OK)
+				break;
+			if (!HasLine)
+			{
+				Window->Eof = TRUE;
+				break;
+			}
+
+			_FC_LINE Line;
+			Line.Text = pOut->Count <= _FC_MAX_LINE_LENGTH ? _FC_StringDuplicateRange((const char*)pOut->pData, pOut->Count) : NULL;
+			if (Line.Text == NULL)
+			{
+				Result = FC_ERROR_MEMORY;
+				break;
+			}
+			Line.Length = (UINT)pOut->Count;
+			if (Stats != NULL)
+				_FC_StatsPhase(_FC_STATS_HASH);
+			Line.Hash = _FC_HashLine(Line.Text, Line.Length, HashConfig);
+			if (Stats != NULL)
+			{
+				_FC_StatsPhase(_FC_STATS_PARSE);
+				Stats->LinesParsed++;
+			}
+
+			if (!_FC_BufferAppend(&Window->Lines, &Line))
+			{
+				_FC_WorkFree(Line.Text);
+				Result = FC_ERROR_MEMORY;
+				break;
+			}
+		}
+
+		_FC_StatsPhase(OuterPhase);
+		return Result;
+	}
+
+	/**
+	 * @brief Frees the lines of a window that come before line number Keep.
+	 * @internal
+	 */
+	static void
+		_FC_LineWindowDrop(
+			_Inout_ _FC_LINE_WINDOW* Window,
+			_In_ size_t Keep)
+	{
+		size_t Count = Keep - Window->Base;
+		for (size_t i = 0; i < Count; i++)
+			_FC_WorkFree(((_FC_LINE*)_FC_BufferGet(&Window->Lines, i))->Text);
+		_FC_BufferSplice(&Window->Lines, 0, Count, NULL, 0);
+		Window->Base = Keep;
+	}
+
+	/**
+	 * @brief Compares two line streams with the chunked LCS while holding only the lines
+	 *        of the current chunk.
+	 *
+	 * This is the strategy for texts whose line tables do not fit FC_CONFIG::MaxMemoryBytes.
+	 * Each side keeps a window of parsed lines from its cursor to one line past the chunk,
+	 * which `_FC_ProcessWindowChunk` needs to recognize a rewind, and lines are freed once
+	 * the cursor has passed them. Chunks are cut exactly as `_FC_CompareLineArrays` cuts
+	 * them, so the reported differences are the same; a chunk that does not fit the budget
+	 * is retried with fewer lines.
+	 * @internal
+	 * @param Path1 The path reported for the first text, or NULL.
+	 * @param Path2 The path reported for the second text, or NULL.
+	 * @param StreamA The open stream of the first text.
+	 * @param StreamB The open stream of the second text.
+	 * @param MaxBytes The size in bytes of the larger text, which sets the chunk size.
+	 * @param Config A pointer to the comparison configuration.
+	 * @return An FC_RESULT code indicating the outcome.
+	 */
+	static FC_RESULT
+		_FC_CompareTextStreams(
+			_In_opt_z_ const WCHAR* Path1,
+			_In_opt_z_ const WCHAR* Path2,
+			_Inout_ _FC_LINE_STREAM* StreamA,
+			_Inout_ _FC_LINE_STREAM* StreamB,
+			_In_ LONGLONG MaxBytes,
+			_In_ const FC_CONFIG* Config)
+	{
+		FC_RESULT Result = FC_OK;
+		_FC_LINE_WINDOW WindowA = { StreamA }, WindowB = { StreamB };
+		_FC_BUFFER Out, Scratch;
+		size_t ChunkLines = _FC_ComputeChunkSize(MaxBytes, Config->BufferLines);
+		size_t CurA = 0, CurB = 0;
+		BOOL AnyDiff = FALSE;
+
+		_FC_BufferInit(&WindowA.Lines, sizeof(_FC_LINE));
+		_FC_BufferInit(&WindowB.Lines, sizeof(_FC_LINE));
+		_FC_BufferInit(&Out, sizeof(char));
+		_FC_BufferInit(&Scratch, sizeof(char));
+
+		FC_CONFIG HashConfig = *Config;
+		HashConfig.Flags &= ~(UINT)FC_IGNORE_WS;
+
+		// Keep the line buffer allocated so empty lines never copy from a NULL text.
+		if (!_FC_BufferEnsureCapacity(&Out, 1))
+		{
+			Result = FC_ERROR_MEMORY;
+			goto cleanup;
+		}
+
+		for (;;)
+		{
+			Result = _FC_LineWindowFill(&WindowA, CurA + ChunkLines + 1, Config, &HashConfig, &Out, &Scratch);
+			if (Result == FC_OK)
+				Result = _FC_LineWindowFill(&WindowB, CurB + ChunkLines + 1, Config, &HashConfig, &Out, &Scratch);
+			if (Result == FC_ERROR_MEMORY && _FC_ShrinkChunkForBudget(&ChunkLines))
+				continue;
+			if (Result != FC_OK)
+				goto cleanup;
+			if (CurA == WindowA.Base + WindowA.Lines.Count && CurB == WindowB.Base + WindowB.Lines.Count)
+				break;
+
+			ULONGLONG Done = StreamA->Consumed + StreamA->Pos;
+			if (!_FC_ReportProgress(Config, FC_PHASE_TEXT_COMPARE, (Done < StreamA->Size) ? Done : StreamA->Size, StreamA->Size))
+			{
+				Result = FC_CANCELLED;
+				goto cleanup;
+			}
+
+			FC_RESULT ChunkResult = _FC_ProcessWindowChunk(Path1, Path2,
+				&WindowA.Lines, WindowA.Base, &WindowB.Lines, WindowB.Base,
+				ChunkLines, &CurA, &CurB, Config, NULL);
+			if (ChunkResult == FC_ERROR_MEMORY && _FC_ShrinkChunkForBudget(&ChunkLines))
+				continue;
+			if (ChunkResult == FC_ERROR_MEMORY || ChunkResult == FC_ERROR_IO)
+			{
+				Result = ChunkResult;
+				goto cleanup;
+			}
+			if (ChunkResult == FC_DIFFERENT)
+				AnyDiff = TRUE;
+
+			_FC_LineWindowDrop(&WindowA, CurA);
+			_FC_LineWindowDrop(&WindowB, CurB);
+		}
+
+		if (!_FC_ReportProgress(Config, FC_PHASE_TEXT_COMPARE, StreamA->Size, StreamA->Size))
+			Result = FC_CANCELLED;
+		else
+			Result = AnyDiff ? FC_DIFFERENT : FC_OK;
+
+	cleanup:
+		_FC_FreeLineBufferContents(&WindowA.Lines);
+		_FC_FreeLineBufferContents(&WindowB.Lines);
+		_FC_BufferFree(&Out);
+		_FC_BufferFree(&Scratch);
+		return Result;
+	}
+
+	/**
+	 * @brief Parses two in-memory texts into normalized line arrays with `_FC_ParseLines`.
+	 * @internal
+	 * @param[out] pBufferA Receives the lines of Buffer1; freed by the caller in every case.
+	 * @param[out] pBufferB Receives the lines of Buffer2; freed by the caller in every case.
+	 * @return FC_OK, FC_ERROR_MEMORY or FC_CANCELLED.
+	 */
+	static FC_RESULT
+		_FC_ParseTextPair(
+			_In_reads_(Length1) const char* Buffer1,
+			_In_ size_t Length1,
+			_In_reads_(Length2) const char* Buffer2,
+			_In_ size_t Length2,
+			_Inout_ _FC_BUFFER* pBufferA,
+			_Inout_ _FC_BUFFER* pBufferB,
+			_In_ const FC_CONFIG* Config)
+	{
+		ULONGLONG ParseTotal = (ULONGLONG)Length1 + (ULONGLONG)Length2;
+		if (!_FC_ReportProgress(Config, FC_PHASE_TEXT_PARSE, 0, ParseTotal))
+			return FC_CANCELLED;
+
+		FC_RESULT Result = _FC_ParseLines(Buffer1, Length1, pBufferA, Config);
+		if (Result != FC_OK)
+			return Result;
+		if (!_FC_ReportProgress(Config, FC_PHASE_TEXT_PARSE, Length1, ParseTotal))
+			return FC_CANCELLED;
+
+		Result = _FC_ParseLines(Buffer2, Length2, pBufferB, Config);
+		if (Result != FC_OK)
+			return Result;
+		if (!_FC_ReportProgress(Config, FC_PHASE_TEXT_PARSE, ParseTotal, ParseTotal))
+			return FC_CANCELLED;
+		return FC_OK;
+	}
+
+	/**
+	 * @brief Compares two in-memory texts line by line.
+	 *
+	 * Parses both buffers into normalized line arrays using `_FC_ParseLines` and
+	 * runs the chunked LCS over them with `_FC_CompareLineArrays`. The paths are only passed through to the
+	 * callback context and may be NULL for in-memory comparisons. If the line arrays
+	 * do not fit FC_CONFIG::MaxMemoryBytes, the texts are streamed with
+	 * `_FC_CompareTextStreams` instead.
+	 * @internal
+	 * @param Path1 The path reported for the first text, or NULL.
+	 * @param Path2 The path reported for the second text, or NULL.
+	 * @param Buffer1 The first text.
+	 * @param Length1 The length of the first text in bytes.
+	 * @param Buffer2 The second text.
+	 * @param Length2 The length of the second text in bytes.
+	 * @param Config A pointer to the comparison configuration.
+	 * @return An FC_RESULT code indicating the outcome.
+	 */
+	static FC_RESULT
+		_FC_CompareTextBuffers(
+			_In_opt_z_ const WCHAR* Path1,
+			_In_opt_z_ const WCHAR* Path2,
+			_In_reads_(Length1) const char* Buffer1,
+			_In_ size_t Length1,
+			_In_reads_(Length2) const char* Buffer2,
+			_In_ size_t Length2,
+			_In_ const FC_CONFIG* Config)
+	{
+		FC_RESULT Result = FC_OK;
+		_FC_BUFFER BufferA = { 0 }, BufferB = { 0 };
+		LONGLONG MaxBytes = (Length1 > Length2) ? (LONGLONG)Length1 : (LONGLONG)Length2;
+
+		// Initialize our generic buffers to hold _FC_LINE structs.
+		_FC_BufferInit(&BufferA, sizeof(_FC_LINE));
+		_FC_BufferInit(&BufferB, sizeof(_FC_LINE));
+		_FC_BufferPreferLargePages(&BufferA);
+		_FC_BufferPreferLargePages(&BufferB);
+
+		Result = _FC_ParseTextPair(Buffer1, Length1, Buffer2, Length2, &BufferA, &BufferB, Config);
+		BOOL Parsed = (Result == FC_OK);
+		if (Parsed)
+			Result = _FC_CompareLineArrays(Path1, Path2, &BufferA, &BufferB, MaxBytes, NULL, Config);
+
+		// Free the buffers and their nested content.
+		_FC_FreeLineBufferContents(&BufferA);
+		_FC_FreeLineBufferContents(&BufferB);
+
+		if (Result == FC_ERROR_MEMORY && !Parsed && _FC_StreamForBudget())
+		{
+			_FC_LINE_STREAM StreamA, StreamB;
+			_FC_LineStreamInitMemory(&StreamA, Buffer1, Length1, Config);
+			_FC_LineStreamInitMemory(&StreamB, Buffer2, Length2, Config);
+			Result = _FC_CompareTextStreams(Path1, Path2, &StreamA, &StreamB, MaxBytes, Config);
+			_FC_LineStreamClose(&StreamA);
+			_FC_LineStreamClose(&StreamB);
+		}
+		return Result;
+	}
+
+	/**
+	 * @brief Compares two files in text mode.
+	 *
+	 * Reads both files into memory and hands them to `_FC_CompareTextBuffers`. If the
+	 * contents or their line arrays do not fit FC_CONFIG::MaxMemoryBytes, the memory is
+	 * released and both files are streamed with `_FC_CompareTextStreams` instead.
+	 * @internal
+	 * @param Path1 The path to the first file.
+	 * @param Path2 The path to the second file.
+	 * @param Config A pointer to the comparison configuration.
+	 * @return An FC_RESULT code indicating the outcome.
+	 */
+	static FC_RESULT
+		_FC_CompareFilesText(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		FC_RESULT Result = FC_OK;
+		_FC_BUFFER Read1 = { 0 }, Read2 = { 0 };
+		_FC_BUFFER BufferA = { 0 }, BufferB = { 0 };
+		struct _FC_SESSION* Session = g_FcWork.Session;
+
+		// A session keeps its read buffers between comparisons.
+		_FC_BUFFER* pRead1 = (Session != NULL) ? &Session->Read1 : &Read1;
+		_FC_BUFFER* pRead2 = (Session != NULL) ? &Session->Read2 : &Read2;
+		_FC_BufferInit(&Read1, sizeof(char));
+		_FC_BufferInit(&Read2, sizeof(char));
+		_FC_BufferInit(&BufferA, sizeof(_FC_LINE));
+		_FC_BufferInit(&BufferB, sizeof(_FC_LINE));
+		_FC_BufferPreferLargePages(pRead1);
+		_FC_BufferPreferLargePages(pRead2);
+		_FC_BufferPreferLargePages(&BufferA);
+		_FC_BufferPreferLargePages(&BufferB);
+
+		Result = _FC_ReadFileIntoBuffer(Path1, pRead1);
+		if (Result == FC_OK)
+			Result = _FC_ReadFileIntoBuffer(Path2, pRead2);
+		if (Result == FC_OK)
+			Result = _FC_ParseTextPair((const char*)pRead1->pData, pRead1->Count,
+				(const char*)pRead2->pData, pRead2->Count, &BufferA, &BufferB, Config);
+
+		BOOL Parsed = (Result == FC_OK);
+		if (Parsed)
+		{
+			LONGLONG MaxBytes = (pRead1->Count > pRead2->Count) ? (LONGLONG)pRead1->Count : (LONGLONG)pRead2->Count;
+			Result = _FC_CompareLineArrays(Path1, Path2, &BufferA, &BufferB, MaxBytes, NULL, Config);
+		}
+		_FC_FreeLineBufferContents(&BufferA);
+		_FC_FreeLineBufferContents(&BufferB);
+
+		if (Result == FC_ERROR_MEMORY && !Parsed && _FC_StreamForBudget())
+		{
+			// Give the budget back before streaming; a session reallocates its buffers later.
+			_FC_BufferFree(pRead1);
+			_FC_BufferFree(pRead2);
+
+			ULONGLONG Size1 = 0, Size2 = 0;
+			_FC_LINE_STREAM StreamA, StreamB;
+			Result = _FC_LineStreamOpenFile(&StreamA, Path1, Config);
+			FC_RESULT ResultB = _FC_LineStreamOpenFile(&StreamB, Path2, Config);
+			if (Result == FC_OK)
+				Result = ResultB;
+			if (Result == FC_OK)
+			{
+				Size1 = StreamA.Size;
+				Size2 = StreamB.Size;
+				Result = _FC_CompareTextStreams(Path1, Path2, &StreamA, &StreamB,
+					(LONGLONG)((Size1 > Size2) ? Size1 : Size2), Config);
+			}
+			_FC_LineStreamClose(&StreamA);
+			_FC_LineStreamClose(&StreamB);
+		}
+
+		_FC_BufferFree(&Read1);
+		_FC_BufferFree(&Read2);
+		return Result;
+	}
+
+	/**
+	 * @brief Compares two files in binary mode.
+	 *
+	 * This function performs a byte-for-byte comparison of two files.
+	 * For smaller files it uses memory-mapped I/O for efficiency; for larger files it
+	 * switches to streamed micro-batches to avoid excessive cache and working-set pressure.
+	 * @internal
+	 * @param Path1 The path to the first file.
+	 * @param Path2 The path to the second file.
+	 * @param Config A pointer to the comparison configuration.
+	 * @return An FC_RESULT code indicating the outcome.
+	 */
+	static FC_RESULT
+		_FC_CompareFilesBinaryStreamed(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		_FC_FILE File1Handle = _FC_INVALID_FILE;
+		_FC_FILE File2Handle = _FC_INVALID_FILE;
+		unsigned char* Buffer1 = NULL;
+		unsigned char* Buffer2 = NULL;
+		FC_RESULT Result = FC_ERROR_IO;
+		size_t offset = 0;
+		struct _FC_SESSION* Session = g_FcWork.Session;
+		enum { FC_BINARY_STREAM_CHUNK = 1024 * 1024 };
+		FC_STATS* Stats = _FC_Stats();
+		_FC_STATS_PHASE OuterPhase = _FC_StatsPhase(_FC_STATS_READ);
+
+		File1Handle = _FC_PalOpenRead(Path1, TRUE);
+		File2Handle = _FC_PalOpenRead(Path2, TRUE);
+
+		if (File1Handle == _FC_INVALID_FILE || File2Handle == _FC_INVALID_FILE)
+			goto cleanup;
+
+		ULONGLONG File1Size, File2Size;
+		if (!_FC_PalFileSize(File1Handle, &File1Size) || !_FC_PalFileSize(File2Handle, &File2Size))
+			goto cleanup;
+
+		if (File1Size > (ULONGLONG)SIZE_MAX || File2Size > (ULONGLONG)SIZE_MAX)
+		{
+			goto cleanup;
+		}
+
+		if (Session != NULL)
+		{
+			// Session chunk buffers are allocated once and kept until FC_SessionClose.
+			if (Session->Chunk1 == NULL)
+				Session->Chunk1 = (unsigned char*)_FC_AllocFrom(Session->Heap, NULL, 0, FC_BINARY_STREAM_CHUNK);
+			if (Session->Chunk2 == NULL)
+				Session->Chunk2 = (unsigned char*)_FC_AllocFrom(Session->Heap, NULL, 0, FC_BINARY_STREAM_CHUNK);
+			Buffer1 = Session->Chunk1;
+			Buffer2 = Session->Chunk2;
+		}
+		else
+		{
+			Buffer1 = (unsigned char*)_FC_WorkAlloc(0, FC_BINARY_STREAM_CHUNK);
+			Buffer2 = (unsigned char*)_FC_WorkAlloc(0, FC_BINARY_STREAM_CHUNK);
+		}
+		if (Buffer1 == NULL || Buffer2 == NULL)
+		{
+			Result = FC_ERROR_MEMORY;
+			goto cleanup;
+		}
+
+		size_t CompareSize = (size_t)(File1Size < File2Size ? File1Size : File2Size);
+
+		Result = FC_OK;
+		while (offset < CompareSize)
+		{
+			if (!_FC_ReportProgress(Config, FC_PHASE_BINARY_COMPARE, offset, CompareSize))
+			{
+				Result = FC_CANCELLED;
+				goto cleanup;
+			}
+
+			size_t toRead = CompareSize - offset;
+			if (toRead > FC_BINARY_STREAM_CHUNK)
+				toRead = FC_BINARY_STREAM_CHUNK;
+
+			LONGLONG TraceStart = _FC_TraceNow();
+			size_t Mismatches = 0;
+			_FC_PROBE2(binary__chunk__start, offset, toRead);
+			// A short read means the file shrank below its advertised size.
+			if (!_FC_ReadFully(File1Handle, offset, Buffer1, toRead) ||
+				!_FC_ReadFully(File2Handle, offset, Buffer2, toRead))
+			{
+				Result = FC_ERROR_IO;
+				goto cleanup;
+			}
+
+			if (Stats != NULL)
+			{
+				Stats->BytesRead += 2 * (ULONGLONG)toRead;
+				_FC_StatsPhase(_FC_STATS_BINARY);
+			}
+			_FC_TraceSpan(_FC_TRACE_READ, TraceStart, 2 * (ULONGLONG)toRead, 0);
+			TraceStart = _FC_TraceNow();
+			for (size_t i = 0; i < toRead; ++i)
+			{
+				if (Buffer1[i] != Buffer2[i])
+				{
+					Mismatches++;
+					if (Result == FC_OK)
+						Result = FC_DIFFERENT;
+					if (Config->DiffCallback != NULL)
+						{
+							FC_DIFF_BLOCK block = { FC_DIFF_TYPE_CHANGE, offset + i, Buffer1[i], offset + i, Buffer2[i] };
+							FC_USER_CONTEXT BinContext = { Path1, Path2, NULL, NULL, Config->UserData };
+							_FC_StatsPhase(_FC_STATS_REPORT);
+							Config->DiffCallback(&BinContext, &block);
+							_FC_StatsPhase(_FC_STATS_BINARY);
+						}
+				}
+			}
+			_FC_TraceSpan(_FC_TRACE_BINARY, TraceStart, toRead, 0);
+			_FC_PROBE3(binary__chunk__done, offset, toRead, Mismatches);
+			if (Stats != NULL)
+				_FC_StatsPhase(_FC_STATS_READ);
+			offset += toRead;
+		}
+		if (!_FC_ReportProgress(Config, FC_PHASE_BINARY_COMPARE, CompareSize, CompareSize))
+		{
+			Result = FC_CANCELLED;
+			goto cleanup;
+		}
+
+		if (File1Size != File2Size)
+		{
+			Result = FC_DIFFERENT;
+			if (Config->DiffCallback != NULL)
+			{
+				FC_DIFF_BLOCK block = {
+					FC_DIFF_TYPE_SIZE,
+					(size_t)File1Size, (size_t)File1Size,
+					(size_t)File2Size, (size_t)File2Size };
+				FC_USER_CONTEXT BinContext = { Path1, Path2, NULL, NULL, Config->UserData };
+				_FC_StatsPhase(_FC_STATS_REPORT);
+				Config->DiffCallback(&BinContext, &block);
+			}
+		}
+
+	cleanup:
+		_FC_StatsPhase(OuterPhase);
+		if (Session == NULL)
+		{
+			_FC_WorkFree(Buffer1);
+			_FC_WorkFree(Buffer2);
+		}
+		if (File1Handle != _FC_INVALID_FILE) _FC_PalClose(File1Handle);
+		if (File2Handle != _FC_INVALID_FILE) _FC_PalClose(File2Handle);
+		return Result;
+	}
+
+	/**
+	 * @brief Compares two byte ranges and reports each mismatch and any size difference.
+	 *
+	 * Shared by the memory-mapped file path and the in-memory buffer API. Only the
+	 * common prefix (CompareSize bytes) is inspected; a size difference is reported
+	 * afterwards, matching ReactOS fc.exe behavior.
+	 * @internal
+	 * @param Path1 The path reported for the first input, or NULL.
+	 * @param Path2 The path reported for the second input, or NULL.
+	 * @param Buffer1 The first byte range (at least CompareSize bytes).
+	 * @param Buffer2 The second byte range (at least CompareSize bytes).
+	 * @param CompareSize The length of the common prefix.
+	 * @param Size1 The total size of the first input.
+	 * @param Size2 The total size of the second input.
+	 * @param Config A pointer to the comparison configuration.
+	 * @return FC_OK if identical, FC_DIFFERENT otherwise.
+	 */
+	static FC_RESULT
+		_FC_CompareBytes(
+			_In_opt_z_ const WCHAR* Path1,
+			_In_opt_z_ const WCHAR* Path2,
+			_In_reads_(CompareSize) const unsigned char* Buffer1,
+			_In_reads_(CompareSize) const unsigned char* Buffer2,
+			_In_ size_t CompareSize,
+			_In_ ULONGLONG Size1,
+			_In_ ULONGLONG Size2,
+			_In_ const FC_CONFIG* Config)
+	{
+		FC_RESULT Result = FC_OK;
+		LONGLONG TraceStart = _FC_TraceNow();
+		_FC_STATS_PHASE OuterPhase = _FC_StatsPhase(_FC_STATS_BINARY);
+		for (size_t Granule = 0; Granule < CompareSize; Granule += FC_PROGRESS_GRANULE_BYTES)
+		{
+			if (!_FC_ReportProgress(Config, FC_PHASE_BINARY_COMPARE, Granule, CompareSize))
+			{
+				_FC_StatsPhase(OuterPhase);
+				_FC_TraceSpan(_FC_TRACE_BINARY, TraceStart, Granule, 0);
+				return FC_CANCELLED;
+			}
+
+			size_t GranuleEnd = CompareSize - Granule > FC_PROGRESS_GRANULE_BYTES
+				? Granule + FC_PROGRESS_GRANULE_BYTES : CompareSize;
+			for (size_t i = Granule; i < GranuleEnd; ++i)
+			{
+				if (Buffer1[i] != Buffer2[i])
+				{
+					if (Result == FC_OK) Result = FC_DIFFERENT;
+					if (Config->DiffCallback != NULL)
+					{
+						FC_DIFF_BLOCK block = { FC_DIFF_TYPE_CHANGE, i, Buffer1[i], i, Buffer2[i] };
+						FC_USER_CONTEXT BinContext = { Path1, Path2, NULL, NULL, Config->UserData };
+						_FC_StatsPhase(_FC_STATS_REPORT);
+						Config->DiffCallback(&BinContext, &block);
+						_FC_StatsPhase(_FC_STATS_BINARY);
+					}
+				}
+			}
+		}
+		_FC_StatsPhase(OuterPhase);
+		_FC_TraceSpan(_FC_TRACE_BINARY, TraceStart, CompareSize, 0);
+		if (!_FC_ReportProgress(Config, FC_PHASE_BINARY_COMPARE, CompareSize, CompareSize))
+			return FC_CANCELLED;
+
+		// Report size difference after byte comparison (if applicable).
+		if (Size1 != Size2)
+		{
+			Result = FC_DIFFERENT;
+			if (Config->DiffCallback != NULL)
+			{
+				FC_DIFF_BLOCK block = { FC_DIFF_TYPE_SIZE, (size_t)Size1, (size_t)Size1, (size_t)Size2, (size_t)Size2 };
+				FC_USER_CONTEXT BinContext = { Path1, Path2, NULL, NULL, Config->UserData };
+				OuterPhase = _FC_StatsPhase(_FC_STATS_REPORT);
+				Config->DiffCallback(&BinContext, &block);
+				_FC_StatsPhase(OuterPhase);
+			}
+		}
+		return Result;
+	}
+
+	static FC_RESULT
+		_FC_CompareFilesBinary(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		_FC_FILE File1Handle = _FC_INVALID_FILE;
+		_FC_FILE File2Handle = _FC_INVALID_FILE;
+		const unsigned char* Buffer1 = NULL;
+		const unsigned char* Buffer2 = NULL;
+		size_t CompareSize = 0;
+		FC_RESULT Result = FC_ERROR_IO; // Default to error
+
+		File1Handle = _FC_PalOpenRead(Path1, FALSE);
+		File2Handle = _FC_PalOpenRead(Path2, FALSE);
+
+		if (File1Handle == _FC_INVALID_FILE || File2Handle == _FC_INVALID_FILE)
+		{
+			goto cleanup;
+		}
+
+		ULONGLONG File1Size, File2Size;
+		if (!_FC_PalFileSize(File1Handle, &File1Size) || !_FC_PalFileSize(File2Handle, &File2Size))
+		{
+			goto cleanup;
+		}
+
+		// Both empty: identical.
+		if (File1Size == 0 && File2Size == 0)
+		{
+			Result = FC_OK;
+			goto cleanup;
+		}
+
+		// For large files, prefer streaming reads to avoid heavy mapping/cache pressure.
+		{
+			ULONGLONG bigger = (File1Size > File2Size) ? File1Size : File2Size;
+			if (bigger >= _FC_GetEffectiveBinaryStreamThresholdBytes())
+			{
+				Result = _FC_CompareFilesBinaryStreamed(Path1, Path2, Config);
+				goto cleanup;
+			}
+		}
+
+		// Compare the common prefix of both files byte-by-byte first, matching
+		// ReactOS fc.exe behavior: byte mismatches are always reported, and a
+		// size-difference notification follows afterwards (not instead of).
+		ULONGLONG MinSize = File1Size < File2Size ? File1Size : File2Size;
+		// Guard against truncation on 32-bit builds where SIZE_MAX < INT64_MAX.
+		if (MinSize > (ULONGLONG)SIZE_MAX)
+		{
+			Result = FC_ERROR_IO;
+			goto cleanup;
+		}
+		CompareSize = (size_t)MinSize;
+
+		if (CompareSize > 0)
+		{
+			Buffer1 = (const unsigned char*)_FC_PalMapView(File1Handle, CompareSize);
+			Buffer2 = (const unsigned char*)_FC_PalMapView(File2Handle, CompareSize);
+
+			if (Buffer1 == NULL || Buffer2 == NULL)
+			{
+				Result = FC_ERROR_IO;
+				goto cleanup;
+			}
+		}
+
+		if (_FC_Stats() != NULL)
+			_FC_Stats()->BytesRead += 2 * (ULONGLONG)CompareSize;
+		Result = _FC_CompareBytes(Path1, Path2, Buffer1, Buffer2, CompareSize,
+			File1Size, File2Size, Config);
+
+	cleanup:
+		if (Buffer1) _FC_PalUnmapView(Buffer1, CompareSize);
+		if (Buffer2) _FC_PalUnmapView(Buffer2, CompareSize);
+		if (File1Handle != _FC_INVALID_FILE) _FC_PalClose(File1Handle);
+		if (File2Handle != _FC_INVALID_FILE) _FC_PalClose(File2Handle);
+		return Result;
+	}
+
+#ifdef _WIN32
+	/**
+	 * @brief Converts a Win32 path to a canonical NT path and validates it.
+	 *
+	 * This function uses the native `RtlDosPathNameToNtPathName_U_WithStatus` API to
+	 * resolve a DOS-style path into its underlying NT object manager path. It performs
+	 * security checks to reject dangerous paths, such as those pointing directly to
+	 * devices (`\\.\`, `\\?\`), reserved DOS device names (CON, PRN, etc.), or
+	 * Alternate Data Stream paths (e.g. `file.txt:stream`).
+	 * @internal
+	 * @param InputPath The Win32-style path to process.
+	 * @param[out] CanonicalPathOut A pointer to a WCHAR* that will receive the new, heap-allocated canonical path string. The caller must free this memory.
+	 * @return TRUE on success, FALSE if the path is invalid, dangerous, or a memory allocation fails.
+	 */
+	static BOOL
+		_FC_ToCanonicalPath(
+			_In_z_ const WCHAR* InputPath,
+			_Outptr_result_nullonfailure_ WCHAR** CanonicalPathOut)
+	{
+		if (!InputPath || !CanonicalPathOut)
+			return FALSE;
+
+		*CanonicalPathOut = NULL;
+
+		UNICODE_STRING NtPath = { 0 };
+		WCHAR* outPath = NULL;
+		BOOL ntPathInitialized = FALSE;
+		BOOL success = FALSE;
+
+		// Step 1: Check if input path type is acceptable
+		RTL_PATH_TYPE PathType = RtlDetermineDosPathNameType_U(InputPath);
+		if (PathType == RtlPathTypeUnknown ||
+			PathType == RtlPathTypeLocalDevice ||
+			PathType == RtlPathTypeRootLocalDevice)
+		{
+			goto cleanup; // reject raw \\.\ or \\?\ paths
+		}
+
+		// Step 2: Allow-list accepted path types (defence-in-depth: blocks any
+		// future RTL_PATH_TYPE values that may be added to the enum)
+		if (!(PathType == RtlPathTypeUncAbsolute ||
+			PathType == RtlPathTypeDriveAbsolute ||
+			PathType == RtlPathTypeDriveRelative ||
+			PathType == RtlPathTypeRooted ||
+			PathType == RtlPathTypeRelative))
+		{
+			goto cleanup;
+		}
+
+		// Step 3: Reject Alternate Data Stream (ADS) paths
+		// An ADS path embeds a colon after the filename, e.g. "C:\file.txt:stream".
+		// Skip the drive-letter colon at index 1 if present, then reject any further colon.
+		{
+			const WCHAR* scanStart = InputPath;
+			if (InputPath[0] != L'\0' &&
+				InputPath[1] != L'\0' &&
+				((InputPath[0] >= L'A' && InputPath[0] <= L'Z') ||
+				 (InputPath[0] >= L'a' && InputPath[0] <= L'z')) &&
+				InputPath[1] == L':')
+			{
+				scanStart = InputPath + 2;
+			}
+			if (wcschr(scanStart, L':') != NULL)
+			{
+				goto cleanup;
+			}
+		}
+
+		// Step 4: Convert to full NT path via native call
+		NTSTATUS Status = RtlDosPathNameToNtPathName_U_WithStatus(
+			InputPath,
+			&NtPath,
+			NULL, // FilePart not needed
+			NULL); // Reserved
+
+		if (!NT_SUCCESS(Status))
+		{
+			goto cleanup;
+		}
+		ntPathInitialized = TRUE;
+
+		// Step 5: Detect risky NT path prefixes
+		if (NtPath.Length >= 8 * sizeof(WCHAR))
+		{
+			const WCHAR* s = NtPath.Buffer;
+			// Block named pipes and raw device paths
+			if (_wcsnicmp(s, L"\\Device\\", 8) == 0 ||
+				_wcsnicmp(s, L"\\??\\PIPE\\", 9) == 0)
+			{
+				goto cleanup;
+			}
+		}
+
+		// Step 6: Reject reserved DOS device names
+		const WCHAR* base = wcsrchr(NtPath.Buffer, L'\\');
+		if (base == NULL)
+		{
+			// No backslash found, the whole path is the base component.
+			base = NtPath.Buffer;
+		}
+		else
+		{
+			// Move past the backslash to the start of the name.
+			base++;
+		}
+
+		for (int i = 0; i < _FC_ARRAYSIZE(g_ReservedDevices); ++i)
+		{
+			if (_wcsicmp(base, g_ReservedDevices[i]) == 0)
+			{
+				goto cleanup;
+			}
+		}
+
+		// Step 7: Allocate and copy canonical path
+		size_t len = (NtPath.Length / sizeof(WCHAR)) + 1;
+		outPath = (WCHAR*)_FC_WorkAlloc(0, len * sizeof(WCHAR));
+		if (!outPath)
+		{
+			goto cleanup;
+		}
+
+		errno_t err = wcsncpy_s(outPath, len, NtPath.Buffer, _TRUNCATE);
+		if (err != 0 || outPath[0] == L'\0')
+		{
+			goto cleanup;
+		}
+
+		// Step 8: Success - set output parameter
+		*CanonicalPathOut = outPath;
+		success = TRUE;
+
+	cleanup:
+		if (ntPathInitialized)
+		{
+			RtlFreeUnicodeString(&NtPath);
+		}
+		if (!success && outPath)
+		{
+			_FC_WorkFree(outPath);
+		}
+		return success;
+	}
+
+#else
+	/**
+	 * @brief Converts a POSIX path to an absolute, normalized path.
+	 *
+	 * Relative paths are resolved against the current directory, and empty, `.` and
+	 * `..` components are folded lexically, as the NT conversion folds them. Paths
+	 * that do not name a regular file (devices, pipes, directories) are refused when
+	 * the file is opened by `_FC_PalOpenRead`, which takes the place of the device
+	 * checks made here on Windows.
+	 * @internal
+	 * @param InputPath The path to process.
+	 * @param[out] CanonicalPathOut A pointer to a WCHAR* that will receive the new, heap-allocated canonical path string. The caller must free this memory.
+	 * @return TRUE on success, FALSE if the path is empty, the current directory is unavailable, or a memory allocation fails.
+	 */
+	static BOOL
+		_FC_ToCanonicalPath(
+			_In_z_ const WCHAR* InputPath,
+			_Outptr_result_nullonfailure_ WCHAR** CanonicalPathOut)
+	{
+		if (!InputPath || !CanonicalPathOut)
+			return FALSE;
+
+		*CanonicalPathOut = NULL;
+		if (InputPath[0] == L'\0')
+			return FALSE;
+
+		WCHAR* basePath = NULL;
+		WCHAR* outPath = NULL;
+		size_t baseLength = 0;
+		BOOL success = FALSE;
+
+		// Step 1: A relative path starts from the current directory.
+		if (InputPath[0] != L'/')
+		{
+			char cwd[PATH_MAX];
+			if (getcwd(cwd, sizeof(cwd)) == NULL)
+				goto cleanup;
+			int count = _FC_PalUtf8ToWide(cwd, -1, NULL, 0, TRUE);
+			if (count <= 0)
+				goto cleanup;
+			basePath = (WCHAR*)_FC_WorkAlloc(0, (size_t)count * sizeof(WCHAR));
+			if (!basePath || _FC_PalUtf8ToWide(cwd, -1, basePath, count, TRUE) != count)
+				goto cleanup;
+			baseLength = (size_t)count - 1;
+		}
+
+		// Step 2: Copy the components, folding "." and "..". Every component adds a
+		// separator and its name, so the output never exceeds both inputs plus two.
+		size_t inputLength = wcslen(InputPath);
+		if (inputLength > SIZE_MAX / sizeof(WCHAR) - baseLength - 2)
+			goto cleanup;
+		outPath = (WCHAR*)_FC_WorkAlloc(0, (baseLength + inputLength + 2) * sizeof(WCHAR));
+		if (!outPath)
+			goto cleanup;
+
+		size_t outLength = 0;
+		const WCHAR* parts[2] = { basePath ? basePath : L"", InputPath };
+		for (int p = 0; p < 2; ++p)
+		{
+			const WCHAR* c = parts[p];
+			for (;;)
+			{
+				while (*c == L'/')
+					c++;
+				if (*c == L'\0')
+					break;
+				const WCHAR* end = c;
+				while (*end != L'\0' && *end != L'/')
+					end++;
+				size_t n = (size_t)(end - c);
+				if (n == 2 && c[0] == L'.' && c[1] == L'.')
+				{
+					while (outLength > 0 && outPath[outLength - 1] != L'/')
+						outLength--;
+					if (outLength > 0)
+						outLength--;
+				}
+				else if (!(n == 1 && c[0] == L'.'))
+				{
+					outPath[outLength++] = L'/';
+					memcpy(outPath + outLength, c, n * sizeof(WCHAR));
+					outLength += n;
+				}
+				c = end;
+			}
+		}
+		if (outLength == 0)
+			outPath[outLength++] = L'/';
+		outPath[outLength] = L'\0';
+
+		// Step 3: Success - set output parameter
+		*CanonicalPathOut = outPath;
+		success = TRUE;
+
+	cleanup:
+		_FC_WorkFree(basePath);
+		if (!success && outPath)
+		{
+			_FC_WorkFree(outPath);
+		}
+		return success;
+	}
+#endif
+
+	/**
+	 * @brief Status values for UTF-8 to wide-path conversion.
+	 * @internal
+	 */
+	typedef enum _FC_UTF8_TO_WIDE_STATUS
+	{
+		FC_UTF8_TO_WIDE_OK = 0,
+		FC_UTF8_TO_WIDE_INVALID_PARAM,
+		FC_UTF8_TO_WIDE_INVALID_UTF8,
+		FC_UTF8_TO_WIDE_OUT_OF_MEMORY,
+	} _FC_UTF8_TO_WIDE_STATUS;
+
+	/**
+	 * @brief Converts a UTF-8 encoded string to a new wide (UTF-16) string.
+	 * @internal
+	 * @param Utf8String The null-terminated UTF-8 string to convert.
+	 * @param WideStringOut Receives a new heap-allocated wide string on success.
+	 * @return A status code describing success or failure.
+	 */
+	static _FC_UTF8_TO_WIDE_STATUS
+		_FC_ConvertUtf8ToWide(
+			_In_z_ const char* Utf8String,
+			_Outptr_result_z_ WCHAR** WideStringOut)
+	{
+		if (WideStringOut == NULL || Utf8String == NULL)
+			return FC_UTF8_TO_WIDE_INVALID_PARAM;
+
+		*WideStringOut = NULL;
+
+		int wideLength = _FC_PalUtf8ToWide(Utf8String, -1, NULL, 0, TRUE);
+		if (wideLength == 0)
+			return FC_UTF8_TO_WIDE_INVALID_UTF8;
+
+		WCHAR* wideBuffer = (WCHAR*)_FC_WorkAlloc(0, (size_t)wideLength * sizeof(WCHAR));
+		if (wideBuffer == NULL)
+			return FC_UTF8_TO_WIDE_OUT_OF_MEMORY;
+
+		if (_FC_PalUtf8ToWide(Utf8String, -1, wideBuffer, wideLength, TRUE) == 0)
+		{
+			_FC_WorkFree(wideBuffer);
+			return FC_UTF8_TO_WIDE_INVALID_UTF8;
+		}
+
+		*WideStringOut = wideBuffer;
+		return FC_UTF8_TO_WIDE_OK;
+	}
+
+	/**
+	 * @brief Returns TRUE if a path has a classic binary-extension used by fc.exe docs.
+	 * @internal
+	 */
+	static inline BOOL
+		_FC_HasBinaryExtension(_In_z_ const WCHAR* Path)
+	{
+		if (Path == NULL)
+			return FALSE;
+
+		const WCHAR* Dot = wcsrchr(Path, L'.');
+		if (Dot == NULL || Dot[1] == L'\0')
+			return FALSE;
+
+		return (_FC_PalCompareNoCaseW(Dot, L".exe") == 0 ||
+			_FC_PalCompareNoCaseW(Dot, L".com") == 0 ||
+			_FC_PalCompareNoCaseW(Dot, L".sys") == 0 ||
+			_FC_PalCompareNoCaseW(Dot, L".obj") == 0 ||
+			_FC_PalCompareNoCaseW(Dot, L".lib") == 0 ||
+			_FC_PalCompareNoCaseW(Dot, L".bin") == 0);
+	}
+
+	/**
+	 * @brief Decides whether a file pair is compared as text or as binary.
+	 *
+	 * Text modes use the line comparison unless a file exceeds the text size limit.
+	 * For `FC_MODE_AUTO`, classic fc.exe-style binary-extension rules apply first,
+	 * then `_FC_IsProbablyTextFileW` content detection.
+	 * @internal
+	 * @param Path1 The canonical path to the first file.
+	 * @param Path2 The canonical path to the second file.
+	 * @param Config A pointer to the comparison configuration.
+	 * @return TRUE for a text comparison, FALSE for a binary one.
+	 */
+	static inline BOOL
+		_FC_ShouldCompareAsText(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		switch (Config->Mode)
+		{
+		case FC_MODE_TEXT_ASCII:
+		case FC_MODE_TEXT_UNICODE:
+			// Avoid OOM-prone full-buffer text parsing for very large files.
+			return !_FC_ShouldUseBinaryForLargeText(Path1, Path2, Config);
+
+		case FC_MODE_BINARY:
+			return FALSE;
+
+		case FC_MODE_AUTO:
+		default:
+			// NOTE: AUTO mode is intentionally modernized to blend classic extension
+			// heuristics with content sniffing (extension check first, then detection).
+			// See README "Documented Differences from Windows fc.exe".
+			if (_FC_HasBinaryExtension(Path1) || _FC_HasBinaryExtension(Path2))
+				return FALSE;
+
+			// Otherwise, fall back to content-based detection.
+			if (!_FC_IsProbablyTextFileW(Path1) || !_FC_IsProbablyTextFileW(Path2))
+				return FALSE;
+			return !_FC_ShouldUseBinaryForLargeText(Path1, Path2, Config);
+		}
+	}
+
+	/**
+	 * @brief The internal core comparison dispatcher.
+	 *
+	 * This function selects the appropriate comparison strategy (text or binary)
+	 * with `_FC_ShouldCompareAsText`.
+	 * @internal
+	 * @param Path1 The canonical path to the first file.
+	 * @param Path2 The canonical path to the second file.
+	 * @param Config A pointer to the comparison configuration.
+	 * @return An FC_RESULT code indicating the outcome.
+	 */
+	static inline FC_RESULT
+		_FC_CompareFilesInternal(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		if (_FC_ShouldCompareAsText(Path1, Path2, Config))
+			return _FC_CompareFilesText(Path1, Path2, Config);
+		return _FC_CompareFilesBinary(Path1, Path2, Config);
+	}
+
+	/* -------------------- Trace Events -------------------- */
+
+	//
+	// A trace file receives one event per phase of each comparison in the Chrome
+	// trace-event JSON format, which chrome://tracing and the Perfetto UI load
+	// directly. Every event carries FC_CONFIG::TracePair and the thread ID.
+	// Spans cover opening (path checks), sniffing, reading, parsing, each LCS
+	// chunk, each text diff callback, byte comparison and the whole pair; a rewind
+	// is an instant event. Byte mismatches in binary mode are not traced one by one.
+	//
+	// Each thread collects events in its own buffer and takes the trace lock only
+	// to write a full buffer, so one handle can serve a whole thread pool. The
+	// remaining events are written by FC_TraceClose.
+	//
+
+	/**
+	 * @brief Creates (or truncates) a trace-event file.
+	 *
+	 * Attach the handle to `FC_CONFIG::Trace` to record comparisons into it; one
+	 * handle may be shared by concurrent comparisons on several threads.
+	 *
+	 * @param Path A null-terminated, wide (UTF-16) encoded path to the trace file.
+	 * @param[out] TraceOut Receives the new trace handle.
+	 *
+	 * @return An FC_RESULT code indicating the outcome.
+	 * @retval FC_OK on success.
+	 * @retval FC_ERROR_INVALID_PARAM if a required pointer is NULL or the path is empty.
+	 * @retval FC_ERROR_IO if the file cannot be created.
+	 * @retval FC_ERROR_MEMORY if a memory allocation fails.
+	 */
+	FC_RESULT
+		FC_TraceOpenW(
+			_In_z_ const WCHAR* Path,
+			_Outptr_result_maybenull_ FC_TRACE** TraceOut)
+	{
+		if (TraceOut == NULL)
+			return FC_ERROR_INVALID_PARAM;
+		*TraceOut = NULL;
+		if (Path == NULL || Path[0] == L'\0')
+			return FC_ERROR_INVALID_PARAM;
+
+		LONGLONG Frequency = _FC_PalCounterFrequency();
+		if (Frequency <= 0)
+			return FC_ERROR_IO;
+
+		FC_TRACE* Trace = (FC_TRACE*)_FC_PalAlloc(_FC_PalProcessHeap(), _FC_ALLOC_ZERO, sizeof(FC_TRACE));
+		if (Trace == NULL)
+			return FC_ERROR_MEMORY;
+
+		Trace->File = _FC_PalCreateFile(Path, TRUE);
+		if (Trace->File == _FC_INVALID_FILE)
+		{
+			_FC_HeapFree(Trace);
+			return FC_ERROR_IO;
+		}
+
+		_FC_PalLockInit(&Trace->Lock);
+		Trace->Id = _FC_PalIncrement64(&g_FcTraceNextId);
+		Trace->Origin = _FC_PalCounter();
+		Trace->Frequency = Frequency;
+		Trace->ProcessId = _FC_PalProcessId();
+
+		static const char Header[] = "{\"traceEvents\":[\n";
+		_FC_TraceWriteLocked(Trace, Header, sizeof(Header) - 1);
+		if (Trace->Failed)
+		{
+			_FC_PalClose(Trace->File);
+			_FC_PalLockDelete(&Trace->Lock);
+			_FC_HeapFree(Trace);
+			return FC_ERROR_IO;
+		}
+
+		*TraceOut = Trace;
+		return FC_OK;
+	}
+
+	/**
+	 * @brief Writes the buffered events of all threads, completes the file and releases the handle.
+	 *
+	 * No comparison may be using the trace when this is called. The handle is
+	 * freed even if writing fails.
+	 *
+	 * @param Trace The trace handle from `FC_TraceOpenW`; NULL is ignored.
+	 * @return FC_OK on success, or FC_ERROR_IO if an event could not be written or buffered.
+	 */
+	FC_RESULT
+		FC_TraceClose(
+			_In_opt_ FC_TRACE* Trace)
+	{
+		if (Trace == NULL)
+			return FC_OK;
+
+		_FC_PalLockExclusive(&Trace->Lock);
+		_FC_TRACE_BUFFER* Buffer = Trace->Buffers;
+		while (Buffer != NULL)
+		{
+			_FC_TRACE_BUFFER* Next = Buffer->Next;
+			_FC_TraceFlushLocked(Trace, Buffer);
+			_FC_HeapFree(Buffer);
+			Buffer = Next;
+		}
+		Trace->Buffers = NULL;
+
+		static const char Footer[] = "\n],\"displayTimeUnit\":\"ms\"}\n";
+		_FC_TraceWriteLocked(Trace, Footer, sizeof(Footer) - 1);
+		_FC_PalUnlockExclusive(&Trace->Lock);
+
+		FC_RESULT Result = Trace->Failed ? FC_ERROR_IO : FC_OK;
+		if (!_FC_PalClose(Trace->File))
+			Result = FC_ERROR_IO;
+		_FC_PalLockDelete(&Trace->Lock);
+		_FC_HeapFree(Trace);
+		return Result;
+	}
+
+	/* -------------------- Persistent Comparison Cache -------------------- */
+
+	//
+	// The cache remembers, per canonical path, the file's size, last-write and
+	// change times, volume serial number and file ID together with a SHA-256
+	// digest of its content, and, per (digest, digest, configuration) triple, the
+	// result of a completed comparison. A file record is only trusted while all
+	// five metadata fields still match; any change sends the file back through a
+	// full read. The change time matters because the last-write time can be reset
+	// by user code (touch -r, utime, SetFileTime) after a same-size rewrite.
+	//
+	// Only FC_OK is answered from the cache: an FC_DIFFERENT result is always
+	// recomputed, because the caller's DiffCallback must still see every block.
+	//
+
+#define _FC_CACHE_DIGEST_BYTES 32
+#define _FC_CACHE_MAGIC "FCCACHE1"
+#define _FC_CACHE_VERSION 2u
+
+	/**
+	 * @struct _FC_SHA256
+	 * @brief Streaming SHA-256 state used for cache content digests.
+	 * @internal
+	 */
+	typedef struct {
+		DWORD State[8];       /**< Intermediate hash value H0..H7. */
+		ULONGLONG BitCount;   /**< Total number of message bits processed. */
+		BYTE Block[64];       /**< Pending partial block. */
+		size_t BlockUsed;     /**< Number of valid bytes in Block. */
+	} _FC_SHA256;
+
+	static const DWORD g_FcSha256K[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+#define _FC_ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+	/**
+	 * @brief Processes one 64-byte block into the SHA-256 state.
+	 * @internal
+	 */
+	static void
+		_FC_Sha256Transform(
+			_Inout_ _FC_SHA256* Sha,
+			_In_reads_(64) const BYTE* Block)
+	{
+		DWORD W[64];
+		for (int i = 0; i < 16; i++)
+		{
+			W[i] = ((DWORD)Block[i * 4] << 24) | ((DWORD)Block[i * 4 + 1] << 16) |
+				((DWORD)Block[i * 4 + 2] << 8) | (DWORD)Block[i * 4 + 3];
+		}
+		for (int i = 16; i < 64; i++)
+		{
+			DWORD s0 = _FC_ROTR32(W[i - 15], 7) ^ _FC_ROTR32(W[i - 15], 18) ^ (W[i - 15] >> 3);
+			DWORD s1 = _FC_ROTR32(W[i - 2], 17) ^ _FC_ROTR32(W[i - 2], 19) ^ (W[i - 2] >> 10);
+			W[i] = W[i - 16] + s0 + W[i - 7] + s1;
+		}
+
+		DWORD a = Sha->State[0], b = Sha->State[1], c = Sha->State[2], d = Sha->State[3];
+		DWORD e = Sha->State[4], f = Sha->State[5], g = Sha->State[6], h = Sha->State[7];
+		for (int i = 0; i < 64; i++)
+		{
+			DWORD S1 = _FC_ROTR32(e, 6) ^ _FC_ROTR32(e, 11) ^ _FC_ROTR32(e, 25);
+			DWORD ch = (e & f) ^ (~e & g);
+			DWORD t1 = h + S1 + ch + g_FcSha256K[i] + W[i];
+			DWORD S0 = _FC_ROTR32(a, 2) ^ _FC_ROTR32(a, 13) ^ _FC_ROTR32(a, 22);
+			DWORD maj = (a & b) ^ (a & c) ^ (b & c);
+			DWORD t2 = S0 + maj;
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		Sha->State[0] += a; Sha->State[1] += b; Sha->State[2] += c; Sha->State[3] += d;
+		Sha->State[4] += e; Sha->State[5] += f; Sha->State[6] += g; Sha->State[7] += h;
+	}
+
+#undef _FC_ROTR32
+
+	static void
+		_FC_Sha256Init(
+			_Out_ _FC_SHA256* Sha)
+	{
+		static const DWORD Initial[8] = {
+			0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+		};
+		memcpy(Sha->State, Initial, sizeof(Initial));
+		Sha->BitCount = 0;
+		Sha->BlockUsed = 0;
+	}
+
+	static void
+		_FC_Sha256Update(
+			_Inout_ _FC_SHA256* Sha,
+			_In_reads_(Length) const BYTE* Data,
+			_In_ size_t Length)
+	{
+		Sha->BitCount += (ULONGLONG)Length * 8;
+		while (Length > 0)
+		{
+			if (Sha->BlockUsed == 0 && Length >= 64)
+			{
+				_FC_Sha256Transform(Sha, Data);
+				Data += 64;
+				Length -= 64;
+				continue;
+			}
+			size_t Take = 64 - Sha->BlockUsed;
+			if (Take > Length)
+				Take = Length;
+			memcpy(Sha->Block + Sha->BlockUsed, Data, Take);
+			Sha->BlockUsed += Take;
+			Data += Take;
+			Length -= Take;
+			if (Sha->BlockUsed == 64)
+			{
+				_FC_Sha256Transform(Sha, Sha->Block);
+				Sha->BlockUsed = 0;
+			}
+		}
+	}
+
+	static void
+		_FC_Sha256Final(
+			_Inout_ _FC_SHA256* Sha,
+			_Out_writes_(_FC_CACHE_DIGEST_BYTES) BYTE* Digest)
+	{
+		ULONGLONG BitCount = Sha->BitCount;
+		BYTE Pad = 0x80;
+		_FC_Sha256Update(Sha, &Pad, 1);
+		Pad = 0;
+		while (Sha->BlockUsed != 56)
+			_FC_Sha256Update(Sha, &Pad, 1);
+		BYTE Length[8];
+		for (int i = 0; i < 8; i++)
+			Length[i] = (BYTE)(BitCount >> (56 - i * 8));
+		_FC_Sha256Update(Sha, Length, 8);
+		for (int i = 0; i < 8; i++)
+		{
+			Digest[i * 4] = (BYTE)(Sha->State[i] >> 24);
+			Digest[i * 4 + 1] = (BYTE)(Sha->State[i] >> 16);
+			Digest[i * 4 + 2] = (BYTE)(Sha->State[i] >> 8);
+			Digest[i * 4 + 3] = (BYTE)Sha->State[i];
+		}
+	}
+
+	/**
+	 * @brief 64-bit FNV-1a, used for index keys and the on-disk checksum.
+	 * @internal
+	 */
+	static inline ULONGLONG
+		_FC_Fnv1a64(
+			_In_ ULONGLONG Hash,
+			_In_reads_bytes_(Length) const void* Data,
+			_In_ size_t Length)
+	{
+		const BYTE* Bytes = (const BYTE*)Data;
+		for (size_t i = 0; i < Length; i++)
+		{
+			Hash ^= Bytes[i];
+			Hash *= 0x100000001b3ull;
+		}
+		return Hash;
+	}
+
+#define _FC_FNV64_OFFSET 0xcbf29ce484222325ull
+
+	/**
+	 * @struct _FC_CACHE_FILE_META
+	 * @brief The metadata that must be unchanged for a cached digest to be trusted.
+	 * @internal
+	 */
+	typedef struct {
+		ULONGLONG Size;
+		ULONGLONG LastWriteTime;  /**< FILETIME as a 64-bit count of 100 ns intervals. */
+		ULONGLONG ChangeTime;     /**< Last status change (ctime), in the same units. */
+		ULONGLONG FileId;         /**< nFileIndexHigh:nFileIndexLow. */
+		DWORD VolumeSerial;
+	} _FC_CACHE_FILE_META;
+
+	/**
+	 * @struct _FC_CACHE_FILE
+	 * @brief A cached per-file record.
+	 * @internal
+	 */
+	typedef struct {
+		ULONGLONG Key;                         /**< FNV-1a of the path; must stay first (see _FC_CACHE_INDEX). */
+		WCHAR* Path;                           /**< Canonical path, heap-allocated. */
+		_FC_CACHE_FILE_META Meta;
+		BYTE Digest[_FC_CACHE_DIGEST_BYTES];   /**< SHA-256 of the file content. */
+		ULONGLONG LastUsed;                    /**< Cache clock value of the last lookup or store. */
+	} _FC_CACHE_FILE;
+
+	/**
+	 * @struct _FC_CACHE_PAIR
+	 * @brief A cached comparison result for two contents under one configuration.
+	 * @internal
+	 */
+	typedef struct {
+		ULONGLONG Key;                         /**< FNV-1a of both digests and ConfigKey; must stay first. */
+		BYTE Digest1[_FC_CACHE_DIGEST_BYTES];
+		BYTE Digest2[_FC_CACHE_DIGEST_BYTES];
+		ULONGLONG ConfigKey;                   /**< Fingerprint of the result-affecting FC_CONFIG fields. */
+		FC_RESULT Result;                      /**< FC_OK or FC_DIFFERENT. */
+		ULONGLONG LastUsed;
+	} _FC_CACHE_PAIR;
+
+	/**
+	 * @struct _FC_CACHE_INDEX
+	 * @brief Chained hash index over a buffer of records whose first member is a ULONGLONG key.
+	 * @internal
+	 */
+	typedef struct {
+		size_t* Heads;       /**< First record index per bucket; SIZE_MAX = empty. */
+		size_t* Next;        /**< Next record index in the same bucket, per record. */
+		size_t NumBuckets;   /**< Power of two. */
+		size_t Capacity;     /**< Number of records Next can describe. */
+	} _FC_CACHE_INDEX;
+
+	struct _FC_CACHE {
+		_FC_LOCK Lock;              /**< Guards every field below; never held across file I/O on compared files. */
+		WCHAR* Path;                /**< Location of the cache file. */
+		ULONGLONG MaxBytes;         /**< Upper bound on the size of the saved cache file. */
+		ULONGLONG Clock;            /**< Monotonic use counter driving LRU eviction. */
+		_FC_BUFFER Files;           /**< _FC_CACHE_FILE records. */
+		_FC_BUFFER Pairs;           /**< _FC_CACHE_PAIR records. */
+		_FC_CACHE_INDEX FileIndex;
+		_FC_CACHE_INDEX PairIndex;
+		BOOL Dirty;                 /**< TRUE when the in-memory state differs from the file. */
+		ULONGLONG Hits;             /**< Comparisons answered without reading content. */
+		ULONGLONG Misses;           /**< Comparisons that had to read content. */
+	};
+
+	static void
+		_FC_CacheIndexFree(
+			_Inout_ _FC_CACHE_INDEX* Index)
+	{
+		_FC_HeapFree(Index->Heads);
+		_FC_HeapFree(Index->Next);
+		memset(Index, 0, sizeof(*Index));
+	}
+
+	/**
+	 * @brief Rebuilds an index from scratch, sized for twice the current record count.
+	 * @internal
+	 * @return TRUE on success, FALSE on allocation failure (the old index is kept).
+	 */
+	static BOOL
+		_FC_CacheIndexRebuild(
+			_Inout_ _FC_CACHE_INDEX* Index,
+			_In_ const _FC_BUFFER* Records)
+	{
+		size_t Capacity = Records->Count > 32 ? Records->Count * 2 : 64;
+		size_t NumBuckets = 64;
+		while (NumBuckets < Capacity && NumBuckets <= SIZE_MAX / 2)
+			NumBuckets *= 2;
+		if (Capacity > SIZE_MAX / sizeof(size_t) || NumBuckets > SIZE_MAX / sizeof(size_t))
+			return FALSE;
+
+		size_t* Heads = (size_t*)_FC_PalAlloc(_FC_PalProcessHeap(), 0, NumBuckets * sizeof(size_t));
+		size_t* Next = (size_t*)_FC_PalAlloc(_FC_PalProcessHeap(), 0, Capacity * sizeof(size_t));
+		if (Heads == NULL || Next == NULL)
+		{
+			_FC_HeapFree(Heads);
+			_FC_HeapFree(Next);
+			return FALSE;
+		}
+		memset(Heads, 0xFF, NumBuckets * sizeof(size_t));
+
+		for (size_t i = 0; i < Records->Count; i++)
+		{
+			ULONGLONG Key = *(const ULONGLONG*)_FC_BufferGet(Records, i);
+			size_t Bucket = (size_t)(Key & (NumBuckets - 1));
+			Next[i] = Heads[Bucket];
+			Heads[Bucket] = i;
+		}
+
+		_FC_CacheIndexFree(Index);
+		Index->Heads = Heads;
+		Index->Next = Next;
+		Index->NumBuckets = NumBuckets;
+		Index->Capacity = Capacity;
+		return TRUE;
+	}
+
+	/**
+	 * @brief Links the most recently appended record into the index.
+	 * @internal
+	 */
+	static BOOL
+		_FC_CacheIndexAdd(
+			_Inout_ _FC_CACHE_INDEX* Index,
+			_In_ const _FC_BUFFER* Records)
+	{
+		size_t RecordIndex = Records->Count - 1;
+		if (Index->Heads == NULL || RecordIndex >= Index->Capacity)
+			return _FC_CacheIndexRebuild(Index, Records);
+
+		ULONGLONG Key = *(const ULONGLONG*)_FC_BufferGet(Records, RecordIndex);
+		size_t Bucket = (size_t)(Key & (Index->NumBuckets - 1));
+		Index->Next[RecordIndex] = Index->Heads[Bucket];
+		Index->Heads[Bucket] = RecordIndex;
+		return TRUE;
+	}
+
+	static inline size_t
+		_FC_CacheIndexFirst(
+			_In_ const _FC_CACHE_INDEX* Index,
+			_In_ ULONGLONG Key)
+	{
+		if (Index->Heads == NULL)
+			return SIZE_MAX;
+		return Index->Heads[(size_t)(Key & (Index->NumBuckets - 1))];
+	}
+
+	static inline ULONGLONG
+		_FC_CachePathKey(
+			_In_z_ const WCHAR* Path)
+	{
+		return _FC_Fnv1a64(_FC_FNV64_OFFSET, Path, wcslen(Path) * sizeof(WCHAR));
+	}
+
+	static inline ULONGLONG
+		_FC_CachePairKey(
+			_In_reads_(_FC_CACHE_DIGEST_BYTES) const BYTE* Digest1,
+			_In_reads_(_FC_CACHE_DIGEST_BYTES) const BYTE* Digest2,
+			_In_ ULONGLONG ConfigKey)
+	{
+		ULONGLONG Hash = _FC_Fnv1a64(_FC_FNV64_OFFSET, Digest1, _FC_CACHE_DIGEST_BYTES);
+		Hash = _FC_Fnv1a64(Hash, Digest2, _FC_CACHE_DIGEST_BYTES);
+		return _FC_Fnv1a64(Hash, &ConfigKey, sizeof(ConfigKey));
+	}
+
+	/**
+	 * @brief Fingerprints the FC_CONFIG fields that can change a comparison result.
+	 *
+	 * Output-only flags (/N, /A) and FC_LARGE_PAGES are excluded so that they share
+	 * cached results.
+	 * @internal
+	 */
+	static inline ULONGLONG
+		_FC_CacheConfigKey(
+			_In_ const FC_CONFIG* Config)
+	{
+		ULONGLONG Fields[5];
+		Fields[0] = (ULONGLONG)Config->Mode;
+		Fields[1] = (ULONGLONG)(Config->Flags & ~(UINT)(FC_SHOW_LINE_NUMS | FC_ABBREVIATED | FC_LARGE_PAGES));
+		Fields[2] = (ULONGLONG)Config->ResyncLines;
+		Fields[3] = (ULONGLONG)Config->BufferLines;
+		Fields[4] = _FC_GetEffectiveTextLimitBytes(Config);
+		return _FC_Fnv1a64(_FC_FNV64_OFFSET, Fields, sizeof(Fields));
+	}
+
+	static inline ULONGLONG
+		_FC_GetEffectiveCacheRacyWindow(void)
+	{
+#if defined(FC_TESTING)
+		ULONGLONG Override;
+		if (_FC_PalGetEnvironmentNumber(L"FC_CACHE_RACY_WINDOW_OVERRIDE", &Override))
+			return Override;
+#endif
+		return (ULONGLONG)FC_CACHE_RACY_WINDOW;
+	}
+
+	static BOOL
+		_FC_CacheMetaFromHandle(
+			_In_ _FC_FILE FileHandle,
+			_Out_ _FC_CACHE_FILE_META* Meta)
+	{
+		memset(Meta, 0, sizeof(*Meta));
+		return _FC_PalFileInfo(FileHandle, &Meta->Size, &Meta->LastWriteTime, &Meta->ChangeTime, &Meta->FileId, &Meta->VolumeSerial);
+	}
+
+	static BOOL
+		_FC_CacheQueryMeta(
+			_In_z_ const WCHAR* Path,
+			_Out_ _FC_CACHE_FILE_META* Meta)
+	{
+		memset(Meta, 0, sizeof(*Meta));
+		_FC_FILE FileHandle = _FC_PalOpenRead(Path, FALSE);
+		if (FileHandle == _FC_INVALID_FILE)
+			return FALSE;
+		BOOL Ok = _FC_CacheMetaFromHandle(FileHandle, Meta);
+		_FC_PalClose(FileHandle);
+		return Ok;
+	}
+
+	static inline BOOL
+		_FC_CacheMetaEqual(
+			_In_ const _FC_CACHE_FILE_META* A,
+			_In_ const _FC_CACHE_FILE_META* B)
+	{
+		return A->Size == B->Size &&
+			A->LastWriteTime == B->LastWriteTime &&
+			A->ChangeTime == B->ChangeTime &&
+			A->FileId == B->FileId &&
+			A->VolumeSerial == B->VolumeSerial;
+	}
+
+	/**
+	 * @brief Computes the SHA-256 digest of a file whose metadata must match Expected.
+	 *
+	 * The metadata is checked on the open handle before and after hashing, so a
+	 * file that is replaced or rewritten while it is being read is never recorded.
+	 * @internal
+	 * @return TRUE if the digest describes the file as identified by Expected.
+	 */
+	static BOOL
+		_FC_CacheDigestFile(
+			_In_z_ const WCHAR* Path,
+			_In_ const _FC_CACHE_FILE_META* Expected,
+			_Out_writes_(_FC_CACHE_DIGEST_BYTES) BYTE* Digest)
+	{
+		BOOL Ok = FALSE;
+		BYTE* Chunk = NULL;
+		_FC_CACHE_FILE_META Meta;
+		_FC_FILE FileHandle = _FC_PalOpenRead(Path, TRUE);
+		if (FileHandle == _FC_INVALID_FILE)
+			return FALSE;
+
+		if (!_FC_CacheMetaFromHandle(FileHandle, &Meta) || !_FC_CacheMetaEqual(&Meta, Expected))
+			goto cleanup;
+
+		enum { FC_CACHE_DIGEST_CHUNK = 64 * 1024 };
+		Chunk = (BYTE*)_FC_WorkAlloc(0, FC_CACHE_DIGEST_CHUNK);
+		if (Chunk == NULL)
+			goto cleanup;
+
+		_FC_SHA256 Sha;
+		_FC_Sha256Init(&Sha);
+		ULONGLONG Total = 0;
+		for (;;)
+		{
+			DWORD BytesRead = 0;
+			if (!_FC_PalRead(FileHandle, Chunk, FC_CACHE_DIGEST_CHUNK, &BytesRead))
+				goto cleanup;
+			if (BytesRead == 0)
+				break;
+			_FC_Sha256Update(&Sha, Chunk, BytesRead);
+			Total += BytesRead;
+		}
+		_FC_Sha256Final(&Sha, Digest);
+
+		if (Total != Expected->Size ||
+			!_FC_CacheMetaFromHandle(FileHandle, &Meta) || !_FC_CacheMetaEqual(&Meta, Expected))
+			goto cleanup;
+		Ok = TRUE;
+
+	cleanup:
+		_FC_WorkFree(Chunk);
+		_FC_PalClose(FileHandle);
+		return Ok;
+	}
+
+	static size_t
+		_FC_CacheFindFile(
+			_In_ const FC_CACHE* Cache,
+			_In_z_ const WCHAR* Path,
+			_In_ ULONGLONG Key)
+	{
+		for (size_t i = _FC_CacheIndexFirst(&Cache->FileIndex, Key); i != SIZE_MAX; i = Cache->FileIndex.Next[i])
+		{
+			const _FC_CACHE_FILE* Record = (const _FC_CACHE_FILE*)_FC_BufferGet(&Cache->Files, i);
+			if (Record->Key == Key && wcscmp(Record->Path, Path) == 0)
+				return i;
+		}
+		return SIZE_MAX;
+	}
+
+	static size_t
+		_FC_CacheFindPair(
+			_In_ const FC_CACHE* Cache,
+			_In_reads_(_FC_CACHE_DIGEST_BYTES) const BYTE* Digest1,
+			_In_reads_(_FC_CACHE_DIGEST_BYTES) const BYTE* Digest2,
+			_In_ ULONGLONG ConfigKey)
+	{
+		ULONGLONG Key = _FC_CachePairKey(Digest1, Digest2, ConfigKey);
+		for (size_t i = _FC_CacheIndexFirst(&Cache->PairIndex, Key); i != SIZE_MAX; i = Cache->PairIndex.Next[i])
+		{
+			const _FC_CACHE_PAIR* Record = (const _FC_CACHE_PAIR*)_FC_BufferGet(&Cache->Pairs, i);
+			if (Record->Key == Key && Record->ConfigKey == ConfigKey &&
+				memcmp(Record->Digest1, Digest1, _FC_CACHE_DIGEST_BYTES) == 0 &&
+				memcmp(Record->Digest2, Digest2, _FC_CACHE_DIGEST_BYTES) == 0)
+				return i;
+		}
+		return SIZE_MAX;
+	}
+
+	/**
+	 * @brief Returns the cached digest of a file if its record is still valid. Caller holds the lock.
+	 * @internal
+	 */
+	static BOOL
+		_FC_CacheLookupFile(
+			_Inout_ FC_CACHE* Cache,
+			_In_z_ const WCHAR* Path,
+			_In_ const _FC_CACHE_FILE_META* Meta,
+			_Out_writes_(_FC_CACHE_DIGEST_BYTES) BYTE* Digest)
+	{
+		size_t i = _FC_CacheFindFile(Cache, Path, _FC_CachePathKey(Path));
+		if (i == SIZE_MAX)
+			return FALSE;
+		_FC_CACHE_FILE* Record = (_FC_CACHE_FILE*)_FC_BufferGet(&Cache->Files, i);
+		if (!_FC_CacheMetaEqual(&Record->Meta, Meta))
+			return FALSE;
+		memcpy(Digest, Record->Digest, _FC_CACHE_DIGEST_BYTES);
+		Record->LastUsed = ++Cache->Clock;
+		return TRUE;
+	}
+
+	/**
+	 * @brief Records or refreshes a file's digest. Caller holds the lock.
+	 *
+	 * Recently modified files are skipped (see FC_CACHE_RACY_WINDOW). Failures are
+	 * silently ignored; the cache is an optimization and never affects results.
+	 * @internal
+	 */
+	static void
+		_FC_CacheStoreFile(
+			_Inout_ FC_CACHE* Cache,
+			_In_z_ const WCHAR* Path,
+			_In_ const _FC_CACHE_FILE_META* Meta,
+			_In_reads_(_FC_CACHE_DIGEST_BYTES) const BYTE* Digest,
+			_In_ ULONGLONG Now)
+	{
+		ULONGLONG Touched = (Meta->ChangeTime > Meta->LastWriteTime) ? Meta->ChangeTime : Meta->LastWriteTime;
+		if (Now < Touched || Now - Touched < _FC_GetEffectiveCacheRacyWindow())
+			return;
+
+		ULONGLONG Key = _FC_CachePathKey(Path);
+		size_t i = _FC_CacheFindFile(Cache, Path, Key);
+		if (i != SIZE_MAX)
+		{
+			_FC_CACHE_FILE* Record = (_FC_CACHE_FILE*)_FC_BufferGet(&Cache->Files, i);
+			Record->Meta = *Meta;
+			memcpy(Record->Digest, Digest, _FC_CACHE_DIGEST_BYTES);
+			Record->LastUsed = ++Cache->Clock;
+			Cache->Dirty = TRUE;
+			return;
+		}
+
+		size_t Length = wcslen(Path);
+		_FC_CACHE_FILE Record;
+		memset(&Record, 0, sizeof(Record));
+		Record.Key = Key;
+		Record.Path = (WCHAR*)_FC_PalAlloc(_FC_PalProcessHeap(), 0, (Length + 1) * sizeof(WCHAR));
+		if (Record.Path == NULL)
+			return;
+		memcpy(Record.Path, Path, (Length + 1) * sizeof(WCHAR));
+		Record.Meta = *Meta;
+		memcpy(Record.Digest, Digest, _FC_CACHE_DIGEST_BYTES);
+		Record.LastUsed = ++Cache->Clock;
+		if (!_FC_BufferAppend(&Cache->Files, &Record))
+		{
+			_FC_HeapFree(Record.Path);
+			return;
+		}
+		_FC_CacheIndexAdd(&Cache->FileIndex, &Cache->Files);
+		Cache->Dirty = TRUE;
+	}
+
+	/**
+	 * @brief Records the result of comparing two contents. Caller holds the lock.
+	 * @internal
+	 */
+	static void
+		_FC_CacheStorePair(
+			_Inout_ FC_CACHE* Cache,
+			_In_reads_(_FC_CACHE_DIGEST_BYTES) const BYTE* Digest1,
+			_In_reads_(_FC_CACHE_DIGEST_BYTES) const BYTE* Digest2,
+			_In_ ULONGLONG ConfigKey,
+			_In_ FC_RESULT Result)
+	{
+		size_t i = _FC_CacheFindPair(Cache, Digest1, Digest2, ConfigKey);
+		if (i != SIZE_MAX)
+		{
+			_FC_CACHE_PAIR* Existing = (_FC_CACHE_PAIR*)_FC_BufferGet(&Cache->Pairs, i);
+			Existing->Result = Result;
+			Existing->LastUsed = ++Cache->Clock;
+			Cache->Dirty = TRUE;
+			return;
+		}
+
+		_FC_CACHE_PAIR Record;
+		memset(&Record, 0, sizeof(Record));
+		Record.Key = _FC_CachePairKey(Digest1, Digest2, ConfigKey);
+		memcpy(Record.Digest1, Digest1, _FC_CACHE_DIGEST_BYTES);
+		memcpy(Record.Digest2, Digest2, _FC_CACHE_DIGEST_BYTES);
+		Record.ConfigKey = ConfigKey;
+		Record.Result = Result;
+		Record.LastUsed = ++Cache->Clock;
+		if (!_FC_BufferAppend(&Cache->Pairs, &Record))
+			return;
+		_FC_CacheIndexAdd(&Cache->PairIndex, &Cache->Pairs);
+		Cache->Dirty = TRUE;
+	}
+
+	/**
+	 * @brief Compares two canonical paths, consulting and updating the cache.
+	 *
+	 * If both files still match their cached metadata and either their digests
+	 * are equal or a cached FC_OK exists for the digest pair under the same
+	 * configuration, FC_OK is returned without reading either file. Otherwise the
+	 * normal comparison runs, and any digest not already known is computed with an
+	 * extra sequential read so that the next run can be answered from the cache.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_CacheCompareFiles(
+			_Inout_ FC_CACHE* Cache,
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		_FC_CACHE_FILE_META Meta1, Meta2;
+		BYTE Digest1[_FC_CACHE_DIGEST_BYTES], Digest2[_FC_CACHE_DIGEST_BYTES];
+		BOOL Known1 = FALSE, Known2 = FALSE;
+		ULONGLONG ConfigKey = _FC_CacheConfigKey(Config);
+
+		BOOL HaveMeta = _FC_CacheQueryMeta(Path1, &Meta1) && _FC_CacheQueryMeta(Path2, &Meta2);
+		if (HaveMeta)
+		{
+			_FC_PalLockExclusive(&Cache->Lock);
+			Known1 = _FC_CacheLookupFile(Cache, Path1, &Meta1, Digest1);
+			Known2 = _FC_CacheLookupFile(Cache, Path2, &Meta2, Digest2);
+			if (Known1 && Known2)
+			{
+				BOOL Identical = memcmp(Digest1, Digest2, _FC_CACHE_DIGEST_BYTES) == 0;
+				if (!Identical)
+				{
+					size_t i = _FC_CacheFindPair(Cache, Digest1, Digest2, ConfigKey);
+					if (i != SIZE_MAX)
+					{
+						_FC_CACHE_PAIR* Pair = (_FC_CACHE_PAIR*)_FC_BufferGet(&Cache->Pairs, i);
+						Pair->LastUsed = ++Cache->Clock;
+						Identical = (Pair->Result == FC_OK);
+					}
+				}
+				if (Identical)
+				{
+					Cache->Hits++;
+					Cache->Dirty = TRUE;
+					_FC_PalUnlockExclusive(&Cache->Lock);
+					return FC_OK;
+				}
+			}
+			Cache->Misses++;
+			_FC_PalUnlockExclusive(&Cache->Lock);
+		}
+
+		FC_RESULT Result = _FC_CompareFilesInternal(Path1, Path2, Config);
+		if (!HaveMeta || (Result != FC_OK && Result != FC_DIFFERENT))
+			return Result;
+
+		// A file that changed while it was being compared must not be recorded
+		// against the result that was just computed.
+		_FC_CACHE_FILE_META After1, After2;
+		if (!_FC_CacheQueryMeta(Path1, &After1) || !_FC_CacheMetaEqual(&After1, &Meta1) ||
+			!_FC_CacheQueryMeta(Path2, &After2) || !_FC_CacheMetaEqual(&After2, &Meta2))
+			return Result;
+
+		if (!Known1)
+			Known1 = _FC_CacheDigestFile(Path1, &Meta1, Digest1);
+		if (!Known2)
+			Known2 = _FC_CacheDigestFile(Path2, &Meta2, Digest2);
+
+		ULONGLONG Now = _FC_PalSystemTime();
+
+		_FC_PalLockExclusive(&Cache->Lock);
+		if (Known1)
+			_FC_CacheStoreFile(Cache, Path1, &Meta1, Digest1, Now);
+		if (Known2)
+			_FC_CacheStoreFile(Cache, Path2, &Meta2, Digest2, Now);
+		if (Known1 && Known2 && memcmp(Digest1, Digest2, _FC_CACHE_DIGEST_BYTES) != 0)
+			_FC_CacheStorePair(Cache, Digest1, Digest2, ConfigKey, Result);
+		_FC_PalUnlockExclusive(&Cache->Lock);
+		return Result;
+	}
+
+	/**
+	 * @brief Cursor over the bytes of a loaded cache file.
+	 * @internal
+	 */
+	typedef struct {
+		const BYTE* Data;
+		size_t Remaining;
+	} _FC_CACHE_READER;
+
+	static inline BOOL
+		_FC_CacheRead(
+			_Inout_ _FC_CACHE_READER* Reader,
+			_Out_writes_bytes_(Length) void* Out,
+			_In_ size_t Length)
+	{
+		if (Reader->Remaining < Length)
+			return FALSE;
+		memcpy(Out, Reader->Data, Length);
+		Reader->Data += Length;
+		Reader->Remaining -= Length;
+		return TRUE;
+	}
+
+	/**
+	 * @struct _FC_CACHE_HEADER
+	 * @brief Fixed header at the start of a cache file, followed by file records, then pair records.
+	 * @internal
+	 */
+	typedef struct {
+		char Magic[8];          /**< _FC_CACHE_MAGIC, not NUL-terminated. */
+		DWORD Version;          /**< _FC_CACHE_VERSION. */
+		DWORD Reserved;
+		ULONGLONG Clock;
+		ULONGLONG FileCount;
+		ULONGLONG PairCount;
+		ULONGLONG Checksum;     /**< FNV-1a of every byte after the header. */
+	} _FC_CACHE_HEADER;
+
+	/**
+	 * @brief Serialized size of one file record, or 0 if its path cannot be encoded.
+	 * @internal
+	 */
+	static size_t
+		_FC_CacheFileRecordBytes(
+			_In_ const _FC_CACHE_FILE* Record)
+	{
+		int PathBytes = _FC_PalWideToUtf8(Record->Path, -1, NULL, 0);
+		if (PathBytes <= 1)
+			return 0;
+		return 5 * sizeof(ULONGLONG) + 2 * sizeof(DWORD) + _FC_CACHE_DIGEST_BYTES + (size_t)(PathBytes - 1);
+	}
+
+#define _FC_CACHE_PAIR_RECORD_BYTES (2 * _FC_CACHE_DIGEST_BYTES + 2 * sizeof(ULONGLONG) + 2 * sizeof(DWORD))
+
+	/**
+	 * @brief Loads a cache file into an empty cache.
+	 *
+	 * Any structural problem — wrong magic or version, truncated data, checksum
+	 * mismatch, or an undecodable path — discards the whole file, so a corrupted
+	 * cache only costs a cold run.
+	 * @internal
+	 */
+	static void
+		_FC_CacheLoad(
+			_Inout_ FC_CACHE* Cache)
+	{
+		size_t Length = 0;
+		FC_RESULT ReadResult = FC_OK;
+		char* Contents = _FC_ReadFileContents(Cache->Path, &Length, &ReadResult);
+		if (Contents == NULL)
+			return;
+
+		BOOL Ok = FALSE;
+		_FC_CACHE_READER Reader = { (const BYTE*)Contents, Length };
+		_FC_CACHE_HEADER Header;
+		if (!_FC_CacheRead(&Reader, &Header, sizeof(Header)) ||
+			memcmp(Header.Magic, _FC_CACHE_MAGIC, sizeof(Header.Magic)) != 0 ||
+			Header.Version != _FC_CACHE_VERSION ||
+			_FC_Fnv1a64(_FC_FNV64_OFFSET, Reader.Data, Reader.Remaining) != Header.Checksum)
+			goto cleanup;
+
+		for (ULONGLONG n = 0; n < Header.FileCount; n++)
+		{
+			_FC_CACHE_FILE Record;
+			memset(&Record, 0, sizeof(Record));
+			DWORD PathBytes = 0;
+			if (!_FC_CacheRead(&Reader, &Record.Meta.Size, sizeof(ULONGLONG)) ||
+				!_FC_CacheRead(&Reader, &Record.Meta.LastWriteTime, sizeof(ULONGLONG)) ||
+				!_FC_CacheRead(&Reader, &Record.Meta.ChangeTime, sizeof(ULONGLONG)) ||
+				!_FC_CacheRead(&Reader, &Record.Meta.FileId, sizeof(ULONGLONG)) ||
+				!_FC_CacheRead(&Reader, &Record.LastUsed, sizeof(ULONGLONG)) ||
+				!_FC_CacheRead(&Reader, &Record.Meta.VolumeSerial, sizeof(DWORD)) ||
+				!_FC_CacheRead(&Reader, &PathBytes, sizeof(DWORD)) ||
+				!_FC_CacheRead(&Reader, Record.Digest, _FC_CACHE_DIGEST_BYTES) ||
+				PathBytes == 0 || PathBytes > Reader.Remaining)
+				goto cleanup;
+
+			char* Utf8Path = _FC_StringDuplicateRange((const char*)Reader.Data, PathBytes);
+			if (Utf8Path == NULL)
+				goto cleanup;
+			Reader.Data += PathBytes;
+			Reader.Remaining -= PathBytes;
+			_FC_UTF8_TO_WIDE_STATUS Status = _FC_ConvertUtf8ToWide(Utf8Path, &Record.Path);
+			_FC_HeapFree(Utf8Path);
+			if (Status != FC_UTF8_TO_WIDE_OK)
+				goto cleanup;
+
+			Record.Key = _FC_CachePathKey(Record.Path);
+			if (!_FC_BufferAppend(&Cache->Files, &Record))
+			{
+				_FC_HeapFree(Record.Path);
+				goto cleanup;
+			}
+		}
+
+		for (ULONGLONG n = 0; n < Header.PairCount; n++)
+		{
+			_FC_CACHE_PAIR Record;
+			memset(&Record, 0, sizeof(Record));
+			DWORD StoredResult = 0, Reserved = 0;
+			if (!_FC_CacheRead(&Reader, Record.Digest1, _FC_CACHE_DIGEST_BYTES) ||
+				!_FC_CacheRead(&Reader, Record.Digest2, _FC_CACHE_DIGEST_BYTES) ||
+				!_FC_CacheRead(&Reader, &Record.ConfigKey, sizeof(ULONGLONG)) ||
+				!_FC_CacheRead(&Reader, &Record.LastUsed, sizeof(ULONGLONG)) ||
+				!_FC_CacheRead(&Reader, &StoredResult, sizeof(DWORD)) ||
+				!_FC_CacheRead(&Reader, &Reserved, sizeof(DWORD)) ||
+				(StoredResult != FC_OK && StoredResult != FC_DIFFERENT))
+				goto cleanup;
+
+			Record.Result = (FC_RESULT)StoredResult;
+			Record.Key = _FC_CachePairKey(Record.Digest1, Record.Digest2, Record.ConfigKey);
+			if (!_FC_BufferAppend(&Cache->Pairs, &Record))
+				goto cleanup;
+		}
+
+		if (Reader.Remaining != 0 ||
+			!_FC_CacheIndexRebuild(&Cache->FileIndex, &Cache->Files) ||
+			!_FC_CacheIndexRebuild(&Cache->PairIndex, &Cache->Pairs))
+			goto cleanup;
+
+		Cache->Clock = Header.Clock;
+		Ok = TRUE;
+
+	cleanup:
+		_FC_HeapFree(Contents);
+		if (!Ok)
+		{
+			for (size_t i = 0; i < Cache->Files.Count; i++)
+				_FC_HeapFree(((_FC_CACHE_FILE*)_FC_BufferGet(&Cache->Files, i))->Path);
+			Cache->Files.Count = 0;
+			Cache->Pairs.Count = 0;
+			_FC_CacheIndexFree(&Cache->FileIndex);
+			_FC_CacheIndexFree(&Cache->PairIndex);
+			Cache->Clock = 0;
+		}
+	}
+
+	/**
+	 * @brief One record considered for the saved file, ordered by recency.
+	 * @internal
+	 */
+	typedef struct {
+		ULONGLONG LastUsed;
+		size_t Index;
+		size_t Bytes;
+		BOOL IsPair;
+	} _FC_CACHE_EVICT_ITEM;
+
+	static int __cdecl
+		_FC_CacheCompareByRecency(
+			_In_ const void* A,
+			_In_ const void* B)
+	{
+		ULONGLONG UsedA = ((const _FC_CACHE_EVICT_ITEM*)A)->LastUsed;
+		ULONGLONG UsedB = ((const _FC_CACHE_EVICT_ITEM*)B)->LastUsed;
+		return (UsedA < UsedB) ? 1 : (UsedA > UsedB) ? -1 : 0;
+	}
+
+	/**
+	 * @brief Writes the cache to disk, evicting least-recently-used records to fit MaxBytes.
+	 *
+	 * The data is written to "<path>.tmp" and moved over the cache file, so
+	 * readers never observe a partially written cache.
+	 * @internal
+	 * @return FC_OK on success, FC_ERROR_IO or FC_ERROR_MEMORY on failure.
+	 */
+	static FC_RESULT
+		_FC_CacheSave(
+			_In_ FC_CACHE* Cache)
+	{
+		FC_RESULT Result = FC_ERROR_MEMORY;
+		_FC_CACHE_EVICT_ITEM* Items = NULL;
+		BYTE* KeepFile = NULL;
+		BYTE* KeepPair = NULL;
+		WCHAR* TempPath = NULL;
+		_FC_FILE FileHandle = _FC_INVALID_FILE;
+		_FC_BUFFER Out = { 0 };
+		_FC_BufferInit(&Out, sizeof(char));
+
+		size_t ItemCount = Cache->Files.Count + Cache->Pairs.Count;
+		if (ItemCount > 0)
+		{
+			Items = (_FC_CACHE_EVICT_ITEM*)_FC_PalAlloc(_FC_PalProcessHeap(), 0, ItemCount * sizeof(_FC_CACHE_EVICT_ITEM));
+			KeepFile = (BYTE*)_FC_PalAlloc(_FC_PalProcessHeap(), _FC_ALLOC_ZERO, Cache->Files.Count + 1);
+			KeepPair = (BYTE*)_FC_PalAlloc(_FC_PalProcessHeap(), _FC_ALLOC_ZERO, Cache->Pairs.Count + 1);
+			if (Items == NULL || KeepFile == NULL || KeepPair == NULL)
+				goto cleanup;
+		}
+
+		size_t n = 0;
+		for (size_t i = 0; i < Cache->Files.Count; i++)
+		{
+			const _FC_CACHE_FILE* Record = (const _FC_CACHE_FILE*)_FC_BufferGet(&Cache->Files, i);
+			_FC_CACHE_EVICT_ITEM Item = { Record->LastUsed, i, _FC_CacheFileRecordBytes(Record), FALSE };
+			if (Item.Bytes > 0)
+				Items[n++] = Item;
+		}
+		for (size_t i = 0; i < Cache->Pairs.Count; i++)
+		{
+			const _FC_CACHE_PAIR* Record = (const _FC_CACHE_PAIR*)_FC_BufferGet(&Cache->Pairs, i);
+			_FC_CACHE_EVICT_ITEM Item = { Record->LastUsed, i, _FC_CACHE_PAIR_RECORD_BYTES, TRUE };
+			Items[n++] = Item;
+		}
+		if (n > 1)
+			qsort(Items, n, sizeof(_FC_CACHE_EVICT_ITEM), _FC_CacheCompareByRecency);
+
+		// Keep the most recently used records until the budget is exhausted.
+		_FC_CACHE_HEADER Header;
+		memset(&Header, 0, sizeof(Header));
+		ULONGLONG Budget = (Cache->MaxBytes > sizeof(Header)) ? Cache->MaxBytes - sizeof(Header) : 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (Items[i].Bytes > Budget)
+				break;
+			Budget -= Items[i].Bytes;
+			if (Items[i].IsPair)
+			{
+				KeepPair[Items[i].Index] = 1;
+				Header.PairCount++;
+			}
+			else
+			{
+				KeepFile[Items[i].Index] = 1;
+				Header.FileCount++;
+			}
+		}
+
+		memcpy(Header.Magic, _FC_CACHE_MAGIC, sizeof(Header.Magic));
+		Header.Version = _FC_CACHE_VERSION;
+		Header.Clock = Cache->Clock;
+		if (!_FC_BufferAppendRange(&Out, &Header, sizeof(Header)))
+			goto cleanup;
+
+		for (size_t i = 0; i < Cache->Files.Count; i++)
+		{
+			if (!KeepFile[i])
+				continue;
+			const _FC_CACHE_FILE* Record = (const _FC_CACHE_FILE*)_FC_BufferGet(&Cache->Files, i);
+			int Utf8Bytes = _FC_PalWideToUtf8(Record->Path, -1, NULL, 0);
+			DWORD PathBytes = (DWORD)(Utf8Bytes - 1);
+			if (!_FC_BufferAppendRange(&Out, &Record->Meta.Size, sizeof(ULONGLONG)) ||
+				!_FC_BufferAppendRange(&Out, &Record->Meta.LastWriteTime, sizeof(ULONGLONG)) ||
+				!_FC_BufferAppendRange(&Out, &Record->Meta.ChangeTime, sizeof(ULONGLONG)) ||
+				!_FC_BufferAppendRange(&Out, &Record->Meta.FileId, sizeof(ULONGLONG)) ||
+				!_FC_BufferAppendRange(&Out, &Record->LastUsed, sizeof(ULONGLONG)) ||
+				!_FC_BufferAppendRange(&Out, &Record->Meta.VolumeSerial, sizeof(DWORD)) ||
+				!_FC_BufferAppendRange(&Out, &PathBytes, sizeof(DWORD)) ||
+				!_FC_BufferAppendRange(&Out, Record->Digest, _FC_CACHE_DIGEST_BYTES) ||
+				!_FC_BufferEnsureCapacity(&Out, (size_t)Utf8Bytes))
+				goto cleanup;
+			_FC_PalWideToUtf8(Record->Path, -1, (char*)Out.pData + Out.Count, Utf8Bytes);
+			Out.Count += PathBytes;
+		}
+
+		for (size_t i = 0; i < Cache->Pairs.Count; i++)
+		{
+			if (!KeepPair[i])
+				continue;
+			const _FC_CACHE_PAIR* Record = (const _FC_CACHE_PAIR*)_FC_BufferGet(&Cache->Pairs, i);
+			DWORD StoredResult = (DWORD)Record->Result, Reserved = 0;
+			if (!_FC_BufferAppendRange(&Out, Record->Digest1, _FC_CACHE_DIGEST_BYTES) ||
+				!_FC_BufferAppendRange(&Out, Record->Digest2, _FC_CACHE_DIGEST_BYTES) ||
+				!_FC_BufferAppendRange(&Out, &Record->ConfigKey, sizeof(ULONGLONG)) ||
+				!_FC_BufferAppendRange(&Out, &Record->LastUsed, sizeof(ULONGLONG)) ||
+				!_FC_BufferAppendRange(&Out, &StoredResult, sizeof(DWORD)) ||
+				!_FC_BufferAppendRange(&Out, &Reserved, sizeof(DWORD)))
+				goto cleanup;
+		}
+
+		Header.Checksum = _FC_Fnv1a64(_FC_FNV64_OFFSET, (const BYTE*)Out.pData + sizeof(Header), Out.Count - sizeof(Header));
+		memcpy(Out.pData, &Header, sizeof(Header));
+
+		size_t PathLength = wcslen(Cache->Path);
+		TempPath = (WCHAR*)_FC_PalAlloc(_FC_PalProcessHeap(), 0, (PathLength + 5) * sizeof(WCHAR));
+		if (TempPath == NULL)
+			goto cleanup;
+		memcpy(TempPath, Cache->Path, PathLength * sizeof(WCHAR));
+		memcpy(TempPath + PathLength, L".tmp", 5 * sizeof(WCHAR));
+
+		Result = FC_ERROR_IO;
+		FileHandle = _FC_PalCreateFile(TempPath, FALSE);
+		if (FileHandle == _FC_INVALID_FILE)
+			goto cleanup;
+		for (size_t Written = 0; Written < Out.Count; )
+		{
+			DWORD ToWrite = (Out.Count - Written > 0x40000000u) ? 0x40000000u : (DWORD)(Out.Count - Written);
+			DWORD Put = 0;
+			if (!_FC_PalWrite(FileHandle, (const BYTE*)Out.pData + Written, ToWrite, &Put) || Put == 0)
+				goto cleanup;
+			Written += Put;
+		}
+		if (!_FC_PalFlush(FileHandle))
+			goto cleanup;
+		_FC_PalClose(FileHandle);
+		FileHandle = _FC_INVALID_FILE;
+
+		if (!_FC_PalReplaceFile(TempPath, Cache->Path))
+			goto cleanup;
+		Result = FC_OK;
+
+	cleanup:
+		if (FileHandle != _FC_INVALID_FILE)
+			_FC_PalClose(FileHandle);
+		if (Result != FC_OK && TempPath != NULL)
+			_FC_PalDeleteFile(TempPath);
+		_FC_HeapFree(TempPath);
+		_FC_HeapFree(Items);
+		_FC_HeapFree(KeepFile);
+		_FC_HeapFree(KeepPair);
+		_FC_BufferFree(&Out);
+		return Result;
+	}
+
+	/**
+	 * @brief Opens (or creates) a persistent comparison cache.
+	 *
+	 * The cache file is read once here and written back by `FC_CacheClose`. A
+	 * missing, unreadable or corrupted file yields an empty cache rather than an
+	 * error. Attach the handle to `FC_CONFIG::Cache` to use it; one handle may be
+	 * shared by concurrent comparisons on several threads.
+	 *
+	 * Several processes may use the same cache file, but each one rewrites it
+	 * from its own view on close, so the last writer wins.
+	 *
+	 * @param Path A null-terminated, wide (UTF-16) encoded path to the cache file.
+	 * @param MaxBytes Upper bound on the saved file size; 0 uses FC_CACHE_DEFAULT_MAX_BYTES.
+	 * @param[out] CacheOut Receives the new cache handle.
+	 *
+	 * @return An FC_RESULT code indicating the outcome.
+	 * @retval FC_OK on success.
+	 * @retval FC_ERROR_INVALID_PARAM if a required pointer is NULL or the path is empty.
+	 * @retval FC_ERROR_MEMORY if a memory allocation fails.
+	 */
+	FC_RESULT
+		FC_CacheOpenW(
+			_In_z_ const WCHAR* Path,
+			_In_ ULONGLONG MaxBytes,
+			_Outptr_result_maybenull_ FC_CACHE** CacheOut)
+	{
+		if (CacheOut == NULL)
+			return FC_ERROR_INVALID_PARAM;
+		*CacheOut = NULL;
+		if (Path == NULL || Path[0] == L'\0')
+			return FC_ERROR_INVALID_PARAM;
+
+		FC_CACHE* Cache = (FC_CACHE*)_FC_PalAlloc(_FC_PalProcessHeap(), _FC_ALLOC_ZERO, sizeof(FC_CACHE));
+		if (Cache == NULL)
+			return FC_ERROR_MEMORY;
+
+		size_t Length = wcslen(Path);
+		Cache->Path = (WCHAR*)_FC_PalAlloc(_FC_PalProcessHeap(), 0, (Length + 1) * sizeof(WCHAR));
+		if (Cache->Path == NULL)
+		{
+			_FC_HeapFree(Cache);
+			return FC_ERROR_MEMORY;
+		}
+		memcpy(Cache->Path, Path, (Length + 1) * sizeof(WCHAR));
+
+		_FC_PalLockInit(&Cache->Lock);
+		Cache->MaxBytes = (MaxBytes > 0) ? MaxBytes : (ULONGLONG)FC_CACHE_DEFAULT_MAX_BYTES;
+
+		// Cache records outlive any comparison, so they never live on a session heap.
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, NULL);
+		_FC_BufferInit(&Cache->Files, sizeof(_FC_CACHE_FILE));
+		_FC_BufferInit(&Cache->Pairs, sizeof(_FC_CACHE_PAIR));
+		_FC_CacheLoad(Cache);
+		_FC_LeaveWork(Previous);
+
+		*CacheOut = Cache;
+		return FC_OK;
+	}
+
+	/**
+	 * @brief Saves a cache if it was modified, then releases it.
+	 *
+	 * No comparison may be using the cache when this is called. The handle is
+	 * freed even if saving fails.
+	 *
+	 * @param Cache The cache handle from `FC_CacheOpenW`; NULL is ignored.
+	 * @return FC_OK on success, or FC_ERROR_IO / FC_ERROR_MEMORY if the cache file could not be written.
+	 */
+	FC_RESULT
+		FC_CacheClose(
+			_In_opt_ FC_CACHE* Cache)
+	{
+		if (Cache == NULL)
+			return FC_OK;
+
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, NULL);
+		FC_RESULT Result = Cache->Dirty ? _FC_CacheSave(Cache) : FC_OK;
+		_FC_LeaveWork(Previous);
+
+		for (size_t i = 0; i < Cache->Files.Count; i++)
+			_FC_HeapFree(((_FC_CACHE_FILE*)_FC_BufferGet(&Cache->Files, i))->Path);
+		_FC_BufferFree(&Cache->Files);
+		_FC_BufferFree(&Cache->Pairs);
+		_FC_CacheIndexFree(&Cache->FileIndex);
+		_FC_CacheIndexFree(&Cache->PairIndex);
+		_FC_PalLockDelete(&Cache->Lock);
+		_FC_HeapFree(Cache->Path);
+		_FC_HeapFree(Cache);
+		return Result;
+	}
+
+	/**
+	 * @brief Reports how many comparisons were answered from the cache since it was opened.
+	 * @param Cache The cache handle.
+	 * @param[out] Hits Optional; receives the number of comparisons answered without reading content.
+	 * @param[out] Misses Optional; receives the number of comparisons that read content.
+	 */
+	void
+		FC_CacheGetStats(
+			_In_ FC_CACHE* Cache,
+			_Out_opt_ ULONGLONG* Hits,
+			_Out_opt_ ULONGLONG* Misses)
+	{
+		if (Cache == NULL)
+			return;
+		_FC_PalLockShared(&Cache->Lock);
+		if (Hits != NULL)
+			*Hits = Cache->Hits;
+		if (Misses != NULL)
+			*Misses = Cache->Misses;
+		_FC_PalUnlockShared(&Cache->Lock);
+	}
+
+	//
+	// Main Implementation
+	//
+
+	// Forward declaration: FC_CompareFilesUtf8 calls FC_CompareFilesW which is defined below.
+	FC_RESULT FC_CompareFilesW(
+		_In_z_ const WCHAR* Path1,
+		_In_z_ const WCHAR* Path2,
+		_In_ const FC_CONFIG* Config);
+
+	/**
+	 * @brief Compares two files using UTF-8 encoded paths.
+	 *
+	 * This is a convenience wrapper function that takes UTF-8 encoded file paths,
+	 * converts them to wide (UTF-16) strings, and then calls the primary `FC_CompareFilesW`
+	 * function to perform the comparison.
+	 *
+	 * @param Path1 A null-terminated, UTF-8 encoded path to the first file.
+	 * @param Path2 A null-terminated, UTF-8 encoded path to the second file.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 *
+	 * @return An FC_RESULT code indicating the outcome of the comparison.
+	 * @retval FC_ERROR_INVALID_PARAM if any of the required pointers are NULL or if the path strings contain invalid UTF-8 sequences.
+	 * @retval FC_ERROR_MEMORY if memory allocation for path conversion fails.
+	 * @retval Other FC_RESULT codes as returned by `FC_CompareFilesW`.
+	 */
+	FC_RESULT
+		FC_CompareFilesUtf8(
+			_In_z_ const char* Path1,
+			_In_z_ const char* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		FC_RESULT Result = FC_OK;
+		_FC_UTF8_TO_WIDE_STATUS Path1Status;
+		_FC_UTF8_TO_WIDE_STATUS Path2Status;
+		WCHAR* WidePath1 = NULL;
+		WCHAR* WidePath2 = NULL;
+
+		if (!Path1 || !Path2 || !Config || !Config->DiffCallback ||
+			!_FC_IsValidAllocator(&Config->Allocator))
+		{
+			return FC_ERROR_INVALID_PARAM; // No cleanup needed, return directly.
+		}
+
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+
+		// Convert paths, checking each one immediately.
+		Path1Status = _FC_ConvertUtf8ToWide(Path1, &WidePath1);
+		if (Path1Status != FC_UTF8_TO_WIDE_OK)
+		{
+			Result = (Path1Status == FC_UTF8_TO_WIDE_OUT_OF_MEMORY)
+				? FC_ERROR_MEMORY
+				: FC_ERROR_INVALID_PARAM;
+			goto cleanup;
+		}
+
+		Path2Status = _FC_ConvertUtf8ToWide(Path2, &WidePath2);
+		if (Path2Status != FC_UTF8_TO_WIDE_OK)
+		{
+			Result = (Path2Status == FC_UTF8_TO_WIDE_OUT_OF_MEMORY)
+				? FC_ERROR_MEMORY
+				: FC_ERROR_INVALID_PARAM;
+			goto cleanup;
+		}
+
+		// Chain to the primary public API.
+		Result = FC_CompareFilesW(WidePath1, WidePath2, Config);
+
+	cleanup:
+		_FC_WorkFree(WidePath1);
+		_FC_WorkFree(WidePath2);
+		_FC_LeaveWork(Previous);
+
+		return Result;
+	}
+
+	/**
+	 * @brief Validates, canonicalizes and compares two paths with the working-memory
+	 *        source (process heap or session) already selected by the caller.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_CompareFilesEntry(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		FC_RESULT Result = FC_OK;
+		WCHAR* CanonicalPath1 = NULL;
+		WCHAR* CanonicalPath2 = NULL;
+		LONGLONG TraceStart = _FC_TraceNow();
+		_FC_PROBE3(compare__start, g_FcWork.TracePair, Config ? Config->Mode : 0, 0);
+
+		if (!Path1 || !Path2 || !Config || !Config->DiffCallback ||
+			!_FC_IsValidAllocator(&Config->Allocator)) {
+			Result = FC_ERROR_INVALID_PARAM;
+			goto cleanup;
+		}
+
+		// Path preparation
+		BOOL Canonical = _FC_ToCanonicalPath(Path1, &CanonicalPath1) &&
+			_FC_ToCanonicalPath(Path2, &CanonicalPath2);
+		_FC_TraceSpan(_FC_TRACE_OPEN, TraceStart, 0, 0);
+		if (!Canonical)
+		{
+			Result = FC_ERROR_INVALID_PARAM;
+			goto cleanup;
+		}
+
+		// Call the core logic function, which does NOT free the memory.
+		if (Config->Cache != NULL)
+			Result = _FC_CacheCompareFiles(Config->Cache, CanonicalPath1, CanonicalPath2, Config);
+		else
+			Result = _FC_CompareFilesInternal(CanonicalPath1, CanonicalPath2, Config);
+
+	cleanup:
+		// This function is the owner of these pointers, so it frees them.
+		_FC_WorkFree(CanonicalPath1);
+		_FC_WorkFree(CanonicalPath2);
+		if (_FC_Trace() != NULL)
+			_FC_TraceRecord(_FC_TRACE_COMPARE, TraceStart, (ULONGLONG)Result, 0, Path1);
+		_FC_PROBE2(compare__done, g_FcWork.TracePair, Result);
+
+		return Result;
+	}
+
+	/**
+	 * @brief Compares two files using wide (UTF-16) encoded paths. (Primary Function)
+	 *
+	 * This is the main entry point of the library. It takes two file paths and a
+	 * configuration structure, performs path canonicalization and validation, and then
+	 * dispatches to the appropriate internal comparison routine (text or binary)
+	 * based on the configuration. This function supports long file paths.
+	 *
+	 * When `Config->Cache` is set, unchanged files already known to be identical
+	 * are answered from the cache without reading their content.
+	 *
+	 * @param Path1 A null-terminated, wide (UTF-16) encoded path to the first file.
+	 * @param Path2 A null-terminated, wide (UTF-16) encoded path to the second file.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 *
+	 * @return An FC_RESULT code indicating the outcome of the comparison.
+	 * @retval FC_OK if the files are identical.
+	 * @retval FC_DIFFERENT if the files differ.
+	 * @retval FC_ERROR_INVALID_PARAM if any required pointers are NULL or if the paths are determined to be invalid or unsafe.
+	 * @retval FC_ERROR_IO if a file cannot be read.
+	 * @retval FC_ERROR_MEMORY if a memory allocation fails during the operation.
+	 * @retval FC_CANCELLED if `Config->ProgressCallback` returned FALSE.
+	 */
+	FC_RESULT
+		FC_CompareFilesW(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+		FC_RESULT Result = _FC_CompareFilesEntry(Path1, Path2, Config);
+		_FC_LeaveWork(Previous);
+		return Result;
+	}
+
+	/**
+	 * @brief Validates the common arguments of the in-memory comparison entry points.
+	 * @internal
+	 * @return TRUE if the arguments are usable, FALSE otherwise.
+	 */
+	static inline BOOL
+		_FC_ValidateBufferArgs(
+			_In_opt_ const void* Buffer1,
+			_In_ size_t Length1,
+			_In_opt_ const void* Buffer2,
+			_In_ size_t Length2,
+			_In_opt_ const FC_CONFIG* Config)
+	{
+		if (!Config || !Config->DiffCallback || !_FC_IsValidAllocator(&Config->Allocator))
+			return FALSE;
+		// A NULL buffer is only meaningful as an empty input.
+		if ((!Buffer1 && Length1 > 0) || (!Buffer2 && Length2 > 0))
+			return FALSE;
+		return TRUE;
+	}
+
+	/**
+	 * @brief Decides whether two in-memory inputs are compared line by line or byte by byte.
+	 *
+	 * Mirrors `_FC_ShouldCompareAsText`: text modes fall back to binary for inputs over
+	 * the text size limit, and `FC_MODE_AUTO` classifies the first 4 KB of each buffer.
+	 * @internal
+	 * @return TRUE for a text comparison, FALSE for a binary one.
+	 */
+	static inline BOOL
+		_FC_ShouldCompareBuffersAsText(
+			_In_reads_bytes_(Length1) const unsigned char* Bytes1,
+			_In_ size_t Length1,
+			_In_reads_bytes_(Length2) const unsigned char* Bytes2,
+			_In_ size_t Length2,
+			_In_ const FC_CONFIG* Config)
+	{
+		ULONGLONG Limit = _FC_GetEffectiveTextLimitBytes(Config);
+		BOOL UseText;
+		switch (Config->Mode)
+		{
+		case FC_MODE_TEXT_ASCII:
+		case FC_MODE_TEXT_UNICODE:
+			UseText = TRUE;
+			break;
+
+		case FC_MODE_BINARY:
+			UseText = FALSE;
+			break;
+
+		case FC_MODE_AUTO:
+		default:
+			UseText = _FC_IsProbablyTextBuffer(Bytes1, (DWORD)(Length1 < 4096 ? Length1 : 4096)) &&
+				_FC_IsProbablyTextBuffer(Bytes2, (DWORD)(Length2 < 4096 ? Length2 : 4096));
+			break;
+		}
+
+		// Avoid OOM-prone line parsing for very large inputs, as for files.
+		if (UseText && ((ULONGLONG)Length1 > Limit || (ULONGLONG)Length2 > Limit))
+			UseText = FALSE;
+		return UseText;
+	}
+
+	/**
+	 * @brief Body of `FC_CompareBuffers`, run with the working-memory source already selected.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_CompareBuffersEntry(
+			_In_reads_bytes_opt_(Length1) const void* Buffer1,
+			_In_ size_t Length1,
+			_In_reads_bytes_opt_(Length2) const void* Buffer2,
+			_In_ size_t Length2,
+			_In_ const FC_CONFIG* Config)
+	{
+		const unsigned char* Bytes1 = (const unsigned char*)Buffer1;
+		const unsigned char* Bytes2 = (const unsigned char*)Buffer2;
+
+		if (!_FC_ValidateBufferArgs(Buffer1, Length1, Buffer2, Length2, Config))
+			return FC_ERROR_INVALID_PARAM;
+		if (!Bytes1) Bytes1 = (const unsigned char*)"";
+		if (!Bytes2) Bytes2 = (const unsigned char*)"";
+
+		FC_RESULT Result;
+		_FC_PROBE3(compare__start, g_FcWork.TracePair, Config->Mode, 1);
+		if (_FC_ShouldCompareBuffersAsText(Bytes1, Length1, Bytes2, Length2, Config))
+			Result = _FC_CompareTextBuffers(NULL, NULL, (const char*)Bytes1, Length1, (const char*)Bytes2, Length2, Config);
+		else
+			Result = _FC_CompareBytes(NULL, NULL, Bytes1, Bytes2, Length1 < Length2 ? Length1 : Length2,
+				(ULONGLONG)Length1, (ULONGLONG)Length2, Config);
+		_FC_PROBE2(compare__done, g_FcWork.TracePair, Result);
+		return Result;
+	}
+
+	/**
+	 * @brief Compares two in-memory buffers. (No file I/O)
+	 *
+	 * Runs the same text and binary kernels as `FC_CompareFilesW` directly over
+	 * caller-owned memory: there is no path canonicalization, no file access and
+	 * no cache lookup. Mode selection mirrors the file API: text modes fall back
+	 * to a binary comparison when either buffer exceeds the text size limit, and
+	 * `FC_MODE_AUTO` classifies the first 4 KB of each buffer (there is no file
+	 * extension to consult).
+	 *
+	 * The `Path1` and `Path2` members of the `FC_USER_CONTEXT` handed to the
+	 * callback are NULL. The buffers need not be null-terminated and are not modified.
+	 *
+	 * @param Buffer1 The first buffer. May be NULL only if Length1 is 0.
+	 * @param Length1 The length of the first buffer in bytes.
+	 * @param Buffer2 The second buffer. May be NULL only if Length2 is 0.
+	 * @param Length2 The length of the second buffer in bytes.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 *
+	 * @return An FC_RESULT code indicating the outcome of the comparison.
+	 * @retval FC_OK if the buffers are identical.
+	 * @retval FC_DIFFERENT if the buffers differ.
+	 * @retval FC_ERROR_INVALID_PARAM if a required pointer is NULL.
+	 * @retval FC_ERROR_MEMORY if a memory allocation fails during the operation.
+	 * @retval FC_CANCELLED if `Config->ProgressCallback` returned FALSE.
+	 */
+	FC_RESULT
+		FC_CompareBuffers(
+			_In_reads_bytes_opt_(Length1) const void* Buffer1,
+			_In_ size_t Length1,
+			_In_reads_bytes_opt_(Length2) const void* Buffer2,
+			_In_ size_t Length2,
+			_In_ const FC_CONFIG* Config)
+	{
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+		FC_RESULT Result = _FC_CompareBuffersEntry(Buffer1, Length1, Buffer2, Length2, Config);
+		_FC_LeaveWork(Previous);
+		return Result;
+	}
+
+	/**
+	 * @brief Body of `FC_CompareBuffersText`, run with the working-memory source already selected.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_CompareBuffersTextEntry(
+			_In_reads_bytes_opt_(Length1) const char* Text1,
+			_In_ size_t Length1,
+			_In_reads_bytes_opt_(Length2) const char* Text2,
+			_In_ size_t Length2,
+			_In_ const FC_CONFIG* Config)
+	{
+		if (!_FC_ValidateBufferArgs(Text1, Length1, Text2, Length2, Config))
+			return FC_ERROR_INVALID_PARAM;
+		if (!Text1) Text1 = "";
+		if (!Text2) Text2 = "";
+
+		FC_RESULT Result;
+		_FC_PROBE3(compare__start, g_FcWork.TracePair, Config->Mode, 1);
+		if (Config->Mode == FC_MODE_BINARY)
+		{
+			FC_CONFIG TextConfig = *Config;
+			TextConfig.Mode = FC_MODE_TEXT_ASCII;
+			Result = _FC_CompareTextBuffers(NULL, NULL, Text1, Length1, Text2, Length2, &TextConfig);
+		}
+		else
+		{
+			Result = _FC_CompareTextBuffers(NULL, NULL, Text1, Length1, Text2, Length2, Config);
+		}
+		_FC_PROBE2(compare__done, g_FcWork.TracePair, Result);
+		return Result;
+	}
+
+	/**
+	 * @brief Compares two in-memory texts line by line. (No file I/O)
+	 *
+	 * Always runs the line-based comparison, regardless of the text size limit
+	 * and of content detection. `FC_MODE_BINARY` is treated as
+	 * `FC_MODE_TEXT_ASCII`; all other modes and flags apply as for files.
+	 * The `Path1` and `Path2` members of the callback context are NULL.
+	 *
+	 * @param Text1 The first text. May be NULL only if Length1 is 0.
+	 * @param Length1 The length of the first text in bytes.
+	 * @param Text2 The second text. May be NULL only if Length2 is 0.
+	 * @param Length2 The length of the second text in bytes.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 *
+	 * @return An FC_RESULT code indicating the outcome of the comparison.
+	 * @retval FC_OK if the texts are identical under the configured normalization.
+	 * @retval FC_DIFFERENT if the texts differ.
+	 * @retval FC_ERROR_INVALID_PARAM if a required pointer is NULL.
+	 * @retval FC_ERROR_MEMORY if a memory allocation fails during the operation.
+	 * @retval FC_CANCELLED if `Config->ProgressCallback` returned FALSE.
+	 */
+	FC_RESULT
+		FC_CompareBuffersText(
+			_In_reads_bytes_opt_(Length1) const char* Text1,
+			_In_ size_t Length1,
+			_In_reads_bytes_opt_(Length2) const char* Text2,
+			_In_ size_t Length2,
+			_In_ const FC_CONFIG* Config)
+	{
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+		FC_RESULT Result = _FC_CompareBuffersTextEntry(Text1, Length1, Text2, Length2, Config);
+		_FC_LeaveWork(Previous);
+		return Result;
+	}
+
+	/* -------------------- Equality Checks -------------------- */
+
+	//
+	// FC_FilesEqualW and FC_BuffersEqual answer the same identical / different
+	// question as the comparison functions without any of the diff machinery:
+	// binary inputs are compared by size and then by memcmp over read windows,
+	// stopping at the first mismatch, and text inputs are split and normalized
+	// one line at a time from both sides and compared in lockstep. Neither path
+	// builds line tables, hash maps or LCS state, and memory use is bounded by
+	// the read windows and the longest line.
+	//
+
+	/**
+	 * @brief Compares two line streams in lockstep, stopping at the first unequal line.
+	 * @internal
+	 * @return FC_OK if every normalized line matches, FC_DIFFERENT, or an error code.
+	 */
+	static FC_RESULT
+		_FC_LineStreamsEqual(
+			_Inout_ _FC_LINE_STREAM* StreamA,
+			_Inout_ _FC_LINE_STREAM* StreamB,
+			_In_ const FC_CONFIG* Config)
+	{
+		FC_RESULT Result = FC_OK;
+		_FC_BUFFER OutA, OutB, Scratch;
+		_FC_BufferInit(&OutA, sizeof(char));
+		_FC_BufferInit(&OutB, sizeof(char));
+		_FC_BufferInit(&Scratch, sizeof(char));
+
+		// Keep both line buffers allocated so empty lines never carry a NULL text.
+		if (!_FC_BufferEnsureCapacity(&OutA, 1) || !_FC_BufferEnsureCapacity(&OutB, 1))
+		{
+			Result = FC_ERROR_MEMORY;
+			goto cleanup;
+		}
+
+		for (;;)
+		{
+			BOOL HasA, HasB;
+			Result = _FC_LineStreamNextNormalized(StreamA, Config, &OutA, &Scratch, &HasA);
+			if (Result != FC_OK)
+				goto cleanup;
+			Result = _FC_LineStreamNextNormalized(StreamB, Config, &OutB, &Scratch, &HasB);
+			if (Result != FC_OK)
+				goto cleanup;
+			if (!HasA || !HasB)
+			{
+				Result = (HasA == HasB) ? FC_OK : FC_DIFFERENT;
+				break;
+			}
+
+			if (!_FC_LineTextsEqual((const char*)OutA.pData, OutA.Count, (const char*)OutB.pData, OutB.Count, Config))
+			{
+				Result = FC_DIFFERENT;
+				break;
+			}
+		}
+
+	cleanup:
+		_FC_BufferFree(&OutA);
+		_FC_BufferFree(&OutB);
+		_FC_BufferFree(&Scratch);
+		return Result;
+	}
+
+	/**
+	 * @brief Compares two files byte for byte: sizes first, then windows until the first mismatch.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_FilesBytesEqual(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2)
+	{
+		FC_RESULT Result = FC_ERROR_IO;
+		BYTE* Window1 = NULL;
+		BYTE* Window2 = NULL;
+		ULONGLONG Size1, Size2;
+		_FC_FILE File1 = _FC_PalOpenRead(Path1, TRUE);
+		_FC_FILE File2 = _FC_PalOpenRead(Path2, TRUE);
+		if (File1 == _FC_INVALID_FILE || File2 == _FC_INVALID_FILE)
+			goto cleanup;
+		if (!_FC_PalFileSize(File1, &Size1) || !_FC_PalFileSize(File2, &Size2))
+			goto cleanup;
+
+		// Different sizes settle the question without reading anything.
+		if (Size1 != Size2)
+		{
+			Result = FC_DIFFERENT;
+			goto cleanup;
+		}
+
+		Window1 = (BYTE*)_FC_WorkAlloc(0, FC_EQUAL_READ_BYTES);
+		Window2 = (BYTE*)_FC_WorkAlloc(0, FC_EQUAL_READ_BYTES);
+		if (Window1 == NULL || Window2 == NULL)
+		{
+			Result = FC_ERROR_MEMORY;
+			goto cleanup;
+		}
+
+		Result = FC_OK;
+		for (ULONGLONG Offset = 0; Offset < Size1; )
+		{
+			ULONGLONG Remaining = Size1 - Offset;
+			size_t ToRead = Remaining > FC_EQUAL_READ_BYTES ? FC_EQUAL_READ_BYTES : (size_t)Remaining;
+			if (!_FC_ReadFully(File1, Offset, Window1, ToRead) || !_FC_ReadFully(File2, Offset, Window2, ToRead))
+			{
+				Result = FC_ERROR_IO;
+				break;
+			}
+			if (memcmp(Window1, Window2, ToRead) != 0)
+			{
+				Result = FC_DIFFERENT;
+				break;
+			}
+			Offset += ToRead;
+		}
+
+	cleanup:
+		if (File1 != _FC_INVALID_FILE) _FC_PalClose(File1);
+		if (File2 != _FC_INVALID_FILE) _FC_PalClose(File2);
+		_FC_WorkFree(Window1);
+		_FC_WorkFree(Window2);
+		return Result;
+	}
+
+	/**
+	 * @brief Body of `FC_FilesEqualW`, run with the working-memory source already selected.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_FilesEqualEntry(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		FC_RESULT Result = FC_OK;
+		WCHAR* CanonicalPath1 = NULL;
+		WCHAR* CanonicalPath2 = NULL;
+
+		if (!_FC_ToCanonicalPath(Path1, &CanonicalPath1) ||
+			!_FC_ToCanonicalPath(Path2, &CanonicalPath2))
+		{
+			Result = FC_ERROR_INVALID_PARAM;
+			goto cleanup;
+		}
+
+		if (_FC_ShouldCompareAsText(CanonicalPath1, CanonicalPath2, Config))
+		{
+			_FC_LINE_STREAM StreamA, StreamB;
+			Result = _FC_LineStreamOpenFile(&StreamA, CanonicalPath1, Config);
+			FC_RESULT ResultB = _FC_LineStreamOpenFile(&StreamB, CanonicalPath2, Config);
+			if (Result == FC_OK)
+				Result = ResultB;
+			if (Result == FC_OK)
+				Result = _FC_LineStreamsEqual(&StreamA, &StreamB, Config);
+			_FC_LineStreamClose(&StreamA);
+			_FC_LineStreamClose(&StreamB);
+		}
+		else
+		{
+			Result = _FC_FilesBytesEqual(CanonicalPath1, CanonicalPath2);
+		}
+
+	cleanup:
+		_FC_WorkFree(CanonicalPath1);
+		_FC_WorkFree(CanonicalPath2);
+		return Result;
+	}
+
+	/**
+	 * @brief Tells whether two files are identical under a configuration, without diffing them.
+	 *
+	 * Returns the same FC_OK / FC_DIFFERENT answer as `FC_CompareFilesW` with the same
+	 * configuration, using the cheapest strategy for the selected mode:
+	 * - Binary: files of different sizes are different without being read; otherwise
+	 *   both files are compared window by window with `memcmp`, stopping at the first
+	 *   mismatching window.
+	 * - Text: lines are read, split and normalized (tabs, /W, /C, BOM) one at a time
+	 *   from both files and compared in lockstep, stopping at the first unequal line.
+	 *   No line tables, hash maps or LCS state are built.
+	 *
+	 * `Config->DiffCallback` may be NULL and is never called. `Config->Cache` and
+	 * `Config->ProgressCallback` are ignored.
+	 *
+	 * @param Path1 A null-terminated, wide (UTF-16) encoded path to the first file.
+	 * @param Path2 A null-terminated, wide (UTF-16) encoded path to the second file.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 *
+	 * @return An FC_RESULT code indicating the outcome of the check.
+	 * @retval FC_OK if the files are identical.
+	 * @retval FC_DIFFERENT if the files differ.
+	 * @retval FC_ERROR_INVALID_PARAM if a required pointer is NULL or a path is invalid.
+	 * @retval FC_ERROR_IO if a file cannot be read.
+	 * @retval FC_ERROR_MEMORY if a memory allocation fails.
+	 */
+	FC_RESULT
+		FC_FilesEqualW(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		if (!Path1 || !Path2 || !Config || !_FC_IsValidAllocator(&Config->Allocator))
+			return FC_ERROR_INVALID_PARAM;
+
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+		FC_RESULT Result = _FC_FilesEqualEntry(Path1, Path2, Config);
+		_FC_LeaveWork(Previous);
+		return Result;
+	}
+
+	/**
+	 * @brief Tells whether two in-memory buffers are identical under a configuration.
+	 *
+	 * The buffer counterpart of `FC_FilesEqualW`: returns the same answer as
+	 * `FC_CompareBuffers` with the same configuration. Binary inputs are compared by
+	 * length and a single `memcmp`; text inputs line by line without diff state.
+	 *
+	 * @param Buffer1 The first buffer. May be NULL only if Length1 is 0.
+	 * @param Length1 The length of the first buffer in bytes.
+	 * @param Buffer2 The second buffer. May be NULL only if Length2 is 0.
+	 * @param Length2 The length of the second buffer in bytes.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 *
+	 * @return FC_OK if the buffers are identical, FC_DIFFERENT if they differ,
+	 *         FC_ERROR_INVALID_PARAM or FC_ERROR_MEMORY.
+	 */
+	FC_RESULT
+		FC_BuffersEqual(
+			_In_reads_bytes_opt_(Length1) const void* Buffer1,
+			_In_ size_t Length1,
+			_In_reads_bytes_opt_(Length2) const void* Buffer2,
+			_In_ size_t Length2,
+			_In_ const FC_CONFIG* Config)
+	{
+		const unsigned char* Bytes1 = (const unsigned char*)Buffer1;
+		const unsigned char* Bytes2 = (const unsigned char*)Buffer2;
+		if (!Config || !_FC_IsValidAllocator(&Config->Allocator) ||
+			(!Bytes1 && Length1 > 0) || (!Bytes2 && Length2 > 0))
+			return FC_ERROR_INVALID_PARAM;
+		if (!Bytes1) Bytes1 = (const unsigned char*)"";
+		if (!Bytes2) Bytes2 = (const unsigned char*)"";
+
+		if (!_FC_ShouldCompareBuffersAsText(Bytes1, Length1, Bytes2, Length2, Config))
+			return (Length1 == Length2 && memcmp(Bytes1, Bytes2, Length1) == 0) ? FC_OK : FC_DIFFERENT;
+
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+		_FC_LINE_STREAM StreamA, StreamB;
+		_FC_LineStreamInitMemory(&StreamA, (const char*)Bytes1, Length1, Config);
+		_FC_LineStreamInitMemory(&StreamB, (const char*)Bytes2, Length2, Config);
+		FC_RESULT Result = _FC_LineStreamsEqual(&StreamA, &StreamB, Config);
+		_FC_LineStreamClose(&StreamA);
+		_FC_LineStreamClose(&StreamB);
+		_FC_LeaveWork(Previous);
+		return Result;
+	}
+
+	/* -------------------- Comparison Sessions -------------------- */
+
+	/**
+	 * @brief Prepares a session for one FC_Session* call.
+	 * @internal
+	 * @param Config The caller's configuration (for its allocator). May be NULL.
+	 * @param[out] Previous Receives the working-memory scope that was active on this thread.
+	 * @return FALSE if the session is NULL or already running a comparison.
+	 */
+	static inline BOOL
+		_FC_SessionBegin(
+			_In_opt_ FC_SESSION* Session,
+			_In_opt_ const FC_CONFIG* Config,
+			_Out_ _FC_WORK_SCOPE* Previous)
+	{
+		memset(Previous, 0, sizeof(*Previous));
+		if (Session == NULL || Session->Active)
+			return FALSE;
+		Session->Active = TRUE;
+		*Previous = _FC_EnterWork(Session, Config);
+		return TRUE;
+	}
+
+	/**
+	 * @brief Ends an FC_Session* call, dropping read buffers that grew past the retention cap.
+	 * @internal
+	 */
+	static inline void
+		_FC_SessionEnd(
+			_Inout_ FC_SESSION* Session,
+			_In_ _FC_WORK_SCOPE Previous)
+	{
+		if (Session->Read1.Capacity > FC_SESSION_MAX_RETAINED_BYTES)
+			_FC_BufferFree(&Session->Read1);
+		if (Session->Read2.Capacity > FC_SESSION_MAX_RETAINED_BYTES)
+			_FC_BufferFree(&Session->Read2);
+		_FC_LeaveWork(Previous);
+		Session->Active = FALSE;
+	}
+
+	/**
+	 * @brief Creates a reusable comparison session.
+	 *
+	 * A session owns a private heap and the file read buffers of its comparisons.
+	 * Line arrays, hash tables, LCS tables and canonical paths are carved from that
+	 * heap, whose freed blocks are recycled by the next comparison instead of going
+	 * back to the shared process heap, and read buffers keep their capacity (up to
+	 * `FC_SESSION_MAX_RETAINED_BYTES` each). This lowers the fixed cost of services
+	 * that compare many small pairs.
+	 *
+	 * @param[out] SessionOut Receives the new session, or NULL on failure.
+	 * @return FC_OK on success, FC_ERROR_INVALID_PARAM or FC_ERROR_MEMORY on failure.
+	 */
+	FC_RESULT
+		FC_SessionCreate(
+			_Outptr_result_maybenull_ FC_SESSION** SessionOut)
+	{
+		if (SessionOut == NULL)
+			return FC_ERROR_INVALID_PARAM;
+		*SessionOut = NULL;
+
+		FC_SESSION* Session = (FC_SESSION*)_FC_PalAlloc(_FC_PalProcessHeap(), _FC_ALLOC_ZERO, sizeof(FC_SESSION));
+		if (Session == NULL)
+			return FC_ERROR_MEMORY;
+
+		// Sessions are single-threaded by contract, so the heap needs no lock.
+		Session->Heap = _FC_PalHeapCreate();
+		if (Session->Heap == NULL)
 		{
-			Ptr += 3;
-			if (Ptr == End)
-				return FC_OK;
+			_FC_HeapFree(Session);
+			return FC_ERROR_MEMORY;
 		}
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(Session, NULL);
+		_FC_BufferInit(&Session->Read1, sizeof(char));
+		_FC_BufferInit(&Session->Read2, sizeof(char));
+		_FC_LeaveWork(Previous);
 
-		// Compute hash config once: clear FC_IGNORE_WS since text is already
-		// WS-normalized before hashing, so single preserved spaces are significant.
-		FC_CONFIG HashConfig = *Config;
-		if (HashConfig.Flags & FC_IGNORE_WS)
-			HashConfig.Flags &= ~(UINT)FC_IGNORE_WS;
+		*SessionOut = Session;
+		return FC_OK;
+	}
 
-		while (Ptr <= End)
+	/**
+	 * @brief Destroys a session and releases everything it retained.
+	 * @param Session The session to close. NULL is accepted and ignored.
+	 * @return FC_OK, or FC_ERROR_INVALID_PARAM if a comparison is still running on the session.
+	 */
+	FC_RESULT
+		FC_SessionClose(
+			_In_opt_ FC_SESSION* Session)
+	{
+		if (Session == NULL)
+			return FC_OK;
+		if (Session->Active)
+			return FC_ERROR_INVALID_PARAM;
+
+		// Destroying the private heap releases the buffers and any leftovers at once;
+		// read buffers on large pages live outside it.
+		_FC_BufferFree(&Session->Read1);
+		_FC_BufferFree(&Session->Read2);
+		_FC_PalHeapDestroy(Session->Heap);
+		_FC_HeapFree(Session);
+		return FC_OK;
+	}
+
+	/**
+	 * @brief Compares two files, reusing the memory of a session.
+	 *
+	 * Behaves exactly like `FC_CompareFilesW`, including path canonicalization and
+	 * `Config->Cache` lookups.
+	 *
+	 * Thread affinity: a session is not thread-safe. It must be used by one thread
+	 * at a time, although consecutive calls may come from different threads. Give
+	 * each worker thread its own session for parallel comparisons. A DiffCallback
+	 * may call the plain FC_Compare* functions, but not FC_Session* functions on
+	 * the session it is being called from.
+	 *
+	 * @param Session A session from `FC_SessionCreate`.
+	 * @param Path1 A null-terminated, wide (UTF-16) encoded path to the first file.
+	 * @param Path2 A null-terminated, wide (UTF-16) encoded path to the second file.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 * @return As for `FC_CompareFilesW`; FC_ERROR_INVALID_PARAM also if the session is NULL or busy.
+	 */
+	FC_RESULT
+		FC_SessionCompareFilesW(
+			_In_ FC_SESSION* Session,
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config)
+	{
+		_FC_WORK_SCOPE Previous;
+		if (!_FC_SessionBegin(Session, Config, &Previous))
+			return FC_ERROR_INVALID_PARAM;
+		FC_RESULT Result = _FC_CompareFilesEntry(Path1, Path2, Config);
+		_FC_SessionEnd(Session, Previous);
+		return Result;
+	}
+
+	/**
+	 * @brief Compares two in-memory buffers, reusing the memory of a session.
+	 *
+	 * Behaves exactly like `FC_CompareBuffers`; see `FC_SessionCompareFilesW` for
+	 * the thread-affinity rules.
+	 * @return As for `FC_CompareBuffers`; FC_ERROR_INVALID_PARAM also if the session is NULL or busy.
+	 */
+	FC_RESULT
+		FC_SessionCompareBuffers(
+			_In_ FC_SESSION* Session,
+			_In_reads_bytes_opt_(Length1) const void* Buffer1,
+			_In_ size_t Length1,
+			_In_reads_bytes_opt_(Length2) const void* Buffer2,
+			_In_ size_t Length2,
+			_In_ const FC_CONFIG* Config)
+	{
+		_FC_WORK_SCOPE Previous;
+		if (!_FC_SessionBegin(Session, Config, &Previous))
+			return FC_ERROR_INVALID_PARAM;
+		FC_RESULT Result = _FC_CompareBuffersEntry(Buffer1, Length1, Buffer2, Length2, Config);
+		_FC_SessionEnd(Session, Previous);
+		return Result;
+	}
+
+	/**
+	 * @brief Compares two in-memory texts line by line, reusing the memory of a session.
+	 *
+	 * Behaves exactly like `FC_CompareBuffersText`; see `FC_SessionCompareFilesW`
+	 * for the thread-affinity rules.
+	 * @return As for `FC_CompareBuffersText`; FC_ERROR_INVALID_PARAM also if the session is NULL or busy.
+	 */
+	FC_RESULT
+		FC_SessionCompareBuffersText(
+			_In_ FC_SESSION* Session,
+			_In_reads_bytes_opt_(Length1) const char* Text1,
+			_In_ size_t Length1,
+			_In_reads_bytes_opt_(Length2) const char* Text2,
+			_In_ size_t Length2,
+			_In_ const FC_CONFIG* Config)
+	{
+		_FC_WORK_SCOPE Previous;
+		if (!_FC_SessionBegin(Session, Config, &Previous))
+			return FC_ERROR_INVALID_PARAM;
+		FC_RESULT Result = _FC_CompareBuffersTextEntry(Text1, Length1, Text2, Length2, Config);
+		_FC_SessionEnd(Session, Previous);
+		return Result;
+	}
+
+	/* -------------------- Pull-Based Diff Iteration -------------------- */
+
+#ifndef FC_DIFF_ITERATOR_READ_BYTES
+#define FC_DIFF_ITERATOR_READ_BYTES (64u * 1024u)
+#endif
+
+	/**
+	 * @struct _FC_DIFF_ITERATOR
+	 * @brief State of one FC_DiffBegin/FC_DiffNext/FC_DiffEnd sequence.
+	 * @internal
+	 */
+	struct _FC_DIFF_ITERATOR
+	{
+		FC_CONFIG Config;           // Caller's configuration with DiffCallback routed to Pending.
+		WCHAR* Path1;               // Canonical paths.
+		WCHAR* Path2;
+		BOOL IsText;
+		BOOL Finished;              // Set once every block has been produced.
+		FC_USER_CONTEXT Context;    // Whole-file context handed out by FC_DiffGetContext.
+
+		// Text comparison: full line arrays and the chunk cursor.
+		_FC_BUFFER LinesA;
+		_FC_BUFFER LinesB;
+		size_t CurA;
+		size_t CurB;
+		size_t ChunkLines;
+		_FC_BUFFER Pending;         // FC_DIFF_BLOCKs of the chunk being consumed.
+		size_t PendingIndex;
+		FC_RESULT ChunkError;       // First allocation failure seen by the collector.
+
+		// Binary comparison: both files are read in lockstep, one window at a time.
+		_FC_FILE File1;
+		_FC_FILE File2;
+		ULONGLONG Size1;
+		ULONGLONG Size2;
+		ULONGLONG WindowBase;       // File offset of Window1[0].
+		size_t WindowFill;          // Valid bytes in both windows.
+		size_t WindowPos;           // Next byte to examine.
+		unsigned char* Window1;
+		unsigned char* Window2;
+	};
+
+	/**
+	 * @brief DiffCallback that queues the blocks of one chunk for FC_DiffNext.
+	 * @internal
+	 */
+	static void
+		_FC_DiffIteratorCollect(
+			_In_ const FC_USER_CONTEXT* Context,
+			_In_ const FC_DIFF_BLOCK* Block)
+	{
+		FC_DIFF_ITERATOR* Iter = (FC_DIFF_ITERATOR*)Context->UserData;
+		if (!_FC_BufferAppend(&Iter->Pending, Block))
+			Iter->ChunkError = FC_ERROR_MEMORY;
+	}
+
+	/**
+	 * @brief Reads the next window of the common prefix of both binary inputs.
+	 * @internal
+	 * @return FC_OK (WindowFill is 0 once the common prefix is exhausted) or FC_ERROR_IO.
+	 */
+	static FC_RESULT
+		_FC_DiffIteratorFillWindow(
+			_Inout_ FC_DIFF_ITERATOR* Iter)
+	{
+		ULONGLONG Common = Iter->Size1 < Iter->Size2 ? Iter->Size1 : Iter->Size2;
+		Iter->WindowBase += Iter->WindowFill;
+		Iter->WindowFill = 0;
+		Iter->WindowPos = 0;
+		if (Iter->WindowBase >= Common)
+			return FC_OK;
+
+		size_t ToRead = (Common - Iter->WindowBase > FC_DIFF_ITERATOR_READ_BYTES)
+			? FC_DIFF_ITERATOR_READ_BYTES : (size_t)(Common - Iter->WindowBase);
+		if (!_FC_ReadFully(Iter->File1, Iter->WindowBase, Iter->Window1, ToRead) ||
+			!_FC_ReadFully(Iter->File2, Iter->WindowBase, Iter->Window2, ToRead))
+			return FC_ERROR_IO; // Read failure or unexpected EOF before the advertised size.
+		Iter->WindowFill = ToRead;
+		return FC_OK;
+	}
+
+	/**
+	 * @brief Opens both files and prepares the state for the text or binary walk.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_DiffIteratorPrepare(
+			_Inout_ FC_DIFF_ITERATOR* Iter)
+	{
+		FC_RESULT Result = FC_OK;
+		Iter->IsText = _FC_ShouldCompareAsText(Iter->Path1, Iter->Path2, &Iter->Config);
+
+		if (Iter->IsText)
 		{
-			// This condition handles the last line if the file doesn't end with a newline.
-			if (Ptr == End)
+			size_t Length1 = 0, Length2 = 0;
+			char* Buffer1 = _FC_ReadFileContents(Iter->Path1, &Length1, &Result);
+			char* Buffer2 = Buffer1 ? _FC_ReadFileContents(Iter->Path2, &Length2, &Result) : NULL;
+			if (Buffer1 && Buffer2)
 			{
-				if (BufferLength == 0 || Buffer[BufferLength - 1] == '\n' || Buffer[BufferLength - 1] == '\r')
-				{
-					break; // Don't process a zero-length line at the very end.
-				}
+				Result = _FC_ParseLines(Buffer1, Length1, &Iter->LinesA, &Iter->Config);
+				if (Result == FC_OK)
+					Result = _FC_ParseLines(Buffer2, Length2, &Iter->LinesB, &Iter->Config);
+				LONGLONG MaxBytes = (Length1 > Length2) ? (LONGLONG)Length1 : (LONGLONG)Length2;
+				Iter->ChunkLines = _FC_ComputeChunkSize(MaxBytes, Iter->Config.BufferLines);
 			}
+			// The raw contents are not needed once the lines have been parsed.
+			_FC_WorkFree(Buffer1);
+			_FC_WorkFree(Buffer2);
 
-			const char* Newline = Ptr;
-			while (Newline < End && *Newline != '\n' && *Newline != '\r')
-			{
-				Newline++;
-			}
-			size_t LineLength = (size_t)(Newline - Ptr);
+			Iter->Context.Lines1 = &Iter->LinesA;
+			Iter->Context.Lines2 = &Iter->LinesB;
+			return Result;
+		}
 
-			_FC_BUFFER textBuffer = { 0 };
-			_FC_BufferInit(&textBuffer, sizeof(char));
-			if (!_FC_BufferAppendRange(&textBuffer, Ptr, LineLength))
-			{
-				_FC_BufferFree(&textBuffer);
-				return FC_ERROR_MEMORY;
-			}
+		Iter->File1 = _FC_PalOpenRead(Iter->Path1, TRUE);
+		Iter->File2 = _FC_PalOpenRead(Iter->Path2, TRUE);
+		if (Iter->File1 == _FC_INVALID_FILE || Iter->File2 == _FC_INVALID_FILE)
+			return FC_ERROR_IO;
 
-			if (!(Config->Flags & FC_RAW_TABS))
-			{
-				// Expand tabs using 8-column tab stops, matching fc.exe/ReactOS behavior.
-				_FC_BUFFER expandedBuffer = { 0 };
-				_FC_BufferInit(&expandedBuffer, sizeof(char));
-				int col = 0;
-				for (size_t ti = 0; ti < textBuffer.Count; ti++)
-				{
-					char c = *(const char*)_FC_BufferGet(&textBuffer, ti);
-					if (c == '\t')
-					{
-						int nSpaces = 8 - (col % 8);
-						for (int si = 0; si < nSpaces; si++)
-						{
-							char sp = ' ';
-							if (!_FC_BufferAppend(&expandedBuffer, &sp))
-							{
-								_FC_BufferFree(&expandedBuffer);
-								_FC_BufferFree(&textBuffer);
-								return FC_ERROR_MEMORY;
-							}
-						}
-						col += nSpaces;
-					}
-					else
-					{
-						if (!_FC_BufferAppend(&expandedBuffer, &c))
-						{
-							_FC_BufferFree(&expandedBuffer);
-							_FC_BufferFree(&textBuffer);
-							return FC_ERROR_MEMORY;
-						}
-						// ParseLines never places newlines in the text buffer;
-						// this reset is defensive in case the invariant changes.
-						if (c == '\n' || c == '\r')
-							col = 0;
-						else
-							col++;
-					}
-				}
-				_FC_BufferFree(&textBuffer);
-				textBuffer = expandedBuffer;
-			}
+		if (!_FC_PalFileSize(Iter->File1, &Iter->Size1) || !_FC_PalFileSize(Iter->File2, &Iter->Size2))
+			return FC_ERROR_IO;
+
+		Iter->Window1 = (unsigned char*)_FC_WorkAlloc(0, FC_DIFF_ITERATOR_READ_BYTES);
+		Iter->Window2 = (unsigned char*)_FC_WorkAlloc(0, FC_DIFF_ITERATOR_READ_BYTES);
+		if (Iter->Window1 == NULL || Iter->Window2 == NULL)
+			return FC_ERROR_MEMORY;
+		return _FC_DiffIteratorFillWindow(Iter);
+	}
 
-			if (Config->Flags & FC_IGNORE_WS)
+	/**
+	 * @brief Produces the next block of a text iteration, running chunks until one yields blocks.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_DiffIteratorNextText(
+			_Inout_ FC_DIFF_ITERATOR* Iter,
+			_Out_ FC_DIFF_BLOCK* Block)
+	{
+		while (Iter->PendingIndex >= Iter->Pending.Count)
+		{
+			if (Iter->CurA >= Iter->LinesA.Count && Iter->CurB >= Iter->LinesB.Count)
 			{
-				// Compress whitespace: trim leading/trailing, collapse internal runs
-				// to a single space. Matches Windows fc.exe /W: "Compresses white space
-				// (tabs and spaces) during comparison."
-				_FC_BUFFER compressedBuffer;
-				_FC_BufferInit(&compressedBuffer, sizeof(char));
-				size_t wsStart = 0, wsEnd = textBuffer.Count;
-				// Trim leading whitespace.
-				while (wsStart < wsEnd)
-				{
-					char c = *(const char*)_FC_BufferGet(&textBuffer, wsStart);
-					if (c == ' ' || c == '\t') wsStart++;
-					else break;
-				}
-				// Trim trailing whitespace.
-				while (wsEnd > wsStart)
-				{
-					char c = *(const char*)_FC_BufferGet(&textBuffer, wsEnd - 1);
-					if (c == ' ' || c == '\t') wsEnd--;
-					else break;
-				}
-				// Collapse internal runs of whitespace to a single space.
-				BOOL inSpace = FALSE;
-				for (size_t ci = wsStart; ci < wsEnd; ci++)
-				{
-					char c = *(const char*)_FC_BufferGet(&textBuffer, ci);
-					if (c == ' ' || c == '\t')
-					{
-						if (!inSpace)
-						{
-							char sp = ' ';
-							if (!_FC_BufferAppend(&compressedBuffer, &sp))
-							{
-								_FC_BufferFree(&compressedBuffer);
-								_FC_BufferFree(&textBuffer);
-								return FC_ERROR_MEMORY;
-							}
-							inSpace = TRUE;
-						}
-					}
-					else
-					{
-						if (!_FC_BufferAppend(&compressedBuffer, &c))
-						{
-							_FC_BufferFree(&compressedBuffer);
-							_FC_BufferFree(&textBuffer);
-							return FC_ERROR_MEMORY;
-						}
-						inSpace = FALSE;
-					}
-				}
-				_FC_BufferFree(&textBuffer);
-				textBuffer = compressedBuffer;
+				Iter->Finished = TRUE;
+				return FC_OK;
 			}
 
-			size_t FinalLength = textBuffer.Count;
-			char* FinalText = _FC_BufferToString(&textBuffer);
+			// Only the blocks of one chunk are held at a time.
+			Iter->Pending.Count = 0;
+			Iter->PendingIndex = 0;
+			FC_RESULT ChunkResult = _FC_ProcessNextChunk(Iter->Path1, Iter->Path2,
+				&Iter->LinesA, &Iter->LinesB, Iter->ChunkLines, &Iter->CurA, &Iter->CurB, &Iter->Config, NULL);
+			if (ChunkResult == FC_ERROR_MEMORY || ChunkResult == FC_ERROR_IO)
+				return ChunkResult;
+			if (Iter->ChunkError != FC_OK)
+				return Iter->ChunkError;
+		}
 
-			if (FinalText == NULL)
-			{
-				return FC_ERROR_MEMORY; // _FC_BufferToString frees on failure
-			}
+		*Block = *(const FC_DIFF_BLOCK*)_FC_BufferGet(&Iter->Pending, Iter->PendingIndex++);
+		return FC_DIFFERENT;
+	}
 
-			// If ignoring whitespace and the line becomes empty, discard it.
-			if ((Config->Flags & FC_IGNORE_WS) && FinalLength == 0)
-			{
-				HeapFree(GetProcessHeap(), 0, FinalText);
-			}
-			else
+	/**
+	 * @brief Produces the next mismatching byte, then the size difference, of a binary iteration.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_DiffIteratorNextBinary(
+			_Inout_ FC_DIFF_ITERATOR* Iter,
+			_Out_ FC_DIFF_BLOCK* Block)
+	{
+		while (Iter->WindowFill > 0)
+		{
+			for (size_t i = Iter->WindowPos; i < Iter->WindowFill; i++)
 			{
-				_FC_LINE line;
-				line.Text = FinalText;
-				line.Length = FinalLength;
-				line.Hash = _FC_HashLine(FinalText, FinalLength, &HashConfig);
-
-				if (!_FC_BufferAppend(pLineBuffer, &line))
+				if (Iter->Window1[i] != Iter->Window2[i])
 				{
-					HeapFree(GetProcessHeap(), 0, FinalText);
-					return FC_ERROR_MEMORY;
+					size_t Offset = (size_t)(Iter->WindowBase + i);
+					FC_DIFF_BLOCK Change = { FC_DIFF_TYPE_CHANGE, Offset, Iter->Window1[i], Offset, Iter->Window2[i] };
+					*Block = Change;
+					Iter->WindowPos = i + 1;
+					return FC_DIFFERENT;
 				}
 			}
+			FC_RESULT Result = _FC_DiffIteratorFillWindow(Iter);
+			if (Result != FC_OK)
+				return Result;
+		}
 
-			if (Newline >= End)
-			{
-				break; // Reached end of buffer
-			}
-
-			Ptr = Newline;
-			while (Ptr < End && (*Ptr == '\n' || *Ptr == '\r'))
-			{
-				Ptr++;
-			}
+		// The size difference follows the byte mismatches, as in the callback API.
+		Iter->Finished = TRUE;
+		if (Iter->Size1 != Iter->Size2)
+		{
+			FC_DIFF_BLOCK Size = { FC_DIFF_TYPE_SIZE,
+				(size_t)Iter->Size1, (size_t)Iter->Size1, (size_t)Iter->Size2, (size_t)Iter->Size2 };
+			*Block = Size;
+			return FC_DIFFERENT;
 		}
 		return FC_OK;
 	}
 
 	/**
-	 * @brief Reads the entire contents of a file into a new heap-allocated buffer.
+	 * @brief Releases everything an iterator owns. Safe on partially prepared iterators.
 	 * @internal
-	 * @param Path The wide character path to the file to read.
-	 * @param[out] OutputLength A pointer to a size_t that will receive the number of bytes read.
-	 * @param[out] Result A pointer to an FC_RESULT that will be set to indicate the outcome.
-	 * @return A pointer to a new, null-terminated buffer containing the file's content, or NULL on failure. The caller must free this memory.
-	 *
-	 * The file is read in fixed-size chunks to avoid single-call `ReadFile` limits and
-	 * reduce large transient allocation pressure.
 	 */
-	static inline char*
-		_FC_ReadFileContents(
-			_In_z_ const WCHAR* Path,
-			_Out_ size_t* OutputLength,
-			_Out_ FC_RESULT* Result)
+	static void
+		_FC_DiffIteratorFree(
+			_In_opt_ FC_DIFF_ITERATOR* Iter)
+	{
+		if (Iter == NULL)
+			return;
+		_FC_FreeLineBufferContents(&Iter->LinesA);
+		_FC_FreeLineBufferContents(&Iter->LinesB);
+		_FC_BufferFree(&Iter->Pending);
+		if (Iter->File1 != _FC_INVALID_FILE) _FC_PalClose(Iter->File1);
+		if (Iter->File2 != _FC_INVALID_FILE) _FC_PalClose(Iter->File2);
+		_FC_WorkFree(Iter->Window1);
+		_FC_WorkFree(Iter->Window2);
+		_FC_WorkFree(Iter->Path1);
+		_FC_WorkFree(Iter->Path2);
+		_FC_WorkFree(Iter);
+	}
+
+	/**
+	 * @brief Starts a pull-based comparison of two files.
+	 *
+	 * Instead of pushing every difference into `Config->DiffCallback` from inside the
+	 * LCS, the iterator hands out one `FC_DIFF_BLOCK` per `FC_DiffNext` call. Text
+	 * comparisons run one chunk of the chunked LCS at a time, when the blocks of the
+	 * previous chunk have been consumed, so LCS scratch memory and queued blocks are
+	 * bounded by the chunk size (the parsed line arrays cover the whole files, as with
+	 * the callback API). Binary comparisons read both files in lockstep and stop at
+	 * each mismatching byte. Blocks, their order and their indices are the same as the
+	 * callback API would report; text indices are absolute line numbers.
+	 *
+	 * Mode selection and path validation match `FC_CompareFilesW`. `Config->DiffCallback`
+	 * may be NULL and is ignored, as are `Config->Cache` and `Config->ProgressCallback`:
+	 * the caller paces the work and can stop at any time with `FC_DiffEnd`. The
+	 * configuration is copied; it need not outlive this call.
+	 *
+	 * An iterator is not thread-safe. It allocates from `Config->Allocator` when set,
+	 * otherwise from the process heap.
+	 *
+	 * @param Path1 A null-terminated, wide (UTF-16) encoded path to the first file.
+	 * @param Path2 A null-terminated, wide (UTF-16) encoded path to the second file.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 * @param[out] IteratorOut Receives the iterator, or NULL on failure.
+	 * @return FC_OK on success, or FC_ERROR_INVALID_PARAM, FC_ERROR_IO or FC_ERROR_MEMORY.
+	 */
+	FC_RESULT
+		FC_DiffBegin(
+			_In_z_ const WCHAR* Path1,
+			_In_z_ const WCHAR* Path2,
+			_In_ const FC_CONFIG* Config,
+			_Outptr_result_maybenull_ FC_DIFF_ITERATOR** IteratorOut)
 	{
-		*OutputLength = 0;
-		*Result = FC_OK;
-		HANDLE FileHandle = INVALID_HANDLE_VALUE;
-		char* Buffer = NULL;
-		_FC_BUFFER FileBuffer = { 0 };
-		_FC_BufferInit(&FileBuffer, sizeof(char));
+		FC_RESULT Result = FC_OK;
+		FC_DIFF_ITERATOR* Iter = NULL;
+		if (IteratorOut == NULL)
+			return FC_ERROR_INVALID_PARAM;
+		*IteratorOut = NULL;
+		if (!Path1 || !Path2 || !Config)
+			return FC_ERROR_INVALID_PARAM;
 
-		FileHandle = CreateFileW(
-			Path,
-			GENERIC_READ,
-			FILE_SHARE_READ,
-			NULL,
-			OPEN_EXISTING,
-			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
-			NULL);
+		if (!_FC_IsValidAllocator(&Config->Allocator))
+			return FC_ERROR_INVALID_PARAM;
 
-		if (FileHandle == INVALID_HANDLE_VALUE)
-		{
-			*Result = FC_ERROR_IO;
-			return NULL;
-		}
+		// The iterator outlives this call, so it never lives on a session heap.
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
 
-		LARGE_INTEGER FileSize;
-		if (!GetFileSizeEx(FileHandle, &FileSize))
+		Iter = (FC_DIFF_ITERATOR*)_FC_WorkAlloc(_FC_ALLOC_ZERO, sizeof(FC_DIFF_ITERATOR));
+		if (Iter == NULL)
 		{
-			*Result = FC_ERROR_IO;
+			Result = FC_ERROR_MEMORY;
 			goto cleanup;
 		}
-
-		if (FileSize.QuadPart > (ULONGLONG)SIZE_MAX - 1)
+		Iter->File1 = _FC_INVALID_FILE;
+		Iter->File2 = _FC_INVALID_FILE;
+		_FC_BufferInit(&Iter->LinesA, sizeof(_FC_LINE));
+		_FC_BufferInit(&Iter->LinesB, sizeof(_FC_LINE));
+		_FC_BufferInit(&Iter->Pending, sizeof(FC_DIFF_BLOCK));
+
+		Iter->Config = *Config;
+		Iter->Config.DiffCallback = _FC_DiffIteratorCollect;
+		Iter->Config.UserData = Iter;
+		Iter->Config.Cache = NULL;
+		Iter->Config.ProgressCallback = NULL;
+		Iter->Config.Stats = NULL;
+
+		if (!_FC_ToCanonicalPath(Path1, &Iter->Path1) ||
+			!_FC_ToCanonicalPath(Path2, &Iter->Path2))
 		{
-			*Result = FC_ERROR_MEMORY; // File too large
+			Result = FC_ERROR_INVALID_PARAM;
 			goto cleanup;
 		}
+		Iter->Context.Path1 = Iter->Path1;
+		Iter->Context.Path2 = Iter->Path2;
+		Iter->Context.UserData = Config->UserData;
 
-		size_t LengthHint = (size_t)FileSize.QuadPart;
-		if (LengthHint > 0 && !_FC_BufferEnsureCapacity(&FileBuffer, LengthHint))
-		{
-			*Result = FC_ERROR_MEMORY;
-			goto cleanup;
-		}
+		Result = _FC_DiffIteratorPrepare(Iter);
 
-		#pragma warning(push)
-		#pragma warning(disable:6262)  // Stack usage warning: benign for scoped read chunk
-		{
-			enum { FC_READ_CHUNK = 64 * 1024 };
-			char ReadChunk[FC_READ_CHUNK];
-			for (;;)
-			{
-				DWORD BytesRead = 0;
-				if (!ReadFile(FileHandle, ReadChunk, FC_READ_CHUNK, &BytesRead, NULL))
-				{
-					*Result = FC_ERROR_IO;
-					goto cleanup;
-				}
-				if (BytesRead == 0)
-					break; // EOF
+	cleanup:
+		if (Result != FC_OK)
+			_FC_DiffIteratorFree(Iter);
+		else
+			*IteratorOut = Iter;
+		_FC_LeaveWork(Previous);
+		return Result;
+	}
 
-				if (!_FC_BufferAppendRange(&FileBuffer, ReadChunk, (size_t)BytesRead))
-				{
-					*Result = FC_ERROR_MEMORY;
-					goto cleanup;
-				}
-			}
-		}
-		#pragma warning(pop)
+	/**
+	 * @brief Retrieves the next difference of an iteration.
+	 *
+	 * @param Iterator An iterator from `FC_DiffBegin`.
+	 * @param[out] Block Receives the next difference when FC_DIFFERENT is returned.
+	 * @return FC_DIFFERENT if *Block holds the next difference, FC_OK once the iteration
+	 *         is complete (and on every later call), or FC_ERROR_IO / FC_ERROR_MEMORY /
+	 *         FC_ERROR_INVALID_PARAM. After an error the iterator can only be ended.
+	 */
+	FC_RESULT
+		FC_DiffNext(
+			_Inout_ FC_DIFF_ITERATOR* Iterator,
+			_Out_ FC_DIFF_BLOCK* Block)
+	{
+		if (Iterator == NULL || Block == NULL)
+			return FC_ERROR_INVALID_PARAM;
+		if (Iterator->Finished)
+			return FC_OK;
 
-		// Ensure null-termination.
-		if (!_FC_BufferEnsureCapacity(&FileBuffer, 1))
-		{
-			*Result = FC_ERROR_MEMORY;
-			goto cleanup;
-		}
-		((char*)FileBuffer.pData)[FileBuffer.Count] = '\0';
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, &Iterator->Config);
+		FC_RESULT Result = Iterator->IsText
+			? _FC_DiffIteratorNextText(Iterator, Block)
+			: _FC_DiffIteratorNextBinary(Iterator, Block);
+		_FC_LeaveWork(Previous);
+		return Result;
+	}
+
+	/**
+	 * @brief Returns the whole-file context of an iteration, for formatting blocks.
+	 *
+	 * For text iterations `Lines1` and `Lines2` cover every line of both files and the
+	 * offsets are 0, so block indices address them directly. For binary iterations
+	 * `Lines1` and `Lines2` are NULL, as in the callback API. `UserData` is the caller's `Config->UserData`. The context
+	 * stays valid until `FC_DiffEnd`.
+	 *
+	 * @param Iterator An iterator from `FC_DiffBegin`.
+	 * @return The context, or NULL if Iterator is NULL.
+	 */
+	const FC_USER_CONTEXT*
+		FC_DiffGetContext(
+			_In_opt_ const FC_DIFF_ITERATOR* Iterator)
+	{
+		return Iterator ? &Iterator->Context : NULL;
+	}
 
-		Buffer = (char*)FileBuffer.pData;
-		*OutputLength = FileBuffer.Count;
-		FileBuffer.pData = NULL;
-		FileBuffer.Count = 0;
-		FileBuffer.Capacity = 0;
+	/**
+	 * @brief Ends an iteration, possibly before the last block, and frees the iterator.
+	 * @param Iterator The iterator to end. NULL is accepted and ignored.
+	 */
+	void
+		FC_DiffEnd(
+			_In_opt_ FC_DIFF_ITERATOR* Iterator)
+	{
+		// The iterator frees itself, so its configuration is copied out first.
+		FC_CONFIG Owner = { 0 };
+		if (Iterator != NULL)
+			Owner = Iterator->Config;
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, &Owner);
+		_FC_DiffIteratorFree(Iterator);
+		_FC_LeaveWork(Previous);
+	}
 
-	cleanup:
-		_FC_BufferFree(&FileBuffer);
-		if (FileHandle != INVALID_HANDLE_VALUE)
+	/* -------------------- Three-Way Comparison and Merge -------------------- */
+
+	//
+	// FC_Merge3W parses base, local and remote once, diffs base against each side
+	// with the regular chunked LCS (the two diffs run on separate threads for
+	// large inputs), and walks both matchings together as diff3 does: runs of base
+	// lines matched identically on both sides are unchanged, and every stretch in
+	// between is classified by which sides differ from the base there.
+	//
+
+	// Inputs with at least this many base lines diff against the two sides in parallel.
+#ifndef FC_MERGE_PARALLEL_MIN_LINES
+#define FC_MERGE_PARALLEL_MIN_LINES 20000u
+#endif
+
+	/**
+	 * @struct _FC_MERGE_DIFF
+	 * @brief One base-to-side diff of a three-way comparison.
+	 * @internal
+	 */
+	typedef struct
+	{
+		const _FC_BUFFER* Base;     // Parsed base lines.
+		const _FC_BUFFER* Side;     // Parsed local or remote lines.
+		size_t ChunkLines;
+		const FC_CONFIG* Owner;     // Caller's configuration, for the worker's memory scope.
+		FC_CONFIG Config;           // Owner with DiffCallback routed to Blocks.
+		_FC_BUFFER Blocks;          // FC_DIFF_BLOCKs in base order.
+		BOOL OutOfMemory;
+		FC_RESULT Result;
+	} _FC_MERGE_DIFF;
+
+	static void
+		_FC_MergeCollect(
+			_In_ const FC_USER_CONTEXT* Context,
+			_In_ const FC_DIFF_BLOCK* Block)
+	{
+		_FC_MERGE_DIFF* Diff = (_FC_MERGE_DIFF*)Context->UserData;
+		if (!_FC_BufferAppend(&Diff->Blocks, Block))
+			Diff->OutOfMemory = TRUE;
+	}
+
+	/**
+	 * @brief Runs the chunked LCS of one base-to-side diff, collecting its blocks.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_MergeRunDiff(
+			_Inout_ _FC_MERGE_DIFF* Diff)
+	{
+		size_t CurA = 0, CurB = 0;
+		while (CurA < Diff->Base->Count || CurB < Diff->Side->Count)
 		{
-			CloseHandle(FileHandle);
+			FC_RESULT ChunkResult = _FC_ProcessNextChunk(NULL, NULL, Diff->Base, Diff->Side,
+				Diff->ChunkLines, &CurA, &CurB, &Diff->Config, NULL);
+			if (ChunkResult == FC_ERROR_MEMORY || ChunkResult == FC_ERROR_IO)
+				return ChunkResult;
+			if (Diff->OutOfMemory)
+				return FC_ERROR_MEMORY;
 		}
-		return Buffer;
+		return FC_OK;
 	}
 
-	static inline BOOL
-		_FC_GetFileSizeW(
-			_In_z_ const WCHAR* Path,
-			_Out_ ULONGLONG* SizeOut)
+	static void
+		_FC_MergeDiffThread(
+			_In_ void* Parameter)
 	{
-		if (Path == NULL || SizeOut == NULL)
-			return FALSE;
-
-		*SizeOut = 0;
-		HANDLE hFile = CreateFileW(
-			Path,
-			GENERIC_READ,
-			FILE_SHARE_READ,
-			NULL,
-			OPEN_EXISTING,
-			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
-			NULL);
-		if (hFile == INVALID_HANDLE_VALUE)
-			return FALSE;
-
-		LARGE_INTEGER Size;
-		BOOL ok = GetFileSizeEx(hFile, &Size);
-		CloseHandle(hFile);
-		if (!ok || Size.QuadPart < 0)
-			return FALSE;
+		_FC_MERGE_DIFF* Diff = (_FC_MERGE_DIFF*)Parameter;
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Diff->Owner);
+		// FC_STATS is filled by the calling thread only; the two side diffs run at once.
+		g_FcWork.Stats = NULL;
+		Diff->Result = _FC_MergeRunDiff(Diff);
+		_FC_LeaveWork(Previous);
+	}
 
-		*SizeOut = (ULONGLONG)Size.QuadPart;
-		return TRUE;
+	/**
+	 * @brief Turns the blocks of a diff into a base-indexed matching.
+	 *
+	 * Lines between blocks are matched one to one, as in `_FC_ReportLcsChain`.
+	 * @internal
+	 * @param[out] Match Receives, for each base line, the matching side line or SIZE_MAX.
+	 */
+	static void
+		_FC_MergeBuildMatching(
+			_In_ const _FC_MERGE_DIFF* Diff,
+			_Out_writes_(Diff->Base->Count) size_t* Match)
+	{
+		size_t BaseCount = Diff->Base->Count;
+		size_t b = 0, s = 0;
+		for (size_t i = 0; i <= Diff->Blocks.Count; i++)
+		{
+			const FC_DIFF_BLOCK* Block = (i < Diff->Blocks.Count)
+				? (const FC_DIFF_BLOCK*)_FC_BufferGet(&Diff->Blocks, i) : NULL;
+			size_t GapEndA = Block ? Block->StartA : BaseCount;
+			size_t GapEndB = Block ? Block->StartB : Diff->Side->Count;
+			while (b < GapEndA && s < GapEndB)
+				Match[b++] = s++;
+			while (b < GapEndA)
+				Match[b++] = SIZE_MAX;
+			if (Block != NULL)
+			{
+				for (; b < Block->EndA; b++)
+					Match[b] = SIZE_MAX;
+				if (s < Block->EndB)
+					s = Block->EndB;
+			}
+		}
 	}
 
-	static inline ULONGLONG
-		_FC_GetEffectiveTextLimitBytes(
+	/**
+	 * @brief Returns TRUE if two line ranges hold equal lines under the configuration.
+	 * @internal
+	 */
+	static BOOL
+		_FC_MergeRangesEqual(
+			_In_ const _FC_BUFFER* LinesA,
+			_In_ size_t StartA,
+			_In_ size_t EndA,
+			_In_ const _FC_BUFFER* LinesB,
+			_In_ size_t StartB,
+			_In_ size_t EndB,
 			_In_ const FC_CONFIG* Config)
 	{
-		if (Config != NULL && Config->MaxTextFileBytes > 0)
-			return (ULONGLONG)Config->MaxTextFileBytes;
-		return (ULONGLONG)FC_DEFAULT_MAX_TEXT_FILE_BYTES;
+		if (EndA - StartA != EndB - StartB)
+			return FALSE;
+		for (size_t i = 0; i < EndA - StartA; i++)
+		{
+			const _FC_LINE* LineA = (const _FC_LINE*)_FC_BufferGet(LinesA, StartA + i);
+			const _FC_LINE* LineB = (const _FC_LINE*)_FC_BufferGet(LinesB, StartB + i);
+			if (LineA->Hash != LineB->Hash || !_FC_LinesEqual(LineA, LineB, Config))
+				return FALSE;
+		}
+		return TRUE;
 	}
 
-	static inline ULONGLONG
-		_FC_GetEffectiveBinaryStreamThresholdBytes(void)
+	/**
+	 * @brief Appends a region, extending the previous one when both have the same type.
+	 * @internal
+	 */
+	static BOOL
+		_FC_MergeAddRegion(
+			_Inout_ _FC_BUFFER* Regions,
+			_In_ const FC_MERGE_REGION* Region)
 	{
-#if defined(FC_TESTING)
-		WCHAR value[32];
-		DWORD len = GetEnvironmentVariableW(L"FC_BINARY_STREAM_THRESHOLD_OVERRIDE", value, _FC_ARRAYSIZE(value));
-		if (len > 0 && len < _FC_ARRAYSIZE(value))
+		if (Regions->Count > 0)
 		{
-			WCHAR* endptr = NULL;
-			unsigned __int64 parsed = _wcstoui64(value, &endptr, 10);
-			if (endptr != value && *endptr == L'\0')
-				return (ULONGLONG)parsed;
+			FC_MERGE_REGION* Last = (FC_MERGE_REGION*)_FC_BufferGet(Regions, Regions->Count - 1);
+			if (Last->Type == Region->Type)
+			{
+				Last->BaseEnd = Region->BaseEnd;
+				Last->LocalEnd = Region->LocalEnd;
+				Last->RemoteEnd = Region->RemoteEnd;
+				return TRUE;
+			}
 		}
-#endif
-		return (ULONGLONG)FC_BINARY_STREAM_THRESHOLD_BYTES;
+		return _FC_BufferAppend(Regions, Region);
 	}
 
-	static inline BOOL
-		_FC_ShouldUseBinaryForLargeText(
-			_In_z_ const WCHAR* Path1,
-			_In_z_ const WCHAR* Path2,
-			_In_ const FC_CONFIG* Config)
+	/**
+	 * @brief Walks the base-to-local and base-to-remote matchings together (diff3).
+	 * @internal
+	 * @param[out] Regions Receives the aligned FC_MERGE_REGIONs covering all three inputs.
+	 */
+	static FC_RESULT
+		_FC_MergeClassify(
+			_In_ const _FC_BUFFER* Base,
+			_In_ const _FC_BUFFER* Local,
+			_In_ const _FC_BUFFER* Remote,
+			_In_reads_(Base->Count) const size_t* MatchLocal,
+			_In_reads_(Base->Count) const size_t* MatchRemote,
+			_In_ const FC_CONFIG* Config,
+			_Inout_ _FC_BUFFER* Regions)
 	{
-		ULONGLONG limit = _FC_GetEffectiveTextLimitBytes(Config);
-		ULONGLONG size1 = 0, size2 = 0;
+		size_t o = 0, a = 0, b = 0;
+		while (o < Base->Count || a < Local->Count || b < Remote->Count)
+		{
+			FC_MERGE_REGION Region = { FC_MERGE_UNCHANGED, o, o, a, a, b, b };
 
-		// Fail-open: if probing size fails, preserve existing behavior.
-		if (!_FC_GetFileSizeW(Path1, &size1) || !_FC_GetFileSizeW(Path2, &size2))
-			return FALSE;
+			// A stable run: base lines matched in step on both sides.
+			size_t Run = 0;
+			while (o + Run < Base->Count &&
+				MatchLocal[o + Run] == a + Run && MatchRemote[o + Run] == b + Run)
+				Run++;
 
-		return (size1 > limit || size2 > limit);
+			if (Run > 0)
+			{
+				Region.BaseEnd = o + Run;
+				Region.LocalEnd = a + Run;
+				Region.RemoteEnd = b + Run;
+			}
+			else
+			{
+				// An unstable stretch ends at the next base line both sides still match.
+				size_t j = o;
+				while (j < Base->Count && (MatchLocal[j] == SIZE_MAX || MatchRemote[j] == SIZE_MAX))
+					j++;
+				Region.BaseEnd = j;
+				Region.LocalEnd = (j < Base->Count) ? MatchLocal[j] : Local->Count;
+				Region.RemoteEnd = (j < Base->Count) ? MatchRemote[j] : Remote->Count;
+
+				BOOL LocalSame = _FC_MergeRangesEqual(Base, o, j, Local, a, Region.LocalEnd, Config);
+				BOOL RemoteSame = _FC_MergeRangesEqual(Base, o, j, Remote, b, Region.RemoteEnd, Config);
+				if (LocalSame && RemoteSame)
+					Region.Type = FC_MERGE_UNCHANGED;
+				else if (LocalSame)
+					Region.Type = FC_MERGE_REMOTE;
+				else if (RemoteSame)
+					Region.Type = FC_MERGE_LOCAL;
+				else if (_FC_MergeRangesEqual(Local, a, Region.LocalEnd, Remote, b, Region.RemoteEnd, Config))
+					Region.Type = FC_MERGE_BOTH;
+				else
+					Region.Type = FC_MERGE_CONFLICT;
+			}
+
+			if (!_FC_MergeAddRegion(Regions, &Region))
+				return FC_ERROR_MEMORY;
+			o = Region.BaseEnd;
+			a = Region.LocalEnd;
+			b = Region.RemoteEnd;
+		}
+		return FC_OK;
 	}
 
 	/**
-	 * @brief Analyzes a byte buffer to determine if it likely contains text.
-	 *
-	 * This heuristic is used by @c FC_MODE_AUTO to decide whether to apply text or
-	 * binary comparison. This is an intentional design difference from the Windows
-	 * @c fc.exe tool, which defaults unconditionally to text mode (@c /L) when no
-	 * explicit mode flag is given. Here, the content is inspected instead, which
-	 * prevents misleading line-diff output for binary files that happen to carry a
-	 * @c .txt extension.
-	 *
-	 * The heuristic rules, applied in order:
-	 * -# If the buffer begins with a UTF-8, UTF-16 LE, or UTF-16 BE BOM, it is text.
-	 * -# If any byte is @c 0x00 (null), it is binary (strong binary indicator).
-	 * -# If at least 90 % of bytes are printable ASCII (0x20–0x7E, TAB, CR, LF),
-	 *    it is text; otherwise binary.
+	 * @brief Records where each parsed line starts in its raw buffer, split exactly as
+	 *        `_FC_ParseLines` splits it, followed by the buffer length.
 	 *
-	 * The caller reads only the first 4 KB of each file (@c _FC_IsProbablyTextFileW).
-	 * If either file is classified as binary the pair is compared in binary mode.
+	 * The raw text of line i is [Starts[i], Starts[i + 1]): the line, its terminator
+	 * and any blank lines the parser folded away after it. AtFileStart has the
+	 * meaning it has for `_FC_ParseLineRange`.
 	 * @internal
-	 * @param Buffer A pointer to the byte buffer to inspect.
-	 * @param BufferLength The length of the buffer in bytes.
-	 * @return TRUE if the buffer content is likely text, FALSE otherwise.
 	 */
-	static inline BOOL
-		_FC_IsProbablyTextBuffer(const BYTE* Buffer, DWORD BufferLength)
+	static BOOL
+		_FC_ComputeRawLineStarts(
+			_In_reads_(BufferLength) const char* Buffer,
+			_In_ size_t BufferLength,
+			_In_ BOOL AtFileStart,
+			_In_ const FC_CONFIG* Config,
+			_Inout_ _FC_BUFFER* pStarts)
 	{
-		const double textThreshold = 0.90;
-		if (BufferLength == 0) return FALSE;
-
-		// Detect UTF BOMs (early exit for known good encodings)
-		if (BufferLength >= 3 && Buffer[0] == 0xEF && Buffer[1] == 0xBB && Buffer[2] == 0xBF) // UTF-8 BOM
-			return TRUE;
-		if (BufferLength >= 2 && Buffer[0] == 0xFF && Buffer[1] == 0xFE) // UTF-16 LE BOM
-			return TRUE;
-		if (BufferLength >= 2 && Buffer[0] == 0xFE && Buffer[1] == 0xFF) // UTF-16 BE BOM
-			return TRUE;
+		const char* Ptr = Buffer;
+		const char* End = Buffer + BufferLength;
+		if (AtFileStart &&
+			(Config->Mode == FC_MODE_TEXT_UNICODE || Config->Mode == FC_MODE_AUTO) &&
+			BufferLength >= 3 &&
+			(unsigned char)Ptr[0] == 0xEF &&
+			(unsigned char)Ptr[1] == 0xBB &&
+			(unsigned char)Ptr[2] == 0xBF)
+		{
+			Ptr += 3;
+		}
 
-		int printable = 0;
-		for (DWORD i = 0; i < BufferLength; ++i)
+		while (Ptr < End)
 		{
-			BYTE c = Buffer[i];
-			if ((c >= 32 && c <= 126) || c == 9 || c == 10 || c == 13) {
-				printable++;
+			const char* Newline = Ptr;
+			BOOL Blank = TRUE;
+			while (Newline < End && *Newline != '\n' && *Newline != '\r')
+			{
+				if (*Newline != ' ' && *Newline != '\t')
+					Blank = FALSE;
+				Newline++;
 			}
-			else if (c == 0) {
-				return FALSE; // Null byte strongly suggests binary
+
+			// Lines emptied by FC_IGNORE_WS are dropped by the parser.
+			if (!(Blank && (Config->Flags & FC_IGNORE_WS)))
+			{
+				size_t Start = (size_t)(Ptr - Buffer);
+				if (!_FC_BufferAppend(pStarts, &Start))
+					return FALSE;
 			}
-			// Could expand here with UTF-8 continuation byte validation, if needed
-		}
 
-		double ratio = (double)printable / BufferLength;
-		return (ratio >= textThreshold);
+			Ptr = Newline;
+			while (Ptr < End && (*Ptr == '\n' || *Ptr == '\r'))
+				Ptr++;
+		}
+		return _FC_BufferAppend(pStarts, &BufferLength);
 	}
 
 	/**
-	 * @brief Reads the beginning of a file to determine if it is likely a text file.
-	 *
-	 * This function opens the specified file, reads the first chunk of data, and uses
-	 * `_FC_IsProbablyTextBuffer` to analyze its content.
+	 * @brief One input of a three-way comparison: raw contents, parsed lines and raw line starts.
+	 * @internal
+	 */
+	typedef struct
+	{
+		_FC_BUFFER Raw;
+		_FC_BUFFER Lines;
+		_FC_BUFFER Starts;
+	} _FC_MERGE_INPUT;
+
+	/**
+	 * @brief Builds the merged text: each side's changes applied to the base, conflicts
+	 *        wrapped in diff3-style markers.
 	 * @internal
-	 * @param Path The wide character path to the file to check.
-	 * @return TRUE if the file is likely a text file, FALSE otherwise or on error.
 	 */
-	static inline BOOL
-		_FC_IsProbablyTextFileW(const WCHAR* Path) {
-		HANDLE hFile = CreateFileW(
-			Path,
-			GENERIC_READ,
-			FILE_SHARE_READ,
-			NULL,
-			OPEN_EXISTING,
-			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
-			NULL
-		);
-		if (hFile == INVALID_HANDLE_VALUE) return FALSE;
-
-#define BUFFER_SIZE 4096
-
-		BYTE* buffer = (BYTE*)HeapAlloc(GetProcessHeap(), 0, BUFFER_SIZE);
-		if (buffer == NULL)
+	static BOOL
+		_FC_MergeRender(
+			_In_ const _FC_MERGE_INPUT* Base,
+			_In_ const _FC_MERGE_INPUT* Local,
+			_In_ const _FC_MERGE_INPUT* Remote,
+			_In_ const _FC_BUFFER* Regions,
+			_Inout_ _FC_BUFFER* Out)
+	{
+		// Markers use the line terminator of the first input that has one.
+		const char* Eol = "\n";
+		const _FC_MERGE_INPUT* Inputs[3] = { Local, Base, Remote };
+		for (int i = 0; i < 3; i++)
 		{
-			// If heap allocation fails, we can't proceed.
-			CloseHandle(hFile);
-			return FALSE;
+			const char* Raw = (const char*)Inputs[i]->Raw.pData;
+			const char* Lf = Raw ? (const char*)memchr(Raw, '\n', Inputs[i]->Raw.Count) : NULL;
+			if (Lf != NULL)
+			{
+				Eol = (Lf > Raw && Lf[-1] == '\r') ? "\r\n" : "\n";
+				break;
+			}
 		}
+		size_t EolLength = strlen(Eol);
+		BOOL NeedEol = FALSE; // The last line written had no terminator.
 
-		DWORD bytesRead = 0;
-		BOOL success = ReadFile(hFile, buffer, BUFFER_SIZE, &bytesRead, NULL);
-
-		// Call the text-checking function.
-		BOOL isText = _FC_IsProbablyTextBuffer(buffer, bytesRead);
+		// The local prefix (a BOM, or blank lines before the first line) leads the output.
+		size_t Prefix = *(const size_t*)_FC_BufferGet(&Local->Starts, 0);
+		if (!_FC_BufferAppendRange(Out, Local->Raw.pData, Prefix))
+			return FALSE;
 
-		HeapFree(GetProcessHeap(), 0, buffer);
-		CloseHandle(hFile);
+#define _FC_MERGE_EMIT(Input, First, Last)                                                         \
+		for (size_t li = (First); li < (Last); li++)                                               \
+		{                                                                                          \
+			size_t From = *(const size_t*)_FC_BufferGet(&(Input)->Starts, li);                     \
+			size_t To = *(const size_t*)_FC_BufferGet(&(Input)->Starts, li + 1);                   \
+			if (NeedEol && !_FC_BufferAppendRange(Out, Eol, EolLength))                            \
+				return FALSE;                                                                      \
+			if (!_FC_BufferAppendRange(Out, (const char*)(Input)->Raw.pData + From, To - From))    \
+				return FALSE;                                                                      \
+			char LastChar = ((const char*)(Input)->Raw.pData)[To - 1];                             \
+			NeedEol = (LastChar != '\n' && LastChar != '\r');                                      \
+		}
 
-#undef BUFFER_SIZE
+#define _FC_MERGE_MARKER(Text)                                                                     \
+		if ((NeedEol && !_FC_BufferAppendRange(Out, Eol, EolLength)) ||                            \
+			!_FC_BufferAppendRange(Out, (Text), strlen(Text)) ||                                   \
+			!_FC_BufferAppendRange(Out, Eol, EolLength))                                           \
+			return FALSE;                                                                          \
+		NeedEol = FALSE;
 
-		if (!success || bytesRead == 0) return FALSE;
+		for (size_t r = 0; r < Regions->Count; r++)
+		{
+			const FC_MERGE_REGION* Region = (const FC_MERGE_REGION*)_FC_BufferGet(Regions, r);
+			switch (Region->Type)
+			{
+			case FC_MERGE_REMOTE:
+				_FC_MERGE_EMIT(Remote, Region->RemoteStart, Region->RemoteEnd);
+				break;
+
+			case FC_MERGE_CONFLICT:
+				_FC_MERGE_MARKER("<<<<<<< local");
+				_FC_MERGE_EMIT(Local, Region->LocalStart, Region->LocalEnd);
+				_FC_MERGE_MARKER("||||||| base");
+				_FC_MERGE_EMIT(Base, Region->BaseStart, Region->BaseEnd);
+				_FC_MERGE_MARKER("=======");
+				_FC_MERGE_EMIT(Remote, Region->RemoteStart, Region->RemoteEnd);
+				_FC_MERGE_MARKER(">>>>>>> remote");
+				break;
+
+			case FC_MERGE_UNCHANGED:
+			case FC_MERGE_LOCAL:
+			case FC_MERGE_BOTH:
+			default:
+				// Lines equal under the configuration keep the local spelling.
+				_FC_MERGE_EMIT(Local, Region->LocalStart, Region->LocalEnd);
+				break;
+			}
+		}
 
-		return isText;
+#undef _FC_MERGE_EMIT
+#undef _FC_MERGE_MARKER
+		return TRUE;
 	}
 
 	/**
-	 * @brief Compares two files in text mode.
-	 *
-	 * This function orchestrates the text comparison process. It reads both files,
-	 * parses them into normalized line arrays using `_FC_ParseLines`, and then
-	 * compares the resulting arrays with `_FC_CompareLineArrays`.
+	 * @brief Writes a buffer to a new or truncated file.
 	 * @internal
-	 * @param Path1 The path to the first file.
-	 * @param Path2 The path to the second file.
-	 * @param Config A pointer to the comparison configuration.
-	 * @return An FC_RESULT code indicating the outcome.
 	 */
 	static FC_RESULT
-		_FC_CompareFilesText(
-			_In_z_ const WCHAR* Path1,
-			_In_z_ const WCHAR* Path2,
-			_In_ const FC_CONFIG* Config)
+		_FC_WriteFileContents(
+			_In_z_ const WCHAR* Path,
+			_In_reads_bytes_(Length) const void* Data,
+			_In_ size_t Length)
 	{
+		_FC_FILE File = _FC_PalCreateFile(Path, FALSE);
+		if (File == _FC_INVALID_FILE)
+			return FC_ERROR_IO;
 		FC_RESULT Result = FC_OK;
-		size_t Length1 = 0, Length2 = 0;
-		char* Buffer1 = NULL;
-		char* Buffer2 = NULL;
-		_FC_BUFFER BufferA = { 0 }, BufferB = { 0 };
-
-		// Initialize our generic buffers to hold _FC_LINE structs.
-		_FC_BufferInit(&BufferA, sizeof(_FC_LINE));
-		_FC_BufferInit(&BufferB, sizeof(_FC_LINE));
-
-		Buffer1 = _FC_ReadFileContents(Path1, &Length1, &Result);
-		if (!Buffer1) goto cleanup;
-
-		Buffer2 = _FC_ReadFileContents(Path2, &Length2, &Result);
-		if (!Buffer2) goto cleanup;
-
-		Result = _FC_ParseLines(Buffer1, Length1, &BufferA, Config);
-		if (Result != FC_OK) goto cleanup;
-
-		Result = _FC_ParseLines(Buffer2, Length2, &BufferB, Config);
-		if (Result != FC_OK) goto cleanup;
-
-		// ========================================================================
-		// Chunked LCS loop - replaces monolithic _FC_FindLcs call.
-		// ========================================================================
-		LONGLONG MaxBytes = (Length1 > Length2) ? (LONGLONG)Length1 : (LONGLONG)Length2;
-		size_t ChunkLines = _FC_ComputeChunkSize(MaxBytes, Config->BufferLines);
+		size_t Written = 0;
+		while (Written < Length)
+		{
+			DWORD ToWrite = (Length - Written > 0x40000000u) ? 0x40000000u : (DWORD)(Length - Written);
+			DWORD Put = 0;
+			if (!_FC_PalWrite(File, (const BYTE*)Data + Written, ToWrite, &Put) || Put == 0)
+			{
+				Result = FC_ERROR_IO;
+				break;
+			}
+			Written += Put;
+		}
+		if (!_FC_PalClose(File))
+			Result = FC_ERROR_IO;
+		return Result;
+	}
 
-		size_t CurA = 0, CurB = 0;
-		BOOL AnyDiff = FALSE;
+	/**
+	 * @brief Reads and parses one input of a three-way comparison.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_MergeLoadInput(
+			_In_z_ const WCHAR* Path,
+			_In_ const FC_CONFIG* Config,
+			_Inout_ _FC_MERGE_INPUT* Input)
+	{
+		FC_RESULT Result = _FC_ReadFileIntoBuffer(Path, &Input->Raw);
+		if (Result != FC_OK)
+			return Result;
+		Result = _FC_ParseLines((const char*)Input->Raw.pData, Input->Raw.Count, &Input->Lines, Config);
+		if (Result != FC_OK)
+			return Result;
+		if (!_FC_ComputeRawLineStarts((const char*)Input->Raw.pData, Input->Raw.Count, TRUE, Config, &Input->Starts))
+			return FC_ERROR_MEMORY;
+		return FC_OK;
+	}
 
-		while (CurA < BufferA.Count || CurB < BufferB.Count)
-		{
-			// Build non-owning slice views into the full line arrays.
-			size_t SliceCountA = BufferA.Count - CurA;
-			size_t SliceCountB = BufferB.Count - CurB;
-			if (SliceCountA > ChunkLines) SliceCountA = ChunkLines;
-			if (SliceCountB > ChunkLines) SliceCountB = ChunkLines;
-
-			_FC_BUFFER SliceA = {
-				(char*)BufferA.pData + CurA * BufferA.ElementSize,
-				BufferA.ElementSize,
-				SliceCountA,
-				SliceCountA
-			};
-			_FC_BUFFER SliceB = {
-				(char*)BufferB.pData + CurB * BufferB.ElementSize,
-				BufferB.ElementSize,
-				SliceCountB,
-				SliceCountB
-			};
-
-			FC_USER_CONTEXT Ctx = {
-				Path1, Path2,
-				&SliceA, &SliceB,
-				Config->UserData,
-				CurA,    // OffsetA
-				CurB     // OffsetB
-			};
-
-			size_t NextAnchorA = 0, NextAnchorB = 0;
-			FC_RESULT ChunkResult = _FC_ProcessChunk(&Ctx, Config, &NextAnchorA, &NextAnchorB);
+	/**
+	 * @brief Body of `FC_Merge3W`, run with the working-memory source already selected.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_Merge3Entry(
+			_In_z_ const WCHAR* BasePath,
+			_In_z_ const WCHAR* LocalPath,
+			_In_z_ const WCHAR* RemotePath,
+			_In_ const FC_CONFIG* Config,
+			_In_opt_ FC_MERGE_CALLBACK RegionCallback,
+			_In_opt_z_ const WCHAR* OutputPath)
+	{
+		FC_RESULT Result = FC_OK;
+		const WCHAR* Paths[3] = { BasePath, LocalPath, RemotePath };
+		WCHAR* Canonical[3] = { NULL, NULL, NULL };
+		WCHAR* CanonicalOutput = NULL;
+		_FC_MERGE_INPUT Inputs[3];
+		_FC_MERGE_DIFF Diffs[2];
+		size_t* Matches[2] = { NULL, NULL };
+		_FC_BUFFER Regions, Merged;
+		_FC_THREAD Worker;
+		BOOL Parallel = FALSE;
+		BOOL AnyConflict = FALSE;
+
+		// Line splitting and normalization follow the text modes; binary is read as ASCII text.
+		FC_CONFIG TextConfig = *Config;
+		if (TextConfig.Mode == FC_MODE_BINARY)
+			TextConfig.Mode = FC_MODE_TEXT_ASCII;
+		TextConfig.Cache = NULL;
+		TextConfig.ProgressCallback = NULL;
+
+		for (int i = 0; i < 3; i++)
+		{
+			_FC_BufferInit(&Inputs[i].Raw, sizeof(char));
+			_FC_BufferInit(&Inputs[i].Lines, sizeof(_FC_LINE));
+			_FC_BufferInit(&Inputs[i].Starts, sizeof(size_t));
+		}
+		for (int d = 0; d < 2; d++)
+		{
+			memset(&Diffs[d], 0, sizeof(Diffs[d]));
+			_FC_BufferInit(&Diffs[d].Blocks, sizeof(FC_DIFF_BLOCK));
+		}
+		_FC_BufferInit(&Regions, sizeof(FC_MERGE_REGION));
+		_FC_BufferInit(&Merged, sizeof(char));
 
-			if (ChunkResult == FC_ERROR_MEMORY || ChunkResult == FC_ERROR_IO)
+		for (int i = 0; i < 3; i++)
+		{
+			if (!_FC_ToCanonicalPath(Paths[i], &Canonical[i]))
 			{
-				Result = ChunkResult;
+				Result = FC_ERROR_INVALID_PARAM;
 				goto cleanup;
 			}
-			if (ChunkResult == FC_DIFFERENT)
-				AnyDiff = TRUE;
+		}
+		if (OutputPath != NULL && !_FC_ToCanonicalPath(OutputPath, &CanonicalOutput))
+		{
+			Result = FC_ERROR_INVALID_PARAM;
+			goto cleanup;
+		}
 
-			// Advance cursor based on anchor position.
-			// The anchor represents the line after the last confirmed match (chunk-relative).
-			// Boundary-straddling diffs only occur if the anchor is STRICTLY BEFORE chunk_end
-			// AND there's more content after the chunk (not at EOF).
-			//
-			// If anchor is within chunk but we're at/near EOF, just advance normally.
+		// Each input is read and parsed exactly once.
+		for (int i = 0; i < 3; i++)
+		{
+			Result = _FC_MergeLoadInput(Canonical[i], &TextConfig, &Inputs[i]);
+			if (Result != FC_OK)
+				goto cleanup;
+		}
 
-			BOOL IsAnchorWithinChunk = 
-				(NextAnchorA > CurA && NextAnchorA < CurA + SliceCountA) ||
-				(NextAnchorB > CurB && NextAnchorB < CurB + SliceCountB);
+		for (int d = 0; d < 2; d++)
+		{
+			size_t SideBytes = Inputs[d + 1].Raw.Count;
+			size_t MaxBytes = Inputs[0].Raw.Count > SideBytes ? Inputs[0].Raw.Count : SideBytes;
+			Diffs[d].Base = &Inputs[0].Lines;
+			Diffs[d].Side = &Inputs[d + 1].Lines;
+			Diffs[d].ChunkLines = _FC_ComputeChunkSize((LONGLONG)MaxBytes, TextConfig.BufferLines);
+			Diffs[d].Owner = Config;
+			Diffs[d].Config = TextConfig;
+			Diffs[d].Config.DiffCallback = _FC_MergeCollect;
+			Diffs[d].Config.UserData = &Diffs[d];
+		}
 
-			BOOL HasMoreContent = 
-				(CurA + SliceCountA < BufferA.Count) || 
-				(CurB + SliceCountB < BufferB.Count);
+		// Base-to-remote runs on a worker while this thread does base-to-local.
+		if (Inputs[0].Lines.Count >= FC_MERGE_PARALLEL_MIN_LINES)
+			Parallel = _FC_PalThreadStart(&Worker, _FC_MergeDiffThread, &Diffs[1]);
+		Diffs[0].Result = _FC_MergeRunDiff(&Diffs[0]);
+		if (Parallel)
+		{
+			_FC_PalThreadJoin(&Worker);
+		}
+		else
+		{
+			Diffs[1].Result = _FC_MergeRunDiff(&Diffs[1]);
+		}
+		Result = (Diffs[0].Result != FC_OK) ? Diffs[0].Result : Diffs[1].Result;
+		if (Result != FC_OK)
+			goto cleanup;
 
-			if (NextAnchorA == CurA && NextAnchorB == CurB)
+		for (int d = 0; d < 2; d++)
+		{
+			size_t Count = Inputs[0].Lines.Count;
+			Matches[d] = (size_t*)_FC_WorkAlloc(0, (Count > 0 ? Count : 1) * sizeof(size_t));
+			if (Matches[d] == NULL)
 			{
-				// No anchor advance — entire chunk is divergent, force advance
-				CurA += SliceCountA;
-				CurB += SliceCountB;
+				Result = FC_ERROR_MEMORY;
+				goto cleanup;
 			}
-			else if (IsAnchorWithinChunk && HasMoreContent)
+			_FC_MergeBuildMatching(&Diffs[d], Matches[d]);
+		}
+
+		Result = _FC_MergeClassify(&Inputs[0].Lines, &Inputs[1].Lines, &Inputs[2].Lines,
+			Matches[0], Matches[1], &TextConfig, &Regions);
+		if (Result != FC_OK)
+			goto cleanup;
+
+		{
+			FC_MERGE_CONTEXT Context = {
+				Canonical[0], Canonical[1], Canonical[2],
+				&Inputs[0].Lines, &Inputs[1].Lines, &Inputs[2].Lines,
+				Config->UserData };
+			for (size_t r = 0; r < Regions.Count; r++)
 			{
-				// Anchor within chunk AND more content exists — boundary-straddling diff
-				// Rewind to anchor for re-processing from the confirmed match point
-				CurA = NextAnchorA;
-				CurB = NextAnchorB;
+				const FC_MERGE_REGION* Region = (const FC_MERGE_REGION*)_FC_BufferGet(&Regions, r);
+				if (Region->Type == FC_MERGE_CONFLICT)
+					AnyConflict = TRUE;
+				if (RegionCallback != NULL)
+					RegionCallback(&Context, Region);
 			}
-			else
+		}
+
+		if (CanonicalOutput != NULL)
+		{
+			if (!_FC_MergeRender(&Inputs[0], &Inputs[1], &Inputs[2], &Regions, &Merged))
 			{
-				// Normal case: anchor at chunk_end, or at EOF, advance past chunk
-				CurA += SliceCountA;
-				CurB += SliceCountB;
+				Result = FC_ERROR_MEMORY;
+				goto cleanup;
 			}
+			Result = _FC_WriteFileContents(CanonicalOutput, Merged.pData, Merged.Count);
+			if (Result != FC_OK)
+				goto cleanup;
 		}
-
-		Result = AnyDiff ? FC_DIFFERENT : FC_OK;
+		Result = AnyConflict ? FC_DIFFERENT : FC_OK;
 
 	cleanup:
-		if (Buffer1) HeapFree(GetProcessHeap(), 0, Buffer1);
-		if (Buffer2) HeapFree(GetProcessHeap(), 0, Buffer2);
-		// Free the buffers and their nested content.
-		_FC_FreeLineBufferContents(&BufferA);
-		_FC_FreeLineBufferContents(&BufferB);
+		for (int i = 0; i < 3; i++)
+		{
+			_FC_BufferFree(&Inputs[i].Raw);
+			_FC_FreeLineBufferContents(&Inputs[i].Lines);
+			_FC_BufferFree(&Inputs[i].Starts);
+			_FC_WorkFree(Canonical[i]);
+		}
+		for (int d = 0; d < 2; d++)
+		{
+			_FC_BufferFree(&Diffs[d].Blocks);
+			_FC_WorkFree(Matches[d]);
+		}
+		_FC_BufferFree(&Regions);
+		_FC_BufferFree(&Merged);
+		_FC_WorkFree(CanonicalOutput);
 		return Result;
 	}
 
 	/**
-	 * @brief Compares two files in binary mode.
+	 * @brief Three-way comparison of a base file with a local and a remote version,
+	 *        with an optional merged output.
+	 *
+	 * All three files are read and parsed once. The base is diffed against each side
+	 * with the same chunked LCS, flags, /nnnn and /LBn handling as `FC_CompareFilesW`;
+	 * for large inputs the two diffs run on separate threads. The matchings are then
+	 * walked together (diff3): `RegionCallback` receives, in order, aligned regions that
+	 * tile all three files, each classified as unchanged, changed only locally, changed
+	 * only remotely, changed identically on both sides, or conflicting. Line indices
+	 * are absolute and address the line arrays of the callback context.
+	 *
+	 * When `OutputPath` is set, the merge result is written there: non-conflicting
+	 * changes from both sides applied to the base, and each conflict as
+	 * `<<<<<<< local` / `||||||| base` / `=======` / `>>>>>>> remote` sections. Text is
+	 * copied from the raw files, so unchanged lines keep the local spelling and line
+	 * terminators. Blank lines are not compared (see `_FC_ParseLines`) and travel with
+	 * the line before them.
+	 *
+	 * Text modes apply; `FC_MODE_BINARY` is treated as `FC_MODE_TEXT_ASCII`.
+	 * `Config->DiffCallback` may be NULL and is not called. `Config->Cache` and
+	 * `Config->ProgressCallback` are ignored. `Config->UserData` is passed to the
+	 * region callback, which may be called from the calling thread only.
+	 *
+	 * @param BasePath Path to the common ancestor.
+	 * @param LocalPath Path to the local version.
+	 * @param RemotePath Path to the remote version.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 * @param RegionCallback Optional callback for the aligned regions.
+	 * @param OutputPath Optional path of the merged file to write (created or truncated).
 	 *
-	 * This function performs a byte-for-byte comparison of two files.
-	 * For smaller files it uses memory-mapped I/O for efficiency; for larger files it
-	 * switches to streamed micro-batches to avoid excessive cache and working-set pressure.
-	 * @internal
-	 * @param Path1 The path to the first file.
-	 * @param Path2 The path to the second file.
-	 * @param Config A pointer to the comparison configuration.
 	 * @return An FC_RESULT code indicating the outcome.
+	 * @retval FC_OK if the versions merge without conflicts.
+	 * @retval FC_DIFFERENT if at least one region conflicts.
+	 * @retval FC_ERROR_INVALID_PARAM if a required pointer is NULL or a path is invalid.
+	 * @retval FC_ERROR_IO if a file cannot be read or the output cannot be written.
+	 * @retval FC_ERROR_MEMORY if a memory allocation fails.
 	 */
-	static FC_RESULT
-		_FC_CompareFilesBinaryStreamed(
-			_In_z_ const WCHAR* Path1,
-			_In_z_ const WCHAR* Path2,
-			_In_ const FC_CONFIG* Config)
+	FC_RESULT
+		FC_Merge3W(
+			_In_z_ const WCHAR* BasePath,
+			_In_z_ const WCHAR* LocalPath,
+			_In_z_ const WCHAR* RemotePath,
+			_In_ const FC_CONFIG* Config,
+			_In_opt_ FC_MERGE_CALLBACK RegionCallback,
+			_In_opt_z_ const WCHAR* OutputPath)
 	{
-		HANDLE File1Handle = INVALID_HANDLE_VALUE;
-		HANDLE File2Handle = INVALID_HANDLE_VALUE;
-		unsigned char* Buffer1 = NULL;
-		unsigned char* Buffer2 = NULL;
-		FC_RESULT Result = FC_ERROR_IO;
-		size_t offset = 0;
+		if (!BasePath || !LocalPath || !RemotePath || !Config ||
+			!_FC_IsValidAllocator(&Config->Allocator))
+			return FC_ERROR_INVALID_PARAM;
 
-		File1Handle = CreateFileW(Path1, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
-			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
-		File2Handle = CreateFileW(Path2, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
-			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+		FC_RESULT Result = _FC_Merge3Entry(BasePath, LocalPath, RemotePath, Config, RegionCallback, OutputPath);
+		_FC_LeaveWork(Previous);
+		return Result;
+	}
 
-		if (File1Handle == INVALID_HANDLE_VALUE || File2Handle == INVALID_HANDLE_VALUE)
-			goto cleanup;
+	/* -------------------- Incremental Re-Diff -------------------- */
 
-		LARGE_INTEGER File1Size, File2Size;
-		if (!GetFileSizeEx(File1Handle, &File1Size) || !GetFileSizeEx(File2Handle, &File2Size))
-			goto cleanup;
+	//
+	// An FC_DIFF_STATE keeps both texts, their parsed lines, the raw offset of each
+	// line and the current diff blocks. An edit re-parses only the lines whose raw
+	// text it touches, and the LCS runs again only between the nearest unchanged
+	// lines around them; blocks outside that window are kept and renumbered.
+	//
 
-		if (File1Size.QuadPart < 0 || File2Size.QuadPart < 0)
-			goto cleanup;
+	/**
+	 * @struct _FC_DIFF_STATE
+	 * @brief Two texts and their diff, kept up to date across edits.
+	 * @internal
+	 */
+	struct _FC_DIFF_STATE
+	{
+		FC_CONFIG Config;           // Caller's configuration; DiffCallback is not used.
+		_FC_BUFFER Raw[2];          // The texts as edited so far, indexed by FC_TEXT_SIDE.
+		_FC_BUFFER Lines[2];        // Their _FC_LINEs.
+		_FC_BUFFER Starts[2];       // Raw offset of each line, followed by the text length.
+		_FC_BUFFER Blocks;          // FC_DIFF_BLOCKs in order, with absolute indices.
+		FC_USER_CONTEXT Context;    // Whole-text context handed out by FC_DiffStateGetContext.
+		FC_RESULT Error;            // Set when an edit failed after changing the state.
+	};
 
-		if ((ULONGLONG)File1Size.QuadPart > (ULONGLONG)SIZE_MAX ||
-			(ULONGLONG)File2Size.QuadPart > (ULONGLONG)SIZE_MAX)
-		{
-			goto cleanup;
-		}
+	/**
+	 * @struct _FC_RANGE_DIFF
+	 * @brief Collector state of `_FC_DiffLineRange`.
+	 * @internal
+	 */
+	typedef struct
+	{
+		_FC_BUFFER* Blocks;
+		size_t First;               // Blocks[First..] were produced by this run.
+		size_t BaseA;               // Absolute index of the first line of each range.
+		size_t BaseB;
+		BOOL OutOfMemory;
+	} _FC_RANGE_DIFF;
 
-		enum { FC_BINARY_STREAM_CHUNK = 1024 * 1024 };
-		Buffer1 = (unsigned char*)HeapAlloc(GetProcessHeap(), 0, FC_BINARY_STREAM_CHUNK);
-		Buffer2 = (unsigned char*)HeapAlloc(GetProcessHeap(), 0, FC_BINARY_STREAM_CHUNK);
-		if (Buffer1 == NULL || Buffer2 == NULL)
-		{
-			Result = FC_ERROR_MEMORY;
-			goto cleanup;
-		}
+	static void
+		_FC_RangeDiffCollect(
+			_In_ const FC_USER_CONTEXT* Context,
+			_In_ const FC_DIFF_BLOCK* Block)
+	{
+		_FC_RANGE_DIFF* Run = (_FC_RANGE_DIFF*)Context->UserData;
+		FC_DIFF_BLOCK Absolute = *Block;
+		Absolute.StartA += Run->BaseA;
+		Absolute.EndA += Run->BaseA;
+		Absolute.StartB += Run->BaseB;
+		Absolute.EndB += Run->BaseB;
+		if (!_FC_BufferAppend(Run->Blocks, &Absolute))
+			Run->OutOfMemory = TRUE;
+	}
 
-		LONGLONG MinSize = File1Size.QuadPart < File2Size.QuadPart
-			? File1Size.QuadPart : File2Size.QuadPart;
-		if ((ULONGLONG)MinSize > (ULONGLONG)SIZE_MAX)
-			goto cleanup;
-		size_t CompareSize = (size_t)MinSize;
+	/**
+	 * @brief Runs the chunked LCS over line ranges of two texts and appends the blocks.
+	 *
+	 * Unlike the callback API, the appended blocks never overlap: blocks a chunk
+	 * reported past the point the next chunk rewinds to are replaced by those of the
+	 * next chunk, and lines left over on one side once the other is exhausted are
+	 * reported as one final block.
+	 * @internal
+	 */
+	static FC_RESULT
+		_FC_DiffLineRange(
+			_In_ const _FC_BUFFER* LinesA,
+			_In_ size_t StartA,
+			_In_ size_t EndA,
+			_In_ const _FC_BUFFER* LinesB,
+			_In_ size_t StartB,
+			_In_ size_t EndB,
+			_In_ size_t ChunkLines,
+			_In_ const FC_CONFIG* Config,
+			_Inout_ _FC_BUFFER* pBlocks)
+	{
+		_FC_BUFFER SliceA = {
+			(char*)LinesA->pData + StartA * LinesA->ElementSize,
+			LinesA->ElementSize,
+			EndA - StartA,
+			EndA - StartA
+		};
+		_FC_BUFFER SliceB = {
+			(char*)LinesB->pData + StartB * LinesB->ElementSize,
+			LinesB->ElementSize,
+			EndB - StartB,
+			EndB - StartB
+		};
+
+		_FC_RANGE_DIFF Run = { pBlocks, pBlocks->Count, StartA, StartB, FALSE };
+		FC_CONFIG RangeConfig = *Config;
+		RangeConfig.DiffCallback = _FC_RangeDiffCollect;
+		RangeConfig.UserData = &Run;
+		RangeConfig.ProgressCallback = NULL;
 
-		Result = FC_OK;
-		while (offset < CompareSize)
+		size_t CurA = 0, CurB = 0;
+		while (CurA < SliceA.Count || CurB < SliceB.Count)
 		{
-			size_t toRead = CompareSize - offset;
-			if (toRead > FC_BINARY_STREAM_CHUNK)
-				toRead = FC_BINARY_STREAM_CHUNK;
-
-			size_t filled1 = 0, filled2 = 0;
-			while (filled1 < toRead)
+			if (CurA == SliceA.Count || CurB == SliceB.Count)
 			{
-				DWORD br = 0;
-				if (!ReadFile(File1Handle, Buffer1 + filled1, (DWORD)(toRead - filled1), &br, NULL))
-				{
-					Result = FC_ERROR_IO;
-					goto cleanup;
-				}
-				if (br == 0)
-				{
-					Result = FC_ERROR_IO; // Unexpected EOF before advertised file size.
-					goto cleanup;
-				}
-				filled1 += (size_t)br;
+				FC_DIFF_BLOCK Tail = {
+					CurA == SliceA.Count ? FC_DIFF_TYPE_ADD : FC_DIFF_TYPE_DELETE,
+					StartA + CurA, EndA, StartB + CurB, EndB };
+				return _FC_BufferAppend(pBlocks, &Tail) ? FC_OK : FC_ERROR_MEMORY;
 			}
 
-			while (filled2 < toRead)
+			while (pBlocks->Count > Run.First)
 			{
-				DWORD br = 0;
-				if (!ReadFile(File2Handle, Buffer2 + filled2, (DWORD)(toRead - filled2), &br, NULL))
-				{
-					Result = FC_ERROR_IO;
-					goto cleanup;
-				}
-				if (br == 0)
-				{
-					Result = FC_ERROR_IO; // Unexpected EOF before advertised file size.
-					goto cleanup;
-				}
-				filled2 += (size_t)br;
+				const FC_DIFF_BLOCK* Last = (const FC_DIFF_BLOCK*)_FC_BufferGet(pBlocks, pBlocks->Count - 1);
+				if (Last->EndA <= StartA + CurA && Last->EndB <= StartB + CurB)
+					break;
+				pBlocks->Count--;
 			}
 
-			for (size_t i = 0; i < toRead; ++i)
-			{
-				if (Buffer1[i] != Buffer2[i])
-				{
-					if (Result == FC_OK)
-						Result = FC_DIFFERENT;
-					if (Config->DiffCallback != NULL)
-						{
-							FC_DIFF_BLOCK block = { FC_DIFF_TYPE_CHANGE, offset + i, Buffer1[i], offset + i, Buffer2[i] };
-							FC_USER_CONTEXT BinContext = { Path1, Path2, NULL, NULL, Config->UserData };
-							Config->DiffCallback(&BinContext, &block);
-						}
-				}
-			}
-			offset += toRead;
+			FC_RESULT ChunkResult = _FC_ProcessNextChunk(NULL, NULL, &SliceA, &SliceB,
+				ChunkLines, &CurA, &CurB, &RangeConfig, NULL);
+			if (ChunkResult == FC_ERROR_MEMORY || ChunkResult == FC_ERROR_IO)
+				return ChunkResult;
+			if (Run.OutOfMemory)
+				return FC_ERROR_MEMORY;
 		}
+		return FC_OK;
+	}
+
+	/**
+	 * @brief Returns the start and end line of a block in one of the two texts.
+	 * @internal
+	 */
+	static inline void
+		_FC_BlockSpan(
+			_In_ const FC_DIFF_BLOCK* Block,
+			_In_ FC_TEXT_SIDE Side,
+			_Out_ size_t* Start,
+			_Out_ size_t* End)
+	{
+		*Start = (Side == FC_TEXT_FIRST) ? Block->StartA : Block->StartB;
+		*End = (Side == FC_TEXT_FIRST) ? Block->EndA : Block->EndB;
+	}
 
-		if (File1Size.QuadPart != File2Size.QuadPart)
+	/**
+	 * @brief Returns the last line that starts at or before a raw offset (0 if none does).
+	 * @internal
+	 */
+	static size_t
+		_FC_DiffStateLineAt(
+			_In_ const _FC_BUFFER* Starts,
+			_In_ size_t LineCount,
+			_In_ size_t Offset)
+	{
+		const size_t* Start = (const size_t*)Starts->pData;
+		size_t Low = 0, High = LineCount;
+		while (High - Low > 1)
 		{
-			Result = FC_DIFFERENT;
-			if (Config->DiffCallback != NULL)
-			{
-				FC_DIFF_BLOCK block = {
-					FC_DIFF_TYPE_SIZE,
-					(size_t)File1Size.QuadPart, (size_t)File1Size.QuadPart,
-					(size_t)File2Size.QuadPart, (size_t)File2Size.QuadPart };
-				FC_USER_CONTEXT BinContext = { Path1, Path2, NULL, NULL, Config->UserData };
-				Config->DiffCallback(&BinContext, &block);
-			}
+			size_t Mid = Low + (High - Low) / 2;
+			if (Start[Mid] <= Offset)
+				Low = Mid;
+			else
+				High = Mid;
 		}
+		return Low;
+	}
 
-	cleanup:
-		if (Buffer1) HeapFree(GetProcessHeap(), 0, Buffer1);
-		if (Buffer2) HeapFree(GetProcessHeap(), 0, Buffer2);
-		if (File1Handle != INVALID_HANDLE_VALUE) CloseHandle(File1Handle);
-		if (File2Handle != INVALID_HANDLE_VALUE) CloseHandle(File2Handle);
-		return Result;
+	/**
+	 * @brief Returns the chunk size a full comparison of the current texts would use.
+	 * @internal
+	 */
+	static inline size_t
+		_FC_DiffStateChunkLines(
+			_In_ const FC_DIFF_STATE* State)
+	{
+		size_t MaxBytes = State->Raw[0].Count > State->Raw[1].Count ? State->Raw[0].Count : State->Raw[1].Count;
+		return _FC_ComputeChunkSize((LONGLONG)MaxBytes, State->Config.BufferLines);
 	}
 
+	/**
+	 * @brief Re-diffs the neighbourhood of lines that were just replaced in one text.
+	 *
+	 * The window grows from the replaced lines to the nearest blocks they touch, then
+	 * by `max(ResyncLines, 1)` unchanged lines on each side (taking in any block that
+	 * is closer), so that it starts and ends on lines the old diff matched. Only the
+	 * lines inside the window go through the LCS again.
+	 * @internal
+	 * @param State The state, whose lines of Side are already updated.
+	 * @param Side The edited text.
+	 * @param First The first replaced line.
+	 * @param Last The end (exclusive) of the replaced lines, in old line numbers.
+	 * @param NewCount The number of lines that replaced them.
+	 */
 	static FC_RESULT
-		_FC_CompareFilesBinary(
-			_In_z_ const WCHAR* Path1,
-			_In_z_ const WCHAR* Path2,
-			_In_ const FC_CONFIG* Config)
+		_FC_DiffStateRepair(
+			_Inout_ FC_DIFF_STATE* State,
+			_In_ FC_TEXT_SIDE Side,
+			_In_ size_t First,
+			_In_ size_t Last,
+			_In_ size_t NewCount)
 	{
-		HANDLE File1Handle = INVALID_HANDLE_VALUE;
-		HANDLE File2Handle = INVALID_HANDLE_VALUE;
-		HANDLE Map1Handle = NULL;
-		HANDLE Map2Handle = NULL;
-		unsigned char* Buffer1 = NULL;
-		unsigned char* Buffer2 = NULL;
-		FC_RESULT Result = FC_ERROR_IO; // Default to error
-
-		File1Handle = CreateFileW(Path1, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-		File2Handle = CreateFileW(Path2, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-
-		if (File1Handle == INVALID_HANDLE_VALUE || File2Handle == INVALID_HANDLE_VALUE)
+		FC_TEXT_SIDE Other = (Side == FC_TEXT_FIRST) ? FC_TEXT_SECOND : FC_TEXT_FIRST;
+		_FC_BUFFER* Blocks = &State->Blocks;
+		const FC_DIFF_BLOCK* Block = (const FC_DIFF_BLOCK*)Blocks->pData;
+		size_t BlockCount = Blocks->Count;
+		size_t OldCount = State->Lines[Side].Count - NewCount + (Last - First);
+		size_t Context = State->Config.ResyncLines > 1 ? State->Config.ResyncLines : 1;
+		size_t S, E, OS, OE;
+
+		// Left edge: the first block ending at or after First (blocks are sorted on both sides).
+		size_t Low = 0, High = BlockCount;
+		while (Low < High)
 		{
-			goto cleanup;
+			size_t Mid = Low + (High - Low) / 2;
+			_FC_BlockSpan(&Block[Mid], Side, &S, &E);
+			if (E < First) Low = Mid + 1; else High = Mid;
 		}
-
-		LARGE_INTEGER File1Size, File2Size;
-		if (!GetFileSizeEx(File1Handle, &File1Size) || !GetFileSizeEx(File2Handle, &File2Size))
+		size_t k0 = Low;
+		size_t LeftS = First, LeftO = First;
+		if (k0 < BlockCount)
+			_FC_BlockSpan(&Block[k0], Side, &S, &E);
+		if (k0 < BlockCount && S <= First)
 		{
-			goto cleanup;
+			LeftS = S;
+			_FC_BlockSpan(&Block[k0], Other, &LeftO, &OE);
 		}
-
-		// Both empty: identical.
-		if (File1Size.QuadPart == 0 && File2Size.QuadPart == 0)
+		else if (k0 > 0)
 		{
-			Result = FC_OK;
-			goto cleanup;
+			_FC_BlockSpan(&Block[k0 - 1], Side, &S, &E);
+			_FC_BlockSpan(&Block[k0 - 1], Other, &OS, &OE);
+			LeftO = OE + (First - E);
 		}
-
-		// For large files, prefer streaming reads to avoid heavy mapping/cache pressure.
+		for (;;)
 		{
-			ULONGLONG bigger = (File1Size.QuadPart > File2Size.QuadPart)
-				? (ULONGLONG)File1Size.QuadPart
-				: (ULONGLONG)File2Size.QuadPart;
-			if (bigger >= _FC_GetEffectiveBinaryStreamThresholdBytes())
+			size_t PrevEnd = 0;
+			if (k0 > 0)
+				_FC_BlockSpan(&Block[k0 - 1], Side, &S, &PrevEnd);
+			if (LeftS - PrevEnd >= Context)
 			{
-				Result = _FC_CompareFilesBinaryStreamed(Path1, Path2, Config);
-				goto cleanup;
+				LeftS -= Context;
+				LeftO -= Context;
+				break;
+			}
+			if (k0 == 0)
+			{
+				LeftO -= LeftS;
+				LeftS = 0;
+				break;
 			}
+			k0--;
+			_FC_BlockSpan(&Block[k0], Side, &LeftS, &E);
+			_FC_BlockSpan(&Block[k0], Other, &LeftO, &OE);
 		}
 
-		// Compare the common prefix of both files byte-by-byte first, matching
-		// ReactOS fc.exe behavior: byte mismatches are always reported, and a
-		// size-difference notification follows afterwards (not instead of).
-		LONGLONG MinSize = File1Size.QuadPart < File2Size.QuadPart
-			? File1Size.QuadPart : File2Size.QuadPart;
-		// Guard against truncation on 32-bit builds where SIZE_MAX < INT64_MAX.
-		if ((ULONGLONG)MinSize > (ULONGLONG)SIZE_MAX)
+		// Right edge: blocks [k0, k1) start at or before Last.
+		Low = k0;
+		High = BlockCount;
+		while (Low < High)
 		{
-			Result = FC_ERROR_IO;
-			goto cleanup;
+			size_t Mid = Low + (High - Low) / 2;
+			_FC_BlockSpan(&Block[Mid], Side, &S, &E);
+			if (S <= Last) Low = Mid + 1; else High = Mid;
 		}
-		size_t CompareSize = (size_t)MinSize;
-
-		Result = FC_OK;
-		if (CompareSize > 0)
+		size_t k1 = Low;
+		size_t RightS = Last, RightO = Last;
+		if (k1 > 0)
 		{
-			Map1Handle = CreateFileMappingW(File1Handle, NULL, PAGE_READONLY, 0, 0, NULL);
-			Map2Handle = CreateFileMappingW(File2Handle, NULL, PAGE_READONLY, 0, 0, NULL);
-
-			if (Map1Handle == NULL || Map2Handle == NULL)
+			_FC_BlockSpan(&Block[k1 - 1], Side, &S, &E);
+			_FC_BlockSpan(&Block[k1 - 1], Other, &OS, &OE);
+			if (E >= Last)
 			{
-				Result = FC_ERROR_IO;
-				goto cleanup;
+				RightS = E;
+				RightO = OE;
 			}
-
-			Buffer1 = (unsigned char*)MapViewOfFile(Map1Handle, FILE_MAP_READ, 0, 0, CompareSize);
-			Buffer2 = (unsigned char*)MapViewOfFile(Map2Handle, FILE_MAP_READ, 0, 0, CompareSize);
-
-			if (Buffer1 == NULL || Buffer2 == NULL)
+			else
 			{
-				Result = FC_ERROR_IO;
-				goto cleanup;
+				RightO = OE + (Last - E);
 			}
-
-			for (size_t i = 0; i < CompareSize; ++i)
+		}
+		for (;;)
+		{
+			size_t NextStart = OldCount;
+			if (k1 < BlockCount)
+				_FC_BlockSpan(&Block[k1], Side, &NextStart, &E);
+			if (NextStart - RightS >= Context)
 			{
-				if (Buffer1[i] != Buffer2[i])
-				{
-					if (Result == FC_OK) Result = FC_DIFFERENT;
-					if (Config->DiffCallback != NULL)
-					{
-						FC_DIFF_BLOCK block = { FC_DIFF_TYPE_CHANGE, i, Buffer1[i], i, Buffer2[i] };
-						FC_USER_CONTEXT BinContext = { Path1, Path2, NULL, NULL, Config->UserData };
-						Config->DiffCallback(&BinContext, &block);
-					}
-				}
+				RightS += Context;
+				RightO += Context;
+				break;
 			}
+			if (k1 == BlockCount)
+			{
+				RightO += OldCount - RightS;
+				RightS = OldCount;
+				break;
+			}
+			_FC_BlockSpan(&Block[k1], Side, &S, &RightS);
+			_FC_BlockSpan(&Block[k1], Other, &OS, &RightO);
+			k1++;
 		}
 
-		// Report size difference after byte comparison (if applicable).
-		if (File1Size.QuadPart != File2Size.QuadPart)
+		// Re-diff the window in the new line numbers, then renumber the blocks after it.
+		size_t NewRightS = RightS - (Last - First) + NewCount;
+		_FC_BUFFER Repaired;
+		_FC_BufferInit(&Repaired, sizeof(FC_DIFF_BLOCK));
+		FC_RESULT Result = (Side == FC_TEXT_FIRST)
+			? _FC_DiffLineRange(&State->Lines[0], LeftS, NewRightS, &State->Lines[1], LeftO, RightO,
+				_FC_DiffStateChunkLines(State), &State->Config, &Repaired)
+			: _FC_DiffLineRange(&State->Lines[0], LeftO, RightO, &State->Lines[1], LeftS, NewRightS,
+				_FC_DiffStateChunkLines(State), &State->Config, &Repaired);
+		if (Result == FC_OK)
 		{
-			Result = FC_DIFFERENT;
-			if (Config->DiffCallback != NULL)
+			FC_DIFF_BLOCK* Shifted = (FC_DIFF_BLOCK*)Blocks->pData;
+			for (size_t k = k1; k < BlockCount; k++)
 			{
-				FC_DIFF_BLOCK block = { FC_DIFF_TYPE_SIZE, (size_t)File1Size.QuadPart, (size_t)File1Size.QuadPart, (size_t)File2Size.QuadPart, (size_t)File2Size.QuadPart };
-				FC_USER_CONTEXT BinContext = { Path1, Path2, NULL, NULL, Config->UserData };
-				Config->DiffCallback(&BinContext, &block);
+				size_t* Start = (Side == FC_TEXT_FIRST) ? &Shifted[k].StartA : &Shifted[k].StartB;
+				size_t* End = (Side == FC_TEXT_FIRST) ? &Shifted[k].EndA : &Shifted[k].EndB;
+				*Start = *Start - (Last - First) + NewCount;
+				*End = *End - (Last - First) + NewCount;
 			}
+			if (!_FC_BufferSplice(Blocks, k0, k1 - k0, Repaired.pData, Repaired.Count))
+				Result = FC_ERROR_MEMORY;
 		}
-
-	cleanup:
-		if (Buffer1) UnmapViewOfFile(Buffer1);
-		if (Buffer2) UnmapViewOfFile(Buffer2);
-		if (Map1Handle) CloseHandle(Map1Handle);
-		if (Map2Handle) CloseHandle(Map2Handle);
-		if (File1Handle != INVALID_HANDLE_VALUE) CloseHandle(File1Handle);
-		if (File2Handle != INVALID_HANDLE_VALUE) CloseHandle(File2Handle);
+		_FC_BufferFree(&Repaired);
 		return Result;
 	}
 
 	/**
-	 * @brief Converts a Win32 path to a canonical NT path and validates it.
+	 * @brief Applies one byte-range edit to one text of a state.
 	 *
-	 * This function uses the native `RtlDosPathNameToNtPathName_U_WithStatus` API to
-	 * resolve a DOS-style path into its underlying NT object manager path. It performs
-	 * security checks to reject dangerous paths, such as those pointing directly to
-	 * devices (`\\.\`, `\\?\`), reserved DOS device names (CON, PRN, etc.), or
-	 * Alternate Data Stream paths (e.g. `file.txt:stream`).
+	 * The touched lines, plus the line before them (text inserted at a line start can
+	 * extend the terminator of the previous line), are re-parsed from the edited
+	 * text and replace the old line records; the diff is then repaired around them.
 	 * @internal
-	 * @param InputPath The Win32-style path to process.
-	 * @param[out] CanonicalPathOut A pointer to a WCHAR* that will receive the new, heap-allocated canonical path string. The caller must free this memory.
-	 * @return TRUE on success, FALSE if the path is invalid, dangerous, or a memory allocation fails.
+	 * @return FC_OK, FC_ERROR_INVALID_PARAM for an edit outside the text (nothing is
+	 *         changed), or FC_ERROR_MEMORY.
 	 */
-	static BOOL
-		_FC_ToCanonicalPath(
-			_In_z_ const WCHAR* InputPath,
-			_Outptr_result_nullonfailure_ WCHAR** CanonicalPathOut)
+	static FC_RESULT
+		_FC_DiffStateApplyEdit(
+			_Inout_ FC_DIFF_STATE* State,
+			_In_ FC_TEXT_SIDE Side,
+			_In_ const FC_TEXT_EDIT* Edit)
 	{
-		if (!InputPath || !CanonicalPathOut)
-			return FALSE;
+		_FC_BUFFER* Raw = &State->Raw[Side];
+		_FC_BUFFER* Lines = &State->Lines[Side];
+		_FC_BUFFER* Starts = &State->Starts[Side];
+		if (Edit->Offset > Raw->Count || Edit->RemoveLength > Raw->Count - Edit->Offset ||
+			(Edit->Insert == NULL && Edit->InsertLength > 0))
+			return FC_ERROR_INVALID_PARAM;
 
-		*CanonicalPathOut = NULL;
+		size_t LineCount = Lines->Count;
+		size_t First = 0, Last = 0, From = 0, To = Raw->Count;
+		if (LineCount > 0)
+		{
+			size_t Touched = _FC_DiffStateLineAt(Starts, LineCount, Edit->Offset);
+			Last = _FC_DiffStateLineAt(Starts, LineCount, Edit->Offset + Edit->RemoveLength) + 1;
+			First = Touched > 0 ? Touched - 1 : 0;
+			From = First > 0 ? *(const size_t*)_FC_BufferGet(Starts, First) : 0;
+			To = *(const size_t*)_FC_BufferGet(Starts, Last);
+		}
 
-		UNICODE_STRING NtPath = { 0 };
-		WCHAR* outPath = NULL;
-		BOOL ntPathInitialized = FALSE;
-		BOOL success = FALSE;
+		// A failed splice leaves the text unchanged, so the state is still consistent.
+		if (!_FC_BufferSplice(Raw, Edit->Offset, Edit->RemoveLength, Edit->Insert, Edit->InsertLength))
+			return FC_ERROR_MEMORY;
+		size_t NewTo = To - Edit->RemoveLength + Edit->InsertLength;
 
-		// Step 1: Check if input path type is acceptable
-		RTL_PATH_TYPE PathType = RtlDetermineDosPathNameType_U(InputPath);
-		if (PathType == RtlPathTypeUnknown ||
-			PathType == RtlPathTypeLocalDevice ||
-			PathType == RtlPathTypeRootLocalDevice)
+		FC_RESULT Result = FC_OK;
+		_FC_BUFFER NewLines, NewStarts;
+		_FC_BufferInit(&NewLines, sizeof(_FC_LINE));
+		_FC_BufferInit(&NewStarts, sizeof(size_t));
+
+		const char* Window = Raw->Count > 0 ? (const char*)Raw->pData + From : "";
+		Result = _FC_ParseLineRange(Window, NewTo - From, From == 0, &NewLines, &State->Config);
+		if (Result != FC_OK)
+			goto cleanup;
+		if (!_FC_ComputeRawLineStarts(Window, NewTo - From, From == 0, &State->Config, &NewStarts))
 		{
-			goto cleanup; // reject raw \\.\ or \\?\ paths
+			Result = FC_ERROR_MEMORY;
+			goto cleanup;
 		}
+		NewStarts.Count--; // The window length.
+		for (size_t i = 0; i < NewStarts.Count; i++)
+			((size_t*)NewStarts.pData)[i] += From;
 
-		// Step 2: Allow-list accepted path types (defence-in-depth: blocks any
-		// future RTL_PATH_TYPE values that may be added to the enum)
-		if (!(PathType == RtlPathTypeUncAbsolute ||
-			PathType == RtlPathTypeDriveAbsolute ||
-			PathType == RtlPathTypeDriveRelative ||
-			PathType == RtlPathTypeRooted ||
-			PathType == RtlPathTypeRelative))
+		// Reserve first, so that the old line texts are only freed once nothing can fail.
+		if ((NewLines.Count > Last - First && !_FC_BufferEnsureCapacity(Lines, NewLines.Count - (Last - First))) ||
+			(NewStarts.Count > Last - First && !_FC_BufferEnsureCapacity(Starts, NewStarts.Count - (Last - First))))
 		{
+			Result = FC_ERROR_MEMORY;
 			goto cleanup;
 		}
+		for (size_t i = First; i < Last; i++)
+			_FC_WorkFree(((_FC_LINE*)Lines->pData)[i].Text);
+		_FC_BufferSplice(Lines, First, Last - First, NewLines.pData, NewLines.Count);
+		_FC_BufferSplice(Starts, First, Last - First, NewStarts.pData, NewStarts.Count);
+		for (size_t i = First + NewStarts.Count; i < Starts->Count; i++)
+			((size_t*)Starts->pData)[i] = ((size_t*)Starts->pData)[i] - Edit->RemoveLength + Edit->InsertLength;
+		size_t NewCount = NewLines.Count;
+		NewLines.Count = 0; // The line texts now belong to the state.
 
-		// Step 3: Reject Alternate Data Stream (ADS) paths
-		// An ADS path embeds a colon after the filename, e.g. "C:\file.txt:stream".
-		// Skip the drive-letter colon at index 1 if present, then reject any further colon.
+		Result = _FC_DiffStateRepair(State, Side, First, Last, NewCount);
+
+	cleanup:
+		_FC_FreeLineBufferContents(&NewLines);
+		_FC_BufferFree(&NewStarts);
+		if (Result != FC_OK)
+			State->Error = Result;
+		return Result;
+	}
+
+	/**
+	 * @brief Releases everything a state owns. Safe on partially built states.
+	 * @internal
+	 */
+	static void
+		_FC_DiffStateFree(
+			_In_opt_ FC_DIFF_STATE* State)
+	{
+		if (State == NULL)
+			return;
+		for (int i = 0; i < 2; i++)
 		{
-			const WCHAR* scanStart = InputPath;
-			if (InputPath[0] != L'\0' &&
-				InputPath[1] != L'\0' &&
-				((InputPath[0] >= L'A' && InputPath[0] <= L'Z') ||
-				 (InputPath[0] >= L'a' && InputPath[0] <= L'z')) &&
-				InputPath[1] == L':')
-			{
-				scanStart = InputPath + 2;
-			}
-			if (wcschr(scanStart, L':') != NULL)
-			{
-				goto cleanup;
-			}
+			_FC_BufferFree(&State->Raw[i]);
+			_FC_FreeLineBufferContents(&State->Lines[i]);
+			_FC_BufferFree(&State->Starts[i]);
 		}
+		_FC_BufferFree(&State->Blocks);
+		_FC_WorkFree(State);
+	}
 
-		// Step 4: Convert to full NT path via native call
-		NTSTATUS Status = RtlDosPathNameToNtPathName_U_WithStatus(
-			InputPath,
-			&NtPath,
-			NULL, // FilePart not needed
-			NULL); // Reserved
+	/**
+	 * @brief Compares two in-memory texts and keeps the result for incremental updates.
+	 *
+	 * The texts are copied, parsed and compared once with the chunked LCS of
+	 * `FC_CompareBuffersText`. Afterwards `FC_DiffStateEdit` applies byte-range edits
+	 * to either text: only the lines an edit touches are parsed again, and only the
+	 * lines between the nearest unchanged lines around them are compared again, so
+	 * the cost of an edit follows its size rather than the size of the texts (apart
+	 * from moving the tail of the text and renumbering the later lines and blocks).
+	 *
+	 * Blocks never overlap and their indices are absolute line numbers into the line
+	 * arrays of `FC_DiffStateGetContext`. After edits, block boundaries may differ from
+	 * those of a fresh comparison where several alignments are equally good.
+	 *
+	 * Text modes and flags apply as for `FC_CompareBuffersText`; `FC_MODE_BINARY` is
+	 * treated as `FC_MODE_TEXT_ASCII`. `Config->DiffCallback` may be NULL and is not
+	 * called; `Config->Cache` and `Config->ProgressCallback` are ignored. The
+	 * configuration is copied. A state is not thread-safe. It allocates from
+	 * `Config->Allocator` when set, otherwise from the process heap.
+	 *
+	 * @param Text1 The first text. May be NULL only if Length1 is 0.
+	 * @param Length1 The length of the first text in bytes.
+	 * @param Text2 The second text. May be NULL only if Length2 is 0.
+	 * @param Length2 The length of the second text in bytes.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 * @param[out] StateOut Receives the state, or NULL on failure.
+	 * @return FC_OK on success, or FC_ERROR_INVALID_PARAM or FC_ERROR_MEMORY.
+	 */
+	FC_RESULT
+		FC_DiffStateCreate(
+			_In_reads_bytes_opt_(Length1) const char* Text1,
+			_In_ size_t Length1,
+			_In_reads_bytes_opt_(Length2) const char* Text2,
+			_In_ size_t Length2,
+			_In_ const FC_CONFIG* Config,
+			_Outptr_result_maybenull_ FC_DIFF_STATE** StateOut)
+	{
+		FC_RESULT Result = FC_OK;
+		FC_DIFF_STATE* State = NULL;
+		if (StateOut == NULL)
+			return FC_ERROR_INVALID_PARAM;
+		*StateOut = NULL;
+		if (!Config || !_FC_IsValidAllocator(&Config->Allocator) ||
+			(!Text1 && Length1 > 0) || (!Text2 && Length2 > 0))
+			return FC_ERROR_INVALID_PARAM;
 
-		if (!NT_SUCCESS(Status))
+		// The state outlives this call, so it never lives on a session heap.
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+
+		State = (FC_DIFF_STATE*)_FC_WorkAlloc(_FC_ALLOC_ZERO, sizeof(FC_DIFF_STATE));
+		if (State == NULL)
 		{
+			Result = FC_ERROR_MEMORY;
 			goto cleanup;
 		}
-		ntPathInitialized = TRUE;
+		State->Config = *Config;
+		if (State->Config.Mode == FC_MODE_BINARY)
+			State->Config.Mode = FC_MODE_TEXT_ASCII;
+		State->Config.DiffCallback = NULL;
+		State->Config.Cache = NULL;
+		State->Config.Stats = NULL;
+		State->Config.ProgressCallback = NULL;
+		for (int i = 0; i < 2; i++)
+		{
+			_FC_BufferInit(&State->Raw[i], sizeof(char));
+			_FC_BufferInit(&State->Lines[i], sizeof(_FC_LINE));
+			_FC_BufferInit(&State->Starts[i], sizeof(size_t));
+		}
+		_FC_BufferInit(&State->Blocks, sizeof(FC_DIFF_BLOCK));
 
-		// Step 5: Detect risky NT path prefixes
-		if (NtPath.Length >= 8 * sizeof(WCHAR))
+		const char* Texts[2] = { Text1, Text2 };
+		size_t Lengths[2] = { Length1, Length2 };
+		for (int i = 0; i < 2; i++)
 		{
-			const WCHAR* s = NtPath.Buffer;
-			// Block named pipes and raw device paths
-			if (_wcsnicmp(s, L"\\Device\\", 8) == 0 ||
-				_wcsnicmp(s, L"\\??\\PIPE\\", 9) == 0)
+			if (!_FC_BufferAppendRange(&State->Raw[i], Texts[i], Lengths[i]))
+			{
+				Result = FC_ERROR_MEMORY;
+				goto cleanup;
+			}
+			const char* Raw = Lengths[i] > 0 ? (const char*)State->Raw[i].pData : "";
+			Result = _FC_ParseLines(Raw, Lengths[i], &State->Lines[i], &State->Config);
+			if (Result != FC_OK)
+				goto cleanup;
+			if (!_FC_ComputeRawLineStarts(Raw, Lengths[i], TRUE, &State->Config, &State->Starts[i]))
 			{
+				Result = FC_ERROR_MEMORY;
 				goto cleanup;
 			}
 		}
 
-		// Step 6: Reject reserved DOS device names
-		const WCHAR* base = wcsrchr(NtPath.Buffer, L'\\');
-		if (base == NULL)
-		{
-			// No backslash found, the whole path is the base component.
-			base = NtPath.Buffer;
-		}
+		Result = _FC_DiffLineRange(&State->Lines[0], 0, State->Lines[0].Count,
+			&State->Lines[1], 0, State->Lines[1].Count,
+			_FC_DiffStateChunkLines(State), &State->Config, &State->Blocks);
+		if (Result != FC_OK)
+			goto cleanup;
+
+		State->Context.Lines1 = &State->Lines[0];
+		State->Context.Lines2 = &State->Lines[1];
+		State->Context.UserData = Config->UserData;
+
+	cleanup:
+		if (Result != FC_OK)
+			_FC_DiffStateFree(State);
 		else
+			*StateOut = State;
+		_FC_LeaveWork(Previous);
+		return Result;
+	}
+
+	/**
+	 * @brief Applies byte-range edits to one text of a state and updates its diff.
+	 *
+	 * Edits are applied in order; each offset refers to the text as left by the
+	 * previous edit. An edit that lies outside the text fails with
+	 * FC_ERROR_INVALID_PARAM and leaves the state as the earlier edits made it.
+	 * After FC_ERROR_MEMORY the state can only be closed.
+	 *
+	 * @param State A state from `FC_DiffStateCreate`.
+	 * @param Side The text the edits apply to.
+	 * @param Edits The edits. May be NULL only if EditCount is 0.
+	 * @param EditCount The number of edits.
+	 * @return FC_OK if the texts are now identical, FC_DIFFERENT if they differ, or
+	 *         FC_ERROR_INVALID_PARAM / FC_ERROR_MEMORY.
+	 */
+	FC_RESULT
+		FC_DiffStateEdit(
+			_Inout_ FC_DIFF_STATE* State,
+			_In_ FC_TEXT_SIDE Side,
+			_In_reads_opt_(EditCount) const FC_TEXT_EDIT* Edits,
+			_In_ size_t EditCount)
+	{
+		if (State == NULL || (Side != FC_TEXT_FIRST && Side != FC_TEXT_SECOND) ||
+			(Edits == NULL && EditCount > 0))
+			return FC_ERROR_INVALID_PARAM;
+		if (State->Error != FC_OK)
+			return State->Error;
+
+		FC_RESULT Result = FC_OK;
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, &State->Config);
+		for (size_t i = 0; i < EditCount && Result == FC_OK; i++)
+			Result = _FC_DiffStateApplyEdit(State, Side, &Edits[i]);
+		_FC_LeaveWork(Previous);
+
+		if (Result != FC_OK)
+			return Result;
+		return State->Blocks.Count > 0 ? FC_DIFFERENT : FC_OK;
+	}
+
+	/**
+	 * @brief Retrieves the current diff of a state.
+	 *
+	 * @param State A state from `FC_DiffStateCreate`.
+	 * @param[out] Blocks Receives the blocks, valid until the next edit or close.
+	 * @param[out] BlockCount Receives the number of blocks.
+	 * @return FC_OK if the texts are identical, FC_DIFFERENT if they differ, or
+	 *         FC_ERROR_INVALID_PARAM, or the error that made the state unusable.
+	 */
+	FC_RESULT
+		FC_DiffStateGetBlocks(
+			_In_ const FC_DIFF_STATE* State,
+			_Out_ const FC_DIFF_BLOCK** Blocks,
+			_Out_ size_t* BlockCount)
+	{
+		if (State == NULL || Blocks == NULL || BlockCount == NULL)
+			return FC_ERROR_INVALID_PARAM;
+		*Blocks = NULL;
+		*BlockCount = 0;
+		if (State->Error != FC_OK)
+			return State->Error;
+		*Blocks = (const FC_DIFF_BLOCK*)State->Blocks.pData;
+		*BlockCount = State->Blocks.Count;
+		return State->Blocks.Count > 0 ? FC_DIFFERENT : FC_OK;
+	}
+
+	/**
+	 * @brief Returns the whole-text context of a state, for formatting blocks.
+	 *
+	 * `Lines1` and `Lines2` cover every line of both texts, the offsets are 0 and the
+	 * paths are NULL. The line arrays change with each edit.
+	 *
+	 * @param State A state from `FC_DiffStateCreate`.
+	 * @return The context, or NULL if State is NULL.
+	 */
+	const FC_USER_CONTEXT*
+		FC_DiffStateGetContext(
+			_In_opt_ const FC_DIFF_STATE* State)
+	{
+		return State ? &State->Context : NULL;
+	}
+
+	/**
+	 * @brief Frees a state.
+	 * @param State The state to free. NULL is accepted and ignored.
+	 */
+	void
+		FC_DiffStateClose(
+			_In_opt_ FC_DIFF_STATE* State)
+	{
+		// The state frees itself, so its configuration is copied out first.
+		FC_CONFIG Owner = { 0 };
+		if (State != NULL)
+			Owner = State->Config;
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, &Owner);
+		_FC_DiffStateFree(State);
+		_FC_LeaveWork(Previous);
+	}
+
+	/* -------------------- Intra-Line Refinement -------------------- */
+
+	//
+	// FC_RefineBlock pairs the lines of a change block in order and runs a
+	// character-level Myers diff on each pair, after trimming the common prefix and
+	// suffix. The search gives up once it has spent FC_REFINE_LINE_BUDGET steps on a
+	// pair; the trimmed middle is then reported as a single span.
+	//
+
+	// Work allowed per line pair: snake steps, diagonals visited and trace entries kept.
+#ifndef FC_REFINE_LINE_BUDGET
+#define FC_REFINE_LINE_BUDGET (1u << 20)
+#endif
+
+	/**
+	 * @brief Compares two bytes of line text under the case flag.
+	 * @internal
+	 */
+	static inline BOOL
+		_FC_RefineBytesEqual(
+			_In_ char A,
+			_In_ char B,
+			_In_ BOOL FoldCase)
+	{
+		if (A == B)
+			return TRUE;
+		return FoldCase && _FC_ToLowerAscii((unsigned char)A) == _FC_ToLowerAscii((unsigned char)B);
+	}
+
+	/**
+	 * @brief Widens a span so that it does not split a UTF-8 sequence.
+	 * @internal
+	 */
+	static inline void
+		_FC_RefineAlignUtf8(
+			_In_reads_(Length) const char* Text,
+			_In_ size_t Length,
+			_Inout_ size_t* Start,
+			_Inout_ size_t* End)
+	{
+		while (*Start > 0 && *Start < Length && ((unsigned char)Text[*Start] & 0xC0) == 0x80)
+			(*Start)--;
+		while (*End < Length && ((unsigned char)Text[*End] & 0xC0) == 0x80)
+			(*End)++;
+	}
+
+	/**
+	 * @brief Appends the changed spans of one line pair.
+	 * @internal
+	 * @param[out] pCoarse Set to TRUE if the budget ran out and one span covers the change.
+	 * @return FALSE on memory allocation failure.
+	 */
+	static BOOL
+		_FC_RefinePair(
+			_In_ const _FC_LINE* LineA,
+			_In_ const _FC_LINE* LineB,
+			_In_ size_t IndexA,
+			_In_ size_t IndexB,
+			_In_ const FC_CONFIG* Config,
+			_Inout_ _FC_BUFFER* Spans,
+			_Out_ BOOL* pCoarse)
+	{
+		BOOL FoldCase = (Config->Flags & FC_IGNORE_CASE) != 0;
+		const char* A = LineA->Text;
+		const char* B = LineB->Text;
+		size_t N = LineA->Length, M = LineB->Length;
+		*pCoarse = FALSE;
+
+		size_t Prefix = 0;
+		while (Prefix < N && Prefix < M && _FC_RefineBytesEqual(A[Prefix], B[Prefix], FoldCase))
+			Prefix++;
+		size_t Suffix = 0;
+		while (Suffix < N - Prefix && Suffix < M - Prefix &&
+			_FC_RefineBytesEqual(A[N - 1 - Suffix], B[M - 1 - Suffix], FoldCase))
+			Suffix++;
+		if (Prefix == N && Prefix == M)
+			return TRUE;
+
+		const char* a = A + Prefix;
+		const char* b = B + Prefix;
+		size_t n = N - Prefix - Suffix, m = M - Prefix - Suffix;
+		size_t First = Spans->Count;
+		size_t Work = 0, D = 0;
+		BOOL Found = FALSE;
+		BOOL Ok = TRUE;
+
+		// Greedy Myers search; Trace keeps V[-d..d] of every round d at offset d*d.
+		_FC_BUFFER Trace;
+		_FC_BufferInit(&Trace, sizeof(size_t));
+		size_t MaxD = 0;
+		while ((MaxD + 1) * (MaxD + 1) <= FC_REFINE_LINE_BUDGET && MaxD < n + m)
+			MaxD++;
+		size_t Center = MaxD + 1;
+		size_t* V = (size_t*)_FC_WorkAlloc(0, (2 * MaxD + 3) * sizeof(size_t));
+		if (V == NULL)
 		{
-			// Move past the backslash to the start of the name.
-			base++;
+			Ok = FALSE;
+			goto cleanup;
 		}
+		V[Center + 1] = 0;
 
-		for (int i = 0; i < _FC_ARRAYSIZE(g_ReservedDevices); ++i)
+		for (D = 0; D <= MaxD && !Found && Work <= FC_REFINE_LINE_BUDGET; D++)
 		{
-			if (_wcsicmp(base, g_ReservedDevices[i]) == 0)
+			for (size_t j = 0; j <= 2 * D; j += 2)
+			{
+				size_t k = Center - D + j; // Diagonal k - Center, from -D to D.
+				size_t x = (j == 0 || (j != 2 * D && V[k - 1] < V[k + 1])) ? V[k + 1] : V[k - 1] + 1;
+				size_t y = x + Center - k;
+				while (x < n && y < m && _FC_RefineBytesEqual(a[x], b[y], FoldCase))
+				{
+					x++;
+					y++;
+					Work++;
+				}
+				V[k] = x;
+				Work++;
+				if (x >= n && y >= m)
+					Found = TRUE;
+			}
+			if (!_FC_BufferAppendRange(&Trace, &V[Center - D], 2 * D + 1))
 			{
+				Ok = FALSE;
 				goto cleanup;
 			}
+			Work += 2 * D + 1;
 		}
 
-		// Step 7: Allocate and copy canonical path
-		size_t len = (NtPath.Length / sizeof(WCHAR)) + 1;
-		outPath = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, len * sizeof(WCHAR));
-		if (!outPath)
+		if (!Found)
 		{
+			*pCoarse = TRUE;
+			FC_LINE_SPAN Span = { IndexA, IndexB, Prefix, N - Suffix, Prefix, M - Suffix };
+			Ok = _FC_BufferAppend(Spans, &Span);
 			goto cleanup;
 		}
 
-		errno_t err = wcsncpy_s(outPath, len, NtPath.Buffer, _TRUNCATE);
-		if (err != 0 || outPath[0] == L'\0')
+		// Walk back from (n, m); the edits come out last first.
 		{
-			goto cleanup;
+			size_t Rounds = D; // The search ended in round Rounds - 1.
+			size_t x = n, y = m;
+			const size_t* Snapshots = (const size_t*)Trace.pData;
+			for (size_t d = Rounds - 1; d > 0; d--)
+			{
+				const size_t* Prev = Snapshots + (d - 1) * (d - 1); // V[-(d-1)..d-1]
+				size_t j = x + d - y; // Diagonal x - y, shifted by d.
+				BOOL Down = (j == 0 || (j != 2 * d && Prev[j - 2] < Prev[j]));
+				size_t PrevJ = Down ? j : j - 2; // In round d - 1 coordinates.
+				size_t PrevX = Prev[PrevJ];
+				size_t PrevY = PrevX + (d - 1) - PrevJ;
+				FC_LINE_SPAN Edit = { IndexA, IndexB, Prefix + PrevX, Down ? 1u : 0u, Prefix + PrevY, 0 };
+				if (!_FC_BufferAppend(Spans, &Edit))
+				{
+					Ok = FALSE;
+					goto cleanup;
+				}
+				x = PrevX;
+				y = PrevY;
+			}
 		}
 
-		// Step 8: Success - set output parameter
-		*CanonicalPathOut = outPath;
-		success = TRUE;
-
-	cleanup:
-		if (ntPathInitialized)
+		// Reverse the raw edits (stored as position + direction) and merge them into spans.
 		{
-			RtlFreeUnicodeString(&NtPath);
+			size_t EditCount = Spans->Count - First;
+			FC_LINE_SPAN* Edits = (FC_LINE_SPAN*)_FC_BufferGet(Spans, First);
+			for (size_t i = 0; i < EditCount / 2; i++)
+			{
+				FC_LINE_SPAN Swap = Edits[i];
+				Edits[i] = Edits[EditCount - 1 - i];
+				Edits[EditCount - 1 - i] = Swap;
+			}
+			size_t Out = First;
+			for (size_t i = 0; i < EditCount; i++)
+			{
+				FC_LINE_SPAN Edit = *(FC_LINE_SPAN*)_FC_BufferGet(Spans, First + i);
+				BOOL Inserts = (Edit.EndA != 0);
+				FC_LINE_SPAN* Last = (Out > First) ? (FC_LINE_SPAN*)_FC_BufferGet(Spans, Out - 1) : NULL;
+				if (Last != NULL && Last->EndA == Edit.StartA && Last->EndB == Edit.StartB)
+				{
+					if (Inserts) Last->EndB++; else Last->EndA++;
+				}
+				else
+				{
+					FC_LINE_SPAN* Span = (FC_LINE_SPAN*)_FC_BufferGet(Spans, Out++);
+					Span->LineA = IndexA;
+					Span->LineB = IndexB;
+					Span->StartA = Edit.StartA;
+					Span->EndA = Edit.StartA + (Inserts ? 0 : 1);
+					Span->StartB = Edit.StartB;
+					Span->EndB = Edit.StartB + (Inserts ? 1 : 0);
+				}
+			}
+			Spans->Count = Out;
 		}
-		if (!success && outPath)
+
+	cleanup:
+		if (Ok && Config->Mode != FC_MODE_TEXT_ASCII)
 		{
-			HeapFree(GetProcessHeap(), 0, outPath);
+			for (size_t i = First; i < Spans->Count; i++)
+			{
+				FC_LINE_SPAN* Span = (FC_LINE_SPAN*)_FC_BufferGet(Spans, i);
+				_FC_RefineAlignUtf8(A, N, &Span->StartA, &Span->EndA);
+				_FC_RefineAlignUtf8(B, M, &Span->StartB, &Span->EndB);
+			}
 		}
-		return success;
+		_FC_WorkFree(V);
+		_FC_BufferFree(&Trace);
+		return Ok;
 	}
 
 	/**
-	 * @brief Status values for UTF-8 to wide-path conversion.
-	 * @internal
+	 * @brief Finds the changed spans inside the lines of a change block.
+	 *
+	 * The lines of the block are paired in order (the first line of A with the first
+	 * line of B, and so on); lines beyond the shorter side have no partner and get no
+	 * spans. Each pair is compared byte by byte, with `FC_IGNORE_CASE` folding ASCII
+	 * letters; whitespace flags already apply through the normalized line text. In the
+	 * UTF-8 and UTF-16 modes spans are widened to whole code points. A pair whose
+	 * comparison exceeds `FC_REFINE_LINE_BUDGET` gets a single span from its first to
+	 * its last differing byte and is counted in `CoarsePairs`.
+	 *
+	 * Refining is optional and separate from the comparison: it is meant to be called
+	 * from the diff callback, with the context and block it receives, or with the
+	 * context of an `FC_DIFF_STATE` or `FC_DIFF_ITERATOR`. `FC_DIFF_TYPE_ADD` and
+	 * `FC_DIFF_TYPE_DELETE` blocks yield no spans.
+	 *
+	 * @param Context The context the block was reported with; its line buffers must be set.
+	 * @param Block A block reported with Context.
+	 * @param Config The configuration of the comparison. This must not be NULL.
+	 * @param[out] Refined Receives the block and its spans. Release it with
+	 *        `FC_RefinedBlockFree`, also on failure.
+	 * @return FC_OK on success, or FC_ERROR_INVALID_PARAM or FC_ERROR_MEMORY.
 	 */
-	typedef enum _FC_UTF8_TO_WIDE_STATUS
+	FC_RESULT
+		FC_RefineBlock(
+			_In_ const FC_USER_CONTEXT* Context,
+			_In_ const FC_DIFF_BLOCK* Block,
+			_In_ const FC_CONFIG* Config,
+			_Out_ FC_REFINED_BLOCK* Refined)
 	{
-		FC_UTF8_TO_WIDE_OK = 0,
-		FC_UTF8_TO_WIDE_INVALID_PARAM,
-		FC_UTF8_TO_WIDE_INVALID_UTF8,
-		FC_UTF8_TO_WIDE_OUT_OF_MEMORY,
-	} _FC_UTF8_TO_WIDE_STATUS;
+		FC_RESULT Result = FC_OK;
+		if (Refined == NULL)
+			return FC_ERROR_INVALID_PARAM;
+		memset(Refined, 0, sizeof(*Refined));
+		if (!Context || !Block || !Config || !_FC_IsValidAllocator(&Config->Allocator) ||
+			!Context->Lines1 || !Context->Lines2 ||
+			Block->StartA > Block->EndA || Block->StartB > Block->EndB ||
+			Block->StartA < Context->OffsetA || Block->StartB < Context->OffsetB ||
+			Block->EndA - Context->OffsetA > Context->Lines1->Count ||
+			Block->EndB - Context->OffsetB > Context->Lines2->Count)
+			return FC_ERROR_INVALID_PARAM;
+
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+		Refined->Block = *Block;
+		_FC_BufferInit(&Refined->Storage, sizeof(FC_LINE_SPAN));
+
+		if (Block->Type == FC_DIFF_TYPE_CHANGE)
+		{
+			size_t CountA = Block->EndA - Block->StartA;
+			size_t CountB = Block->EndB - Block->StartB;
+			size_t Pairs = CountA < CountB ? CountA : CountB;
+			for (size_t i = 0; i < Pairs; i++)
+			{
+				const _FC_LINE* LineA = (const _FC_LINE*)_FC_BufferGet(Context->Lines1, Block->StartA - Context->OffsetA + i);
+				const _FC_LINE* LineB = (const _FC_LINE*)_FC_BufferGet(Context->Lines2, Block->StartB - Context->OffsetB + i);
+				BOOL Coarse = FALSE;
+				if (!_FC_RefinePair(LineA, LineB, Block->StartA + i, Block->StartB + i, Config, &Refined->Storage, &Coarse))
+				{
+					Result = FC_ERROR_MEMORY;
+					break;
+				}
+				if (Coarse)
+					Refined->CoarsePairs++;
+			}
+		}
+
+		Refined->Spans = (const FC_LINE_SPAN*)Refined->Storage.pData;
+		Refined->SpanCount = Refined->Storage.Count;
+		_FC_LeaveWork(Previous);
+		return Result;
+	}
 
 	/**
-	 * @brief Converts a UTF-8 encoded string to a new wide (UTF-16) string.
-	 * @internal
-	 * @param Utf8String The null-terminated UTF-8 string to convert.
-	 * @param WideStringOut Receives a new heap-allocated wide string on success.
-	 * @return A status code describing success or failure.
+	 * @brief Releases the spans of a refined block.
+	 * @param Refined The block filled by `FC_RefineBlock`. NULL is accepted and ignored.
 	 */
-	static _FC_UTF8_TO_WIDE_STATUS
-		_FC_ConvertUtf8ToWide(
-			_In_z_ const char* Utf8String,
-			_Outptr_result_z_ WCHAR** WideStringOut)
+	void
+		FC_RefinedBlockFree(
+			_In_opt_ FC_REFINED_BLOCK* Refined)
 	{
-		if (WideStringOut == NULL || Utf8String == NULL)
-			return FC_UTF8_TO_WIDE_INVALID_PARAM;
+		if (Refined == NULL)
+			return;
+		_FC_BufferFree(&Refined->Storage);
+		Refined->Spans = NULL;
+		Refined->SpanCount = 0;
+	}
 
-		*WideStringOut = NULL;
+	/* -------------------- Prepared Reference Comparison -------------------- */
 
-		int wideLength = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, Utf8String, -1, NULL, 0);
-		if (wideLength == 0)
-			return FC_UTF8_TO_WIDE_INVALID_UTF8;
+	//
+	// A reference is read, parsed, hashed and indexed once. Each comparison against it
+	// parses only the candidate and runs the same LCS as a pairwise comparison, so the
+	// result is identical; the reference's index only keeps candidate lines that occur
+	// nowhere in the reference out of the per-chunk map (see _FC_FindLcs). The
+	// reference is never modified after FC_ReferenceOpenW returns, which lets any
+	// number of threads compare against it at the same time.
+	//
 
-		WCHAR* wideBuffer = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, (size_t)wideLength * sizeof(WCHAR));
-		if (wideBuffer == NULL)
-			return FC_UTF8_TO_WIDE_OUT_OF_MEMORY;
+	// Flags that change how lines are normalized and hashed; a comparison must use the
+	// same ones as the reference.
+#define _FC_REFERENCE_LINE_FLAGS (FC_IGNORE_CASE | FC_IGNORE_WS | FC_RAW_TABS)
 
-		if (MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, Utf8String, -1, wideBuffer, wideLength) == 0)
-		{
-			HeapFree(GetProcessHeap(), 0, wideBuffer);
-			return FC_UTF8_TO_WIDE_INVALID_UTF8;
-		}
+	/**
+	 * @struct _FC_REFERENCE
+	 * @brief A parsed and indexed reference text.
+	 * @internal
+	 */
+	struct _FC_REFERENCE
+	{
+		FC_CONFIG Config;       // Copy of the opening configuration; its allocator owns everything below.
+		WCHAR* Path;            // Canonical path, reported as Path1.
+		size_t Length;          // Size of the reference in bytes.
+		_FC_BUFFER Lines;       // Normalized lines (_FC_LINE).
+		_FC_LINE_INDEX Index;   // Hash index over Lines.
+	};
 
-		*WideStringOut = wideBuffer;
-		return FC_UTF8_TO_WIDE_OK;
+	/**
+	 * @brief Frees a reference inside the work scope of its own allocator.
+	 * @internal
+	 */
+	static void
+		_FC_ReferenceFree(
+			_In_opt_ struct _FC_REFERENCE* Reference)
+	{
+		if (Reference == NULL)
+			return;
+		_FC_FreeLineBufferContents(&Reference->Lines);
+		_FC_LineIndexFree(&Reference->Index);
+		_FC_WorkFree(Reference->Path);
+		_FC_WorkFree(Reference);
 	}
 
 	/**
-	 * @brief Returns TRUE if a path has a classic binary-extension used by fc.exe docs.
+	 * @brief Checks that a configuration can be used for a comparison against a reference.
 	 * @internal
 	 */
 	static inline BOOL
-		_FC_HasBinaryExtension(_In_z_ const WCHAR* Path)
+		_FC_ReferenceConfigMatches(
+			_In_ const struct _FC_REFERENCE* Reference,
+			_In_ const FC_CONFIG* Config)
 	{
-		if (Path == NULL)
-			return FALSE;
-
-		const WCHAR* Dot = wcsrchr(Path, L'.');
-		if (Dot == NULL || Dot[1] == L'\0')
-			return FALSE;
-
-		return (_wcsicmp(Dot, L".exe") == 0 ||
-			_wcsicmp(Dot, L".com") == 0 ||
-			_wcsicmp(Dot, L".sys") == 0 ||
-			_wcsicmp(Dot, L".obj") == 0 ||
-			_wcsicmp(Dot, L".lib") == 0 ||
-			_wcsicmp(Dot, L".bin") == 0);
+		return Config->DiffCallback != NULL &&
+			_FC_IsValidAllocator(&Config->Allocator) &&
+			Config->Mode == Reference->Config.Mode &&
+			(Config->Flags & _FC_REFERENCE_LINE_FLAGS) == (Reference->Config.Flags & _FC_REFERENCE_LINE_FLAGS);
 	}
 
 	/**
-	 * @brief The internal core comparison dispatcher.
-	 *
-	 * This function selects the appropriate comparison strategy (text or binary) based
-	 * on the `Config->Mode`. For `FC_MODE_AUTO`, it first applies classic fc.exe-style
-	 * binary-extension rules and then falls back to `_FC_IsProbablyTextFileW` content
-	 * detection.
+	 * @brief Parses a candidate text and compares it with a reference.
 	 * @internal
-	 * @param Path1 The canonical path to the first file.
-	 * @param Path2 The canonical path to the second file.
-	 * @param Config A pointer to the comparison configuration.
-	 * @return An FC_RESULT code indicating the outcome.
 	 */
-	static inline FC_RESULT
-		_FC_CompareFilesInternal(
-			_In_z_ const WCHAR* Path1,
-			_In_z_ const WCHAR* Path2,
+	static FC_RESULT
+		_FC_ReferenceCompareText(
+			_In_ const struct _FC_REFERENCE* Reference,
+			_In_opt_z_ const WCHAR* CandidatePath,
+			_In_reads_(Length) const char* Text,
+			_In_ size_t Length,
 			_In_ const FC_CONFIG* Config)
 	{
-		switch (Config->Mode)
-		{
-		case FC_MODE_TEXT_ASCII:
-		case FC_MODE_TEXT_UNICODE:
-			// Avoid OOM-prone full-buffer text parsing for very large files.
-			if (_FC_ShouldUseBinaryForLargeText(Path1, Path2, Config))
-				return _FC_CompareFilesBinary(Path1, Path2, Config);
-			// Corrected order: Path1, Path2
-			return _FC_CompareFilesText(Path1, Path2, Config);
-
-		case FC_MODE_BINARY:
-			// Corrected order: Path1, Path2
-			return _FC_CompareFilesBinary(Path1, Path2, Config);
+		FC_RESULT Result = FC_OK;
+		_FC_BUFFER Lines = { 0 };
+		LONGLONG MaxBytes = (Reference->Length > Length) ? (LONGLONG)Reference->Length : (LONGLONG)Length;
+		_FC_BufferInit(&Lines, sizeof(_FC_LINE));
 
-		case FC_MODE_AUTO:
-		default:
+		if (!_FC_ReportProgress(Config, FC_PHASE_TEXT_PARSE, 0, Length))
 		{
-			// NOTE: AUTO mode is intentionally modernized to blend classic extension
-			// heuristics with content sniffing (extension check first, then detection).
-			// See README "Documented Differences from Windows fc.exe".
-			if (_FC_HasBinaryExtension(Path1) || _FC_HasBinaryExtension(Path2))
-				return _FC_CompareFilesBinary(Path1, Path2, Config);
-
-			// Otherwise, fall back to content-based detection.
-			BOOL isText1 = _FC_IsProbablyTextFileW(Path1);
-			BOOL isText2 = _FC_IsProbablyTextFileW(Path2);
-			if (isText1 && isText2)
-			{
-				if (_FC_ShouldUseBinaryForLargeText(Path1, Path2, Config))
-					return _FC_CompareFilesBinary(Path1, Path2, Config);
-				return _FC_CompareFilesText(Path1, Path2, Config);
-			}
-			else
-				return _FC_CompareFilesBinary(Path1, Path2, Config);
+			Result = FC_CANCELLED;
+			goto cleanup;
 		}
+		Result = _FC_ParseLines(Text, Length, &Lines, Config);
+		if (Result != FC_OK)
+			goto cleanup;
+		if (!_FC_ReportProgress(Config, FC_PHASE_TEXT_PARSE, Length, Length))
+		{
+			Result = FC_CANCELLED;
+			goto cleanup;
 		}
-	}
 
-	//
-	// Main Implementation
-	//
+		Result = _FC_CompareLineArrays(Reference->Path, CandidatePath, &Reference->Lines, &Lines,
+			MaxBytes, &Reference->Index, Config);
 
-	// Forward declaration: FC_CompareFilesUtf8 calls FC_CompareFilesW which is defined below.
-	FC_RESULT FC_CompareFilesW(
-		_In_z_ const WCHAR* Path1,
-		_In_z_ const WCHAR* Path2,
-		_In_ const FC_CONFIG* Config);
+	cleanup:
+		_FC_FreeLineBufferContents(&Lines);
+		return Result;
+	}
 
 	/**
-	 * @brief Compares two files using UTF-8 encoded paths.
+	 * @brief Reads, parses and indexes a text file for repeated comparisons.
 	 *
-	 * This is a convenience wrapper function that takes UTF-8 encoded file paths,
-	 * converts them to wide (UTF-16) strings, and then calls the primary `FC_CompareFilesW`
-	 * function to perform the comparison.
+	 * The reference is always compared as text. `Config->Mode` must be
+	 * `FC_MODE_TEXT_ASCII` or `FC_MODE_TEXT_UNICODE`, and its line flags
+	 * (`FC_IGNORE_CASE`, `FC_IGNORE_WS`, `FC_RAW_TABS`) decide how the reference's
+	 * lines are normalized. `Config->DiffCallback` may be NULL; `Cache` and
+	 * `ProgressCallback` are ignored. The configuration is copied, and the reference
+	 * allocates from `Config->Allocator` when set, otherwise from the process heap.
 	 *
-	 * @param Path1 A null-terminated, UTF-8 encoded path to the first file.
-	 * @param Path2 A null-terminated, UTF-8 encoded path to the second file.
+	 * @param Path A null-terminated, wide (UTF-16) encoded path to the reference file.
 	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
-	 *
-	 * @return An FC_RESULT code indicating the outcome of the comparison.
-	 * @retval FC_ERROR_INVALID_PARAM if any of the required pointers are NULL or if the path strings contain invalid UTF-8 sequences.
-	 * @retval FC_ERROR_MEMORY if memory allocation for path conversion fails.
-	 * @retval Other FC_RESULT codes as returned by `FC_CompareFilesW`.
+	 * @param[out] ReferenceOut Receives the reference, or NULL on failure.
+	 * @return FC_OK on success, or FC_ERROR_INVALID_PARAM, FC_ERROR_IO or FC_ERROR_MEMORY.
 	 */
 	FC_RESULT
-		FC_CompareFilesUtf8(
-			_In_z_ const char* Path1,
-			_In_z_ const char* Path2,
-			_In_ const FC_CONFIG* Config)
+		FC_ReferenceOpenW(
+			_In_z_ const WCHAR* Path,
+			_In_ const FC_CONFIG* Config,
+			_Outptr_result_maybenull_ FC_REFERENCE** ReferenceOut)
 	{
 		FC_RESULT Result = FC_OK;
-		_FC_UTF8_TO_WIDE_STATUS Path1Status;
-		_FC_UTF8_TO_WIDE_STATUS Path2Status;
-		WCHAR* WidePath1 = NULL;
-		WCHAR* WidePath2 = NULL;
+		struct _FC_REFERENCE* Reference = NULL;
+		char* Raw = NULL;
+		if (ReferenceOut == NULL)
+			return FC_ERROR_INVALID_PARAM;
+		*ReferenceOut = NULL;
+		if (!Path || !Config || !_FC_IsValidAllocator(&Config->Allocator) ||
+			(Config->Mode != FC_MODE_TEXT_ASCII && Config->Mode != FC_MODE_TEXT_UNICODE))
+			return FC_ERROR_INVALID_PARAM;
 
-		if (!Path1 || !Path2 || !Config || !Config->DiffCallback)
+		// The reference outlives this call, so it never lives on a session heap.
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+
+		Reference = (struct _FC_REFERENCE*)_FC_WorkAlloc(_FC_ALLOC_ZERO, sizeof(struct _FC_REFERENCE));
+		if (Reference == NULL)
 		{
-			return FC_ERROR_INVALID_PARAM; // No cleanup needed, return directly.
+			Result = FC_ERROR_MEMORY;
+			goto cleanup;
 		}
-
-		// Convert paths, checking each one immediately.
-		Path1Status = _FC_ConvertUtf8ToWide(Path1, &WidePath1);
-		if (Path1Status != FC_UTF8_TO_WIDE_OK)
+		Reference->Config = *Config;
+		Reference->Config.DiffCallback = NULL;
+		Reference->Config.ProgressCallback = NULL;
+		Reference->Config.Cache = NULL;
+		Reference->Config.Stats = NULL;
+		_FC_BufferInit(&Reference->Lines, sizeof(_FC_LINE));
+
+		if (!_FC_ToCanonicalPath(Path, &Reference->Path))
 		{
-			Result = (Path1Status == FC_UTF8_TO_WIDE_OUT_OF_MEMORY)
-				? FC_ERROR_MEMORY
-				: FC_ERROR_INVALID_PARAM;
+			Result = FC_ERROR_INVALID_PARAM;
 			goto cleanup;
 		}
-
-		Path2Status = _FC_ConvertUtf8ToWide(Path2, &WidePath2);
-		if (Path2Status != FC_UTF8_TO_WIDE_OK)
+		Raw = _FC_ReadFileContents(Reference->Path, &Reference->Length, &Result);
+		if (Result != FC_OK)
+			goto cleanup;
+		Result = _FC_ParseLines(Raw, Reference->Length, &Reference->Lines, &Reference->Config);
+		if (Result != FC_OK)
+			goto cleanup;
+		if (!_FC_LineIndexBuild(&Reference->Lines, &Reference->Index))
 		{
-			Result = (Path2Status == FC_UTF8_TO_WIDE_OUT_OF_MEMORY)
-				? FC_ERROR_MEMORY
-				: FC_ERROR_INVALID_PARAM;
+			Result = FC_ERROR_MEMORY;
 			goto cleanup;
 		}
 
-		// Chain to the primary public API.
-		Result = FC_CompareFilesW(WidePath1, WidePath2, Config);
+		*ReferenceOut = Reference;
+		Reference = NULL;
 
 	cleanup:
-		if (WidePath1) HeapFree(GetProcessHeap(), 0, WidePath1);
-		if (WidePath2) HeapFree(GetProcessHeap(), 0, WidePath2);
-
+		_FC_WorkFree(Raw);
+		_FC_ReferenceFree(Reference);
+		_FC_LeaveWork(Previous);
 		return Result;
 	}
 
 	/**
-	 * @brief Compares two files using wide (UTF-16) encoded paths. (Primary Function)
+	 * @brief Compares a reference with a candidate file.
 	 *
-	 * This is the main entry point of the library. It takes two file paths and a
-	 * configuration structure, performs path canonicalization and validation, and then
-	 * dispatches to the appropriate internal comparison routine (text or binary)
-	 * based on the configuration. This function supports long file paths.
+	 * Only the candidate is read and parsed. The reference is file 1: blocks index its
+	 * lines as StartA/EndA, and `Context->Path1` is its canonical path. The candidate
+	 * is always compared as text, whatever its size. `Config->Mode` and its line flags
+	 * must be those the reference was opened with; `DiffCallback`, `UserData`,
+	 * `ResyncLines`, `BufferLines`, `Allocator` and `ProgressCallback` apply as for
+	 * `FC_CompareFilesW`, and `Cache` is ignored.
 	 *
-	 * @param Path1 A null-terminated, wide (UTF-16) encoded path to the first file.
-	 * @param Path2 A null-terminated, wide (UTF-16) encoded path to the second file.
-	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 * The reference is only read, so several threads may compare against one reference
+	 * at the same time, each with its own configuration.
 	 *
-	 * @return An FC_RESULT code indicating the outcome of the comparison.
-	 * @retval FC_OK if the files are identical.
-	 * @retval FC_DIFFERENT if the files differ.
-	 * @retval FC_ERROR_INVALID_PARAM if any required pointers are NULL or if the paths are determined to be invalid or unsafe.
-	 * @retval FC_ERROR_IO if a file cannot be read.
-	 * @retval FC_ERROR_MEMORY if a memory allocation fails during the operation.
+	 * @param Reference A reference from `FC_ReferenceOpenW`.
+	 * @param CandidatePath A null-terminated, wide (UTF-16) encoded path to the candidate file.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 * @return FC_OK if the texts are identical, FC_DIFFERENT if they differ, or
+	 *         FC_ERROR_INVALID_PARAM, FC_ERROR_IO, FC_ERROR_MEMORY or FC_CANCELLED.
 	 */
 	FC_RESULT
-		FC_CompareFilesW(
-			_In_z_ const WCHAR* Path1,
-			_In_z_ const WCHAR* Path2,
+		FC_ReferenceCompareFileW(
+			_In_ const FC_REFERENCE* Reference,
+			_In_z_ const WCHAR* CandidatePath,
 			_In_ const FC_CONFIG* Config)
 	{
 		FC_RESULT Result = FC_OK;
-		WCHAR* CanonicalPath1 = NULL;
-		WCHAR* CanonicalPath2 = NULL;
-
-		if (!Path1 || !Path2 || !Config || !Config->DiffCallback) {
-			Result = FC_ERROR_INVALID_PARAM;
-			goto cleanup;
-		}
+		WCHAR* CanonicalPath = NULL;
+		char* Raw = NULL;
+		size_t Length = 0;
+		if (!Reference || !CandidatePath || !Config || !_FC_ReferenceConfigMatches(Reference, Config))
+			return FC_ERROR_INVALID_PARAM;
 
-		// Path preparation
-		if (!_FC_ToCanonicalPath(Path1, &CanonicalPath1) ||
-			!_FC_ToCanonicalPath(Path2, &CanonicalPath2))
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+		if (!_FC_ToCanonicalPath(CandidatePath, &CanonicalPath))
 		{
 			Result = FC_ERROR_INVALID_PARAM;
 			goto cleanup;
 		}
-
-		// Call the core logic function, which does NOT free the memory.
-		Result = _FC_CompareFilesInternal(CanonicalPath1, CanonicalPath2, Config);
+		Raw = _FC_ReadFileContents(CanonicalPath, &Length, &Result);
+		if (Result != FC_OK)
+			goto cleanup;
+		Result = _FC_ReferenceCompareText(Reference, CanonicalPath, Raw, Length, Config);
 
 	cleanup:
-		// This function is the owner of these pointers, so it frees them.
-		if (CanonicalPath1) HeapFree(GetProcessHeap(), 0, CanonicalPath1);
-		if (CanonicalPath2) HeapFree(GetProcessHeap(), 0, CanonicalPath2);
+		_FC_WorkFree(Raw);
+		_FC_WorkFree(CanonicalPath);
+		_FC_LeaveWork(Previous);
+		return Result;
+	}
 
+	/**
+	 * @brief Compares a reference with an in-memory candidate text.
+	 *
+	 * As `FC_ReferenceCompareFileW`, with `Context->Path2` set to NULL.
+	 *
+	 * @param Reference A reference from `FC_ReferenceOpenW`.
+	 * @param Text The candidate text. May be NULL only if Length is 0.
+	 * @param Length The length of the candidate text in bytes.
+	 * @param Config A pointer to the comparison configuration structure. This must not be NULL.
+	 * @return FC_OK if the texts are identical, FC_DIFFERENT if they differ, or
+	 *         FC_ERROR_INVALID_PARAM, FC_ERROR_MEMORY or FC_CANCELLED.
+	 */
+	FC_RESULT
+		FC_ReferenceCompareBuffer(
+			_In_ const FC_REFERENCE* Reference,
+			_In_reads_bytes_opt_(Length) const char* Text,
+			_In_ size_t Length,
+			_In_ const FC_CONFIG* Config)
+	{
+		if (!Reference || (!Text && Length > 0) || !Config || !_FC_ReferenceConfigMatches(Reference, Config))
+			return FC_ERROR_INVALID_PARAM;
+
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, Config);
+		FC_RESULT Result = _FC_ReferenceCompareText(Reference, NULL, Text ? Text : "", Length, Config);
+		_FC_LeaveWork(Previous);
 		return Result;
 	}
 
+	/**
+	 * @brief Frees a reference. No comparison may be using it.
+	 * @param Reference The reference to free. NULL is accepted and ignored.
+	 */
+	void
+		FC_ReferenceClose(
+			_In_opt_ FC_REFERENCE* Reference)
+	{
+		// The reference frees itself, so its configuration is copied out first.
+		FC_CONFIG Owner = { 0 };
+		if (Reference != NULL)
+			Owner = Reference->Config;
+		_FC_WORK_SCOPE Previous = _FC_EnterWork(NULL, &Owner);
+		_FC_ReferenceFree(Reference);
+		_FC_LeaveWork(Previous);
+	}
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,11 +6,27 @@
 #include <string.h>      // strstr
 #include "../fc/filecheck.h"   // FC_CONFIG, FC_RESULT, FC_OK, FC_DIFFERENT, FC_MODE_*, FC_IGNORE_*,
 // FileCheckCompareFilesUtf8()
+#ifndef _WIN32
+#include <fcntl.h>       // AT_FDCWD
+#include <sys/stat.h>    // stat, utimensat
+#include <time.h>        // nanosleep
+#endif
 
 #pragma comment(lib, "Pathcch.lib") // Link Pathcch
 #define MAX_LONG_PATH 32768
 const int UTF8_BUFFER_SIZE = MAX_LONG_PATH * 4;
+#ifdef _WIN32
 #define LONG_PATH_PREFIX L"\\\\?\\"
+#define PATH_SEPARATOR L"\\"
+#define PATH_SEPARATOR_A "\\"
+#define FC_EXE_NAME L"fc.exe"
+#else
+// POSIX paths need no extended-length prefix.
+#define LONG_PATH_PREFIX L""
+#define PATH_SEPARATOR L"/"
+#define PATH_SEPARATOR_A "/"
+#define FC_EXE_NAME L"fc"
+#endif
 #define MAX_FAILURES 256
 #define FAILURE_DETAIL_SIZE 1024
 
@@ -156,7 +172,7 @@ static void ConcatPath(
 	_Out_writes_z_(MAX_LONG_PATH) WCHAR* out)
 {
 	WCHAR* ext = AllocWcharPath();
-	const BOOL alreadyExtended = (wcsncmp(baseDir, LONG_PATH_PREFIX, 4) == 0);
+	const BOOL alreadyExtended = (wcsncmp(baseDir, LONG_PATH_PREFIX, ARRAYSIZE(LONG_PATH_PREFIX) - 1) == 0);
 
 	if (FAILED(StringCchCopyW(ext, MAX_LONG_PATH, alreadyExtended ? baseDir : LONG_PATH_PREFIX)) ||
 		(!alreadyExtended && FAILED(StringCchCatW(ext, MAX_LONG_PATH, baseDir))) ||
@@ -242,7 +258,62 @@ static void FreeTestPaths(TEST_PATHS* tp)
 }
 
 /**
- * @brief Builds an FC_CONFIG pre-wired to StructuredOutputCallback.
+ * @brief Counts the blocks handed out through an FC_ALLOCATOR and optionally fails one.
+ */
+typedef struct {
+	LONG Allocs;        /**< Successful Alloc calls. */
+	LONG Reallocs;      /**< Successful Realloc calls. */
+	LONG Live;          /**< Blocks allocated and not yet freed. */
+	LONG FailAt;        /**< 1-based Alloc/Realloc call that fails; 0 never fails. */
+	LONG Calls;         /**< Alloc and Realloc calls so far, including the failed one. */
+} COUNTING_ALLOCATOR;
+
+/** Shared by every configuration built with MakeTestConfig. */
+static COUNTING_ALLOCATOR g_TestAllocator;
+
+static BOOL CountingShouldFail(COUNTING_ALLOCATOR* counter)
+{
+	LONG call = InterlockedIncrement(&counter->Calls);
+	return counter->FailAt != 0 && call == counter->FailAt;
+}
+
+static void* CountingAlloc(void* AllocatorData, size_t Size)
+{
+	COUNTING_ALLOCATOR* counter = (COUNTING_ALLOCATOR*)AllocatorData;
+	if (CountingShouldFail(counter)) return NULL;
+	void* block = HeapAlloc(GetProcessHeap(), 0, Size);
+	if (block)
+	{
+		InterlockedIncrement(&counter->Allocs);
+		InterlockedIncrement(&counter->Live);
+	}
+	return block;
+}
+
+static void* CountingRealloc(void* AllocatorData, void* Block, size_t Size)
+{
+	COUNTING_ALLOCATOR* counter = (COUNTING_ALLOCATOR*)AllocatorData;
+	if (CountingShouldFail(counter)) return NULL;
+	void* block = HeapReAlloc(GetProcessHeap(), 0, Block, Size);
+	if (block) InterlockedIncrement(&counter->Reallocs);
+	return block;
+}
+
+static void CountingFree(void* AllocatorData, void* Block)
+{
+	COUNTING_ALLOCATOR* counter = (COUNTING_ALLOCATOR*)AllocatorData;
+	InterlockedDecrement(&counter->Live);
+	HeapFree(GetProcessHeap(), 0, Block);
+}
+
+static FC_ALLOCATOR MakeCountingAllocator(COUNTING_ALLOCATOR* counter)
+{
+	FC_ALLOCATOR allocator = { CountingAlloc, CountingRealloc, CountingFree, counter };
+	return allocator;
+}
+
+/**
+ * @brief Builds an FC_CONFIG pre-wired to StructuredOutputCallback and g_TestAllocator.
  * @param mode  The comparison mode.
  * @param flags FC_* flag bits.
  * @param ctx   Pointer to the DIFF_TEST_CONTEXT that receives callback data.
@@ -254,6 +325,7 @@ static FC_CONFIG MakeTestConfig(FC_MODE mode, UINT flags, DIFF_TEST_CONTEXT* ctx
 	cfg.Mode = mode;
 	cfg.Flags = flags;
 	cfg.UserData = ctx;
+	cfg.Allocator = MakeCountingAllocator(&g_TestAllocator);
 	return cfg;
 }
 
@@ -683,6 +755,7 @@ static void Test_ErrorNonExistentFile(const WCHAR* baseDir)
 	FreeTestPaths(&tp);
 }
 
+#ifdef _WIN32
 static void Test_ErrorReservedDeviceName(const WCHAR* baseDir)
 {
 	TEST_PATHS tp = AllocTestPaths();
@@ -710,6 +783,21 @@ static void Test_ErrorRawDevicePath(const WCHAR* baseDir)
 	ASSERT_TRUE(FC_CompareFilesUtf8(tp.u1, tp.u2, &cfg) == FC_ERROR_INVALID_PARAM);
 	FreeTestPaths(&tp);
 }
+#else
+static void Test_ErrorDeviceFile(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"device_peer.txt", tp.p1);
+	WRITE_STR_FILE(tp.p1, "data");
+	ConvertWideToUtf8OrExit(tp.p1, tp.u1, UTF8_BUFFER_SIZE);
+	// Character devices never end, so they are refused when opened rather than read.
+	ConvertWideToUtf8OrExit(L"/dev/zero", tp.u2, UTF8_BUFFER_SIZE);
+	DIFF_TEST_CONTEXT testCtx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_AUTO, 0, &testCtx);
+	ASSERT_TRUE(FC_CompareFilesUtf8(tp.u1, tp.u2, &cfg) == FC_ERROR_IO);
+	FreeTestPaths(&tp);
+}
+#endif
 
 static void Test_ErrorEmptyPath(const WCHAR* baseDir)
 {
@@ -927,7 +1015,7 @@ static void Test_RelativePathTraversal(const WCHAR* baseDir)
 	ConcatPath(baseDir, L"relative_file.txt", tp.p1);
 	WRITE_STR_FILE(tp.p1, "data");
 	// Build a path like C:\path\to\temp\FileCheckTests\..\FileCheckTests\relative_file.txt
-	if (FAILED(StringCchPrintfW(tp.p2, MAX_LONG_PATH, L"%s\\..\\%s\\relative_file.txt", baseDir, L"FileCheckTests"))) Throw(L"StringCchPrintfW failed", NULL);
+	if (FAILED(StringCchPrintfW(tp.p2, MAX_LONG_PATH, L"%ls" PATH_SEPARATOR L".." PATH_SEPARATOR L"%ls" PATH_SEPARATOR L"relative_file.txt", baseDir, L"FileCheckTests"))) Throw(L"StringCchPrintfW failed", NULL);
 	DIFF_TEST_CONTEXT testCtx = { 0 };
 	FC_CONFIG cfg = MakeTestConfig(FC_MODE_AUTO, 0, &testCtx);
 	ConvertWideToUtf8OrExit(tp.p1, tp.u1, UTF8_BUFFER_SIZE);
@@ -936,13 +1024,15 @@ static void Test_RelativePathTraversal(const WCHAR* baseDir)
 	FreeTestPaths(&tp);
 }
 
+// Trailing dots and alternate data streams are Win32 path semantics.
+#ifdef _WIN32
 static void Test_TrailingDotInPath(const WCHAR* baseDir)
 {
 	TEST_PATHS tp = AllocTestPaths();
 	ConcatPath(baseDir, L"trailing_dot_file.txt", tp.p1);
 	WRITE_STR_FILE(tp.p1, "data");
 	// Create a path ending with a dot
-	if (FAILED(StringCchPrintfW(tp.p2, MAX_LONG_PATH, L"%s.", tp.p1))) Throw(L"StringCchPrintfW failed", NULL);
+	if (FAILED(StringCchPrintfW(tp.p2, MAX_LONG_PATH, L"%ls.", tp.p1))) Throw(L"StringCchPrintfW failed", NULL);
 	DIFF_TEST_CONTEXT testCtx = { 0 };
 	FC_CONFIG cfg = MakeTestConfig(FC_MODE_AUTO, 0, &testCtx);
 	ConvertWideToUtf8OrExit(tp.p1, tp.u1, UTF8_BUFFER_SIZE);
@@ -957,7 +1047,7 @@ static void Test_AlternateDataStream(const WCHAR* baseDir)
 	ConcatPath(baseDir, L"ads_file.txt", tp.p1);
 	WRITE_STR_FILE(tp.p1, "main stream data");
 	// Create a path with an alternate data stream
-	if (FAILED(StringCchPrintfW(tp.p2, MAX_LONG_PATH, L"%s:stream", tp.p1))) Throw(L"StringCchPrintfW failed", NULL);
+	if (FAILED(StringCchPrintfW(tp.p2, MAX_LONG_PATH, L"%ls:stream", tp.p1))) Throw(L"StringCchPrintfW failed", NULL);
 	WRITE_STR_FILE(tp.p2, "ads data");
 	DIFF_TEST_CONTEXT testCtx = { 0 };
 	FC_CONFIG cfg = MakeTestConfig(FC_MODE_AUTO, 0, &testCtx);
@@ -967,6 +1057,7 @@ static void Test_AlternateDataStream(const WCHAR* baseDir)
 	ASSERT_TRUE(FC_CompareFilesUtf8(tp.u1, tp.u2, &cfg) == FC_ERROR_INVALID_PARAM);
 	FreeTestPaths(&tp);
 }
+#endif
 
 static void Test_CompareFileToItself(const WCHAR* baseDir)
 {
@@ -1568,11 +1659,11 @@ static void Test_Regression_LBn_WindowLimitsMatch(const WCHAR* baseDir)
 	// Distance = |3 - 0| = 3.
 	//
 	// BufferLines=5 (>= 3): SAME is matched as a common anchor.
-	//   ProcessLcs reports a DELETE for the 3 "X" lines before SAME.
+	//   The LCS report is a DELETE for the 3 "X" lines before SAME.
 	//   Callback type = FC_DIFF_TYPE_DELETE.
 	//
 	// BufferLines=2 (< 3): SAME is NOT matched; the LCS is empty.
-	//   ProcessLcs reports one big CHANGE covering all lines.
+	//   The LCS report is one big CHANGE covering all lines.
 	//   Callback type = FC_DIFF_TYPE_CHANGE.
 	TEST_PATHS tp = AllocTestPaths();
 	ConcatPath(baseDir, L"lbn_win1.txt", tp.p1);
@@ -1605,196 +1696,2136 @@ static void Test_Regression_LBn_WindowLimitsMatch(const WCHAR* baseDir)
 	FreeTestPaths(&tp);
 }
 
-static BOOL ReadFileToBuffer(
-	_In_z_ const WCHAR* path,
-	_Out_writes_z_(outCap) char* outBuf,
-	_In_ DWORD outCap)
+static ULONGLONG GetTestFileSize(_In_z_ const WCHAR* path)
 {
 	HANDLE h = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 	if (h == INVALID_HANDLE_VALUE)
-		return FALSE;
-
-	DWORD total = 0;
-	if (outCap > 0)
-		outBuf[0] = '\0';
-	while (outCap > 0 && total < outCap - 1)
-	{
-		DWORD bytesRead = 0;
-		char tmp[512];
-		if (!ReadFile(h, tmp, sizeof(tmp), &bytesRead, NULL))
-		{
-			CloseHandle(h);
-			return FALSE;
-		}
-		if (bytesRead == 0)
-			break;
-		DWORD toCopy = bytesRead;
-		if (toCopy > outCap - 1 - total)
-			toCopy = outCap - 1 - total;
-		CopyMemory(outBuf + total, tmp, toCopy);
-		total += toCopy;
-	}
-	if (outCap > 0)
-		outBuf[total] = '\0';
+		return 0;
+	LARGE_INTEGER size;
+	BOOL ok = GetFileSizeEx(h, &size);
 	CloseHandle(h);
-	return TRUE;
+	return ok ? (ULONGLONG)size.QuadPart : 0;
 }
 
-static BOOL ResolveFcExePath(_Out_writes_z_(MAX_LONG_PATH) WCHAR* fcPath)
+static void Test_Cache_UnchangedPairAnsweredFromCache(const WCHAR* baseDir)
 {
-	if (!GetModuleFileNameW(NULL, fcPath, MAX_LONG_PATH))
-		return FALSE;
+	TEST_PATHS tp = AllocTestPaths();
+	WCHAR cachePath[MAX_LONG_PATH];
+	ConcatPath(baseDir, L"cache_pair1.txt", tp.p1);
+	ConcatPath(baseDir, L"cache_pair2.txt", tp.p2);
+	ConcatPath(baseDir, L"cache_pair.fccache", cachePath);
+	DeleteFileW(cachePath);
+	WRITE_STR_FILE(tp.p1, "alpha\nbeta\n");
+	WRITE_STR_FILE(tp.p2, "ALPHA\nbeta\n");
 
-	WCHAR* lastSlash = wcsrchr(fcPath, L'\\');
-	if (lastSlash == NULL)
-		return FALSE;
-	lastSlash[1] = L'\0';
-	if (FAILED(StringCchCatW(fcPath, MAX_LONG_PATH, L"fc.exe")))
-		return FALSE;
-	if (GetFileAttributesW(fcPath) != INVALID_FILE_ATTRIBUTES)
-		return TRUE;
+	// Freshly written files are normally too recent to be recorded.
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_CACHE_RACY_WINDOW_OVERRIDE", L"0"));
 
-	WCHAR cwd[MAX_LONG_PATH];
-	if (!GetCurrentDirectoryW(MAX_LONG_PATH, cwd))
-		return FALSE;
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_IGNORE_CASE, &ctx);
+	ULONGLONG hits = 0, misses = 0;
+
+	// Cold run: compared normally, then recorded.
+	ASSERT_TRUE(FC_CacheOpenW(cachePath, 0, &cfg.Cache) == FC_OK);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_OK);
+	FC_CacheGetStats(cfg.Cache, &hits, &misses);
+	ASSERT_TRUE(hits == 0 && misses == 1);
+	ASSERT_TRUE(FC_CacheClose(cfg.Cache) == FC_OK);
+
+	// Warm run from a reopened cache: answered without reading content.
+	ASSERT_TRUE(FC_CacheOpenW(cachePath, 0, &cfg.Cache) == FC_OK);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_OK);
+	FC_CacheGetStats(cfg.Cache, &hits, &misses);
+	ASSERT_TRUE(hits == 1 && misses == 0);
+
+	// The cached result is tied to the configuration that produced it.
+	cfg.Flags = 0;
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(ctx.CallbackCount == 1);
+	cfg.Flags = FC_IGNORE_CASE;
 
-	if (FAILED(PathCchCombine(fcPath, MAX_LONG_PATH, cwd, L"src\\x64\\Release\\fc.exe")))
-		return FALSE;
-	if (GetFileAttributesW(fcPath) != INVALID_FILE_ATTRIBUTES)
-		return TRUE;
+	// Rewriting a file invalidates its record.
+	WRITE_STR_FILE(tp.p2, "alpha\ngamma\n");
+	ctx.CallbackCount = 0;
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(ctx.CallbackCount == 1);
+	FC_CacheGetStats(cfg.Cache, &hits, &misses);
+	ASSERT_TRUE(hits == 1 && misses == 2);
+	ASSERT_TRUE(FC_CacheClose(cfg.Cache) == FC_OK);
 
-	if (FAILED(PathCchCombine(fcPath, MAX_LONG_PATH, cwd, L"x64\\Release\\fc.exe")))
-		return FALSE;
-	return GetFileAttributesW(fcPath) != INVALID_FILE_ATTRIBUTES;
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_CACHE_RACY_WINDOW_OVERRIDE", NULL));
+	FreeTestPaths(&tp);
 }
 
-static BOOL RunFcToOutputFileWithOptions(
-	_In_z_ const WCHAR* pattern1,
-	_In_z_ const WCHAR* pattern2,
-	_In_opt_z_ const WCHAR* options,
-	_In_z_ const WCHAR* outputPath,
-	_Out_ DWORD* exitCode)
+/**
+ * @brief Gives path2 the last-write time of path1, as `touch -r` does.
+ */
+static BOOL CopyTestLastWriteTime(_In_z_ const WCHAR* path1, _In_z_ const WCHAR* path2)
 {
-	WCHAR fcPath[MAX_LONG_PATH];
-	if (!ResolveFcExePath(fcPath))
+#ifdef _WIN32
+	FILETIME written;
+	HANDLE h = CreateFileW(path1, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (h == INVALID_HANDLE_VALUE)
 		return FALSE;
-
-	WCHAR cmdLine[4096];
-	if (options != NULL && options[0] != L'\0')
-	{
-		if (FAILED(StringCchPrintfW(cmdLine, ARRAYSIZE(cmdLine),
-			L"\"%s\" %s \"%s\" \"%s\"",
-			fcPath, options, pattern1, pattern2)))
-		{
-			return FALSE;
-		}
-	}
-	else if (FAILED(StringCchPrintfW(cmdLine, ARRAYSIZE(cmdLine),
-		L"\"%s\" \"%s\" \"%s\"",
-		fcPath, pattern1, pattern2)))
-	{
+	BOOL ok = GetFileTime(h, NULL, NULL, &written);
+	CloseHandle(h);
+	if (!ok)
 		return FALSE;
-	}
-
-	SECURITY_ATTRIBUTES sa = { 0 };
-	sa.nLength = sizeof(sa);
-	sa.bInheritHandle = TRUE;
-	HANDLE outFile = CreateFileW(outputPath, GENERIC_WRITE, FILE_SHARE_READ, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-	if (outFile == INVALID_HANDLE_VALUE)
+	h = CreateFileW(path2, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (h == INVALID_HANDLE_VALUE)
+		return FALSE;
+	ok = SetFileTime(h, NULL, NULL, &written);
+	CloseHandle(h);
+	return ok;
+#else
+	char native1[MAX_LONG_PATH];
+	char native2[MAX_LONG_PATH];
+	ConvertWideToUtf8OrExit(path1, native1, MAX_LONG_PATH);
+	ConvertWideToUtf8OrExit(path2, native2, MAX_LONG_PATH);
+	struct stat info;
+	if (stat(native1, &info) != 0)
 		return FALSE;
+	struct timespec times[2];
+	times[0].tv_sec = 0;
+	times[0].tv_nsec = UTIME_OMIT;
+#if defined(__APPLE__)
+	times[1] = info.st_mtimespec;
+#else
+	times[1] = info.st_mtim;
+#endif
+	return utimensat(AT_FDCWD, native2, times, 0) == 0;
+#endif
+}
 
-	STARTUPINFOW si = { 0 };
-	si.cb = sizeof(si);
-	si.dwFlags = STARTF_USESTDHANDLES;
-	si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
-	si.hStdOutput = outFile;
-	si.hStdError = outFile;
+/**
+ * @brief Waits long enough for the file system's timestamp clock to advance.
+ */
+static void WaitForTimestampTick(void)
+{
+#ifdef _WIN32
+	Sleep(50);
+#else
+	struct timespec delay = { 0, 50 * 1000 * 1000 };
+	nanosleep(&delay, NULL);
+#endif
+}
 
-	PROCESS_INFORMATION pi = { 0 };
-	BOOL ok = CreateProcessW(
-		fcPath,
-		cmdLine,
-		NULL,
-		NULL,
-		TRUE,
-		0,
-		NULL,
-		NULL,
-		&si,
-		&pi);
+static void Test_Cache_RestoredWriteTimeStillInvalidates(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	WCHAR stampPath[MAX_LONG_PATH];
+	WCHAR cachePath[MAX_LONG_PATH];
+	ConcatPath(baseDir, L"cache_ctime1.txt", tp.p1);
+	ConcatPath(baseDir, L"cache_ctime2.txt", tp.p2);
+	ConcatPath(baseDir, L"cache_ctime.stamp", stampPath);
+	ConcatPath(baseDir, L"cache_ctime.fccache", cachePath);
+	DeleteFileW(cachePath);
+	WRITE_STR_FILE(tp.p1, "alpha\n");
+	WRITE_STR_FILE(tp.p2, "alpha\n");
+	WRITE_STR_FILE(stampPath, "");
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_CACHE_RACY_WINDOW_OVERRIDE", L"0"));
 
-	CloseHandle(outFile);
-	if (!ok)
-		return FALSE;
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	ULONGLONG hits = 0, misses = 0;
+	ASSERT_TRUE(FC_CacheOpenW(cachePath, 0, &cfg.Cache) == FC_OK);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_OK);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_OK);
+	FC_CacheGetStats(cfg.Cache, &hits, &misses);
+	ASSERT_TRUE(hits == 1 && misses == 1);
+
+	// A same-size rewrite with its last-write time put back is still noticed:
+	// the change time moves and cannot be restored.
+	ASSERT_TRUE(CopyTestLastWriteTime(tp.p2, stampPath));
+	WaitForTimestampTick();
+	WRITE_STR_FILE(tp.p2, "omega\n");
+	ASSERT_TRUE(CopyTestLastWriteTime(stampPath, tp.p2));
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+	FC_CacheGetStats(cfg.Cache, &hits, &misses);
+	ASSERT_TRUE(hits == 1 && misses == 2);
+	ASSERT_TRUE(FC_CacheClose(cfg.Cache) == FC_OK);
+
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_CACHE_RACY_WINDOW_OVERRIDE", NULL));
+	FreeTestPaths(&tp);
+}
 
-	WaitForSingleObject(pi.hProcess, INFINITE);
-	ok = GetExitCodeProcess(pi.hProcess, exitCode);
+static void Test_Cache_CorruptFileAndSizeBound(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	WCHAR cachePath[MAX_LONG_PATH];
+	ConcatPath(baseDir, L"cache_bound1.bin", tp.p1);
+	ConcatPath(baseDir, L"cache_bound2.bin", tp.p2);
+	ConcatPath(baseDir, L"cache_bound.fccache", cachePath);
+	WRITE_STR_FILE(tp.p1, "same bytes");
+	WRITE_STR_FILE(tp.p2, "same bytes");
 
-	CloseHandle(pi.hThread);
-	CloseHandle(pi.hProcess);
-	return ok;
+	// A corrupted cache file is discarded, not reported as an error.
+	WRITE_STR_FILE(cachePath, "FCCACHE1 this is not a valid cache file");
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_CACHE_RACY_WINDOW_OVERRIDE", L"0"));
+
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_BINARY, 0, &ctx);
+	ULONGLONG hits = 0, misses = 0;
+	ASSERT_TRUE(FC_CacheOpenW(cachePath, 0, &cfg.Cache) == FC_OK);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_OK);
+	FC_CacheGetStats(cfg.Cache, &hits, &misses);
+	ASSERT_TRUE(hits == 0 && misses == 1);
+	ASSERT_TRUE(FC_CacheClose(cfg.Cache) == FC_OK);
+
+	// A budget too small for any record still saves a valid (empty) cache.
+	ASSERT_TRUE(FC_CacheOpenW(cachePath, 64, &cfg.Cache) == FC_OK);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_OK);
+	FC_CacheGetStats(cfg.Cache, &hits, &misses);
+	ASSERT_TRUE(hits == 1);
+	ASSERT_TRUE(FC_CacheClose(cfg.Cache) == FC_OK);
+	ASSERT_TRUE(GetTestFileSize(cachePath) <= 64);
+
+	ASSERT_TRUE(FC_CacheOpenW(cachePath, 0, &cfg.Cache) == FC_OK);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_OK);
+	FC_CacheGetStats(cfg.Cache, &hits, &misses);
+	ASSERT_TRUE(hits == 0 && misses == 1);
+	ASSERT_TRUE(FC_CacheClose(cfg.Cache) == FC_OK);
+
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_CACHE_RACY_WINDOW_OVERRIDE", NULL));
+	ASSERT_TRUE(FC_CacheOpenW(NULL, 0, &cfg.Cache) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(cfg.Cache == NULL);
+	FreeTestPaths(&tp);
 }
 
-static BOOL RunFcToOutputFile(
-	_In_z_ const WCHAR* pattern1,
-	_In_z_ const WCHAR* pattern2,
-	_In_z_ const WCHAR* outputPath,
-	_Out_ DWORD* exitCode)
+static void Test_Buffers_TextDiffMatchesFileKernel(const WCHAR* baseDir)
 {
-	return RunFcToOutputFileWithOptions(pattern1, pattern2, NULL, outputPath, exitCode);
+	const char* a = "Line1\nLine2\nLine3\n";
+	const char* b = "Line1\nChanged\nLine3\n";
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	ASSERT_TRUE(FC_CompareBuffersText(a, strlen(a), b, strlen(b), &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(ctx.CallbackCount == 1);
+	ASSERT_TRUE(ctx.Blocks[0].Type == FC_DIFF_TYPE_CHANGE);
+	ASSERT_TRUE(ctx.Blocks[0].StartA == 1 && ctx.Blocks[0].EndA == 2);
+	ASSERT_TRUE(ctx.Blocks[0].StartB == 1 && ctx.Blocks[0].EndB == 2);
+
+	// Normalization flags apply exactly as they do for files.
+	DIFF_TEST_CONTEXT ctx2 = { 0 };
+	FC_CONFIG cfg2 = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_IGNORE_CASE, &ctx2);
+	ASSERT_TRUE(FC_CompareBuffersText("Hello\n", 6, "HELLO\n", 6, &cfg2) == FC_OK);
+	ASSERT_TRUE(ctx2.CallbackCount == 0);
+
+	// Binary mode still runs the line comparison through the text entry point.
+	DIFF_TEST_CONTEXT ctx3 = { 0 };
+	FC_CONFIG cfg3 = MakeTestConfig(FC_MODE_BINARY, 0, &ctx3);
+	ASSERT_TRUE(FC_CompareBuffersText(a, strlen(a), a, strlen(a), &cfg3) == FC_OK);
+	ASSERT_TRUE(FC_CompareBuffersText(NULL, 0, NULL, 0, &cfg3) == FC_OK);
 }
 
-static BOOL RunFcToOutputFileNoOptions(
-	_In_z_ const WCHAR* pattern1,
-	_In_z_ const WCHAR* pattern2,
-	_In_z_ const WCHAR* outputPath,
-	_Out_ DWORD* exitCode)
+static void Test_Buffers_BinaryAndAutoDispatch(const WCHAR* baseDir)
 {
-	return RunFcToOutputFile(pattern1, pattern2, outputPath, exitCode);
+	unsigned char d1[] = { 1,2,3,4,5 };
+	unsigned char d2[] = { 1,2,99,4,5,6 };
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_BINARY, 0, &ctx);
+	ASSERT_TRUE(FC_CompareBuffers(d1, sizeof(d1), d2, sizeof(d2), &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(ctx.CallbackCount == 2);
+	ASSERT_TRUE(ctx.Blocks[0].Type == FC_DIFF_TYPE_CHANGE);
+	ASSERT_TRUE(ctx.Blocks[0].StartA == 2 && ctx.Blocks[0].EndA == 3 && ctx.Blocks[0].EndB == 99);
+	ASSERT_TRUE(ctx.Blocks[1].Type == FC_DIFF_TYPE_SIZE);
+	ASSERT_TRUE(ctx.Blocks[1].StartA == 5 && ctx.Blocks[1].StartB == 6);
+
+	// AUTO: text content is line-compared, binary content byte-compared.
+	const char* t1 = "alpha\nbeta\n";
+	const char* t2 = "alpha\ngamma\n";
+	DIFF_TEST_CONTEXT ctx2 = { 0 };
+	FC_CONFIG cfg2 = MakeTestConfig(FC_MODE_AUTO, 0, &ctx2);
+	ASSERT_TRUE(FC_CompareBuffers(t1, strlen(t1), t2, strlen(t2), &cfg2) == FC_DIFFERENT);
+	ASSERT_TRUE(ctx2.CallbackCount == 1 && ctx2.Blocks[0].StartA == 1);
+	DIFF_TEST_CONTEXT ctx3 = { 0 };
+	FC_CONFIG cfg3 = MakeTestConfig(FC_MODE_AUTO, 0, &ctx3);
+	ASSERT_TRUE(FC_CompareBuffers(d1, sizeof(d1), d1, sizeof(d1), &cfg3) == FC_OK);
+
+	// Text mode above the size limit falls back to a byte comparison.
+	DIFF_TEST_CONTEXT ctx4 = { 0 };
+	FC_CONFIG cfg4 = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx4);
+	cfg4.MaxTextFileBytes = 4;
+	ASSERT_TRUE(FC_CompareBuffers(t1, strlen(t1), t2, strlen(t2), &cfg4) == FC_DIFFERENT);
+	ASSERT_TRUE(ctx4.Blocks[0].Type == FC_DIFF_TYPE_CHANGE && ctx4.Blocks[0].StartA == 6);
 }
 
-static void BuildLongSubdirName(_In_ int index, _Out_writes_z_(32) WCHAR* out)
+static void Test_Buffers_InvalidParams(const WCHAR* baseDir)
 {
-	if (FAILED(StringCchPrintfW(out, 32, L"seg_%02d_abcdefghijklmnop", index)))
-		Throw(L"String format fail", NULL);
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_BINARY, 0, &ctx);
+	ASSERT_TRUE(FC_CompareBuffers(NULL, 1, "a", 1, &cfg) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_CompareBuffers("a", 1, "a", 1, NULL) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_CompareBuffersText("a", 1, NULL, 3, &cfg) == FC_ERROR_INVALID_PARAM);
+	cfg.DiffCallback = NULL;
+	ASSERT_TRUE(FC_CompareBuffers("a", 1, "a", 1, &cfg) == FC_ERROR_INVALID_PARAM);
 }
 
-static void EnsureLongDirectory(_In_z_ const WCHAR* baseDir, _Out_writes_z_(MAX_LONG_PATH) WCHAR* outDir)
+/**
+ * @brief Context for a callback that tries to re-enter the session it runs on.
+ */
+typedef struct {
+	FC_SESSION* Session;
+	FC_RESULT ReentrantResult;
+	FC_RESULT NestedPlainResult;
+} SESSION_REENTRY_CONTEXT;
+
+static void
+SessionReentryCallback(
+	_In_ const FC_USER_CONTEXT* Context,
+	_In_ const FC_DIFF_BLOCK* Block)
 {
-	if (FAILED(StringCchCopyW(outDir, MAX_LONG_PATH, LONG_PATH_PREFIX)) ||
-		FAILED(StringCchCatW(outDir, MAX_LONG_PATH, baseDir)))
+	SESSION_REENTRY_CONTEXT* ctx = (SESSION_REENTRY_CONTEXT*)Context->UserData;
+	DIFF_TEST_CONTEXT inner = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &inner);
+	ctx->ReentrantResult = FC_SessionCompareBuffersText(ctx->Session, "a\n", 2, "b\n", 2, &cfg);
+	ctx->NestedPlainResult = FC_CompareBuffersText("a\n", 2, "b\n", 2, &cfg);
+}
+
+static void Test_Session_ReusedAcrossComparisons(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	WCHAR bin1[MAX_LONG_PATH], bin2[MAX_LONG_PATH];
+	unsigned char d1[] = { 1,2,3,4,5 };
+	unsigned char d2[] = { 1,2,99,4,5 };
+	ConcatPath(baseDir, L"session1.txt", tp.p1);
+	ConcatPath(baseDir, L"session2.txt", tp.p2);
+	ConcatPath(baseDir, L"session1.bin", bin1);
+	ConcatPath(baseDir, L"session2.bin", bin2);
+	WRITE_STR_FILE(tp.p1, "Line1\nLine2\nLine3\n");
+	WRITE_STR_FILE(tp.p2, "Line1\nChanged\nLine3\n");
+	if (!WriteDataFile(bin1, d1, sizeof(d1))) Throw(L"write bin failed", bin1);
+	if (!WriteDataFile(bin2, d2, sizeof(d2))) Throw(L"write bin failed", bin2);
+
+	FC_SESSION* session = NULL;
+	ASSERT_TRUE(FC_SessionCreate(&session) == FC_OK);
+	ASSERT_TRUE(session != NULL);
+
+	// Repeated comparisons on one session give the same answers as plain calls.
+	for (int round = 0; round < 3; round++)
 	{
-		Throw(L"Path copy fail", baseDir);
+		DIFF_TEST_CONTEXT ctx = { 0 };
+		FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+		ASSERT_TRUE(FC_SessionCompareFilesW(session, tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+		ASSERT_TRUE(ctx.CallbackCount == 1 && ctx.Blocks[0].StartA == 1 && ctx.Blocks[0].EndA == 2);
+		ASSERT_TRUE(FC_SessionCompareFilesW(session, tp.p1, tp.p1, &cfg) == FC_OK);
 	}
 
-	for (int i = 0; i < 12; i++)
-	{
-		WCHAR seg[32];
-		BuildLongSubdirName(i, seg);
-		if (FAILED(PathCchAddBackslash(outDir, MAX_LONG_PATH)) ||
-			FAILED(StringCchCatW(outDir, MAX_LONG_PATH, seg)))
-		{
-			Throw(L"Path concat fail", seg);
-		}
+	DIFF_TEST_CONTEXT binCtx = { 0 };
+	FC_CONFIG binCfg = MakeTestConfig(FC_MODE_BINARY, 0, &binCtx);
+	ASSERT_TRUE(FC_SessionCompareFilesW(session, bin1, bin2, &binCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(binCtx.CallbackCount == 1 && binCtx.Blocks[0].StartA == 2);
 
-		if (!CreateDirectoryW(outDir, NULL))
-		{
-			DWORD err = GetLastError();
-			if (err != ERROR_ALREADY_EXISTS)
-				Throw(L"CreateDirectoryW fail", outDir);
-		}
+	// The streamed binary path reuses the session's chunk buffers.
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_BINARY_STREAM_THRESHOLD_OVERRIDE", L"1"));
+	for (int round = 0; round < 2; round++)
+	{
+		DIFF_TEST_CONTEXT ctx = { 0 };
+		FC_CONFIG cfg = MakeTestConfig(FC_MODE_BINARY, 0, &ctx);
+		ASSERT_TRUE(FC_SessionCompareFilesW(session, bin1, bin2, &cfg) == FC_DIFFERENT);
+		ASSERT_TRUE(ctx.CallbackCount == 1 && ctx.Blocks[0].EndB == 99);
 	}
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_BINARY_STREAM_THRESHOLD_OVERRIDE", NULL));
+
+	DIFF_TEST_CONTEXT bufCtx = { 0 };
+	FC_CONFIG bufCfg = MakeTestConfig(FC_MODE_AUTO, 0, &bufCtx);
+	ASSERT_TRUE(FC_SessionCompareBuffers(session, "x\ny\n", 4, "x\ny\n", 4, &bufCfg) == FC_OK);
+	ASSERT_TRUE(FC_SessionCompareBuffersText(session, "x\n", 2, "z\n", 2, &bufCfg) == FC_DIFFERENT);
+
+	ASSERT_TRUE(FC_SessionClose(session) == FC_OK);
+	ASSERT_TRUE(FC_SessionClose(NULL) == FC_OK);
+	FreeTestPaths(&tp);
 }
 
-static void Test_Cli_WildcardLongPathFidelity(const WCHAR* baseDir)
+static void Test_Session_RejectsReentryAndNull(const WCHAR* baseDir)
 {
-	WCHAR deepLeft[MAX_LONG_PATH];
-	WCHAR deepRight[MAX_LONG_PATH];
-	EnsureLongDirectory(baseDir, deepLeft);
-	EnsureLongDirectory(baseDir, deepRight);
+	FC_SESSION* session = NULL;
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	ASSERT_TRUE(FC_SessionCreate(NULL) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_SessionCompareBuffersText(NULL, "a", 1, "a", 1, &cfg) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_SessionCreate(&session) == FC_OK);
+
+	// A callback may use the plain API but not re-enter its own session.
+	SESSION_REENTRY_CONTEXT reentry = { session, FC_OK, FC_OK };
+	FC_CONFIG reentryCfg = { 0 };
+	reentryCfg.Mode = FC_MODE_TEXT_ASCII;
+	reentryCfg.DiffCallback = SessionReentryCallback;
+	reentryCfg.UserData = &reentry;
+	ASSERT_TRUE(FC_SessionCompareBuffersText(session, "1\n", 2, "2\n", 2, &reentryCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(reentry.ReentrantResult == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(reentry.NestedPlainResult == FC_DIFFERENT);
+
+	// The session is usable again once the outer call has returned.
+	ASSERT_TRUE(FC_SessionCompareBuffersText(session, "1\n", 2, "1\n", 2, &cfg) == FC_OK);
+	ASSERT_TRUE(FC_SessionClose(session) == FC_OK);
+}
 
-	if (FAILED(PathCchAddBackslash(deepLeft, MAX_LONG_PATH)) ||
-		FAILED(StringCchCatW(deepLeft, MAX_LONG_PATH, L"left_side")))
+/**
+ * @brief Progress test context. Diff must stay first: UserData is shared with
+ *        StructuredOutputCallback.
+ */
+typedef struct {
+	DIFF_TEST_CONTEXT Diff;
+	int Reports;              /**< Number of progress callbacks received. */
+	int CancelAfter;          /**< Return FALSE on this report (1-based); 0 never cancels. */
+	BOOL Monotonic;           /**< Cleared if Done decreased within a phase or exceeded Total. */
+	FC_PROGRESS_PHASE LastPhase;
+	ULONGLONG LastDone;
+	ULONGLONG LastTotal;
+} PROGRESS_TEST_CONTEXT;
+
+static BOOL
+RecordingProgressCallback(
+	_In_opt_ void* UserData,
+	_In_ FC_PROGRESS_PHASE Phase,
+	_In_ ULONGLONG Done,
+	_In_ ULONGLONG Total)
+{
+	PROGRESS_TEST_CONTEXT* ctx = (PROGRESS_TEST_CONTEXT*)UserData;
+	if (ctx->Reports > 0 && Phase == ctx->LastPhase && Done < ctx->LastDone)
+		ctx->Monotonic = FALSE;
+	if (Done > Total)
+		ctx->Monotonic = FALSE;
+	ctx->Reports++;
+	ctx->LastPhase = Phase;
+	ctx->LastDone = Done;
+	ctx->LastTotal = Total;
+	return ctx->CancelAfter == 0 || ctx->Reports < ctx->CancelAfter;
+}
+
+static FC_CONFIG MakeProgressConfig(FC_MODE mode, PROGRESS_TEST_CONTEXT* ctx)
+{
+	FC_CONFIG cfg = MakeTestConfig(mode, 0, &ctx->Diff);
+	cfg.ProgressCallback = RecordingProgressCallback;
+	ctx->Monotonic = TRUE;
+	return cfg;
+}
+
+static void Test_Progress_ReportsEachPhaseToCompletion(const WCHAR* baseDir)
+{
+	const char* a = "one\ntwo\nthree\n";
+	const char* b = "one\n2\nthree\n";
+	PROGRESS_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeProgressConfig(FC_MODE_TEXT_ASCII, &ctx);
+	ASSERT_TRUE(FC_CompareBuffersText(a, strlen(a), b, strlen(b), &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(ctx.Diff.CallbackCount == 1);
+	ASSERT_TRUE(ctx.Monotonic);
+	ASSERT_TRUE(ctx.LastPhase == FC_PHASE_TEXT_COMPARE && ctx.LastDone == 3 && ctx.LastTotal == 3);
+
+	// Binary buffers report once per granule plus a final report.
+	const size_t size = 3 * 1024 * 1024 + 17;
+	unsigned char* d1 = (unsigned char*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size);
+	unsigned char* d2 = (unsigned char*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size);
+	if (!d1 || !d2) Throw(L"alloc failed", NULL);
+	d2[size - 1] = 1;
+	PROGRESS_TEST_CONTEXT binCtx = { 0 };
+	FC_CONFIG binCfg = MakeProgressConfig(FC_MODE_BINARY, &binCtx);
+	ASSERT_TRUE(FC_CompareBuffers(d1, size, d2, size, &binCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(binCtx.Reports == 5);
+	ASSERT_TRUE(binCtx.Monotonic);
+	ASSERT_TRUE(binCtx.LastPhase == FC_PHASE_BINARY_COMPARE && binCtx.LastDone == size && binCtx.LastTotal == size);
+
+	// The streamed file path reports per chunk as well.
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"progress1.bin", tp.p1);
+	ConcatPath(baseDir, L"progress2.bin", tp.p2);
+	if (!WriteDataFile(tp.p1, d1, (DWORD)size)) Throw(L"write bin failed", tp.p1);
+	if (!WriteDataFile(tp.p2, d2, (DWORD)size)) Throw(L"write bin failed", tp.p2);
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_BINARY_STREAM_THRESHOLD_OVERRIDE", L"1"));
+	PROGRESS_TEST_CONTEXT fileCtx = { 0 };
+	FC_CONFIG fileCfg = MakeProgressConfig(FC_MODE_BINARY, &fileCtx);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &fileCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(fileCtx.Reports == 5 && fileCtx.Monotonic);
+	ASSERT_TRUE(fileCtx.LastDone == size && fileCtx.Diff.CallbackCount == 1);
+
+	// Cancelling on the second report stops before the difference is reached.
+	PROGRESS_TEST_CONTEXT cancelCtx = { 0 };
+	FC_CONFIG cancelCfg = MakeProgressConfig(FC_MODE_BINARY, &cancelCtx);
+	cancelCtx.CancelAfter = 2;
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cancelCfg) == FC_CANCELLED);
+	ASSERT_TRUE(cancelCtx.Reports == 2 && cancelCtx.Diff.CallbackCount == 0);
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_BINARY_STREAM_THRESHOLD_OVERRIDE", NULL));
+
+	HeapFree(GetProcessHeap(), 0, d1);
+	HeapFree(GetProcessHeap(), 0, d2);
+	FreeTestPaths(&tp);
+}
+
+static void Test_Progress_CancelStopsTextAndBinary(const WCHAR* baseDir)
+{
+	const char* a = "one\ntwo\n";
+	const char* b = "uno\ndos\n";
+	PROGRESS_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeProgressConfig(FC_MODE_TEXT_ASCII, &ctx);
+	ctx.CancelAfter = 1;
+	ASSERT_TRUE(FC_CompareBuffersText(a, strlen(a), b, strlen(b), &cfg) == FC_CANCELLED);
+	ASSERT_TRUE(ctx.Reports == 1 && ctx.Diff.CallbackCount == 0);
+
+	// Cancelling at the start of the LCS phase skips every diff report.
+	PROGRESS_TEST_CONTEXT lcsCtx = { 0 };
+	FC_CONFIG lcsCfg = MakeProgressConfig(FC_MODE_TEXT_ASCII, &lcsCtx);
+	lcsCtx.CancelAfter = 4;
+	ASSERT_TRUE(FC_CompareBuffersText(a, strlen(a), b, strlen(b), &lcsCfg) == FC_CANCELLED);
+	ASSERT_TRUE(lcsCtx.LastPhase == FC_PHASE_TEXT_COMPARE && lcsCtx.Diff.CallbackCount == 0);
+
+	unsigned char d1[] = { 1,2,3 };
+	unsigned char d2[] = { 9,9,9,9 };
+	PROGRESS_TEST_CONTEXT binCtx = { 0 };
+	FC_CONFIG binCfg = MakeProgressConfig(FC_MODE_BINARY, &binCtx);
+	binCtx.CancelAfter = 1;
+	ASSERT_TRUE(FC_CompareBuffers(d1, sizeof(d1), d2, sizeof(d2), &binCfg) == FC_CANCELLED);
+	ASSERT_TRUE(binCtx.Diff.CallbackCount == 0);
+}
+
+static void Test_Iterator_MatchesCallbackBlocks(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"iter1.txt", tp.p1);
+	ConcatPath(baseDir, L"iter2.txt", tp.p2);
+	WRITE_STR_FILE(tp.p1, "A\nB\nC\nD\nE\nF\nG\n");
+	WRITE_STR_FILE(tp.p2, "A\nX\nC\nD\nE\nG\nH\n");
+
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(ctx.CallbackCount >= 2);
+
+	// The iterator needs no callback and yields the same blocks in the same order.
+	FC_CONFIG iterCfg = cfg;
+	iterCfg.DiffCallback = NULL;
+	FC_DIFF_ITERATOR* iter = NULL;
+	ASSERT_TRUE(FC_DiffBegin(tp.p1, tp.p2, &iterCfg, &iter) == FC_OK);
+	ASSERT_TRUE(iter != NULL);
+
+	const FC_USER_CONTEXT* context = FC_DiffGetContext(iter);
+	ASSERT_TRUE(context != NULL && context->Lines1->Count == 7 && context->Lines2->Count == 7);
+	ASSERT_TRUE(context->OffsetA == 0 && context->OffsetB == 0 && context->UserData == &ctx);
+
+	FC_DIFF_BLOCK block;
+	int count = 0;
+	BOOL same = TRUE;
+	while (FC_DiffNext(iter, &block) == FC_DIFFERENT)
+	{
+		if (count < 10 && memcmp(&block, &ctx.Blocks[count], sizeof(block)) != 0)
+			same = FALSE;
+		count++;
+	}
+	ASSERT_TRUE(count == ctx.CallbackCount);
+	ASSERT_TRUE(same);
+	ASSERT_TRUE(FC_DiffNext(iter, &block) == FC_OK);
+	FC_DiffEnd(iter);
+
+	// Identical files finish at once, and an iteration can be abandoned early.
+	ASSERT_TRUE(FC_DiffBegin(tp.p1, tp.p1, &iterCfg, &iter) == FC_OK);
+	ASSERT_TRUE(FC_DiffNext(iter, &block) == FC_OK);
+	FC_DiffEnd(iter);
+	ASSERT_TRUE(FC_DiffBegin(tp.p1, tp.p2, &iterCfg, &iter) == FC_OK);
+	ASSERT_TRUE(FC_DiffNext(iter, &block) == FC_DIFFERENT);
+	FC_DiffEnd(iter);
+
+	FreeTestPaths(&tp);
+}
+
+static void Test_Iterator_EmptySideYieldsBlock(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	WCHAR blankPath[MAX_LONG_PATH];
+	ConcatPath(baseDir, L"iter_empty.txt", tp.p1);
+	ConcatPath(baseDir, L"iter_full.txt", tp.p2);
+	ConcatPath(baseDir, L"iter_blank.txt", blankPath);
+	WRITE_STR_FILE(tp.p1, "");
+	WRITE_STR_FILE(tp.p2, "x\ny\n");
+	WRITE_STR_FILE(blankPath, "  \n\t\n");
+
+	// An empty side, or an all-blank one under /W, is one ADD or DELETE block for
+	// the other side's lines, from the callback and the iterator alike.
+	const WCHAR* lefts[3] = { tp.p1, tp.p2, blankPath };
+	const WCHAR* rights[3] = { tp.p2, tp.p1, tp.p2 };
+	const UINT flags[3] = { 0, 0, FC_IGNORE_WS };
+	const FC_DIFF_TYPE types[3] = { FC_DIFF_TYPE_ADD, FC_DIFF_TYPE_DELETE, FC_DIFF_TYPE_ADD };
+	for (int i = 0; i < 3; i++)
+	{
+		DIFF_TEST_CONTEXT ctx = { 0 };
+		FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, flags[i], &ctx);
+		ASSERT_TRUE(FC_CompareFilesW(lefts[i], rights[i], &cfg) == FC_DIFFERENT);
+		ASSERT_TRUE(ctx.CallbackCount == 1 && ctx.Blocks[0].Type == types[i]);
+		ASSERT_TRUE(ctx.Blocks[0].EndA - ctx.Blocks[0].StartA + ctx.Blocks[0].EndB - ctx.Blocks[0].StartB == 2);
+
+		FC_CONFIG iterCfg = cfg;
+		iterCfg.DiffCallback = NULL;
+		FC_DIFF_ITERATOR* iter = NULL;
+		FC_DIFF_BLOCK block;
+		ASSERT_TRUE(FC_DiffBegin(lefts[i], rights[i], &iterCfg, &iter) == FC_OK);
+		if (iter == NULL) Throw(L"begin failed", lefts[i]);
+		ASSERT_TRUE(FC_DiffNext(iter, &block) == FC_DIFFERENT);
+		ASSERT_TRUE(memcmp(&block, &ctx.Blocks[0], sizeof(block)) == 0);
+		ASSERT_TRUE(FC_DiffNext(iter, &block) == FC_OK);
+		FC_DiffEnd(iter);
+	}
+	FreeTestPaths(&tp);
+}
+
+static void Test_Iterator_BinaryBlocksAndInvalidParams(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	unsigned char d1[] = { 1,2,3,4,5 };
+	unsigned char d2[] = { 1,7,3,8,5,6,6 };
+	ConcatPath(baseDir, L"iter1.bin", tp.p1);
+	ConcatPath(baseDir, L"iter2.bin", tp.p2);
+	if (!WriteDataFile(tp.p1, d1, sizeof(d1))) Throw(L"write bin failed", tp.p1);
+	if (!WriteDataFile(tp.p2, d2, sizeof(d2))) Throw(L"write bin failed", tp.p2);
+
+	FC_CONFIG cfg = { 0 };
+	cfg.Mode = FC_MODE_BINARY;
+	FC_DIFF_ITERATOR* iter = NULL;
+	FC_DIFF_BLOCK block;
+	ASSERT_TRUE(FC_DiffBegin(tp.p1, tp.p2, &cfg, &iter) == FC_OK);
+	ASSERT_TRUE(FC_DiffGetContext(iter)->Lines1 == NULL);
+	ASSERT_TRUE(FC_DiffNext(iter, &block) == FC_DIFFERENT);
+	ASSERT_TRUE(block.Type == FC_DIFF_TYPE_CHANGE && block.StartA == 1 && block.EndA == 2 && block.EndB == 7);
+	ASSERT_TRUE(FC_DiffNext(iter, &block) == FC_DIFFERENT);
+	ASSERT_TRUE(block.Type == FC_DIFF_TYPE_CHANGE && block.StartA == 3 && block.EndB == 8);
+	ASSERT_TRUE(FC_DiffNext(iter, &block) == FC_DIFFERENT);
+	ASSERT_TRUE(block.Type == FC_DIFF_TYPE_SIZE && block.StartA == 5 && block.StartB == 7);
+	ASSERT_TRUE(FC_DiffNext(iter, &block) == FC_OK);
+	ASSERT_TRUE(FC_DiffNext(iter, &block) == FC_OK);
+	FC_DiffEnd(iter);
+
+	// Invalid arguments are rejected without leaving an iterator behind.
+	iter = (FC_DIFF_ITERATOR*)&cfg;
+	ASSERT_TRUE(FC_DiffBegin(NULL, tp.p2, &cfg, &iter) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(iter == NULL);
+	ASSERT_TRUE(FC_DiffBegin(tp.p1, tp.p2, NULL, &iter) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_DiffBegin(tp.p1, tp.p2, &cfg, NULL) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_DiffNext(NULL, &block) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_DiffGetContext(NULL) == NULL);
+	FC_DiffEnd(NULL);
+
+	// A missing file is an I/O error.
+	WCHAR missing[MAX_LONG_PATH];
+	ConcatPath(baseDir, L"iter_missing.bin", missing);
+	ASSERT_TRUE(FC_DiffBegin(tp.p1, missing, &cfg, &iter) == FC_ERROR_IO);
+	ASSERT_TRUE(iter == NULL);
+
+	FreeTestPaths(&tp);
+}
+
+static void Test_Allocator_RoutesWorkingMemory(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"alloc1.txt", tp.p1);
+	ConcatPath(baseDir, L"alloc2.txt", tp.p2);
+	WRITE_STR_FILE(tp.p1, "Alpha\n  Beta\tline\nGamma\nDelta\n");
+	WRITE_STR_FILE(tp.p2, "alpha\nBeta line\nGAMMA\nEpsilon\n");
+
+	// Text parsing, normalization, hashing and the LCS all go through the hooks.
+	COUNTING_ALLOCATOR counter = { 0 };
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_IGNORE_CASE | FC_IGNORE_WS, &ctx);
+	cfg.Allocator = MakeCountingAllocator(&counter);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(ctx.CallbackCount == 1);
+	ASSERT_TRUE(counter.Allocs > 0 && counter.Reallocs > 0);
+	ASSERT_TRUE(counter.Live == 0);
+
+	LONG fileAllocs = counter.Allocs;
+	ConvertWideToUtf8OrExit(tp.p1, tp.u1, UTF8_BUFFER_SIZE);
+	ConvertWideToUtf8OrExit(tp.p2, tp.u2, UTF8_BUFFER_SIZE);
+	ASSERT_TRUE(FC_CompareFilesUtf8(tp.u1, tp.u2, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(FC_CompareBuffers("a\nb\n", 4, "a\nc\n", 4, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(counter.Allocs > fileAllocs && counter.Live == 0);
+
+	// Session calls take per-call memory from the allocator as well.
+	FC_SESSION* session = NULL;
+	ASSERT_TRUE(FC_SessionCreate(&session) == FC_OK);
+	LONG sessionAllocs = counter.Allocs;
+	ASSERT_TRUE(FC_SessionCompareFilesW(session, tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(counter.Allocs > sessionAllocs && counter.Live == 0);
+	ASSERT_TRUE(FC_SessionClose(session) == FC_OK);
+
+	// Iterators keep the allocator for their whole lifetime.
+	FC_DIFF_ITERATOR* iter = NULL;
+	FC_DIFF_BLOCK block;
+	ASSERT_TRUE(FC_DiffBegin(tp.p1, tp.p2, &cfg, &iter) == FC_OK);
+	ASSERT_TRUE(counter.Live > 0);
+	ASSERT_TRUE(FC_DiffNext(iter, &block) == FC_DIFFERENT);
+	FC_DiffEnd(iter);
+	ASSERT_TRUE(counter.Live == 0);
+
+	// Callbacks must be supplied together.
+	FC_CONFIG partial = cfg;
+	partial.Allocator.Free = NULL;
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &partial) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_CompareBuffersText("a", 1, "a", 1, &partial) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_DiffBegin(tp.p1, tp.p2, &partial, &iter) == FC_ERROR_INVALID_PARAM);
+
+	FreeTestPaths(&tp);
+}
+
+static void Test_Allocator_FailureAtEachCallIsClean(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"allocfail1.txt", tp.p1);
+	ConcatPath(baseDir, L"allocfail2.txt", tp.p2);
+	WRITE_STR_FILE(tp.p1, "one\n two\nthree\nfour\nfive\n");
+	WRITE_STR_FILE(tp.p2, "ONE\ntwo\n3\nfour\nsix\n");
+
+	// Fail each allocation in turn until a run makes fewer calls than the one
+	// that would fail. A failed run must report an error (path canonicalization
+	// reports FC_ERROR_INVALID_PARAM), or the right answer where the failure only
+	// cost an optional probe, never a wrong answer, and must give back
+	// everything it took.
+	BOOL clean = TRUE;
+	BOOL sawMemoryError = FALSE;
+	BOOL wrongAnswer = FALSE;
+	BOOL reachedEnd = FALSE;
+	FC_RESULT result = FC_ERROR_MEMORY;
+	for (LONG failAt = 1; failAt < 10000 && !reachedEnd; failAt++)
+	{
+		COUNTING_ALLOCATOR counter = { 0 };
+		counter.FailAt = failAt;
+		DIFF_TEST_CONTEXT ctx = { 0 };
+		FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_IGNORE_CASE | FC_IGNORE_WS, &ctx);
+		cfg.Allocator = MakeCountingAllocator(&counter);
+		result = FC_CompareFilesW(tp.p1, tp.p2, &cfg);
+		if (result == FC_ERROR_MEMORY) sawMemoryError = TRUE;
+		if (result == FC_OK) wrongAnswer = TRUE;
+		if (counter.Live != 0) clean = FALSE;
+		reachedEnd = counter.Calls < failAt;
+	}
+	ASSERT_TRUE(reachedEnd);
+	ASSERT_TRUE(sawMemoryError);
+	ASSERT_TRUE(result == FC_DIFFERENT);
+	ASSERT_TRUE(!wrongAnswer);
+	ASSERT_TRUE(clean);
+
+	FreeTestPaths(&tp);
+}
+
+static void Test_Equal_AgreesWithCompare(const WCHAR* baseDir)
+{
+	static const char* const pairs[][2] = {
+		{ "a\nb\nc\n", "a\nb\nc\n" },
+		{ "a\r\nb\r\n", "a\nb" },
+		{ "a\n\n\nb\n", "a\nb\n" },
+		{ "\na\n", "a\n" },
+		{ "Hello World\n", "hello world\n" },
+		{ "x  y\t z\n", "x y z\n" },
+		{ "  lead\n\t\n", "lead\n" },
+		{ "tab\there\n", "tab     here\n" },
+		{ "\xEF\xBB\xBFsame\n", "same\n" },
+		{ "one\ntwo\n", "one\ntwo\nthree\n" },
+		{ "", "" },
+		{ "", "\n" },
+		{ "\xEF\xBB\xBF", "" },
+	};
+	static const UINT flagSets[] = { 0, FC_IGNORE_CASE, FC_IGNORE_WS, FC_IGNORE_CASE | FC_IGNORE_WS, FC_RAW_TABS };
+	static const FC_MODE modes[] = { FC_MODE_TEXT_ASCII, FC_MODE_TEXT_UNICODE, FC_MODE_AUTO, FC_MODE_BINARY };
+
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"equal1.txt", tp.p1);
+	ConcatPath(baseDir, L"equal2.txt", tp.p2);
+
+	int mismatches = 0;
+	for (size_t p = 0; p < sizeof(pairs) / sizeof(pairs[0]); p++)
+	{
+		if (!WriteDataFile(tp.p1, pairs[p][0], (DWORD)strlen(pairs[p][0]))) Throw(L"write failed", tp.p1);
+		if (!WriteDataFile(tp.p2, pairs[p][1], (DWORD)strlen(pairs[p][1]))) Throw(L"write failed", tp.p2);
+		for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+		{
+			for (size_t f = 0; f < sizeof(flagSets) / sizeof(flagSets[0]); f++)
+			{
+				DIFF_TEST_CONTEXT ctx = { 0 };
+				FC_CONFIG cfg = MakeTestConfig(modes[m], flagSets[f], &ctx);
+				FC_RESULT expected = FC_CompareFilesW(tp.p1, tp.p2, &cfg);
+				FC_RESULT expectedBuffers = FC_CompareBuffers(pairs[p][0], strlen(pairs[p][0]),
+					pairs[p][1], strlen(pairs[p][1]), &cfg);
+
+				// The equality check never needs a diff callback.
+				cfg.DiffCallback = NULL;
+				if (FC_FilesEqualW(tp.p1, tp.p2, &cfg) != expected) mismatches++;
+				if (FC_BuffersEqual(pairs[p][0], strlen(pairs[p][0]),
+					pairs[p][1], strlen(pairs[p][1]), &cfg) != expectedBuffers) mismatches++;
+			}
+		}
+	}
+	ASSERT_TRUE(mismatches == 0);
+
+	FreeTestPaths(&tp);
+}
+
+static void Test_Equal_StreamsAcrossWindowsAndStopsEarly(const WCHAR* baseDir)
+{
+	// Lines longer than the read window must be reassembled before comparison.
+	const size_t lineLength = 300 * 1024;
+	const size_t size = 3 * lineLength + 3;
+	char* d1 = (char*)HeapAlloc(GetProcessHeap(), 0, size);
+	char* d2 = (char*)HeapAlloc(GetProcessHeap(), 0, size);
+	if (!d1 || !d2) Throw(L"alloc failed", NULL);
+	for (size_t i = 0; i < size; i++)
+		d1[i] = (char)('a' + (i % 26));
+	d1[lineLength] = '\n';
+	d1[2 * lineLength + 1] = '\n';
+	d1[size - 1] = '\n';
+	memcpy(d2, d1, size);
+
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"equal_long1.txt", tp.p1);
+	ConcatPath(baseDir, L"equal_long2.txt", tp.p2);
+	if (!WriteDataFile(tp.p1, d1, (DWORD)size)) Throw(L"write failed", tp.p1);
+	if (!WriteDataFile(tp.p2, d2, (DWORD)size)) Throw(L"write failed", tp.p2);
+
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	ASSERT_TRUE(FC_FilesEqualW(tp.p1, tp.p2, &cfg) == FC_OK);
+
+	d2[2 * lineLength] = 'Z'; // Last byte of the second line.
+	if (!WriteDataFile(tp.p2, d2, (DWORD)size)) Throw(L"write failed", tp.p2);
+	ASSERT_TRUE(FC_FilesEqualW(tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(FC_BuffersEqual(d1, size, d2, size, &cfg) == FC_DIFFERENT);
+
+	// Binary: same size with a late mismatch, then different sizes.
+	FC_CONFIG binCfg = MakeTestConfig(FC_MODE_BINARY, 0, &ctx);
+	ASSERT_TRUE(FC_FilesEqualW(tp.p1, tp.p2, &binCfg) == FC_DIFFERENT);
+	memcpy(d2, d1, size);
+	if (!WriteDataFile(tp.p2, d2, (DWORD)size)) Throw(L"write failed", tp.p2);
+	ASSERT_TRUE(FC_FilesEqualW(tp.p1, tp.p2, &binCfg) == FC_OK);
+	if (!WriteDataFile(tp.p2, d2, (DWORD)(size - 1))) Throw(L"write failed", tp.p2);
+	ASSERT_TRUE(FC_FilesEqualW(tp.p1, tp.p2, &binCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(ctx.CallbackCount == 0);
+
+	// Invalid arguments and missing files.
+	WCHAR missing[MAX_LONG_PATH];
+	ConcatPath(baseDir, L"equal_missing.txt", missing);
+	ASSERT_TRUE(FC_FilesEqualW(tp.p1, missing, &cfg) == FC_ERROR_IO);
+	ASSERT_TRUE(FC_FilesEqualW(NULL, tp.p2, &cfg) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_FilesEqualW(tp.p1, tp.p2, NULL) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_BuffersEqual(NULL, 1, "a", 1, &cfg) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_BuffersEqual(NULL, 0, NULL, 0, &cfg) == FC_OK);
+
+	HeapFree(GetProcessHeap(), 0, d1);
+	HeapFree(GetProcessHeap(), 0, d2);
+	FreeTestPaths(&tp);
+}
+
+/**
+ * @brief Records the regions reported by FC_Merge3W.
+ */
+typedef struct {
+	int Count;                      /**< Regions reported. */
+	FC_MERGE_REGION Regions[16];    /**< The first 16 regions. */
+	size_t BaseLines;               /**< Line count of the base, from the context. */
+} MERGE_TEST_CONTEXT;
+
+static void
+MergeRegionCallback(
+	_In_ const FC_MERGE_CONTEXT* Context,
+	_In_ const FC_MERGE_REGION* Region)
+{
+	MERGE_TEST_CONTEXT* ctx = (MERGE_TEST_CONTEXT*)Context->UserData;
+	if (ctx->Count < 16)
+		ctx->Regions[ctx->Count] = *Region;
+	ctx->Count++;
+	ctx->BaseLines = Context->BaseLines->Count;
+}
+
+static BOOL MergeRegionIs(const MERGE_TEST_CONTEXT* ctx, int i, FC_MERGE_TYPE type,
+	size_t baseStart, size_t baseEnd, size_t localStart, size_t localEnd, size_t remoteStart, size_t remoteEnd)
+{
+	const FC_MERGE_REGION* r = &ctx->Regions[i];
+	return i < ctx->Count && r->Type == type &&
+		r->BaseStart == baseStart && r->BaseEnd == baseEnd &&
+		r->LocalStart == localStart && r->LocalEnd == localEnd &&
+		r->RemoteStart == remoteStart && r->RemoteEnd == remoteEnd;
+}
+
+/** Reads a whole file into a NUL-terminated process-heap buffer, or returns NULL. */
+static char* ReadTestFileAlloc(_In_z_ const WCHAR* path, _Out_ DWORD* size)
+{
+	*size = (DWORD)GetTestFileSize(path);
+	char* data = (char*)HeapAlloc(GetProcessHeap(), 0, *size + 1);
+	HANDLE h = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	DWORD got = 0;
+	BOOL ok = data && h != INVALID_HANDLE_VALUE && ReadFile(h, data, *size, &got, NULL) && got == *size;
+	if (h != INVALID_HANDLE_VALUE) CloseHandle(h);
+	if (!ok)
+	{
+		if (data) HeapFree(GetProcessHeap(), 0, data);
+		return NULL;
+	}
+	data[*size] = '\0';
+	return data;
+}
+
+static void Test_Merge3_ClassifiesRegionsAndWritesMerge(const WCHAR* baseDir)
+{
+	WCHAR base[MAX_LONG_PATH], local[MAX_LONG_PATH], remote[MAX_LONG_PATH], merged[MAX_LONG_PATH];
+	ConcatPath(baseDir, L"merge_base.txt", base);
+	ConcatPath(baseDir, L"merge_local.txt", local);
+	ConcatPath(baseDir, L"merge_remote.txt", remote);
+	ConcatPath(baseDir, L"merge_out.txt", merged);
+
+	// Local-only, remote-only, identical and conflicting edits, separated by unchanged lines.
+	WRITE_STR_FILE(base, "l1\nl2\nl3\nl4\nl5\nl6\nl7\nl8\nl9\n");
+	WRITE_STR_FILE(local, "l1\nL2\nl3\nl4\nl5\nF6\nl7\nX8\nl9\n");
+	WRITE_STR_FILE(remote, "l1\nl2\nl3\nR4\nl5\nF6\nl7\nY8\nl9\n");
+
+	MERGE_TEST_CONTEXT mctx = { 0 };
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	cfg.UserData = &mctx;
+	ASSERT_TRUE(FC_Merge3W(base, local, remote, &cfg, MergeRegionCallback, merged) == FC_DIFFERENT);
+	ASSERT_TRUE(mctx.Count == 9);
+	ASSERT_TRUE(mctx.BaseLines == 9);
+	ASSERT_TRUE(MergeRegionIs(&mctx, 0, FC_MERGE_UNCHANGED, 0, 1, 0, 1, 0, 1));
+	ASSERT_TRUE(MergeRegionIs(&mctx, 1, FC_MERGE_LOCAL, 1, 2, 1, 2, 1, 2));
+	ASSERT_TRUE(MergeRegionIs(&mctx, 3, FC_MERGE_REMOTE, 3, 4, 3, 4, 3, 4));
+	ASSERT_TRUE(MergeRegionIs(&mctx, 5, FC_MERGE_BOTH, 5, 6, 5, 6, 5, 6));
+	ASSERT_TRUE(MergeRegionIs(&mctx, 7, FC_MERGE_CONFLICT, 7, 8, 7, 8, 7, 8));
+	ASSERT_TRUE(MergeRegionIs(&mctx, 8, FC_MERGE_UNCHANGED, 8, 9, 8, 9, 8, 9));
+	ASSERT_TRUE(ctx.CallbackCount == 0);
+
+	DWORD size = 0;
+	char* text = ReadTestFileAlloc(merged, &size);
+	ASSERT_TRUE(text != NULL && strcmp(text,
+		"l1\nL2\nl3\nR4\nl5\nF6\nl7\n"
+		"<<<<<<< local\nX8\n||||||| base\nl8\n=======\nY8\n>>>>>>> remote\n"
+		"l9\n") == 0);
+	if (text) HeapFree(GetProcessHeap(), 0, text);
+
+	// Without the conflicting edit the versions merge cleanly; CRLF and the missing
+	// final newline of local are kept, and remote's appended line is separated.
+	WRITE_STR_FILE(base, "a\r\nb\r\nc\r\nd\r\n");
+	WRITE_STR_FILE(local, "a\r\nB\r\nc\r\nd");
+	WRITE_STR_FILE(remote, "a\r\nb\r\nc\r\nd\r\ne\r\n");
+	ZeroMemory(&mctx, sizeof(mctx));
+	ASSERT_TRUE(FC_Merge3W(base, local, remote, &cfg, MergeRegionCallback, merged) == FC_OK);
+	ASSERT_TRUE(mctx.Count == 4);
+	ASSERT_TRUE(MergeRegionIs(&mctx, 3, FC_MERGE_REMOTE, 4, 4, 4, 4, 4, 5));
+	text = ReadTestFileAlloc(merged, &size);
+	ASSERT_TRUE(text != NULL && strcmp(text, "a\r\nB\r\nc\r\nd\r\ne\r\n") == 0);
+	if (text) HeapFree(GetProcessHeap(), 0, text);
+
+	// Flags apply to the classification; unchanged lines keep the local spelling.
+	WRITE_STR_FILE(base, "x\ny\n");
+	WRITE_STR_FILE(local, "X\ny\n");
+	WRITE_STR_FILE(remote, "x\nY\n");
+	FC_CONFIG caseCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_IGNORE_CASE, &ctx);
+	caseCfg.UserData = &mctx;
+	ZeroMemory(&mctx, sizeof(mctx));
+	ASSERT_TRUE(FC_Merge3W(base, local, remote, &caseCfg, MergeRegionCallback, merged) == FC_OK);
+	ASSERT_TRUE(mctx.Count == 1 && mctx.Regions[0].Type == FC_MERGE_UNCHANGED);
+	text = ReadTestFileAlloc(merged, &size);
+	ASSERT_TRUE(text != NULL && strcmp(text, "X\ny\n") == 0);
+	if (text) HeapFree(GetProcessHeap(), 0, text);
+}
+
+static void Test_Merge3_LargeInputsAndInvalidParams(const WCHAR* baseDir)
+{
+	// Enough base lines for the two diffs to run in parallel.
+	const int lineCount = 25000;
+	const size_t cap = (size_t)lineCount * 16 + 64;
+	char* b = (char*)HeapAlloc(GetProcessHeap(), 0, cap);
+	char* l = (char*)HeapAlloc(GetProcessHeap(), 0, cap);
+	char* r = (char*)HeapAlloc(GetProcessHeap(), 0, cap);
+	char* expected = (char*)HeapAlloc(GetProcessHeap(), 0, cap);
+	if (!b || !l || !r || !expected) Throw(L"alloc failed", NULL);
+	size_t nb = 0, nl = 0, nr = 0, ne = 0;
+	for (int i = 0; i < lineCount; i++)
+	{
+		char line[32];
+		StringCchPrintfA(line, _countof(line), "line%05d\n", i);
+		size_t len = strlen(line);
+		const char* localLine = (i == 100) ? "local00100\n" : line;
+		const char* remoteLine = (i == 24000) ? "remote24000\n" : line;
+		const char* mergedLine = (i == 100) ? localLine : remoteLine;
+		memcpy(b + nb, line, len); nb += len;
+		memcpy(l + nl, localLine, strlen(localLine)); nl += strlen(localLine);
+		memcpy(r + nr, remoteLine, strlen(remoteLine)); nr += strlen(remoteLine);
+		memcpy(expected + ne, mergedLine, strlen(mergedLine)); ne += strlen(mergedLine);
+	}
+	nl--; // Local drops the final newline.
+	memcpy(r + nr, "tail\n", 5); nr += 5;
+	memcpy(expected + ne, "tail\n", 6); ne += 5;
+
+	WCHAR base[MAX_LONG_PATH], local[MAX_LONG_PATH], remote[MAX_LONG_PATH], merged[MAX_LONG_PATH];
+	ConcatPath(baseDir, L"merge_big_base.txt", base);
+	ConcatPath(baseDir, L"merge_big_local.txt", local);
+	ConcatPath(baseDir, L"merge_big_remote.txt", remote);
+	ConcatPath(baseDir, L"merge_big_out.txt", merged);
+	if (!WriteDataFile(base, b, (DWORD)nb)) Throw(L"write failed", base);
+	if (!WriteDataFile(local, l, (DWORD)nl)) Throw(L"write failed", local);
+	if (!WriteDataFile(remote, r, (DWORD)nr)) Throw(L"write failed", remote);
+
+	MERGE_TEST_CONTEXT mctx = { 0 };
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	cfg.UserData = &mctx;
+	ASSERT_TRUE(FC_Merge3W(base, local, remote, &cfg, MergeRegionCallback, merged) == FC_OK);
+	ASSERT_TRUE(mctx.Count == 6);
+	ASSERT_TRUE(MergeRegionIs(&mctx, 1, FC_MERGE_LOCAL, 100, 101, 100, 101, 100, 101));
+	ASSERT_TRUE(MergeRegionIs(&mctx, 3, FC_MERGE_REMOTE, 24000, 24001, 24000, 24001, 24000, 24001));
+	ASSERT_TRUE(MergeRegionIs(&mctx, 5, FC_MERGE_REMOTE, 25000, 25000, 25000, 25000, 25000, 25001));
+
+	DWORD size = 0;
+	char* text = ReadTestFileAlloc(merged, &size);
+	ASSERT_TRUE(text != NULL && size == ne && memcmp(text, expected, ne) == 0);
+	if (text) HeapFree(GetProcessHeap(), 0, text);
+
+	// The region callback and the output are both optional.
+	ASSERT_TRUE(FC_Merge3W(base, local, local, &cfg, NULL, NULL) == FC_OK);
+
+	WCHAR missing[MAX_LONG_PATH];
+	ConcatPath(baseDir, L"merge_missing.txt", missing);
+	ASSERT_TRUE(FC_Merge3W(base, missing, remote, &cfg, NULL, NULL) == FC_ERROR_IO);
+	ASSERT_TRUE(FC_Merge3W(NULL, local, remote, &cfg, NULL, NULL) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_Merge3W(base, local, remote, NULL, NULL, NULL) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_Merge3W(base, local, remote, &cfg, NULL, L"") == FC_ERROR_INVALID_PARAM);
+
+	HeapFree(GetProcessHeap(), 0, b);
+	HeapFree(GetProcessHeap(), 0, l);
+	HeapFree(GetProcessHeap(), 0, r);
+	HeapFree(GetProcessHeap(), 0, expected);
+}
+
+/** Returns TRUE if two line arrays hold the same normalized lines. */
+static BOOL LineArraysEqual(const _FC_BUFFER* a, const _FC_BUFFER* b)
+{
+	if (a->Count != b->Count) return FALSE;
+	for (size_t i = 0; i < a->Count; i++)
+	{
+		const _FC_LINE* la = (const _FC_LINE*)a->pData + i;
+		const _FC_LINE* lb = (const _FC_LINE*)b->pData + i;
+		if (la->Length != lb->Length || la->Hash != lb->Hash || memcmp(la->Text, lb->Text, la->Length) != 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/** Returns TRUE if blocks are ordered, cover both line arrays and leave only equal lines unmatched. */
+static BOOL BlocksFormEditScript(const FC_USER_CONTEXT* ctx, const FC_DIFF_BLOCK* blocks, size_t count)
+{
+	size_t a = 0, b = 0;
+	for (size_t k = 0; k <= count; k++)
+	{
+		size_t startA = k < count ? blocks[k].StartA : ctx->Lines1->Count;
+		size_t startB = k < count ? blocks[k].StartB : ctx->Lines2->Count;
+		if (startA < a || startB < b || startA - a != startB - b) return FALSE;
+		for (; a < startA; a++, b++)
+		{
+			const _FC_LINE* la = (const _FC_LINE*)ctx->Lines1->pData + a;
+			const _FC_LINE* lb = (const _FC_LINE*)ctx->Lines2->pData + b;
+			if (la->Hash != lb->Hash) return FALSE;
+		}
+		if (k < count)
+		{
+			if (blocks[k].EndA < startA || blocks[k].EndB < startB ||
+				(blocks[k].EndA == startA && blocks[k].EndB == startB))
+				return FALSE;
+			a = blocks[k].EndA;
+			b = blocks[k].EndB;
+		}
+	}
+	return a == ctx->Lines1->Count && b == ctx->Lines2->Count;
+}
+
+static void Test_DiffState_EditsMatchFreshComparison(const WCHAR* baseDir)
+{
+	static const char* const pieces[] = {
+		"alpha\n", "Beta\r\n", "gamma", "\n", "\r\n", "\n\n", "  \t ", "x", "ALPHA\n", "\xEF\xBB\xBF",
+	};
+	static const struct { FC_MODE Mode; UINT Flags; } variants[] = {
+		{ FC_MODE_TEXT_ASCII, 0 },
+		{ FC_MODE_TEXT_ASCII, FC_IGNORE_WS | FC_IGNORE_CASE },
+		{ FC_MODE_TEXT_UNICODE, 0 },
+		{ FC_MODE_AUTO, FC_IGNORE_WS },
+	};
+	BOOL allEqual = TRUE, allScripts = TRUE, allResults = TRUE;
+	unsigned int seed = 12345;
+
+	for (size_t v = 0; v < _countof(variants); v++)
+	{
+		char text[2][4096];
+		size_t length[2] = { 0, 0 };
+		for (int side = 0; side < 2; side++)
+		{
+			for (int i = 0; i < 40; i++)
+			{
+				seed = seed * 1103515245u + 12345u;
+				const char* piece = pieces[(seed >> 16) % _countof(pieces)];
+				memcpy(text[side] + length[side], piece, strlen(piece));
+				length[side] += strlen(piece);
+			}
+		}
+
+		DIFF_TEST_CONTEXT ctx = { 0 };
+		FC_CONFIG cfg = MakeTestConfig(variants[v].Mode, variants[v].Flags, &ctx);
+		cfg.ResyncLines = (UINT)v; // 0 to 3: exercises the context around the window.
+		FC_DIFF_STATE* state = NULL;
+		ASSERT_TRUE(FC_DiffStateCreate(text[0], length[0], text[1], length[1], &cfg, &state) == FC_OK);
+		if (state == NULL) continue;
+
+		for (int step = 0; step < 150; step++)
+		{
+			seed = seed * 1103515245u + 12345u;
+			int side = (seed >> 8) & 1;
+			size_t offset = (seed >> 12) % (length[side] + 1);
+			seed = seed * 1103515245u + 12345u;
+			size_t remove = (seed >> 16) % 8;
+			if (remove > length[side] - offset) remove = length[side] - offset;
+			const char* insert = pieces[(seed >> 20) % _countof(pieces)];
+			size_t insertLength = ((seed >> 24) & 3) == 0 ? 0 : strlen(insert);
+			if (length[side] - remove + insertLength >= sizeof(text[side])) insertLength = 0;
+
+			memmove(text[side] + offset + insertLength, text[side] + offset + remove, length[side] - offset - remove);
+			memcpy(text[side] + offset, insert, insertLength);
+			length[side] = length[side] - remove + insertLength;
+
+			FC_TEXT_EDIT edit = { offset, remove, insert, insertLength };
+			FC_RESULT result = FC_DiffStateEdit(state, side ? FC_TEXT_SECOND : FC_TEXT_FIRST, &edit, 1);
+
+			FC_DIFF_STATE* fresh = NULL;
+			if (FC_DiffStateCreate(text[0], length[0], text[1], length[1], &cfg, &fresh) != FC_OK) Throw(L"create failed", NULL);
+			const FC_USER_CONTEXT* got = FC_DiffStateGetContext(state);
+			const FC_USER_CONTEXT* want = FC_DiffStateGetContext(fresh);
+			if (!LineArraysEqual(got->Lines1, want->Lines1) || !LineArraysEqual(got->Lines2, want->Lines2))
+				allEqual = FALSE;
+
+			const FC_DIFF_BLOCK* blocks = NULL;
+			size_t blockCount = 0;
+			FC_RESULT current = FC_DiffStateGetBlocks(state, &blocks, &blockCount);
+			if (current != result || !BlocksFormEditScript(got, blocks, blockCount))
+				allScripts = FALSE;
+
+			FC_CONFIG compareCfg = cfg;
+			if (FC_CompareBuffersText(text[0], length[0], text[1], length[1], &compareCfg) != result)
+				allResults = FALSE;
+			FC_DiffStateClose(fresh);
+		}
+		FC_DiffStateClose(state);
+	}
+	ASSERT_TRUE(allEqual);
+	ASSERT_TRUE(allScripts);
+	ASSERT_TRUE(allResults);
+}
+
+static void Test_DiffState_EditCostAndInvalidParams(const WCHAR* baseDir)
+{
+	const int lineCount = 20000;
+	const size_t cap = (size_t)lineCount * 16;
+	char* text = (char*)HeapAlloc(GetProcessHeap(), 0, cap);
+	if (!text) Throw(L"alloc failed", NULL);
+	size_t length = 0;
+	for (int i = 0; i < lineCount; i++)
+	{
+		char line[32];
+		StringCchPrintfA(line, _countof(line), "line%05d\n", i);
+		memcpy(text + length, line, strlen(line));
+		length += strlen(line);
+	}
+
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	FC_DIFF_STATE* state = NULL;
+	ASSERT_TRUE(FC_DiffStateCreate(text, length, text, length, &cfg, &state) == FC_OK);
+	if (state == NULL) Throw(L"create failed", NULL);
+
+	// Changing one character of line 10000 re-parses and re-diffs a few lines only.
+	LONG callsBefore = g_TestAllocator.Calls;
+	FC_TEXT_EDIT edit = { 10000 * 10 + 4, 1, "X", 1 };
+	ASSERT_TRUE(FC_DiffStateEdit(state, FC_TEXT_SECOND, &edit, 1) == FC_DIFFERENT);
+	ASSERT_TRUE(g_TestAllocator.Calls - callsBefore < 64);
+
+	const FC_DIFF_BLOCK* blocks = NULL;
+	size_t blockCount = 0;
+	ASSERT_TRUE(FC_DiffStateGetBlocks(state, &blocks, &blockCount) == FC_DIFFERENT);
+	ASSERT_TRUE(blockCount == 1 && blocks[0].Type == FC_DIFF_TYPE_CHANGE &&
+		blocks[0].StartA == 10000 && blocks[0].EndA == 10001 &&
+		blocks[0].StartB == 10000 && blocks[0].EndB == 10001);
+
+	// Inserting a line on the other side shifts later blocks; undoing both edits restores equality.
+	FC_TEXT_EDIT insert = { 100 * 10, 0, "new\n", 4 };
+	ASSERT_TRUE(FC_DiffStateEdit(state, FC_TEXT_FIRST, &insert, 1) == FC_DIFFERENT);
+	ASSERT_TRUE(FC_DiffStateGetBlocks(state, &blocks, &blockCount) == FC_DIFFERENT);
+	ASSERT_TRUE(blockCount == 2 && blocks[0].Type == FC_DIFF_TYPE_DELETE &&
+		blocks[1].StartA == 10001 && blocks[1].StartB == 10000);
+	FC_TEXT_EDIT undo = { 10000 * 10 + 4, 1, "1", 1 };
+	ASSERT_TRUE(FC_DiffStateEdit(state, FC_TEXT_SECOND, &undo, 1) == FC_DIFFERENT);
+	FC_TEXT_EDIT undoInsert = { 100 * 10, 4, NULL, 0 };
+	ASSERT_TRUE(FC_DiffStateEdit(state, FC_TEXT_FIRST, &undoInsert, 1) == FC_OK);
+	ASSERT_TRUE(FC_DiffStateGetBlocks(state, &blocks, &blockCount) == FC_OK && blockCount == 0);
+
+	// Invalid edits leave the state usable.
+	FC_TEXT_EDIT outside = { length, 1, NULL, 0 };
+	ASSERT_TRUE(FC_DiffStateEdit(state, FC_TEXT_FIRST, &outside, 1) == FC_ERROR_INVALID_PARAM);
+	FC_TEXT_EDIT noText = { 0, 0, NULL, 1 };
+	ASSERT_TRUE(FC_DiffStateEdit(state, FC_TEXT_FIRST, &noText, 1) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_DiffStateEdit(state, (FC_TEXT_SIDE)2, &edit, 1) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_DiffStateEdit(state, FC_TEXT_FIRST, NULL, 0) == FC_OK);
+	ASSERT_TRUE(FC_DiffStateEdit(NULL, FC_TEXT_FIRST, &edit, 1) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_DiffStateGetBlocks(state, NULL, &blockCount) == FC_ERROR_INVALID_PARAM);
+	FC_DiffStateClose(state);
+	FC_DiffStateClose(NULL);
+
+	FC_DIFF_STATE* none = (FC_DIFF_STATE*)&cfg;
+	ASSERT_TRUE(FC_DiffStateCreate(NULL, 1, "a", 1, &cfg, &none) == FC_ERROR_INVALID_PARAM && none == NULL);
+	ASSERT_TRUE(FC_DiffStateCreate("a", 1, "a", 1, NULL, &none) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_DiffStateCreate("a", 1, "a", 1, &cfg, NULL) == FC_ERROR_INVALID_PARAM);
+
+	HeapFree(GetProcessHeap(), 0, text);
+}
+
+static void Test_Refine_SpansOfChangedLines(const WCHAR* baseDir)
+{
+	const char* text1 = "{\"name\": \"alpha\", \"count\": 10}\nsame\nabc\n";
+	const char* text2 = "{\"name\": \"alpHa\", \"count\": 12}\nsame\nabXc\nadded\n";
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	FC_DIFF_STATE* state = NULL;
+	ASSERT_TRUE(FC_DiffStateCreate(text1, strlen(text1), text2, strlen(text2), &cfg, &state) == FC_OK);
+	if (state == NULL) Throw(L"create failed", NULL);
+	const FC_USER_CONTEXT* context = FC_DiffStateGetContext(state);
+	const FC_DIFF_BLOCK* blocks = NULL;
+	size_t blockCount = 0;
+	ASSERT_TRUE(FC_DiffStateGetBlocks(state, &blocks, &blockCount) == FC_DIFFERENT);
+	ASSERT_TRUE(blockCount == 2 && blocks[0].Type == FC_DIFF_TYPE_CHANGE && blocks[1].Type == FC_DIFF_TYPE_CHANGE);
+
+	// Two separate byte changes in the first line, one span each.
+	FC_REFINED_BLOCK refined;
+	ASSERT_TRUE(FC_RefineBlock(context, &blocks[0], &cfg, &refined) == FC_OK);
+	ASSERT_TRUE(refined.SpanCount == 2 && refined.CoarsePairs == 0);
+	if (refined.SpanCount == 2)
+	{
+		ASSERT_TRUE(refined.Spans[0].LineA == 0 && refined.Spans[0].LineB == 0);
+		ASSERT_TRUE(refined.Spans[0].StartA == 13 && refined.Spans[0].EndA == 14);
+		ASSERT_TRUE(refined.Spans[0].StartB == 13 && refined.Spans[0].EndB == 14);
+		ASSERT_TRUE(refined.Spans[1].StartA == 28 && refined.Spans[1].EndA == 29);
+		ASSERT_TRUE(refined.Spans[1].StartB == 28 && refined.Spans[1].EndB == 29);
+	}
+	FC_RefinedBlockFree(&refined);
+
+	// Ignoring case leaves only the digit.
+	FC_CONFIG foldCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_IGNORE_CASE, &ctx);
+	ASSERT_TRUE(FC_RefineBlock(context, &blocks[0], &foldCfg, &refined) == FC_OK);
+	ASSERT_TRUE(refined.SpanCount == 1 && refined.Spans[0].StartA == 28);
+	FC_RefinedBlockFree(&refined);
+
+	// The second block pairs "abc" with "abXc"; the added line has no partner.
+	ASSERT_TRUE(FC_RefineBlock(context, &blocks[1], &cfg, &refined) == FC_OK);
+	ASSERT_TRUE(refined.SpanCount == 1);
+	if (refined.SpanCount == 1)
+	{
+		ASSERT_TRUE(refined.Spans[0].LineA == 2 && refined.Spans[0].LineB == 2);
+		ASSERT_TRUE(refined.Spans[0].StartA == 2 && refined.Spans[0].EndA == 2);
+		ASSERT_TRUE(refined.Spans[0].StartB == 2 && refined.Spans[0].EndB == 3);
+	}
+	FC_RefinedBlockFree(&refined);
+
+	// Added and deleted blocks have nothing to pair.
+	FC_DIFF_BLOCK added = { FC_DIFF_TYPE_ADD, 3, 3, 3, 4 };
+	ASSERT_TRUE(FC_RefineBlock(context, &added, &cfg, &refined) == FC_OK && refined.SpanCount == 0);
+	FC_RefinedBlockFree(&refined);
+	FC_DiffStateClose(state);
+
+	// Spans never split a UTF-8 sequence: U+00E9 and U+00E8 share their lead byte.
+	const char* utf1 = "caf\xC3\xA9\n";
+	const char* utf2 = "caf\xC3\xA8\n";
+	FC_CONFIG utfCfg = MakeTestConfig(FC_MODE_TEXT_UNICODE, 0, &ctx);
+	ASSERT_TRUE(FC_DiffStateCreate(utf1, strlen(utf1), utf2, strlen(utf2), &utfCfg, &state) == FC_OK);
+	if (state == NULL) Throw(L"create failed", NULL);
+	ASSERT_TRUE(FC_DiffStateGetBlocks(state, &blocks, &blockCount) == FC_DIFFERENT && blockCount == 1);
+	ASSERT_TRUE(FC_RefineBlock(FC_DiffStateGetContext(state), &blocks[0], &utfCfg, &refined) == FC_OK);
+	ASSERT_TRUE(refined.SpanCount == 1 && refined.Spans[0].StartA == 3 && refined.Spans[0].EndA == 5);
+	FC_RefinedBlockFree(&refined);
+	FC_DiffStateClose(state);
+}
+
+static void Test_Refine_BudgetAndInvalidParams(const WCHAR* baseDir)
+{
+	// Every other byte differs, so the edit distance is far beyond the per-line budget.
+	const size_t lineLength = 1 << 16;
+	char* text1 = (char*)HeapAlloc(GetProcessHeap(), 0, lineLength + 1);
+	char* text2 = (char*)HeapAlloc(GetProcessHeap(), 0, lineLength + 1);
+	if (!text1 || !text2) Throw(L"alloc failed", NULL);
+	for (size_t i = 0; i < lineLength; i++)
+	{
+		text1[i] = (char)('a' + (i % 7));
+		text2[i] = (i % 2) ? (char)('A' + (i % 5)) : text1[i];
+	}
+	text2[0] = 'x';
+	text1[lineLength] = '\n';
+	text2[lineLength] = '\n';
+
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	FC_DIFF_STATE* state = NULL;
+	ASSERT_TRUE(FC_DiffStateCreate(text1, lineLength + 1, text2, lineLength + 1, &cfg, &state) == FC_OK);
+	if (state == NULL) Throw(L"create failed", NULL);
+	const FC_USER_CONTEXT* context = FC_DiffStateGetContext(state);
+	const FC_DIFF_BLOCK* blocks = NULL;
+	size_t blockCount = 0;
+	ASSERT_TRUE(FC_DiffStateGetBlocks(state, &blocks, &blockCount) == FC_DIFFERENT && blockCount == 1);
+
+	FC_REFINED_BLOCK refined;
+	ASSERT_TRUE(FC_RefineBlock(context, &blocks[0], &cfg, &refined) == FC_OK);
+	ASSERT_TRUE(refined.CoarsePairs == 1 && refined.SpanCount == 1);
+	if (refined.SpanCount == 1)
+	{
+		ASSERT_TRUE(refined.Spans[0].StartA == 0 && refined.Spans[0].EndA == lineLength);
+		ASSERT_TRUE(refined.Spans[0].StartB == 0 && refined.Spans[0].EndB == lineLength);
+	}
+	FC_RefinedBlockFree(&refined);
+
+	// Blocks outside the context's line buffers and missing arguments are rejected.
+	FC_DIFF_BLOCK outside = { FC_DIFF_TYPE_CHANGE, 0, 2, 0, 1 };
+	ASSERT_TRUE(FC_RefineBlock(context, &outside, &cfg, &refined) == FC_ERROR_INVALID_PARAM && refined.SpanCount == 0);
+	FC_RefinedBlockFree(&refined);
+	FC_USER_CONTEXT binary = { NULL, NULL, NULL, NULL, NULL, 0, 0 };
+	ASSERT_TRUE(FC_RefineBlock(&binary, &blocks[0], &cfg, &refined) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_RefineBlock(NULL, &blocks[0], &cfg, &refined) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_RefineBlock(context, NULL, &cfg, &refined) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_RefineBlock(context, &blocks[0], NULL, &refined) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_RefineBlock(context, &blocks[0], &cfg, NULL) == FC_ERROR_INVALID_PARAM);
+	FC_RefinedBlockFree(NULL);
+	FC_DiffStateClose(state);
+
+	HeapFree(GetProcessHeap(), 0, text1);
+	HeapFree(GetProcessHeap(), 0, text2);
+}
+
+/** Builds the text of the reference used by the FC_Reference* tests; the caller frees it. */
+static char* MakeReferenceText(int lineCount, size_t* length)
+{
+	char* text = (char*)HeapAlloc(GetProcessHeap(), 0, (size_t)lineCount * 16);
+	if (!text) Throw(L"alloc failed", NULL);
+	*length = 0;
+	for (int i = 0; i < lineCount; i++)
+	{
+		// Blank lines and braces repeat throughout, like the lines of real output.
+		char line[32];
+		if (i % 50 == 0) StringCchPrintfA(line, _countof(line), "\n");
+		else if (i % 50 == 25) StringCchPrintfA(line, _countof(line), "}\n");
+		else StringCchPrintfA(line, _countof(line), "row%05d\n", i);
+		memcpy(text + *length, line, strlen(line));
+		*length += strlen(line);
+	}
+	return text;
+}
+
+static void Test_Reference_MatchesPairwiseComparison(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"reference.txt", tp.p1);
+	ConcatPath(baseDir, L"reference_candidate.txt", tp.p2);
+	size_t refLength = 0;
+	char* refText = MakeReferenceText(30000, &refLength);
+	if (!WriteDataFile(tp.p1, refText, (DWORD)refLength)) Throw(L"write failed", tp.p1);
+
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	FC_REFERENCE* reference = NULL;
+	ASSERT_TRUE(FC_ReferenceOpenW(tp.p1, &cfg, &reference) == FC_OK);
+	if (reference == NULL) Throw(L"open failed", tp.p1);
+
+	// Candidates: identical, one changed line, a deletion spanning a blank line,
+	// an insertion near the end, and a truncation.
+	char* candidate = (char*)HeapAlloc(GetProcessHeap(), 0, refLength + 64);
+	if (!candidate) Throw(L"alloc failed", NULL);
+	BOOL allSame = TRUE;
+	for (int variant = 0; variant < 5; variant++)
+	{
+		size_t length = refLength;
+		memcpy(candidate, refText, refLength);
+		const size_t lineStart10 = 9 * 9 + 1; // Line 10 of "\n" + 9 "rowNNNNN\n" lines.
+		if (variant == 1)
+			memcpy(candidate + lineStart10, "ROW", 3);
+		else if (variant == 2)
+		{
+			const char* cut = strstr(candidate, "row14998\n");
+			size_t at = (size_t)(cut - candidate) + 18;
+			memmove(candidate + at, candidate + at + 6 * 9, length - at - 6 * 9);
+			length -= 6 * 9;
+		}
+		else if (variant == 3)
+		{
+			const char* at = strstr(candidate, "row29990\n");
+			size_t offset = (size_t)(at - candidate);
+			memmove(candidate + offset + 6, candidate + offset, length - offset);
+			memcpy(candidate + offset, "added\n", 6);
+			length += 6;
+		}
+		else if (variant == 4)
+			length = refLength / 2;
+
+		DIFF_TEST_CONTEXT pairCtx = { 0 };
+		DIFF_TEST_CONTEXT refCtx = { 0 };
+		FC_CONFIG pairCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &pairCtx);
+		FC_CONFIG refCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &refCtx);
+		FC_RESULT expected = FC_CompareBuffersText(refText, refLength, candidate, length, &pairCfg);
+		FC_RESULT got = FC_ReferenceCompareBuffer(reference, candidate, length, &refCfg);
+		if (got != expected || (variant == 0) != (got == FC_OK) ||
+			refCtx.CallbackCount != pairCtx.CallbackCount ||
+			memcmp(refCtx.Blocks, pairCtx.Blocks, sizeof(refCtx.Blocks)) != 0)
+			allSame = FALSE;
+
+		// The same candidate read from a file.
+		if (variant == 1)
+		{
+			if (!WriteDataFile(tp.p2, candidate, (DWORD)length)) Throw(L"write failed", tp.p2);
+			DIFF_TEST_CONTEXT fileCtx = { 0 };
+			FC_CONFIG fileCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &fileCtx);
+			ASSERT_TRUE(FC_ReferenceCompareFileW(reference, tp.p2, &fileCfg) == FC_DIFFERENT);
+			ASSERT_TRUE(fileCtx.CallbackCount == 1 && fileCtx.Blocks[0].Type == FC_DIFF_TYPE_CHANGE &&
+				fileCtx.Blocks[0].StartA == 10 && fileCtx.Blocks[0].EndA == 11);
+		}
+	}
+	ASSERT_TRUE(allSame);
+	FC_ReferenceClose(reference);
+
+	// Line flags are fixed when the reference is opened.
+	FC_CONFIG foldCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_IGNORE_CASE, &ctx);
+	ASSERT_TRUE(FC_ReferenceOpenW(tp.p1, &foldCfg, &reference) == FC_OK);
+	if (reference == NULL) Throw(L"open failed", tp.p1);
+	memcpy(candidate, refText, refLength);
+	memcpy(candidate + 1, "ROW", 3);
+	ASSERT_TRUE(FC_ReferenceCompareBuffer(reference, candidate, refLength, &foldCfg) == FC_OK);
+	ASSERT_TRUE(FC_ReferenceCompareBuffer(reference, candidate, refLength, &cfg) == FC_ERROR_INVALID_PARAM);
+	FC_ReferenceClose(reference);
+
+	HeapFree(GetProcessHeap(), 0, candidate);
+	HeapFree(GetProcessHeap(), 0, refText);
+	FreeTestPaths(&tp);
+}
+
+typedef struct {
+	const FC_REFERENCE* Reference;
+	const char* Text;
+	size_t Length;
+	int Rounds;
+	FC_RESULT Result;
+	int Blocks;
+	BOOL Consistent;
+} REFERENCE_WORKER;
+
+static DWORD WINAPI ReferenceWorker(LPVOID Parameter)
+{
+	REFERENCE_WORKER* worker = (REFERENCE_WORKER*)Parameter;
+	worker->Consistent = TRUE;
+	for (int round = 0; round < worker->Rounds; round++)
+	{
+		DIFF_TEST_CONTEXT ctx = { 0 };
+		FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+		FC_RESULT result = FC_ReferenceCompareBuffer(worker->Reference, worker->Text, worker->Length, &cfg);
+		if (round > 0 && (result != worker->Result || ctx.CallbackCount != worker->Blocks))
+			worker->Consistent = FALSE;
+		worker->Result = result;
+		worker->Blocks = ctx.CallbackCount;
+	}
+	return 0;
+}
+
+static void Test_Reference_RepeatedLinesMatchPairwise(const WCHAR* baseDir)
+{
+	// With repeated and swapped lines several alignments share the LCS length; the
+	// reference must settle on the same one as a pairwise comparison.
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"reference_repeat.txt", tp.p1);
+	static const char* const words[] = { "a\n", "b\n", "c\n", "}\n" };
+	char refText[512];
+	char candidate[512];
+	unsigned int seed = 12345;
+	BOOL allSame = TRUE;
+	for (int round = 0; round < 200; round++)
+	{
+		size_t refLength = 0, length = 0;
+		if (round == 0)
+		{
+			memcpy(refText, "a\nb\nc\nd\ne\n", refLength = 10);
+			memcpy(candidate, "a\nc\nb\nd\ne\n", length = 10);
+		}
+		else
+		{
+			int lines = 8 + (int)(seed % 24);
+			for (int i = 0; i < lines; i++)
+			{
+				seed = seed * 1103515245u + 12345u;
+				const char* word = words[(seed >> 16) % 4];
+				memcpy(refText + refLength, word, strlen(word));
+				refLength += strlen(word);
+				// The candidate drops, changes or keeps each line.
+				unsigned int edit = (seed >> 20) % 8;
+				if (edit == 0)
+					continue;
+				if (edit == 1)
+					word = words[(seed >> 24) % 4];
+				memcpy(candidate + length, word, strlen(word));
+				length += strlen(word);
+			}
+		}
+		if (!WriteDataFile(tp.p1, refText, (DWORD)refLength)) Throw(L"write failed", tp.p1);
+
+		DIFF_TEST_CONTEXT pairCtx = { 0 };
+		DIFF_TEST_CONTEXT refCtx = { 0 };
+		FC_CONFIG pairCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &pairCtx);
+		FC_CONFIG refCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &refCtx);
+		pairCfg.ResyncLines = 1;
+		refCfg.ResyncLines = 1;
+		FC_REFERENCE* reference = NULL;
+		ASSERT_TRUE(FC_ReferenceOpenW(tp.p1, &refCfg, &reference) == FC_OK);
+		if (reference == NULL) Throw(L"open failed", tp.p1);
+		FC_RESULT expected = FC_CompareBuffersText(refText, refLength, candidate, length, &pairCfg);
+		FC_RESULT got = FC_ReferenceCompareBuffer(reference, candidate, length, &refCfg);
+		FC_ReferenceClose(reference);
+		if (got != expected || refCtx.CallbackCount != pairCtx.CallbackCount ||
+			memcmp(refCtx.Blocks, pairCtx.Blocks, sizeof(refCtx.Blocks)) != 0)
+			allSame = FALSE;
+		if (round == 0)
+		{
+			ASSERT_TRUE(pairCtx.CallbackCount == 2 && pairCtx.Blocks[0].Type == FC_DIFF_TYPE_DELETE);
+		}
+	}
+	ASSERT_TRUE(allSame);
+	FreeTestPaths(&tp);
+}
+
+static void Test_Reference_ConcurrentComparesAndInvalidParams(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"reference_mt.txt", tp.p1);
+	size_t refLength = 0;
+	char* refText = MakeReferenceText(20000, &refLength);
+	if (!WriteDataFile(tp.p1, refText, (DWORD)refLength)) Throw(L"write failed", tp.p1);
+
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	FC_REFERENCE* reference = NULL;
+	ASSERT_TRUE(FC_ReferenceOpenW(tp.p1, &cfg, &reference) == FC_OK);
+	if (reference == NULL) Throw(L"open failed", tp.p1);
+
+	// Each worker compares its own candidate: the reference itself, or a prefix of it.
+	REFERENCE_WORKER workers[4];
+	HANDLE threads[4];
+	for (int i = 0; i < 4; i++)
+	{
+		REFERENCE_WORKER worker = { reference, refText, refLength - (size_t)i * 9000, 8, FC_OK, 0, FALSE };
+		workers[i] = worker;
+		threads[i] = CreateThread(NULL, 0, ReferenceWorker, &workers[i], 0, NULL);
+		if (threads[i] == NULL) Throw(L"CreateThread failed", NULL);
+	}
+	WaitForMultipleObjects(4, threads, TRUE, INFINITE);
+	for (int i = 0; i < 4; i++)
+	{
+		CloseHandle(threads[i]);
+		DIFF_TEST_CONTEXT pairCtx = { 0 };
+		FC_CONFIG pairCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &pairCtx);
+		FC_RESULT expected = FC_CompareBuffersText(refText, refLength, workers[i].Text, workers[i].Length, &pairCfg);
+		ASSERT_TRUE(workers[i].Consistent);
+		ASSERT_TRUE(workers[i].Result == expected && expected == (i == 0 ? FC_OK : FC_DIFFERENT));
+		ASSERT_TRUE(workers[i].Blocks == pairCtx.CallbackCount);
+	}
+
+	// Comparisons must use the reference's mode and line flags, and a callback.
+	FC_CONFIG otherMode = MakeTestConfig(FC_MODE_TEXT_UNICODE, 0, &ctx);
+	FC_CONFIG otherFlags = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_IGNORE_WS, &ctx);
+	FC_CONFIG displayFlags = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_SHOW_LINE_NUMS, &ctx);
+	FC_CONFIG noCallback = cfg;
+	noCallback.DiffCallback = NULL;
+	ASSERT_TRUE(FC_ReferenceCompareBuffer(reference, refText, refLength, &otherMode) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_ReferenceCompareBuffer(reference, refText, refLength, &otherFlags) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_ReferenceCompareBuffer(reference, refText, refLength, &displayFlags) == FC_OK);
+	ASSERT_TRUE(FC_ReferenceCompareBuffer(reference, refText, refLength, &noCallback) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_ReferenceCompareBuffer(reference, NULL, 1, &cfg) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_ReferenceCompareBuffer(reference, NULL, 0, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(FC_ReferenceCompareBuffer(NULL, refText, refLength, &cfg) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_ReferenceCompareFileW(reference, NULL, &cfg) == FC_ERROR_INVALID_PARAM);
+	FC_ReferenceClose(reference);
+	FC_ReferenceClose(NULL);
+
+	// Only text modes can be prepared.
+	FC_REFERENCE* none = (FC_REFERENCE*)&cfg;
+	FC_CONFIG autoCfg = MakeTestConfig(FC_MODE_AUTO, 0, &ctx);
+	FC_CONFIG binaryCfg = MakeTestConfig(FC_MODE_BINARY, 0, &ctx);
+	ASSERT_TRUE(FC_ReferenceOpenW(tp.p1, &autoCfg, &none) == FC_ERROR_INVALID_PARAM && none == NULL);
+	ASSERT_TRUE(FC_ReferenceOpenW(tp.p1, &binaryCfg, &none) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_ReferenceOpenW(NULL, &cfg, &none) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_ReferenceOpenW(tp.p1, NULL, &none) == FC_ERROR_INVALID_PARAM);
+	ASSERT_TRUE(FC_ReferenceOpenW(tp.p1, &cfg, NULL) == FC_ERROR_INVALID_PARAM);
+
+	HeapFree(GetProcessHeap(), 0, refText);
+	FreeTestPaths(&tp);
+}
+
+static void Test_Stats_TextCountersAccumulate(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"stats1.txt", tp.p1);
+	ConcatPath(baseDir, L"stats2.txt", tp.p2);
+	WRITE_STR_FILE(tp.p1, "a\nb\nc\nd\n");
+	WRITE_STR_FILE(tp.p2, "a\nX\nc\nd\n");
+
+	FC_STATS stats = { 0 };
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	cfg.Stats = &stats;
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(ctx.CallbackCount == 1);
+	ASSERT_TRUE(stats.BytesRead == 16 && stats.LinesParsed == 8);
+	ASSERT_TRUE(stats.ChunksProcessed == 1 && stats.Rewinds == 0);
+	ASSERT_TRUE(stats.MatchesProbed == 3 && stats.HashCollisions == 0);
+	ASSERT_TRUE(stats.PeakMemoryBytes >= 16);
+	ASSERT_TRUE(stats.ReadNanoseconds > 0 && stats.ParseNanoseconds + stats.HashNanoseconds + stats.LcsNanoseconds > 0);
+	ASSERT_TRUE(stats.BinaryCompareNanoseconds == 0);
+
+	// A second comparison adds to the totals; buffers are not counted as read.
+	ASSERT_TRUE(FC_CompareBuffersText("a\nb\n", 4, "a\nb\n", 4, &cfg) == FC_OK);
+	ASSERT_TRUE(stats.BytesRead == 16 && stats.LinesParsed == 12 && stats.ChunksProcessed == 2);
+
+	// A difference straddling the first chunk boundary rewinds to its last anchor.
+	const int lineCount = 3000;
+	char* text1 = (char*)HeapAlloc(GetProcessHeap(), 0, (size_t)lineCount * 16);
+	char* text2 = (char*)HeapAlloc(GetProcessHeap(), 0, (size_t)lineCount * 16);
+	if (!text1 || !text2) Throw(L"alloc failed", NULL);
+	size_t length1 = 0, length2 = 0;
+	for (int i = 0; i < lineCount; i++)
+	{
+		char line[32];
+		StringCchPrintfA(line, _countof(line), "line%05d\n", i);
+		memcpy(text1 + length1, line, strlen(line));
+		length1 += strlen(line);
+		if (i < 995 || i > 1005)
+		{
+			memcpy(text2 + length2, line, strlen(line));
+			length2 += strlen(line);
+		}
+	}
+	FC_STATS chunkStats = { 0 };
+	DIFF_TEST_CONTEXT chunkCtx = { 0 };
+	FC_CONFIG chunkCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &chunkCtx);
+	chunkCfg.Stats = &chunkStats;
+	ASSERT_TRUE(FC_CompareBuffersText(text1, length1, text2, length2, &chunkCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(chunkStats.LinesParsed == (ULONGLONG)(2 * lineCount - 11));
+	ASSERT_TRUE(chunkStats.ChunksProcessed >= 3 && chunkStats.Rewinds >= 1);
+	ASSERT_TRUE(chunkStats.MatchesProbed > 0 && chunkStats.HashCollisions == 0);
+	HeapFree(GetProcessHeap(), 0, text1);
+	HeapFree(GetProcessHeap(), 0, text2);
+	FreeTestPaths(&tp);
+}
+
+static void Test_Stats_BinaryPaths(const WCHAR* baseDir)
+{
+	const size_t size = 3 * 1024 * 1024 + 17;
+	unsigned char* d1 = (unsigned char*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size);
+	unsigned char* d2 = (unsigned char*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size);
+	if (!d1 || !d2) Throw(L"alloc failed", NULL);
+	d2[size - 1] = 1;
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"stats1.bin", tp.p1);
+	ConcatPath(baseDir, L"stats2.bin", tp.p2);
+	if (!WriteDataFile(tp.p1, d1, (DWORD)size)) Throw(L"write bin failed", tp.p1);
+	if (!WriteDataFile(tp.p2, d2, (DWORD)size)) Throw(L"write bin failed", tp.p2);
+
+	// Mapped files count the compared bytes of both inputs.
+	FC_STATS stats = { 0 };
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_BINARY, 0, &ctx);
+	cfg.Stats = &stats;
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(stats.BytesRead == 2 * (ULONGLONG)size);
+	ASSERT_TRUE(stats.BinaryCompareNanoseconds > 0 && stats.LinesParsed == 0 && stats.ChunksProcessed == 0);
+
+	// Streamed files also count their two read buffers toward the peak.
+	FC_STATS streamStats = { 0 };
+	cfg.Stats = &streamStats;
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_BINARY_STREAM_THRESHOLD_OVERRIDE", L"1"));
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_BINARY_STREAM_THRESHOLD_OVERRIDE", NULL));
+	ASSERT_TRUE(streamStats.BytesRead == 2 * (ULONGLONG)size);
+	ASSERT_TRUE(streamStats.ReadNanoseconds > 0 && streamStats.BinaryCompareNanoseconds > 0);
+	ASSERT_TRUE(streamStats.PeakMemoryBytes >= 2 * 1024 * 1024);
+
+	HeapFree(GetProcessHeap(), 0, d1);
+	HeapFree(GetProcessHeap(), 0, d2);
+	FreeTestPaths(&tp);
+}
+
+static void Test_Stats_MatchListDiagnostics(const WCHAR* baseDir)
+{
+	// 200 lines alternating between a repeated "}" and unique lines, one unique line changed.
+	char text1[4096], text2[4096];
+	size_t length1 = 0, length2 = 0;
+	for (int i = 0; i < 200; i++)
+	{
+		char line[32];
+		if (i % 2)
+			StringCchCopyA(line, _countof(line), "}\n");
+		else
+			StringCchPrintfA(line, _countof(line), "item%03d\n", i);
+		memcpy(text1 + length1, line, strlen(line));
+		length1 += strlen(line);
+		if (i == 100)
+			StringCchCopyA(line, _countof(line), "changed\n");
+		memcpy(text2 + length2, line, strlen(line));
+		length2 += strlen(line);
+	}
+
+	FC_STATS stats = { 0 };
+	DIFF_TEST_CONTEXT ctx = { 0 };
+	FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+	cfg.Stats = &stats;
+	ASSERT_TRUE(FC_CompareBuffersText(text1, length1, text2, length2, &cfg) == FC_DIFFERENT);
+
+	// Each "}" of A probes all 100 in B; the 99 unchanged unique lines probe one each.
+	ASSERT_TRUE(stats.MaxMatchListLength == 100);
+	ASSERT_TRUE(stats.MatchListLookups == 199);
+	ASSERT_TRUE(stats.MatchesProbed == 100 * 100 + 99);
+	ASSERT_TRUE(stats.PeakLcsLinks > 0);
+	ASSERT_TRUE(stats.TopLines[0].MatchListLength == 100 && strcmp(stats.TopLines[0].Text, "}") == 0);
+	ASSERT_TRUE(stats.TopLines[1].MatchListLength == 1 && strcmp(stats.TopLines[1].Text, "}") != 0);
+
+	// A second comparison adds to the counters but keeps one entry per line.
+	ASSERT_TRUE(FC_CompareBuffersText(text1, length1, text2, length2, &cfg) == FC_DIFFERENT);
+	ASSERT_TRUE(stats.MatchListLookups == 2 * 199 && stats.MaxMatchListLength == 100);
+	ASSERT_TRUE(stats.TopLines[0].MatchListLength == 100 && stats.TopLines[1].MatchListLength == 1);
+	for (int i = 1; i < FC_STATS_TOP_LINES; i++)
+		ASSERT_TRUE(stats.TopLines[i].Hash != stats.TopLines[0].Hash);
+
+	// With /LB10 each "}" visits only the at most 11 in its window, with the same result.
+	FC_STATS windowStats = { 0 };
+	DIFF_TEST_CONTEXT windowCtx = { 0 };
+	FC_CONFIG windowCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &windowCtx);
+	windowCfg.Stats = &windowStats;
+	windowCfg.BufferLines = 10;
+	ASSERT_TRUE(FC_CompareBuffersText(text1, length1, text2, length2, &windowCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(windowCtx.CallbackCount == 1 && windowCtx.Blocks[0].Type == FC_DIFF_TYPE_CHANGE);
+	ASSERT_TRUE(windowStats.MatchesProbed > 99 && windowStats.MatchesProbed <= 100 * 11 + 99);
+
+	// A prepared reference searches its index over the same window.
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"stats_window.txt", tp.p1);
+	if (!WriteDataFile(tp.p1, text1, (DWORD)length1)) Throw(L"write failed", tp.p1);
+	FC_REFERENCE* reference = NULL;
+	ASSERT_TRUE(FC_ReferenceOpenW(tp.p1, &windowCfg, &reference) == FC_OK);
+	if (reference == NULL) Throw(L"open failed", tp.p1);
+	FC_STATS refStats = { 0 };
+	DIFF_TEST_CONTEXT refCtx = { 0 };
+	FC_CONFIG refCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &refCtx);
+	refCfg.Stats = &refStats;
+	refCfg.BufferLines = 10;
+	ASSERT_TRUE(FC_ReferenceCompareBuffer(reference, text2, length2, &refCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(refCtx.CallbackCount == windowCtx.CallbackCount &&
+		memcmp(refCtx.Blocks, windowCtx.Blocks, sizeof(refCtx.Blocks)) == 0);
+	ASSERT_TRUE(refStats.MatchesProbed > 99 && refStats.MatchesProbed <= 100 * 11 + 99);
+	FC_ReferenceClose(reference);
+	FreeTestPaths(&tp);
+}
+
+static void Test_Budget_TextStaysWithinBudget(const WCHAR* baseDir)
+{
+	// 20000 numbered lines with every 4000th changed: whole line tables of both sides
+	// take far more memory than the windows of a streamed comparison.
+	const int lineCount = 20000;
+	char* text1 = (char*)HeapAlloc(GetProcessHeap(), 0, (size_t)lineCount * 16);
+	char* text2 = (char*)HeapAlloc(GetProcessHeap(), 0, (size_t)lineCount * 16);
+	if (!text1 || !text2) Throw(L"alloc failed", NULL);
+	size_t length1 = 0, length2 = 0;
+	for (int i = 0; i < lineCount; i++)
+	{
+		char line[32];
+		StringCchPrintfA(line, _countof(line), "line%05d\n", i);
+		memcpy(text1 + length1, line, strlen(line));
+		length1 += strlen(line);
+		if (i % 4000 == 7)
+			StringCchPrintfA(line, _countof(line), "edit%05d\n", i);
+		memcpy(text2 + length2, line, strlen(line));
+		length2 += strlen(line);
+	}
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"budget1.txt", tp.p1);
+	ConcatPath(baseDir, L"budget2.txt", tp.p2);
+	if (!WriteDataFile(tp.p1, text1, (DWORD)length1)) Throw(L"write failed", tp.p1);
+	if (!WriteDataFile(tp.p2, text2, (DWORD)length2)) Throw(L"write failed", tp.p2);
+
+	FC_STATS fullStats = { 0 };
+	DIFF_TEST_CONTEXT fullCtx = { 0 };
+	FC_CONFIG fullCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &fullCtx);
+	fullCfg.Stats = &fullStats;
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &fullCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(fullCtx.CallbackCount == 5 && fullStats.BudgetFallbacks == 0);
+	ASSERT_TRUE(fullStats.PeakMemoryBytes > 2 * (ULONGLONG)length1);
+
+	// A quarter of that forces the streamed strategy; the differences are the same.
+	for (int pass = 0; pass < 2; pass++)
+	{
+		FC_STATS stats = { 0 };
+		DIFF_TEST_CONTEXT ctx = { 0 };
+		FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &ctx);
+		cfg.Stats = &stats;
+		cfg.MaxMemoryBytes = (size_t)(fullStats.PeakMemoryBytes / 4);
+		FC_RESULT result = (pass == 0)
+			? FC_CompareFilesW(tp.p1, tp.p2, &cfg)
+			: FC_CompareBuffersText(text1, length1, text2, length2, &cfg);
+		ASSERT_TRUE(result == FC_DIFFERENT);
+		ASSERT_TRUE(stats.BudgetFallbacks >= 1);
+		ASSERT_TRUE(stats.PeakMemoryBytes > 0 && stats.PeakMemoryBytes <= cfg.MaxMemoryBytes);
+		ASSERT_TRUE(ctx.CallbackCount == fullCtx.CallbackCount);
+		for (int b = 0; b < fullCtx.CallbackCount; b++)
+			ASSERT_TRUE(memcmp(&ctx.Blocks[b], &fullCtx.Blocks[b], sizeof(FC_DIFF_BLOCK)) == 0);
+	}
+
+	// A tighter budget also shrinks the chunks, which still find the differences.
+	FC_STATS smallStats = { 0 };
+	DIFF_TEST_CONTEXT smallCtx = { 0 };
+	FC_CONFIG smallCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &smallCtx);
+	smallCfg.Stats = &smallStats;
+	smallCfg.MaxMemoryBytes = 96 * 1024;
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &smallCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(smallStats.BudgetFallbacks >= 2 && smallStats.PeakMemoryBytes <= smallCfg.MaxMemoryBytes);
+	ASSERT_TRUE(smallCtx.CallbackCount >= fullCtx.CallbackCount);
+
+	// A budget too small for any strategy fails cleanly without exceeding it.
+	FC_STATS tinyStats = { 0 };
+	DIFF_TEST_CONTEXT tinyCtx = { 0 };
+	FC_CONFIG tinyCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &tinyCtx);
+	tinyCfg.Stats = &tinyStats;
+	tinyCfg.MaxMemoryBytes = 8 * 1024;
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &tinyCfg) == FC_ERROR_MEMORY);
+	ASSERT_TRUE(tinyStats.PeakMemoryBytes <= tinyCfg.MaxMemoryBytes && tinyCtx.CallbackCount == 0);
+
+	HeapFree(GetProcessHeap(), 0, text1);
+	HeapFree(GetProcessHeap(), 0, text2);
+	FreeTestPaths(&tp);
+}
+
+static void Test_LargePages_SameResultsAsHeap(const WCHAR* baseDir)
+{
+	// 300000 numbered lines: read buffers and line arrays well past FC_LARGE_PAGE_MIN_BYTES.
+	const int lineCount = 300000;
+	char* text1 = (char*)HeapAlloc(GetProcessHeap(), 0, (size_t)lineCount * 16);
+	char* text2 = (char*)HeapAlloc(GetProcessHeap(), 0, (size_t)lineCount * 16);
+	if (!text1 || !text2) Throw(L"alloc failed", NULL);
+	size_t length1 = 0, length2 = 0;
+	for (int i = 0; i < lineCount; i++)
+	{
+		char line[32];
+		StringCchPrintfA(line, _countof(line), "line%06d\n", i);
+		memcpy(text1 + length1, line, strlen(line));
+		length1 += strlen(line);
+		if (i % 40000 == 11)
+			StringCchPrintfA(line, _countof(line), "edit%06d\n", i);
+		memcpy(text2 + length2, line, strlen(line));
+		length2 += strlen(line);
+	}
+	TEST_PATHS tp = AllocTestPaths();
+	ConcatPath(baseDir, L"large1.txt", tp.p1);
+	ConcatPath(baseDir, L"large2.txt", tp.p2);
+	if (!WriteDataFile(tp.p1, text1, (DWORD)length1)) Throw(L"write failed", tp.p1);
+	if (!WriteDataFile(tp.p2, text2, (DWORD)length2)) Throw(L"write failed", tp.p2);
+
+	FC_STATS heapStats = { 0 };
+	DIFF_TEST_CONTEXT heapCtx = { 0 };
+	FC_CONFIG heapCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, 0, &heapCtx);
+	heapCfg.Stats = &heapStats;
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &heapCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(heapCtx.CallbackCount == 8 && heapStats.LargePageBytes == 0);
+
+	// Whether the system grants large pages or not, the differences are the same.
+	FC_SESSION* session = NULL;
+	ASSERT_TRUE(FC_SessionCreate(&session) == FC_OK);
+	for (int pass = 0; pass < 4; pass++)
+	{
+		FC_STATS stats = { 0 };
+		DIFF_TEST_CONTEXT ctx = { 0 };
+		FC_CONFIG cfg = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_LARGE_PAGES, &ctx);
+		cfg.Stats = &stats;
+		FC_RESULT result = (pass == 0)
+			? FC_CompareFilesW(tp.p1, tp.p2, &cfg)
+			: (pass == 1)
+			? FC_CompareBuffersText(text1, length1, text2, length2, &cfg)
+			: FC_SessionCompareFilesW(session, tp.p1, tp.p2, &cfg);
+		ASSERT_TRUE(result == FC_DIFFERENT);
+		ASSERT_TRUE(stats.LargePageBytes == 0 || stats.LargePageBytes >= FC_LARGE_PAGE_MIN_BYTES);
+		ASSERT_TRUE(ctx.CallbackCount == heapCtx.CallbackCount);
+		for (int b = 0; b < heapCtx.CallbackCount; b++)
+			ASSERT_TRUE(memcmp(&ctx.Blocks[b], &heapCtx.Blocks[b], sizeof(FC_DIFF_BLOCK)) == 0);
+	}
+	ASSERT_TRUE(FC_SessionClose(session) == FC_OK);
+
+	// Large pages never take the budget past its limit, and a caller's allocator takes precedence.
+	FC_STATS budgetStats = { 0 };
+	DIFF_TEST_CONTEXT budgetCtx = { 0 };
+	FC_CONFIG budgetCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_LARGE_PAGES, &budgetCtx);
+	budgetCfg.Stats = &budgetStats;
+	budgetCfg.MaxMemoryBytes = (size_t)(heapStats.PeakMemoryBytes / 4);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &budgetCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(budgetStats.PeakMemoryBytes <= budgetCfg.MaxMemoryBytes);
+	ASSERT_TRUE(budgetCtx.CallbackCount == heapCtx.CallbackCount);
+
+	COUNTING_ALLOCATOR counter = { 0 };
+	FC_STATS allocStats = { 0 };
+	DIFF_TEST_CONTEXT allocCtx = { 0 };
+	FC_CONFIG allocCfg = MakeTestConfig(FC_MODE_TEXT_ASCII, FC_LARGE_PAGES, &allocCtx);
+	allocCfg.Stats = &allocStats;
+	allocCfg.Allocator = MakeCountingAllocator(&counter);
+	ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &allocCfg) == FC_DIFFERENT);
+	ASSERT_TRUE(allocStats.LargePageBytes == 0 && counter.Live == 0);
+
+	HeapFree(GetProcessHeap(), 0, text1);
+	HeapFree(GetProcessHeap(), 0, text2);
+	FreeTestPaths(&tp);
+}
+
+static size_t CountOccurrences(_In_z_ const char* text, _In_z_ const char* needle)
+{
+	size_t count = 0;
+	for (const char* p = strstr(text, needle); p != NULL; p = strstr(p + 1, needle))
+		count++;
+	return count;
+}
+
+static void Test_Trace_WritesPhaseEvents(const WCHAR* baseDir)
+{
+	TEST_PATHS tp = AllocTestPaths();
+	WCHAR tracePath[MAX_LONG_PATH];
+	ConcatPath(baseDir, L"trace1.txt", tp.p1);
+	ConcatPath(baseDir, L"trace2.txt", tp.p2);
+	ConcatPath(baseDir, L"trace.json", tracePath);
+	WRITE_STR_FILE(tp.p1, "alpha\nbeta\ngamma\ndelta\n");
+	WRITE_STR_FILE(tp.p2, "alpha\nBETA\ngamma\ndelta\n");
+
+	FC_TRACE* trace = NULL;
+	ASSERT_TRUE(FC_TraceOpenW(L"", &trace) == FC_ERROR_INVALID_PARAM && trace == NULL);
+	ASSERT_TRUE(FC_TraceOpenW(tracePath, &trace) == FC_OK && trace != NULL);
+
+	// More pairs than one thread buffer holds, so events are also written before close.
+	const int pairCount = 60;
+	for (int i = 0; i < pairCount; i++)
+	{
+		DIFF_TEST_CONTEXT ctx = { 0 };
+		FC_CONFIG cfg = MakeTestConfig(FC_MODE_AUTO, 0, &ctx);
+		cfg.Trace = trace;
+		cfg.TracePair = (ULONGLONG)i;
+		ASSERT_TRUE(FC_CompareFilesW(tp.p1, tp.p2, &cfg) == FC_DIFFERENT);
+		ASSERT_TRUE(ctx.CallbackCount == 1);
+	}
+	ASSERT_TRUE(FC_TraceClose(trace) == FC_OK);
+	ASSERT_TRUE(FC_TraceClose(NULL) == FC_OK);
+
+	DWORD size = 0;
+	char* json = ReadTestFileAlloc(tracePath, &size);
+	ASSERT_TRUE(json != NULL);
+	ASSERT_TRUE(strncmp(json, "{\"traceEvents\":[\n", 17) == 0);
+	ASSERT_TRUE(size > 2 && strcmp(json + size - 2, "}\n") == 0);
+	ASSERT_TRUE(CountOccurrences(json, "\"name\":\"compare\"") == (size_t)pairCount);
+	ASSERT_TRUE(CountOccurrences(json, "\"name\":\"sniff\"") == 2 * (size_t)pairCount);
+	ASSERT_TRUE(CountOccurrences(json, "\"name\":\"read\"") == 2 * (size_t)pairCount);
+	ASSERT_TRUE(CountOccurrences(json, "\"name\":\"parse\",\"cat\":\"fc\",\"ph\":\"X\"") == 2 * (size_t)pairCount);
+	ASSERT_TRUE(CountOccurrences(json, "\"name\":\"chunk\"") >= (size_t)pairCount);
+	ASSERT_TRUE(CountOccurrences(json, "\"name\":\"report\"") == (size_t)pairCount);
+	ASSERT_TRUE(CountOccurrences(json, "\"name\":\"open\"") == (size_t)pairCount);
+	ASSERT_TRUE(strstr(json, "\"args\":{\"pair\":59,\"result\":1,\"file\":\"trace1.txt\"}") != NULL);
+	ASSERT_TRUE(strstr(json, "\"name\":\"read\"") != NULL && strstr(json, "\"bytes\":23") != NULL);
+
+	HeapFree(GetProcessHeap(), 0, json);
+	FreeTestPaths(&tp);
+}
+
+static void Test_Allocator_SuiteLeavesNoLiveBlocks(const WCHAR* baseDir)
+{
+	// Every MakeTestConfig comparison above ran through g_TestAllocator.
+	ASSERT_TRUE(g_TestAllocator.Allocs > 0);
+	ASSERT_TRUE(g_TestAllocator.Live == 0);
+}
+
+static BOOL ReadFileToBuffer(
+	_In_z_ const WCHAR* path,
+	_Out_writes_z_(outCap) char* outBuf,
+	_In_ DWORD outCap)
+{
+	HANDLE h = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (h == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	DWORD total = 0;
+	if (outCap > 0)
+		outBuf[0] = '\0';
+	while (outCap > 0 && total < outCap - 1)
+	{
+		DWORD bytesRead = 0;
+		char tmp[512];
+		if (!ReadFile(h, tmp, sizeof(tmp), &bytesRead, NULL))
+		{
+			CloseHandle(h);
+			return FALSE;
+		}
+		if (bytesRead == 0)
+			break;
+		DWORD toCopy = bytesRead;
+		if (toCopy > outCap - 1 - total)
+			toCopy = outCap - 1 - total;
+		CopyMemory(outBuf + total, tmp, toCopy);
+		total += toCopy;
+	}
+	if (outCap > 0)
+		outBuf[total] = '\0';
+	CloseHandle(h);
+	return TRUE;
+}
+
+static BOOL ResolveFcExePath(_Out_writes_z_(MAX_LONG_PATH) WCHAR* fcPath)
+{
+	if (!GetModuleFileNameW(NULL, fcPath, MAX_LONG_PATH))
+		return FALSE;
+
+	WCHAR* lastSlash = wcsrchr(fcPath, PATH_SEPARATOR[0]);
+	if (lastSlash == NULL)
+		return FALSE;
+	lastSlash[1] = L'\0';
+	if (FAILED(StringCchCatW(fcPath, MAX_LONG_PATH, FC_EXE_NAME)))
+		return FALSE;
+	if (GetFileAttributesW(fcPath) != INVALID_FILE_ATTRIBUTES)
+		return TRUE;
+
+	WCHAR cwd[MAX_LONG_PATH];
+	if (!GetCurrentDirectoryW(MAX_LONG_PATH, cwd))
+		return FALSE;
+
+	if (FAILED(PathCchCombine(fcPath, MAX_LONG_PATH, cwd, L"src\\x64\\Release\\fc.exe")))
+		return FALSE;
+	if (GetFileAttributesW(fcPath) != INVALID_FILE_ATTRIBUTES)
+		return TRUE;
+
+	if (FAILED(PathCchCombine(fcPath, MAX_LONG_PATH, cwd, L"x64\\Release\\fc.exe")))
+		return FALSE;
+	return GetFileAttributesW(fcPath) != INVALID_FILE_ATTRIBUTES;
+}
+
+static BOOL RunFcToOutputFileWithOptions(
+	_In_z_ const WCHAR* pattern1,
+	_In_z_ const WCHAR* pattern2,
+	_In_opt_z_ const WCHAR* options,
+	_In_z_ const WCHAR* outputPath,
+	_Out_ DWORD* exitCode)
+{
+	WCHAR fcPath[MAX_LONG_PATH];
+	if (!ResolveFcExePath(fcPath))
+		return FALSE;
+
+	WCHAR cmdLine[4096];
+	if (options != NULL && options[0] != L'\0')
+	{
+		if (FAILED(StringCchPrintfW(cmdLine, ARRAYSIZE(cmdLine),
+			L"\"%ls\" %ls \"%ls\" \"%ls\"",
+			fcPath, options, pattern1, pattern2)))
+		{
+			return FALSE;
+		}
+	}
+	else if (FAILED(StringCchPrintfW(cmdLine, ARRAYSIZE(cmdLine),
+		L"\"%ls\" \"%ls\" \"%ls\"",
+		fcPath, pattern1, pattern2)))
+	{
+		return FALSE;
+	}
+
+	SECURITY_ATTRIBUTES sa = { 0 };
+	sa.nLength = sizeof(sa);
+	sa.bInheritHandle = TRUE;
+	HANDLE outFile = CreateFileW(outputPath, GENERIC_WRITE, FILE_SHARE_READ, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (outFile == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	STARTUPINFOW si = { 0 };
+	si.cb = sizeof(si);
+	si.dwFlags = STARTF_USESTDHANDLES;
+	si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+	si.hStdOutput = outFile;
+	si.hStdError = outFile;
+
+	PROCESS_INFORMATION pi = { 0 };
+	BOOL ok = CreateProcessW(
+		fcPath,
+		cmdLine,
+		NULL,
+		NULL,
+		TRUE,
+		0,
+		NULL,
+		NULL,
+		&si,
+		&pi);
+
+	CloseHandle(outFile);
+	if (!ok)
+		return FALSE;
+
+	WaitForSingleObject(pi.hProcess, INFINITE);
+	ok = GetExitCodeProcess(pi.hProcess, exitCode);
+
+	CloseHandle(pi.hThread);
+	CloseHandle(pi.hProcess);
+	return ok;
+}
+
+static BOOL RunFcToOutputFile(
+	_In_z_ const WCHAR* pattern1,
+	_In_z_ const WCHAR* pattern2,
+	_In_z_ const WCHAR* outputPath,
+	_Out_ DWORD* exitCode)
+{
+	return RunFcToOutputFileWithOptions(pattern1, pattern2, NULL, outputPath, exitCode);
+}
+
+static BOOL RunFcToOutputFileNoOptions(
+	_In_z_ const WCHAR* pattern1,
+	_In_z_ const WCHAR* pattern2,
+	_In_z_ const WCHAR* outputPath,
+	_Out_ DWORD* exitCode)
+{
+	return RunFcToOutputFile(pattern1, pattern2, outputPath, exitCode);
+}
+
+static void BuildLongSubdirName(_In_ int index, _Out_writes_z_(32) WCHAR* out)
+{
+	if (FAILED(StringCchPrintfW(out, 32, L"seg_%02d_abcdefghijklmnop", index)))
+		Throw(L"String format fail", NULL);
+}
+
+static void EnsureLongDirectory(_In_z_ const WCHAR* baseDir, _Out_writes_z_(MAX_LONG_PATH) WCHAR* outDir)
+{
+	if (FAILED(StringCchCopyW(outDir, MAX_LONG_PATH, LONG_PATH_PREFIX)) ||
+		FAILED(StringCchCatW(outDir, MAX_LONG_PATH, baseDir)))
+	{
+		Throw(L"Path copy fail", baseDir);
+	}
+
+	for (int i = 0; i < 12; i++)
+	{
+		WCHAR seg[32];
+		BuildLongSubdirName(i, seg);
+		if (FAILED(PathCchAddBackslash(outDir, MAX_LONG_PATH)) ||
+			FAILED(StringCchCatW(outDir, MAX_LONG_PATH, seg)))
+		{
+			Throw(L"Path concat fail", seg);
+		}
+
+		if (!CreateDirectoryW(outDir, NULL))
+		{
+			DWORD err = GetLastError();
+			if (err != ERROR_ALREADY_EXISTS)
+				Throw(L"CreateDirectoryW fail", outDir);
+		}
+	}
+}
+
+static void Test_Cli_WildcardLongPathFidelity(const WCHAR* baseDir)
+{
+	WCHAR deepLeft[MAX_LONG_PATH];
+	WCHAR deepRight[MAX_LONG_PATH];
+	EnsureLongDirectory(baseDir, deepLeft);
+	EnsureLongDirectory(baseDir, deepRight);
+
+	if (FAILED(PathCchAddBackslash(deepLeft, MAX_LONG_PATH)) ||
+		FAILED(StringCchCatW(deepLeft, MAX_LONG_PATH, L"left_side")))
 	{
 		Throw(L"Path concat fail", deepLeft);
 	}
@@ -1811,9 +3842,9 @@ static void Test_Cli_WildcardLongPathFidelity(const WCHAR* baseDir)
 
 	WCHAR leftFile[MAX_LONG_PATH];
 	WCHAR rightFile[MAX_LONG_PATH];
-	if (FAILED(StringCchPrintfW(leftFile, MAX_LONG_PATH, L"%s\\paired_name.txt", deepLeft)))
+	if (FAILED(StringCchPrintfW(leftFile, MAX_LONG_PATH, L"%ls" PATH_SEPARATOR L"paired_name.txt", deepLeft)))
 		Throw(L"Path build fail", NULL);
-	if (FAILED(StringCchPrintfW(rightFile, MAX_LONG_PATH, L"%s\\paired_name.bak", deepRight)))
+	if (FAILED(StringCchPrintfW(rightFile, MAX_LONG_PATH, L"%ls" PATH_SEPARATOR L"paired_name.bak", deepRight)))
 		Throw(L"Path build fail", NULL);
 	WRITE_STR_FILE(leftFile, "same content\n");
 	WRITE_STR_FILE(rightFile, "same content\n");
@@ -1823,15 +3854,15 @@ static void Test_Cli_WildcardLongPathFidelity(const WCHAR* baseDir)
 	WCHAR pattern1Prefixed[MAX_LONG_PATH];
 	WCHAR pattern2Prefixed[MAX_LONG_PATH];
 	WCHAR outputPath[MAX_LONG_PATH];
-	const WCHAR* patternBaseLeft = (wcsncmp(deepLeft, LONG_PATH_PREFIX, 4) == 0) ? (deepLeft + 4) : deepLeft;
-	const WCHAR* patternBaseRight = (wcsncmp(deepRight, LONG_PATH_PREFIX, 4) == 0) ? (deepRight + 4) : deepRight;
-	if (FAILED(StringCchPrintfW(pattern1, MAX_LONG_PATH, L"%s\\*.txt", patternBaseLeft)))
+	const WCHAR* patternBaseLeft = (wcsncmp(deepLeft, LONG_PATH_PREFIX, ARRAYSIZE(LONG_PATH_PREFIX) - 1) == 0) ? (deepLeft + ARRAYSIZE(LONG_PATH_PREFIX) - 1) : deepLeft;
+	const WCHAR* patternBaseRight = (wcsncmp(deepRight, LONG_PATH_PREFIX, ARRAYSIZE(LONG_PATH_PREFIX) - 1) == 0) ? (deepRight + ARRAYSIZE(LONG_PATH_PREFIX) - 1) : deepRight;
+	if (FAILED(StringCchPrintfW(pattern1, MAX_LONG_PATH, L"%ls" PATH_SEPARATOR L"*.txt", patternBaseLeft)))
 		Throw(L"Pattern build fail", NULL);
-	if (FAILED(StringCchPrintfW(pattern2, MAX_LONG_PATH, L"%s\\*.bak", patternBaseRight)))
+	if (FAILED(StringCchPrintfW(pattern2, MAX_LONG_PATH, L"%ls" PATH_SEPARATOR L"*.bak", patternBaseRight)))
 		Throw(L"Pattern build fail", NULL);
-	if (FAILED(StringCchPrintfW(pattern1Prefixed, MAX_LONG_PATH, L"%s\\*.txt", deepLeft)))
+	if (FAILED(StringCchPrintfW(pattern1Prefixed, MAX_LONG_PATH, L"%ls" PATH_SEPARATOR L"*.txt", deepLeft)))
 		Throw(L"Pattern build fail", NULL);
-	if (FAILED(StringCchPrintfW(pattern2Prefixed, MAX_LONG_PATH, L"%s\\*.bak", deepRight)))
+	if (FAILED(StringCchPrintfW(pattern2Prefixed, MAX_LONG_PATH, L"%ls" PATH_SEPARATOR L"*.bak", deepRight)))
 		Throw(L"Pattern build fail", NULL);
 	if (FAILED(PathCchCombine(outputPath, MAX_LONG_PATH, baseDir, L"wildcard_longpath_output.txt")))
 		Throw(L"Combine fail", NULL);
@@ -1852,8 +3883,8 @@ static void Test_Cli_WildcardLongPathFidelity(const WCHAR* baseDir)
 	}
 	if (exitCode == 0 && strstr(output, "Comparing files ") != NULL)
 	{
-		ASSERT_TRUE(strstr(output, "seg_11_abcdefghijklmnop\\left_side\\paired_name.txt") != NULL);
-		ASSERT_TRUE(strstr(output, "seg_11_abcdefghijklmnop\\right_side\\paired_name.bak") != NULL);
+		ASSERT_TRUE(strstr(output, "seg_11_abcdefghijklmnop" PATH_SEPARATOR_A "left_side" PATH_SEPARATOR_A "paired_name.txt") != NULL);
+		ASSERT_TRUE(strstr(output, "seg_11_abcdefghijklmnop" PATH_SEPARATOR_A "right_side" PATH_SEPARATOR_A "paired_name.bak") != NULL);
 	}
 	else
 	{
@@ -1862,8 +3893,8 @@ static void Test_Cli_WildcardLongPathFidelity(const WCHAR* baseDir)
 		// long-path test data flowed through CLI output.
 		ASSERT_TRUE(exitCode != 0);
 		ASSERT_TRUE(output[0] != '\0');
-		ASSERT_TRUE(strstr(output, "seg_11_abcdefghijklmnop\\left_side\\") != NULL);
-		ASSERT_TRUE(strstr(output, "seg_11_abcdefghijklmnop\\right_side\\") != NULL);
+		ASSERT_TRUE(strstr(output, "seg_11_abcdefghijklmnop" PATH_SEPARATOR_A "left_side" PATH_SEPARATOR_A) != NULL);
+		ASSERT_TRUE(strstr(output, "seg_11_abcdefghijklmnop" PATH_SEPARATOR_A "right_side" PATH_SEPARATOR_A) != NULL);
 	}
 }
 
@@ -2208,6 +4239,308 @@ static void Test_Cli_LineOutput_AnsiExtendedBytes_NL(const WCHAR* baseDir)
 	ASSERT_TRUE(output[0] != '\0');
 }
 
+static void MakeTestDirectory(_In_z_ const WCHAR* parent, _In_z_ const WCHAR* name, _Out_writes_z_(MAX_LONG_PATH) WCHAR* out)
+{
+	if (FAILED(PathCchCombine(out, MAX_LONG_PATH, parent, name)))
+		Throw(L"Combine fail", name);
+	if (!CreateDirectoryW(out, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+		Throw(L"CreateDirectoryW fail", out);
+}
+
+static void Test_Cli_TreeMode_ReportsAddedRemovedAndChanged(const WCHAR* baseDir)
+{
+	WCHAR treeRoot[MAX_LONG_PATH];
+	WCHAR dirLeft[MAX_LONG_PATH];
+	WCHAR dirRight[MAX_LONG_PATH];
+	WCHAR subLeft[MAX_LONG_PATH];
+	WCHAR subRight[MAX_LONG_PATH];
+	WCHAR onlyLeftDir[MAX_LONG_PATH];
+	MakeTestDirectory(baseDir, L"tree_cmp", treeRoot);
+	MakeTestDirectory(treeRoot, L"left", dirLeft);
+	MakeTestDirectory(treeRoot, L"right", dirRight);
+	MakeTestDirectory(dirLeft, L"sub", subLeft);
+	MakeTestDirectory(dirRight, L"sub", subRight);
+	MakeTestDirectory(dirLeft, L"gone", onlyLeftDir);
+
+	WCHAR path[MAX_LONG_PATH];
+	ConcatPath(dirLeft, L"same.txt", path);
+	WRITE_STR_FILE(path, "same\n");
+	ConcatPath(dirRight, L"same.txt", path);
+	WRITE_STR_FILE(path, "same\n");
+	ConcatPath(subLeft, L"changed.txt", path);
+	WRITE_STR_FILE(path, "old line\n");
+	ConcatPath(subRight, L"changed.txt", path);
+	WRITE_STR_FILE(path, "new line\n");
+	ConcatPath(onlyLeftDir, L"inner.txt", path);
+	WRITE_STR_FILE(path, "removed\n");
+	ConcatPath(subRight, L"added.txt", path);
+	WRITE_STR_FILE(path, "added\n");
+
+	WCHAR outputPath[MAX_LONG_PATH];
+	if (FAILED(PathCchCombine(outputPath, MAX_LONG_PATH, baseDir, L"tree_cmp_output.txt"))) Throw(L"Combine fail", NULL);
+	DWORD exitCode = 0;
+	char output[8192];
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(dirLeft, dirRight, L"/TREE", outputPath, &exitCode));
+	ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+	ASSERT_TRUE(exitCode == 1);
+	ASSERT_TRUE(strstr(output, "Comparing directories ") != NULL);
+	ASSERT_TRUE(strstr(output, ": gone" PATH_SEPARATOR_A) != NULL);
+	ASSERT_TRUE(strstr(output, ": sub" PATH_SEPARATOR_A "added.txt") != NULL);
+	ASSERT_TRUE(strstr(output, "new line") != NULL);
+	ASSERT_TRUE(strstr(output, "FC: 2 file(s) compared, 1 different, 1 only in first tree, 1 only in second tree") != NULL);
+
+	// Output is ordered by relative path, independent of worker scheduling.
+	const char* gone = strstr(output, ": gone" PATH_SEPARATOR_A);
+	const char* same = strstr(output, "same.txt");
+	const char* changed = strstr(output, "changed.txt");
+	ASSERT_TRUE(gone != NULL && same != NULL && changed != NULL);
+	ASSERT_TRUE(gone < same && same < changed);
+}
+
+static void Test_Cli_TreeMode_QuietBinaryFlagsSizeMismatch(const WCHAR* baseDir)
+{
+	WCHAR treeRoot[MAX_LONG_PATH];
+	WCHAR dirLeft[MAX_LONG_PATH];
+	WCHAR dirRight[MAX_LONG_PATH];
+	MakeTestDirectory(baseDir, L"tree_quiet", treeRoot);
+	MakeTestDirectory(treeRoot, L"left", dirLeft);
+	MakeTestDirectory(treeRoot, L"right", dirRight);
+
+	WCHAR path[MAX_LONG_PATH];
+	ConcatPath(dirLeft, L"equal.bin", path);
+	WRITE_STR_FILE(path, "0123456789");
+	ConcatPath(dirRight, L"equal.bin", path);
+	WRITE_STR_FILE(path, "0123456789");
+	ConcatPath(dirLeft, L"longer.bin", path);
+	WRITE_STR_FILE(path, "0123456789");
+	ConcatPath(dirRight, L"longer.bin", path);
+	WRITE_STR_FILE(path, "0123456789abcdef");
+
+	WCHAR outputPath[MAX_LONG_PATH];
+	if (FAILED(PathCchCombine(outputPath, MAX_LONG_PATH, baseDir, L"tree_quiet_output.txt"))) Throw(L"Combine fail", NULL);
+	DWORD exitCode = 0;
+	char output[8192];
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(dirLeft, dirRight, L"/TREE /Q /B", outputPath, &exitCode));
+	ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+	ASSERT_TRUE(exitCode == 1);
+	ASSERT_TRUE(strstr(output, "FC: files differ (size): longer.bin") != NULL);
+	ASSERT_TRUE(strstr(output, "equal.bin") == NULL);
+	ASSERT_TRUE(strstr(output, "Comparing files ") == NULL);
+
+	// Identical trees exit 0.
+	ConcatPath(dirRight, L"longer.bin", path);
+	WRITE_STR_FILE(path, "0123456789");
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(dirLeft, dirRight, L"/TREE /Q /B", outputPath, &exitCode));
+	ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+	ASSERT_TRUE(exitCode == 0);
+	ASSERT_TRUE(strstr(output, "FC: 2 file(s) compared, 0 different") != NULL);
+}
+
+static void Test_Cli_TreeMode_MatchesNamesByPlatformCase(const WCHAR* baseDir)
+{
+	WCHAR treeRoot[MAX_LONG_PATH];
+	WCHAR dirLeft[MAX_LONG_PATH];
+	WCHAR dirRight[MAX_LONG_PATH];
+	MakeTestDirectory(baseDir, L"tree_case", treeRoot);
+	MakeTestDirectory(treeRoot, L"left", dirLeft);
+	MakeTestDirectory(treeRoot, L"right", dirRight);
+
+	WCHAR path[MAX_LONG_PATH];
+	ConcatPath(dirLeft, L"Readme", path);
+	WRITE_STR_FILE(path, "same\n");
+	ConcatPath(dirRight, L"Readme", path);
+	WRITE_STR_FILE(path, "same\n");
+
+	WCHAR outputPath[MAX_LONG_PATH];
+	if (FAILED(PathCchCombine(outputPath, MAX_LONG_PATH, baseDir, L"tree_case_output.txt"))) Throw(L"Combine fail", NULL);
+	DWORD exitCode = 0;
+	char output[8192];
+#ifdef _WIN32
+	// Names match case-insensitively; each side is opened under its own spelling.
+	WCHAR subLeft[MAX_LONG_PATH];
+	WCHAR subRight[MAX_LONG_PATH];
+	MakeTestDirectory(dirLeft, L"Docs", subLeft);
+	MakeTestDirectory(dirRight, L"docs", subRight);
+	ConcatPath(subLeft, L"notes.txt", path);
+	WRITE_STR_FILE(path, "notes\n");
+	ConcatPath(subRight, L"NOTES.txt", path);
+	WRITE_STR_FILE(path, "notes\n");
+
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(dirLeft, dirRight, L"/TREE", outputPath, &exitCode));
+	ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+	ASSERT_TRUE(exitCode == 0);
+	ASSERT_TRUE(strstr(output, "docs" PATH_SEPARATOR_A "NOTES.txt") != NULL);
+	ASSERT_TRUE(strstr(output, "FC: 2 file(s) compared, 0 different") != NULL);
+#else
+	// "Readme" and "README" are different files; only the exact name pairs up.
+	ConcatPath(dirLeft, L"README", path);
+	WRITE_STR_FILE(path, "other\n");
+
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(dirLeft, dirRight, L"/TREE", outputPath, &exitCode));
+	ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+	ASSERT_TRUE(exitCode == 1);
+	ASSERT_TRUE(strstr(output, ": README\n") != NULL);
+	ASSERT_TRUE(strstr(output, ": Readme\n") == NULL);
+	ASSERT_TRUE(strstr(output, "Error during comparison") == NULL);
+	ASSERT_TRUE(strstr(output, "FC: 1 file(s) compared, 0 different, 1 only in first tree, 0 only in second tree") != NULL);
+#endif
+}
+
+static void Test_Cli_CacheSwitchCreatesCacheFile(const WCHAR* baseDir)
+{
+	WCHAR file1[MAX_LONG_PATH];
+	WCHAR file2[MAX_LONG_PATH];
+	WCHAR cachePath[MAX_LONG_PATH];
+	WCHAR options[MAX_LONG_PATH + 16];
+	if (FAILED(PathCchCombine(file1, MAX_LONG_PATH, baseDir, L"cli_cache1.txt"))) Throw(L"Combine fail", NULL);
+	if (FAILED(PathCchCombine(file2, MAX_LONG_PATH, baseDir, L"cli_cache2.txt"))) Throw(L"Combine fail", NULL);
+	if (FAILED(PathCchCombine(cachePath, MAX_LONG_PATH, baseDir, L"cli_cache.fccache"))) Throw(L"Combine fail", NULL);
+	DeleteFileW(cachePath);
+	WRITE_STR_FILE(file1, "cached\n");
+	WRITE_STR_FILE(file2, "cached\n");
+	if (FAILED(StringCchPrintfW(options, ARRAYSIZE(options), L"\"/CACHE:%ls\"", cachePath))) Throw(L"Format fail", NULL);
+
+	WCHAR outputPath[MAX_LONG_PATH];
+	if (FAILED(PathCchCombine(outputPath, MAX_LONG_PATH, baseDir, L"cli_cache_output.txt"))) Throw(L"Combine fail", NULL);
+	DWORD exitCode = 0;
+	char output[4096];
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_CACHE_RACY_WINDOW_OVERRIDE", L"0"));
+	for (int run = 0; run < 2; run++)
+	{
+		ASSERT_TRUE(RunFcToOutputFileWithOptions(file1, file2, options, outputPath, &exitCode));
+		ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+		ASSERT_TRUE(exitCode == 0);
+		ASSERT_TRUE(strstr(output, "FC: no differences encountered") != NULL);
+		ASSERT_TRUE(GetFileAttributesW(cachePath) != INVALID_FILE_ATTRIBUTES);
+	}
+
+	// /CACHE: must not be mistaken for /C.
+	WRITE_STR_FILE(file2, "CACHED\n");
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(file1, file2, options, outputPath, &exitCode));
+	ASSERT_TRUE(exitCode == 1);
+	ASSERT_TRUE(SetEnvironmentVariableW(L"FC_CACHE_RACY_WINDOW_OVERRIDE", NULL));
+}
+
+static void Test_Cli_StatsSwitchPrintsCounters(const WCHAR* baseDir)
+{
+	WCHAR file1[MAX_LONG_PATH];
+	WCHAR file2[MAX_LONG_PATH];
+	WCHAR outputPath[MAX_LONG_PATH];
+	if (FAILED(PathCchCombine(file1, MAX_LONG_PATH, baseDir, L"cli_stats1.txt"))) Throw(L"Combine fail", NULL);
+	if (FAILED(PathCchCombine(file2, MAX_LONG_PATH, baseDir, L"cli_stats2.txt"))) Throw(L"Combine fail", NULL);
+	if (FAILED(PathCchCombine(outputPath, MAX_LONG_PATH, baseDir, L"cli_stats_output.txt"))) Throw(L"Combine fail", NULL);
+	WRITE_STR_FILE(file1, "one\ntwo\nthree\n");
+	WRITE_STR_FILE(file2, "one\n2\nthree\n");
+
+	DWORD exitCode = 0;
+	char output[4096];
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(file1, file2, L"/STATS", outputPath, &exitCode));
+	ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+	ASSERT_TRUE(exitCode == 1);
+	ASSERT_TRUE(strstr(output, "FC statistics:") != NULL);
+	ASSERT_TRUE(strstr(output, "  lines parsed               6\n") != NULL);
+	ASSERT_TRUE(strstr(output, "  bytes read                26\n") != NULL);
+
+	// Without the switch nothing is printed.
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(file1, file2, NULL, outputPath, &exitCode));
+	ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+	ASSERT_TRUE(strstr(output, "FC statistics:") == NULL);
+}
+
+static void Test_Cli_LcsWarnFiresAtDefaultWindow(const WCHAR* baseDir)
+{
+	WCHAR file1[MAX_LONG_PATH];
+	WCHAR file2[MAX_LONG_PATH];
+	WCHAR outputPath[MAX_LONG_PATH];
+	if (FAILED(PathCchCombine(file1, MAX_LONG_PATH, baseDir, L"cli_lcswarn1.txt"))) Throw(L"Combine fail", NULL);
+	if (FAILED(PathCchCombine(file2, MAX_LONG_PATH, baseDir, L"cli_lcswarn2.txt"))) Throw(L"Combine fail", NULL);
+	if (FAILED(PathCchCombine(outputPath, MAX_LONG_PATH, baseDir, L"cli_lcswarn_output.txt"))) Throw(L"Combine fail", NULL);
+
+	// Under the default /LB100 no match list can reach 256 lines, and the equal
+	// chunks around the change never reach the LCS.
+	const int lineCount = 20000;
+	char* text = (char*)HeapAlloc(GetProcessHeap(), 0, (size_t)lineCount * 2);
+	if (!text) Throw(L"alloc failed", NULL);
+	for (int i = 0; i < lineCount; i++)
+	{
+		text[i * 2] = '}';
+		text[i * 2 + 1] = '\n';
+	}
+	ASSERT_TRUE(WriteDataFile(file1, text, (DWORD)lineCount * 2));
+	text[10000 * 2] = 'x';
+	ASSERT_TRUE(WriteDataFile(file2, text, (DWORD)lineCount * 2));
+	HeapFree(GetProcessHeap(), 0, text);
+
+	DWORD exitCode = 0;
+	char output[4096];
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(file1, file2, L"/LCSWARN", outputPath, &exitCode));
+	ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+	ASSERT_TRUE(exitCode == 1);
+	ASSERT_TRUE(strstr(output, "FC: warning:") != NULL);
+	ASSERT_TRUE(strstr(output, "the line \"}\" had up to") != NULL);
+}
+
+static void Test_Cli_InlineMarksChangedCharacters(const WCHAR* baseDir)
+{
+	WCHAR file1[MAX_LONG_PATH];
+	WCHAR file2[MAX_LONG_PATH];
+	WCHAR outputPath[MAX_LONG_PATH];
+	if (FAILED(PathCchCombine(file1, MAX_LONG_PATH, baseDir, L"cli_inline1.txt"))) Throw(L"Combine fail", NULL);
+	if (FAILED(PathCchCombine(file2, MAX_LONG_PATH, baseDir, L"cli_inline2.txt"))) Throw(L"Combine fail", NULL);
+	if (FAILED(PathCchCombine(outputPath, MAX_LONG_PATH, baseDir, L"cli_inline_output.txt"))) Throw(L"Combine fail", NULL);
+	WRITE_STR_FILE(file1, "same\nvalue = 10\n");
+	WRITE_STR_FILE(file2, "same\nvalue = 12\n");
+
+	DWORD exitCode = 0;
+	char output[4096];
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(file1, file2, L"/INLINE /N", outputPath, &exitCode));
+	ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+	ASSERT_TRUE(exitCode == 1);
+	ASSERT_TRUE(strstr(output, "    2:  value = 10\n                 ^\n") != NULL);
+}
+
+static void Test_Cli_ChunkedDiffPrintsLinesPastFirstChunk(const WCHAR* baseDir)
+{
+	WCHAR file1[MAX_LONG_PATH];
+	WCHAR file2[MAX_LONG_PATH];
+	WCHAR outputPath[MAX_LONG_PATH];
+	if (FAILED(PathCchCombine(file1, MAX_LONG_PATH, baseDir, L"cli_chunked1.txt"))) Throw(L"Combine fail", NULL);
+	if (FAILED(PathCchCombine(file2, MAX_LONG_PATH, baseDir, L"cli_chunked2.txt"))) Throw(L"Combine fail", NULL);
+	if (FAILED(PathCchCombine(outputPath, MAX_LONG_PATH, baseDir, L"cli_chunked_output.txt"))) Throw(L"Combine fail", NULL);
+
+	// The change sits far past the first comparison chunk; its block indices are
+	// absolute while the chunk's line buffers are not.
+	const int lineCount = 300000;
+	const size_t cap = (size_t)lineCount * 16;
+	char* text = (char*)HeapAlloc(GetProcessHeap(), 0, cap);
+	if (!text) Throw(L"alloc failed", NULL);
+	size_t length = 0;
+	for (int i = 0; i < lineCount; i++)
+	{
+		char line[32];
+		StringCchPrintfA(line, _countof(line), "line%06d\n", i);
+		memcpy(text + length, line, strlen(line));
+		length += strlen(line);
+	}
+	ASSERT_TRUE(WriteDataFile(file1, text, (DWORD)length));
+	memcpy(text + (size_t)250000 * 11, "lime", 4);
+	ASSERT_TRUE(WriteDataFile(file2, text, (DWORD)length));
+	HeapFree(GetProcessHeap(), 0, text);
+
+	DWORD exitCode = 0;
+	char output[4096];
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(file1, file2, L"/N", outputPath, &exitCode));
+	ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+	ASSERT_TRUE(exitCode == 1);
+	ASSERT_TRUE(strstr(output, "250001:  line250000\n") != NULL);
+	ASSERT_TRUE(strstr(output, "250001:  lime250000\n") != NULL);
+
+	ASSERT_TRUE(RunFcToOutputFileWithOptions(file1, file2, L"/INLINE", outputPath, &exitCode));
+	ASSERT_TRUE(ReadFileToBuffer(outputPath, output, ARRAYSIZE(output)));
+	ASSERT_TRUE(exitCode == 1);
+	ASSERT_TRUE(strstr(output, "lime250000\n  ^\n") != NULL);
+}
+
 int wmain(void)
 {
 	WCHAR tempDir[MAX_LONG_PATH]; DWORD len = GetTempPathW(MAX_LONG_PATH, tempDir);
@@ -2241,8 +4574,12 @@ int wmain(void)
 	Test_ErrorNullPathPointer(testDir);
 	Test_ErrorNullConfigPointer(testDir);
 	Test_ErrorNonExistentFile(testDir);
+#ifdef _WIN32
 	Test_ErrorReservedDeviceName(testDir);
 	Test_ErrorRawDevicePath(testDir);
+#else
+	Test_ErrorDeviceFile(testDir);
+#endif
 	Test_ErrorEmptyPath(testDir);
 	Test_ErrorNullOutputCallback(testDir);
 	Test_EmptyVsEmpty(testDir);
@@ -2253,8 +4590,10 @@ int wmain(void)
 	Test_WhitespaceOnlyFile(testDir);
 	Test_ForwardSlashesInPath(testDir);
 	Test_RelativePathTraversal(testDir);
+#ifdef _WIN32
 	Test_TrailingDotInPath(testDir);
 	Test_AlternateDataStream(testDir);
+#endif
 	Test_CompareFileToItself(testDir);
 	Test_InvalidMode(testDir);
 	Test_StructuredOutput_Deletion(testDir);
@@ -2283,6 +4622,38 @@ int wmain(void)
 	Test_BinaryStreamThresholdOverride_Different(testDir);
 	Test_Regression_AutoDetect_TextContent_IsText(testDir);
 	Test_Regression_LBn_WindowLimitsMatch(testDir);
+	Test_Cache_UnchangedPairAnsweredFromCache(testDir);
+	Test_Cache_RestoredWriteTimeStillInvalidates(testDir);
+	Test_Cache_CorruptFileAndSizeBound(testDir);
+	Test_Buffers_TextDiffMatchesFileKernel(testDir);
+	Test_Buffers_BinaryAndAutoDispatch(testDir);
+	Test_Buffers_InvalidParams(testDir);
+	Test_Session_ReusedAcrossComparisons(testDir);
+	Test_Session_RejectsReentryAndNull(testDir);
+	Test_Progress_ReportsEachPhaseToCompletion(testDir);
+	Test_Progress_CancelStopsTextAndBinary(testDir);
+	Test_Iterator_MatchesCallbackBlocks(testDir);
+	Test_Iterator_EmptySideYieldsBlock(testDir);
+	Test_Iterator_BinaryBlocksAndInvalidParams(testDir);
+	Test_Allocator_RoutesWorkingMemory(testDir);
+	Test_Allocator_FailureAtEachCallIsClean(testDir);
+	Test_Equal_AgreesWithCompare(testDir);
+	Test_Equal_StreamsAcrossWindowsAndStopsEarly(testDir);
+	Test_Merge3_ClassifiesRegionsAndWritesMerge(testDir);
+	Test_Merge3_LargeInputsAndInvalidParams(testDir);
+	Test_DiffState_EditsMatchFreshComparison(testDir);
+	Test_DiffState_EditCostAndInvalidParams(testDir);
+	Test_Refine_SpansOfChangedLines(testDir);
+	Test_Refine_BudgetAndInvalidParams(testDir);
+	Test_Reference_MatchesPairwiseComparison(testDir);
+	Test_Reference_RepeatedLinesMatchPairwise(testDir);
+	Test_Reference_ConcurrentComparesAndInvalidParams(testDir);
+	Test_Stats_TextCountersAccumulate(testDir);
+	Test_Stats_BinaryPaths(testDir);
+	Test_Stats_MatchListDiagnostics(testDir);
+	Test_Budget_TextStaysWithinBudget(testDir);
+	Test_LargePages_SameResultsAsHeap(testDir);
+	Test_Trace_WritesPhaseEvents(testDir);
 	Test_Cli_WildcardLongPathFidelity(testDir);
 	Test_Cli_DualWildcardDisjointStems(testDir);
 	Test_Cli_DualWildcardPartialStemOverlap(testDir);
@@ -2291,6 +4662,15 @@ int wmain(void)
 	Test_Cli_WildcardAllocFailureOnGrowth(testDir);
 	Test_Cli_LineOutput_Utf8Multibyte_NU(testDir);
 	Test_Cli_LineOutput_AnsiExtendedBytes_NL(testDir);
+	Test_Cli_TreeMode_ReportsAddedRemovedAndChanged(testDir);
+	Test_Cli_TreeMode_QuietBinaryFlagsSizeMismatch(testDir);
+	Test_Cli_TreeMode_MatchesNamesByPlatformCase(testDir);
+	Test_Cli_CacheSwitchCreatesCacheFile(testDir);
+	Test_Cli_InlineMarksChangedCharacters(testDir);
+	Test_Cli_ChunkedDiffPrintsLinesPastFirstChunk(testDir);
+	Test_Cli_StatsSwitchPrintsCounters(testDir);
+	Test_Cli_LcsWarnFiresAtDefaultWindow(testDir);
+	Test_Allocator_SuiteLeavesNoLiveBlocks(testDir);
 
 	HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
 	WriteW(hConsole, L"\n\n");
@@ -2318,7 +4698,7 @@ int wmain(void)
 		for (int i = 0; i < g_FailureCount; ++i) {
 			WCHAR failureMsg[1024];
 			swprintf_s(failureMsg, sizeof(failureMsg) / sizeof(WCHAR),
-				L"[%d/%d] %s\n  File: %s (Line %d)\n  Assertion: %s\n\n",
+				L"[%d/%d] %ls\n  File: %ls (Line %d)\n  Assertion: %ls\n\n",
 				i + 1, g_FailureCount,
 				g_Failures[i].FunctionName,
 				g_Failures[i].FileName,